@@ -29,43 +29,381 @@
 #define MAX_COMM_LEN 16
 
 /**
- *  Migration event captured from sched_migrate_task tracepoint.
+ *  Number of CPUs covered by the cpu_core_types map.
+ */
+#define MAX_TRACKED_CPUS 1024
+
+/**
+ *  Keys into the migration_config array map.
+ */
+#define CONFIG_TARGET_PID 0
+#define CONFIG_TOPOLOGY_GENERATION 1
+#define CONFIG_RING_SHARDS 2
+#define CONFIG_SAMPLE_RATE 3
+#define CONFIG_THREAD_RATE 4
+#define CONFIG_THREAD_BURST 5
+#define CONFIG_CLOCK_SOURCE 6
+#define CONFIG_MAX_ENTRIES 7
+
+/**
+ *  Number of processes that can have their own sampling rate.
+ */
+#define MAX_SAMPLED_TGIDS 1024
+
+/**
+ *  Largest sampling rate; also bounded by the width of sample_weight.
+ */
+#define MAX_SAMPLE_RATE 65535
+
+/**
+ *  Maximum number of ring buffers in event_shards.
  *
- *  This structure is written by the eBPF program and read by userspace
- *  via the ring buffer. Fields are ordered to minimize padding.
+ *  With CONFIG_RING_SHARDS set to N > 0, CPU c writes to shard c % N
+ *  instead of the shared events ring.
  */
-struct migration_event
+#define MAX_RING_SHARDS 256
+
+/**
+ *  Size in bytes of each ring buffer in event_shards (power of two).
+ */
+#define RING_SHARD_BYTES (64 * 1024)
+
+/**
+ *  Core type values stored in cpu_core_types.
+ *
+ *  These must match core::CoreType in types.hpp.
+ */
+#define CORE_TYPE_UNKNOWN 0
+#define CORE_TYPE_PCORE 1
+#define CORE_TYPE_ECORE 2
+
+/**
+ *  Clock values stored at CONFIG_CLOCK_SOURCE.
+ *
+ *  These must match core::ClockSource in clock.hpp.
+ */
+#define CLOCK_SOURCE_MONOTONIC 0
+#define CLOCK_SOURCE_BOOTTIME 1
+
+/**
+ *  Record types written to the ring buffers (record_header.type).
+ */
+#define RECORD_MIGRATION 1
+#define RECORD_SUPPRESSED 2
+#define RECORD_THREAD_IDENTITY 3
+#define RECORD_THREAD_LIFECYCLE 4
+
+/**
+ *  Lifecycle transitions reported in thread_lifecycle_record.kind.
+ *
+ *  These must match core::ThreadLifecycleKind in events.hpp.
+ */
+#define THREAD_EVENT_FORK 1
+#define THREAD_EVENT_EXEC 2
+#define THREAD_EVENT_EXIT 3
+#define THREAD_EVENT_RENAME 4
+
+/**
+ *  Layout of migration_record.src and .dst: the CPU ID in the low bits
+ *  and its CORE_TYPE_* value in the two bits above.
+ */
+#define RECORD_CPU_BITS 14
+#define RECORD_CPU_MASK ((1U << RECORD_CPU_BITS) - 1)
+
+/**
+ *  Common header at the start of every ring buffer record.
+ */
+struct record_header
+{
+    /**
+     *  RECORD_* value identifying the record layout.
+     */
+    __u16 type;
+
+    /**
+     *  Size of the whole record in bytes, so unknown types can be skipped.
+     */
+    __u16 size;
+};
+
+/**
+ *  Migration captured from the sched_migrate_task tracepoint.
+ *
+ *  Kept to 24 bytes, so a ring holds twice as many migrations as it
+ *  would with the process ID and command name inline. Those are sent once
+ *  per thread in a thread_identity_record, ahead of the thread's first
+ *  migration record and again after a rename.
+ */
+struct migration_record
 {
     /**
-     *  Timestamp when the migration occurred (nanoseconds since boot).
-     *  Obtained via bpf_ktime_get_ns().
+     *  Record header; type is RECORD_MIGRATION.
+     */
+    struct record_header header;
+
+    /**
+     *  Thread ID of the migrated task.
+     */
+    __u32 tid;
+
+    /**
+     *  Timestamp when the migration occurred, in nanoseconds on the clock
+     *  selected by CONFIG_CLOCK_SOURCE.
      */
     __u64 timestamp_ns;
 
     /**
-     *  Process ID of the migrated task.
+     *  Source CPU and its core type (see RECORD_CPU_BITS).
+     */
+    __u16 src;
+
+    /**
+     *  Destination CPU and its core type (see RECORD_CPU_BITS).
+     */
+    __u16 dst;
+
+    /**
+     *  Sampling rate N in effect when captured: this event stands for N
+     *  migrations. 1 when every event is kept.
+     */
+    __u16 sample_weight;
+
+    /**
+     *  Low 16 bits of the topology generation read from migration_config
+     *  when captured; userspace restores the rest.
+     */
+    __u16 topology_generation;
+};
+
+/**
+ *  Process and command name of a thread.
+ *
+ *  Written before a thread's migration records when userspace has not
+ *  been told about the thread yet, or its name changed.
+ */
+struct thread_identity_record
+{
+    /**
+     *  Record header; type is RECORD_THREAD_IDENTITY.
+     */
+    struct record_header header;
+
+    /**
+     *  Thread ID.
+     */
+    __u32 tid;
+
+    /**
+     *  Process ID the thread belongs to.
      */
     __u32 pid;
 
     /**
-     *  Thread ID of the migrated task.
+     *  Explicit padding; always zero.
+     */
+    __u32 reserved;
+
+    /**
+     *  Command name of the thread (may be truncated).
+     */
+    char comm[MAX_COMM_LEN];
+};
+
+/**
+ *  A traced thread was created, ran a new program, exited or was renamed.
+ *
+ *  Thread IDs are reused over long captures; the start time tells the
+ *  threads that shared one apart, and the exit lets userspace drop what
+ *  it kept for the thread. Lifecycle records are never sampled or rate
+ *  limited.
+ */
+struct thread_lifecycle_record
+{
+    /**
+     *  Record header; type is RECORD_THREAD_LIFECYCLE.
+     */
+    struct record_header header;
+
+    /**
+     *  Thread ID.
+     */
+    __u32 tid;
+
+    /**
+     *  Process ID the thread belongs to.
+     */
+    __u32 pid;
+
+    /**
+     *  THREAD_EVENT_* value.
+     */
+    __u32 kind;
+
+    /**
+     *  Time of the transition, on the CONFIG_CLOCK_SOURCE clock.
+     */
+    __u64 timestamp_ns;
+
+    /**
+     *  Time the thread was created, on the CONFIG_CLOCK_SOURCE clock.
+     */
+    __u64 start_time_ns;
+
+    /**
+     *  Command name of the thread after the transition (may be truncated).
+     */
+    char comm[MAX_COMM_LEN];
+};
+
+/**
+ *  Count of migrations a thread had suppressed by its token bucket.
+ *
+ *  Emitted just before the thread's next admitted migration after a
+ *  suppressed stretch, which is still streamed; suppressed threads cost
+ *  one extra record per stretch.
+ */
+struct suppressed_record
+{
+    /**
+     *  Record header; type is RECORD_SUPPRESSED.
+     */
+    struct record_header header;
+
+    /**
+     *  Thread ID of the rate-limited thread.
+     */
+    __u32 tid;
+
+    /**
+     *  Time the record was written, on the CONFIG_CLOCK_SOURCE clock.
+     */
+    __u64 timestamp_ns;
+
+    /**
+     *  Timestamp of the first suppressed migration in this stretch.
+     */
+    __u64 first_suppressed_ns;
+
+    /**
+     *  Number of migrations suppressed since first_suppressed_ns.
+     */
+    __u64 suppressed;
+
+    /**
+     *  Process ID of the rate-limited thread.
+     */
+    __u32 pid;
+
+    /**
+     *  Explicit padding; always zero.
+     */
+    __u32 reserved;
+};
+
+/**
+ *  Bits of thread_state.flags.
+ */
+#define THREAD_BUCKET_READY (1U << 0) /* tokens and last_refill_ns are set */
+#define THREAD_COMM_SENT (1U << 1)    /* comm was sent in an identity record */
+
+/**
+ *  Per-thread state kept in task-local storage.
+ *
+ *  The storage is created on a thread's first traced migration and freed
+ *  with the thread. The dump_thread_states iterator writes these records
+ *  back to back.
+ */
+struct thread_state
+{
+    /**
+     *  Available tokens in units of 1e-9 tokens (one event costs 1e9).
+     */
+    __u64 tokens;
+
+    /**
+     *  Time tokens were last added.
+     */
+    __u64 last_refill_ns;
+
+    /**
+     *  Migrations suppressed and not yet reported.
+     */
+    __u64 suppressed;
+
+    /**
+     *  Timestamp of the first unreported suppressed migration.
+     */
+    __u64 first_suppressed_ns;
+
+    /**
+     *  Time of the thread's last migration, kept or not.
+     */
+    __u64 last_migration_ns;
+
+    /**
+     *  Process ID of the thread.
+     */
+    __u32 pid;
+
+    /**
+     *  Thread ID of the thread.
      */
     __u32 tid;
 
     /**
-     *  Source CPU ID (where the task was running before migration).
+     *  CPU the thread last migrated to.
+     */
+    __u32 last_cpu;
+
+    /**
+     *  Phase annotation written by userspace; 0 when unset.
+     */
+    __u32 phase;
+
+    /**
+     *  THREAD_* bits.
      */
-    __u32 src_cpu;
+    __u32 flags;
 
     /**
-     *  Destination CPU ID (where the task is running after migration).
+     *  Explicit padding; always zero.
      */
-    __u32 dst_cpu;
+    __u32 reserved;
 
     /**
-     *  Command name of the migrated task (may be truncated).
+     *  Command name last sent in an identity record.
      */
     char comm[MAX_COMM_LEN];
 };
 
+/**
+ *  Threads per struct thread_activity_block.
+ */
+#define ACTIVITY_BLOCK_THREADS 64
+
+/**
+ *  Blocks in the thread_activity map; covers thread IDs up to the
+ *  largest pid_max (4194304).
+ */
+#define MAX_ACTIVITY_BLOCKS (4194304 / ACTIVITY_BLOCK_THREADS)
+
+/**
+ *  Scheduling activity of ACTIVITY_BLOCK_THREADS consecutive thread IDs.
+ *
+ *  Each thread has a byte of its own, so a store needs no atomic
+ *  read-modify-write; userspace clears ran[] when it checks a thread.
+ */
+struct thread_activity_block
+{
+    /**
+     *  Set when the thread was switched out since userspace last cleared it.
+     */
+    __u8 ran[ACTIVITY_BLOCK_THREADS];
+
+    /**
+     *  Non-zero while the thread is on a CPU.
+     */
+    __u8 on_cpu[ACTIVITY_BLOCK_THREADS];
+};
+
 #endif /* THREVEAL_BPF_COMMON_H_ */
@@ -4,10 +4,21 @@
  *
  *  eBPF program for tracking scheduler migration events.
  *
- *  This program attaches to the sched:sched_migrate_task tracepoint to capture
+ *  This program attaches to the sched_migrate_task tracepoint to capture
  *  thread migrations between CPUs. Events are sent to userspace via a ring
  *  buffer for correlation with PMU counter data.
  *
+ *  The handlers are BTF-typed tracepoints (tp_btf). Per-thread state
+ *  lives in task-local storage (Linux 5.11+) and is read back through
+ *  task iterators; every kernel with task storage also has tp_btf, so
+ *  the object carries no raw_tp or classic tp fallback.
+ *
+ *  The thread's fork, exec, exit and rename are reported too, so
+ *  userspace can tell threads that reused a thread ID apart and drop
+ *  what it kept for threads that are gone.
+ *  Optionally, a sched_switch handler records which threads ran, so
+ *  userspace can skip reading the counters of idle threads.
+ *
  *  Compilation: clang -g -O2 -target bpf -D__TARGET_ARCH_x86 -c migration_tracker.bpf.c
  */
 
@@ -22,6 +33,8 @@
 /* Shared data structures with userspace (__BPF__ is auto-defined by clang) */
 #include "bpf_common.h"
 
+#define NSEC_PER_SEC 1000000000ULL
+
 /**
  *  Ring buffer for sending migration events to userspace.
  *
@@ -39,6 +52,44 @@ struct
     __uint(max_entries, 256 * 1024);
 } events SEC(".maps");
 
+/**
+ *  Template for the per-shard ring buffers created by userspace.
+ */
+struct ring_shard
+{
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, RING_SHARD_BYTES);
+};
+
+/**
+ *  Per-CPU ring buffers, used when CONFIG_RING_SHARDS is non-zero.
+ *
+ *  Every ringbuf reserve takes the ring's spinlock, so a single shared
+ *  ring serializes all CPUs during migration storms. Sharding by CPU
+ *  keeps each producer on its own lock; userspace merges the shards back
+ *  into timestamp order.
+ */
+struct
+{
+    __uint(type, BPF_MAP_TYPE_ARRAY_OF_MAPS);
+    __uint(max_entries, MAX_RING_SHARDS);
+    __type(key, __u32);
+    __array(values, struct ring_shard);
+} event_shards SEC(".maps");
+
+/**
+ *  Events dropped because their ring was full, indexed by shard.
+ *
+ *  Slot 0 also counts drops from the shared events ring.
+ */
+struct
+{
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, MAX_RING_SHARDS);
+    __type(key, __u32);
+    __type(value, __u64);
+} ring_drops SEC(".maps");
+
 /**
  *  Optional PID filter for targeted tracing.
  *
@@ -51,77 +102,889 @@ struct
 struct
 {
     __uint(type, BPF_MAP_TYPE_ARRAY);
-    __uint(max_entries, 1);
+    __uint(max_entries, CONFIG_MAX_ENTRIES);
     __type(key, __u32);
     __type(value, __u32);
 } migration_config SEC(".maps");
 
-/* Configuration key for target PID */
-#define CONFIG_TARGET_PID 0
+/**
+ *  Per-process sampling rates overriding CONFIG_SAMPLE_RATE.
+ *
+ *  Lets one noisy process be thinned out without losing detail on the
+ *  rest of the system.
+ */
+struct
+{
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_SAMPLED_TGIDS);
+    __type(key, __u32);
+    __type(value, __u32);
+} tgid_sample_rates SEC(".maps");
 
 /**
- *  Tracepoint handler for sched:sched_migrate_task.
+ *  CPU to core type map (CORE_TYPE_* values).
  *
- *  This tracepoint fires when the scheduler moves a task from one CPU to
- *  another. The tracepoint arguments provide:
- *  - p: pointer to the task_struct being migrated
- *  - dest_cpu: the destination CPU ID
- *  - orig_cpu is available in the tracepoint context
+ *  Rewritten by userspace whenever the topology changes, followed by the
+ *  new generation in migration_config. Events read the generation before
+ *  the types, so a stamped generation is never newer than the types.
+ */
+struct
+{
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, MAX_TRACKED_CPUS);
+    __type(key, __u32);
+    __type(value, __u32);
+} cpu_core_types SEC(".maps");
+
+/**
+ *  Per-thread state, including the rate-limiting token bucket (see
+ *  admit_thread()).
  *
- *  @param      ctx  Tracepoint context containing event arguments
- *  @return     0 on success (required by BPF verifier)
+ *  Task-local storage hangs off the task_struct itself: a lookup is a
+ *  pointer chase rather than a hash, there is no capacity to run out of,
+ *  and the kernel frees a thread's state when the thread exits.
  */
-SEC("tp/sched/sched_migrate_task")
-int handle_sched_migrate_task(struct trace_event_raw_sched_migrate_task *ctx)
+struct
 {
-    struct migration_event *event;
-    __u32 key = CONFIG_TARGET_PID;
-    __u32 *target_pid;
-    __u32 pid;
-    __u32 tid;
+    __uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, int);
+    __type(value, struct thread_state);
+} thread_states SEC(".maps");
 
-    /* Get current process and thread IDs */
-    __u64 pid_tgid = bpf_get_current_pid_tgid();
-    pid = pid_tgid >> 32;        /* Upper 32 bits: TGID (process ID) */
-    tid = pid_tgid & 0xFFFFFFFF; /* Lower 32 bits: PID (thread ID) */
+/**
+ *  Per-thread "ran since last checked" flags, indexed by thread ID.
+ *
+ *  Userspace maps the array and clears a thread's ran byte when it reads
+ *  the thread's counters, so an idle thread costs no syscall. Sized to one
+ *  entry unless activity tracking is enabled.
+ */
+struct
+{
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(map_flags, BPF_F_MMAPABLE);
+    __uint(max_entries, MAX_ACTIVITY_BLOCKS);
+    __type(key, __u32);
+    __type(value, struct thread_activity_block);
+} thread_activity SEC(".maps");
 
-    /* Check if we should filter by PID */
-    target_pid = bpf_map_lookup_elem(&migration_config, &key);
-    if (target_pid && *target_pid != 0)
+/**
+ *  Looks up the core type of a CPU.
+ *
+ *  @param      cpu  Logical CPU ID.
+ *  @return     CORE_TYPE_* value, or CORE_TYPE_UNKNOWN if not mapped.
+ */
+static __always_inline __u8 lookup_core_type(__u32 cpu)
+{
+    __u32 *type = bpf_map_lookup_elem(&cpu_core_types, &cpu);
+    return type ? (__u8)*type : CORE_TYPE_UNKNOWN;
+}
+
+/**
+ *  Reads the trace clock selected by CONFIG_CLOCK_SOURCE.
+ *
+ *  bpf_ktime_get_boot_ns() keeps counting across suspend, matching
+ *  CLOCK_BOOTTIME in userspace; bpf_ktime_get_ns() matches CLOCK_MONOTONIC.
+ *
+ *  @return     The current time in nanoseconds.
+ */
+static __always_inline __u64 trace_clock_ns(void)
+{
+    __u32 key = CONFIG_CLOCK_SOURCE;
+    __u32 *source = bpf_map_lookup_elem(&migration_config, &key);
+
+    if (source && *source == CLOCK_SOURCE_BOOTTIME)
+    {
+        return bpf_ktime_get_boot_ns();
+    }
+    return bpf_ktime_get_ns();
+}
+
+/**
+ *  Returns the 1-in-N sampling rate for a process.
+ *
+ *  @param      pid  Process ID (TGID).
+ *  @return     The per-process rate if set, else the global rate; at least 1.
+ */
+static __always_inline __u32 sample_rate(__u32 pid)
+{
+    __u32 key = CONFIG_SAMPLE_RATE;
+    __u32 *rate = bpf_map_lookup_elem(&tgid_sample_rates, &pid);
+    __u32 value;
+
+    if (!rate)
+    {
+        rate = bpf_map_lookup_elem(&migration_config, &key);
+    }
+    value = rate ? *rate : 1;
+    if (value == 0)
+    {
+        return 1;
+    }
+    return value > MAX_SAMPLE_RATE ? MAX_SAMPLE_RATE : value;
+}
+
+/**
+ *  Counts a dropped event against its ring.
+ *
+ *  @param      shard  Shard index, or 0 for the shared ring.
+ */
+static __always_inline void count_drop(__u32 shard)
+{
+    __u64 *drops = bpf_map_lookup_elem(&ring_drops, &shard);
+    if (drops)
     {
-        /* Filter enabled: only capture events for target process */
-        if (pid != *target_pid)
+        __sync_fetch_and_add(drops, 1);
+    }
+}
+
+/**
+ *  Reserves a record in this CPU's shard, or in the shared ring when
+ *  sharding is off, and fills in its header.
+ *
+ *  @param      type   RECORD_* value.
+ *  @param      size   Record size; must be a compile-time constant.
+ *  @param      shard  Set to the shard index used, for drop accounting.
+ *  @return     The reserved record, or NULL if the ring is full.
+ */
+static __always_inline void *reserve_record(__u32 type, __u32 size, __u32 *shard)
+{
+    __u32 key = CONFIG_RING_SHARDS;
+    __u32 *shards = bpf_map_lookup_elem(&migration_config, &key);
+    struct record_header *header;
+    void *ring;
+
+    *shard = 0;
+    if (!shards || *shards == 0)
+    {
+        header = bpf_ringbuf_reserve(&events, size, 0);
+    }
+    else
+    {
+        *shard = bpf_get_smp_processor_id() % *shards;
+        ring = bpf_map_lookup_elem(&event_shards, shard);
+        if (!ring)
         {
-            return 0;
+            return NULL;
         }
+        header = bpf_ringbuf_reserve(ring, size, 0);
+    }
+
+    if (header)
+    {
+        header->type = type;
+        header->size = size;
     }
+    return header;
+}
+
+/**
+ *  Reports a thread's suppressed migrations.
+ *
+ *  @return     1 if the record was written, 0 if its ring was full.
+ */
+static __always_inline int emit_suppressed(struct thread_state *state, __u64 now)
+{
+    struct suppressed_record *record;
+    __u32 shard;
 
-    /* Reserve space in ring buffer for the event */
-    event = bpf_ringbuf_reserve(&events, sizeof(*event), 0);
-    if (!event)
+    record = reserve_record(RECORD_SUPPRESSED, sizeof(*record), &shard);
+    if (!record)
     {
-        /* Ring buffer full - drop event (userspace not consuming fast enough) */
+        count_drop(shard);
         return 0;
     }
 
-    /* Populate event fields */
-    event->timestamp_ns = bpf_ktime_get_ns();
-    event->pid = pid;
-    event->tid = tid;
+    record->timestamp_ns = now;
+    record->first_suppressed_ns = state->first_suppressed_ns;
+    record->suppressed = state->suppressed;
+    record->pid = state->pid;
+    record->tid = state->tid;
+    bpf_ringbuf_submit(record, 0);
+    return 1;
+}
+
+/**
+ *  Charges one migration to a thread's token bucket.
+ *
+ *  Buckets hold up to CONFIG_THREAD_BURST tokens and refill at
+ *  CONFIG_THREAD_RATE tokens per second. A migration without a token is
+ *  only counted; the next admitted migration first reports the count.
+ *  A thread without state is always admitted.
+ *
+ *  @return     1 if the migration may be streamed, 0 if it was suppressed.
+ */
+static __always_inline int admit_thread(struct thread_state *state, __u64 now)
+{
+    __u32 key = CONFIG_THREAD_RATE;
+    __u64 capacity;
+    __u64 elapsed;
+    __u64 max_elapsed;
+    __u64 tokens;
+    __u32 *rate;
+    __u32 *burst;
+
+    rate = bpf_map_lookup_elem(&migration_config, &key);
+    if (!rate || *rate == 0 || !state)
+    {
+        return 1;
+    }
+
+    key = CONFIG_THREAD_BURST;
+    burst = bpf_map_lookup_elem(&migration_config, &key);
+    capacity = (burst && *burst > 0 ? *burst : 1) * NSEC_PER_SEC;
+
+    /* A new bucket starts full */
+    if (!(state->flags & THREAD_BUCKET_READY))
+    {
+        state->tokens = capacity;
+        state->last_refill_ns = now;
+        state->flags |= THREAD_BUCKET_READY;
+    }
+
+    /*
+     * Credit no more idle time than refills an empty bucket. That keeps
+     * elapsed * rate within capacity + rate, below 2^63 for any u32 rate
+     * and burst.
+     */
+    elapsed = now > state->last_refill_ns ? now - state->last_refill_ns : 0;
+    max_elapsed = capacity / *rate + 1;
+    if (elapsed > max_elapsed)
+    {
+        elapsed = max_elapsed;
+    }
+    tokens = state->tokens + elapsed * *rate;
+    if (tokens > capacity)
+    {
+        tokens = capacity;
+    }
+    state->last_refill_ns = now;
+
+    if (tokens < NSEC_PER_SEC)
+    {
+        state->tokens = tokens;
+        if (state->suppressed == 0)
+        {
+            state->first_suppressed_ns = now;
+        }
+        state->suppressed++;
+        return 0;
+    }
+
+    state->tokens = tokens - NSEC_PER_SEC;
+    if (state->suppressed > 0 && emit_suppressed(state, now))
+    {
+        state->suppressed = 0;
+    }
+    return 1;
+}
+
+/*
+ * task_struct::cpu moved out of thread_info in Linux 5.16; these flavors
+ * let CO-RE resolve whichever layout the running kernel has
+ */
+struct task_struct___cpu
+{
+    unsigned int cpu;
+} __attribute__((preserve_access_index));
+
+struct thread_info___cpu
+{
+    __u32 cpu;
+} __attribute__((preserve_access_index));
+
+struct task_struct___thread_info
+{
+    struct thread_info___cpu thread_info;
+} __attribute__((preserve_access_index));
+
+/**
+ *  Returns the CPU a task is on, as task_cpu() does in the kernel.
+ *
+ *  The tracepoint fires before the task is moved, so this is the
+ *  migration's source CPU.
+ */
+static __always_inline __u32 task_cpu_of(struct task_struct *p)
+{
+    struct task_struct___cpu *task = (void *)p;
+
+    if (bpf_core_field_exists(task->cpu))
+    {
+        return BPF_CORE_READ(task, cpu);
+    }
+    return BPF_CORE_READ((struct task_struct___thread_info *)p, thread_info.cpu);
+}
+
+/**
+ *  Checks the optional target PID filter.
+ *
+ *  @return     1 if migrations of the process are traced.
+ */
+static __always_inline int is_traced(__u32 pid)
+{
+    __u32 key = CONFIG_TARGET_PID;
+    __u32 *target_pid = bpf_map_lookup_elem(&migration_config, &key);
+
+    /* Filter enabled: only capture events for target process */
+    return !target_pid || *target_pid == 0 || pid == *target_pid;
+}
+
+/**
+ *  Returns a thread's state, creating it on first use.
+ *
+ *  @return     The state, or NULL if it could not be allocated.
+ */
+static __always_inline struct thread_state *get_thread_state(struct task_struct *task)
+{
+    return bpf_task_storage_get(&thread_states, task, 0, BPF_LOCAL_STORAGE_GET_F_CREATE);
+}
+
+/**
+ *  Updates the thread's state, then decides whether to keep a migration.
+ *
+ *  @param      state  The migrated thread's state, or NULL if unavailable.
+ *  @param      now    Time of the migration.
+ *  @return     The sampling rate the kept migration stands for, or 0 if
+ *              it is not kept.
+ */
+static __always_inline __u32 admit_migration(struct thread_state *state, __u32 pid, __u32 tid,
+                                             __u32 dst_cpu, __u64 now)
+{
+    __u32 rate;
+
+    if (state)
+    {
+        state->pid = pid;
+        state->tid = tid;
+        state->last_cpu = dst_cpu;
+        state->last_migration_ns = now;
+    }
+
+    /* Keep a few busy threads from crowding everyone else out */
+    if (!admit_thread(state, now))
+    {
+        return 0;
+    }
 
     /*
-     * Read CPU IDs from tracepoint context.
-     * The tracepoint structure provides orig_cpu and dest_cpu fields.
+     * Keep a uniform 1-in-N sample instead of letting a full ring drop
+     * whole bursts; the rate is raised by userspace under load
      */
-    event->src_cpu = ctx->orig_cpu;
-    event->dst_cpu = ctx->dest_cpu;
+    rate = sample_rate(pid);
+    if (rate > 1 && bpf_get_prandom_u32() % rate != 0)
+    {
+        return 0;
+    }
+    return rate;
+}
 
-    /* Read command name (process name, max 16 chars) */
-    bpf_get_current_comm(&event->comm, sizeof(event->comm));
+/**
+ *  Sends a thread's identity unless userspace already has it.
+ *
+ *  The identity goes out the first time the thread's migration is kept
+ *  and whenever its name changed since. It is reserved before the
+ *  migration record, so it is ahead of that one in the same ring; later
+ *  migrations may go to other rings, which userspace reconciles.
+ *
+ *  @param      state  The thread's state, or NULL to send unconditionally.
+ *  @param      comm   The thread's current command name, 8-byte aligned.
+ */
+static __always_inline void send_identity(struct thread_state *state, __u32 pid, __u32 tid,
+                                          const char *comm)
+{
+    struct thread_identity_record *record;
+    const __u64 *name = (const __u64 *)comm;
+    __u64 *sent;
+    __u32 shard;
+
+    if (state && (state->flags & THREAD_COMM_SENT))
+    {
+        sent = (__u64 *)state->comm;
+        if (sent[0] == name[0] && sent[1] == name[1])
+        {
+            return;
+        }
+    }
+
+    record = reserve_record(RECORD_THREAD_IDENTITY, sizeof(*record), &shard);
+    if (!record)
+    {
+        /* Not marked as sent, so the next kept migration retries */
+        count_drop(shard);
+        return;
+    }
 
-    /* Submit event to userspace */
-    bpf_ringbuf_submit(event, 0);
+    record->tid = tid;
+    record->pid = pid;
+    record->reserved = 0;
+    __builtin_memcpy(record->comm, comm, MAX_COMM_LEN);
+    bpf_ringbuf_submit(record, 0);
 
+    if (state)
+    {
+        __builtin_memcpy(state->comm, comm, MAX_COMM_LEN);
+        state->flags |= THREAD_COMM_SENT;
+    }
+}
+
+/**
+ *  Packs a CPU and its core type into a migration_record CPU field.
+ */
+static __always_inline __u16 pack_cpu(__u32 cpu)
+{
+    return (__u16)((cpu & RECORD_CPU_MASK) | ((__u32)lookup_core_type(cpu) << RECORD_CPU_BITS));
+}
+
+/**
+ *  Writes a kept migration to this CPU's ring.
+ */
+static __always_inline void submit_migration(__u32 tid, __u32 src_cpu, __u32 dst_cpu, __u64 now,
+                                             __u32 rate)
+{
+    struct migration_record *record;
+    __u32 key = CONFIG_TOPOLOGY_GENERATION;
+    __u32 *generation;
+    __u32 shard;
+
+    /* Reserve space in this CPU's ring buffer for the event */
+    record = reserve_record(RECORD_MIGRATION, sizeof(*record), &shard);
+    if (!record)
+    {
+        /* Ring buffer full - userspace not consuming fast enough */
+        count_drop(shard);
+        return;
+    }
+
+    record->tid = tid;
+    record->timestamp_ns = now;
+
+    /* Stamp topology generation first, then resolve core types */
+    generation = bpf_map_lookup_elem(&migration_config, &key);
+    record->topology_generation = generation ? (__u16)*generation : 0;
+    record->src = pack_cpu(src_cpu);
+    record->dst = pack_cpu(dst_cpu);
+    record->sample_weight = (__u16)rate;
+
+    bpf_ringbuf_submit(record, 0);
+}
+
+/**
+ *  Handles the migration of a traced task.
+ *
+ *  @param      p         The task being migrated, as a BTF pointer.
+ *  @param      dest_cpu  The CPU it moves to.
+ */
+static __always_inline void trace_migration(struct task_struct *p, int dest_cpu)
+{
+    char comm[MAX_COMM_LEN] __attribute__((aligned(8))) = {};
+    struct thread_state *state;
+    __u32 pid = p->tgid;
+    __u32 tid = p->pid;
+    __u32 rate;
+    __u64 now;
+
+    state = get_thread_state(p);
+    now = trace_clock_ns();
+    rate = admit_migration(state, pid, tid, dest_cpu, now);
+    if (rate == 0)
+    {
+        return;
+    }
+
+    bpf_probe_read_kernel_str(comm, sizeof(comm), p->comm);
+    send_identity(state, pid, tid, comm);
+    submit_migration(tid, task_cpu_of(p), dest_cpu, now, rate);
+}
+
+/**
+ *  BTF-typed raw tracepoint handler for sched_migrate_task.
+ *
+ *  The tracepoint's arguments arrive as typed pointers, so there is no
+ *  perf trace buffer to fill and the task is read with plain loads. The
+ *  event describes the migrated task itself rather than whichever task
+ *  triggered the migration.
+ *
+ *  @param      p         The task being migrated.
+ *  @param      dest_cpu  The CPU it moves to.
+ *  @return     0 (required by BPF verifier)
+ */
+SEC("tp_btf/sched_migrate_task")
+int BPF_PROG(handle_sched_migrate_task_btf, struct task_struct *p, int dest_cpu)
+{
+    if (is_traced(p->tgid))
+    {
+        trace_migration(p, dest_cpu);
+    }
+    return 0;
+}
+
+/**
+ *  BPF_PROG_RUN harness for the tp_btf handler.
+ *
+ *  tp_btf programs cannot be test-run, so this raw tracepoint program is
+ *  never attached; EbpfLoader::benchmarkProgram() runs it instead. It
+ *  takes the tp_btf handler's path with the calling thread as the
+ *  migrated task: the same state lookup, token bucket, identity cache and
+ *  record. The target PID filter is skipped so every run is traced.
+ *
+ *  @param      dest_cpu  The CPU the calling thread would move to.
+ *  @return     0 (required by BPF verifier)
+ */
+SEC("raw_tp")
+int BPF_PROG(bench_sched_migrate_task, int dest_cpu)
+{
+    trace_migration(bpf_get_current_task_btf(), dest_cpu);
+    return 0;
+}
+
+/**
+ *  Returns when a task was created, on the trace clock.
+ */
+static __always_inline __u64 task_start_ns(struct task_struct *p)
+{
+    __u32 key = CONFIG_CLOCK_SOURCE;
+    __u32 *source = bpf_map_lookup_elem(&migration_config, &key);
+
+    if (source && *source == CLOCK_SOURCE_BOOTTIME)
+    {
+        return p->start_boottime;
+    }
+    return p->start_time;
+}
+
+/**
+ *  Writes a lifecycle record for a traced thread.
+ *
+ *  @param      start_ns  The thread's start time, or 0 if unknown.
+ *  @param      kind      THREAD_EVENT_* value.
+ *  @param      comm      The thread's command name, 8-byte aligned.
+ */
+static __always_inline void emit_lifecycle(__u32 pid, __u32 tid, __u64 start_ns, __u32 kind,
+                                           const char *comm)
+{
+    struct thread_lifecycle_record *record;
+    __u32 shard;
+
+    record = reserve_record(RECORD_THREAD_LIFECYCLE, sizeof(*record), &shard);
+    if (!record)
+    {
+        count_drop(shard);
+        return;
+    }
+
+    record->tid = tid;
+    record->pid = pid;
+    record->kind = kind;
+    record->timestamp_ns = trace_clock_ns();
+    record->start_time_ns = start_ns;
+    __builtin_memcpy(record->comm, comm, MAX_COMM_LEN);
+    bpf_ringbuf_submit(record, 0);
+}
+
+/**
+ *  Records the name a lifecycle record carried as already sent.
+ *
+ *  Userspace takes the name from the lifecycle record, so the thread's
+ *  next kept migration needs no identity record.
+ */
+static __always_inline void mark_comm_sent(struct task_struct *p, const char *comm)
+{
+    struct thread_state *state = bpf_task_storage_get(&thread_states, p, 0, 0);
+
+    if (state)
+    {
+        __builtin_memcpy(state->comm, comm, MAX_COMM_LEN);
+        state->flags |= THREAD_COMM_SENT;
+    }
+}
+
+/**
+ *  Reports a new thread or process.
+ *
+ *  @param      parent  The task calling fork() or clone().
+ *  @param      child   The new task.
+ *  @return     0 (required by BPF verifier)
+ */
+SEC("tp_btf/sched_process_fork")
+int BPF_PROG(handle_sched_process_fork, struct task_struct *parent, struct task_struct *child)
+{
+    char comm[MAX_COMM_LEN] __attribute__((aligned(8))) = {};
+    __u32 pid = child->tgid;
+
+    if (!is_traced(pid))
+    {
+        return 0;
+    }
+
+    bpf_probe_read_kernel_str(comm, sizeof(comm), child->comm);
+    emit_lifecycle(pid, child->pid, task_start_ns(child), THREAD_EVENT_FORK, comm);
+    return 0;
+}
+
+/**
+ *  Reports a thread that started a new program.
+ *
+ *  A thread other than the leader takes over the leader's thread ID when
+ *  it calls exec(); its own thread ID ends without an exit of its own, so
+ *  one is reported for it.
+ *
+ *  @param      p        The task, already renamed after the new program.
+ *  @param      old_pid  The task's thread ID before exec().
+ *  @return     0 (required by BPF verifier)
+ */
+SEC("tp_btf/sched_process_exec")
+int BPF_PROG(handle_sched_process_exec, struct task_struct *p, pid_t old_pid)
+{
+    char comm[MAX_COMM_LEN] __attribute__((aligned(8))) = {};
+    __u32 pid = p->tgid;
+    __u32 tid = p->pid;
+
+    if (!is_traced(pid))
+    {
+        return 0;
+    }
+
+    bpf_probe_read_kernel_str(comm, sizeof(comm), p->comm);
+    if ((__u32)old_pid != tid)
+    {
+        emit_lifecycle(pid, old_pid, 0, THREAD_EVENT_EXIT, comm);
+    }
+    emit_lifecycle(pid, tid, task_start_ns(p), THREAD_EVENT_EXEC, comm);
+    mark_comm_sent(p, comm);
+    return 0;
+}
+
+/**
+ *  Reports a thread that exited.
+ *
+ *  Suppressed migrations not yet reported are flushed first; the
+ *  thread's state is freed with it and nothing would report them later.
+ *
+ *  @param      p  The exiting task.
+ *  @return     0 (required by BPF verifier)
+ */
+SEC("tp_btf/sched_process_exit")
+int BPF_PROG(handle_sched_process_exit, struct task_struct *p)
+{
+    char comm[MAX_COMM_LEN] __attribute__((aligned(8))) = {};
+    struct thread_state *state;
+    __u32 pid = p->tgid;
+
+    if (!is_traced(pid))
+    {
+        return 0;
+    }
+
+    state = bpf_task_storage_get(&thread_states, p, 0, 0);
+    if (state && state->suppressed > 0 && emit_suppressed(state, trace_clock_ns()))
+    {
+        state->suppressed = 0;
+    }
+
+    bpf_probe_read_kernel_str(comm, sizeof(comm), p->comm);
+    emit_lifecycle(pid, p->pid, task_start_ns(p), THREAD_EVENT_EXIT, comm);
+    return 0;
+}
+
+/**
+ *  Reports a thread that is being renamed, e.g. by prctl(PR_SET_NAME).
+ *
+ *  @param      task  The task; its comm still holds the old name.
+ *  @param      comm  The new name.
+ *  @return     0 (required by BPF verifier)
+ */
+SEC("tp_btf/task_rename")
+int BPF_PROG(handle_task_rename, struct task_struct *task, const char *comm)
+{
+    char name[MAX_COMM_LEN] __attribute__((aligned(8))) = {};
+    __u32 pid = task->tgid;
+
+    if (!is_traced(pid))
+    {
+        return 0;
+    }
+
+    bpf_probe_read_kernel_str(name, sizeof(name), comm);
+    emit_lifecycle(pid, task->pid, task_start_ns(task), THREAD_EVENT_RENAME, name);
+    mark_comm_sent(task, name);
+    return 0;
+}
+
+/**
+ *  Tracepoint handler for context switches, recording thread activity.
+ *
+ *  Loaded only when activity tracking is enabled. The switched-out thread
+ *  is marked as having run; on_cpu covers a thread that has not been
+ *  switched out since it was last checked. sync_thread_activity catches
+ *  up on what happened while the handler was not attached.
+ *
+ *  @param      preempt  Whether prev was preempted.
+ *  @param      prev     The thread leaving the CPU.
+ *  @param      next     The thread taking the CPU.
+ *  @return     0 (required by BPF verifier)
+ */
+SEC("tp_btf/sched_switch")
+int BPF_PROG(handle_sched_switch, bool preempt, struct task_struct *prev,
+             struct task_struct *next)
+{
+    struct thread_activity_block *block;
+    __u32 prev_tid = prev->pid;
+    __u32 next_tid = next->pid;
+    __u32 key;
+
+    /* The idle tasks share thread ID 0; nobody samples them */
+    if (prev_tid != 0)
+    {
+        key = prev_tid / ACTIVITY_BLOCK_THREADS;
+        block = bpf_map_lookup_elem(&thread_activity, &key);
+        if (block)
+        {
+            block->ran[prev_tid % ACTIVITY_BLOCK_THREADS] = 1;
+            block->on_cpu[prev_tid % ACTIVITY_BLOCK_THREADS] = 0;
+        }
+    }
+
+    if (next_tid != 0)
+    {
+        key = next_tid / ACTIVITY_BLOCK_THREADS;
+        block = bpf_map_lookup_elem(&thread_activity, &key);
+        if (block)
+        {
+            block->on_cpu[next_tid % ACTIVITY_BLOCK_THREADS] = 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  Task iterator writing every thread's state as a struct thread_state.
+ *
+ *  Threads that never migrated while traced have no state and are
+ *  skipped. Reading the iterator is a snapshot query; nothing changes.
+ */
+SEC("iter/task")
+int dump_thread_states(struct bpf_iter__task *ctx)
+{
+    struct task_struct *task = ctx->task;
+    struct thread_state *state;
+    struct thread_state record;
+
+    if (!task)
+    {
+        return 0;
+    }
+
+    state = bpf_task_storage_get(&thread_states, task, 0, 0);
+    if (!state)
+    {
+        return 0;
+    }
+
+    /* State written from userspace has not seen a migration yet */
+    record = *state;
+    record.pid = task->tgid;
+    record.tid = task->pid;
+    bpf_seq_write(ctx->meta->seq, &record, sizeof(record));
+    return 0;
+}
+
+/**
+ *  Task iterator writing the state of threads with unreported suppressed
+ *  migrations, then resetting their count.
+ */
+SEC("iter/task")
+int drain_suppressed(struct bpf_iter__task *ctx)
+{
+    struct task_struct *task = ctx->task;
+    struct thread_state *state;
+    struct thread_state record;
+
+    if (!task)
+    {
+        return 0;
+    }
+
+    state = bpf_task_storage_get(&thread_states, task, 0, 0);
+    if (!state || state->suppressed == 0)
+    {
+        return 0;
+    }
+
+    /* A failed write is retried with the next read; keep the count until then */
+    record = *state;
+    record.pid = task->tgid;
+    record.tid = task->pid;
+    if (bpf_seq_write(ctx->meta->seq, &record, sizeof(record)) == 0)
+    {
+        state->suppressed = 0;
+    }
+    return 0;
+}
+
+/**
+ *  Task iterator clearing every thread's THREAD_COMM_SENT flag.
+ *
+ *  Run when a loader reuses pinned maps: the identities the flag stands
+ *  for went to the previous run's decoder, so each thread's identity is
+ *  sent again with its next kept migration.
+ */
+SEC("iter/task")
+int reset_comm_sent(struct bpf_iter__task *ctx)
+{
+    struct task_struct *task = ctx->task;
+    struct thread_state *state;
+
+    if (!task)
+    {
+        return 0;
+    }
+
+    state = bpf_task_storage_get(&thread_states, task, 0, 0);
+    if (state)
+    {
+        state->flags &= ~THREAD_COMM_SENT;
+    }
+    return 0;
+}
+
+/**
+ *  Task iterator bringing the activity flags up to date.
+ *
+ *  Run right after the sched_switch handler is attached, since threads
+ *  may have run or been switched in while it was not. Every thread is
+ *  marked as having run, and on_cpu is set from the task itself.
+ */
+SEC("iter/task")
+int sync_thread_activity(struct bpf_iter__task *ctx)
+{
+    struct task_struct *task = ctx->task;
+    struct thread_activity_block *block;
+    __u32 slot;
+    __u32 tid;
+    __u32 key;
+
+    if (!task || task->pid == 0)
+    {
+        return 0;
+    }
+
+    tid = task->pid;
+    key = tid / ACTIVITY_BLOCK_THREADS;
+    block = bpf_map_lookup_elem(&thread_activity, &key);
+    if (!block)
+    {
+        return 0;
+    }
+
+    slot = tid % ACTIVITY_BLOCK_THREADS;
+    block->ran[slot] = 1;
+    block->on_cpu[slot] = *(volatile int *)&task->on_cpu ? 1 : 0;
+
+    /* Look again, in case the thread was switched in around the store */
+    if (*(volatile int *)&task->on_cpu)
+    {
+        block->on_cpu[slot] = 1;
+    }
     return 0;
 }
 
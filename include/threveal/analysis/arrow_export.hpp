@@ -0,0 +1,214 @@
+/**
+ *  @file       arrow_export.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Apache Arrow IPC export of migrations and PMU samples.
+ *
+ *  Traces are written as Arrow record batches so that pandas, Polars and
+ *  other Arrow readers can use them without parsing: the file format is
+ *  opened with a memory map, the stream format is read as it is written.
+ *  The Arrow flatbuffer metadata is encoded by hand, so there is no
+ *  dependency on the Arrow libraries.
+ *
+ *  Every column is non-nullable and stored little-endian. Column buffers
+ *  start on 64-byte boundaries. The schema's custom metadata holds the
+ *  trace header text under "threveal.trace_header", and core types are
+ *  stored as their CoreType value.
+ */
+
+#ifndef THREVEAL_ANALYSIS_ARROW_EXPORT_HPP_
+#define THREVEAL_ANALYSIS_ARROW_EXPORT_HPP_
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+/**
+ *  Largest record batch written; larger writes are split.
+ */
+inline constexpr std::size_t kArrowBatchRows = 64 * 1024;
+
+/**
+ *  Arrow IPC container.
+ */
+enum class ArrowFormat : std::uint8_t
+{
+    /**
+     *  Stream format, for pipes and live capture; read front to back.
+     */
+    kStream = 0,
+
+    /**
+     *  File format (Feather v2), with a footer for random access and
+     *  memory mapping.
+     */
+    kFile = 1,
+};
+
+/**
+ *  Kind of record stored in an Arrow export.
+ */
+enum class ArrowTable : std::uint8_t
+{
+    /**
+     *  Columns timestamp_ns, pid, tid, src_cpu, dst_cpu, comm,
+     *  topology_generation, src_type, dst_type, sample_weight and
+     *  fidelity.
+     */
+    kMigrations = 0,
+
+    /**
+     *  Columns timestamp_ns, tid, cpu_id, instructions, cycles,
+     *  llc_misses, llc_references and branch_misses.
+     */
+    kPmuSamples = 1,
+};
+
+/**
+ *  Writes one table of records in Arrow IPC format.
+ *
+ *  Each write() appends record batches, so a capture can be exported
+ *  while it runs.
+ */
+class ArrowWriter
+{
+  public:
+    /**
+     *  Creates a file, replacing any existing one, and writes the schema.
+     *
+     *  @param      path    Destination path.
+     *  @param      table   Kind of record to store.
+     *  @param      header  Host metadata stored in the schema.
+     *  @param      format  Container format.
+     *  @return     The writer, or TraceError on failure.
+     */
+    [[nodiscard]] static auto open(const std::string& path, ArrowTable table,
+                                   const TraceHeader& header,
+                                   ArrowFormat format = ArrowFormat::kFile)
+        -> std::expected<ArrowWriter, core::TraceError>;
+
+    /**
+     *  Writes to an open descriptor, such as a pipe, and writes the schema.
+     *
+     *  @param      fd      Descriptor to write to; the writer takes
+     *                      ownership, also on failure.
+     *  @param      table   Kind of record to store.
+     *  @param      header  Host metadata stored in the schema.
+     *  @param      format  Container format.
+     *  @return     The writer, or TraceError on failure.
+     */
+    [[nodiscard]] static auto fromDescriptor(int fd, ArrowTable table, const TraceHeader& header,
+                                             ArrowFormat format = ArrowFormat::kStream)
+        -> std::expected<ArrowWriter, core::TraceError>;
+
+    /**
+     *  Finishes the export if finish() was not called.
+     */
+    ~ArrowWriter();
+
+    ArrowWriter(const ArrowWriter&) = delete;
+    auto operator=(const ArrowWriter&) -> ArrowWriter& = delete;
+
+    ArrowWriter(ArrowWriter&& other) noexcept;
+    auto operator=(ArrowWriter&& other) noexcept -> ArrowWriter&;
+
+    /**
+     *  Appends migrations as one or more record batches.
+     *
+     *  @return     Success, TraceError::kSchemaMismatch if the writer
+     *              stores another table, or TraceError::kWriteFailed.
+     */
+    [[nodiscard]] auto write(std::span<const core::MigrationEvent> migrations)
+        -> std::expected<void, core::TraceError>;
+
+    /**
+     *  Appends PMU samples as one or more record batches.
+     *
+     *  @return     Success, TraceError::kSchemaMismatch if the writer
+     *              stores another table, or TraceError::kWriteFailed.
+     */
+    [[nodiscard]] auto write(std::span<const core::PmuSample> samples)
+        -> std::expected<void, core::TraceError>;
+
+    /**
+     *  Writes the end-of-stream marker and, for files, the footer, then
+     *  closes the output.
+     *
+     *  @return     Success, or TraceError::kWriteFailed.
+     */
+    [[nodiscard]] auto finish() -> std::expected<void, core::TraceError>;
+
+    /**
+     *  Returns the number of records written.
+     */
+    [[nodiscard]] auto rows() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of record batches written.
+     */
+    [[nodiscard]] auto batches() const noexcept -> std::size_t;
+
+  private:
+    /**
+     *  Location of a record batch, for the file footer.
+     */
+    struct Block
+    {
+        std::uint64_t offset;
+        std::uint32_t metadata_length;
+        std::uint64_t body_length;
+    };
+
+    ArrowWriter(int fd, ArrowTable table, ArrowFormat format, std::string header_text) noexcept;
+
+    [[nodiscard]] auto start() -> std::expected<void, core::TraceError>;
+
+    [[nodiscard]] auto writeMessage(std::span<const std::byte> metadata,
+                                    std::span<const std::byte> body)
+        -> std::expected<Block, core::TraceError>;
+
+    [[nodiscard]] auto writeBatch(std::span<const std::byte> metadata, std::size_t rows)
+        -> std::expected<void, core::TraceError>;
+
+    [[nodiscard]] auto writeBytes(std::span<const std::byte> bytes)
+        -> std::expected<void, core::TraceError>;
+
+    void closeOutput() noexcept;
+
+    int fd_{-1};
+    ArrowTable table_{ArrowTable::kMigrations};
+    ArrowFormat format_{ArrowFormat::kFile};
+    std::string header_text_;
+    std::uint64_t offset_{0};
+    std::uint64_t rows_{0};
+    std::vector<Block> blocks_;
+    std::vector<std::byte> body_;
+};
+
+/**
+ *  Exports a store's migrations and PMU samples as two Arrow files.
+ *
+ *  @param      store            The events to export.
+ *  @param      header           Host metadata stored in both schemas.
+ *  @param      migrations_path  Destination of the migrations table.
+ *  @param      pmu_path         Destination of the PMU sample table.
+ *  @return     Success, or TraceError on failure.
+ */
+[[nodiscard]] auto exportArrow(const EventStore& store, const TraceHeader& header,
+                               const std::string& migrations_path, const std::string& pmu_path)
+    -> std::expected<void, core::TraceError>;
+
+}  // namespace threveal::analysis
+
+#endif  // THREVEAL_ANALYSIS_ARROW_EXPORT_HPP_
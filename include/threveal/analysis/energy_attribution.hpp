@@ -0,0 +1,175 @@
+/**
+ *  @file       energy_attribution.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Attribution of RAPL energy to threads by core-type residency.
+ *
+ *  RAPL reports energy for the whole package (or all cores), not per core
+ *  type. Each energy interval is split across threads in proportion to the
+ *  cycles they retired in that interval, tracked separately for P-cores and
+ *  E-cores, which gives per-thread instructions-per-joule on each core type.
+ */
+
+#ifndef THREVEAL_ANALYSIS_ENERGY_ATTRIBUTION_HPP_
+#define THREVEAL_ANALYSIS_ENERGY_ATTRIBUTION_HPP_
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+/**
+ *  Accumulated work and attributed energy on one core type.
+ */
+struct CoreTypeEnergy
+{
+    /**
+     *  Instructions retired on this core type.
+     */
+    std::uint64_t instructions{0};
+
+    /**
+     *  Cycles elapsed on this core type.
+     */
+    std::uint64_t cycles{0};
+
+    /**
+     *  Energy attributed to this core type, in joules.
+     */
+    double energy_joules{0.0};
+
+    /**
+     *  Computes instructions retired per joule consumed.
+     *
+     *  @return     Instructions per joule, or 0.0 if no energy was attributed.
+     */
+    [[nodiscard]] constexpr auto instructionsPerJoule() const noexcept -> double
+    {
+        if (energy_joules <= 0.0)
+        {
+            return 0.0;
+        }
+        return static_cast<double>(instructions) / energy_joules;
+    }
+};
+
+/**
+ *  Per-thread energy profile split by core type.
+ */
+struct ThreadEnergy
+{
+    /**
+     *  Thread ID this profile belongs to.
+     */
+    std::uint32_t tid{0};
+
+    /**
+     *  Work and energy while running on P-cores.
+     */
+    CoreTypeEnergy p_core;
+
+    /**
+     *  Work and energy while running on E-cores.
+     */
+    CoreTypeEnergy e_core;
+
+    /**
+     *  Returns the profile for the given core type.
+     *
+     *  @param      type  kPCore or kECore.
+     *  @return     The matching profile (E-core profile for any other value).
+     */
+    [[nodiscard]] constexpr auto forCoreType(core::CoreType type) const noexcept
+        -> const CoreTypeEnergy&
+    {
+        return type == core::CoreType::kPCore ? p_core : e_core;
+    }
+
+    /**
+     *  Returns the total energy attributed to this thread, in joules.
+     */
+    [[nodiscard]] constexpr auto totalEnergyJoules() const noexcept -> double
+    {
+        return p_core.energy_joules + e_core.energy_joules;
+    }
+};
+
+/**
+ *  Tuning knobs for energy attribution.
+ */
+struct EnergyAttributionOptions
+{
+    /**
+     *  Relative energy cost of one P-core cycle.
+     *
+     *  RAPL does not split energy by core type, so by default a cycle costs
+     *  the same everywhere. Set from offline calibration to model the higher
+     *  per-cycle cost of P-cores.
+     */
+    double p_core_cycle_weight{1.0};
+
+    /**
+     *  Relative energy cost of one E-core cycle.
+     */
+    double e_core_cycle_weight{1.0};
+};
+
+/**
+ *  A proposed core-type placement for a thread.
+ */
+struct ThreadPlacement
+{
+    /**
+     *  Thread ID to place.
+     */
+    std::uint32_t tid;
+
+    /**
+     *  Core type the thread would be pinned to.
+     */
+    core::CoreType target;
+};
+
+/**
+ *  Attributes stored energy samples to threads.
+ *
+ *  Each energy sample covers the interval since the previous one. PMU
+ *  samples whose timestamps fall inside that interval share its energy in
+ *  proportion to their (weighted) cycles. The cores domain is used when
+ *  present, otherwise the package domain. PMU samples before the first
+ *  energy sample, and energy from intervals without any cycles, are left
+ *  unattributed.
+ *
+ *  @param      store     Event store with PMU and energy samples.
+ *  @param      topology  Topology used to classify each PMU sample's CPU.
+ *  @param      options   Per-core-type cycle weights.
+ *  @return     One profile per thread, sorted by tid.
+ */
+[[nodiscard]] auto attributeEnergy(const EventStore& store, const core::TopologyMap& topology,
+                                   const EnergyAttributionOptions& options = {})
+    -> std::vector<ThreadEnergy>;
+
+/**
+ *  Estimates the energy change of applying a placement plan.
+ *
+ *  For each planned thread, its total instructions are re-costed at the
+ *  instructions-per-joule it achieved on the target core type. Threads
+ *  never observed on the target type use the aggregate efficiency of all
+ *  threads on that type. Threads missing from the profiles are ignored.
+ *
+ *  @param      profiles  Profiles from attributeEnergy().
+ *  @param      plan      Proposed placements.
+ *  @return     Predicted minus measured energy in joules (negative saves).
+ */
+[[nodiscard]] auto estimatePlacementEnergyDelta(std::span<const ThreadEnergy> profiles,
+                                                std::span<const ThreadPlacement> plan) -> double;
+
+}  // namespace threveal::analysis
+
+#endif  // THREVEAL_ANALYSIS_ENERGY_ATTRIBUTION_HPP_
@@ -3,17 +3,27 @@
  *  @author     Rutger Kool <rutgerkool@gmail.com>
  *
  *  Storage and querying of migration and PMU events.
+ *
+ *  Thread lifecycle events build a ThreadRegistry next to the events, so
+ *  per-thread queries can tell apart threads that reused a thread ID.
+ *
+ *  For long captures, PMU samples can be downsampled as they are added;
+ *  see PmuDownsampler.
  */
 
 #ifndef THREVEAL_ANALYSIS_EVENT_STORE_HPP_
 #define THREVEAL_ANALYSIS_EVENT_STORE_HPP_
 
+#include "threveal/analysis/pmu_downsampler.hpp"
+#include "threveal/analysis/thread_registry.hpp"
+#include "threveal/core/clock.hpp"
 #include "threveal/core/events.hpp"
 #include "threveal/core/types.hpp"
 
 #include <cstdint>
 #include <optional>
 #include <span>
+#include <unordered_map>
 #include <vector>
 
 namespace threveal::analysis
@@ -30,6 +40,16 @@ class EventStore
      */
     EventStore() = default;
 
+    /**
+     *  Constructs an empty EventStore that downsamples PMU samples.
+     *
+     *  Downsampled samples are stored in batches once they are decided;
+     *  call flushPmuSamples() before querying them.
+     *
+     *  @param      downsampling  Policy for samples away from migrations.
+     */
+    explicit EventStore(PmuDownsampling downsampling);
+
     /**
      *  Adds a migration event to the store.
      *
@@ -44,6 +64,35 @@ class EventStore
      */
     void addPmuSample(core::PmuSample sample);
 
+    /**
+     *  Decides and stores every PMU sample held back by downsampling.
+     *
+     *  Samples waiting for a migration are decided as if none follows.
+     *  Does nothing without downsampling.
+     */
+    void flushPmuSamples();
+
+    /**
+     *  Adds a RAPL energy sample to the store.
+     *
+     *  @param      sample  The energy sample to store.
+     */
+    void addEnergySample(core::EnergySample sample);
+
+    /**
+     *  Adds an HFI capability update to the store.
+     *
+     *  @param      update  The capability update to store.
+     */
+    void addHfiUpdate(core::HfiCapabilityUpdate update);
+
+    /**
+     *  Adds a thread lifecycle event to the thread registry.
+     *
+     *  @param      event  The fork, exec, exit or rename.
+     */
+    void addThreadLifecycle(const core::ThreadLifecycleEvent& event);
+
     /**
      *  Returns a view of all stored migration events.
      *
@@ -59,7 +108,51 @@ class EventStore
     [[nodiscard]] auto allPmuSamples() const noexcept -> std::span<const core::PmuSample>;
 
     /**
-     *  Returns all migrations for a specific thread.
+     *  Returns a view of all stored energy samples.
+     *
+     *  @return     A span of all energy samples sorted by timestamp.
+     */
+    [[nodiscard]] auto allEnergySamples() const noexcept -> std::span<const core::EnergySample>;
+
+    /**
+     *  Returns a view of all stored HFI capability updates.
+     *
+     *  @return     A span of all HFI updates sorted by timestamp.
+     */
+    [[nodiscard]] auto allHfiUpdates() const noexcept
+        -> std::span<const core::HfiCapabilityUpdate>;
+
+    /**
+     *  Finds the HFI capabilities in effect for a CPU at a point in time.
+     *
+     *  @param      cpu_id        The CPU to look up.
+     *  @param      timestamp_ns  Point in time, nanoseconds on the trace clock.
+     *  @return     The latest update for that CPU at or before timestamp_ns,
+     *              or std::nullopt if none was received yet.
+     */
+    [[nodiscard]] auto hfiCapabilityAt(core::CpuId cpu_id, std::uint64_t timestamp_ns) const
+        -> std::optional<core::HfiCapabilityUpdate>;
+
+    /**
+     *  Returns the lifetimes of the threads seen.
+     */
+    [[nodiscard]] auto threads() const noexcept -> const ThreadRegistry&;
+
+    /**
+     *  Finds the thread that held a thread ID at a point in time.
+     *
+     *  @param      tid           The thread ID.
+     *  @param      timestamp_ns  Point in time, nanoseconds on the trace clock.
+     *  @return     The thread's key; see ThreadRegistry::resolve().
+     */
+    [[nodiscard]] auto threadAt(std::uint32_t tid, std::uint64_t timestamp_ns) const
+        -> core::ThreadKey;
+
+    /**
+     *  Returns all migrations for a specific thread ID.
+     *
+     *  Every thread that held the ID is included; use the ThreadKey
+     *  overload to keep them apart.
      *
      *  @param      tid  The thread ID to filter by.
      *  @return     A vector of migrations for the specified thread.
@@ -67,11 +160,21 @@ class EventStore
     [[nodiscard]] auto migrationsForThread(std::uint32_t tid) const
         -> std::vector<core::MigrationEvent>;
 
+    /**
+     *  Returns all migrations of one thread.
+     *
+     *  @param      thread  The thread, e.g. from threadAt().
+     *  @return     The thread's migrations, not those of other threads
+     *              that held its ID.
+     */
+    [[nodiscard]] auto migrationsForThread(const core::ThreadKey& thread) const
+        -> std::vector<core::MigrationEvent>;
+
     /**
      *  Returns all migrations within a time range.
      *
-     *  @param      start_ns  Start of time range (inclusive), nanoseconds since boot.
-     *  @param      end_ns    End of time range (inclusive), nanoseconds since boot.
+     *  @param      start_ns  Start of time range (inclusive), nanoseconds on the trace clock.
+     *  @param      end_ns    End of time range (inclusive), nanoseconds on the trace clock.
      *  @return     A vector of migrations within the specified range.
      */
     [[nodiscard]] auto migrationsInRange(std::uint64_t start_ns, std::uint64_t end_ns) const
@@ -85,9 +188,22 @@ class EventStore
      */
     [[nodiscard]] auto pmuSamplesForThread(std::uint32_t tid) const -> std::vector<core::PmuSample>;
 
+    /**
+     *  Returns all PMU samples of one thread.
+     *
+     *  @param      thread  The thread, e.g. from threadAt().
+     *  @return     The thread's samples, not those of other threads that
+     *              held its ID.
+     */
+    [[nodiscard]] auto pmuSamplesForThread(const core::ThreadKey& thread) const
+        -> std::vector<core::PmuSample>;
+
     /**
      *  Finds the PMU sample closest to and before a migration event.
      *
+     *  Only samples of the migrated thread count, not those of an earlier
+     *  thread with the same ID.
+     *
      *  @param      migration  The migration event to correlate.
      *  @return     The closest PMU sample before the migration, or std::nullopt
      *              if no suitable sample exists.
@@ -98,6 +214,9 @@ class EventStore
     /**
      *  Finds the PMU sample closest to and after a migration event.
      *
+     *  Only samples of the migrated thread count, not those of a later
+     *  thread with the same ID.
+     *
      *  @param      migration  The migration event to correlate.
      *  @return     The closest PMU sample after the migration, or std::nullopt
      *              if no suitable sample exists.
@@ -112,6 +231,16 @@ class EventStore
      */
     [[nodiscard]] auto migrationCount() const noexcept -> std::size_t;
 
+    /**
+     *  Returns the number of migrations the stored events stand for.
+     *
+     *  Equal to migrationCount() unless events were sampled in the kernel,
+     *  in which case each event counts as its sample weight.
+     *
+     *  @return     The sum of migration sample weights.
+     */
+    [[nodiscard]] auto estimatedMigrationCount() const noexcept -> std::uint64_t;
+
     /**
      *  Returns the number of stored PMU samples.
      *
@@ -120,13 +249,56 @@ class EventStore
     [[nodiscard]] auto pmuSampleCount() const noexcept -> std::size_t;
 
     /**
-     *  Removes all stored events.
+     *  Returns the number of PMU samples removed by downsampling.
+     *
+     *  A rollup bucket of n samples counts as n - 1.
+     *
+     *  @return     The count, or 0 without downsampling.
+     */
+    [[nodiscard]] auto downsampledPmuSampleCount() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of stored energy samples.
+     *
+     *  @return     The count of energy samples.
+     */
+    [[nodiscard]] auto energySampleCount() const noexcept -> std::size_t;
+
+    /**
+     *  Returns the number of stored HFI capability updates.
+     *
+     *  @return     The count of HFI updates.
+     */
+    [[nodiscard]] auto hfiUpdateCount() const noexcept -> std::size_t;
+
+    /**
+     *  Records how the trace clock related to wall-clock time.
+     *
+     *  @param      snapshot  Snapshot taken while collecting.
+     */
+    void setClockSnapshot(const core::ClockSnapshot& snapshot) noexcept;
+
+    /**
+     *  Returns the clock snapshot, if one was recorded.
+     */
+    [[nodiscard]] auto clockSnapshot() const noexcept -> const std::optional<core::ClockSnapshot>&;
+
+    /**
+     *  Removes all stored events, the thread registry and the clock snapshot.
+     *
+     *  The downsampling policy is kept.
      */
     void clear() noexcept;
 
   private:
     std::vector<core::MigrationEvent> migrations_;
     std::vector<core::PmuSample> pmu_samples_;
+    std::vector<core::EnergySample> energy_samples_;
+    std::vector<core::HfiCapabilityUpdate> hfi_updates_;
+    std::unordered_map<core::CpuId, std::vector<core::HfiCapabilityUpdate>> hfi_by_cpu_;
+    ThreadRegistry threads_;
+    std::optional<PmuDownsampler> downsampler_;
+    std::optional<core::ClockSnapshot> clock_snapshot_;
 };
 
 }  // namespace threveal::analysis
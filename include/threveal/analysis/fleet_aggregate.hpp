@@ -0,0 +1,265 @@
+/**
+ *  @file       fleet_aggregate.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Migration statistics merged across many hosts.
+ *
+ *  CPU numbers mean different things on different machines, so every
+ *  migration is first normalised to its core classes using the host's
+ *  own topology. Counts are then kept per thread role (the command name
+ *  without its pool index) and merged across hosts. Each aggregate keeps
+ *  at most a fixed number of roles, ranked by their P→E migrations, and
+ *  distinct hosts and threads are estimated with fixed-size sketches, so
+ *  memory does not grow with the number of hosts.
+ */
+
+#ifndef THREVEAL_ANALYSIS_FLEET_AGGREGATE_HPP_
+#define THREVEAL_ANALYSIS_FLEET_AGGREGATE_HPP_
+
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+/**
+ *  Default number of roles a FleetAggregate keeps.
+ */
+inline constexpr std::size_t kDefaultFleetCapacity = 1024;
+
+/**
+ *  Mergeable estimate of the number of distinct items (HyperLogLog).
+ *
+ *  Uses 256 one-byte registers, for a standard error of about 6.5%.
+ */
+class DistinctCounter
+{
+  public:
+    static constexpr std::size_t kRegisters = 256;
+
+    /**
+     *  Adds an item by its 64-bit hash.
+     *
+     *  @param      hash  Well-mixed hash of the item.
+     */
+    void add(std::uint64_t hash) noexcept;
+
+    /**
+     *  Adds every item counted by another counter.
+     */
+    void merge(const DistinctCounter& other) noexcept;
+
+    /**
+     *  Returns the estimated number of distinct items added.
+     */
+    [[nodiscard]] auto estimate() const noexcept -> double;
+
+  private:
+    std::array<std::uint8_t, kRegisters> registers_{};
+};
+
+/**
+ *  Migration counts of one thread role, or of the whole fleet.
+ *
+ *  All counts are weighted by each event's sample weight.
+ */
+struct RoleAggregate
+{
+    /**
+     *  The thread role; empty for fleet-wide totals.
+     */
+    std::string role;
+
+    std::uint64_t migrations{0};
+    std::uint64_t p_to_p{0};
+    std::uint64_t p_to_e{0};
+    std::uint64_t e_to_p{0};
+    std::uint64_t e_to_e{0};
+    std::uint64_t unknown{0};
+
+    /**
+     *  Wall-clock time of the earliest migration, or 0 if no trace had
+     *  clock offsets.
+     */
+    std::uint64_t first_seen_realtime_ns{0};
+
+    /**
+     *  Wall-clock time of the latest migration, or 0 if unknown.
+     */
+    std::uint64_t last_seen_realtime_ns{0};
+
+    /**
+     *  Distinct hosts the role migrated on.
+     */
+    DistinctCounter hosts;
+
+    /**
+     *  Distinct threads (host and TID) with this role.
+     */
+    DistinctCounter threads;
+
+    /**
+     *  Adds another aggregate's counts to this one.
+     */
+    void merge(const RoleAggregate& other) noexcept;
+};
+
+/**
+ *  Options for building fleet aggregates.
+ */
+struct FleetAggregateOptions
+{
+    /**
+     *  Maximum number of roles kept; must be at least one.
+     */
+    std::size_t capacity{kDefaultFleetCapacity};
+
+    /**
+     *  Group threads by threadRole() instead of by full command name.
+     */
+    bool group_by_role{true};
+};
+
+/**
+ *  Bounded, mergeable migration statistics for many hosts.
+ */
+class FleetAggregate
+{
+  public:
+    /**
+     *  Creates an empty aggregate.
+     *
+     *  @param      options  Capacity and grouping.
+     */
+    explicit FleetAggregate(FleetAggregateOptions options = {});
+
+    /**
+     *  Reads a whole trace and adds it as one host.
+     *
+     *  Migrations are classified with the core types stamped by the
+     *  producer, or with the trace's topology when not stamped.
+     *
+     *  @param      reader  An open trace; it is read to the end.
+     *  @return     Success, or TraceError if the trace is truncated.
+     */
+    [[nodiscard]] auto addTrace(TraceReader& reader) -> std::expected<void, core::TraceError>;
+
+    /**
+     *  Merges another aggregate into this one.
+     *
+     *  Hosts in the two aggregates are assumed to be distinct.
+     *
+     *  @param      other  The aggregate to merge.
+     */
+    void merge(const FleetAggregate& other);
+
+    /**
+     *  Records a trace that could not be read.
+     */
+    void addSkippedTrace() noexcept;
+
+    /**
+     *  Returns the kept roles, most P→E migrations first.
+     */
+    [[nodiscard]] auto roles() const noexcept -> std::span<const RoleAggregate>;
+
+    /**
+     *  Returns exact fleet-wide totals.
+     */
+    [[nodiscard]] auto totals() const noexcept -> const RoleAggregate&;
+
+    /**
+     *  Returns the number of traces added.
+     */
+    [[nodiscard]] auto hostCount() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of traces that could not be read.
+     */
+    [[nodiscard]] auto skippedTraces() const noexcept -> std::uint64_t;
+
+    /**
+     *  Upper bound on P→E migrations missing from any kept role.
+     *
+     *  Zero unless roles had to be dropped to stay within capacity. A kept
+     *  role's true P→E count lies between its reported count and the
+     *  reported count plus this bound.
+     */
+    [[nodiscard]] auto errorBound() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the options in effect.
+     */
+    [[nodiscard]] auto options() const noexcept -> const FleetAggregateOptions&;
+
+  private:
+    /**
+     *  Sorts roles by rank and drops those beyond capacity.
+     */
+    void truncate();
+
+    FleetAggregateOptions options_;
+    std::vector<RoleAggregate> roles_;
+    RoleAggregate totals_;
+    std::uint64_t hosts_{0};
+    std::uint64_t skipped_{0};
+    std::uint64_t error_bound_{0};
+};
+
+/**
+ *  Options for mergeTraceFiles().
+ */
+struct FleetMergeOptions
+{
+    /**
+     *  Options for every partial and the final aggregate.
+     */
+    FleetAggregateOptions aggregate{};
+
+    /**
+     *  Number of worker threads; 0 uses the hardware concurrency.
+     */
+    std::size_t threads{0};
+};
+
+/**
+ *  Strips the pool index from a command name.
+ *
+ *  Trailing digits and the separators before them are removed, so
+ *  "worker-12" and "worker-3" both become "worker". A name made only of
+ *  digits is returned unchanged.
+ *
+ *  @param      comm  The command name.
+ *  @return     The role, a prefix of comm.
+ */
+[[nodiscard]] auto threadRole(std::string_view comm) noexcept -> std::string_view;
+
+/**
+ *  Aggregates many trace files in parallel.
+ *
+ *  Each worker streams one trace at a time into its own bounded
+ *  aggregate; the partials are merged at the end. Unreadable traces are
+ *  counted as skipped.
+ *
+ *  @param      paths    Trace files, one per host.
+ *  @param      options  Aggregation and parallelism.
+ *  @return     The fleet aggregate, or the first TraceError if no trace
+ *              could be read.
+ */
+[[nodiscard]] auto mergeTraceFiles(std::span<const std::string> paths,
+                                   const FleetMergeOptions& options = {})
+    -> std::expected<FleetAggregate, core::TraceError>;
+
+}  // namespace threveal::analysis
+
+#endif  // THREVEAL_ANALYSIS_FLEET_AGGREGATE_HPP_
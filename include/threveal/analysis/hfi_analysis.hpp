@@ -0,0 +1,248 @@
+/**
+ *  @file       hfi_analysis.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Analysis of scheduler migrations against HFI capability hints.
+ *
+ *  Each migration is judged against the HFI table in effect when it
+ *  happened: moving to a CPU with higher performance capability follows the
+ *  hardware's recommendation, and so does moving to a more efficient CPU
+ *  when performance drops. Losing performance without gaining efficiency
+ *  goes against it. The measured P/E IPC ratio is also compared with the
+ *  ratio HFI predicts.
+ */
+
+#ifndef THREVEAL_ANALYSIS_HFI_ANALYSIS_HPP_
+#define THREVEAL_ANALYSIS_HFI_ANALYSIS_HPP_
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+/**
+ *  How a migration relates to the HFI performance ranking.
+ */
+enum class HfiVerdict : std::uint8_t
+{
+    /**
+     *  No HFI capability was known for the source or destination CPU.
+     */
+    kUnknown = 0,
+
+    /**
+     *  The destination CPU has a higher performance capability.
+     */
+    kFollowed = 1,
+
+    /**
+     *  The destination CPU has a lower performance capability and no
+     *  higher efficiency capability.
+     */
+    kAgainst = 2,
+
+    /**
+     *  Source and destination capabilities are within the neutral band.
+     */
+    kNeutral = 3,
+
+    /**
+     *  The destination CPU has a higher efficiency capability and no
+     *  higher performance capability.
+     */
+    kEfficiency = 4,
+};
+
+/**
+ *  Converts an HfiVerdict to its human-readable string representation.
+ *
+ *  @param      verdict  The verdict to convert.
+ *  @return     A string view containing "followed", "efficiency", "against", "neutral",
+ *              or "unknown".
+ */
+[[nodiscard]] constexpr auto toString(HfiVerdict verdict) noexcept -> std::string_view
+{
+    switch (verdict)
+    {
+        case HfiVerdict::kFollowed:
+            return "followed";
+        case HfiVerdict::kAgainst:
+            return "against";
+        case HfiVerdict::kNeutral:
+            return "neutral";
+        case HfiVerdict::kEfficiency:
+            return "efficiency";
+        case HfiVerdict::kUnknown:
+            return "unknown";
+    }
+    return "invalid";
+}
+
+/**
+ *  Tuning for HFI migration classification.
+ */
+struct HfiAnalysisOptions
+{
+    /**
+     *  Capability differences up to this value count as neutral.
+     *
+     *  Applies to both the performance and the efficiency column.
+     *
+     *  HFI capabilities are scaled to 0-1023; small differences between
+     *  siblings of the same core type carry no scheduling preference.
+     */
+    std::uint32_t neutral_band{32};
+};
+
+/**
+ *  A migration annotated with the HFI capabilities in effect at the time.
+ */
+struct HfiMigrationVerdict
+{
+    /**
+     *  The migration being judged.
+     */
+    core::MigrationEvent migration;
+
+    /**
+     *  Performance capability of the source CPU, if known.
+     */
+    std::optional<std::uint32_t> src_performance{};
+
+    /**
+     *  Performance capability of the destination CPU, if known.
+     */
+    std::optional<std::uint32_t> dst_performance{};
+
+    /**
+     *  Efficiency capability of the source CPU, if known.
+     */
+    std::optional<std::uint32_t> src_efficiency{};
+
+    /**
+     *  Efficiency capability of the destination CPU, if known.
+     */
+    std::optional<std::uint32_t> dst_efficiency{};
+
+    /**
+     *  Whether the migration followed the hardware recommendation.
+     */
+    HfiVerdict verdict{HfiVerdict::kUnknown};
+};
+
+/**
+ *  Counts of migrations per verdict, scaled by each event's sample weight.
+ */
+struct HfiVerdictSummary
+{
+    std::size_t followed{0};
+    std::size_t efficiency{0};
+    std::size_t against{0};
+    std::size_t neutral{0};
+    std::size_t unknown{0};
+
+    /**
+     *  Fraction of judged (non-neutral, known) migrations that followed HFI,
+     *  for performance or for efficiency.
+     *
+     *  @return     Ratio in [0, 1], or 0.0 if no migration could be judged.
+     */
+    [[nodiscard]] constexpr auto followRate() const noexcept -> double
+    {
+        auto judged = followed + efficiency + against;
+        if (judged == 0)
+        {
+            return 0.0;
+        }
+        return static_cast<double>(followed + efficiency) / static_cast<double>(judged);
+    }
+};
+
+/**
+ *  Measured IPC ratio between core types next to HFI's predicted ratio.
+ */
+struct IpcRatioComparison
+{
+    /**
+     *  Aggregate IPC of samples taken on P-cores.
+     */
+    double p_core_ipc{0.0};
+
+    /**
+     *  Aggregate IPC of samples taken on E-cores.
+     */
+    double e_core_ipc{0.0};
+
+    /**
+     *  Cycle-weighted mean performance capability of the sampled P-cores.
+     */
+    double p_core_capability{0.0};
+
+    /**
+     *  Cycle-weighted mean performance capability of the sampled E-cores.
+     */
+    double e_core_capability{0.0};
+
+    /**
+     *  Measured P/E IPC ratio.
+     */
+    [[nodiscard]] constexpr auto measuredRatio() const noexcept -> double
+    {
+        return (e_core_ipc > 0.0) ? p_core_ipc / e_core_ipc : 0.0;
+    }
+
+    /**
+     *  P/E performance capability ratio predicted by HFI.
+     */
+    [[nodiscard]] constexpr auto predictedRatio() const noexcept -> double
+    {
+        return (e_core_capability > 0.0) ? p_core_capability / e_core_capability : 0.0;
+    }
+};
+
+/**
+ *  Judges every stored migration against the HFI table at its timestamp.
+ *
+ *  @param      store    Event store with migrations and HFI updates.
+ *  @param      options  Classification tuning.
+ *  @return     One verdict per migration, in timestamp order.
+ */
+[[nodiscard]] auto classifyHfiMigrations(const EventStore& store,
+                                         const HfiAnalysisOptions& options = {})
+    -> std::vector<HfiMigrationVerdict>;
+
+/**
+ *  Tallies verdicts.
+ *
+ *  @param      verdicts  Output of classifyHfiMigrations().
+ *  @return     Counts per verdict.
+ */
+[[nodiscard]] auto summarizeHfiVerdicts(std::span<const HfiMigrationVerdict> verdicts)
+    -> HfiVerdictSummary;
+
+/**
+ *  Compares the measured P/E IPC ratio with the HFI-predicted ratio.
+ *
+ *  Only PMU samples taken on a CPU with a known HFI capability are used, so
+ *  both ratios describe the same set of samples.
+ *
+ *  @param      store     Event store with PMU samples and HFI updates.
+ *  @param      topology  Topology used to resolve each sample's core type.
+ *  @return     The comparison, or std::nullopt if either core type has no
+ *              usable samples.
+ */
+[[nodiscard]] auto compareIpcRatios(const EventStore& store, const core::TopologyMap& topology)
+    -> std::optional<IpcRatioComparison>;
+
+}  // namespace threveal::analysis
+
+#endif  // THREVEAL_ANALYSIS_HFI_ANALYSIS_HPP_
@@ -0,0 +1,262 @@
+/**
+ *  @file       pmu_downsampler.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Bounded retention of PMU samples for long captures.
+ *
+ *  At a 1 ms interval a week-long capture produces some 600 million
+ *  samples per thread. Correlation only needs the samples around each
+ *  migration at full resolution, so those are always kept; the rest are
+ *  either reservoir-sampled per thread or merged into coarser buckets as
+ *  they age. Memory then grows with the number of threads and
+ *  migrations rather than with run time.
+ *
+ *  A sample is decided once no migration can arrive for it any more.
+ *  Decisions are collected as additions and removals and applied to the
+ *  store's sorted samples in batches, so a removal never costs a shift of
+ *  every later sample.
+ */
+
+#ifndef THREVEAL_ANALYSIS_PMU_DOWNSAMPLER_HPP_
+#define THREVEAL_ANALYSIS_PMU_DOWNSAMPLER_HPP_
+
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+/**
+ *  What happens to samples that are not near a migration.
+ */
+enum class PmuDownsamplingMode : std::uint8_t
+{
+    /**
+     *  Keep a uniform random subset of each thread's samples.
+     */
+    kReservoir = 0,
+
+    /**
+     *  Merge samples into buckets that get coarser with age.
+     */
+    kRollup = 1,
+};
+
+/**
+ *  Converts a PmuDownsamplingMode to its name.
+ */
+[[nodiscard]] constexpr auto toString(PmuDownsamplingMode mode) noexcept -> std::string_view
+{
+    switch (mode)
+    {
+        case PmuDownsamplingMode::kReservoir:
+            return "reservoir";
+        case PmuDownsamplingMode::kRollup:
+            return "rollup";
+    }
+    return "unknown";
+}
+
+/**
+ *  One resolution of a rollup.
+ */
+struct RollupTier
+{
+    /**
+     *  Age, relative to the thread's newest sample, at which a bucket of
+     *  this tier is closed.
+     */
+    std::chrono::nanoseconds age;
+
+    /**
+     *  Time span covered by one bucket.
+     */
+    std::chrono::nanoseconds width;
+};
+
+/**
+ *  Downsampling policy for PMU samples.
+ */
+struct PmuDownsampling
+{
+    PmuDownsamplingMode mode{PmuDownsamplingMode::kReservoir};
+
+    /**
+     *  Samples of a thread this close to one of its migrations, before or
+     *  after, are kept at full resolution.
+     */
+    std::chrono::nanoseconds migration_window{std::chrono::milliseconds(10)};
+
+    /**
+     *  How long after a sample a migration of its thread may still be
+     *  added; the sample is not downsampled before.
+     */
+    std::chrono::nanoseconds settle_time{std::chrono::milliseconds(100)};
+
+    /**
+     *  Samples away from migrations kept per thread in kReservoir mode.
+     */
+    std::size_t reservoir_size{10000};
+
+    /**
+     *  Tiers from fine to coarse for kRollup mode.
+     *
+     *  Closed buckets of one tier are merged into the next. Each age
+     *  should exceed the previous one by at least the previous width, or
+     *  a bucket may close before all of its parts arrived and be split.
+     *  Buckets of the last tier are kept.
+     */
+    std::vector<RollupTier> rollup{
+        {std::chrono::minutes(1), std::chrono::milliseconds(100)},
+        {std::chrono::hours(1), std::chrono::seconds(10)},
+    };
+
+    /**
+     *  Seed of the reservoir's random choices.
+     */
+    std::uint64_t seed{0};
+};
+
+/**
+ *  Decides which PMU samples a store keeps.
+ *
+ *  Samples and migrations are fed in as they arrive, roughly in time
+ *  order per thread. The resulting changes are applied to a sample
+ *  vector sorted by timestamp with apply(). Until then, and for undecided
+ *  samples until settle(), the vector does not reflect them, but it never
+ *  holds a sample together with a bucket it was merged into.
+ *
+ *  A rollup bucket is a PmuSample of the bucket's thread and CPU with the
+ *  summed counters of its parts and the timestamp of its last part.
+ */
+class PmuDownsampler
+{
+  public:
+    /**
+     *  Creates a downsampler.
+     *
+     *  @param      policy  Windows, budget and rollup tiers.
+     */
+    explicit PmuDownsampler(PmuDownsampling policy);
+
+    /**
+     *  Takes a new sample.
+     */
+    void addSample(const core::PmuSample& sample);
+
+    /**
+     *  Records a migration; its thread's samples around it are kept.
+     *
+     *  @param      tid           Thread that migrated.
+     *  @param      timestamp_ns  Time of the migration.
+     */
+    void addMigration(std::uint32_t tid, std::uint64_t timestamp_ns);
+
+    /**
+     *  Decides a thread's remaining samples and forgets it.
+     *
+     *  Called when the thread exits, so state is held for live threads only.
+     */
+    void endThread(std::uint32_t tid);
+
+    /**
+     *  Decides every sample still waiting for a migration.
+     *
+     *  Migrations added later no longer keep those samples.
+     */
+    void settle();
+
+    /**
+     *  Returns the number of additions and removals not yet applied.
+     */
+    [[nodiscard]] auto pendingChanges() const noexcept -> std::size_t;
+
+    /**
+     *  Applies the pending changes.
+     *
+     *  @param      samples  The store's samples, sorted by timestamp and
+     *                       holding every addition applied before.
+     */
+    void apply(std::vector<core::PmuSample>& samples);
+
+    /**
+     *  Returns the number of samples dropped or merged into a bucket.
+     */
+    [[nodiscard]] auto downsampledCount() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the policy.
+     */
+    [[nodiscard]] auto policy() const noexcept -> const PmuDownsampling&;
+
+    /**
+     *  Forgets all threads and pending changes.
+     */
+    void clear() noexcept;
+
+  private:
+    /**
+     *  A rollup bucket and the stored samples it will replace.
+     */
+    struct Bucket
+    {
+        std::uint64_t index{0};
+        core::PmuSample merged{};
+        std::vector<core::PmuSample> parts;
+    };
+
+    /**
+     *  Downsampling state of one thread.
+     */
+    struct ThreadState
+    {
+        /**
+         *  Samples waiting for migrations, in time order.
+         */
+        std::deque<core::PmuSample> pending;
+
+        /**
+         *  Recent migrations, in time order.
+         */
+        std::deque<std::uint64_t> migrations;
+
+        std::uint64_t newest_ns{0};
+
+        /**
+         *  Reservoir members and the number of samples offered.
+         */
+        std::vector<core::PmuSample> members;
+        std::uint64_t offered{0};
+
+        /**
+         *  Open buckets of each tier, in time order.
+         */
+        std::vector<std::deque<Bucket>> tiers;
+    };
+
+    void decide(ThreadState& thread, std::uint64_t horizon_ns);
+    void offer(ThreadState& thread, const core::PmuSample& sample);
+    void rollUp(ThreadState& thread, std::size_t tier, const core::PmuSample& sample);
+    void closeBuckets(ThreadState& thread, bool all);
+    void close(ThreadState& thread, std::size_t tier);
+    auto nextIndex(std::uint64_t bound) noexcept -> std::uint64_t;
+
+    PmuDownsampling policy_;
+    std::unordered_map<std::uint32_t, ThreadState> threads_;
+    std::vector<core::PmuSample> additions_;
+    std::vector<core::PmuSample> removals_;
+    std::uint64_t rng_state_{0};
+    std::uint64_t downsampled_{0};
+};
+
+}  // namespace threveal::analysis
+
+#endif  // THREVEAL_ANALYSIS_PMU_DOWNSAMPLER_HPP_
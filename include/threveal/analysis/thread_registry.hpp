@@ -0,0 +1,137 @@
+/**
+ *  @file       thread_registry.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Lifetimes of the threads seen during a capture.
+ *
+ *  Over a long capture the kernel hands out a thread ID again once its
+ *  thread has exited. The registry builds each thread's lifetime from its
+ *  lifecycle events and resolves a thread ID at a point in time to the
+ *  thread that held it, so events of unrelated threads are not merged
+ *  into one history.
+ */
+
+#ifndef THREVEAL_ANALYSIS_THREAD_REGISTRY_HPP_
+#define THREVEAL_ANALYSIS_THREAD_REGISTRY_HPP_
+
+#include "threveal/core/events.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <unordered_map>
+
+namespace threveal::analysis
+{
+
+/**
+ *  End time of a thread that has not exited.
+ */
+inline constexpr std::uint64_t kThreadAlive = std::numeric_limits<std::uint64_t>::max();
+
+/**
+ *  One thread's lifetime.
+ */
+struct ThreadLifetime
+{
+    /**
+     *  The thread's ID and start time.
+     */
+    core::ThreadKey key;
+
+    /**
+     *  Process ID the thread belongs to.
+     */
+    std::uint32_t pid{0};
+
+    /**
+     *  Latest command name of the thread.
+     */
+    std::array<char, core::kMaxCommLength> comm{};
+
+    /**
+     *  Time the thread exited, or kThreadAlive.
+     */
+    std::uint64_t end_ns{kThreadAlive};
+
+    /**
+     *  Checks whether the thread held its ID at a point in time.
+     */
+    [[nodiscard]] constexpr auto contains(std::uint64_t timestamp_ns) const noexcept -> bool
+    {
+        return key.start_time_ns <= timestamp_ns && timestamp_ns <= end_ns;
+    }
+};
+
+/**
+ *  Tracks thread lifetimes from lifecycle events.
+ *
+ *  Events may be recorded in any order. Threads without lifecycle events,
+ *  such as those traced without BTF-typed tracepoints, resolve to a key
+ *  with a zero start time, which matches what bare thread IDs did.
+ */
+class ThreadRegistry
+{
+  public:
+    /**
+     *  Constructs an empty registry.
+     */
+    ThreadRegistry() = default;
+
+    /**
+     *  Records a lifecycle event.
+     *
+     *  An exit without a start time ends the thread currently holding
+     *  the ID. A thread starting while another still holds its ID ends
+     *  the older one, whose exit was missed.
+     *
+     *  @param      event  The fork, exec, exit or rename.
+     */
+    void record(const core::ThreadLifecycleEvent& event);
+
+    /**
+     *  Finds the thread that held a thread ID at a point in time.
+     *
+     *  @param      tid           The thread ID.
+     *  @param      timestamp_ns  Point in time, nanoseconds on the trace clock.
+     *  @return     The thread's key, or {tid, 0} if no known thread held
+     *              the ID then.
+     */
+    [[nodiscard]] auto resolve(std::uint32_t tid, std::uint64_t timestamp_ns) const
+        -> core::ThreadKey;
+
+    /**
+     *  Looks up a thread's lifetime.
+     */
+    [[nodiscard]] auto lifetime(const core::ThreadKey& key) const -> std::optional<ThreadLifetime>;
+
+    /**
+     *  Returns the number of threads seen, alive or not.
+     */
+    [[nodiscard]] auto threadCount() const noexcept -> std::size_t;
+
+    /**
+     *  Returns the number of threads that have not exited.
+     */
+    [[nodiscard]] auto liveThreadCount() const noexcept -> std::size_t;
+
+    /**
+     *  Removes all threads.
+     */
+    void clear() noexcept;
+
+  private:
+    auto find(const core::ThreadKey& key) -> ThreadLifetime&;
+
+    std::map<core::ThreadKey, ThreadLifetime> lifetimes_;
+
+    // Start time of the thread holding each ID; dropped on exit
+    std::unordered_map<std::uint32_t, std::uint64_t> live_;
+};
+
+}  // namespace threveal::analysis
+
+#endif  // THREVEAL_ANALYSIS_THREAD_REGISTRY_HPP_
@@ -0,0 +1,215 @@
+/**
+ *  @file       trace_diff.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  A/B comparison of two runs' migration cost and placement.
+ *
+ *  Thread IDs differ between runs, so threads are aligned by command name
+ *  and the order in which threads of that name first appear: the third
+ *  "worker-1" of the baseline is compared with the third "worker-1" of
+ *  the candidate. Aligned pairs are grouped by thread role (see
+ *  threadRole()) and each role is compared on migration rate, P-core
+ *  residency, IPC per core type and warm-up migrations.
+ *
+ *  Significance comes from a paired bootstrap over the aligned threads of
+ *  a role, run in parallel. Roles with too few aligned threads are
+ *  reported without a significance test.
+ */
+
+#ifndef THREVEAL_ANALYSIS_TRACE_DIFF_HPP_
+#define THREVEAL_ANALYSIS_TRACE_DIFF_HPP_
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/core/topology.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+/**
+ *  Quantity compared between two runs.
+ */
+enum class DiffMetric : std::uint8_t
+{
+    /**
+     *  Weighted migrations per second of thread lifetime; higher is worse.
+     */
+    kMigrationRate = 0,
+
+    /**
+     *  Fraction of time between migrations spent on P-cores; lower is
+     *  worse.
+     */
+    kPCoreResidency = 1,
+
+    /**
+     *  Instructions per cycle in PMU samples taken on P-cores; lower is
+     *  worse.
+     */
+    kPCoreIpc = 2,
+
+    /**
+     *  Instructions per cycle in PMU samples taken on E-cores; lower is
+     *  worse.
+     */
+    kECoreIpc = 3,
+
+    /**
+     *  Weighted migrations per thread within the warm-up window after the
+     *  thread first appears; higher is worse.
+     */
+    kWarmupMigrations = 4,
+};
+
+/**
+ *  Returns a short name for a metric.
+ */
+[[nodiscard]] constexpr auto toString(DiffMetric metric) noexcept -> std::string_view
+{
+    switch (metric)
+    {
+        case DiffMetric::kMigrationRate:
+            return "migration_rate";
+        case DiffMetric::kPCoreResidency:
+            return "p_core_residency";
+        case DiffMetric::kPCoreIpc:
+            return "p_core_ipc";
+        case DiffMetric::kECoreIpc:
+            return "e_core_ipc";
+        case DiffMetric::kWarmupMigrations:
+            return "warmup_migrations";
+    }
+    return "invalid";
+}
+
+/**
+ *  Options for diffRuns().
+ */
+struct TraceDiffOptions
+{
+    /**
+     *  Bootstrap resamples per role; at least one is drawn.
+     */
+    std::size_t bootstrap_samples{1000};
+
+    /**
+     *  Significance level; also sets the confidence interval to 1 - alpha.
+     */
+    double alpha{0.05};
+
+    /**
+     *  Time after a thread first appears that counts as warm-up.
+     */
+    std::chrono::nanoseconds warmup{std::chrono::seconds(1)};
+
+    /**
+     *  Aligned threads a role needs before it is tested for significance.
+     */
+    std::size_t min_threads{2};
+
+    /**
+     *  Number of worker threads; 0 uses the hardware concurrency.
+     */
+    std::size_t threads{0};
+
+    /**
+     *  Seed of the bootstrap; results do not depend on the worker count.
+     */
+    std::uint64_t seed{0x746872657665616cULL};
+};
+
+/**
+ *  Comparison of one metric for one thread role.
+ */
+struct DiffEntry
+{
+    std::string role;
+    DiffMetric metric{DiffMetric::kMigrationRate};
+
+    /**
+     *  Aligned thread pairs the comparison is based on.
+     */
+    std::size_t threads{0};
+
+    double baseline{0.0};
+    double candidate{0.0};
+
+    /**
+     *  candidate / baseline - 1; infinite if only the candidate is
+     *  non-zero.
+     */
+    double relative_change{0.0};
+
+    /**
+     *  Bootstrap confidence interval of candidate - baseline.
+     */
+    double ci_low{0.0};
+    double ci_high{0.0};
+
+    /**
+     *  Two-sided bootstrap p-value; 1 for roles that were not tested.
+     */
+    double p_value{1.0};
+
+    /**
+     *  Significant change in the worse direction.
+     */
+    bool regression{false};
+};
+
+/**
+ *  Result of diffRuns().
+ */
+struct TraceDiff
+{
+    /**
+     *  Regressions first, largest relative change in the worse direction
+     *  first, followed by every other comparison.
+     */
+    std::vector<DiffEntry> entries;
+
+    /**
+     *  Threads present in both runs.
+     */
+    std::size_t aligned_threads{0};
+
+    /**
+     *  Threads only present in the baseline.
+     */
+    std::size_t unmatched_baseline{0};
+
+    /**
+     *  Threads only present in the candidate.
+     */
+    std::size_t unmatched_candidate{0};
+};
+
+/**
+ *  Compares a candidate run against a baseline.
+ *
+ *  Migrations are classified with the core types stamped by the producer,
+ *  or with the run's topology when not stamped. PMU samples are
+ *  attributed to the core type of their CPU and only count for threads
+ *  that migrated.
+ *
+ *  @param      baseline           Events of the reference run.
+ *  @param      baseline_topology  Topology of the reference host.
+ *  @param      candidate          Events of the run under test.
+ *  @param      candidate_topology Topology of the host under test.
+ *  @param      options            Bootstrap and parallelism.
+ *  @return     The ranked comparisons.
+ */
+[[nodiscard]] auto diffRuns(const EventStore& baseline, const core::TopologyMap& baseline_topology,
+                            const EventStore& candidate,
+                            const core::TopologyMap& candidate_topology,
+                            const TraceDiffOptions& options = {}) -> TraceDiff;
+
+}  // namespace threveal::analysis
+
+#endif  // THREVEAL_ANALYSIS_TRACE_DIFF_HPP_
@@ -0,0 +1,162 @@
+/**
+ *  @file       trace_file.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  On-disk trace format for collected migrations.
+ *
+ *  A trace starts with a short text header naming the host and holding
+ *  its topology snapshot and clock offsets, so traces from different
+ *  machines can be interpreted and lined up without access to the host.
+ *  Fixed-size little-endian migration records follow the header. Records
+ *  are read in caller-sized batches, so a trace never has to fit in
+ *  memory.
+ */
+
+#ifndef THREVEAL_ANALYSIS_TRACE_FILE_HPP_
+#define THREVEAL_ANALYSIS_TRACE_FILE_HPP_
+
+#include "threveal/core/clock.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+/**
+ *  Version of the trace format written by writeTrace().
+ */
+inline constexpr std::uint32_t kTraceFormatVersion = 1;
+
+/**
+ *  Size in bytes of one encoded migration record.
+ */
+inline constexpr std::size_t kTraceRecordSize = 50;
+
+/**
+ *  Metadata stored at the start of a trace.
+ */
+struct TraceHeader
+{
+    /**
+     *  Name of the host the trace was collected on.
+     */
+    std::string host;
+
+    /**
+     *  Clock readings taken during collection, if recorded.
+     */
+    std::optional<core::ClockSnapshot> clock;
+
+    /**
+     *  CPU topology of the host.
+     */
+    core::TopologyMap topology;
+
+    /**
+     *  Number of migration records in the trace.
+     *
+     *  Ignored by writeTrace(), which stores the actual count.
+     */
+    std::uint64_t migration_count{0};
+};
+
+/**
+ *  Formats the text header of a trace, without the data marker.
+ *
+ *  The same text describes a producer in other transports, such as the
+ *  stream protocol's hello frame.
+ *
+ *  @param      header  Host metadata; migration_count is written as is.
+ *  @return     The header lines, or TraceError::kInvalidHeader if the host
+ *              name contains a line break.
+ */
+[[nodiscard]] auto formatTraceHeader(const TraceHeader& header)
+    -> std::expected<std::string, core::TraceError>;
+
+/**
+ *  Parses text produced by formatTraceHeader().
+ *
+ *  @param      text  The header lines.
+ *  @return     The header, or TraceError on malformed text.
+ */
+[[nodiscard]] auto parseTraceHeader(std::string_view text)
+    -> std::expected<TraceHeader, core::TraceError>;
+
+/**
+ *  Writes a trace file, replacing any existing file.
+ *
+ *  @param      path        Destination path.
+ *  @param      header      Host metadata.
+ *  @param      migrations  Migrations to store, in any order.
+ *  @return     Success, or TraceError on failure.
+ */
+[[nodiscard]] auto writeTrace(const std::string& path, const TraceHeader& header,
+                              std::span<const core::MigrationEvent> migrations)
+    -> std::expected<void, core::TraceError>;
+
+/**
+ *  Streaming reader for trace files.
+ */
+class TraceReader
+{
+  public:
+    /**
+     *  Opens a trace and parses its header.
+     *
+     *  @param      path  The trace file.
+     *  @return     The reader, or TraceError on failure.
+     */
+    [[nodiscard]] static auto open(const std::string& path)
+        -> std::expected<TraceReader, core::TraceError>;
+
+    ~TraceReader();
+
+    TraceReader(const TraceReader&) = delete;
+    auto operator=(const TraceReader&) -> TraceReader& = delete;
+
+    TraceReader(TraceReader&& other) noexcept;
+    auto operator=(TraceReader&& other) noexcept -> TraceReader&;
+
+    /**
+     *  Returns the parsed header.
+     */
+    [[nodiscard]] auto header() const noexcept -> const TraceHeader&;
+
+    /**
+     *  Returns the number of records not read yet.
+     */
+    [[nodiscard]] auto remaining() const noexcept -> std::uint64_t;
+
+    /**
+     *  Reads the next batch of migrations.
+     *
+     *  @param      out  Destination; up to out.size() records are read.
+     *  @return     Number of records read (0 at the end of the trace), or
+     *              TraceError::kReadFailed if the file is truncated.
+     */
+    [[nodiscard]] auto read(std::span<core::MigrationEvent> out)
+        -> std::expected<std::size_t, core::TraceError>;
+
+  private:
+    TraceReader(int fd, TraceHeader header, std::vector<std::byte> pending) noexcept;
+
+    int fd_{-1};
+    TraceHeader header_;
+    std::uint64_t remaining_{0};
+    std::vector<std::byte> buffer_;
+    std::size_t buffer_pos_{0};
+};
+
+}  // namespace threveal::analysis
+
+#endif  // THREVEAL_ANALYSIS_TRACE_FILE_HPP_
@@ -8,11 +8,20 @@
 #ifndef THREVEAL_COLLECTION_EBPF_LOADER_HPP_
 #define THREVEAL_COLLECTION_EBPF_LOADER_HPP_
 
+#include "threveal/collection/thread_activity.hpp"
 #include "threveal/core/errors.hpp"
+#include "threveal/core/clock.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
 
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <expected>
+#include <string>
 #include <string_view>
+#include <vector>
 
 // Forward declaration of the generated skeleton structure (name from libbpf)
 struct migration_tracker_bpf;
@@ -54,6 +63,11 @@ enum class EbpfError : std::uint8_t
      *  Permission denied (requires CAP_BPF or root).
      */
     kPermissionDenied = 6,
+
+    /**
+     *  Failed to create, reuse or remove pins in bpffs.
+     */
+    kPinFailed = 7,
 };
 
 /**
@@ -78,10 +92,152 @@ enum class EbpfError : std::uint8_t
             return "failed to access BPF map";
         case EbpfError::kPermissionDenied:
             return "permission denied for BPF operations";
+        case EbpfError::kPinFailed:
+            return "failed to pin BPF objects";
     }
     return "unknown eBPF error";
 }
 
+/**
+ *  Default bpffs directory for pinned objects.
+ */
+inline constexpr std::string_view kDefaultPinRoot = "/sys/fs/bpf/threveal";
+
+/**
+ *  Upper bound for EbpfLoaderOptions::ring_shards.
+ *
+ *  This must match MAX_RING_SHARDS in bpf_common.h.
+ */
+inline constexpr std::uint32_t kMaxRingShards = 256;
+
+/**
+ *  Largest 1-in-N sampling rate the BPF program accepts.
+ *
+ *  This must match MAX_SAMPLE_RATE in bpf_common.h.
+ */
+inline constexpr std::uint32_t kMaxSampleRate = 65535;
+
+/**
+ *  Outcome of EbpfLoader::benchmarkProgram().
+ */
+struct ProgramBenchmark
+{
+    /**
+     *  Number of BPF_PROG_RUN invocations.
+     */
+    std::uint64_t runs{0};
+
+    /**
+     *  Time spent inside the program, as accounted by the kernel's BPF
+     *  run-time statistics.
+     */
+    std::chrono::nanoseconds program_time{0};
+
+    /**
+     *  Wall time of the whole run, including the system calls.
+     */
+    std::chrono::nanoseconds wall_time{0};
+};
+
+/**
+ *  In-kernel state of one traced thread, as read by
+ *  EbpfLoader::threadStates().
+ */
+struct ThreadState
+{
+    /**
+     *  Process ID of the thread.
+     */
+    std::uint32_t pid{0};
+
+    /**
+     *  Thread ID.
+     */
+    std::uint32_t tid{0};
+
+    /**
+     *  CPU the thread last migrated to.
+     */
+    core::CpuId last_cpu{0};
+
+    /**
+     *  Time of the last migration, kept or not, on clockSource().
+     */
+    std::uint64_t last_migration_ns{0};
+
+    /**
+     *  Tokens left in the rate-limiting bucket; 0 before the thread was
+     *  first rate-limited.
+     */
+    double tokens{0.0};
+
+    /**
+     *  Migrations suppressed and not yet reported.
+     */
+    std::uint64_t suppressed{0};
+
+    /**
+     *  Phase annotation set by EbpfLoader::setThreadPhase(); 0 when unset.
+     */
+    std::uint32_t phase{0};
+
+    /**
+     *  Whether the thread's command name has reached userspace.
+     */
+    bool comm_sent{false};
+};
+
+/**
+ *  Options controlling how the BPF object is loaded.
+ */
+struct EbpfLoaderOptions
+{
+    /**
+     *  Pin maps and the attachment link in bpffs and reuse them on start.
+     *
+     *  A warm start skips verifying the migration handler and keeps the
+     *  in-kernel map state of the previous run, except that each thread's
+     *  identity is sent again for the new run's decoder. The handler's
+     *  attachment stays active after the loader is destroyed;
+     *  EbpfLoader::unpinAll() removes it. The thread lifecycle hooks are
+     *  not pinned and are attached by each loader, including on a warm
+     *  start.
+     */
+    bool pinned{false};
+
+    /**
+     *  bpffs directory holding one subdirectory per BPF object version.
+     */
+    std::string pin_root{kDefaultPinRoot};
+
+    /**
+     *  Number of ring buffers events are sharded across by CPU.
+     *
+     *  Zero uses the single shared events ring. Any other value (up to
+     *  kMaxRingShards) gives each group of CPUs its own ring, so producers
+     *  do not contend on one ring's lock; the number of possible CPUs gives
+     *  one ring per CPU.
+     */
+    std::uint32_t ring_shards{0};
+
+    /**
+     *  Record which threads ran, for EbpfLoader::threadActivity().
+     *
+     *  Adds a handler on every context switch, so it costs more than the
+     *  migration handler. Like the lifecycle hooks it is never pinned and
+     *  is attached by each loader.
+     */
+    bool track_activity{false};
+
+    /**
+     *  Load the harness EbpfLoader::benchmarkProgram() runs.
+     *
+     *  The harness keeps per-thread state from a raw tracepoint, which
+     *  needs Linux 5.13 or later; it is never attached.
+     */
+    bool benchmark{false};
+};
+
 /**
  *  Wrapper for the migration_tracker eBPF program.
  */
@@ -91,9 +247,33 @@ class EbpfLoader
     /**
      *  Creates and loads a new EbpfLoader instance.
      *
+     *  In pinned mode, pins are kept under a subdirectory named after
+     *  objectVersionHash(). Pins left by other versions of the object are
+     *  removed, so maps with a stale layout are never reused. A loader that
+     *  reuses a pinned attachment starts out attached, hooks included.
+     *
+     *  @param      options  Load options.
      *  @return     An EbpfLoader on success, or EbpfError on failure.
      */
-    [[nodiscard]] static auto create() -> std::expected<EbpfLoader, EbpfError>;
+    [[nodiscard]] static auto create(const EbpfLoaderOptions& options = {})
+        -> std::expected<EbpfLoader, EbpfError>;
+
+    /**
+     *  Returns a hash identifying the embedded BPF object.
+     *
+     *  The object carries its own BTF, so any change to programs, map
+     *  definitions or shared structures changes the hash.
+     */
+    [[nodiscard]] static auto objectVersionHash() noexcept -> std::uint64_t;
+
+    /**
+     *  Removes every pin under a pin root, detaching pinned programs.
+     *
+     *  @param      pin_root  bpffs directory passed as EbpfLoaderOptions::pin_root.
+     *  @return     Success or EbpfError::kPinFailed.
+     */
+    [[nodiscard]] static auto unpinAll(std::string_view pin_root = kDefaultPinRoot)
+        -> std::expected<void, EbpfError>;
 
     /**
      *  Destroys the loader and releases all BPF resources.
@@ -107,14 +287,21 @@ class EbpfLoader
     auto operator=(const EbpfLoader&) -> EbpfLoader& = delete;
 
     /**
-     *  Attaches the BPF program to its tracepoint.
+     *  Attaches the migration handler and the thread lifecycle hooks.
+     *
+     *  In pinned mode a pinned migration handler is reused and only the
+     *  hooks are attached.
      *
      *  @return     Success or EbpfError on failure.
      */
     [[nodiscard]] auto attach() -> std::expected<void, EbpfError>;
 
     /**
-     *  Detaches the BPF program from its tracepoint.
+     *  Detaches the migration handler and the thread lifecycle hooks.
+     *
+     *  In pinned mode only this loader's handle on the migration handler
+     *  is released; the pinned attachment keeps running until
+     *  unpinAll(). A later attach() attaches the hooks again.
      */
     void detach() noexcept;
 
@@ -126,6 +313,110 @@ class EbpfLoader
      */
     [[nodiscard]] auto setTargetPid(std::uint32_t pid) -> std::expected<void, EbpfError>;
 
+    /**
+     *  Sets the global 1-in-N sampling rate.
+     *
+     *  Kept events record the rate as their sample weight.
+     *
+     *  @param      rate  Sampling rate; 0 and 1 keep every event.
+     *  @return     Success, EbpfError::kInvalidState if the rate exceeds
+     *              kMaxSampleRate, or another EbpfError on failure.
+     */
+    [[nodiscard]] auto setSampleRate(std::uint32_t rate) -> std::expected<void, EbpfError>;
+
+    /**
+     *  Sets a sampling rate for one process, overriding the global rate.
+     *
+     *  @param      tgid  Process ID.
+     *  @param      rate  Sampling rate, or 0 to remove the override.
+     *  @return     Success, EbpfError::kInvalidState if the rate exceeds
+     *              kMaxSampleRate, or another EbpfError on failure.
+     */
+    [[nodiscard]] auto setTgidSampleRate(std::uint32_t tgid, std::uint32_t rate)
+        -> std::expected<void, EbpfError>;
+
+    /**
+     *  Limits how many migrations per second each thread may stream.
+     *
+     *  Each thread gets a token bucket of burst tokens refilled at
+     *  events_per_sec. Migrations without a token are counted in the
+     *  kernel and reported later as suppression summaries.
+     *
+     *  @param      events_per_sec  Refill rate, or 0 to disable limiting.
+     *  @param      burst           Bucket capacity (at least 1 is used).
+     *  @return     Success or EbpfError on failure.
+     */
+    [[nodiscard]] auto setThreadRateLimit(std::uint32_t events_per_sec, std::uint32_t burst)
+        -> std::expected<void, EbpfError>;
+
+    /**
+     *  Reads and resets suppressed counts still held in the token buckets.
+     *
+     *  Counts are normally reported through the ring buffer when a thread
+     *  is admitted again; this collects the rest, e.g. when stopping.
+     *  Migrations suppressed while collecting may be missed.
+     *
+     *  @return     One summary per thread with unreported suppressions, or
+     *              EbpfError on failure.
+     */
+    [[nodiscard]] auto collectSuppressed()
+        -> std::expected<std::vector<core::SuppressionSummary>, EbpfError>;
+
+    /**
+     *  Reads the state of every thread that migrated while traced.
+     *
+     *  The state lives in task-local storage and is freed when its thread
+     *  exits, so only live threads are reported. It is read through a
+     *  task iterator in one pass, without a lookup per thread.
+     *
+     *  @return     One entry per thread, or EbpfError on failure.
+     */
+    [[nodiscard]] auto threadStates() const -> std::expected<std::vector<ThreadState>, EbpfError>;
+
+    /**
+     *  Annotates a thread with an application phase.
+     *
+     *  The annotation is kept with the thread's state in the kernel and
+     *  reported by threadStates(). Threads other than a process's main
+     *  thread need Linux 6.9 or later.
+     *
+     *  @param      tid    Thread ID.
+     *  @param      phase  Phase number, or 0 to clear it.
+     *  @return     Success, EbpfError::kInvalidState if the thread does not
+     *              exist, or another EbpfError on failure.
+     */
+    [[nodiscard]] auto setThreadPhase(std::uint32_t tid, std::uint32_t phase)
+        -> std::expected<void, EbpfError>;
+
+    /**
+     *  Loads a topology into the in-kernel CPU to core type map.
+     *
+     *  The per-CPU types are written first and the generation last, so
+     *  events stamped with the new generation always see the new types.
+     *
+     *  @param      topology    The topology to install.
+     *  @param      generation  Generation number to stamp on events.
+     *  @return     Success or EbpfError on failure.
+     */
+    [[nodiscard]] auto setTopology(const core::TopologyMap& topology,
+                                   core::TopologyGeneration generation)
+        -> std::expected<void, EbpfError>;
+
+    /**
+     *  Maps the per-thread activity flags into this process.
+     *
+     *  The mapping is made on the first call and kept until the loader is
+     *  destroyed; the view must not outlive the loader. The flags are only
+     *  kept up to date while the loader is attached: detach() marks every
+     *  thread as on a CPU, and attach() marks every thread as having run
+     *  and reads which threads are on a CPU from the kernel.
+     *
+     *  @return     A view of the flags, EbpfError::kInvalidState unless the
+     *              loader was created with track_activity, or
+     *              kMapAccessFailed if mapping fails.
+     */
+    [[nodiscard]] auto threadActivity() -> std::expected<ThreadActivityMap, EbpfError>;
+
     /**
      *  Returns the file descriptor for the events ring buffer.
      *
@@ -135,6 +426,45 @@ class EbpfLoader
      */
     [[nodiscard]] auto ringBufferFd() const noexcept -> int;
 
+    /**
+     *  Returns the file descriptors of every ring events are written to.
+     *
+     *  This is the shared events ring, or one fd per shard when sharding
+     *  is enabled. The index of an fd is its shard index.
+     *
+     *  @return     The ring buffer fds, or an empty vector if not valid.
+     */
+    [[nodiscard]] auto ringBufferFds() const -> std::vector<int>;
+
+    /**
+     *  Reads the number of events dropped because their ring was full.
+     *
+     *  @return     One counter per ring, in ringBufferFds() order, or
+     *              EbpfError on failure.
+     */
+    [[nodiscard]] auto ringDrops() const -> std::expected<std::vector<std::uint64_t>, EbpfError>;
+
+    /**
+     *  Times the migration handler by running it through BPF_PROG_RUN.
+     *
+     *  tp_btf programs cannot be test-run, so each run goes through a
+     *  raw_tp harness that takes the tp_btf handler's path with the
+     *  calling thread as the migrated task: its state, token bucket and
+     *  identity cache, and a record written for every admitted run. The
+     *  target PID filter is skipped, while the thread rate limit applies
+     *  as configured. The rings are drained as it goes. BPF run-time
+     *  statistics are enabled for the duration, giving the in-kernel cost
+     *  per invocation without the system call.
+     *
+     *  @param      runs      Number of invocations.
+     *  @param      dest_cpu  Destination CPU passed to the handler.
+     *  @return     The timings, EbpfError::kInvalidState unless the loader
+     *              was created with benchmark and is detached, or another
+     *              EbpfError on failure.
+     */
+    [[nodiscard]] auto benchmarkProgram(std::uint64_t runs, std::uint32_t dest_cpu = 0)
+        -> std::expected<ProgramBenchmark, EbpfError>;
+
     /**
      *  Checks if the BPF program is currently attached.
      */
@@ -145,10 +475,50 @@ class EbpfLoader
      */
     [[nodiscard]] auto isValid() const noexcept -> bool;
 
+    /**
+     *  Checks if the loader was created in pinned mode.
+     */
+    [[nodiscard]] auto isPinned() const noexcept -> bool;
+
+    /**
+     *  Checks if an existing pinned attachment was reused on creation.
+     */
+    [[nodiscard]] auto reusedPins() const noexcept -> bool;
+
+    /**
+     *  Returns the versioned pin directory, or an empty string if not pinned.
+     */
+    [[nodiscard]] auto pinDirectory() const noexcept -> const std::string&;
+
+    /**
+     *  Returns the clock the BPF program stamps events with.
+     *
+     *  This is core::traceClock() as it was when the loader was created.
+     */
+    [[nodiscard]] auto clockSource() const noexcept -> core::ClockSource;
+
   private:
-    explicit EbpfLoader(migration_tracker_bpf* skel) noexcept;
+    EbpfLoader(migration_tracker_bpf* skel, std::string pin_dir, int pinned_link_fd,
+               std::vector<int> shard_fds, core::ClockSource clock) noexcept;
+
+    /**
+     *  Releases all resources, leaving pinned objects in place.
+     */
+    void reset() noexcept;
 
     migration_tracker_bpf* skel_;
+    std::string pin_dir_;
+    int pinned_link_fd_{-1};
+    std::vector<int> shard_fds_;
+    core::ClockSource clock_{core::ClockSource::kMonotonic};
+
+    /**
+     *  Mapping of the thread_activity map, made by threadActivity().
+     */
+    void* activity_{nullptr};
+    std::size_t activity_bytes_{0};
+
+    bool reused_pins_{false};
     bool attached_{false};
 };
 
@@ -0,0 +1,222 @@
+/**
+ *  @file       energy_sampler.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Periodic RAPL energy sampling via the Linux powercap interface.
+ *
+ *  Reads the package and cores RAPL domains from /sys/class/powercap at the
+ *  same cadence as PmuSampler so energy can be attributed to threads by the
+ *  cycles they spent on each core type.
+ */
+
+#ifndef THREVEAL_COLLECTION_ENERGY_SAMPLER_HPP_
+#define THREVEAL_COLLECTION_ENERGY_SAMPLER_HPP_
+
+#include "threveal/collection/pmu_sampler.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace threveal::collection
+{
+
+/**
+ *  RAPL domains tracked by the energy sampler.
+ */
+enum class EnergyDomain : std::uint8_t
+{
+    /**
+     *  Whole-package energy (powercap "package-N" zones).
+     */
+    kPackage = 0,
+
+    /**
+     *  Core (PP0) energy, covering both P-cores and E-cores.
+     */
+    kCores = 1,
+};
+
+/**
+ *  Converts an EnergyDomain to its human-readable string representation.
+ *
+ *  @param      domain  The domain to convert.
+ *  @return     A string view naming the domain.
+ */
+[[nodiscard]] constexpr auto toString(EnergyDomain domain) noexcept -> std::string_view
+{
+    switch (domain)
+    {
+        case EnergyDomain::kPackage:
+            return "energy-pkg";
+        case EnergyDomain::kCores:
+            return "energy-cores";
+    }
+    return "unknown";
+}
+
+/**
+ *  Periodic sampler for RAPL energy counters.
+ */
+class EnergySampler
+{
+  public:
+    /**
+     *  Callback type for delivering energy samples.
+     */
+    using SampleCallback = std::function<void(const core::EnergySample&)>;
+
+    /**
+     *  Default powercap sysfs root.
+     */
+    static constexpr std::string_view kDefaultPowercapRoot = "/sys/class/powercap";
+
+    /**
+     *  Creates a new energy sampler reading RAPL zones under a powercap root.
+     *
+     *  The root is pluggable so tests can point the sampler at a fake
+     *  powercap tree containing intel-rapl:N directories.
+     *
+     *  @param      callback       Function to receive energy samples.
+     *  @param      interval       Time between samples (default: PMU cadence).
+     *  @param      powercap_root  Directory containing intel-rapl zones.
+     *  @return     An EnergySampler on success, or EnergyError on failure.
+     */
+    [[nodiscard]] static auto create(SampleCallback callback,
+                                     std::chrono::microseconds interval =
+                                         PmuSampler::kDefaultInterval,
+                                     std::string_view powercap_root = kDefaultPowercapRoot)
+        -> std::expected<EnergySampler, core::EnergyError>;
+
+    /**
+     *  Destroys the sampler, stopping sampling and closing counter files.
+     */
+    ~EnergySampler();
+
+    /**
+     *  Move constructor.
+     *
+     *  @param      other  Sampler to move from (will be invalidated).
+     */
+    EnergySampler(EnergySampler&& other) noexcept;
+
+    /**
+     *  Move assignment operator.
+     *
+     *  @param      other  Sampler to move from (will be invalidated).
+     *  @return     Reference to this sampler.
+     */
+    auto operator=(EnergySampler&& other) noexcept -> EnergySampler&;
+
+    // Non-copyable
+    EnergySampler(const EnergySampler&) = delete;
+    auto operator=(const EnergySampler&) -> EnergySampler& = delete;
+
+    /**
+     *  Starts periodic sampling.
+     *
+     *  @return     Success, or EnergyError if already running or the baseline
+     *              read fails.
+     */
+    [[nodiscard]] auto start() -> std::expected<void, core::EnergyError>;
+
+    /**
+     *  Stops periodic sampling.
+     */
+    void stop() noexcept;
+
+    /**
+     *  Reads all domains once and returns the energy consumed since the
+     *  previous read.
+     *
+     *  Counter wraparound is handled using each zone's max_energy_range_uj.
+     *  Called by the sampling thread; exposed for synchronous use and tests.
+     *
+     *  @return     The energy sample on success, or EnergyError on failure.
+     */
+    [[nodiscard]] auto collectSample() -> std::expected<core::EnergySample, core::EnergyError>;
+
+    /**
+     *  Checks whether a domain was found under the powercap root.
+     *
+     *  @param      domain  The domain to query.
+     *  @return     True if at least one zone of that domain is being read.
+     */
+    [[nodiscard]] auto hasDomain(EnergyDomain domain) const noexcept -> bool;
+
+    /**
+     *  Checks if sampling is currently active.
+     *
+     *  @return     True if the sampling thread is running.
+     */
+    [[nodiscard]] auto isRunning() const noexcept -> bool;
+
+    /**
+     *  Returns the number of samples collected since start().
+     *
+     *  @return     The total sample count.
+     */
+    [[nodiscard]] auto sampleCount() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the configured sampling interval.
+     *
+     *  @return     The interval between samples.
+     */
+    [[nodiscard]] auto interval() const noexcept -> std::chrono::microseconds;
+
+  private:
+    /**
+     *  An open RAPL zone counter.
+     */
+    struct Zone
+    {
+        EnergyDomain domain;
+        int fd;
+        std::uint64_t max_range_uj;
+        std::uint64_t last_uj;
+    };
+
+    /**
+     *  Private constructor - use create() factory method.
+     *
+     *  @param      zones     Opened RAPL zones.
+     *  @param      callback  Function to receive samples.
+     *  @param      interval  Time between samples.
+     */
+    EnergySampler(std::vector<Zone> zones, SampleCallback callback,
+                  std::chrono::microseconds interval) noexcept;
+
+    /**
+     *  Sampling thread entry point.
+     *
+     *  @param      stop_token  Token for cooperative cancellation.
+     */
+    void samplingLoop(const std::stop_token& stop_token);
+
+    /**
+     *  Closes all open zone counters.
+     */
+    void closeAll() noexcept;
+
+    std::vector<Zone> zones_;
+    SampleCallback callback_;
+    std::chrono::microseconds interval_;
+
+    std::jthread sampling_thread_;
+    std::atomic<std::uint64_t> sample_count_{0};
+    std::atomic<bool> running_{false};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_ENERGY_SAMPLER_HPP_
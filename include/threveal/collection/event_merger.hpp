@@ -0,0 +1,104 @@
+/**
+ *  @file       event_merger.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  K-way timestamp merge of migration events from several ring buffers.
+ *
+ *  Rings are consumed in arbitrary order, and a ring shared by several
+ *  CPUs is not ordered either: each CPU reads the clock before reserving
+ *  its record, so records from different CPUs can commit out of
+ *  timestamp order. The merger keeps each source's buffer sorted and
+ *  releases events in global timestamp order up to a watermark below
+ *  which no ring can still deliver an older event.
+ */
+
+#ifndef THREVEAL_COLLECTION_EVENT_MERGER_HPP_
+#define THREVEAL_COLLECTION_EVENT_MERGER_HPP_
+
+#include "threveal/core/events.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace threveal::collection
+{
+
+/**
+ *  Receives merged events in timestamp order.
+ */
+using MergedEventSink = std::function<void(const core::MigrationEvent&)>;
+
+/**
+ *  Merges per-source ordered event streams into one ordered stream.
+ */
+class EventMerger
+{
+  public:
+    /**
+     *  Creates a merger for a fixed number of sources.
+     *
+     *  @param      source_count  Number of input streams (e.g. ring buffers).
+     */
+    explicit EventMerger(std::size_t source_count);
+
+    /**
+     *  Buffers an event from one source.
+     *
+     *  Events from the same source may arrive out of timestamp order;
+     *  each is inserted behind the buffered events that are not newer,
+     *  which is cheap while they are only slightly out of order.
+     *
+     *  @param      source  Source index in [0, sourceCount()).
+     *  @param      event   The event to buffer.
+     */
+    void push(std::size_t source, const core::MigrationEvent& event);
+
+    /**
+     *  Emits buffered events with timestamps at or below a watermark.
+     *
+     *  @param      watermark_ns  No source may still deliver an event older
+     *                            than this timestamp.
+     *  @param      sink          Receives the events in timestamp order.
+     *  @return     Number of events emitted.
+     */
+    auto drainUntil(std::uint64_t watermark_ns, const MergedEventSink& sink) -> std::size_t;
+
+    /**
+     *  Emits every buffered event in timestamp order.
+     *
+     *  @param      sink  Receives the events.
+     *  @return     Number of events emitted.
+     */
+    auto flush(const MergedEventSink& sink) -> std::size_t;
+
+    /**
+     *  Returns the number of buffered events.
+     */
+    [[nodiscard]] auto pending() const noexcept -> std::size_t;
+
+    /**
+     *  Returns the number of sources.
+     */
+    [[nodiscard]] auto sourceCount() const noexcept -> std::size_t;
+
+    /**
+     *  Returns how many events arrived older than an already emitted event.
+     *
+     *  Late events are still emitted, but out of order. A non-zero count
+     *  means the watermark slack is too small.
+     */
+    [[nodiscard]] auto lateEvents() const noexcept -> std::uint64_t;
+
+  private:
+    std::vector<std::deque<core::MigrationEvent>> queues_;
+    std::size_t pending_{0};
+    std::uint64_t last_emitted_ns_{0};
+    std::uint64_t late_events_{0};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_EVENT_MERGER_HPP_
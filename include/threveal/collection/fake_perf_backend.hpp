@@ -0,0 +1,202 @@
+/**
+ *  @file       fake_perf_backend.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  In-process PMU model for running the collectors without perf_event.
+ *
+ *  Counters advance only when the test advances the fake clock. Each
+ *  enabled counter accumulates the time its thread spends on P-cores and
+ *  E-cores, and its value is derived from that time with the core type's
+ *  model using integer arithmetic, so the same calls always produce the
+ *  same values.
+ */
+
+#ifndef THREVEAL_COLLECTION_FAKE_PERF_BACKEND_HPP_
+#define THREVEAL_COLLECTION_FAKE_PERF_BACKEND_HPP_
+
+#include "threveal/collection/perf_backend.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+namespace threveal::collection
+{
+
+/**
+ *  Event rates of one core type.
+ *
+ *  Rates are integers per thousand of the parent event, so that for
+ *  example IPC is exactly instructions_per_kcycle / 1000.
+ */
+struct FakePmuModel
+{
+    std::uint64_t cycles_per_us{0};
+    std::uint64_t instructions_per_kcycle{0};
+    std::uint64_t llc_loads_per_kinstruction{0};
+    std::uint64_t llc_misses_per_kload{0};
+    std::uint64_t branch_misses_per_kinstruction{0};
+
+    /**
+     *  Returns the count of an event after running for a duration.
+     */
+    [[nodiscard]] constexpr auto count(PmuEventType event,
+                                       std::chrono::nanoseconds active) const noexcept
+        -> std::uint64_t
+    {
+        auto cycles = static_cast<std::uint64_t>(active.count()) * cycles_per_us / 1000;
+        auto instructions = cycles * instructions_per_kcycle / 1000;
+        auto llc_loads = instructions * llc_loads_per_kinstruction / 1000;
+        switch (event)
+        {
+            case PmuEventType::kCycles:
+                return cycles;
+            case PmuEventType::kInstructions:
+                return instructions;
+            case PmuEventType::kLlcLoads:
+                return llc_loads;
+            case PmuEventType::kLlcLoadMisses:
+                return llc_loads * llc_misses_per_kload / 1000;
+            case PmuEventType::kBranchMisses:
+                return instructions * branch_misses_per_kinstruction / 1000;
+        }
+        return 0;
+    }
+};
+
+/**
+ *  P-core model: 4 GHz, IPC 2.0, 25% LLC miss rate.
+ */
+inline constexpr FakePmuModel kFakePCoreModel{4000, 2000, 20, 250, 5};
+
+/**
+ *  E-core model: 3 GHz, IPC 1.2, 40% LLC miss rate.
+ */
+inline constexpr FakePmuModel kFakeECoreModel{3000, 1200, 20, 400, 8};
+
+/**
+ *  Options for FakePerfBackend.
+ */
+struct FakePerfBackendOptions
+{
+    FakePmuModel p_core{kFakePCoreModel};
+    FakePmuModel e_core{kFakeECoreModel};
+
+    /**
+     *  Time the clock advances before every read; lets a sampler that
+     *  nobody drives see progress. Zero leaves the clock to advance().
+     */
+    std::chrono::nanoseconds read_advance{0};
+};
+
+/**
+ *  PerfBackend that models the counters in process.
+ *
+ *  Threads run on the first P-core (or E-core on a topology without
+ *  P-cores) until moved with setCpu(); counters opened on a specific CPU
+ *  stay there. Time on CPUs outside the topology is not counted.
+ */
+class FakePerfBackend final : public PerfBackend
+{
+  public:
+    /**
+     *  Creates a backend for the given topology.
+     *
+     *  @param      topology  Core types of the modelled CPUs.
+     *  @param      options   Models and clock behaviour.
+     */
+    explicit FakePerfBackend(core::TopologyMap topology, FakePerfBackendOptions options = {});
+
+    [[nodiscard]] auto open(PmuEventType event, pid_t tid, int cpu, int group_fd, bool read_group)
+        -> std::expected<int, core::PmuError> override;
+
+    void close(int fd) noexcept override;
+
+    [[nodiscard]] auto read(int fd, std::span<std::uint64_t> values)
+        -> std::expected<std::size_t, core::PmuError> override;
+
+    [[nodiscard]] auto control(int fd, PerfControl op, bool group)
+        -> std::expected<void, core::PmuError> override;
+
+    [[nodiscard]] auto currentCpu(pid_t tid) const noexcept -> core::CpuId override;
+
+    /**
+     *  Advances the clock, crediting every counting event.
+     */
+    void advance(std::chrono::nanoseconds elapsed);
+
+    /**
+     *  Moves a thread to a CPU; applies from the next advance().
+     */
+    void setCpu(pid_t tid, core::CpuId cpu);
+
+    /**
+     *  Makes every following open() fail with the error, or succeed again
+     *  when empty.
+     */
+    void setOpenError(std::optional<core::PmuError> error);
+
+    /**
+     *  Returns the time advanced since construction.
+     */
+    [[nodiscard]] auto now() const -> std::chrono::nanoseconds;
+
+    /**
+     *  Returns the number of handles not yet closed.
+     */
+    [[nodiscard]] auto openHandles() const -> std::size_t;
+
+  private:
+    /**
+     *  State of one open handle.
+     */
+    struct Counter
+    {
+        PmuEventType event{PmuEventType::kCycles};
+        pid_t tid{0};
+        int cpu{-1};
+        int leader{-1};
+        bool read_group{false};
+        bool enabled{false};
+        std::chrono::nanoseconds p_core_time{0};
+        std::chrono::nanoseconds e_core_time{0};
+
+        /**
+         *  Members of a leader, in the order they joined.
+         */
+        std::vector<int> members;
+    };
+
+    [[nodiscard]] auto cpuOf(const Counter& counter) const noexcept -> core::CpuId;
+    [[nodiscard]] auto isCounting(const Counter& counter) const noexcept -> bool;
+    [[nodiscard]] auto valueOf(const Counter& counter) const noexcept -> std::uint64_t;
+    void advanceLocked(std::chrono::nanoseconds elapsed);
+
+    static constexpr int kFirstHandle = 1 << 20;
+
+    core::TopologyMap topology_;
+    FakePerfBackendOptions options_;
+    core::CpuId default_cpu_{0};
+
+    mutable std::mutex mutex_;
+    std::map<int, Counter> counters_;
+    std::unordered_map<pid_t, core::CpuId> cpus_;
+    std::optional<core::PmuError> open_error_;
+    std::chrono::nanoseconds now_{0};
+    int next_handle_{kFirstHandle};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_FAKE_PERF_BACKEND_HPP_
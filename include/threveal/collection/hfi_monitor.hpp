@@ -0,0 +1,143 @@
+/**
+ *  @file       hfi_monitor.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Collector for Intel Hardware Feedback Interface (HFI) capability updates.
+ *
+ *  On hybrid parts the HFI table ranks each CPU's performance and energy
+ *  efficiency. The intel_hfi driver forwards table changes to userspace as
+ *  THERMAL_GENL_EVENT_CPU_CAPABILITY_CHANGE events on the thermal generic
+ *  netlink family. A file-backed source replays the same updates for tests
+ *  and for hosts without HFI.
+ */
+
+#ifndef THREVEAL_COLLECTION_HFI_MONITOR_HPP_
+#define THREVEAL_COLLECTION_HFI_MONITOR_HPP_
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace threveal::collection
+{
+
+/**
+ *  Callback type for delivering HFI capability updates.
+ */
+using HfiCallback = std::function<void(const core::HfiCapabilityUpdate&)>;
+
+/**
+ *  Monitors per-CPU HFI capability changes.
+ */
+class HfiMonitor
+{
+  public:
+    /**
+     *  Creates a monitor subscribed to thermal netlink capability events.
+     *
+     *  @param      callback  Function to receive capability updates.
+     *  @return     An HfiMonitor on success, or HfiError on failure.
+     */
+    [[nodiscard]] static auto create(HfiCallback callback)
+        -> std::expected<HfiMonitor, core::HfiError>;
+
+    /**
+     *  Creates a monitor that replays updates from a text file.
+     *
+     *  Each non-empty line not starting with '#' holds one update as
+     *  "<cpu> <performance> <efficiency>". Lines appended after creation are
+     *  picked up by subsequent poll() calls, so a test can feed updates
+     *  incrementally.
+     *
+     *  @param      path      Path of the replay file.
+     *  @param      callback  Function to receive capability updates.
+     *  @return     An HfiMonitor on success, or HfiError on failure.
+     */
+    [[nodiscard]] static auto createFromFile(std::string_view path, HfiCallback callback)
+        -> std::expected<HfiMonitor, core::HfiError>;
+
+    /**
+     *  Destroys the monitor and closes its descriptor.
+     */
+    ~HfiMonitor();
+
+    // Move-only semantics
+    HfiMonitor(HfiMonitor&& other) noexcept;
+    auto operator=(HfiMonitor&& other) noexcept -> HfiMonitor&;
+    HfiMonitor(const HfiMonitor&) = delete;
+    auto operator=(const HfiMonitor&) -> HfiMonitor& = delete;
+
+    /**
+     *  Delivers pending capability updates to the callback.
+     *
+     *  The netlink source waits up to timeout for a message; the file source
+     *  never blocks.
+     *
+     *  @param      timeout  Maximum time to wait for updates.
+     *  @return     Number of updates delivered, or -1 on error.
+     */
+    [[nodiscard]] auto poll(std::chrono::milliseconds timeout) -> int;
+
+    /**
+     *  Returns the total number of updates delivered.
+     */
+    [[nodiscard]] auto updateCount() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the underlying descriptor, for integration into an event loop.
+     *
+     *  @return     The netlink socket or file descriptor, or -1 if invalid.
+     */
+    [[nodiscard]] auto fileDescriptor() const noexcept -> int;
+
+    /**
+     *  Checks if the monitor is in a valid state.
+     */
+    [[nodiscard]] auto isValid() const noexcept -> bool;
+
+  private:
+    /**
+     *  Where capability updates come from.
+     */
+    enum class Source : std::uint8_t
+    {
+        kNetlink,
+        kFile,
+    };
+
+    HfiMonitor(Source source, int fd, std::uint16_t family_id, HfiCallback callback) noexcept;
+
+    /**
+     *  Receives and decodes pending thermal netlink messages.
+     */
+    auto pollNetlink(std::chrono::milliseconds timeout) -> int;
+
+    /**
+     *  Reads and parses lines appended to the replay file.
+     */
+    auto pollFile() -> int;
+
+    /**
+     *  Stamps and delivers a single update.
+     */
+    void deliver(core::CpuId cpu_id, std::uint32_t performance, std::uint32_t efficiency);
+
+    static constexpr int kInvalidFd = -1;
+
+    Source source_;
+    int fd_;
+    std::uint16_t family_id_;
+    HfiCallback callback_;
+    std::string pending_line_;
+    std::uint64_t update_count_{0};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_HFI_MONITOR_HPP_
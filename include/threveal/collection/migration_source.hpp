@@ -0,0 +1,122 @@
+/**
+ *  @file       migration_source.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Common interface of the scheduler migration collectors.
+ *
+ *  MigrationTracker captures migrations with a BPF program and needs
+ *  CAP_BPF; PerfTracepointSource opens the same tracepoint through
+ *  perf_event and only needs CAP_PERFMON. Both deliver MigrationEvents to
+ *  a MigrationCallback in timestamp order, so the rest of the pipeline
+ *  does not depend on which one is running.
+ */
+
+#ifndef THREVEAL_COLLECTION_MIGRATION_SOURCE_HPP_
+#define THREVEAL_COLLECTION_MIGRATION_SOURCE_HPP_
+
+#include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology_handle.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <optional>
+
+namespace threveal::collection
+{
+
+/**
+ *  Callback type for delivering migration events.
+ */
+using MigrationCallback = std::function<void(const core::MigrationEvent&)>;
+
+/**
+ *  A collector of scheduler migration events.
+ *
+ *  Errors of every source are reported as EbpfError.
+ */
+class MigrationSource
+{
+  public:
+    /**
+     *  How far the merge watermark trails the clock when events arrive
+     *  on several rings.
+     *
+     *  An event is written a moment after its timestamp is taken; the
+     *  slack covers that window so no ring can still deliver an older event.
+     */
+    static constexpr std::chrono::nanoseconds kMergeSlack{std::chrono::milliseconds{1}};
+
+    virtual ~MigrationSource() = default;
+
+    MigrationSource(const MigrationSource&) = delete;
+    auto operator=(const MigrationSource&) -> MigrationSource& = delete;
+
+    /**
+     *  Starts capturing migration events.
+     *
+     *  @return     Success or EbpfError on failure.
+     */
+    [[nodiscard]] virtual auto start() -> std::expected<void, EbpfError> = 0;
+
+    /**
+     *  Stops capturing migration events.
+     */
+    virtual void stop() noexcept = 0;
+
+    /**
+     *  Waits for events and delivers those older than the merge watermark.
+     *
+     *  @param      timeout  Maximum time to wait for events.
+     *  @return     Number of events read, or a negative value on error.
+     */
+    [[nodiscard]] virtual auto poll(std::chrono::milliseconds timeout) -> int = 0;
+
+    /**
+     *  Reads everything pending and delivers every buffered event.
+     *
+     *  Call after stop() so events held back by the merge are not lost.
+     *
+     *  @return     Number of events delivered, or a negative value on error.
+     */
+    virtual auto flush() -> int = 0;
+
+    /**
+     *  Sets the target PID filter.
+     *
+     *  @param      pid  Process ID to filter, or std::nullopt to capture all.
+     *  @return     Success or EbpfError on failure.
+     */
+    [[nodiscard]] virtual auto setTargetPid(std::optional<std::uint32_t> pid)
+        -> std::expected<void, EbpfError> = 0;
+
+    /**
+     *  Installs the topology used to stamp core types on events.
+     *
+     *  @param      snapshot  The topology and its generation.
+     *  @return     Success or EbpfError on failure.
+     */
+    [[nodiscard]] virtual auto setTopology(const core::TopologySnapshot& snapshot)
+        -> std::expected<void, EbpfError> = 0;
+
+    /**
+     *  Checks if capture is currently active.
+     */
+    [[nodiscard]] virtual auto isRunning() const noexcept -> bool = 0;
+
+    /**
+     *  Returns the total number of events delivered.
+     */
+    [[nodiscard]] virtual auto eventCount() const noexcept -> std::uint64_t = 0;
+
+  protected:
+    MigrationSource() = default;
+    MigrationSource(MigrationSource&&) noexcept = default;
+    auto operator=(MigrationSource&&) noexcept -> MigrationSource& = default;
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_MIGRATION_SOURCE_HPP_
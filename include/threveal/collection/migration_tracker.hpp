@@ -9,14 +9,18 @@
 #define THREVEAL_COLLECTION_MIGRATION_TRACKER_HPP_
 
 #include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/collection/migration_source.hpp"
+#include "threveal/collection/sampling_controller.hpp"
 #include "threveal/core/events.hpp"
+#include "threveal/core/topology_handle.hpp"
 
-#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <expected>
 #include <functional>
+#include <memory>
 #include <optional>
+#include <vector>
 
 // Forward declaration for libbpf ring buffer
 struct ring_buffer;
@@ -25,29 +29,42 @@ namespace threveal::collection
 {
 
 /**
- *  Callback type for delivering migration events.
+ *  Callback type for delivering per-thread suppression summaries.
  */
-using MigrationCallback = std::function<void(const core::MigrationEvent&)>;
+using SuppressionCallback = std::function<void(const core::SuppressionSummary&)>;
+
+/**
+ *  Callback type for delivering thread lifecycle events.
+ */
+using ThreadLifecycleCallback = std::function<void(const core::ThreadLifecycleEvent&)>;
 
 /**
  *  Tracks scheduler migration events using eBPF.
  */
-class MigrationTracker
+class MigrationTracker final : public MigrationSource
 {
   public:
     /**
      *  Creates a new MigrationTracker.
      *
-     *  @param      callback  Function to receive migration events.
+     *  With sharded rings, every ring is registered in one libbpf
+     *  ring_buffer and events are delivered in timestamp order, also when
+     *  several CPUs share a ring. Only events older than the merge slack
+     *  when they are read can still come out of order; they are counted
+     *  as late.
+     *
+     *  @param      callback        Function to receive migration events.
+     *  @param      loader_options  Options for loading the BPF object.
      *  @return     A MigrationTracker on success, or EbpfError on failure.
      */
-    [[nodiscard]] static auto create(MigrationCallback callback)
+    [[nodiscard]] static auto create(MigrationCallback callback,
+                                     const EbpfLoaderOptions& loader_options = {})
         -> std::expected<MigrationTracker, EbpfError>;
 
     /**
      *  Destroys the tracker and releases all resources.
      */
-    ~MigrationTracker();
+    ~MigrationTracker() override;
 
     // Move-only semantics
     MigrationTracker(MigrationTracker&& other) noexcept;
@@ -60,20 +77,123 @@ class MigrationTracker
      *
      *  @return     Success or EbpfError on failure.
      */
-    [[nodiscard]] auto start() -> std::expected<void, EbpfError>;
+    [[nodiscard]] auto start() -> std::expected<void, EbpfError> override;
 
     /**
      *  Stops capturing migration events.
      */
-    void stop() noexcept;
+    void stop() noexcept override;
 
     /**
      *  Polls for pending migration events.
      *
+     *  With sharded rings, events newer than the merge watermark stay
+     *  buffered until a later poll() or flush().
+     *
      *  @param      timeout  Maximum time to wait for events.
-     *  @return     Number of events processed, or -1 on error.
+     *  @return     Number of events read from the rings, or a negative
+     *              value on error.
+     */
+    [[nodiscard]] auto poll(std::chrono::milliseconds timeout) -> int override;
+
+    /**
+     *  Reads all rings and delivers every buffered event.
+     *
+     *  Also reports suppressed counts still held in the kernel. Call
+     *  after stop() so events held back by the merge are not lost.
+     *
+     *  @return     Number of events delivered, or a negative value on error.
+     */
+    auto flush() -> int override;
+
+    /**
+     *  Returns the number of events dropped because their ring was full.
+     *
+     *  @return     One counter per ring, or EbpfError on failure.
+     */
+    [[nodiscard]] auto ringDrops() const -> std::expected<std::vector<std::uint64_t>, EbpfError>;
+
+    /**
+     *  Lets the tracker adjust the global sampling rate under load.
+     *
+     *  The ring fill level is sampled before each poll(). At most once
+     *  per policy interval, poll() feeds the peak fill level, the new
+     *  drops and the delivered events to a SamplingController and installs
+     *  its rate.
+     *
+     *  @param      policy  Controller thresholds and limits.
+     */
+    void enableAdaptiveSampling(const SamplingPolicy& policy = {});
+
+    /**
+     *  Stops adjusting the sampling rate and restores full capture.
+     *
+     *  @return     Success or EbpfError on failure.
+     */
+    [[nodiscard]] auto disableAdaptiveSampling() -> std::expected<void, EbpfError>;
+
+    /**
+     *  Returns the global sampling rate currently installed.
      */
-    [[nodiscard]] auto poll(std::chrono::milliseconds timeout) -> int;
+    [[nodiscard]] auto sampleRate() const noexcept -> std::uint32_t;
+
+    /**
+     *  Sets a fixed sampling rate for one process.
+     *
+     *  Per-process rates are not touched by adaptive sampling.
+     *
+     *  @param      pid   Process ID.
+     *  @param      rate  Sampling rate, or 0 to follow the global rate.
+     *  @return     Success or EbpfError on failure.
+     */
+    [[nodiscard]] auto setProcessSampleRate(std::uint32_t pid, std::uint32_t rate)
+        -> std::expected<void, EbpfError>;
+
+    /**
+     *  Returns the fraction of the fullest ring that holds unread data.
+     *
+     *  @return     Fill level in [0, 1], or 0.0 if not valid.
+     */
+    [[nodiscard]] auto ringFillLevel() const -> double;
+
+    /**
+     *  Sets the callback receiving suppression summaries.
+     *
+     *  Must be called before start(); summaries are delivered from poll()
+     *  and flush().
+     *
+     *  @param      callback  Summary receiver, or an empty function.
+     */
+    void setSuppressionCallback(SuppressionCallback callback);
+
+    /**
+     *  Sets the callback receiving thread forks, execs, exits and renames.
+     *
+     *  Lifecycle events need BTF-typed tracepoints; with another migration
+     *  handler none are delivered. An exit is the point to stop the
+     *  thread's PmuSampler and to drop anything else kept per thread ID,
+     *  since the ID may be reused. Must be called before start(); events
+     *  are delivered from poll() and flush(), ahead of migrations still
+     *  held for ordering.
+     *
+     *  @param      callback  Event receiver, or an empty function.
+     */
+    void setLifecycleCallback(ThreadLifecycleCallback callback);
+
+    /**
+     *  Limits how many migrations per second each thread may stream.
+     *
+     *  @param      events_per_sec  Per-thread refill rate, or 0 to disable.
+     *  @param      burst           Per-thread bucket capacity.
+     *  @return     Success or EbpfError on failure.
+     */
+    [[nodiscard]] auto setThreadRateLimit(std::uint32_t events_per_sec, std::uint32_t burst)
+        -> std::expected<void, EbpfError>;
+
+    /**
+     *  Returns the total number of migrations reported as suppressed.
+     */
+    [[nodiscard]] auto suppressedCount() const noexcept -> std::uint64_t;
 
     /**
      *  Sets the target PID filter.
@@ -82,30 +202,54 @@ class MigrationTracker
      *  @return     Success or EbpfError on failure.
      */
     [[nodiscard]] auto setTargetPid(std::optional<std::uint32_t> pid)
-        -> std::expected<void, EbpfError>;
+        -> std::expected<void, EbpfError> override;
+
+    /**
+     *  Installs a topology for in-kernel core type stamping.
+     *
+     *  Call with the initial snapshot and again from a TopologyWatcher
+     *  callback so stamped types follow hotplug and isolation changes.
+     *
+     *  @param      snapshot  The topology and its generation.
+     *  @return     Success or EbpfError on failure.
+     */
+    [[nodiscard]] auto setTopology(const core::TopologySnapshot& snapshot)
+        -> std::expected<void, EbpfError> override;
 
     /**
      *  Checks if tracking is currently active.
      */
-    [[nodiscard]] auto isRunning() const noexcept -> bool;
+    [[nodiscard]] auto isRunning() const noexcept -> bool override;
 
     /**
      *  Returns the total number of events processed.
      */
-    [[nodiscard]] auto eventCount() const noexcept -> std::uint64_t;
+    [[nodiscard]] auto eventCount() const noexcept -> std::uint64_t override;
 
   private:
-    MigrationTracker(EbpfLoader loader, ring_buffer* ring_buf, MigrationCallback callback) noexcept;
+    /**
+     *  Consumer state referenced by the libbpf callbacks.
+     *
+     *  Heap-allocated so callback contexts stay valid when the tracker moves.
+     */
+    struct Consumer;
+
+    MigrationTracker(EbpfLoader loader, std::unique_ptr<Consumer> consumer,
+                     ring_buffer* ring_buf) noexcept;
 
     /**
      *  Ring buffer callback invoked by libbpf.
      */
     static auto ringBufferCallback(void* ctx, void* data, std::size_t size) -> int;
 
+    /**
+     *  Runs one adaptive sampling step if the policy interval has passed.
+     */
+    void adjustSampling();
+
     EbpfLoader loader_;
+    std::unique_ptr<Consumer> consumer_;
     ring_buffer* ring_buf_;
-    MigrationCallback callback_;
-    std::atomic<std::uint64_t> event_count_{0};
     bool running_{false};
 };
 
@@ -0,0 +1,186 @@
+/**
+ *  @file       perf_backend.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  The perf_event operations used by the PMU collectors.
+ *
+ *  PmuCounter, PmuGroup and PmuSampler reach the kernel only through a
+ *  PerfBackend. The system backend issues perf_event_open(), read() and
+ *  ioctl() directly; FakePerfBackend (fake_perf_backend.hpp) models the
+ *  counters in process, so the collectors can run without PMU access.
+ */
+
+#ifndef THREVEAL_COLLECTION_PERF_BACKEND_HPP_
+#define THREVEAL_COLLECTION_PERF_BACKEND_HPP_
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string_view>
+#include <sys/types.h>
+
+namespace threveal::collection
+{
+
+/**
+ *  Hardware performance counter event types.
+ */
+enum class PmuEventType : std::uint8_t
+{
+    /**
+     *  CPU cycles elapsed.
+     *
+     *  Maps to PERF_COUNT_HW_CPU_CYCLES.
+     */
+    kCycles = 0,
+
+    /**
+     *  Instructions retired.
+     *
+     *  Maps to PERF_COUNT_HW_INSTRUCTIONS.
+     */
+    kInstructions = 1,
+
+    /**
+     *  Last-level cache load references.
+     *
+     *  Maps to PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ | ACCESS.
+     */
+    kLlcLoads = 2,
+
+    /**
+     *  Last-level cache load misses.
+     *
+     *  Maps to PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ | MISS.
+     */
+    kLlcLoadMisses = 3,
+
+    /**
+     *  Branch mispredictions.
+     *
+     *  Maps to PERF_COUNT_HW_BRANCH_MISSES.
+     */
+    kBranchMisses = 4,
+};
+
+/**
+ *  Converts a PmuEventType to its human-readable string representation.
+ *
+ *  @param      event  The event type to convert.
+ *  @return     A string view describing the event.
+ */
+[[nodiscard]] constexpr auto toString(PmuEventType event) noexcept -> std::string_view
+{
+    switch (event)
+    {
+        case PmuEventType::kCycles:
+            return "cycles";
+        case PmuEventType::kInstructions:
+            return "instructions";
+        case PmuEventType::kLlcLoads:
+            return "LLC-loads";
+        case PmuEventType::kLlcLoadMisses:
+            return "LLC-load-misses";
+        case PmuEventType::kBranchMisses:
+            return "branch-misses";
+    }
+    return "unknown";
+}
+
+/**
+ *  Most events a group read returns.
+ */
+inline constexpr std::size_t kMaxPerfGroupEvents = 8;
+
+/**
+ *  State change applied to an open event.
+ */
+enum class PerfControl : std::uint8_t
+{
+    kEnable = 0,
+    kDisable = 1,
+    kReset = 2,
+};
+
+/**
+ *  Opens, reads and controls hardware counters.
+ *
+ *  Handles are plain integers; for the system backend they are perf_event
+ *  file descriptors. Implementations must be safe to call from several
+ *  threads at once.
+ */
+class PerfBackend
+{
+  public:
+    PerfBackend() = default;
+    virtual ~PerfBackend() = default;
+
+    PerfBackend(const PerfBackend&) = delete;
+    auto operator=(const PerfBackend&) -> PerfBackend& = delete;
+    PerfBackend(PerfBackend&&) = delete;
+    auto operator=(PerfBackend&&) -> PerfBackend& = delete;
+
+    /**
+     *  Opens a counter that counts user-space events only.
+     *
+     *  A counter opened without a group starts disabled; group members
+     *  follow their leader.
+     *
+     *  @param      event       The event to count.
+     *  @param      tid         Thread to monitor (0 for the calling thread).
+     *  @param      cpu         CPU to monitor (-1 for any CPU).
+     *  @param      group_fd    Leader to join, or -1 to open a new counter.
+     *  @param      read_group  Make read() on this leader return every
+     *                          member's value, in the order they joined.
+     *  @return     The handle, or PmuError on failure.
+     */
+    [[nodiscard]] virtual auto open(PmuEventType event, pid_t tid, int cpu, int group_fd,
+                                    bool read_group) -> std::expected<int, core::PmuError> = 0;
+
+    /**
+     *  Closes a handle returned by open().
+     */
+    virtual void close(int fd) noexcept = 0;
+
+    /**
+     *  Reads a counter, or every counter of a group opened with read_group.
+     *
+     *  @param      fd      The handle.
+     *  @param      values  Destination for the counter values.
+     *  @return     Number of values written, or PmuError::kReadFailed.
+     */
+    [[nodiscard]] virtual auto read(int fd, std::span<std::uint64_t> values)
+        -> std::expected<std::size_t, core::PmuError> = 0;
+
+    /**
+     *  Enables, disables or resets a counter.
+     *
+     *  @param      fd     The handle.
+     *  @param      op     The change to apply.
+     *  @param      group  Apply it to the leader's whole group.
+     *  @return     Success, or PmuError::kInvalidState.
+     */
+    [[nodiscard]] virtual auto control(int fd, PerfControl op, bool group)
+        -> std::expected<void, core::PmuError> = 0;
+
+    /**
+     *  Returns the CPU a sample of the thread is attributed to.
+     */
+    [[nodiscard]] virtual auto currentCpu(pid_t tid) const noexcept -> core::CpuId = 0;
+};
+
+/**
+ *  Returns the backend that issues perf_event system calls.
+ *
+ *  The backend lives for the whole process. currentCpu() reports the CPU
+ *  of the calling thread.
+ */
+[[nodiscard]] auto systemPerfBackend() noexcept -> PerfBackend&;
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_PERF_BACKEND_HPP_
@@ -0,0 +1,245 @@
+/**
+ *  @file       perf_tracepoint_source.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Migration capture through perf_event, for hosts without CAP_BPF.
+ *
+ *  sched:sched_migrate_task is opened as a PERF_TYPE_TRACEPOINT event on
+ *  every CPU, sampling every hit with PERF_SAMPLE_TIME, PERF_SAMPLE_CPU
+ *  and PERF_SAMPLE_RAW. The raw tracepoint record is decoded with the
+ *  field layout from the tracepoint's format file, so no kernel headers
+ *  are needed. This only takes CAP_PERFMON (or a low perf_event_paranoid)
+ *  and read access to tracefs.
+ *
+ *  Compared with MigrationTracker, each sample is about three times the
+ *  size of a compact ring record, the process ID is looked up in /proc,
+ *  and there is no in-kernel filtering, sampling or rate limiting.
+ */
+
+#ifndef THREVEAL_COLLECTION_PERF_TRACEPOINT_SOURCE_HPP_
+#define THREVEAL_COLLECTION_PERF_TRACEPOINT_SOURCE_HPP_
+
+#include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/collection/migration_source.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology_handle.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace threveal::collection
+{
+
+/**
+ *  Location of one field in a raw tracepoint record.
+ */
+struct TracepointField
+{
+    std::size_t offset{0};
+    std::size_t size{0};
+};
+
+/**
+ *  Layout of sched:sched_migrate_task records, from its format file.
+ */
+struct MigrateTracepointFormat
+{
+    /**
+     *  Tracepoint ID, the perf_event_attr config.
+     */
+    std::uint64_t id{0};
+
+    /**
+     *  Command name of the migrated task.
+     */
+    TracepointField comm;
+
+    /**
+     *  Thread ID of the migrated task (named pid in the kernel).
+     */
+    TracepointField tid;
+
+    TracepointField orig_cpu;
+    TracepointField dest_cpu;
+};
+
+/**
+ *  Parses the format file of sched:sched_migrate_task.
+ *
+ *  @param      text  Contents of events/sched/sched_migrate_task/format.
+ *  @return     The layout, or std::nullopt if the ID or a needed field is
+ *              missing or has an unexpected size.
+ */
+[[nodiscard]] auto parseMigrateTracepointFormat(std::string_view text)
+    -> std::optional<MigrateTracepointFormat>;
+
+/**
+ *  Decodes one PERF_RECORD_SAMPLE of the migration tracepoint.
+ *
+ *  The sample must have been taken with sample_type TIME | CPU | RAW.
+ *  The process ID is left at zero; the raw record does not carry it.
+ *
+ *  @param      record  The perf record, header included.
+ *  @param      format  Layout of the raw tracepoint record.
+ *  @return     The migration, or std::nullopt if the record is not a
+ *              sample or is truncated.
+ */
+[[nodiscard]] auto decodeMigrateSample(std::span<const std::byte> record,
+                                       const MigrateTracepointFormat& format)
+    -> std::optional<core::MigrationEvent>;
+
+/**
+ *  Receives one perf record, header included.
+ */
+using PerfRecordFn = std::function<void(std::span<const std::byte>)>;
+
+/**
+ *  Consumer side of a perf_event mmap ring.
+ *
+ *  The ring is one metadata page followed by a power-of-two data area.
+ *  A record that wraps around the end is copied into a scratch buffer,
+ *  so the callback always sees it contiguous.
+ */
+class PerfRingReader
+{
+  public:
+    PerfRingReader() = default;
+
+    /**
+     *  Reads a ring mapped at `base`.
+     *
+     *  @param      base        Start of the mapping (the metadata page).
+     *  @param      page_bytes  Size of the metadata page.
+     *  @param      data_bytes  Size of the data area; a power of two.
+     */
+    PerfRingReader(void* base, std::size_t page_bytes, std::size_t data_bytes) noexcept;
+
+    /**
+     *  Delivers the records written since the last read and frees them.
+     *
+     *  @param      callback     Receiver of each record.
+     *  @param      max_records  Largest batch to deliver.
+     *  @return     Records delivered.
+     */
+    auto read(const PerfRecordFn& callback,
+              std::size_t max_records = std::numeric_limits<std::size_t>::max()) -> std::size_t;
+
+    /**
+     *  Returns the bytes written but not yet read.
+     */
+    [[nodiscard]] auto availableBytes() const noexcept -> std::size_t;
+
+    /**
+     *  Returns the size of the data area.
+     */
+    [[nodiscard]] auto capacity() const noexcept -> std::size_t;
+
+  private:
+    void* meta_{nullptr};
+    std::byte* data_{nullptr};
+    std::size_t data_bytes_{0};
+    std::vector<std::byte> scratch_;
+};
+
+/**
+ *  Options for PerfTracepointSource::create().
+ */
+struct PerfTracepointOptions
+{
+    /**
+     *  tracefs mount point; empty tries /sys/kernel/tracing, then
+     *  /sys/kernel/debug/tracing.
+     */
+    std::string tracefs_root;
+
+    /**
+     *  Data pages of each CPU's ring; rounded up to a power of two.
+     */
+    std::size_t ring_pages{64};
+
+    /**
+     *  Only deliver migrations of this process.
+     */
+    std::optional<std::uint32_t> target_pid;
+};
+
+/**
+ *  Captures migrations with one perf_event tracepoint counter per CPU.
+ *
+ *  Events of all CPUs are merged into timestamp order, the same way
+ *  MigrationTracker merges its ring shards. Lost samples are counted, not
+ *  delivered.
+ */
+class PerfTracepointSource final : public MigrationSource
+{
+  public:
+    /**
+     *  Opens and maps the tracepoint on every online CPU.
+     *
+     *  @param      callback  Function to receive migration events.
+     *  @param      options   tracefs location, ring size and filter.
+     *  @return     The source, or EbpfError::kOpenFailed if the format
+     *              file cannot be read, kPermissionDenied without
+     *              CAP_PERFMON, kAttachFailed if the event cannot be
+     *              opened, or kMapAccessFailed if a ring cannot be mapped.
+     */
+    [[nodiscard]] static auto create(MigrationCallback callback,
+                                     const PerfTracepointOptions& options = {})
+        -> std::expected<PerfTracepointSource, EbpfError>;
+
+    ~PerfTracepointSource() override;
+
+    PerfTracepointSource(PerfTracepointSource&& other) noexcept;
+    auto operator=(PerfTracepointSource&& other) noexcept -> PerfTracepointSource&;
+    PerfTracepointSource(const PerfTracepointSource&) = delete;
+    auto operator=(const PerfTracepointSource&) -> PerfTracepointSource& = delete;
+
+    [[nodiscard]] auto start() -> std::expected<void, EbpfError> override;
+    void stop() noexcept override;
+    [[nodiscard]] auto poll(std::chrono::milliseconds timeout) -> int override;
+    auto flush() -> int override;
+    [[nodiscard]] auto setTargetPid(std::optional<std::uint32_t> pid)
+        -> std::expected<void, EbpfError> override;
+    [[nodiscard]] auto setTopology(const core::TopologySnapshot& snapshot)
+        -> std::expected<void, EbpfError> override;
+    [[nodiscard]] auto isRunning() const noexcept -> bool override;
+    [[nodiscard]] auto eventCount() const noexcept -> std::uint64_t override;
+
+    /**
+     *  Returns the number of samples the kernel reported as lost.
+     */
+    [[nodiscard]] auto lostCount() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of CPUs with a ring.
+     */
+    [[nodiscard]] auto cpuCount() const noexcept -> std::size_t;
+
+  private:
+    /**
+     *  Rings, decoding state and the merge; heap-allocated so moves are
+     *  cheap.
+     */
+    struct State;
+
+    explicit PerfTracepointSource(std::unique_ptr<State> state) noexcept;
+
+    auto readRings() -> int;
+
+    std::unique_ptr<State> state_;
+    bool running_{false};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_PERF_TRACEPOINT_SOURCE_HPP_
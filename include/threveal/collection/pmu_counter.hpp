@@ -3,86 +3,23 @@
  *  @author     Rutger Kool <rutgerkool@gmail.com>
  *
  *  Wrapper for Linux perf_event hardware performance counters.
+ *
+ *  PmuEventType is declared in perf_backend.hpp.
  */
 
 #ifndef THREVEAL_COLLECTION_PMU_COUNTER_HPP_
 #define THREVEAL_COLLECTION_PMU_COUNTER_HPP_
 
+#include "threveal/collection/perf_backend.hpp"
 #include "threveal/core/errors.hpp"
 
 #include <cstdint>
 #include <expected>
-#include <string_view>
 #include <sys/types.h>
 
 namespace threveal::collection
 {
 
-/**
- *  Hardware performance counter event types.
- */
-enum class PmuEventType : std::uint8_t
-{
-    /**
-     *  CPU cycles elapsed.
-     *
-     *  Maps to PERF_COUNT_HW_CPU_CYCLES.
-     */
-    kCycles = 0,
-
-    /**
-     *  Instructions retired.
-     *
-     *  Maps to PERF_COUNT_HW_INSTRUCTIONS.
-     */
-    kInstructions = 1,
-
-    /**
-     *  Last-level cache load references.
-     *
-     *  Maps to PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ | ACCESS.
-     */
-    kLlcLoads = 2,
-
-    /**
-     *  Last-level cache load misses.
-     *
-     *  Maps to PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ | MISS.
-     */
-    kLlcLoadMisses = 3,
-
-    /**
-     *  Branch mispredictions.
-     *
-     *  Maps to PERF_COUNT_HW_BRANCH_MISSES.
-     */
-    kBranchMisses = 4,
-};
-
-/**
- *  Converts a PmuEventType to its human-readable string representation.
- *
- *  @param      event  The event type to convert.
- *  @return     A string view describing the event.
- */
-[[nodiscard]] constexpr auto toString(PmuEventType event) noexcept -> std::string_view
-{
-    switch (event)
-    {
-        case PmuEventType::kCycles:
-            return "cycles";
-        case PmuEventType::kInstructions:
-            return "instructions";
-        case PmuEventType::kLlcLoads:
-            return "LLC-loads";
-        case PmuEventType::kLlcLoadMisses:
-            return "LLC-load-misses";
-        case PmuEventType::kBranchMisses:
-            return "branch-misses";
-    }
-    return "unknown";
-}
-
 /**
  *  Wrapper for a single hardware performance counter.
  */
@@ -95,9 +32,11 @@ class PmuCounter
      *  @param      event  The type of hardware event to count.
      *  @param      tid    Thread ID to monitor (0 or -1 for calling thread).
      *  @param      cpu    CPU to monitor (-1 for any CPU the thread runs on).
+     *  @param      backend  Counter implementation; must outlive the counter.
      *  @return     A PmuCounter on success, or PmuError on failure.
      */
-    [[nodiscard]] static auto create(PmuEventType event, pid_t tid = 0, int cpu = -1)
+    [[nodiscard]] static auto create(PmuEventType event, pid_t tid = 0, int cpu = -1,
+                                     PerfBackend& backend = systemPerfBackend())
         -> std::expected<PmuCounter, core::PmuError>;
 
     /**
@@ -162,7 +101,8 @@ class PmuCounter
     /**
      *  Returns the underlying file descriptor.
      *
-     *  @return     The perf_event file descriptor, or -1 if invalid.
+     *  @return     The backend's handle (a perf_event file descriptor for
+     *              the system backend), or -1 if invalid.
      */
     [[nodiscard]] auto fileDescriptor() const noexcept -> int;
 
@@ -177,15 +117,17 @@ class PmuCounter
     /**
      *  Private constructor - use create() factory method.
      *
-     *  @param      fd     The perf_event file descriptor.
-     *  @param      event  The event type being counted.
+     *  @param      fd       The backend handle.
+     *  @param      event    The event type being counted.
+     *  @param      backend  The backend that opened the handle.
      */
-    PmuCounter(int fd, PmuEventType event) noexcept;
+    PmuCounter(int fd, PmuEventType event, PerfBackend& backend) noexcept;
 
     static constexpr int kInvalidFd = -1;
 
     int fd_;
     PmuEventType event_type_;
+    PerfBackend* backend_;
 };
 
 }  // namespace threveal::collection
@@ -11,9 +11,11 @@
 #ifndef THREVEAL_COLLECTION_PMU_GROUP_HPP_
 #define THREVEAL_COLLECTION_PMU_GROUP_HPP_
 
+#include "threveal/collection/perf_backend.hpp"
 #include "threveal/core/errors.hpp"
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 #include <expected>
 #include <sys/types.h>
@@ -96,9 +98,11 @@ class PmuGroup
      *
      *  @param      tid  Thread ID to monitor (0 for calling thread).
      *  @param      cpu  CPU to monitor (-1 for any CPU the thread runs on).
+     *  @param      backend  Counter implementation; must outlive the group.
      *  @return     A PmuGroup on success, or PmuError on failure.
      */
-    [[nodiscard]] static auto create(pid_t tid = 0, int cpu = -1)
+    [[nodiscard]] static auto create(pid_t tid = 0, int cpu = -1,
+                                     PerfBackend& backend = systemPerfBackend())
         -> std::expected<PmuGroup, core::PmuError>;
 
     /**
@@ -164,9 +168,10 @@ class PmuGroup
     /**
      *  Private constructor - use create() factory method.
      *
-     *  @param      fds  Array of perf_event file descriptors.
+     *  @param      fds      Backend handles, leader first.
+     *  @param      backend  The backend that opened the handles.
      */
-    explicit PmuGroup(std::array<int, kCounterCount> fds) noexcept;
+    PmuGroup(std::array<int, kCounterCount> fds, PerfBackend& backend) noexcept;
 
     /**
      *  Closes all valid file descriptors.
@@ -179,6 +184,8 @@ class PmuGroup
      *  File descriptors for each counter in the group.
      */
     std::array<int, kCounterCount> fds_;
+
+    PerfBackend* backend_;
 };
 
 }  // namespace threveal::collection
@@ -8,6 +8,7 @@
 #ifndef THREVEAL_COLLECTION_PMU_SAMPLER_HPP_
 #define THREVEAL_COLLECTION_PMU_SAMPLER_HPP_
 
+#include "threveal/collection/perf_backend.hpp"
 #include "threveal/collection/pmu_group.hpp"
 #include "threveal/core/errors.hpp"
 #include "threveal/core/events.hpp"
@@ -19,6 +20,7 @@
 #include <expected>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <stop_token>
 #include <sys/types.h>
 #include <thread>
@@ -37,6 +39,35 @@ class PmuSampler
      */
     using SampleCallback = std::function<void(const core::PmuSample&)>;
 
+    /**
+     *  Reports whether a thread ran since the previous call for it.
+     */
+    using ActivityProbe = std::function<bool(pid_t)>;
+
+    /**
+     *  Skipping of samples while the target thread is idle.
+     *
+     *  A blocked thread's counters do not move, so its samples carry no
+     *  information beyond the previous one. With suppression enabled a
+     *  sample is only emitted when cycles advanced, plus a heartbeat so
+     *  consumers can tell an idle thread from a lost one.
+     */
+    struct IdleSuppression
+    {
+        /**
+         *  Emit a sample after this many intervals without one; 0 never
+         *  sends a heartbeat.
+         */
+        std::uint32_t heartbeat_intervals{100};
+
+        /**
+         *  Optional check made before reading the counters, called with
+         *  targetTid(). A thread it reports as idle is not read at all,
+         *  saving the read syscall; see EbpfLoader::threadActivity().
+         */
+        ActivityProbe ran_since_last_check;
+    };
+
     /**
      *  Default sampling interval (1 millisecond).
      */
@@ -53,10 +84,12 @@ class PmuSampler
      *  @param      tid       Thread ID to monitor (0 for calling thread).
      *  @param      callback  Function to receive PMU samples.
      *  @param      interval  Time between samples (default: 1ms).
+     *  @param      backend   Counter implementation; must outlive the sampler.
      *  @return     A PmuSampler on success, or PmuError on failure.
      */
     [[nodiscard]] static auto create(pid_t tid, SampleCallback callback,
-                                     std::chrono::microseconds interval = kDefaultInterval)
+                                     std::chrono::microseconds interval = kDefaultInterval,
+                                     PerfBackend& backend = systemPerfBackend())
         -> std::expected<PmuSampler, core::PmuError>;
 
     /**
@@ -95,6 +128,15 @@ class PmuSampler
      */
     void stop() noexcept;
 
+    /**
+     *  Enables skipping samples while the thread is idle.
+     *
+     *  @param      suppression  Heartbeat period and optional activity probe.
+     *  @return     Success, or PmuError::kInvalidState while running.
+     */
+    [[nodiscard]] auto setIdleSuppression(IdleSuppression suppression)
+        -> std::expected<void, core::PmuError>;
+
     /**
      *  Checks if sampling is currently active.
      *
@@ -109,6 +151,13 @@ class PmuSampler
      */
     [[nodiscard]] auto sampleCount() const noexcept -> std::uint64_t;
 
+    /**
+     *  Returns the number of intervals skipped as idle since start().
+     *
+     *  @return     The total suppressed count.
+     */
+    [[nodiscard]] auto suppressedCount() const noexcept -> std::uint64_t;
+
     /**
      *  Returns the configured sampling interval.
      *
@@ -131,9 +180,10 @@ class PmuSampler
      *  @param      group     PMU counter group for the target thread.
      *  @param      callback  Function to receive samples.
      *  @param      interval  Time between samples.
+     *  @param      backend   Backend the group was opened on.
      */
     PmuSampler(pid_t tid, PmuGroup group, SampleCallback callback,
-               std::chrono::microseconds interval) noexcept;
+               std::chrono::microseconds interval, PerfBackend& backend) noexcept;
 
     /**
      *  Sampling thread entry point.
@@ -145,7 +195,8 @@ class PmuSampler
     /**
      *  Collects a single PMU sample.
      *
-     *  @return     True if sample was collected successfully.
+     *  @return     True if a sample was delivered; false if the read
+     *              failed or the interval was suppressed as idle.
      */
     auto collectSample() -> bool;
 
@@ -153,9 +204,17 @@ class PmuSampler
     PmuGroup group_;
     SampleCallback callback_;
     std::chrono::microseconds interval_;
+    PerfBackend* backend_;
+    std::optional<IdleSuppression> idle_;
+
+    // Owned by the sampling thread while running
+    std::uint64_t last_cycles_{0};
+    std::uint32_t idle_intervals_{0};
+    bool has_last_{false};
 
     std::jthread sampling_thread_;
     std::atomic<std::uint64_t> sample_count_{0};
+    std::atomic<std::uint64_t> suppressed_count_{0};
     std::atomic<bool> running_{false};
 };
 
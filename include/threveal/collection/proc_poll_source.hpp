@@ -0,0 +1,227 @@
+/**
+ *  @file       proc_poll_source.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Coarse migration detection by polling /proc, for hosts that permit
+ *  neither BPF nor perf tracepoints.
+ *
+ *  Every target thread's /proc/<pid>/task/<tid>/stat stays open. Each
+ *  tick the files are read with pread() in batches, and only the
+ *  processor field (the CPU the thread last ran on) is scanned. A change
+ *  since the previous read is reported as a MigrationEvent with
+ *  MigrationFidelity::kPolled: it is stamped with the tick's time, and
+ *  any migrations between two reads are missed.
+ *
+ *  Reading a stat file costs about a microsecond of kernel time, so the
+ *  reads per tick can be capped; the threads are then visited round-robin
+ *  over several ticks.
+ */
+
+#ifndef THREVEAL_COLLECTION_PROC_POLL_SOURCE_HPP_
+#define THREVEAL_COLLECTION_PROC_POLL_SOURCE_HPP_
+
+#include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/collection/migration_source.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology_handle.hpp"
+#include "threveal/core/types.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace threveal::collection
+{
+
+/**
+ *  Returns the processor field (the 39th) of a /proc stat line.
+ *
+ *  Fields are counted from the last ')', so a command name containing
+ *  spaces or parentheses does not shift them.
+ *
+ *  @param      stat  Contents of a stat file.
+ *  @return     The CPU, or std::nullopt if the line is truncated.
+ */
+[[nodiscard]] auto parseStatProcessor(std::string_view stat) noexcept
+    -> std::optional<core::CpuId>;
+
+/**
+ *  Options for ProcPollSource::create().
+ */
+struct ProcPollOptions
+{
+    /**
+     *  procfs mount point.
+     */
+    std::string proc_root{"/proc"};
+
+    /**
+     *  Time between two reads of the same thread when every thread is
+     *  read each tick.
+     */
+    std::chrono::milliseconds interval{10};
+
+    /**
+     *  Stat files read per tick; zero reads every thread each tick.
+     */
+    std::size_t max_reads_per_tick{0};
+
+    /**
+     *  Time between scans of the task directories for new threads.
+     */
+    std::chrono::milliseconds rescan_interval{100};
+
+    /**
+     *  Only poll the threads of this process; all processes otherwise.
+     */
+    std::optional<std::uint32_t> target_pid;
+};
+
+/**
+ *  Detects migrations by polling the CPU of each thread in /proc.
+ *
+ *  An open stat file keeps referring to the thread it was opened for, so
+ *  a reused thread ID never continues another thread's history; reads of
+ *  an exited thread fail and its file is closed.
+ */
+class ProcPollSource final : public MigrationSource
+{
+  public:
+    /**
+     *  Stat files read back to back before any of them is scanned.
+     */
+    static constexpr std::size_t kBatchSize = 64;
+
+    /**
+     *  Bytes read of each stat file; the processor field ends well before.
+     */
+    static constexpr std::size_t kStatBytes = 512;
+
+    /**
+     *  Creates a source; no file is opened until start().
+     *
+     *  @param      callback  Function to receive migration events.
+     *  @param      options   procfs location, tick rate and filter.
+     *  @return     The source, EbpfError::kInvalidState without a callback
+     *              or interval, or kOpenFailed if proc_root is missing.
+     */
+    [[nodiscard]] static auto create(MigrationCallback callback,
+                                     const ProcPollOptions& options = {})
+        -> std::expected<ProcPollSource, EbpfError>;
+
+    ~ProcPollSource() override;
+
+    ProcPollSource(ProcPollSource&& other) noexcept;
+    auto operator=(ProcPollSource&& other) noexcept -> ProcPollSource&;
+    ProcPollSource(const ProcPollSource&) = delete;
+    auto operator=(const ProcPollSource&) -> ProcPollSource& = delete;
+
+    /**
+     *  Opens the stat files of the target threads and reads their CPUs.
+     */
+    [[nodiscard]] auto start() -> std::expected<void, EbpfError> override;
+
+    /**
+     *  Stops polling and closes every stat file.
+     */
+    void stop() noexcept override;
+
+    /**
+     *  Sleeps until the next tick, within the timeout, and runs it.
+     */
+    [[nodiscard]] auto poll(std::chrono::milliseconds timeout) -> int override;
+
+    /**
+     *  Nothing is buffered; returns 0.
+     */
+    auto flush() -> int override;
+
+    /**
+     *  Changes the polled process; takes effect at the next rescan.
+     */
+    [[nodiscard]] auto setTargetPid(std::optional<std::uint32_t> pid)
+        -> std::expected<void, EbpfError> override;
+
+    [[nodiscard]] auto setTopology(const core::TopologySnapshot& snapshot)
+        -> std::expected<void, EbpfError> override;
+
+    [[nodiscard]] auto isRunning() const noexcept -> bool override;
+
+    [[nodiscard]] auto eventCount() const noexcept -> std::uint64_t override;
+
+    /**
+     *  Reads the next threads in turn and reports their migrations.
+     *
+     *  poll() calls this once per interval; it is public so the scan can
+     *  be driven and measured directly.
+     *
+     *  @param      now_ns  Trace clock time to stamp events with.
+     *  @return     Migrations reported.
+     */
+    auto tick(std::uint64_t now_ns) -> std::size_t;
+
+    /**
+     *  Opens newly created threads and closes those no longer listed.
+     */
+    void rescan();
+
+    /**
+     *  Returns the number of threads with an open stat file.
+     */
+    [[nodiscard]] auto threadCount() const noexcept -> std::size_t;
+
+  private:
+    /**
+     *  A polled thread and the CPU it was last seen on.
+     */
+    struct Thread
+    {
+        std::uint32_t pid{0};
+        std::uint32_t tid{0};
+        int fd{-1};
+        core::CpuId cpu{0};
+        std::array<char, core::kMaxCommLength> comm{};
+
+        /**
+         *  Last rescan that listed the thread.
+         */
+        std::uint64_t epoch{0};
+    };
+
+    ProcPollSource(MigrationCallback callback, ProcPollOptions options);
+
+    auto open(std::uint32_t pid, std::uint32_t tid) -> bool;
+    void listProcess(std::uint32_t pid, std::size_t known);
+    void release() noexcept;
+
+    MigrationCallback callback_;
+    ProcPollOptions options_;
+    std::optional<core::TopologySnapshot> topology_;
+
+    /**
+     *  Sorted by thread ID.
+     */
+    std::vector<Thread> threads_;
+
+    /**
+     *  kBatchSize stat files of kStatBytes each.
+     */
+    std::vector<char> buffer_;
+
+    std::size_t cursor_{0};
+    std::uint64_t epoch_{0};
+    std::chrono::steady_clock::time_point next_tick_;
+    std::chrono::steady_clock::time_point next_rescan_;
+    std::uint64_t event_count_{0};
+    bool running_{false};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_PROC_POLL_SOURCE_HPP_
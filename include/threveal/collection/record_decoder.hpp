@@ -0,0 +1,196 @@
+/**
+ *  @file       record_decoder.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Decoding of raw ring buffer records written by the BPF program.
+ *
+ *  Every record starts with a header carrying its type and size, so the
+ *  decoder can validate a record before copying it out of the ring and
+ *  skip types it does not know.
+ *
+ *  Migration records only carry a thread ID. The process ID and command
+ *  name arrive once per thread in an identity record, which the decoder
+ *  keeps in a thread table to complete every later migration. Lifecycle
+ *  records keep the table current: a new or renamed thread is entered
+ *  and an exited one removed, so the table only holds live threads.
+ *
+ *  With several rings, a thread's identity may sit in another ring than
+ *  its migration and be read after it. Migrations are then completed
+ *  only once every ring has been read up to their timestamp, and exited
+ *  threads are kept until then.
+ */
+
+#ifndef THREVEAL_COLLECTION_RECORD_DECODER_HPP_
+#define THREVEAL_COLLECTION_RECORD_DECODER_HPP_
+
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <variant>
+
+// Forward declaration of the BPF record layout (bpf_common.h)
+struct migration_record;
+
+namespace threveal::collection
+{
+
+/**
+ *  Process and command name of a thread, from an identity record.
+ */
+struct ThreadIdentity
+{
+    /**
+     *  Process ID the thread belongs to.
+     */
+    std::uint32_t pid{0};
+
+    /**
+     *  Thread ID.
+     */
+    std::uint32_t tid{0};
+
+    /**
+     *  Command name (null-terminated, may be truncated).
+     */
+    std::array<char, core::kMaxCommLength> comm{};
+};
+
+/**
+ *  When RecordDecoder completes migrations with their thread's identity.
+ */
+enum class IdentityResolution : std::uint8_t
+{
+    /**
+     *  In decode(); enough when every record goes through one ring.
+     */
+    kOnDecode = 0,
+
+    /**
+     *  In resolve(), called once every ring has been read up to the
+     *  migration's timestamp. Exited threads stay in the table until
+     *  retireExited() passes their exit.
+     */
+    kDeferred = 1,
+};
+
+/**
+ *  A decoded ring buffer record.
+ */
+using RingRecord = std::variant<core::MigrationEvent, core::SuppressionSummary, ThreadIdentity,
+                                core::ThreadLifecycleEvent>;
+
+/**
+ *  Decodes ring buffer records against a table of known threads.
+ *
+ *  One decoder must see every ring of a BPF object, since a thread's
+ *  identity and migrations may be written to different rings. decode()
+ *  may be called from one thread at a time; setTopologyGeneration() from
+ *  any thread.
+ */
+class RecordDecoder
+{
+  public:
+    RecordDecoder() = default;
+
+    /**
+     *  Creates a decoder that completes migrations as given.
+     *
+     *  @param      resolution  When migrations get their thread's identity.
+     */
+    explicit RecordDecoder(IdentityResolution resolution) noexcept;
+
+    /**
+     *  Decodes one ring buffer record.
+     *
+     *  Identity and lifecycle records update the thread table and are
+     *  returned as well. A migration is returned with a zero process ID
+     *  and an empty command name if its thread's identity has not arrived
+     *  yet, and always with IdentityResolution::kDeferred.
+     *
+     *  @param      data  The raw record as delivered by libbpf.
+     *  @return     The decoded record, or std::nullopt if the record is
+     *              truncated, inconsistent or of an unknown type.
+     */
+    [[nodiscard]] auto decode(std::span<const std::byte> data) -> std::optional<RingRecord>;
+
+    /**
+     *  Sets the newest topology generation the BPF program may stamp.
+     *
+     *  Records carry only the low 16 bits of the generation; they are
+     *  widened to the latest generation up to this one with the same low
+     *  bits. Call it before installing a new generation in the kernel.
+     */
+    void setTopologyGeneration(core::TopologyGeneration generation) noexcept;
+
+    /**
+     *  Completes a migration with its thread's process ID and command name.
+     *
+     *  With IdentityResolution::kDeferred, call it once every ring has
+     *  been read up to the migration's timestamp. A thread still unknown
+     *  then is counted in unresolvedMigrations().
+     *
+     *  @param      event  The migration to complete.
+     */
+    void resolve(core::MigrationEvent& event);
+
+    /**
+     *  Removes exited threads whose exit is at or below a watermark.
+     *
+     *  With IdentityResolution::kDeferred, call it after resolving every
+     *  migration up to the watermark; migrations of an exited thread may
+     *  still be buffered until then.
+     *
+     *  @param      watermark_ns  Timestamp every migration up to which has
+     *                            been resolved.
+     */
+    void retireExited(std::uint64_t watermark_ns);
+
+    /**
+     *  Looks up a thread in the table; exited threads are not reported.
+     */
+    [[nodiscard]] auto identity(std::uint32_t tid) const -> std::optional<ThreadIdentity>;
+
+    /**
+     *  Returns the number of threads in the table; exited threads are not
+     *  counted.
+     */
+    [[nodiscard]] auto threadCount() const noexcept -> std::size_t;
+
+    /**
+     *  Returns the number of migrations decoded before their thread's
+     *  identity.
+     */
+    [[nodiscard]] auto unresolvedMigrations() const noexcept -> std::uint64_t;
+
+  private:
+    /**
+     *  A thread table entry; exit_ns is set while a deferred exit waits
+     *  for retireExited().
+     */
+    struct Thread
+    {
+        ThreadIdentity identity;
+        std::optional<std::uint64_t> exit_ns;
+    };
+
+    auto decodeMigration(const migration_record& raw) -> core::MigrationEvent;
+    void learn(const ThreadIdentity& identity);
+    void track(const core::ThreadLifecycleEvent& event);
+
+    std::unordered_map<std::uint32_t, Thread> threads_;
+    std::atomic<core::TopologyGeneration> generation_{0};
+    IdentityResolution resolution_{IdentityResolution::kOnDecode};
+    std::size_t exited_{0};
+    std::uint64_t unresolved_{0};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_RECORD_DECODER_HPP_
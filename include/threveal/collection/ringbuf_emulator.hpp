@@ -0,0 +1,281 @@
+/**
+ *  @file       ringbuf_emulator.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Userspace emulation of a BPF_MAP_TYPE_RINGBUF map.
+ *
+ *  The emulator reproduces the kernel's memory protocol: a consumer
+ *  position page, a producer position page and a power-of-two data area
+ *  mapped twice in a row, so a record that wraps around the end is still
+ *  contiguous. Records carry the kernel's 8-byte header whose length word
+ *  holds the busy and discard bits, and reservations are serialised like
+ *  the kernel's per-ring lock, so several threads can act as CPUs
+ *  producing into one ring.
+ *
+ *  consume() follows libbpf's ring processing step by step and hands each
+ *  record to a callback, such as one calling RecordDecoder::decode(). Consumer
+ *  throughput, batch sizes and wakeup strategies can then be measured
+ *  without loading BPF programs.
+ */
+
+#ifndef THREVEAL_COLLECTION_RINGBUF_EMULATOR_HPP_
+#define THREVEAL_COLLECTION_RINGBUF_EMULATOR_HPP_
+
+#include "threveal/collection/ebpf_loader.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <limits>
+#include <span>
+#include <string>
+
+namespace threveal::collection
+{
+
+/**
+ *  Size of a record header; records are padded to multiples of it.
+ */
+inline constexpr std::size_t kRingbufHeaderSize = 8;
+
+/**
+ *  Default data area size; the same as one MigrationTracker ring shard.
+ */
+inline constexpr std::size_t kDefaultRingbufBytes = 64 * 1024;
+
+/**
+ *  When a submitted record wakes the consumer.
+ */
+enum class RingbufWakeup : std::uint8_t
+{
+    /**
+     *  Only when the consumer has caught up with the record, as the
+     *  kernel does for flags of 0.
+     */
+    kAdaptive = 0,
+
+    /**
+     *  On every record (BPF_RB_FORCE_WAKEUP).
+     */
+    kForce = 1,
+
+    /**
+     *  Never (BPF_RB_NO_WAKEUP); the consumer has to poll.
+     */
+    kNone = 2,
+};
+
+/**
+ *  Options for RingbufEmulator::create().
+ */
+struct RingbufEmulatorOptions
+{
+    /**
+     *  Size of the data area; rounded up to a power of two of at least
+     *  one page.
+     */
+    std::size_t data_bytes{kDefaultRingbufBytes};
+
+    /**
+     *  Wakeup strategy of submit().
+     */
+    RingbufWakeup wakeup{RingbufWakeup::kAdaptive};
+};
+
+/**
+ *  Receives one record; a negative return stops consume() with that
+ *  value, like a libbpf sample callback.
+ */
+using RingbufSampleFn = std::function<int(std::span<const std::byte>)>;
+
+/**
+ *  An emulated BPF ring buffer.
+ *
+ *  reserve(), submit() and discard() may be called from any number of
+ *  threads; consume() and poll() from one consumer thread at a time.
+ */
+class RingbufEmulator
+{
+  public:
+    /**
+     *  Maps a new ring.
+     *
+     *  @param      options  Size and wakeup strategy.
+     *  @return     The ring, or EbpfError::kMapAccessFailed if the memory
+     *              or wakeup descriptor cannot be created.
+     */
+    [[nodiscard]] static auto create(const RingbufEmulatorOptions& options = {})
+        -> std::expected<RingbufEmulator, EbpfError>;
+
+    ~RingbufEmulator();
+
+    RingbufEmulator(const RingbufEmulator&) = delete;
+    auto operator=(const RingbufEmulator&) -> RingbufEmulator& = delete;
+
+    RingbufEmulator(RingbufEmulator&& other) noexcept;
+    auto operator=(RingbufEmulator&& other) noexcept -> RingbufEmulator&;
+
+    /**
+     *  Reserves space for a record, like bpf_ringbuf_reserve().
+     *
+     *  The record stays busy, and holds back every later record from the
+     *  consumer, until it is submitted or discarded.
+     *
+     *  @param      size  Record size in bytes.
+     *  @return     The record's bytes, or an empty span if the ring is
+     *              full or the record can never fit; counted as a drop.
+     */
+    [[nodiscard]] auto reserve(std::size_t size) noexcept -> std::span<std::byte>;
+
+    /**
+     *  Publishes a reserved record, like bpf_ringbuf_submit().
+     */
+    void submit(std::span<std::byte> record) noexcept;
+
+    /**
+     *  Releases a reserved record unread, like bpf_ringbuf_discard().
+     */
+    void discard(std::span<std::byte> record) noexcept;
+
+    /**
+     *  Copies a record into the ring, like bpf_ringbuf_output().
+     *
+     *  @return     False if the record was dropped.
+     */
+    auto output(std::span<const std::byte> record) noexcept -> bool;
+
+    /**
+     *  Delivers submitted records in ring order.
+     *
+     *  Stops at the first busy record, after max_records records, or when
+     *  the callback returns a negative value.
+     *
+     *  @param      callback     Receiver of each record.
+     *  @param      max_records  Largest batch to deliver.
+     *  @return     Records delivered, or the callback's negative value.
+     */
+    auto consume(const RingbufSampleFn& callback,
+                 std::size_t max_records = std::numeric_limits<std::size_t>::max()) -> long;
+
+    /**
+     *  Waits for a wakeup, then consumes, like ring_buffer__poll().
+     *
+     *  Records submitted without a wakeup are left for a later consume(),
+     *  which is what makes the wakeup strategy visible to the consumer.
+     *
+     *  @param      callback  Receiver of each record.
+     *  @param      timeout   Longest wait; zero only checks for a wakeup.
+     *  @return     Records delivered, or a negative value on error.
+     */
+    auto poll(const RingbufSampleFn& callback, std::chrono::milliseconds timeout) -> long;
+
+    /**
+     *  Returns the descriptor that becomes readable on a wakeup, for use
+     *  with epoll; poll() drains it.
+     */
+    [[nodiscard]] auto eventFd() const noexcept -> int;
+
+    /**
+     *  Returns the size of the data area.
+     */
+    [[nodiscard]] auto capacity() const noexcept -> std::size_t;
+
+    /**
+     *  Returns the bytes between the consumer and producer positions.
+     */
+    [[nodiscard]] auto availableBytes() const noexcept -> std::size_t;
+
+    /**
+     *  Returns the number of reservations that failed.
+     */
+    [[nodiscard]] auto drops() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of wakeups signalled by producers.
+     */
+    [[nodiscard]] auto wakeups() const noexcept -> std::uint64_t;
+
+  private:
+    RingbufEmulator(std::byte* base, std::size_t map_size, std::size_t page_bytes,
+                    std::size_t data_bytes, int memfd, int event_fd,
+                    RingbufWakeup wakeup) noexcept;
+
+    void commit(std::span<std::byte> record, bool discarded) noexcept;
+    void release() noexcept;
+
+    std::byte* base_{nullptr};
+    std::size_t map_size_{0};
+    std::size_t page_bytes_{0};
+    std::size_t data_bytes_{0};
+    int memfd_{-1};
+    int event_fd_{-1};
+    RingbufWakeup wakeup_{RingbufWakeup::kAdaptive};
+};
+
+/**
+ *  Load generated by produceMigrations().
+ */
+struct RingbufProducerOptions
+{
+    /**
+     *  Producer threads; thread i writes migrations onto CPU i.
+     */
+    std::size_t threads{1};
+
+    /**
+     *  Migrations each thread submits or drops before returning.
+     */
+    std::uint64_t events_per_thread{1000};
+
+    /**
+     *  Target migrations per second across all threads; zero produces
+     *  as fast as possible.
+     */
+    double events_per_sec{0.0};
+
+    /**
+     *  Process ID written into every migration; thread IDs follow it.
+     */
+    std::uint32_t pid{1000};
+
+    /**
+     *  Command name written into every migration.
+     */
+    std::string comm{"producer"};
+};
+
+/**
+ *  Outcome of produceMigrations().
+ */
+struct RingbufProducerStats
+{
+    std::uint64_t submitted{0};
+    std::uint64_t dropped{0};
+
+    /**
+     *  Identity records that did not fit and were retried.
+     */
+    std::uint64_t dropped_identities{0};
+};
+
+/**
+ *  Writes migration records as the BPF program does, from several
+ *  threads at once.
+ *
+ *  Each thread stands for one CPU and its migrations carry increasing
+ *  timestamps, so per-thread order can be checked by the consumer. Its
+ *  identity record goes ahead of its first migration that fits.
+ *  Blocks until every thread is done.
+ *
+ *  @param      ring     The ring to write to.
+ *  @param      options  Threads, volume and rate.
+ *  @return     Migrations submitted and dropped.
+ */
+auto produceMigrations(RingbufEmulator& ring, const RingbufProducerOptions& options)
+    -> RingbufProducerStats;
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_RINGBUF_EMULATOR_HPP_
@@ -0,0 +1,125 @@
+/**
+ *  @file       sampling_controller.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Feedback controller for the in-kernel migration sampling rate.
+ *
+ *  When ring buffers fill up, dropping whole bursts skews every analysis
+ *  toward quiet periods. The controller watches ring fill level, drops and
+ *  delivered event rate, and raises the 1-in-N sampling rate before the
+ *  rings overflow; it lowers the rate again once the load subsides.
+ */
+
+#ifndef THREVEAL_COLLECTION_SAMPLING_CONTROLLER_HPP_
+#define THREVEAL_COLLECTION_SAMPLING_CONTROLLER_HPP_
+
+#include <chrono>
+#include <cstdint>
+
+namespace threveal::collection
+{
+
+/**
+ *  Tuning for SamplingController.
+ */
+struct SamplingPolicy
+{
+    /**
+     *  Fill fraction of the fullest ring at which the rate is doubled.
+     */
+    double high_fill{0.5};
+
+    /**
+     *  Fill fraction below which the rate may be halved.
+     */
+    double low_fill{0.1};
+
+    /**
+     *  Delivered events per second to stay under; zero disables the budget.
+     */
+    double event_budget_per_sec{0.0};
+
+    /**
+     *  Largest rate the controller will select.
+     */
+    std::uint32_t max_rate{1024};
+
+    /**
+     *  Minimum time between two adjustments.
+     */
+    std::chrono::milliseconds interval{100};
+};
+
+/**
+ *  Consumer-side measurements over one adjustment interval.
+ */
+struct SamplingObservation
+{
+    /**
+     *  Fraction of the fullest ring that holds unread data, in [0, 1].
+     */
+    double fill{0.0};
+
+    /**
+     *  Events dropped because a ring was full.
+     */
+    std::uint64_t drops{0};
+
+    /**
+     *  Events delivered to the consumer.
+     */
+    std::uint64_t events{0};
+
+    /**
+     *  Length of the interval.
+     */
+    std::chrono::nanoseconds elapsed{0};
+};
+
+/**
+ *  Multiplicative increase/decrease controller for the sampling rate.
+ *
+ *  Rates move in powers of two, so a rate change never needs more than
+ *  log2(max_rate) intervals to settle.
+ */
+class SamplingController
+{
+  public:
+    /**
+     *  Creates a controller starting at rate 1 (every event kept).
+     *
+     *  @param      policy  Thresholds and limits.
+     */
+    explicit SamplingController(SamplingPolicy policy = {}) noexcept;
+
+    /**
+     *  Folds in one interval's measurements.
+     *
+     *  The rate doubles on any drop, on a fill level at or above
+     *  high_fill, or when the delivered rate exceeds the budget. It halves
+     *  when the fill level is at or below low_fill and halving would still
+     *  fit the budget.
+     *
+     *  @param      observation  Measurements since the previous update.
+     *  @return     The new rate.
+     */
+    auto update(const SamplingObservation& observation) noexcept -> std::uint32_t;
+
+    /**
+     *  Returns the current 1-in-N rate.
+     */
+    [[nodiscard]] auto rate() const noexcept -> std::uint32_t;
+
+    /**
+     *  Returns the policy in use.
+     */
+    [[nodiscard]] auto policy() const noexcept -> const SamplingPolicy&;
+
+  private:
+    SamplingPolicy policy_;
+    std::uint32_t rate_{1};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_SAMPLING_CONTROLLER_HPP_
@@ -0,0 +1,75 @@
+/**
+ *  @file       thread_activity.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  View of the in-kernel per-thread activity flags.
+ *
+ *  The BPF sched_switch handler marks every thread it switches out as
+ *  having run and tracks which threads are on a CPU. The flags live in a
+ *  memory-mapped BPF array, so checking whether a thread ran since the
+ *  previous check is a load and an exchange, without a system call.
+ */
+
+#ifndef THREVEAL_COLLECTION_THREAD_ACTIVITY_HPP_
+#define THREVEAL_COLLECTION_THREAD_ACTIVITY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+// Defined in bpf_common.h
+struct thread_activity_block;
+
+namespace threveal::collection
+{
+
+/**
+ *  Non-owning view of the thread_activity map.
+ *
+ *  Obtained from EbpfLoader::threadActivity() and valid while that loader
+ *  lives. A default-constructed view knows nothing and reports every
+ *  thread as having run.
+ */
+class ThreadActivityMap
+{
+  public:
+    ThreadActivityMap() noexcept = default;
+
+    /**
+     *  Creates a view of mapped activity blocks.
+     *
+     *  @param      blocks       The first block.
+     *  @param      block_count  Number of blocks; covers thread IDs below
+     *                           block_count * ACTIVITY_BLOCK_THREADS.
+     */
+    ThreadActivityMap(thread_activity_block* blocks, std::size_t block_count) noexcept;
+
+    /**
+     *  Checks whether a thread ran since the previous check and clears
+     *  the flag.
+     *
+     *  A thread on a CPU at the time of the check counts as having run.
+     *
+     *  @param      tid  Thread ID.
+     *  @return     false only if the thread certainly did not run; true
+     *              if it did, or if the view does not cover it.
+     */
+    [[nodiscard]] auto ranSinceLastCheck(std::uint32_t tid) const noexcept -> bool;
+
+    /**
+     *  Checks if the view refers to a mapped array.
+     */
+    [[nodiscard]] auto isMapped() const noexcept -> bool;
+
+    /**
+     *  Returns the number of thread IDs covered.
+     */
+    [[nodiscard]] auto capacity() const noexcept -> std::size_t;
+
+  private:
+    thread_activity_block* blocks_{nullptr};
+    std::size_t block_count_{0};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_THREAD_ACTIVITY_HPP_
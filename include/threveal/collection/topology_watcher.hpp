@@ -0,0 +1,152 @@
+/**
+ *  @file       topology_watcher.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Background watcher that republishes the CPU topology when it changes.
+ *
+ *  CPU hotplug (e.g. for power capping) and cpuset isolation change which
+ *  CPUs are usable while a trace is running. The watcher periodically
+ *  reloads the topology, and when it differs from the current snapshot it
+ *  publishes a new generation through a TopologyHandle and notifies a
+ *  callback, which typically forwards the snapshot to the BPF side.
+ */
+
+#ifndef THREVEAL_COLLECTION_TOPOLOGY_WATCHER_HPP_
+#define THREVEAL_COLLECTION_TOPOLOGY_WATCHER_HPP_
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/topology_handle.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <stop_token>
+#include <thread>
+
+namespace threveal::collection
+{
+
+/**
+ *  Function that builds a fresh topology, normally TopologyMap::loadFromSysfs.
+ */
+using TopologyLoader = std::function<std::expected<core::TopologyMap, core::TopologyError>()>;
+
+/**
+ *  Callback invoked after a new topology generation has been published.
+ */
+using TopologyChangeCallback = std::function<void(const core::TopologySnapshot&)>;
+
+/**
+ *  Polls for topology changes and publishes them through a TopologyHandle.
+ */
+class TopologyWatcher
+{
+  public:
+    /**
+     *  Default time between topology checks.
+     */
+    static constexpr std::chrono::milliseconds kDefaultInterval{1000};
+
+    /**
+     *  Minimum allowed time between topology checks.
+     */
+    static constexpr std::chrono::milliseconds kMinInterval{10};
+
+    /**
+     *  Creates a watcher for the given handle.
+     *
+     *  The loader is run once up front; if the result already differs from
+     *  the handle's topology it is published immediately.
+     *
+     *  @param      handle     Handle to publish into; must outlive the watcher.
+     *  @param      on_change  Optional callback for each new generation.
+     *  @param      interval   Time between checks (clamped to kMinInterval).
+     *  @param      loader     Topology source, defaults to sysfs.
+     *  @return     A TopologyWatcher on success, or the loader's TopologyError.
+     */
+    [[nodiscard]] static auto create(core::TopologyHandle& handle,
+                                     TopologyChangeCallback on_change = {},
+                                     std::chrono::milliseconds interval = kDefaultInterval,
+                                     TopologyLoader loader = &core::TopologyMap::loadFromSysfs)
+        -> std::expected<TopologyWatcher, core::TopologyError>;
+
+    /**
+     *  Destroys the watcher, stopping the background thread if running.
+     */
+    ~TopologyWatcher();
+
+    // Move-only semantics
+    TopologyWatcher(TopologyWatcher&& other) noexcept;
+    auto operator=(TopologyWatcher&& other) noexcept -> TopologyWatcher&;
+    TopologyWatcher(const TopologyWatcher&) = delete;
+    auto operator=(const TopologyWatcher&) -> TopologyWatcher& = delete;
+
+    /**
+     *  Starts periodic checking on a background thread.
+     *
+     *  @return     Success, or TopologyError::kInvalidState if already running.
+     */
+    [[nodiscard]] auto start() -> std::expected<void, core::TopologyError>;
+
+    /**
+     *  Stops periodic checking.
+     */
+    void stop() noexcept;
+
+    /**
+     *  Reloads the topology once and publishes it if it changed.
+     *
+     *  A failed reload (e.g. sysfs briefly unreadable during hotplug) keeps
+     *  the current snapshot.
+     *
+     *  @return     True if a new generation was published.
+     */
+    auto checkNow() -> bool;
+
+    /**
+     *  Checks if the background thread is running.
+     */
+    [[nodiscard]] auto isRunning() const noexcept -> bool;
+
+    /**
+     *  Returns the number of generations this watcher has published.
+     */
+    [[nodiscard]] auto changeCount() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the configured check interval.
+     */
+    [[nodiscard]] auto interval() const noexcept -> std::chrono::milliseconds;
+
+  private:
+    TopologyWatcher(core::TopologyHandle& handle, TopologyChangeCallback on_change,
+                    std::chrono::milliseconds interval, TopologyLoader loader) noexcept;
+
+    /**
+     *  Watcher thread entry point.
+     *
+     *  @param      stop_token  Token for cooperative cancellation.
+     */
+    void watchLoop(const std::stop_token& stop_token);
+
+    /**
+     *  Publishes a changed topology and notifies the callback.
+     */
+    void publishChange(core::TopologyMap map);
+
+    core::TopologyHandle* handle_;
+    TopologyChangeCallback on_change_;
+    std::chrono::milliseconds interval_;
+    TopologyLoader loader_;
+
+    std::jthread watch_thread_;
+    std::atomic<std::uint64_t> change_count_{0};
+    std::atomic<bool> running_{false};
+};
+
+}  // namespace threveal::collection
+
+#endif  // THREVEAL_COLLECTION_TOPOLOGY_WATCHER_HPP_
@@ -0,0 +1,202 @@
+/**
+ *  @file       clock.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  The clock every collected timestamp is taken from.
+ *
+ *  The BPF program, the samplers and the analysis all compare timestamps
+ *  from different sources, so they must read the same kernel clock.
+ *  CLOCK_MONOTONIC stops while the system is suspended, which makes
+ *  durations spanning a suspend look too short; CLOCK_BOOTTIME keeps
+ *  counting and is the better choice on laptops and VMs. A ClockSnapshot
+ *  records how the trace clock relates to the other clocks, so a trace
+ *  can be mapped to wall-clock time afterwards.
+ */
+
+#ifndef THREVEAL_CORE_CLOCK_HPP_
+#define THREVEAL_CORE_CLOCK_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <time.h>
+
+namespace threveal::core
+{
+
+/**
+ *  Kernel clock used for trace timestamps.
+ */
+enum class ClockSource : std::uint8_t
+{
+    /**
+     *  CLOCK_MONOTONIC; bpf_ktime_get_ns() in BPF. Stops during suspend.
+     */
+    kMonotonic = 0,
+
+    /**
+     *  CLOCK_BOOTTIME; bpf_ktime_get_boot_ns() in BPF. Includes suspend.
+     */
+    kBoottime = 1,
+};
+
+/**
+ *  Converts a ClockSource to its human-readable string representation.
+ *
+ *  @param      source  The clock source to convert.
+ *  @return     A string view containing "monotonic" or "boottime".
+ */
+[[nodiscard]] constexpr auto toString(ClockSource source) noexcept -> std::string_view
+{
+    switch (source)
+    {
+        case ClockSource::kMonotonic:
+            return "monotonic";
+        case ClockSource::kBoottime:
+            return "boottime";
+    }
+    return "invalid";
+}
+
+/**
+ *  Returns the clock_gettime() ID of a clock source.
+ */
+[[nodiscard]] constexpr auto toClockId(ClockSource source) noexcept -> clockid_t
+{
+    return (source == ClockSource::kBoottime) ? CLOCK_BOOTTIME : CLOCK_MONOTONIC;
+}
+
+/**
+ *  Reads a clock in nanoseconds.
+ *
+ *  clock_gettime() is served from the vDSO for both sources, so this does
+ *  not enter the kernel.
+ *
+ *  @param      clock_id  Any clock_gettime() clock.
+ *  @return     The clock value in nanoseconds.
+ */
+[[nodiscard]] auto readClockNs(clockid_t clock_id) noexcept -> std::uint64_t;
+
+/**
+ *  Reads a clock source in nanoseconds.
+ */
+[[nodiscard]] inline auto readClockNs(ClockSource source) noexcept -> std::uint64_t
+{
+    return readClockNs(toClockId(source));
+}
+
+/**
+ *  Selects the process-wide trace clock.
+ *
+ *  EbpfLoader copies the selection into the BPF program when it is
+ *  created, so select the clock once at startup before creating any
+ *  collector. The default is ClockSource::kMonotonic.
+ *
+ *  @param      source  The clock to use for all trace timestamps.
+ */
+void setTraceClock(ClockSource source) noexcept;
+
+/**
+ *  Returns the process-wide trace clock.
+ */
+[[nodiscard]] auto traceClock() noexcept -> ClockSource;
+
+/**
+ *  Reads the process-wide trace clock in nanoseconds.
+ */
+[[nodiscard]] auto traceTimestampNs() noexcept -> std::uint64_t;
+
+/**
+ *  Number of bracketed reads captureClockSnapshot() takes by default.
+ */
+inline constexpr std::size_t kClockSnapshotAttempts = 8;
+
+/**
+ *  Simultaneous readings of the trace clock and the other system clocks.
+ *
+ *  Stored in a trace header, it maps trace timestamps to wall-clock time.
+ */
+struct ClockSnapshot
+{
+    /**
+     *  The clock trace_ns was read from.
+     */
+    ClockSource source{ClockSource::kMonotonic};
+
+    /**
+     *  Trace clock reading, in nanoseconds.
+     */
+    std::uint64_t trace_ns{0};
+
+    /**
+     *  CLOCK_REALTIME reading, in nanoseconds since the Unix epoch.
+     */
+    std::uint64_t realtime_ns{0};
+
+    /**
+     *  CLOCK_MONOTONIC reading, in nanoseconds.
+     */
+    std::uint64_t monotonic_ns{0};
+
+    /**
+     *  CLOCK_BOOTTIME reading, in nanoseconds.
+     */
+    std::uint64_t boottime_ns{0};
+
+    /**
+     *  Width of the window the readings were taken in; an upper bound on
+     *  the error of the offsets.
+     */
+    std::uint64_t uncertainty_ns{0};
+
+    /**
+     *  Offset to add to a trace timestamp to get wall-clock time.
+     */
+    [[nodiscard]] constexpr auto realtimeOffsetNs() const noexcept -> std::int64_t
+    {
+        return static_cast<std::int64_t>(realtime_ns - trace_ns);
+    }
+
+    /**
+     *  Time the system had spent suspended when the snapshot was taken.
+     */
+    [[nodiscard]] constexpr auto suspendedNs() const noexcept -> std::uint64_t
+    {
+        return (boottime_ns > monotonic_ns) ? boottime_ns - monotonic_ns : 0;
+    }
+
+    /**
+     *  Maps a trace timestamp to nanoseconds since the Unix epoch.
+     *
+     *  Exact for ClockSource::kBoottime. A CLOCK_MONOTONIC timestamp taken
+     *  on the other side of a suspend is off by the suspended time, which
+     *  is the reason to prefer boottime.
+     *
+     *  @param      trace_timestamp_ns  Timestamp from the snapshot's clock.
+     *  @return     Nanoseconds since the Unix epoch.
+     */
+    [[nodiscard]] constexpr auto toRealtimeNs(std::uint64_t trace_timestamp_ns) const noexcept
+        -> std::uint64_t
+    {
+        return trace_timestamp_ns + static_cast<std::uint64_t>(realtimeOffsetNs());
+    }
+};
+
+/**
+ *  Reads all clocks as close together as possible.
+ *
+ *  Each attempt reads the other clocks between two reads of the trace
+ *  clock; the attempt with the narrowest bracket wins, which filters out
+ *  preemption and keeps the offsets well below a microsecond.
+ *
+ *  @param      source    The trace clock.
+ *  @param      attempts  Number of bracketed reads (at least one is made).
+ *  @return     The snapshot.
+ */
+[[nodiscard]] auto captureClockSnapshot(ClockSource source = traceClock(),
+                                        std::size_t attempts = kClockSnapshotAttempts)
+    -> ClockSnapshot;
+
+}  // namespace threveal::core
+
+#endif  // THREVEAL_CORE_CLOCK_HPP_
@@ -58,6 +58,11 @@ enum class TopologyError : std::uint8_t
      *  Permission was denied when accessing sysfs entries.
      */
     kPermissionDenied = 5,
+
+    /**
+     *  The topology watcher is not in a valid state for the operation.
+     */
+    kInvalidState = 6,
 };
 
 /**
@@ -80,6 +85,8 @@ enum class TopologyError : std::uint8_t
             return "invalid CPU ID";
         case TopologyError::kPermissionDenied:
             return "permission denied accessing sysfs";
+        case TopologyError::kInvalidState:
+            return "topology watcher in invalid state";
     }
     return "unknown topology error";
 }
@@ -167,6 +174,274 @@ enum class PmuError : std::uint8_t
     return "unknown PMU error";
 }
 
+/**
+ *  Error conditions that can occur during RAPL energy collection.
+ *
+ *  These errors are returned via std::expected from energy collection
+ *  functions when the powercap interface cannot be read.
+ */
+enum class EnergyError : std::uint8_t
+{
+    /**
+     *  No usable RAPL domains were found under the powercap root.
+     *
+     *  This typically indicates /sys/class/powercap/intel-rapl:* is absent
+     *  (intel_rapl_common not loaded, or running inside a VM).
+     */
+    kPowercapNotFound = 1,
+
+    /**
+     *  Reading an energy counter failed or returned malformed content.
+     */
+    kReadFailed = 2,
+
+    /**
+     *  Permission denied when reading energy_uj.
+     *
+     *  Since Linux 5.10 the energy counters are readable by root only.
+     */
+    kPermissionDenied = 3,
+
+    /**
+     *  The energy sampler is in an invalid state for the operation.
+     */
+    kInvalidState = 4,
+};
+
+/**
+ *  Converts an EnergyError to its human-readable string representation.
+ *
+ *  @param      error  The error to convert.
+ *  @return     A string view describing the error condition.
+ */
+[[nodiscard]] constexpr auto toString(EnergyError error) noexcept -> std::string_view
+{
+    switch (error)
+    {
+        case EnergyError::kPowercapNotFound:
+            return "RAPL powercap domains not found";
+        case EnergyError::kReadFailed:
+            return "failed to read energy counter";
+        case EnergyError::kPermissionDenied:
+            return "permission denied reading energy counters";
+        case EnergyError::kInvalidState:
+            return "energy sampler in invalid state";
+    }
+    return "unknown energy error";
+}
+
+/**
+ *  Error conditions that can occur while monitoring HFI updates.
+ */
+enum class HfiError : std::uint8_t
+{
+    /**
+     *  Failed to create or bind the netlink socket.
+     */
+    kSocketFailed = 1,
+
+    /**
+     *  The thermal netlink family or its event group is not registered.
+     *
+     *  Indicates a kernel without CONFIG_THERMAL_NETLINK or without HFI.
+     */
+    kFamilyNotFound = 2,
+
+    /**
+     *  Joining the thermal event multicast group failed.
+     */
+    kSubscribeFailed = 3,
+
+    /**
+     *  The replay file could not be opened.
+     */
+    kSourceNotFound = 4,
+
+    /**
+     *  The monitor is not in a valid state for the operation.
+     */
+    kInvalidState = 5,
+};
+
+/**
+ *  Converts an HfiError to its human-readable string representation.
+ *
+ *  @param      error  The error to convert.
+ *  @return     A string view describing the error condition.
+ */
+[[nodiscard]] constexpr auto toString(HfiError error) noexcept -> std::string_view
+{
+    switch (error)
+    {
+        case HfiError::kSocketFailed:
+            return "failed to create netlink socket";
+        case HfiError::kFamilyNotFound:
+            return "thermal netlink family not available";
+        case HfiError::kSubscribeFailed:
+            return "failed to join thermal event group";
+        case HfiError::kSourceNotFound:
+            return "HFI replay file not found";
+        case HfiError::kInvalidState:
+            return "HFI monitor in invalid state";
+    }
+    return "unknown HFI error";
+}
+
+/**
+ *  Error conditions that can occur while reading or writing trace files.
+ */
+enum class TraceError : std::uint8_t
+{
+    /**
+     *  The trace file could not be opened or created.
+     */
+    kOpenFailed = 1,
+
+    /**
+     *  Reading failed or the file ended before all records were read.
+     */
+    kReadFailed = 2,
+
+    /**
+     *  Writing the trace file failed.
+     */
+    kWriteFailed = 3,
+
+    /**
+     *  The trace header is malformed.
+     */
+    kParseError = 4,
+
+    /**
+     *  The file was written by an unsupported version of the format.
+     */
+    kVersionMismatch = 5,
+
+    /**
+     *  The header holds a value that cannot be written, such as a host
+     *  name containing a line break.
+     */
+    kInvalidHeader = 6,
+
+    /**
+     *  The records passed to a writer do not match the table it writes.
+     */
+    kSchemaMismatch = 7,
+};
+
+/**
+ *  Converts a TraceError to its human-readable string representation.
+ *
+ *  @param      error  The error to convert.
+ *  @return     A string view describing the error condition.
+ */
+[[nodiscard]] constexpr auto toString(TraceError error) noexcept -> std::string_view
+{
+    switch (error)
+    {
+        case TraceError::kOpenFailed:
+            return "failed to open trace file";
+        case TraceError::kReadFailed:
+            return "failed to read trace file";
+        case TraceError::kWriteFailed:
+            return "failed to write trace file";
+        case TraceError::kParseError:
+            return "malformed trace header";
+        case TraceError::kVersionMismatch:
+            return "unsupported trace format version";
+        case TraceError::kInvalidHeader:
+            return "trace header cannot be written";
+        case TraceError::kSchemaMismatch:
+            return "records do not match the trace schema";
+    }
+    return "unknown trace error";
+}
+
+/**
+ *  Error conditions that can occur while streaming events over a socket.
+ */
+enum class TransportError : std::uint8_t
+{
+    /**
+     *  The endpoint address is malformed, such as a socket path that is
+     *  too long or an address that is not numeric.
+     */
+    kInvalidEndpoint = 1,
+
+    /**
+     *  socket() or a socket option failed.
+     */
+    kSocketFailed = 2,
+
+    /**
+     *  Connecting to the aggregator failed.
+     */
+    kConnectFailed = 3,
+
+    /**
+     *  Binding or listening on the endpoint failed.
+     */
+    kBindFailed = 4,
+
+    /**
+     *  The peer closed the connection or it failed while sending.
+     */
+    kDisconnected = 5,
+
+    /**
+     *  Waiting for the socket failed.
+     */
+    kPollFailed = 6,
+
+    /**
+     *  The peer sent a frame that does not follow the stream protocol.
+     */
+    kProtocolError = 7,
+
+    /**
+     *  The operation did not complete before its deadline.
+     */
+    kTimedOut = 8,
+
+    /**
+     *  Creating, sizing or mapping shared memory failed, or the mapping is
+     *  not a compatible ring.
+     */
+    kMapFailed = 9,
+};
+
+/**
+ *  Converts a TransportError to its human-readable string representation.
+ *
+ *  @param      error  The error to convert.
+ *  @return     A string view describing the error condition.
+ */
+[[nodiscard]] constexpr auto toString(TransportError error) noexcept -> std::string_view
+{
+    switch (error)
+    {
+        case TransportError::kInvalidEndpoint:
+            return "invalid stream endpoint";
+        case TransportError::kSocketFailed:
+            return "failed to create socket";
+        case TransportError::kConnectFailed:
+            return "failed to connect to aggregator";
+        case TransportError::kBindFailed:
+            return "failed to listen on endpoint";
+        case TransportError::kDisconnected:
+            return "stream peer disconnected";
+        case TransportError::kPollFailed:
+            return "failed to wait for socket";
+        case TransportError::kProtocolError:
+            return "stream protocol violation";
+        case TransportError::kTimedOut:
+            return "stream operation timed out";
+        case TransportError::kMapFailed:
+            return "failed to map shared memory";
+    }
+    return "unknown transport error";
+}
+
 }  // namespace threveal::core
 
 #endif  // THREVEAL_CORE_ERRORS_HPP_
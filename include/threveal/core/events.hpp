@@ -14,6 +14,7 @@
 #include "threveal/core/types.hpp"
 
 #include <array>
+#include <compare>
 #include <cstdint>
 #include <string>
 #include <string_view>
@@ -21,7 +22,8 @@
 namespace threveal::core
 {
 
-// Forward declaration to avoid circular dependency
+// Forward declarations to avoid circular dependency
+class TopologyHandle;
 class TopologyMap;
 
 /**
@@ -88,6 +90,40 @@ enum class MigrationType : std::uint8_t
     return "Invalid";
 }
 
+/**
+ *  How precisely a migration was observed.
+ */
+enum class MigrationFidelity : std::uint8_t
+{
+    /**
+     *  Captured at the scheduler tracepoint with its exact time and CPUs.
+     */
+    kExact = 0,
+
+    /**
+     *  Inferred from a thread's CPU changing between two polls.
+     *
+     *  The timestamp is the poll that saw the change, migrations in
+     *  between are missed, and the source CPU is the one last seen.
+     */
+    kPolled = 1,
+};
+
+/**
+ *  Converts a MigrationFidelity to its string representation.
+ */
+[[nodiscard]] constexpr auto toString(MigrationFidelity fidelity) noexcept -> std::string_view
+{
+    switch (fidelity)
+    {
+        case MigrationFidelity::kExact:
+            return "exact";
+        case MigrationFidelity::kPolled:
+            return "polled";
+    }
+    return "invalid";
+}
+
 /**
  *  Represents a scheduler migration event captured from the kernel.
  *
@@ -97,7 +133,7 @@ enum class MigrationType : std::uint8_t
 struct MigrationEvent
 {
     /**
-     *  Timestamp when the migration occurred (nanoseconds since boot).
+     *  Timestamp when the migration occurred (nanoseconds on the trace clock).
      */
     std::uint64_t timestamp_ns;
 
@@ -126,6 +162,36 @@ struct MigrationEvent
      */
     std::array<char, kMaxCommLength> comm;
 
+    /**
+     *  Topology generation in effect when the event was captured.
+     *
+     *  Zero if the producer did not stamp the event.
+     */
+    TopologyGeneration topology_generation{0};
+
+    /**
+     *  Core type of the source CPU as seen by the producer, if stamped.
+     */
+    CoreType src_type{CoreType::kUnknown};
+
+    /**
+     *  Core type of the destination CPU as seen by the producer, if stamped.
+     */
+    CoreType dst_type{CoreType::kUnknown};
+
+    /**
+     *  Number of migrations this event stands for.
+     *
+     *  The producer keeps 1 in N events under load and records N here;
+     *  counts should sum weights rather than events.
+     */
+    std::uint32_t sample_weight{1};
+
+    /**
+     *  How the migration was observed; polled events are low fidelity.
+     */
+    MigrationFidelity fidelity{MigrationFidelity::kExact};
+
     /**
      *  Returns the command name as a string view.
      *
@@ -141,6 +207,156 @@ struct MigrationEvent
     }
 };
 
+/**
+ *  Migrations of one thread that were counted but not streamed.
+ *
+ *  Produced when a thread exceeds its per-thread rate limit; the
+ *  suppressed migrations are known only by their number and time span.
+ */
+struct SuppressionSummary
+{
+    /**
+     *  Time the summary was produced (nanoseconds on the trace clock).
+     */
+    std::uint64_t timestamp_ns;
+
+    /**
+     *  Timestamp of the first suppressed migration in the summary.
+     */
+    std::uint64_t first_suppressed_ns;
+
+    /**
+     *  Number of suppressed migrations.
+     */
+    std::uint64_t suppressed;
+
+    /**
+     *  Process ID of the rate-limited thread.
+     */
+    std::uint32_t pid;
+
+    /**
+     *  Thread ID of the rate-limited thread.
+     */
+    std::uint32_t tid;
+};
+
+/**
+ *  Lifecycle transitions of a thread.
+ *
+ *  Values match the THREAD_EVENT_* constants of the BPF program.
+ */
+enum class ThreadLifecycleKind : std::uint8_t
+{
+    /**
+     *  The thread was created by fork() or clone().
+     */
+    kFork = 1,
+
+    /**
+     *  The thread started a new program; its name changed with it.
+     */
+    kExec = 2,
+
+    /**
+     *  The thread exited; its thread ID may be reused from now on.
+     */
+    kExit = 3,
+
+    /**
+     *  The thread was renamed.
+     */
+    kRename = 4,
+};
+
+/**
+ *  Converts a ThreadLifecycleKind to its human-readable string representation.
+ *
+ *  @param      kind  The transition to convert.
+ *  @return     A string view containing "fork", "exec", "exit" or "rename".
+ */
+[[nodiscard]] constexpr auto toString(ThreadLifecycleKind kind) noexcept -> std::string_view
+{
+    switch (kind)
+    {
+        case ThreadLifecycleKind::kFork:
+            return "fork";
+        case ThreadLifecycleKind::kExec:
+            return "exec";
+        case ThreadLifecycleKind::kExit:
+            return "exit";
+        case ThreadLifecycleKind::kRename:
+            return "rename";
+    }
+    return "Invalid";
+}
+
+/**
+ *  Identifies one thread over a whole capture.
+ *
+ *  Thread IDs are reused once a thread exits; the thread's start time
+ *  tells the threads that shared an ID apart. A start time of zero means
+ *  the thread's lifecycle is unknown.
+ */
+struct ThreadKey
+{
+    /**
+     *  Thread ID.
+     */
+    std::uint32_t tid{0};
+
+    /**
+     *  Time the thread was created (nanoseconds on the trace clock).
+     */
+    std::uint64_t start_time_ns{0};
+
+    [[nodiscard]] auto operator<=>(const ThreadKey&) const = default;
+};
+
+/**
+ *  A thread was created, started a new program, exited or was renamed.
+ */
+struct ThreadLifecycleEvent
+{
+    /**
+     *  Time of the transition (nanoseconds on the trace clock).
+     */
+    std::uint64_t timestamp_ns;
+
+    /**
+     *  Time the thread was created, or zero if unknown.
+     */
+    std::uint64_t start_time_ns;
+
+    /**
+     *  Process ID the thread belongs to.
+     */
+    std::uint32_t pid;
+
+    /**
+     *  Thread ID.
+     */
+    std::uint32_t tid;
+
+    /**
+     *  The transition.
+     */
+    ThreadLifecycleKind kind;
+
+    /**
+     *  Command name after the transition (may be truncated).
+     */
+    std::array<char, kMaxCommLength> comm;
+
+    /**
+     *  Returns the thread this event belongs to.
+     */
+    [[nodiscard]] constexpr auto key() const noexcept -> ThreadKey
+    {
+        return {tid, start_time_ns};
+    }
+};
+
 /**
  *  Represents a hardware performance counter sample.
  *
@@ -150,7 +366,7 @@ struct MigrationEvent
 struct PmuSample
 {
     /**
-     *  Timestamp when the sample was collected (nanoseconds since boot).
+     *  Timestamp when the sample was collected (nanoseconds on the trace clock).
      */
     std::uint64_t timestamp_ns;
 
@@ -218,6 +434,73 @@ struct PmuSample
     }
 };
 
+/**
+ *  Represents a RAPL energy reading over one sampling interval.
+ *
+ *  Energy samples are collected at the PMU sampler cadence and attributed
+ *  to threads in proportion to the cycles they retired on each core type.
+ */
+struct EnergySample
+{
+    /**
+     *  Timestamp when the sample was collected (nanoseconds on the trace clock).
+     */
+    std::uint64_t timestamp_ns;
+
+    /**
+     *  Package-domain energy consumed since last sample, in microjoules.
+     */
+    std::uint64_t package_energy_uj;
+
+    /**
+     *  Cores-domain (PP0) energy consumed since last sample, in microjoules.
+     *
+     *  Zero when the platform does not expose a cores domain.
+     */
+    std::uint64_t cores_energy_uj;
+};
+
+/**
+ *  Represents an Intel Hardware Feedback Interface (HFI) capability update.
+ *
+ *  The kernel publishes per-CPU performance and efficiency capabilities
+ *  through thermal netlink whenever the HFI table changes (thermal limits,
+ *  power budget). Capabilities are scaled to 0-1023; a value of zero means
+ *  the hardware recommends not scheduling work on that CPU.
+ */
+struct HfiCapabilityUpdate
+{
+    /**
+     *  Timestamp when the update was received (nanoseconds on the trace clock).
+     */
+    std::uint64_t timestamp_ns;
+
+    /**
+     *  CPU whose capabilities changed.
+     */
+    CpuId cpu_id;
+
+    /**
+     *  Relative performance capability (0-1023).
+     */
+    std::uint32_t performance;
+
+    /**
+     *  Relative energy efficiency capability (0-1023).
+     */
+    std::uint32_t efficiency;
+};
+
+/**
+ *  Maps a pair of resolved core types to a migration type.
+ *
+ *  @param      src_type  Core type of the source CPU.
+ *  @param      dst_type  Core type of the destination CPU.
+ *  @return     The migration type, or kUnknown if either type is unknown.
+ */
+[[nodiscard]] auto classifyCoreTypes(CoreType src_type, CoreType dst_type) noexcept
+    -> MigrationType;
+
 /**
  *  Classifies a migration event by determining source and destination core types.
  *
@@ -232,6 +515,21 @@ struct PmuSample
 [[nodiscard]] auto classifyMigration(const MigrationEvent& event, const TopologyMap& topology)
     -> MigrationType;
 
+/**
+ *  Classifies a migration event against a runtime-updated topology.
+ *
+ *  Core types stamped on the event by its producer win, since they reflect
+ *  the topology at capture time. Otherwise the current snapshot is used.
+ *  Never blocks on a concurrent topology update.
+ *
+ *  @param      event   The migration event to classify.
+ *  @param      handle  Handle to the current topology.
+ *  @return     The classified migration type, or kUnknown if either CPU
+ *              cannot be resolved.
+ */
+[[nodiscard]] auto classifyMigration(const MigrationEvent& event, const TopologyHandle& handle)
+    -> MigrationType;
+
 }  // namespace threveal::core
 
 #endif  // THREVEAL_CORE_EVENTS_HPP_
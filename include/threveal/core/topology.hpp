@@ -17,6 +17,7 @@
 #include <cstdint>
 #include <expected>
 #include <span>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -105,17 +106,88 @@ class TopologyMap
      */
     [[nodiscard]] auto isSmtSibling(CpuId cpu_a, CpuId cpu_b) const noexcept -> bool;
 
+    /**
+     *  Checks if a CPU is isolated from the general scheduler domains.
+     *
+     *  @param      cpu_id  The logical CPU identifier.
+     *  @return     True if the CPU was listed as isolated when loaded.
+     */
+    [[nodiscard]] auto isIsolated(CpuId cpu_id) const noexcept -> bool;
+
+    /**
+     *  Returns a view of all isolated CPU IDs.
+     *
+     *  @return     A sorted span of isolated CPU IDs.
+     */
+    [[nodiscard]] auto getIsolatedCpus() const noexcept -> std::span<const CpuId>;
+
+    /**
+     *  Returns a copy restricted to the given online CPUs.
+     *
+     *  CPUs not in the online list are dropped from both core lists, so
+     *  offlined CPUs classify as unknown rather than as their old type.
+     *
+     *  @param      online  CPU IDs that are currently online.
+     *  @return     A new TopologyMap with only online CPUs.
+     */
+    [[nodiscard]] auto withOnlineCpus(std::span<const CpuId> online) const -> TopologyMap;
+
+    /**
+     *  Returns a copy with the given set of isolated CPUs.
+     *
+     *  @param      isolated  CPU IDs that are isolated.
+     *  @return     A new TopologyMap with the isolated set replaced.
+     */
+    [[nodiscard]] auto withIsolatedCpus(std::span<const CpuId> isolated) const -> TopologyMap;
+
+    /**
+     *  Compares core assignments, SMT data and isolation state.
+     */
+    [[nodiscard]] friend auto operator==(const TopologyMap&, const TopologyMap&) -> bool = default;
+
+    /**
+     *  Returns the physical core ID of each logical CPU, indexed by CPU ID.
+     *
+     *  @return     A span of core IDs (kInvalidCpuId where unknown); empty
+     *              if SMT data was not loaded.
+     */
+    [[nodiscard]] auto getPhysicalCoreIds() const noexcept -> std::span<const CpuId>;
+
+    /**
+     *  Returns a copy with the given SMT data.
+     *
+     *  @param      core_ids  Physical core ID per logical CPU, indexed by CPU ID.
+     *  @return     A new TopologyMap with SMT data replaced.
+     */
+    [[nodiscard]] auto withPhysicalCoreIds(std::span<const CpuId> core_ids) const -> TopologyMap;
+
     /**
      *  Loads CPU topology from sysfs.
      *
      *  Parses /sys/devices/cpu_core/cpus and /sys/devices/cpu_atom/cpus
-     *  to determine which CPUs are P-cores and E-cores.
+     *  to determine which CPUs are P-cores and E-cores, then drops CPUs
+     *  not listed in /sys/devices/system/cpu/online and records those in
+     *  /sys/devices/system/cpu/isolated.
      *
      *  @return     A populated TopologyMap on success, or a TopologyError
      *              indicating why detection failed.
      */
     [[nodiscard]] static auto loadFromSysfs() -> std::expected<TopologyMap, TopologyError>;
 
+    /**
+     *  Loads CPU topology from a sysfs tree mounted at an arbitrary root.
+     *
+     *  All files are opened with openat() relative to directory descriptors
+     *  and read into stack buffers in a single pass over the present CPUs,
+     *  which keeps startup cheap on hosts with hundreds of CPUs.
+     *
+     *  @param      sysfs_root  Path of the sysfs root (normally "/sys").
+     *  @return     A populated TopologyMap on success, or a TopologyError
+     *              indicating why detection failed.
+     */
+    [[nodiscard]] static auto loadFromSysfsRoot(std::string_view sysfs_root)
+        -> std::expected<TopologyMap, TopologyError>;
+
   private:
     /**
      *  Builds the CPU ID to CoreType lookup table.
@@ -125,20 +197,37 @@ class TopologyMap
      */
     void buildLookupTable();
 
-    /**
-     *  Loads SMT sibling data from sysfs.
-     *
-     *  Reads /sys/devices/system/cpu/cpu<N>/topology/core_id for each CPU
-     *  to determine which CPUs share a physical core.
-     */
-    void loadSmtData();
-
     std::vector<CpuId> p_cores_;
     std::vector<CpuId> e_cores_;
     std::vector<CoreType> cpu_to_type_;
     std::vector<CpuId> physical_core_id_;
+    std::vector<CpuId> isolated_;
 };
 
+/**
+ *  Trims leading and trailing whitespace from a string view.
+ *
+ *  @param      str  The string view to trim.
+ *  @return     A string view with whitespace removed from both ends.
+ */
+[[nodiscard]] constexpr auto trim(std::string_view str) noexcept -> std::string_view
+{
+    const char* whitespace = " \t\n\r";
+
+    // Find first non-whitespace character
+    auto start = str.find_first_not_of(whitespace);
+    if (start == std::string_view::npos)
+    {
+        // String is all whitespace
+        return {};
+    }
+
+    // Find last non-whitespace character
+    auto end = str.find_last_not_of(whitespace);
+
+    return str.substr(start, end - start + 1);
+}
+
 /**
  *  Parses a CPU list string in sysfs format.
  *
@@ -155,6 +244,17 @@ class TopologyMap
 [[nodiscard]] auto parseCpuList(std::string_view content)
     -> std::expected<std::vector<CpuId>, TopologyError>;
 
+/**
+ *  Formats CPU IDs in the compact sysfs list format.
+ *
+ *  The inverse of parseCpuList(): {0, 1, 2, 5, 7, 8} becomes "0-2,5,7-8".
+ *  Input order and duplicates do not matter.
+ *
+ *  @param      cpus  The CPU IDs to format.
+ *  @return     The list string, empty for an empty input.
+ */
+[[nodiscard]] auto formatCpuList(std::span<const CpuId> cpus) -> std::string;
+
 /**
  *  Parses a core_type sysfs string to determine the core type.
  *
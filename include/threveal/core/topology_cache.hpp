@@ -0,0 +1,108 @@
+/**
+ *  @file       topology_cache.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Persistent topology snapshot for fast tool startup.
+ *
+ *  Probing sysfs touches a few files per CPU. The result only changes on
+ *  reboot, hotplug or isolation changes, so it is cached in a small text
+ *  file keyed by the kernel boot ID together with the online and isolated
+ *  CPU lists. A later invocation reads three short files plus the cache
+ *  instead of probing every CPU.
+ */
+
+#ifndef THREVEAL_CORE_TOPOLOGY_CACHE_HPP_
+#define THREVEAL_CORE_TOPOLOGY_CACHE_HPP_
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
+
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace threveal::core
+{
+
+/**
+ *  Path of the kernel's per-boot random UUID.
+ */
+inline constexpr std::string_view kBootIdPath = "/proc/sys/kernel/random/boot_id";
+
+/**
+ *  Locations used by loadTopologyCached().
+ */
+struct TopologyCacheOptions
+{
+    /**
+     *  Cache file path; empty selects defaultTopologyCachePath().
+     */
+    std::string cache_path;
+
+    /**
+     *  Sysfs root to probe on a cache miss.
+     */
+    std::string sysfs_root{"/sys"};
+
+    /**
+     *  File holding the boot ID.
+     */
+    std::string boot_id_path{kBootIdPath};
+};
+
+/**
+ *  Returns the default cache location.
+ *
+ *  Uses $XDG_RUNTIME_DIR (a per-user tmpfs cleared on logout) when set,
+ *  otherwise a per-UID file in /tmp.
+ *
+ *  @return     The cache file path.
+ */
+[[nodiscard]] auto defaultTopologyCachePath() -> std::string;
+
+/**
+ *  Computes the cache key for the current boot and CPU state.
+ *
+ *  @param      options  Locations of the boot ID and sysfs root.
+ *  @return     The key, or std::nullopt if the boot ID cannot be read.
+ */
+[[nodiscard]] auto topologyCacheKey(const TopologyCacheOptions& options = {})
+    -> std::optional<std::string>;
+
+/**
+ *  Serializes a topology together with its cache key.
+ *
+ *  @param      map  The topology to serialize.
+ *  @param      key  Cache key from topologyCacheKey().
+ *  @return     The serialized snapshot.
+ */
+[[nodiscard]] auto serializeTopology(const TopologyMap& map, std::string_view key) -> std::string;
+
+/**
+ *  Restores a topology serialized with serializeTopology().
+ *
+ *  @param      data  The serialized snapshot.
+ *  @param      key   The key the snapshot must have been written with.
+ *  @return     The topology, or TopologyError::kParseError if the data is
+ *              malformed or was written under a different key.
+ */
+[[nodiscard]] auto deserializeTopology(std::string_view data, std::string_view key)
+    -> std::expected<TopologyMap, TopologyError>;
+
+/**
+ *  Loads the topology from the cache, probing sysfs on a miss.
+ *
+ *  A fresh probe result is written back to the cache on a best-effort
+ *  basis; failing to write never fails the load. Cache files not owned by
+ *  the current user are ignored.
+ *
+ *  @param      options  Cache, sysfs and boot ID locations.
+ *  @return     The topology, or the probe's TopologyError.
+ */
+[[nodiscard]] auto loadTopologyCached(const TopologyCacheOptions& options = {})
+    -> std::expected<TopologyMap, TopologyError>;
+
+}  // namespace threveal::core
+
+#endif  // THREVEAL_CORE_TOPOLOGY_CACHE_HPP_
@@ -0,0 +1,95 @@
+/**
+ *  @file       topology_handle.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Read-copy-update handle for a CPU topology that changes at runtime.
+ *
+ *  CPUs can be offlined, onlined, isolated or unisolated while tracing.
+ *  Each change produces a new immutable TopologyMap, published together
+ *  with a generation number. Readers take a snapshot without locking and
+ *  keep using it for as long as they hold the pointer.
+ */
+
+#ifndef THREVEAL_CORE_TOPOLOGY_HANDLE_HPP_
+#define THREVEAL_CORE_TOPOLOGY_HANDLE_HPP_
+
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace threveal::core
+{
+
+/**
+ *  An immutable topology paired with the generation it was published as.
+ */
+struct TopologySnapshot
+{
+    /**
+     *  The CPU topology at this generation.
+     */
+    TopologyMap map;
+
+    /**
+     *  Generation number, starting at 1 for the initial topology.
+     */
+    TopologyGeneration generation;
+};
+
+/**
+ *  Shared, atomically swappable reference to the current topology.
+ *
+ *  Readers call load() and never block on a writer. Writers call publish()
+ *  with a freshly built map; the previous snapshot is freed once the last
+ *  reader drops it.
+ */
+class TopologyHandle
+{
+  public:
+    /**
+     *  Creates a handle whose first generation is the given topology.
+     *
+     *  @param      initial  The topology to publish as generation 1.
+     */
+    explicit TopologyHandle(TopologyMap initial);
+
+    // Shared by reference between readers and the watcher
+    TopologyHandle(const TopologyHandle&) = delete;
+    auto operator=(const TopologyHandle&) -> TopologyHandle& = delete;
+    TopologyHandle(TopologyHandle&&) = delete;
+    auto operator=(TopologyHandle&&) -> TopologyHandle& = delete;
+    ~TopologyHandle() = default;
+
+    /**
+     *  Returns the current snapshot.
+     *
+     *  @return     A non-null pointer to the latest published snapshot.
+     */
+    [[nodiscard]] auto load() const noexcept -> std::shared_ptr<const TopologySnapshot>;
+
+    /**
+     *  Publishes a new topology as the next generation.
+     *
+     *  @param      map  The new topology.
+     *  @return     The generation number assigned to it.
+     */
+    auto publish(TopologyMap map) -> TopologyGeneration;
+
+    /**
+     *  Returns the generation of the current snapshot.
+     */
+    [[nodiscard]] auto generation() const noexcept -> TopologyGeneration;
+
+  private:
+    std::atomic<std::shared_ptr<const TopologySnapshot>> current_;
+
+    // Serializes writers so generations are assigned without gaps
+    std::mutex publish_mutex_;
+};
+
+}  // namespace threveal::core
+
+#endif  // THREVEAL_CORE_TOPOLOGY_HANDLE_HPP_
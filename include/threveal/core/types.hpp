@@ -31,6 +31,13 @@ using CpuId = std::uint32_t;
  */
 inline constexpr CpuId kInvalidCpuId = std::numeric_limits<CpuId>::max();
 
+/**
+ *  Monotonic version number of a published CPU topology.
+ *
+ *  Generation 0 means "not stamped"; the first published topology is 1.
+ */
+using TopologyGeneration = std::uint32_t;
+
 /**
  *  Classification of CPU core types on Intel hybrid architectures.
  *
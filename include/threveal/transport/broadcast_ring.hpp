@@ -0,0 +1,218 @@
+/**
+ *  @file       broadcast_ring.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Shared-memory fan-out of the migration stream to other processes.
+ *
+ *  One process collects migrations and publishes them into a ring in a
+ *  memfd; any number of co-located processes map the same memfd read-only
+ *  and follow the stream without loading BPF programs of their own. Each
+ *  record fills one 64-byte cache line guarded by its own sequence lock,
+ *  so the publisher never waits for readers and a reader that falls more
+ *  than a ring's length behind detects exactly how many records it lost.
+ *
+ *  The memfd descriptor is handed to subscribers over a Unix socket with
+ *  sendDescriptor()/receiveDescriptor(), or opened via /proc/<pid>/fd.
+ */
+
+#ifndef THREVEAL_TRANSPORT_BROADCAST_RING_HPP_
+#define THREVEAL_TRANSPORT_BROADCAST_RING_HPP_
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+
+namespace threveal::transport
+{
+
+/**
+ *  Size of a ring slot; one cache line.
+ */
+inline constexpr std::size_t kBroadcastSlotSize = 64;
+
+/**
+ *  Default number of slots in a ring (4 MiB of records).
+ */
+inline constexpr std::size_t kDefaultBroadcastSlots = 65536;
+
+/**
+ *  Shared layout of a ring; defined in the implementation.
+ */
+struct BroadcastRingLayout;
+
+/**
+ *  Single writer of a broadcast ring.
+ *
+ *  publish() is wait-free but not thread-safe: call it from one thread,
+ *  such as the MigrationTracker callback.
+ */
+class BroadcastPublisher
+{
+  public:
+    /**
+     *  Creates a ring in a new memfd.
+     *
+     *  @param      name   Name shown in /proc/<pid>/fd, for debugging.
+     *  @param      slots  Ring capacity, rounded up to a power of two.
+     *  @return     The publisher, or TransportError::kMapFailed.
+     */
+    [[nodiscard]] static auto create(const std::string& name,
+                                     std::size_t slots = kDefaultBroadcastSlots)
+        -> std::expected<BroadcastPublisher, core::TransportError>;
+
+    ~BroadcastPublisher();
+
+    BroadcastPublisher(const BroadcastPublisher&) = delete;
+    auto operator=(const BroadcastPublisher&) -> BroadcastPublisher& = delete;
+
+    BroadcastPublisher(BroadcastPublisher&& other) noexcept;
+    auto operator=(BroadcastPublisher&& other) noexcept -> BroadcastPublisher&;
+
+    /**
+     *  Appends a migration, overwriting the oldest record once full.
+     */
+    void publish(const core::MigrationEvent& event) noexcept;
+
+    /**
+     *  Appends migrations in order.
+     */
+    void publish(std::span<const core::MigrationEvent> events) noexcept;
+
+    /**
+     *  Returns the memfd to hand to subscribers; owned by the publisher.
+     */
+    [[nodiscard]] auto fd() const noexcept -> int;
+
+    /**
+     *  Returns the number of slots in the ring.
+     */
+    [[nodiscard]] auto capacity() const noexcept -> std::size_t;
+
+    /**
+     *  Returns the number of migrations published so far.
+     */
+    [[nodiscard]] auto published() const noexcept -> std::uint64_t;
+
+  private:
+    BroadcastPublisher(int fd, BroadcastRingLayout* ring, std::size_t map_size) noexcept;
+
+    int fd_{-1};
+    BroadcastRingLayout* ring_{nullptr};
+    std::size_t map_size_{0};
+};
+
+/**
+ *  Read-only follower of a broadcast ring.
+ *
+ *  Each subscriber keeps its own cursor, so subscribers never affect the
+ *  publisher or each other.
+ */
+class BroadcastSubscriber
+{
+  public:
+    /**
+     *  Where a new subscriber starts reading.
+     */
+    enum class Start : std::uint8_t
+    {
+        /**
+         *  Only migrations published after attaching.
+         */
+        kLatest = 0,
+
+        /**
+         *  The oldest migration still in the ring.
+         */
+        kOldest = 1,
+    };
+
+    /**
+     *  Maps a ring from a memfd descriptor.
+     *
+     *  @param      fd     Descriptor of the ring; the caller keeps
+     *                     ownership, the mapping does not need it.
+     *  @param      start  Where to start reading.
+     *  @return     The subscriber, or TransportError::kMapFailed if the
+     *              descriptor is not a compatible ring.
+     */
+    [[nodiscard]] static auto attach(int fd, Start start = Start::kLatest)
+        -> std::expected<BroadcastSubscriber, core::TransportError>;
+
+    /**
+     *  Maps a ring by path, e.g. /proc/<pid>/fd/<fd> of the publisher.
+     */
+    [[nodiscard]] static auto attach(const std::string& path, Start start = Start::kLatest)
+        -> std::expected<BroadcastSubscriber, core::TransportError>;
+
+    ~BroadcastSubscriber();
+
+    BroadcastSubscriber(const BroadcastSubscriber&) = delete;
+    auto operator=(const BroadcastSubscriber&) -> BroadcastSubscriber& = delete;
+
+    BroadcastSubscriber(BroadcastSubscriber&& other) noexcept;
+    auto operator=(BroadcastSubscriber&& other) noexcept -> BroadcastSubscriber&;
+
+    /**
+     *  Copies the next migrations out of the ring.
+     *
+     *  Never blocks. Records overwritten before they could be read are
+     *  skipped and counted in overruns().
+     *
+     *  @param      out  Destination; up to out.size() migrations are read.
+     *  @return     Number of migrations read; 0 when caught up.
+     */
+    [[nodiscard]] auto read(std::span<core::MigrationEvent> out) noexcept -> std::size_t;
+
+    /**
+     *  Returns the number of migrations published but not read yet.
+     */
+    [[nodiscard]] auto backlog() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of migrations lost because the reader fell
+     *  behind.
+     */
+    [[nodiscard]] auto overruns() const noexcept -> std::uint64_t;
+
+  private:
+    BroadcastSubscriber(void* mapping, std::size_t map_size, std::uint64_t cursor) noexcept;
+
+    void* mapping_{nullptr};
+    const BroadcastRingLayout* ring_{nullptr};
+    std::size_t map_size_{0};
+    std::uint64_t cursor_{0};
+    std::uint64_t overruns_{0};
+};
+
+/**
+ *  Passes a descriptor over a connected Unix socket (SCM_RIGHTS).
+ *
+ *  @param      socket_fd  A connected Unix domain socket.
+ *  @param      fd         The descriptor to share.
+ *  @return     Success, or TransportError::kDisconnected.
+ */
+[[nodiscard]] auto sendDescriptor(int socket_fd, int fd)
+    -> std::expected<void, core::TransportError>;
+
+/**
+ *  Receives a descriptor sent with sendDescriptor().
+ *
+ *  Blocks until a descriptor arrives unless the socket is non-blocking.
+ *
+ *  @param      socket_fd  A connected Unix domain socket.
+ *  @return     The received descriptor, owned by the caller;
+ *              TransportError::kDisconnected if the peer closed, or
+ *              TransportError::kProtocolError if no descriptor came with
+ *              the message.
+ */
+[[nodiscard]] auto receiveDescriptor(int socket_fd)
+    -> std::expected<int, core::TransportError>;
+
+}  // namespace threveal::transport
+
+#endif  // THREVEAL_TRANSPORT_BROADCAST_RING_HPP_
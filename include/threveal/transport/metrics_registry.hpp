@@ -0,0 +1,180 @@
+/**
+ *  @file       metrics_registry.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Pre-aggregated counters for continuous monitoring.
+ *
+ *  The collector updates the registry with relaxed atomic increments as
+ *  events arrive; a scrape only loads the same atomics and renders them
+ *  in the OpenMetrics text format. Neither side takes a lock, so a scrape
+ *  never stalls collection. Per-process counters live in a fixed-size
+ *  table sized up front; processes beyond it are counted under
+ *  tgid="other".
+ */
+
+#ifndef THREVEAL_TRANSPORT_METRICS_REGISTRY_HPP_
+#define THREVEAL_TRANSPORT_METRICS_REGISTRY_HPP_
+
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace threveal::transport
+{
+
+/**
+ *  Default number of processes tracked individually.
+ */
+inline constexpr std::size_t kDefaultMetricProcesses = 2048;
+
+/**
+ *  Content type of the text rendered by MetricsRegistry::render().
+ */
+inline constexpr const char* kOpenMetricsContentType =
+    "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+/**
+ *  Where events were dropped before reaching the consumer.
+ */
+enum class DropReason : std::uint8_t
+{
+    /**
+     *  A kernel ring buffer was full.
+     */
+    kRingFull = 0,
+
+    /**
+     *  Suppressed in the kernel by sampling or rate limiting.
+     */
+    kSuppressed = 1,
+
+    /**
+     *  Discarded from a stream sink's bounded queue.
+     */
+    kStreamQueue = 2,
+};
+
+/**
+ *  Lock-free counters rendered as OpenMetrics.
+ *
+ *  recordMigration() keeps per-thread residency state and must be called
+ *  from one thread; every other method may be called from any thread.
+ */
+class MetricsRegistry
+{
+  public:
+    /**
+     *  Creates an empty registry.
+     *
+     *  @param      max_processes  Processes tracked individually.
+     */
+    explicit MetricsRegistry(std::size_t max_processes = kDefaultMetricProcesses);
+
+    ~MetricsRegistry() = default;
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    auto operator=(const MetricsRegistry&) -> MetricsRegistry& = delete;
+    MetricsRegistry(MetricsRegistry&&) = delete;
+    auto operator=(MetricsRegistry&&) -> MetricsRegistry& = delete;
+
+    /**
+     *  Counts a migration by type and process, scaled by its sample
+     *  weight, and credits the time since the thread's previous migration
+     *  to the core type it left.
+     */
+    void recordMigration(const core::MigrationEvent& event) noexcept;
+
+    /**
+     *  Adds a PMU sample's instructions and cycles to a core type.
+     *
+     *  @param      sample  The sample.
+     *  @param      type    Core type of sample.cpu_id.
+     */
+    void recordPmuSample(const core::PmuSample& sample, core::CoreType type) noexcept;
+
+    /**
+     *  Publishes a source's running drop total.
+     *
+     *  @param      reason  The drop source.
+     *  @param      total   Events dropped so far; counters never decrease,
+     *                      so a smaller total is ignored.
+     */
+    void setDropped(DropReason reason, std::uint64_t total) noexcept;
+
+    /**
+     *  Adds time the collector spent handling events.
+     */
+    void addCollectorTime(std::chrono::nanoseconds busy) noexcept;
+
+    /**
+     *  Records how long a scrape took; rendered by the next scrape.
+     */
+    void recordScrape(std::chrono::nanoseconds duration) noexcept;
+
+    /**
+     *  Appends the OpenMetrics exposition, ending with "# EOF".
+     *
+     *  @param      out  Destination; reusing it avoids reallocation.
+     */
+    void render(std::string& out) const;
+
+    /**
+     *  Returns the number of samples the next render() writes.
+     */
+    [[nodiscard]] auto seriesCount() const noexcept -> std::size_t;
+
+  private:
+    static constexpr std::size_t kMigrationTypes = 5;
+    static constexpr std::size_t kCoreTypes = 3;
+    static constexpr std::size_t kDropReasons = 3;
+
+    /**
+     *  Migrations of one process; key is tgid + 1, or 0 while unused.
+     */
+    struct ProcessSlot
+    {
+        std::atomic<std::uint32_t> key{0};
+        std::array<std::atomic<std::uint64_t>, kMigrationTypes> migrations{};
+    };
+
+    /**
+     *  Last migration of a thread, owned by the recordMigration() caller.
+     *
+     *  The cache is direct-mapped by TID; a thread evicted by another
+     *  loses the interval up to its next migration.
+     */
+    struct ResidencyEntry
+    {
+        std::uint32_t tid{0};
+        bool valid{false};
+        std::uint64_t since_ns{0};
+    };
+
+    auto slotFor(std::uint32_t tgid) noexcept -> ProcessSlot&;
+
+    std::size_t max_processes_;
+    std::vector<ProcessSlot> slots_;
+    std::size_t slot_mask_;
+    std::atomic<std::size_t> used_slots_{0};
+    ProcessSlot overflow_;
+
+    std::vector<ResidencyEntry> residency_cache_;
+    std::array<std::atomic<std::uint64_t>, kCoreTypes> residency_ns_{};
+    std::array<std::atomic<std::uint64_t>, kCoreTypes> instructions_{};
+    std::array<std::atomic<std::uint64_t>, kCoreTypes> cycles_{};
+    std::array<std::atomic<std::uint64_t>, kDropReasons> dropped_{};
+    std::atomic<std::uint64_t> collector_ns_{0};
+    std::atomic<std::uint64_t> scrapes_{0};
+    std::atomic<std::uint64_t> last_scrape_ns_{0};
+};
+
+}  // namespace threveal::transport
+
+#endif  // THREVEAL_TRANSPORT_METRICS_REGISTRY_HPP_
@@ -0,0 +1,175 @@
+/**
+ *  @file       metrics_server.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Minimal HTTP/1.1 responder serving a MetricsRegistry to Prometheus.
+ *
+ *  The server runs an epoll loop on one thread and answers GET and HEAD
+ *  for /metrics with the registry rendered in the OpenMetrics text
+ *  format. It listens on a local TCP address or a Unix domain socket,
+ *  keeps connections alive between scrapes and closes idle ones. Request
+ *  bodies, chunked encoding and TLS are not supported.
+ */
+
+#ifndef THREVEAL_TRANSPORT_METRICS_SERVER_HPP_
+#define THREVEAL_TRANSPORT_METRICS_SERVER_HPP_
+
+#include "threveal/core/errors.hpp"
+#include "threveal/transport/metrics_registry.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace threveal::transport
+{
+
+/**
+ *  Path served by a MetricsServer.
+ */
+inline constexpr std::string_view kMetricsPath = "/metrics";
+
+/**
+ *  Options for a MetricsServer.
+ */
+struct MetricsServerOptions
+{
+    /**
+     *  Connections beyond this are closed right after accept().
+     */
+    std::size_t max_connections{64};
+
+    /**
+     *  Connections without traffic for this long are closed.
+     */
+    std::chrono::milliseconds idle_timeout{5000};
+};
+
+/**
+ *  Serves a MetricsRegistry over HTTP.
+ *
+ *  Not thread-safe; run it on its own thread with run(), or call poll()
+ *  from an existing event loop. The registry may be updated concurrently
+ *  and must outlive the server.
+ */
+class MetricsServer
+{
+  public:
+    /**
+     *  Starts listening.
+     *
+     *  @param      endpoint  Address to listen on; TCP port 0 picks a free
+     *                        port, reported by endpoint().
+     *  @param      registry  Counters to serve; scrape durations are
+     *                        recorded into it.
+     *  @param      options   Connection limits.
+     *  @return     The server, or TransportError on failure.
+     */
+    [[nodiscard]] static auto create(const StreamEndpoint& endpoint, MetricsRegistry& registry,
+                                     MetricsServerOptions options = {})
+        -> std::expected<MetricsServer, core::TransportError>;
+
+    /**
+     *  Closes all connections and removes the Unix socket file.
+     */
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    auto operator=(const MetricsServer&) -> MetricsServer& = delete;
+
+    MetricsServer(MetricsServer&& other) noexcept;
+    auto operator=(MetricsServer&& other) noexcept -> MetricsServer&;
+
+    /**
+     *  Returns the address scrapers should connect to.
+     */
+    [[nodiscard]] auto endpoint() const noexcept -> const StreamEndpoint&;
+
+    /**
+     *  Waits for activity, accepts connections and answers requests.
+     *
+     *  A client sending a malformed or oversized request gets an error
+     *  response and is disconnected; that is not an error of the server.
+     *
+     *  @param      timeout  Longest time to wait for activity.
+     *  @return     Number of scrapes served, or TransportError::kPollFailed.
+     */
+    auto poll(std::chrono::milliseconds timeout)
+        -> std::expected<std::size_t, core::TransportError>;
+
+    /**
+     *  Calls poll() until stop is requested.
+     *
+     *  @param      stop  Stop token, e.g. from a std::jthread.
+     *  @return     Success, or the first poll() error.
+     */
+    auto run(std::stop_token stop) -> std::expected<void, core::TransportError>;
+
+    /**
+     *  Returns the number of scrapes served.
+     */
+    [[nodiscard]] auto scrapes() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of open connections.
+     */
+    [[nodiscard]] auto connections() const noexcept -> std::size_t;
+
+  private:
+    /**
+     *  One accepted connection.
+     */
+    struct Connection
+    {
+        /**
+         *  Received bytes not yet forming a whole request.
+         */
+        std::string incoming;
+
+        /**
+         *  Responses the socket did not take yet.
+         */
+        std::string outgoing;
+
+        /**
+         *  Close once outgoing is sent.
+         */
+        bool close_after{false};
+
+        /**
+         *  Whether EPOLLOUT is armed.
+         */
+        bool writing{false};
+
+        std::chrono::steady_clock::time_point last_active;
+    };
+
+    MetricsServer(int listen_fd, int epoll_fd, StreamEndpoint endpoint, MetricsRegistry& registry,
+                  MetricsServerOptions options) noexcept;
+
+    void acceptConnections();
+    auto receive(int fd, Connection& connection) -> std::size_t;
+    auto respond(Connection& connection, std::string_view request) -> bool;
+    void flush(int fd, Connection& connection);
+    void closeIdle();
+    void closeAll() noexcept;
+
+    int listen_fd_{-1};
+    int epoll_fd_{-1};
+    StreamEndpoint endpoint_;
+    MetricsRegistry* registry_;
+    MetricsServerOptions options_;
+    std::unordered_map<int, Connection> connections_;
+    std::string body_;
+    std::uint64_t scrapes_{0};
+};
+
+}  // namespace threveal::transport
+
+#endif  // THREVEAL_TRANSPORT_METRICS_SERVER_HPP_
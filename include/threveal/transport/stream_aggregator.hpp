@@ -0,0 +1,207 @@
+/**
+ *  @file       stream_aggregator.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Receiving end of the stream protocol.
+ *
+ *  The aggregator listens on a Unix domain socket (or TCP), accepts any
+ *  number of producers and ingests their migrations into a single
+ *  EventStore. Each producer starts with a fixed number of credits and
+ *  earns one back for every chunk stored, so producers can never run
+ *  more than that many chunks ahead of the aggregator.
+ */
+
+#ifndef THREVEAL_TRANSPORT_STREAM_AGGREGATOR_HPP_
+#define THREVEAL_TRANSPORT_STREAM_AGGREGATOR_HPP_
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+namespace threveal::transport
+{
+
+/**
+ *  Default number of chunks a producer may have in flight.
+ */
+inline constexpr std::uint32_t kDefaultStreamCredits = 8;
+
+/**
+ *  Options for a StreamAggregator.
+ */
+struct StreamAggregatorOptions
+{
+    /**
+     *  Credits granted to a producer when it says hello.
+     */
+    std::uint32_t initial_credits{kDefaultStreamCredits};
+
+    /**
+     *  Connections beyond this are closed right after accept().
+     */
+    std::size_t max_producers{64};
+};
+
+/**
+ *  What the aggregator knows about one producer connection.
+ */
+struct ProducerInfo
+{
+    /**
+     *  Host, clock offsets and topology from the producer's hello.
+     */
+    analysis::TraceHeader metadata;
+
+    /**
+     *  Whether the connection is still open.
+     */
+    bool connected{true};
+
+    /**
+     *  Chunks ingested from this connection.
+     */
+    std::uint64_t chunks{0};
+
+    /**
+     *  Migrations ingested from this connection.
+     */
+    std::uint64_t migrations{0};
+};
+
+/**
+ *  Ingests migrations from many producers into one EventStore.
+ *
+ *  Not thread-safe; run it on its own thread with run(), or call poll()
+ *  from an existing event loop.
+ */
+class StreamAggregator
+{
+  public:
+    /**
+     *  Starts listening.
+     *
+     *  @param      endpoint  Address to listen on; TCP port 0 picks a free
+     *                        port, reported by endpoint().
+     *  @param      options   Credit and connection limits.
+     *  @return     The aggregator, or TransportError on failure.
+     */
+    [[nodiscard]] static auto create(const StreamEndpoint& endpoint,
+                                     StreamAggregatorOptions options = {})
+        -> std::expected<StreamAggregator, core::TransportError>;
+
+    /**
+     *  Closes all connections and removes the Unix socket file.
+     */
+    ~StreamAggregator();
+
+    StreamAggregator(const StreamAggregator&) = delete;
+    auto operator=(const StreamAggregator&) -> StreamAggregator& = delete;
+
+    StreamAggregator(StreamAggregator&& other) noexcept;
+    auto operator=(StreamAggregator&& other) noexcept -> StreamAggregator&;
+
+    /**
+     *  Returns the address producers should connect to.
+     */
+    [[nodiscard]] auto endpoint() const noexcept -> const StreamEndpoint&;
+
+    /**
+     *  Waits for activity, accepts producers and ingests their chunks.
+     *
+     *  A producer that violates the protocol is disconnected; that is not
+     *  an error of the aggregator.
+     *
+     *  @param      timeout  Longest time to wait for activity.
+     *  @return     Number of migrations ingested, or
+     *              TransportError::kPollFailed.
+     */
+    auto poll(std::chrono::milliseconds timeout)
+        -> std::expected<std::size_t, core::TransportError>;
+
+    /**
+     *  Calls poll() until stop is requested.
+     *
+     *  @param      stop  Stop token, e.g. from a std::jthread.
+     *  @return     Success, or the first poll() error.
+     */
+    auto run(std::stop_token stop) -> std::expected<void, core::TransportError>;
+
+    /**
+     *  Returns the store all producers' migrations are ingested into.
+     */
+    [[nodiscard]] auto store() noexcept -> analysis::EventStore&;
+    [[nodiscard]] auto store() const noexcept -> const analysis::EventStore&;
+
+    /**
+     *  Returns every producer that said hello, in connection order.
+     */
+    [[nodiscard]] auto producers() const noexcept -> std::span<const ProducerInfo>;
+
+    /**
+     *  Returns the number of connections closed for protocol violations.
+     */
+    [[nodiscard]] auto protocolErrors() const noexcept -> std::uint64_t;
+
+  private:
+    /**
+     *  One accepted connection.
+     */
+    struct Connection
+    {
+        int fd{-1};
+
+        /**
+         *  Index into producers_, or -1 until the hello arrives.
+         */
+        std::ptrdiff_t producer{-1};
+
+        /**
+         *  Received bytes not yet forming a whole frame.
+         */
+        std::vector<std::byte> incoming;
+
+        /**
+         *  Credit frames the socket did not take yet.
+         */
+        std::vector<std::byte> outgoing;
+
+        /**
+         *  Credits earned since the last credit frame.
+         */
+        std::uint32_t owed_credits{0};
+    };
+
+    StreamAggregator(int listen_fd, StreamEndpoint endpoint, StreamAggregatorOptions options);
+
+    void acceptProducers();
+    auto receive(Connection& connection) -> std::expected<std::size_t, core::TransportError>;
+    auto handleFrame(Connection& connection, const FrameHeader& header,
+                     std::span<const std::byte> payload)
+        -> std::expected<std::size_t, core::TransportError>;
+    void sendCredits(Connection& connection);
+    void closeConnection(Connection& connection) noexcept;
+    void closeAll() noexcept;
+
+    int listen_fd_{-1};
+    StreamEndpoint endpoint_;
+    StreamAggregatorOptions options_;
+    std::vector<Connection> connections_;
+    std::vector<ProducerInfo> producers_;
+    std::vector<core::MigrationEvent> decoded_;
+    analysis::EventStore store_;
+    std::uint64_t protocol_errors_{0};
+};
+
+}  // namespace threveal::transport
+
+#endif  // THREVEAL_TRANSPORT_STREAM_AGGREGATOR_HPP_
@@ -0,0 +1,222 @@
+/**
+ *  @file       stream_sink.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Streams migrations to a local aggregator instead of a trace file.
+ *
+ *  Migrations are compressed into chunks as they are pushed and queued
+ *  until the aggregator grants credits for them. Queued chunks are
+ *  written with one scatter-gather sendmsg() per pump, straight from the
+ *  chunk buffers. When the aggregator goes away the sink keeps queueing,
+ *  drops the oldest chunks once its queue is full, and reconnects with
+ *  exponential backoff.
+ */
+
+#ifndef THREVEAL_TRANSPORT_STREAM_SINK_HPP_
+#define THREVEAL_TRANSPORT_STREAM_SINK_HPP_
+
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <span>
+#include <vector>
+
+namespace threveal::transport
+{
+
+/**
+ *  Default number of migrations per chunk.
+ */
+inline constexpr std::size_t kDefaultChunkMigrations = 1024;
+
+/**
+ *  Default number of sealed chunks a sink queues while throttled.
+ */
+inline constexpr std::size_t kDefaultMaxQueuedChunks = 64;
+
+/**
+ *  Options for a StreamSink.
+ */
+struct StreamSinkOptions
+{
+    /**
+     *  Migrations per chunk; a chunk is sealed when it is full.
+     */
+    std::size_t chunk_migrations{kDefaultChunkMigrations};
+
+    /**
+     *  Sealed chunks kept while disconnected or out of credits; the oldest
+     *  unsent chunk is dropped beyond this.
+     */
+    std::size_t max_queued_chunks{kDefaultMaxQueuedChunks};
+
+    /**
+     *  Delay before the first reconnect attempt.
+     */
+    std::chrono::milliseconds reconnect_min{100};
+
+    /**
+     *  Longest delay between reconnect attempts.
+     */
+    std::chrono::milliseconds reconnect_max{5000};
+};
+
+/**
+ *  Producer side of the stream protocol.
+ *
+ *  Not thread-safe; drive it from the thread that collects migrations.
+ *  Chunks still queued when the sink is destroyed are discarded, so call
+ *  flush() first.
+ */
+class StreamSink
+{
+  public:
+    /**
+     *  Creates a sink and tries to connect.
+     *
+     *  The aggregator does not have to be running yet; the sink connects
+     *  on a later pump().
+     *
+     *  @param      endpoint  The aggregator's address.
+     *  @param      metadata  Host, clock offsets and topology sent on
+     *                        every connect.
+     *  @param      options   Chunking, queueing and reconnect settings.
+     *  @return     The sink, or TransportError::kInvalidEndpoint if the
+     *              address or metadata cannot be used.
+     */
+    [[nodiscard]] static auto create(StreamEndpoint endpoint, const analysis::TraceHeader& metadata,
+                                     StreamSinkOptions options = {})
+        -> std::expected<StreamSink, core::TransportError>;
+
+    ~StreamSink();
+
+    StreamSink(const StreamSink&) = delete;
+    auto operator=(const StreamSink&) -> StreamSink& = delete;
+
+    StreamSink(StreamSink&& other) noexcept;
+    auto operator=(StreamSink&& other) noexcept -> StreamSink&;
+
+    /**
+     *  Compresses migrations into chunks and sends what credits allow.
+     *
+     *  Full chunks are encoded straight from the caller's span, such as
+     *  EventStore::allMigrations(); only a trailing partial chunk is kept
+     *  until more migrations arrive or flush() seals it.
+     *
+     *  @param      events  Migrations to stream.
+     *  @return     Number of chunks written, or TransportError::kDisconnected
+     *              while the aggregator is unreachable (the chunks stay
+     *              queued).
+     */
+    auto push(std::span<const core::MigrationEvent> events)
+        -> std::expected<std::size_t, core::TransportError>;
+
+    /**
+     *  Reads credits, reconnects if due, and writes queued chunks.
+     *
+     *  Never blocks.
+     *
+     *  @return     Number of chunks written, or TransportError::kDisconnected
+     *              while the aggregator is unreachable.
+     */
+    auto pump() -> std::expected<std::size_t, core::TransportError>;
+
+    /**
+     *  Seals the open chunk and waits until every chunk is written.
+     *
+     *  @param      timeout  Longest time to wait for credits or a connection.
+     *  @return     Success, or TransportError::kTimedOut with chunks still
+     *              queued.
+     */
+    auto flush(std::chrono::milliseconds timeout) -> std::expected<void, core::TransportError>;
+
+    /**
+     *  Returns whether the sink is connected.
+     */
+    [[nodiscard]] auto isConnected() const noexcept -> bool;
+
+    /**
+     *  Returns the credits left for starting new chunks.
+     */
+    [[nodiscard]] auto credits() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of sealed chunks not written yet.
+     */
+    [[nodiscard]] auto queuedChunks() const noexcept -> std::size_t;
+
+    /**
+     *  Returns the number of chunks written to the aggregator.
+     */
+    [[nodiscard]] auto sentChunks() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of migrations dropped because the queue was full.
+     */
+    [[nodiscard]] auto droppedMigrations() const noexcept -> std::uint64_t;
+
+    /**
+     *  Returns the number of successful connects after the first.
+     */
+    [[nodiscard]] auto reconnects() const noexcept -> std::uint64_t;
+
+  private:
+    /**
+     *  An encoded frame, ready to send.
+     */
+    struct Chunk
+    {
+        std::array<std::byte, kFrameHeaderSize> header{};
+        std::vector<std::byte> payload;
+        std::uint32_t migrations{0};
+    };
+
+    StreamSink(StreamEndpoint endpoint, std::vector<std::byte> hello,
+               StreamSinkOptions options) noexcept;
+
+    void enqueue(std::span<const core::MigrationEvent> events);
+    void sealOpenChunk();
+    void queueChunk(std::span<const core::MigrationEvent> events);
+    void dropExcessChunks();
+    void disconnect() noexcept;
+    auto tryConnect() -> std::expected<void, core::TransportError>;
+    auto readCredits() -> bool;
+    auto writeQueued() -> std::expected<std::size_t, core::TransportError>;
+
+    StreamEndpoint endpoint_;
+    StreamSinkOptions options_;
+    std::vector<std::byte> hello_;
+    int fd_{-1};
+
+    std::vector<core::MigrationEvent> open_chunk_;
+    std::deque<Chunk> queue_;
+
+    /**
+     *  Bytes of the hello frame, then of queue_.front(), already written.
+     */
+    std::size_t hello_sent_{0};
+    std::size_t front_sent_{0};
+
+    std::uint64_t credits_{0};
+    std::vector<std::byte> credit_buffer_;
+
+    std::chrono::steady_clock::time_point next_connect_{};
+    std::chrono::milliseconds backoff_{0};
+    bool ever_connected_{false};
+
+    std::uint64_t sent_chunks_{0};
+    std::uint64_t dropped_migrations_{0};
+    std::uint64_t reconnects_{0};
+};
+
+}  // namespace threveal::transport
+
+#endif  // THREVEAL_TRANSPORT_STREAM_SINK_HPP_
@@ -0,0 +1,936 @@
+/**
+ *  @file       arrow_export.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the Arrow IPC export.
+ *
+ *  The metadata follows Arrow's Schema.fbs, Message.fbs and File.fbs with
+ *  metadata version V5. Only the parts of the flatbuffer format that the
+ *  metadata needs are encoded: scalars, strings, tables and vectors of
+ *  tables or structs. Objects are written parent first, so every offset
+ *  points forward as the format requires.
+ */
+
+#include "threveal/analysis/arrow_export.hpp"
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <numeric>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+namespace
+{
+
+using core::TraceError;
+
+constexpr std::array<char, 8> kFileMagic = {'A', 'R', 'R', 'O', 'W', '1', '\0', '\0'};
+
+/**
+ *  The trailing magic omits the padding.
+ */
+constexpr std::size_t kTrailingMagicSize = 6;
+
+constexpr std::uint32_t kContinuation = 0xffffffff;
+
+/**
+ *  Continuation marker and metadata length in front of each message.
+ */
+constexpr std::size_t kMessagePrefixSize = 8;
+
+constexpr std::size_t kBufferAlignment = 64;
+
+constexpr std::uint16_t kMetadataVersionV5 = 4;
+
+// MessageHeader union members
+constexpr std::uint8_t kHeaderSchema = 1;
+constexpr std::uint8_t kHeaderRecordBatch = 3;
+
+// Type union members
+constexpr std::uint8_t kTypeInt = 2;
+constexpr std::uint8_t kTypeUtf8 = 5;
+
+template <typename T>
+void putLittleEndian(std::byte* out, T value) noexcept
+{
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out[i] = static_cast<std::byte>((value >> (8 * i)) & 0xff);
+    }
+}
+
+template <typename T>
+void append(std::vector<std::byte>& out, T value)
+{
+    auto pos = out.size();
+    out.resize(pos + sizeof(T));
+    putLittleEndian(out.data() + pos, value);
+}
+
+void appendText(std::vector<std::byte>& out, std::string_view text)
+{
+    const auto* bytes = static_cast<const std::byte*>(static_cast<const void*>(text.data()));
+    out.insert(out.end(), bytes, bytes + text.size());
+}
+
+/**
+ *  Pads until (out.size() + phase) is a multiple of alignment.
+ */
+void padTo(std::vector<std::byte>& out, std::size_t alignment, std::size_t phase = 0)
+{
+    while ((out.size() + phase) % alignment != 0)
+    {
+        out.push_back(std::byte{0});
+    }
+}
+
+constexpr auto alignUp(std::size_t value, std::size_t alignment) noexcept -> std::size_t
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/**
+ *  Stores a forward offset from pos to target.
+ */
+void patchOffset(std::vector<std::byte>& out, std::size_t pos, std::size_t target)
+{
+    putLittleEndian(out.data() + pos, static_cast<std::uint32_t>(target - pos));
+}
+
+// --- Flatbuffer encoding ---
+
+class FlatTable;
+
+struct FlatField
+{
+    enum class Kind : std::uint8_t
+    {
+        kScalar,
+        kString,
+        kTable,
+        kTables,
+        kStructs,
+    };
+
+    Kind kind{Kind::kScalar};
+    std::uint16_t slot{0};
+    std::uint8_t size{0};
+    std::uint64_t value{0};
+    std::vector<std::byte> bytes;
+    std::vector<FlatTable> tables;
+
+    [[nodiscard]] auto inlineSize() const noexcept -> std::size_t
+    {
+        return (kind == Kind::kScalar) ? size : sizeof(std::uint32_t);
+    }
+};
+
+/**
+ *  A flatbuffer table under construction.
+ */
+class FlatTable
+{
+  public:
+    auto scalar(std::uint16_t slot, std::uint64_t value, std::uint8_t size) -> FlatTable&
+    {
+        FlatField field;
+        field.slot = slot;
+        field.size = size;
+        field.value = value;
+        fields_.push_back(std::move(field));
+        return *this;
+    }
+
+    auto string(std::uint16_t slot, std::string_view text) -> FlatTable&
+    {
+        FlatField field;
+        field.kind = FlatField::Kind::kString;
+        field.slot = slot;
+        appendText(field.bytes, text);
+        fields_.push_back(std::move(field));
+        return *this;
+    }
+
+    auto table(std::uint16_t slot, FlatTable child) -> FlatTable&
+    {
+        FlatField field;
+        field.kind = FlatField::Kind::kTable;
+        field.slot = slot;
+        field.tables.push_back(std::move(child));
+        fields_.push_back(std::move(field));
+        return *this;
+    }
+
+    auto tables(std::uint16_t slot, std::vector<FlatTable> children) -> FlatTable&
+    {
+        FlatField field;
+        field.kind = FlatField::Kind::kTables;
+        field.slot = slot;
+        field.tables = std::move(children);
+        fields_.push_back(std::move(field));
+        return *this;
+    }
+
+    /**
+     *  Adds a vector of structs whose first member is 8 bytes wide.
+     */
+    auto structs(std::uint16_t slot, std::vector<std::byte> bytes, std::size_t count)
+        -> FlatTable&
+    {
+        FlatField field;
+        field.kind = FlatField::Kind::kStructs;
+        field.slot = slot;
+        field.value = count;
+        field.bytes = std::move(bytes);
+        fields_.push_back(std::move(field));
+        return *this;
+    }
+
+    /**
+     *  Encodes the table as the root of a buffer padded to 8 bytes.
+     */
+    [[nodiscard]] auto encode() const -> std::vector<std::byte>
+    {
+        std::vector<std::byte> out;
+        append<std::uint32_t>(out, 0);
+        auto root = encodeInto(out);
+        patchOffset(out, 0, root);
+        padTo(out, 8);
+        return out;
+    }
+
+  private:
+    /**
+     *  Appends the vtable, the table and then its children.
+     *
+     *  @return     Position of the table.
+     */
+    auto encodeInto(std::vector<std::byte>& out) const -> std::size_t
+    {
+        // Largest fields first keeps every field naturally aligned
+        std::vector<std::size_t> order(fields_.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [this](std::size_t lhs, std::size_t rhs)
+                         {
+                             return fields_[lhs].inlineSize() > fields_[rhs].inlineSize();
+                         });
+
+        std::vector<std::size_t> offsets(fields_.size());
+        std::size_t inline_size = sizeof(std::uint32_t);
+        std::size_t slots = 0;
+        for (auto index : order)
+        {
+            const auto& field = fields_[index];
+            inline_size = alignUp(inline_size, field.inlineSize());
+            offsets[index] = inline_size;
+            inline_size += field.inlineSize();
+            slots = std::max<std::size_t>(slots, field.slot + 1U);
+        }
+
+        std::vector<std::uint16_t> vtable(slots, 0);
+        for (std::size_t i = 0; i < fields_.size(); ++i)
+        {
+            vtable[fields_[i].slot] = static_cast<std::uint16_t>(offsets[i]);
+        }
+
+        padTo(out, 2);
+        auto vtable_pos = out.size();
+        append(out, static_cast<std::uint16_t>((vtable.size() + 2) * sizeof(std::uint16_t)));
+        append(out, static_cast<std::uint16_t>(inline_size));
+        for (auto offset : vtable)
+        {
+            append(out, offset);
+        }
+
+        padTo(out, 8);
+        auto table_pos = out.size();
+        out.resize(table_pos + inline_size);
+        putLittleEndian(out.data() + table_pos, static_cast<std::uint32_t>(table_pos - vtable_pos));
+        for (std::size_t i = 0; i < fields_.size(); ++i)
+        {
+            const auto& field = fields_[i];
+            for (std::size_t b = 0; field.kind == FlatField::Kind::kScalar && b < field.size; ++b)
+            {
+                out[table_pos + offsets[i] + b] =
+                    static_cast<std::byte>((field.value >> (8 * b)) & 0xff);
+            }
+        }
+
+        for (std::size_t i = 0; i < fields_.size(); ++i)
+        {
+            if (fields_[i].kind != FlatField::Kind::kScalar)
+            {
+                patchOffset(out, table_pos + offsets[i], encodeChild(fields_[i], out));
+            }
+        }
+        return table_pos;
+    }
+
+    static auto encodeChild(const FlatField& field, std::vector<std::byte>& out) -> std::size_t
+    {
+        switch (field.kind)
+        {
+            case FlatField::Kind::kString:
+            {
+                padTo(out, 4);
+                auto pos = out.size();
+                append(out, static_cast<std::uint32_t>(field.bytes.size()));
+                out.insert(out.end(), field.bytes.begin(), field.bytes.end());
+                out.push_back(std::byte{0});
+                return pos;
+            }
+
+            case FlatField::Kind::kTable:
+                return field.tables.front().encodeInto(out);
+
+            case FlatField::Kind::kTables:
+            {
+                padTo(out, 4);
+                auto pos = out.size();
+                append(out, static_cast<std::uint32_t>(field.tables.size()));
+                auto slots_pos = out.size();
+                out.resize(slots_pos + (field.tables.size() * sizeof(std::uint32_t)));
+                for (std::size_t i = 0; i < field.tables.size(); ++i)
+                {
+                    auto child = field.tables[i].encodeInto(out);
+                    patchOffset(out, slots_pos + (i * sizeof(std::uint32_t)), child);
+                }
+                return pos;
+            }
+
+            case FlatField::Kind::kStructs:
+            {
+                // The elements, not the length, must be 8-byte aligned
+                padTo(out, 8, sizeof(std::uint32_t));
+                auto pos = out.size();
+                append(out, static_cast<std::uint32_t>(field.value));
+                out.insert(out.end(), field.bytes.begin(), field.bytes.end());
+                return pos;
+            }
+
+            case FlatField::Kind::kScalar:
+                break;
+        }
+        return 0;
+    }
+
+    std::vector<FlatField> fields_;
+};
+
+// --- Arrow metadata ---
+
+enum class ColumnType : std::uint8_t
+{
+    kUInt8,
+    kUInt32,
+    kUInt64,
+    kUtf8,
+};
+
+struct Column
+{
+    std::string_view name;
+    ColumnType type;
+};
+
+constexpr std::array kMigrationColumns = {
+    Column{"timestamp_ns", ColumnType::kUInt64},
+    Column{"pid", ColumnType::kUInt32},
+    Column{"tid", ColumnType::kUInt32},
+    Column{"src_cpu", ColumnType::kUInt32},
+    Column{"dst_cpu", ColumnType::kUInt32},
+    Column{"comm", ColumnType::kUtf8},
+    Column{"topology_generation", ColumnType::kUInt32},
+    Column{"src_type", ColumnType::kUInt8},
+    Column{"dst_type", ColumnType::kUInt8},
+    Column{"sample_weight", ColumnType::kUInt32},
+    Column{"fidelity", ColumnType::kUInt8},
+};
+
+constexpr std::array kPmuColumns = {
+    Column{"timestamp_ns", ColumnType::kUInt64},
+    Column{"tid", ColumnType::kUInt32},
+    Column{"cpu_id", ColumnType::kUInt32},
+    Column{"instructions", ColumnType::kUInt64},
+    Column{"cycles", ColumnType::kUInt64},
+    Column{"llc_misses", ColumnType::kUInt64},
+    Column{"llc_references", ColumnType::kUInt64},
+    Column{"branch_misses", ColumnType::kUInt64},
+};
+
+auto columnsOf(ArrowTable table) noexcept -> std::span<const Column>
+{
+    if (table == ArrowTable::kPmuSamples)
+    {
+        return kPmuColumns;
+    }
+    return kMigrationColumns;
+}
+
+auto bitWidth(ColumnType type) noexcept -> std::uint32_t
+{
+    switch (type)
+    {
+        case ColumnType::kUInt8:
+            return 8;
+        case ColumnType::kUInt32:
+            return 32;
+        case ColumnType::kUInt64:
+            return 64;
+        case ColumnType::kUtf8:
+            break;
+    }
+    return 0;
+}
+
+auto fieldTable(const Column& column) -> FlatTable
+{
+    FlatTable field;
+    field.string(0, column.name).scalar(1, 0, 1);
+    if (column.type == ColumnType::kUtf8)
+    {
+        field.scalar(2, kTypeUtf8, 1).table(3, FlatTable{});
+    }
+    else
+    {
+        FlatTable type;
+        type.scalar(0, bitWidth(column.type), 4).scalar(1, 0, 1);
+        field.scalar(2, kTypeInt, 1).table(3, std::move(type));
+    }
+    field.tables(5, {});
+    return field;
+}
+
+auto keyValue(std::string_view key, std::string_view value) -> FlatTable
+{
+    FlatTable pair;
+    pair.string(0, key).string(1, value);
+    return pair;
+}
+
+auto coreTypeLegend() -> std::string
+{
+    std::string legend;
+    for (auto type : {core::CoreType::kUnknown, core::CoreType::kPCore, core::CoreType::kECore})
+    {
+        if (!legend.empty())
+        {
+            legend += ',';
+        }
+        legend += std::to_string(static_cast<unsigned>(type));
+        legend += '=';
+        legend += core::toString(type);
+    }
+    return legend;
+}
+
+auto schemaTable(ArrowTable table, std::string_view header_text) -> FlatTable
+{
+    std::vector<FlatTable> fields;
+    for (const auto& column : columnsOf(table))
+    {
+        fields.push_back(fieldTable(column));
+    }
+
+    std::vector<FlatTable> metadata;
+    metadata.push_back(keyValue("threveal.trace_header", header_text));
+    if (table == ArrowTable::kMigrations)
+    {
+        metadata.push_back(keyValue("threveal.core_types", coreTypeLegend()));
+    }
+
+    FlatTable schema;
+    schema.scalar(0, 0, 2).tables(1, std::move(fields)).tables(2, std::move(metadata));
+    return schema;
+}
+
+auto messageTable(std::uint8_t header_type, FlatTable header, std::uint64_t body_length)
+    -> FlatTable
+{
+    FlatTable message;
+    message.scalar(0, kMetadataVersionV5, 2)
+        .scalar(1, header_type, 1)
+        .table(2, std::move(header))
+        .scalar(3, body_length, 8);
+    return message;
+}
+
+/**
+ *  Transposes rows into a record batch body and its metadata.
+ */
+class BatchBuilder
+{
+  public:
+    explicit BatchBuilder(std::vector<std::byte>& body) : body_(body)
+    {
+        body_.clear();
+    }
+
+    template <typename Row, typename T>
+    void addColumn(std::span<const Row> rows, T Row::*member)
+    {
+        using Value = decltype(toUnsigned(T{}));
+        addNode(rows.size());
+        addBuffer(0);
+        auto values = addBuffer(rows.size() * sizeof(Value));
+        for (std::size_t i = 0; i < rows.size(); ++i)
+        {
+            putLittleEndian(body_.data() + values + (i * sizeof(Value)),
+                            toUnsigned(rows[i].*member));
+        }
+    }
+
+    template <typename Row>
+    void addStrings(std::span<const Row> rows, std::string_view (Row::*text)() const noexcept)
+    {
+        std::size_t total = 0;
+        for (const auto& row : rows)
+        {
+            total += (row.*text)().size();
+        }
+
+        addNode(rows.size());
+        addBuffer(0);
+        auto offsets = addBuffer((rows.size() + 1) * sizeof(std::int32_t));
+        auto data = addBuffer(total);
+
+        std::size_t end = 0;
+        putLittleEndian(body_.data() + offsets, std::uint32_t{0});
+        for (std::size_t i = 0; i < rows.size(); ++i)
+        {
+            auto value = (rows[i].*text)();
+            std::memcpy(body_.data() + data + end, value.data(), value.size());
+            end += value.size();
+            putLittleEndian(body_.data() + offsets + ((i + 1) * sizeof(std::int32_t)),
+                            static_cast<std::uint32_t>(end));
+        }
+    }
+
+    /**
+     *  Pads the body and returns the encoded RecordBatch message.
+     */
+    [[nodiscard]] auto finish(std::size_t rows) -> std::vector<std::byte>
+    {
+        padTo(body_, kBufferAlignment);
+        FlatTable batch;
+        batch.scalar(0, rows, 8)
+            .structs(1, std::move(nodes_), node_count_)
+            .structs(2, std::move(buffers_), buffer_count_);
+        return messageTable(kHeaderRecordBatch, std::move(batch), body_.size()).encode();
+    }
+
+  private:
+    template <typename T>
+    static constexpr auto toUnsigned(T value) noexcept
+    {
+        if constexpr (std::is_enum_v<T>)
+        {
+            return std::to_underlying(value);
+        }
+        else
+        {
+            return value;
+        }
+    }
+
+    void addNode(std::size_t length)
+    {
+        // FieldNode: length, null count
+        append<std::uint64_t>(nodes_, length);
+        append<std::uint64_t>(nodes_, 0);
+        ++node_count_;
+    }
+
+    /**
+     *  Reserves an aligned buffer in the body and returns its offset.
+     */
+    auto addBuffer(std::size_t length) -> std::size_t
+    {
+        padTo(body_, kBufferAlignment);
+        auto offset = body_.size();
+        body_.resize(offset + length);
+
+        // Buffer: offset, length
+        append<std::uint64_t>(buffers_, offset);
+        append<std::uint64_t>(buffers_, length);
+        ++buffer_count_;
+        return offset;
+    }
+
+    std::vector<std::byte>& body_;
+    std::vector<std::byte> nodes_;
+    std::vector<std::byte> buffers_;
+    std::size_t node_count_{0};
+    std::size_t buffer_count_{0};
+};
+
+// Column order must match kMigrationColumns and kPmuColumns
+auto encodeBatch(std::span<const core::MigrationEvent> rows, std::vector<std::byte>& body)
+    -> std::vector<std::byte>
+{
+    using core::MigrationEvent;
+    BatchBuilder batch{body};
+    batch.addColumn(rows, &MigrationEvent::timestamp_ns);
+    batch.addColumn(rows, &MigrationEvent::pid);
+    batch.addColumn(rows, &MigrationEvent::tid);
+    batch.addColumn(rows, &MigrationEvent::src_cpu);
+    batch.addColumn(rows, &MigrationEvent::dst_cpu);
+    batch.addStrings(rows, &MigrationEvent::commAsStringView);
+    batch.addColumn(rows, &MigrationEvent::topology_generation);
+    batch.addColumn(rows, &MigrationEvent::src_type);
+    batch.addColumn(rows, &MigrationEvent::dst_type);
+    batch.addColumn(rows, &MigrationEvent::sample_weight);
+    batch.addColumn(rows, &MigrationEvent::fidelity);
+    return batch.finish(rows.size());
+}
+
+auto encodeBatch(std::span<const core::PmuSample> rows, std::vector<std::byte>& body)
+    -> std::vector<std::byte>
+{
+    using core::PmuSample;
+    BatchBuilder batch{body};
+    batch.addColumn(rows, &PmuSample::timestamp_ns);
+    batch.addColumn(rows, &PmuSample::tid);
+    batch.addColumn(rows, &PmuSample::cpu_id);
+    batch.addColumn(rows, &PmuSample::instructions);
+    batch.addColumn(rows, &PmuSample::cycles);
+    batch.addColumn(rows, &PmuSample::llc_misses);
+    batch.addColumn(rows, &PmuSample::llc_references);
+    batch.addColumn(rows, &PmuSample::branch_misses);
+    return batch.finish(rows.size());
+}
+
+}  // namespace
+
+ArrowWriter::ArrowWriter(int fd, ArrowTable table, ArrowFormat format,
+                         std::string header_text) noexcept
+    : fd_(fd), table_(table), format_(format), header_text_(std::move(header_text))
+{
+}
+
+ArrowWriter::~ArrowWriter()
+{
+    if (fd_ >= 0)
+    {
+        (void)finish();
+    }
+}
+
+ArrowWriter::ArrowWriter(ArrowWriter&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)),
+      table_(other.table_),
+      format_(other.format_),
+      header_text_(std::move(other.header_text_)),
+      offset_(other.offset_),
+      rows_(other.rows_),
+      blocks_(std::move(other.blocks_)),
+      body_(std::move(other.body_))
+{
+}
+
+auto ArrowWriter::operator=(ArrowWriter&& other) noexcept -> ArrowWriter&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    if (fd_ >= 0)
+    {
+        (void)finish();
+    }
+    fd_ = std::exchange(other.fd_, -1);
+    table_ = other.table_;
+    format_ = other.format_;
+    header_text_ = std::move(other.header_text_);
+    offset_ = other.offset_;
+    rows_ = other.rows_;
+    blocks_ = std::move(other.blocks_);
+    body_ = std::move(other.body_);
+    return *this;
+}
+
+auto ArrowWriter::open(const std::string& path, ArrowTable table, const TraceHeader& header,
+                       ArrowFormat format) -> std::expected<ArrowWriter, TraceError>
+{
+    // Validate the header before touching the file system
+    if (!formatTraceHeader(header))
+    {
+        return std::unexpected(TraceError::kInvalidHeader);
+    }
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return std::unexpected(TraceError::kOpenFailed);
+    }
+    return fromDescriptor(fd, table, header, format);
+}
+
+auto ArrowWriter::fromDescriptor(int fd, ArrowTable table, const TraceHeader& header,
+                                 ArrowFormat format) -> std::expected<ArrowWriter, TraceError>
+{
+    auto text = formatTraceHeader(header);
+    if (!text)
+    {
+        close(fd);
+        return std::unexpected(text.error());
+    }
+
+    ArrowWriter writer{fd, table, format, std::move(*text)};
+    auto started = writer.start();
+    if (!started)
+    {
+        writer.closeOutput();
+        return std::unexpected(started.error());
+    }
+    return writer;
+}
+
+auto ArrowWriter::write(std::span<const core::MigrationEvent> migrations)
+    -> std::expected<void, TraceError>
+{
+    if (table_ != ArrowTable::kMigrations)
+    {
+        return std::unexpected(TraceError::kSchemaMismatch);
+    }
+
+    for (std::size_t first = 0; first < migrations.size(); first += kArrowBatchRows)
+    {
+        auto rows = migrations.subspan(first, std::min(kArrowBatchRows, migrations.size() - first));
+        auto written = writeBatch(encodeBatch(rows, body_), rows.size());
+        if (!written)
+        {
+            return written;
+        }
+    }
+    return {};
+}
+
+auto ArrowWriter::write(std::span<const core::PmuSample> samples)
+    -> std::expected<void, TraceError>
+{
+    if (table_ != ArrowTable::kPmuSamples)
+    {
+        return std::unexpected(TraceError::kSchemaMismatch);
+    }
+
+    for (std::size_t first = 0; first < samples.size(); first += kArrowBatchRows)
+    {
+        auto rows = samples.subspan(first, std::min(kArrowBatchRows, samples.size() - first));
+        auto written = writeBatch(encodeBatch(rows, body_), rows.size());
+        if (!written)
+        {
+            return written;
+        }
+    }
+    return {};
+}
+
+auto ArrowWriter::finish() -> std::expected<void, TraceError>
+{
+    if (fd_ < 0)
+    {
+        return {};
+    }
+
+    std::vector<std::byte> tail;
+    append(tail, kContinuation);
+    append<std::uint32_t>(tail, 0);
+
+    if (format_ == ArrowFormat::kFile)
+    {
+        // Block: offset, metadata length, padding, body length
+        std::vector<std::byte> blocks;
+        for (const auto& block : blocks_)
+        {
+            append(blocks, block.offset);
+            append(blocks, block.metadata_length);
+            append<std::uint32_t>(blocks, 0);
+            append(blocks, block.body_length);
+        }
+
+        FlatTable footer;
+        footer.scalar(0, kMetadataVersionV5, 2)
+            .table(1, schemaTable(table_, header_text_))
+            .structs(2, {}, 0)
+            .structs(3, std::move(blocks), blocks_.size());
+        auto encoded = footer.encode();
+
+        tail.insert(tail.end(), encoded.begin(), encoded.end());
+        append(tail, static_cast<std::uint32_t>(encoded.size()));
+        appendText(tail, std::string_view{kFileMagic.data(), kTrailingMagicSize});
+    }
+
+    auto written = writeBytes(tail);
+    bool closed = close(std::exchange(fd_, -1)) == 0;
+    if (!written)
+    {
+        return written;
+    }
+    if (!closed)
+    {
+        return std::unexpected(TraceError::kWriteFailed);
+    }
+    return {};
+}
+
+auto ArrowWriter::rows() const noexcept -> std::uint64_t
+{
+    return rows_;
+}
+
+auto ArrowWriter::batches() const noexcept -> std::size_t
+{
+    return blocks_.size();
+}
+
+auto ArrowWriter::start() -> std::expected<void, TraceError>
+{
+    if (format_ == ArrowFormat::kFile)
+    {
+        std::vector<std::byte> magic;
+        appendText(magic, std::string_view{kFileMagic.data(), kFileMagic.size()});
+        auto written = writeBytes(magic);
+        if (!written)
+        {
+            return written;
+        }
+    }
+
+    auto schema = messageTable(kHeaderSchema, schemaTable(table_, header_text_), 0).encode();
+    auto written = writeMessage(schema, {});
+    if (!written)
+    {
+        return std::unexpected(written.error());
+    }
+    return {};
+}
+
+auto ArrowWriter::writeMessage(std::span<const std::byte> metadata,
+                               std::span<const std::byte> body)
+    -> std::expected<Block, TraceError>
+{
+    // Pad the metadata so the body, and with it every buffer, starts on a
+    // 64-byte boundary of the output
+    auto start = offset_;
+    auto padded = alignUp(start + kMessagePrefixSize + metadata.size(), kBufferAlignment) - start -
+                  kMessagePrefixSize;
+
+    std::vector<std::byte> message;
+    message.reserve(kMessagePrefixSize + padded);
+    append(message, kContinuation);
+    append(message, static_cast<std::uint32_t>(padded));
+    message.insert(message.end(), metadata.begin(), metadata.end());
+    message.resize(kMessagePrefixSize + padded);
+
+    auto written = writeBytes(message);
+    if (written)
+    {
+        written = writeBytes(body);
+    }
+    if (!written)
+    {
+        return std::unexpected(written.error());
+    }
+
+    return Block{.offset = start,
+                 .metadata_length = static_cast<std::uint32_t>(kMessagePrefixSize + padded),
+                 .body_length = body.size()};
+}
+
+auto ArrowWriter::writeBatch(std::span<const std::byte> metadata, std::size_t rows)
+    -> std::expected<void, TraceError>
+{
+    auto block = writeMessage(metadata, body_);
+    if (!block)
+    {
+        return std::unexpected(block.error());
+    }
+    blocks_.push_back(*block);
+    rows_ += rows;
+    return {};
+}
+
+auto ArrowWriter::writeBytes(std::span<const std::byte> bytes) -> std::expected<void, TraceError>
+{
+    while (!bytes.empty())
+    {
+        ssize_t written = ::write(fd_, bytes.data(), bytes.size());
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return std::unexpected(TraceError::kWriteFailed);
+        }
+        offset_ += static_cast<std::uint64_t>(written);
+        bytes = bytes.subspan(static_cast<std::size_t>(written));
+    }
+    return {};
+}
+
+void ArrowWriter::closeOutput() noexcept
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+auto exportArrow(const EventStore& store, const TraceHeader& header,
+                 const std::string& migrations_path, const std::string& pmu_path)
+    -> std::expected<void, TraceError>
+{
+    auto migrations = ArrowWriter::open(migrations_path, ArrowTable::kMigrations, header);
+    if (!migrations)
+    {
+        return std::unexpected(migrations.error());
+    }
+    auto written = migrations->write(store.allMigrations());
+    if (written)
+    {
+        written = migrations->finish();
+    }
+    if (!written)
+    {
+        return written;
+    }
+
+    auto samples = ArrowWriter::open(pmu_path, ArrowTable::kPmuSamples, header);
+    if (!samples)
+    {
+        return std::unexpected(samples.error());
+    }
+    written = samples->write(store.allPmuSamples());
+    if (written)
+    {
+        written = samples->finish();
+    }
+    return written;
+}
+
+}  // namespace threveal::analysis
@@ -0,0 +1,161 @@
+/**
+ *  @file       energy_attribution.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of RAPL energy attribution.
+ */
+
+#include "threveal/analysis/energy_attribution.hpp"
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+namespace
+{
+
+constexpr double kJoulesPerMicrojoule = 1e-6;
+
+/**
+ *  A PMU sample resolved to its core type and attribution weight.
+ */
+struct WeightedSample
+{
+    const core::PmuSample* sample;
+    core::CoreType type;
+    double weight;
+};
+
+}  // namespace
+
+auto attributeEnergy(const EventStore& store, const core::TopologyMap& topology,
+                     const EnergyAttributionOptions& options) -> std::vector<ThreadEnergy>
+{
+    auto energy_samples = store.allEnergySamples();
+    auto pmu_samples = store.allPmuSamples();
+
+    std::map<std::uint32_t, ThreadEnergy> profiles;
+    std::vector<WeightedSample> interval_samples;
+
+    // Both sequences are sorted by timestamp, so one forward sweep suffices.
+    // The first energy sample only opens the first interval.
+    std::size_t pmu_index = 0;
+    for (std::size_t i = 0; i < energy_samples.size(); ++i)
+    {
+        const auto& energy = energy_samples[i];
+
+        interval_samples.clear();
+        double total_weight = 0.0;
+
+        while (pmu_index < pmu_samples.size() &&
+               pmu_samples[pmu_index].timestamp_ns <= energy.timestamp_ns)
+        {
+            const auto& sample = pmu_samples[pmu_index++];
+            if (i == 0)
+            {
+                continue;
+            }
+
+            auto type = topology.getCoreType(sample.cpu_id);
+            if (!type)
+            {
+                continue;
+            }
+
+            double cycle_weight = (*type == core::CoreType::kPCore) ? options.p_core_cycle_weight
+                                                                    : options.e_core_cycle_weight;
+            double weight = static_cast<double>(sample.cycles) * cycle_weight;
+
+            interval_samples.push_back({.sample = &sample, .type = *type, .weight = weight});
+            total_weight += weight;
+        }
+
+        // Prefer the cores domain: package energy includes uncore and graphics
+        auto energy_uj =
+            (energy.cores_energy_uj != 0) ? energy.cores_energy_uj : energy.package_energy_uj;
+        double energy_joules = static_cast<double>(energy_uj) * kJoulesPerMicrojoule;
+
+        for (const auto& entry : interval_samples)
+        {
+            auto& profile = profiles[entry.sample->tid];
+            profile.tid = entry.sample->tid;
+
+            auto& bucket = (entry.type == core::CoreType::kPCore) ? profile.p_core : profile.e_core;
+            bucket.instructions += entry.sample->instructions;
+            bucket.cycles += entry.sample->cycles;
+
+            if (total_weight > 0.0)
+            {
+                bucket.energy_joules += energy_joules * (entry.weight / total_weight);
+            }
+        }
+    }
+
+    std::vector<ThreadEnergy> result;
+    result.reserve(profiles.size());
+    for (const auto& [tid, profile] : profiles)
+    {
+        result.push_back(profile);
+    }
+
+    return result;
+}
+
+auto estimatePlacementEnergyDelta(std::span<const ThreadEnergy> profiles,
+                                  std::span<const ThreadPlacement> plan) -> double
+{
+    // Aggregate efficiency per core type, for threads with no history there
+    CoreTypeEnergy aggregate_p{};
+    CoreTypeEnergy aggregate_e{};
+    for (const auto& profile : profiles)
+    {
+        aggregate_p.instructions += profile.p_core.instructions;
+        aggregate_p.energy_joules += profile.p_core.energy_joules;
+        aggregate_e.instructions += profile.e_core.instructions;
+        aggregate_e.energy_joules += profile.e_core.energy_joules;
+    }
+
+    double delta_joules = 0.0;
+
+    for (const auto& placement : plan)
+    {
+        auto profile = std::ranges::find(profiles, placement.tid, &ThreadEnergy::tid);
+        if (profile == profiles.end())
+        {
+            continue;
+        }
+
+        double ipj = profile->forCoreType(placement.target).instructionsPerJoule();
+        if (ipj <= 0.0)
+        {
+            const auto& aggregate =
+                (placement.target == core::CoreType::kPCore) ? aggregate_p : aggregate_e;
+            ipj = aggregate.instructionsPerJoule();
+        }
+
+        if (ipj <= 0.0)
+        {
+            // No measurement on the target core type at all
+            continue;
+        }
+
+        auto instructions = profile->p_core.instructions + profile->e_core.instructions;
+        double predicted = static_cast<double>(instructions) / ipj;
+        delta_joules += predicted - profile->totalEnergyJoules();
+    }
+
+    return delta_joules;
+}
+
+}  // namespace threveal::analysis
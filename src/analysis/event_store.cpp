@@ -7,19 +7,39 @@
 
 #include "threveal/analysis/event_store.hpp"
 
+#include "threveal/analysis/pmu_downsampler.hpp"
+#include "threveal/analysis/thread_registry.hpp"
+#include "threveal/core/clock.hpp"
 #include "threveal/core/events.hpp"
 
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <optional>
 #include <ranges>
 #include <span>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace threveal::analysis
 {
 
+namespace
+{
+
+/**
+ *  Fewest downsampling changes applied at once; larger stores wait for
+ *  an eighth of their size, so each sample is moved a bounded number of
+ *  times on average.
+ */
+constexpr std::size_t kMinDownsamplingBatch = 4096;
+
+}  // namespace
+
+EventStore::EventStore(PmuDownsampling downsampling) : downsampler_(std::move(downsampling)) {}
+
 void EventStore::addMigration(core::MigrationEvent event)
 {
     // Maintain sorted order by timestamp for efficient time-range queries.
@@ -31,10 +51,26 @@ void EventStore::addMigration(core::MigrationEvent event)
                                                     });
 
     migrations_.insert(insertion_point, event);
+
+    if (downsampler_)
+    {
+        downsampler_->addMigration(event.tid, event.timestamp_ns);
+    }
 }
 
 void EventStore::addPmuSample(core::PmuSample sample)
 {
+    if (downsampler_)
+    {
+        downsampler_->addSample(sample);
+        if (downsampler_->pendingChanges() >=
+            std::max(kMinDownsamplingBatch, pmu_samples_.size() / 8))
+        {
+            downsampler_->apply(pmu_samples_);
+        }
+        return;
+    }
+
     // Maintain sorted order by timestamp for efficient correlation queries.
     // This enables binary search when finding samples before/after migration events.
     auto insertion_point = std::ranges::lower_bound(pmu_samples_, sample.timestamp_ns, {},
@@ -46,6 +82,60 @@ void EventStore::addPmuSample(core::PmuSample sample)
     pmu_samples_.insert(insertion_point, sample);
 }
 
+void EventStore::flushPmuSamples()
+{
+    if (downsampler_)
+    {
+        downsampler_->settle();
+        downsampler_->apply(pmu_samples_);
+    }
+}
+
+void EventStore::addEnergySample(core::EnergySample sample)
+{
+    // Energy intervals are attributed by sweeping PMU samples in time order,
+    // so keep these sorted the same way.
+    auto insertion_point = std::ranges::lower_bound(energy_samples_, sample.timestamp_ns, {},
+                                                    [](const core::EnergySample& existing)
+                                                    {
+                                                        return existing.timestamp_ns;
+                                                    });
+
+    energy_samples_.insert(insertion_point, sample);
+}
+
+void EventStore::addHfiUpdate(core::HfiCapabilityUpdate update)
+{
+    // Sorted so capability-at-time lookups can binary search
+    auto insertion_point = std::ranges::upper_bound(hfi_updates_, update.timestamp_ns, {},
+                                                    [](const core::HfiCapabilityUpdate& existing)
+                                                    {
+                                                        return existing.timestamp_ns;
+                                                    });
+
+    hfi_updates_.insert(insertion_point, update);
+
+    // Per-CPU copy so capability lookups do not scan other CPUs' updates
+    auto& per_cpu = hfi_by_cpu_[update.cpu_id];
+    per_cpu.insert(std::ranges::upper_bound(per_cpu, update.timestamp_ns, {},
+                                            [](const core::HfiCapabilityUpdate& existing)
+                                            {
+                                                return existing.timestamp_ns;
+                                            }),
+                   update);
+}
+
+void EventStore::addThreadLifecycle(const core::ThreadLifecycleEvent& event)
+{
+    threads_.record(event);
+
+    // An exited thread's samples can all be decided
+    if (downsampler_ && event.kind == core::ThreadLifecycleKind::kExit)
+    {
+        downsampler_->endThread(event.tid);
+    }
+}
+
 auto EventStore::allMigrations() const noexcept -> std::span<const core::MigrationEvent>
 {
     return migrations_;
@@ -56,6 +146,16 @@ auto EventStore::allPmuSamples() const noexcept -> std::span<const core::PmuSamp
     return pmu_samples_;
 }
 
+auto EventStore::allEnergySamples() const noexcept -> std::span<const core::EnergySample>
+{
+    return energy_samples_;
+}
+
+auto EventStore::allHfiUpdates() const noexcept -> std::span<const core::HfiCapabilityUpdate>
+{
+    return hfi_updates_;
+}
+
 auto EventStore::migrationsForThread(std::uint32_t tid) const -> std::vector<core::MigrationEvent>
 {
     std::vector<core::MigrationEvent> result;
@@ -73,6 +173,31 @@ auto EventStore::migrationsForThread(std::uint32_t tid) const -> std::vector<cor
     return result;
 }
 
+auto EventStore::threads() const noexcept -> const ThreadRegistry&
+{
+    return threads_;
+}
+
+auto EventStore::threadAt(std::uint32_t tid, std::uint64_t timestamp_ns) const -> core::ThreadKey
+{
+    return threads_.resolve(tid, timestamp_ns);
+}
+
+auto EventStore::migrationsForThread(const core::ThreadKey& thread) const
+    -> std::vector<core::MigrationEvent>
+{
+    std::vector<core::MigrationEvent> result;
+    for (const auto& migration : migrations_)
+    {
+        if (migration.tid == thread.tid &&
+            threads_.resolve(migration.tid, migration.timestamp_ns) == thread)
+        {
+            result.push_back(migration);
+        }
+    }
+    return result;
+}
+
 auto EventStore::migrationsInRange(std::uint64_t start_ns, std::uint64_t end_ns) const
     -> std::vector<core::MigrationEvent>
 {
@@ -115,6 +240,20 @@ auto EventStore::pmuSamplesForThread(std::uint32_t tid) const -> std::vector<cor
     return result;
 }
 
+auto EventStore::pmuSamplesForThread(const core::ThreadKey& thread) const
+    -> std::vector<core::PmuSample>
+{
+    std::vector<core::PmuSample> result;
+    for (const auto& sample : pmu_samples_)
+    {
+        if (sample.tid == thread.tid && threads_.resolve(sample.tid, sample.timestamp_ns) == thread)
+        {
+            result.push_back(sample);
+        }
+    }
+    return result;
+}
+
 auto EventStore::pmuBeforeMigration(const core::MigrationEvent& migration) const
     -> std::optional<core::PmuSample>
 {
@@ -131,8 +270,14 @@ auto EventStore::pmuBeforeMigration(const core::MigrationEvent& migration) const
                                           });
 
     // Search backwards from upper to find a sample with matching tid.
+    // Samples from before the thread started belong to an earlier thread.
+    auto start_ns = threads_.resolve(migration.tid, migration.timestamp_ns).start_time_ns;
     for (auto it = std::make_reverse_iterator(upper); it != pmu_samples_.rend(); ++it)
     {
+        if (it->timestamp_ns < start_ns)
+        {
+            break;
+        }
         if (it->tid == migration.tid)
         {
             return *it;
@@ -158,8 +303,15 @@ auto EventStore::pmuAfterMigration(const core::MigrationEvent& migration) const
                                           });
 
     // Search forward from lower to find a sample with matching tid.
+    // Samples from after the thread exited belong to a later thread.
+    auto thread = threads_.lifetime(threads_.resolve(migration.tid, migration.timestamp_ns));
+    auto end_ns = thread ? thread->end_ns : kThreadAlive;
     for (auto it = lower; it != pmu_samples_.end(); ++it)
     {
+        if (it->timestamp_ns > end_ns)
+        {
+            break;
+        }
         if (it->tid == migration.tid)
         {
             return *it;
@@ -169,20 +321,87 @@ auto EventStore::pmuAfterMigration(const core::MigrationEvent& migration) const
     return std::nullopt;
 }
 
+auto EventStore::hfiCapabilityAt(core::CpuId cpu_id, std::uint64_t timestamp_ns) const
+    -> std::optional<core::HfiCapabilityUpdate>
+{
+    auto per_cpu = hfi_by_cpu_.find(cpu_id);
+    if (per_cpu == hfi_by_cpu_.end())
+    {
+        return std::nullopt;
+    }
+
+    // The update in effect is the one just before the first later update
+    auto upper = std::ranges::upper_bound(per_cpu->second, timestamp_ns, {},
+                                          [](const core::HfiCapabilityUpdate& update)
+                                          {
+                                              return update.timestamp_ns;
+                                          });
+    if (upper == per_cpu->second.begin())
+    {
+        return std::nullopt;
+    }
+
+    return *std::prev(upper);
+}
+
 auto EventStore::migrationCount() const noexcept -> std::size_t
 {
     return migrations_.size();
 }
 
+auto EventStore::estimatedMigrationCount() const noexcept -> std::uint64_t
+{
+    std::uint64_t total = 0;
+    for (const auto& migration : migrations_)
+    {
+        total += migration.sample_weight;
+    }
+    return total;
+}
+
 auto EventStore::pmuSampleCount() const noexcept -> std::size_t
 {
     return pmu_samples_.size();
 }
 
+auto EventStore::downsampledPmuSampleCount() const noexcept -> std::uint64_t
+{
+    return downsampler_ ? downsampler_->downsampledCount() : 0;
+}
+
+auto EventStore::energySampleCount() const noexcept -> std::size_t
+{
+    return energy_samples_.size();
+}
+
+auto EventStore::hfiUpdateCount() const noexcept -> std::size_t
+{
+    return hfi_updates_.size();
+}
+
+void EventStore::setClockSnapshot(const core::ClockSnapshot& snapshot) noexcept
+{
+    clock_snapshot_ = snapshot;
+}
+
+auto EventStore::clockSnapshot() const noexcept -> const std::optional<core::ClockSnapshot>&
+{
+    return clock_snapshot_;
+}
+
 void EventStore::clear() noexcept
 {
     migrations_.clear();
     pmu_samples_.clear();
+    energy_samples_.clear();
+    hfi_updates_.clear();
+    hfi_by_cpu_.clear();
+    threads_.clear();
+    if (downsampler_)
+    {
+        downsampler_->clear();
+    }
+    clock_snapshot_.reset();
 }
 
 }  // namespace threveal::analysis
@@ -0,0 +1,420 @@
+/**
+ *  @file       fleet_aggregate.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of fleet-wide migration aggregation.
+ */
+
+#include "threveal/analysis/fleet_aggregate.hpp"
+#include "splitmix.hpp"
+
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+namespace
+{
+
+/**
+ *  Number of trace records decoded per read.
+ */
+constexpr std::size_t kReadBatch = 4096;
+
+/**
+ *  Bits of the hash used to pick a DistinctCounter register.
+ */
+constexpr int kRegisterBits = std::countr_zero(DistinctCounter::kRegisters);
+
+/**
+ *  Hashes a host name (64-bit FNV-1a).
+ */
+auto hashHost(std::string_view host) noexcept -> std::uint64_t
+{
+    constexpr std::uint64_t kOffsetBasis = 0xcbf29ce484222325ULL;
+    constexpr std::uint64_t kPrime = 0x100000001b3ULL;
+
+    std::uint64_t hash = kOffsetBasis;
+    for (char c : host)
+    {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= kPrime;
+    }
+    return hash;
+}
+
+void combineSeen(std::uint64_t& first, std::uint64_t& last, std::uint64_t other_first,
+                 std::uint64_t other_last) noexcept
+{
+    if (other_first != 0 && (first == 0 || other_first < first))
+    {
+        first = other_first;
+    }
+    last = std::max(last, other_last);
+}
+
+void count(RoleAggregate& aggregate, core::MigrationType type, std::uint64_t weight) noexcept
+{
+    aggregate.migrations += weight;
+    switch (type)
+    {
+        case core::MigrationType::kPToP:
+            aggregate.p_to_p += weight;
+            break;
+        case core::MigrationType::kPToE:
+            aggregate.p_to_e += weight;
+            break;
+        case core::MigrationType::kEToP:
+            aggregate.e_to_p += weight;
+            break;
+        case core::MigrationType::kEToE:
+            aggregate.e_to_e += weight;
+            break;
+        case core::MigrationType::kUnknown:
+            aggregate.unknown += weight;
+            break;
+    }
+}
+
+/**
+ *  Ranking used for truncation: most P→E migrations first.
+ */
+auto ranksBefore(const RoleAggregate& lhs, const RoleAggregate& rhs) noexcept -> bool
+{
+    if (lhs.p_to_e != rhs.p_to_e)
+    {
+        return lhs.p_to_e > rhs.p_to_e;
+    }
+    if (lhs.migrations != rhs.migrations)
+    {
+        return lhs.migrations > rhs.migrations;
+    }
+    return lhs.role < rhs.role;
+}
+
+}  // namespace
+
+void DistinctCounter::add(std::uint64_t hash) noexcept
+{
+    auto index = static_cast<std::size_t>(hash >> (64 - kRegisterBits));
+    auto rest = hash << kRegisterBits;
+
+    // Position of the first set bit in the remaining bits
+    constexpr int kMaxRank = 64 - kRegisterBits + 1;
+    auto rank = static_cast<std::uint8_t>((rest == 0) ? kMaxRank : std::countl_zero(rest) + 1);
+    registers_[index] = std::max(registers_[index], rank);
+}
+
+void DistinctCounter::merge(const DistinctCounter& other) noexcept
+{
+    for (std::size_t i = 0; i < kRegisters; ++i)
+    {
+        registers_[i] = std::max(registers_[i], other.registers_[i]);
+    }
+}
+
+auto DistinctCounter::estimate() const noexcept -> double
+{
+    constexpr auto kCount = static_cast<double>(kRegisters);
+    constexpr double kAlpha = 0.7213 / (1.0 + (1.079 / kCount));
+
+    double sum = 0.0;
+    std::size_t zeros = 0;
+    for (auto value : registers_)
+    {
+        sum += std::ldexp(1.0, -value);
+        zeros += (value == 0) ? 1 : 0;
+    }
+
+    auto raw = kAlpha * kCount * kCount / sum;
+
+    // Linear counting is more accurate while many registers are empty
+    constexpr double kSmallRange = 2.5;
+    if (raw <= kSmallRange * kCount && zeros > 0)
+    {
+        return kCount * std::log(kCount / static_cast<double>(zeros));
+    }
+    return raw;
+}
+
+void RoleAggregate::merge(const RoleAggregate& other) noexcept
+{
+    migrations += other.migrations;
+    p_to_p += other.p_to_p;
+    p_to_e += other.p_to_e;
+    e_to_p += other.e_to_p;
+    e_to_e += other.e_to_e;
+    unknown += other.unknown;
+    combineSeen(first_seen_realtime_ns, last_seen_realtime_ns, other.first_seen_realtime_ns,
+                other.last_seen_realtime_ns);
+    hosts.merge(other.hosts);
+    threads.merge(other.threads);
+}
+
+FleetAggregate::FleetAggregate(FleetAggregateOptions options) : options_(options)
+{
+    options_.capacity = std::max<std::size_t>(options_.capacity, 1);
+}
+
+auto FleetAggregate::addTrace(TraceReader& reader) -> std::expected<void, core::TraceError>
+{
+    const auto& header = reader.header();
+    auto host_hash = hashHost(header.host);
+
+    // Exact per-host counts first; a single host has few distinct roles
+    std::unordered_map<std::string, RoleAggregate> by_role;
+    RoleAggregate host_totals;
+
+    std::vector<core::MigrationEvent> batch(kReadBatch);
+    while (reader.remaining() > 0)
+    {
+        auto read = reader.read(batch);
+        if (!read)
+        {
+            return std::unexpected(read.error());
+        }
+
+        for (const auto& event : std::span{batch}.first(*read))
+        {
+            // Stamped core types reflect the topology at capture time
+            auto type = (event.src_type != core::CoreType::kUnknown &&
+                         event.dst_type != core::CoreType::kUnknown)
+                            ? core::classifyCoreTypes(event.src_type, event.dst_type)
+                            : core::classifyMigration(event, header.topology);
+
+            auto comm = event.commAsStringView();
+            auto key = options_.group_by_role ? threadRole(comm) : comm;
+            auto [it, inserted] = by_role.try_emplace(std::string(key));
+            auto& role = it->second;
+            if (inserted)
+            {
+                role.role = it->first;
+            }
+
+            count(role, type, event.sample_weight);
+            count(host_totals, type, event.sample_weight);
+
+            auto thread_hash = mixBits(host_hash ^ event.tid);
+            role.threads.add(thread_hash);
+            host_totals.threads.add(thread_hash);
+
+            if (header.clock)
+            {
+                auto realtime = header.clock->toRealtimeNs(event.timestamp_ns);
+                combineSeen(role.first_seen_realtime_ns, role.last_seen_realtime_ns, realtime,
+                            realtime);
+                combineSeen(host_totals.first_seen_realtime_ns,
+                            host_totals.last_seen_realtime_ns, realtime, realtime);
+            }
+        }
+    }
+
+    auto host_item = mixBits(host_hash);
+    host_totals.hosts.add(host_item);
+    totals_.merge(host_totals);
+
+    // Reserve first: the index holds views into the role names
+    roles_.reserve(roles_.size() + by_role.size());
+    std::unordered_map<std::string_view, std::size_t> index;
+    for (std::size_t i = 0; i < roles_.size(); ++i)
+    {
+        index.emplace(roles_[i].role, i);
+    }
+    for (auto& [name, role] : by_role)
+    {
+        role.hosts.add(host_item);
+        if (auto it = index.find(name); it != index.end())
+        {
+            roles_[it->second].merge(role);
+        }
+        else
+        {
+            roles_.push_back(std::move(role));
+        }
+    }
+
+    ++hosts_;
+    truncate();
+    return {};
+}
+
+void FleetAggregate::merge(const FleetAggregate& other)
+{
+    // Reserve first: the index holds views into the role names
+    roles_.reserve(roles_.size() + other.roles_.size());
+    std::unordered_map<std::string_view, std::size_t> index;
+    for (std::size_t i = 0; i < roles_.size(); ++i)
+    {
+        index.emplace(roles_[i].role, i);
+    }
+
+    for (const auto& role : other.roles_)
+    {
+        if (auto it = index.find(role.role); it != index.end())
+        {
+            roles_[it->second].merge(role);
+        }
+        else
+        {
+            roles_.push_back(role);
+        }
+    }
+
+    totals_.merge(other.totals_);
+    hosts_ += other.hosts_;
+    skipped_ += other.skipped_;
+    error_bound_ += other.error_bound_;
+    truncate();
+}
+
+void FleetAggregate::addSkippedTrace() noexcept
+{
+    ++skipped_;
+}
+
+auto FleetAggregate::roles() const noexcept -> std::span<const RoleAggregate>
+{
+    return roles_;
+}
+
+auto FleetAggregate::totals() const noexcept -> const RoleAggregate&
+{
+    return totals_;
+}
+
+auto FleetAggregate::hostCount() const noexcept -> std::uint64_t
+{
+    return hosts_;
+}
+
+auto FleetAggregate::skippedTraces() const noexcept -> std::uint64_t
+{
+    return skipped_;
+}
+
+auto FleetAggregate::errorBound() const noexcept -> std::uint64_t
+{
+    return error_bound_;
+}
+
+auto FleetAggregate::options() const noexcept -> const FleetAggregateOptions&
+{
+    return options_;
+}
+
+void FleetAggregate::truncate()
+{
+    std::ranges::sort(roles_, ranksBefore);
+    if (roles_.size() <= options_.capacity)
+    {
+        return;
+    }
+
+    // Every dropped role has at most as many P→E migrations as the first one
+    error_bound_ += roles_[options_.capacity].p_to_e;
+    roles_.resize(options_.capacity);
+}
+
+auto threadRole(std::string_view comm) noexcept -> std::string_view
+{
+    constexpr std::string_view kIndexChars = "0123456789-_/:.#";
+
+    auto end = comm.find_last_not_of(kIndexChars);
+    if (end == std::string_view::npos)
+    {
+        return comm;
+    }
+    return comm.substr(0, end + 1);
+}
+
+auto mergeTraceFiles(std::span<const std::string> paths, const FleetMergeOptions& options)
+    -> std::expected<FleetAggregate, core::TraceError>
+{
+    auto workers = options.threads;
+    if (workers == 0)
+    {
+        workers = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    workers = std::clamp<std::size_t>(workers, 1, std::max<std::size_t>(paths.size(), 1));
+
+    struct Partial
+    {
+        FleetAggregate aggregate;
+        std::size_t first_error_index{std::numeric_limits<std::size_t>::max()};
+        core::TraceError first_error{core::TraceError::kOpenFailed};
+    };
+
+    std::vector<Partial> partials(workers, Partial{FleetAggregate{options.aggregate}});
+    std::atomic<std::size_t> next{0};
+
+    auto work = [&paths, &next](Partial& partial)
+    {
+        for (auto i = next.fetch_add(1, std::memory_order_relaxed); i < paths.size();
+             i = next.fetch_add(1, std::memory_order_relaxed))
+        {
+            auto reader = TraceReader::open(paths[i]);
+            auto added = reader ? partial.aggregate.addTrace(*reader)
+                                : std::expected<void, core::TraceError>{
+                                      std::unexpect, reader.error()};
+            if (!added)
+            {
+                partial.aggregate.addSkippedTrace();
+                if (i < partial.first_error_index)
+                {
+                    partial.first_error_index = i;
+                    partial.first_error = added.error();
+                }
+            }
+        }
+    };
+
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(workers - 1);
+        for (std::size_t w = 1; w < workers; ++w)
+        {
+            threads.emplace_back(work, std::ref(partials[w]));
+        }
+        work(partials[0]);
+    }
+
+    auto& result = partials[0];
+    for (std::size_t w = 1; w < workers; ++w)
+    {
+        result.aggregate.merge(partials[w].aggregate);
+        if (partials[w].first_error_index < result.first_error_index)
+        {
+            result.first_error_index = partials[w].first_error_index;
+            result.first_error = partials[w].first_error;
+        }
+    }
+
+    if (!paths.empty() && result.aggregate.hostCount() == 0)
+    {
+        return std::unexpected(result.first_error);
+    }
+    return std::move(result.aggregate);
+}
+
+}  // namespace threveal::analysis
@@ -0,0 +1,184 @@
+/**
+ *  @file       hfi_analysis.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of HFI-aware migration analysis.
+ */
+
+#include "threveal/analysis/hfi_analysis.hpp"
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+namespace
+{
+
+/**
+ *  Running totals for one core type.
+ */
+struct CapabilityAccumulator
+{
+    std::uint64_t instructions{0};
+    std::uint64_t cycles{0};
+    double weighted_capability{0.0};
+
+    void add(const core::PmuSample& sample, std::uint32_t performance) noexcept
+    {
+        instructions += sample.instructions;
+        cycles += sample.cycles;
+        weighted_capability +=
+            static_cast<double>(performance) * static_cast<double>(sample.cycles);
+    }
+
+    [[nodiscard]] auto ipc() const noexcept -> double
+    {
+        return (cycles == 0) ? 0.0
+                             : static_cast<double>(instructions) / static_cast<double>(cycles);
+    }
+
+    [[nodiscard]] auto meanCapability() const noexcept -> double
+    {
+        return (cycles == 0) ? 0.0 : weighted_capability / static_cast<double>(cycles);
+    }
+};
+
+}  // namespace
+
+auto classifyHfiMigrations(const EventStore& store, const HfiAnalysisOptions& options)
+    -> std::vector<HfiMigrationVerdict>
+{
+    auto migrations = store.allMigrations();
+
+    std::vector<HfiMigrationVerdict> verdicts;
+    verdicts.reserve(migrations.size());
+
+    for (const auto& migration : migrations)
+    {
+        HfiMigrationVerdict result{.migration = migration};
+
+        auto src = store.hfiCapabilityAt(migration.src_cpu, migration.timestamp_ns);
+        auto dst = store.hfiCapabilityAt(migration.dst_cpu, migration.timestamp_ns);
+        if (src)
+        {
+            result.src_performance = src->performance;
+            result.src_efficiency = src->efficiency;
+        }
+        if (dst)
+        {
+            result.dst_performance = dst->performance;
+            result.dst_efficiency = dst->efficiency;
+        }
+
+        if (src && dst)
+        {
+            auto perf_gain = static_cast<std::int64_t>(dst->performance) -
+                             static_cast<std::int64_t>(src->performance);
+            auto efficiency_gain = static_cast<std::int64_t>(dst->efficiency) -
+                                   static_cast<std::int64_t>(src->efficiency);
+            auto band = static_cast<std::int64_t>(options.neutral_band);
+
+            if (perf_gain > band)
+            {
+                result.verdict = HfiVerdict::kFollowed;
+            }
+            else if (efficiency_gain > band)
+            {
+                // Trading performance for efficiency is what HFI asks for
+                // when the efficiency column ranks the destination higher
+                result.verdict = HfiVerdict::kEfficiency;
+            }
+            else if (-perf_gain > band)
+            {
+                result.verdict = HfiVerdict::kAgainst;
+            }
+            else
+            {
+                result.verdict = HfiVerdict::kNeutral;
+            }
+        }
+
+        verdicts.push_back(result);
+    }
+
+    return verdicts;
+}
+
+auto summarizeHfiVerdicts(std::span<const HfiMigrationVerdict> verdicts) -> HfiVerdictSummary
+{
+    HfiVerdictSummary summary{};
+
+    for (const auto& verdict : verdicts)
+    {
+        // Sampled events stand for sample_weight migrations each
+        std::size_t weight = verdict.migration.sample_weight;
+        switch (verdict.verdict)
+        {
+            case HfiVerdict::kFollowed:
+                summary.followed += weight;
+                break;
+            case HfiVerdict::kEfficiency:
+                summary.efficiency += weight;
+                break;
+            case HfiVerdict::kAgainst:
+                summary.against += weight;
+                break;
+            case HfiVerdict::kNeutral:
+                summary.neutral += weight;
+                break;
+            case HfiVerdict::kUnknown:
+                summary.unknown += weight;
+                break;
+        }
+    }
+
+    return summary;
+}
+
+auto compareIpcRatios(const EventStore& store, const core::TopologyMap& topology)
+    -> std::optional<IpcRatioComparison>
+{
+    CapabilityAccumulator p_core;
+    CapabilityAccumulator e_core;
+
+    for (const auto& sample : store.allPmuSamples())
+    {
+        auto type = topology.getCoreType(sample.cpu_id);
+        if (!type)
+        {
+            continue;
+        }
+
+        auto capability = store.hfiCapabilityAt(sample.cpu_id, sample.timestamp_ns);
+        if (!capability)
+        {
+            continue;
+        }
+
+        auto& accumulator = (*type == core::CoreType::kPCore) ? p_core : e_core;
+        accumulator.add(sample, capability->performance);
+    }
+
+    if (p_core.cycles == 0 || e_core.cycles == 0)
+    {
+        return std::nullopt;
+    }
+
+    return IpcRatioComparison{
+        .p_core_ipc = p_core.ipc(),
+        .e_core_ipc = e_core.ipc(),
+        .p_core_capability = p_core.meanCapability(),
+        .e_core_capability = e_core.meanCapability(),
+    };
+}
+
+}  // namespace threveal::analysis
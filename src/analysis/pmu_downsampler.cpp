@@ -0,0 +1,351 @@
+/**
+ *  @file       pmu_downsampler.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of PMU sample downsampling.
+ */
+
+#include "threveal/analysis/pmu_downsampler.hpp"
+#include "splitmix.hpp"
+
+#include "threveal/core/events.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+namespace
+{
+
+/**
+ *  Every field of a sample, timestamp first; a removal matches a stored
+ *  sample only if all of them are equal.
+ */
+auto sampleKey(const core::PmuSample& sample) noexcept
+{
+    return std::tie(sample.timestamp_ns, sample.tid, sample.cpu_id, sample.cycles,
+                    sample.instructions, sample.llc_misses, sample.llc_references,
+                    sample.branch_misses);
+}
+
+auto sampleLess(const core::PmuSample& lhs, const core::PmuSample& rhs) noexcept -> bool
+{
+    return sampleKey(lhs) < sampleKey(rhs);
+}
+
+auto sameSample(const core::PmuSample& lhs, const core::PmuSample& rhs) noexcept -> bool
+{
+    return sampleKey(lhs) == sampleKey(rhs);
+}
+
+auto earlier(const core::PmuSample& lhs, const core::PmuSample& rhs) noexcept -> bool
+{
+    return lhs.timestamp_ns < rhs.timestamp_ns;
+}
+
+auto nanoseconds(std::chrono::nanoseconds duration) noexcept -> std::uint64_t
+{
+    return static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(duration.count(), 0));
+}
+
+}  // namespace
+
+PmuDownsampler::PmuDownsampler(PmuDownsampling policy)
+    : policy_(std::move(policy)), rng_state_(policy_.seed)
+{
+}
+
+void PmuDownsampler::addSample(const core::PmuSample& sample)
+{
+    auto& thread = threads_[sample.tid];
+    thread.tiers.resize(policy_.rollup.size());
+
+    // Samples of one thread nearly always arrive in order
+    auto position = std::upper_bound(thread.pending.begin(), thread.pending.end(), sample,
+                                     earlier);
+    thread.pending.insert(position, sample);
+    thread.newest_ns = std::max(thread.newest_ns, sample.timestamp_ns);
+
+    auto settle = nanoseconds(policy_.settle_time);
+    if (thread.newest_ns >= settle)
+    {
+        decide(thread, thread.newest_ns - settle);
+    }
+    if (policy_.mode == PmuDownsamplingMode::kRollup)
+    {
+        closeBuckets(thread, false);
+    }
+}
+
+void PmuDownsampler::addMigration(std::uint32_t tid, std::uint64_t timestamp_ns)
+{
+    auto& thread = threads_[tid];
+    auto position = std::upper_bound(thread.migrations.begin(), thread.migrations.end(),
+                                     timestamp_ns);
+    thread.migrations.insert(position, timestamp_ns);
+
+    // Samples that far back have been decided already
+    auto reach = nanoseconds(policy_.migration_window) + nanoseconds(policy_.settle_time);
+    while (thread.migrations.front() + reach < timestamp_ns)
+    {
+        thread.migrations.pop_front();
+    }
+}
+
+void PmuDownsampler::endThread(std::uint32_t tid)
+{
+    auto found = threads_.find(tid);
+    if (found == threads_.end())
+    {
+        return;
+    }
+
+    decide(found->second, std::numeric_limits<std::uint64_t>::max());
+    if (policy_.mode == PmuDownsamplingMode::kRollup)
+    {
+        closeBuckets(found->second, true);
+    }
+    threads_.erase(found);
+}
+
+void PmuDownsampler::settle()
+{
+    for (auto& [tid, thread] : threads_)
+    {
+        decide(thread, std::numeric_limits<std::uint64_t>::max());
+    }
+}
+
+auto PmuDownsampler::pendingChanges() const noexcept -> std::size_t
+{
+    return additions_.size() + removals_.size();
+}
+
+void PmuDownsampler::apply(std::vector<core::PmuSample>& samples)
+{
+    if (additions_.empty() && removals_.empty())
+    {
+        return;
+    }
+
+    std::ranges::sort(additions_, sampleLess);
+    std::ranges::sort(removals_, sampleLess);
+
+    // A sample replaced before it was ever stored cancels out
+    std::vector<core::PmuSample> added;
+    std::vector<core::PmuSample> removed;
+    std::size_t a = 0;
+    std::size_t r = 0;
+    while (a < additions_.size() && r < removals_.size())
+    {
+        if (sameSample(additions_[a], removals_[r]))
+        {
+            ++a;
+            ++r;
+        }
+        else if (sampleLess(additions_[a], removals_[r]))
+        {
+            added.push_back(additions_[a++]);
+        }
+        else
+        {
+            removed.push_back(removals_[r++]);
+        }
+    }
+    added.insert(added.end(), additions_.begin() + static_cast<std::ptrdiff_t>(a),
+                 additions_.end());
+    removed.insert(removed.end(), removals_.begin() + static_cast<std::ptrdiff_t>(r),
+                   removals_.end());
+    additions_.clear();
+    removals_.clear();
+
+    // One pass over the stored samples; both are in time order
+    if (!removed.empty())
+    {
+        std::vector<bool> matched(removed.size(), false);
+        std::size_t next = 0;
+        std::size_t kept = 0;
+        for (const auto& sample : samples)
+        {
+            while (next < removed.size() && removed[next].timestamp_ns < sample.timestamp_ns)
+            {
+                ++next;
+            }
+
+            bool drop = false;
+            for (auto i = next; i < removed.size() &&
+                                removed[i].timestamp_ns == sample.timestamp_ns;
+                 ++i)
+            {
+                if (!matched[i] && sameSample(removed[i], sample))
+                {
+                    matched[i] = true;
+                    drop = true;
+                    break;
+                }
+            }
+            if (!drop)
+            {
+                samples[kept++] = sample;
+            }
+        }
+        samples.resize(kept);
+    }
+
+    auto middle = static_cast<std::ptrdiff_t>(samples.size());
+    samples.insert(samples.end(), added.begin(), added.end());
+    std::inplace_merge(samples.begin(), samples.begin() + middle, samples.end(), earlier);
+}
+
+auto PmuDownsampler::downsampledCount() const noexcept -> std::uint64_t
+{
+    return downsampled_;
+}
+
+auto PmuDownsampler::policy() const noexcept -> const PmuDownsampling&
+{
+    return policy_;
+}
+
+void PmuDownsampler::clear() noexcept
+{
+    threads_.clear();
+    additions_.clear();
+    removals_.clear();
+    rng_state_ = policy_.seed;
+    downsampled_ = 0;
+}
+
+void PmuDownsampler::decide(ThreadState& thread, std::uint64_t horizon_ns)
+{
+    auto window = nanoseconds(policy_.migration_window);
+    while (!thread.pending.empty() && thread.pending.front().timestamp_ns <= horizon_ns)
+    {
+        auto sample = thread.pending.front();
+        thread.pending.pop_front();
+
+        // Later samples cannot be near migrations this far back
+        while (!thread.migrations.empty() &&
+               thread.migrations.front() + window < sample.timestamp_ns)
+        {
+            thread.migrations.pop_front();
+        }
+        if (!thread.migrations.empty() &&
+            thread.migrations.front() <= sample.timestamp_ns + window)
+        {
+            additions_.push_back(sample);
+            continue;
+        }
+
+        if (policy_.mode == PmuDownsamplingMode::kReservoir)
+        {
+            offer(thread, sample);
+        }
+        else
+        {
+            additions_.push_back(sample);
+            if (!thread.tiers.empty())
+            {
+                rollUp(thread, 0, sample);
+            }
+        }
+    }
+}
+
+void PmuDownsampler::offer(ThreadState& thread, const core::PmuSample& sample)
+{
+    // Algorithm R: the n-th sample replaces a random member with
+    // probability size/n, so every sample is equally likely to be kept
+    ++thread.offered;
+    if (thread.members.size() < policy_.reservoir_size)
+    {
+        thread.members.push_back(sample);
+        additions_.push_back(sample);
+        return;
+    }
+
+    auto slot = nextIndex(thread.offered);
+    if (slot < policy_.reservoir_size)
+    {
+        removals_.push_back(std::exchange(thread.members[slot], sample));
+        additions_.push_back(sample);
+    }
+    ++downsampled_;
+}
+
+void PmuDownsampler::rollUp(ThreadState& thread, std::size_t tier, const core::PmuSample& sample)
+{
+    auto width = std::max<std::uint64_t>(nanoseconds(policy_.rollup[tier].width), 1);
+    auto index = sample.timestamp_ns / width;
+
+    // Counters of different cores are not comparable; a move starts a bucket
+    auto& buckets = thread.tiers[tier];
+    if (buckets.empty() || buckets.back().index != index ||
+        buckets.back().merged.cpu_id != sample.cpu_id)
+    {
+        buckets.push_back(Bucket{index, sample, {sample}});
+        return;
+    }
+
+    auto& bucket = buckets.back();
+    bucket.parts.push_back(sample);
+    bucket.merged.timestamp_ns = std::max(bucket.merged.timestamp_ns, sample.timestamp_ns);
+    bucket.merged.instructions += sample.instructions;
+    bucket.merged.cycles += sample.cycles;
+    bucket.merged.llc_misses += sample.llc_misses;
+    bucket.merged.llc_references += sample.llc_references;
+    bucket.merged.branch_misses += sample.branch_misses;
+}
+
+void PmuDownsampler::closeBuckets(ThreadState& thread, bool all)
+{
+    // Closing a bucket feeds the next tier, so go from fine to coarse
+    for (std::size_t tier = 0; tier < thread.tiers.size(); ++tier)
+    {
+        auto age = nanoseconds(policy_.rollup[tier].age);
+        auto width = std::max<std::uint64_t>(nanoseconds(policy_.rollup[tier].width), 1);
+        while (!thread.tiers[tier].empty())
+        {
+            auto end_ns = (thread.tiers[tier].front().index + 1) * width;
+            if (!all && end_ns + age > thread.newest_ns)
+            {
+                break;
+            }
+            close(thread, tier);
+        }
+    }
+}
+
+void PmuDownsampler::close(ThreadState& thread, std::size_t tier)
+{
+    auto bucket = std::move(thread.tiers[tier].front());
+    thread.tiers[tier].pop_front();
+
+    // A lone part already is the bucket
+    if (bucket.parts.size() > 1)
+    {
+        removals_.insert(removals_.end(), bucket.parts.begin(), bucket.parts.end());
+        additions_.push_back(bucket.merged);
+        downsampled_ += bucket.parts.size() - 1;
+    }
+
+    if (tier + 1 < thread.tiers.size())
+    {
+        rollUp(thread, tier + 1, bucket.merged);
+    }
+}
+
+auto PmuDownsampler::nextIndex(std::uint64_t bound) noexcept -> std::uint64_t
+{
+    return splitMixNext(rng_state_) % bound;
+}
+
+}  // namespace threveal::analysis
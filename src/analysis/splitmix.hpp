@@ -0,0 +1,69 @@
+/**
+ *  @file       splitmix.hpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  splitmix64 hashing and random numbers shared by the analysis sources.
+ *
+ *  Internal to the analysis library; not part of the public headers.
+ */
+
+#ifndef THREVEAL_ANALYSIS_SPLITMIX_HPP_
+#define THREVEAL_ANALYSIS_SPLITMIX_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace threveal::analysis
+{
+
+/**
+ *  Spreads a value over all 64 bits (splitmix64 finalizer).
+ *
+ *  @param      value  The value to mix.
+ *  @return     The mixed value.
+ */
+[[nodiscard]] constexpr auto mixBits(std::uint64_t value) noexcept -> std::uint64_t
+{
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+/**
+ *  Advances a splitmix64 state and returns the next random value.
+ *
+ *  @param      state  Generator state, updated in place.
+ *  @return     The next value in the sequence.
+ */
+[[nodiscard]] constexpr auto splitMixNext(std::uint64_t& state) noexcept -> std::uint64_t
+{
+    state += 0x9e3779b97f4a7c15ULL;
+    return mixBits(state);
+}
+
+/**
+ *  Small, fast generator for sampling indices (splitmix64).
+ */
+class SplitMix
+{
+  public:
+    explicit constexpr SplitMix(std::uint64_t seed) noexcept : state_(seed) {}
+
+    /**
+     *  Returns a value in [0, bound); bound must be non-zero.
+     */
+    [[nodiscard]] constexpr auto below(std::size_t bound) noexcept -> std::size_t
+    {
+        return static_cast<std::size_t>(splitMixNext(state_) % bound);
+    }
+
+  private:
+    std::uint64_t state_;
+};
+
+}  // namespace threveal::analysis
+
+#endif  // THREVEAL_ANALYSIS_SPLITMIX_HPP_
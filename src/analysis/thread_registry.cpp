@@ -0,0 +1,119 @@
+/**
+ *  @file       thread_registry.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of thread lifetime tracking.
+ */
+
+#include "threveal/analysis/thread_registry.hpp"
+
+#include "threveal/core/events.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace threveal::analysis
+{
+
+void ThreadRegistry::record(const core::ThreadLifecycleEvent& event)
+{
+    auto key = event.key();
+    auto live = live_.find(event.tid);
+    bool exit = event.kind == core::ThreadLifecycleKind::kExit;
+
+    // Only the thread currently holding the ID can exit without a start time
+    if (exit && key.start_time_ns == 0 && live != live_.end())
+    {
+        key.start_time_ns = live->second;
+    }
+
+    auto& lifetime = find(key);
+    lifetime.pid = event.pid;
+    lifetime.comm = event.comm;
+
+    if (exit)
+    {
+        lifetime.end_ns = std::max(event.timestamp_ns, key.start_time_ns);
+        if (live != live_.end() && live->second == key.start_time_ns)
+        {
+            live_.erase(live);
+        }
+        return;
+    }
+
+    if (lifetime.end_ns != kThreadAlive)
+    {
+        return;  // Arrived after the thread's exit
+    }
+    if (live == live_.end())
+    {
+        live_.emplace(event.tid, key.start_time_ns);
+        return;
+    }
+    if (live->second < key.start_time_ns)
+    {
+        // The older thread's exit was missed; it held the ID until this one started
+        find({event.tid, live->second}).end_ns = key.start_time_ns - 1;
+        live->second = key.start_time_ns;
+    }
+    else if (live->second > key.start_time_ns)
+    {
+        // A late event of a thread that has since been replaced
+        lifetime.end_ns = live->second - 1;
+    }
+}
+
+auto ThreadRegistry::resolve(std::uint32_t tid, std::uint64_t timestamp_ns) const
+    -> core::ThreadKey
+{
+    // The latest thread with this ID that started at or before the time
+    auto it = lifetimes_.upper_bound(core::ThreadKey{tid, timestamp_ns});
+    if (it != lifetimes_.begin())
+    {
+        --it;
+        if (it->first.tid == tid && it->second.contains(timestamp_ns))
+        {
+            return it->first;
+        }
+    }
+    return core::ThreadKey{tid, 0};
+}
+
+auto ThreadRegistry::lifetime(const core::ThreadKey& key) const -> std::optional<ThreadLifetime>
+{
+    if (auto it = lifetimes_.find(key); it != lifetimes_.end())
+    {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+auto ThreadRegistry::threadCount() const noexcept -> std::size_t
+{
+    return lifetimes_.size();
+}
+
+auto ThreadRegistry::liveThreadCount() const noexcept -> std::size_t
+{
+    return live_.size();
+}
+
+void ThreadRegistry::clear() noexcept
+{
+    lifetimes_.clear();
+    live_.clear();
+}
+
+auto ThreadRegistry::find(const core::ThreadKey& key) -> ThreadLifetime&
+{
+    auto [it, inserted] = lifetimes_.try_emplace(key);
+    if (inserted)
+    {
+        it->second.key = key;
+    }
+    return it->second;
+}
+
+}  // namespace threveal::analysis
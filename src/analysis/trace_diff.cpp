@@ -0,0 +1,493 @@
+/**
+ *  @file       trace_diff.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the A/B run comparison.
+ */
+
+#include "threveal/analysis/trace_diff.hpp"
+#include "splitmix.hpp"
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/analysis/fleet_aggregate.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+namespace
+{
+
+constexpr std::size_t kMetrics = 5;
+constexpr std::size_t kCoreTypes = 3;
+
+/**
+ *  Bootstrap resamples handed to a worker at a time.
+ */
+constexpr std::size_t kBootstrapChunk = 64;
+
+constexpr double kNanosecondsPerSecond = 1e9;
+
+auto coreIndex(core::CoreType type) noexcept -> std::size_t
+{
+    auto index = static_cast<std::size_t>(type);
+    return (index < kCoreTypes) ? index : 0;
+}
+
+auto coreTypeOf(core::CpuId cpu, const core::TopologyMap& topology) noexcept -> core::CoreType
+{
+    return topology.getCoreType(cpu).value_or(core::CoreType::kUnknown);
+}
+
+/**
+ *  Everything diffRuns() needs to know about one thread of one run.
+ */
+struct ThreadProfile
+{
+    std::string comm;
+    std::uint32_t tid{0};
+    std::uint64_t first_ns{0};
+    std::uint64_t last_ns{0};
+    std::uint64_t last_migration_ns{0};
+    std::uint64_t migrations{0};
+    std::uint64_t warmup_migrations{0};
+    std::array<std::uint64_t, kCoreTypes> residency_ns{};
+    std::array<std::uint64_t, kCoreTypes> instructions{};
+    std::array<std::uint64_t, kCoreTypes> cycles{};
+};
+
+/**
+ *  Numerator and denominator of a metric for one thread; a role's value
+ *  is the ratio of the sums over its threads.
+ */
+struct MetricParts
+{
+    double numerator{0.0};
+    double denominator{0.0};
+};
+
+auto metricParts(const ThreadProfile& profile, DiffMetric metric) noexcept -> MetricParts
+{
+    constexpr auto kP = static_cast<std::size_t>(core::CoreType::kPCore);
+    constexpr auto kE = static_cast<std::size_t>(core::CoreType::kECore);
+
+    switch (metric)
+    {
+        case DiffMetric::kMigrationRate:
+            return {static_cast<double>(profile.migrations),
+                    static_cast<double>(profile.last_ns - profile.first_ns) /
+                        kNanosecondsPerSecond};
+        case DiffMetric::kPCoreResidency:
+        {
+            std::uint64_t observed = 0;
+            for (auto ns : profile.residency_ns)
+            {
+                observed += ns;
+            }
+            return {static_cast<double>(profile.residency_ns[kP]), static_cast<double>(observed)};
+        }
+        case DiffMetric::kPCoreIpc:
+            return {static_cast<double>(profile.instructions[kP]),
+                    static_cast<double>(profile.cycles[kP])};
+        case DiffMetric::kECoreIpc:
+            return {static_cast<double>(profile.instructions[kE]),
+                    static_cast<double>(profile.cycles[kE])};
+        case DiffMetric::kWarmupMigrations:
+            return {static_cast<double>(profile.warmup_migrations), 1.0};
+    }
+    return {};
+}
+
+auto ratio(double numerator, double denominator) noexcept -> double
+{
+    return (denominator > 0.0) ? numerator / denominator : 0.0;
+}
+
+auto higherIsWorse(DiffMetric metric) noexcept -> bool
+{
+    return metric == DiffMetric::kMigrationRate || metric == DiffMetric::kWarmupMigrations;
+}
+
+/**
+ *  Runs fn(worker) on `workers` threads, the first on the caller's.
+ */
+template <typename Fn>
+void runWorkers(std::size_t workers, Fn fn)
+{
+    std::vector<std::jthread> threads;
+    threads.reserve(workers - 1);
+    for (std::size_t w = 1; w < workers; ++w)
+    {
+        threads.emplace_back(fn, w);
+    }
+    fn(std::size_t{0});
+}
+
+/**
+ *  Builds the profiles of the threads hashed to one worker.
+ *
+ *  Every worker scans the whole store, so each thread's events are seen
+ *  in timestamp order by a single worker and no state is shared.
+ */
+auto buildShard(const EventStore& store, const core::TopologyMap& topology,
+                std::uint64_t warmup_ns, std::size_t workers, std::size_t worker)
+    -> std::vector<ThreadProfile>
+{
+    std::unordered_map<std::uint32_t, ThreadProfile> threads;
+    auto owned = [workers, worker](std::uint32_t tid)
+    {
+        return mixBits(tid) % workers == worker;
+    };
+
+    for (const auto& event : store.allMigrations())
+    {
+        if (!owned(event.tid))
+        {
+            continue;
+        }
+
+        auto [found, inserted] = threads.try_emplace(event.tid);
+        auto& profile = found->second;
+        if (inserted)
+        {
+            profile.comm = std::string{event.commAsStringView()};
+            profile.tid = event.tid;
+            profile.first_ns = event.timestamp_ns;
+        }
+        else
+        {
+            // The thread ran on the source core since its previous migration
+            auto src = (event.src_type != core::CoreType::kUnknown)
+                           ? event.src_type
+                           : coreTypeOf(event.src_cpu, topology);
+            profile.residency_ns[coreIndex(src)] += event.timestamp_ns - profile.last_migration_ns;
+        }
+
+        auto weight = std::max<std::uint32_t>(event.sample_weight, 1);
+        profile.migrations += weight;
+        if (event.timestamp_ns - profile.first_ns < warmup_ns)
+        {
+            profile.warmup_migrations += weight;
+        }
+        profile.last_migration_ns = event.timestamp_ns;
+        profile.last_ns = event.timestamp_ns;
+    }
+
+    for (const auto& sample : store.allPmuSamples())
+    {
+        if (!owned(sample.tid))
+        {
+            continue;
+        }
+        auto found = threads.find(sample.tid);
+        if (found == threads.end())
+        {
+            continue;
+        }
+
+        auto& profile = found->second;
+        auto index = coreIndex(coreTypeOf(sample.cpu_id, topology));
+        profile.instructions[index] += sample.instructions;
+        profile.cycles[index] += sample.cycles;
+        profile.first_ns = std::min(profile.first_ns, sample.timestamp_ns);
+        profile.last_ns = std::max(profile.last_ns, sample.timestamp_ns);
+    }
+
+    std::vector<ThreadProfile> profiles;
+    profiles.reserve(threads.size());
+    for (auto& entry : threads)
+    {
+        profiles.push_back(std::move(entry.second));
+    }
+    return profiles;
+}
+
+/**
+ *  Builds the profile of every migrating thread in a run.
+ */
+auto buildProfiles(const EventStore& store, const core::TopologyMap& topology,
+                   std::uint64_t warmup_ns, std::size_t workers) -> std::vector<ThreadProfile>
+{
+    std::vector<std::vector<ThreadProfile>> shards(workers);
+    runWorkers(workers,
+               [&](std::size_t worker)
+               {
+                   shards[worker] = buildShard(store, topology, warmup_ns, workers, worker);
+               });
+
+    std::vector<ThreadProfile> profiles;
+    for (auto& shard : shards)
+    {
+        std::ranges::move(shard, std::back_inserter(profiles));
+    }
+    return profiles;
+}
+
+/**
+ *  Groups threads by command name, each group in order of appearance.
+ */
+auto byComm(const std::vector<ThreadProfile>& profiles)
+    -> std::map<std::string_view, std::vector<const ThreadProfile*>>
+{
+    std::map<std::string_view, std::vector<const ThreadProfile*>> groups;
+    for (const auto& profile : profiles)
+    {
+        groups[profile.comm].push_back(&profile);
+    }
+    for (auto& [comm, group] : groups)
+    {
+        std::ranges::sort(group,
+                          [](const ThreadProfile* a, const ThreadProfile* b)
+                          {
+                              return std::pair{a->first_ns, a->tid} <
+                                     std::pair{b->first_ns, b->tid};
+                          });
+    }
+    return groups;
+}
+
+/**
+ *  Aligned threads of one role, as per-thread metric parts.
+ */
+struct RoleSamples
+{
+    std::string role;
+    std::vector<std::array<MetricParts, kMetrics>> baseline;
+    std::vector<std::array<MetricParts, kMetrics>> candidate;
+
+    /**
+     *  Bootstrap differences, kMetrics rows of bootstrap_samples each.
+     */
+    std::vector<double> deltas;
+};
+
+auto partsOf(const ThreadProfile& profile) -> std::array<MetricParts, kMetrics>
+{
+    std::array<MetricParts, kMetrics> parts{};
+    for (std::size_t m = 0; m < kMetrics; ++m)
+    {
+        parts[m] = metricParts(profile, static_cast<DiffMetric>(m));
+    }
+    return parts;
+}
+
+/**
+ *  Draws resamples [first, last) of a role's paired bootstrap.
+ */
+void bootstrap(RoleSamples& samples, std::size_t first, std::size_t last,
+               std::size_t sample_count, std::uint64_t seed)
+{
+    auto pairs = samples.baseline.size();
+    for (auto s = first; s < last; ++s)
+    {
+        SplitMix rng{mixBits(seed ^ mixBits(s))};
+        std::array<MetricParts, kMetrics> base{};
+        std::array<MetricParts, kMetrics> cand{};
+        for (std::size_t i = 0; i < pairs; ++i)
+        {
+            auto pick = rng.below(pairs);
+            for (std::size_t m = 0; m < kMetrics; ++m)
+            {
+                base[m].numerator += samples.baseline[pick][m].numerator;
+                base[m].denominator += samples.baseline[pick][m].denominator;
+                cand[m].numerator += samples.candidate[pick][m].numerator;
+                cand[m].denominator += samples.candidate[pick][m].denominator;
+            }
+        }
+        for (std::size_t m = 0; m < kMetrics; ++m)
+        {
+            samples.deltas[(m * sample_count) + s] = ratio(cand[m].numerator, cand[m].denominator) -
+                                                      ratio(base[m].numerator, base[m].denominator);
+        }
+    }
+}
+
+/**
+ *  Returns the q-quantile of values, reordering them.
+ */
+auto quantile(std::span<double> values, double q) -> double
+{
+    auto index = static_cast<std::size_t>(q * static_cast<double>(values.size() - 1));
+    std::ranges::nth_element(values, values.begin() + static_cast<std::ptrdiff_t>(index));
+    return values[index];
+}
+
+/**
+ *  Relative change in the worse direction, for ranking.
+ */
+auto severity(const DiffEntry& entry) noexcept -> double
+{
+    return higherIsWorse(entry.metric) ? entry.relative_change : -entry.relative_change;
+}
+
+}  // namespace
+
+auto diffRuns(const EventStore& baseline, const core::TopologyMap& baseline_topology,
+              const EventStore& candidate, const core::TopologyMap& candidate_topology,
+              const TraceDiffOptions& options) -> TraceDiff
+{
+    auto workers = options.threads;
+    if (workers == 0)
+    {
+        workers = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    auto warmup_ns = static_cast<std::uint64_t>(std::max<std::int64_t>(options.warmup.count(), 0));
+    auto sample_count = std::max<std::size_t>(options.bootstrap_samples, 1);
+
+    auto baseline_profiles = buildProfiles(baseline, baseline_topology, warmup_ns, workers);
+    auto candidate_profiles = buildProfiles(candidate, candidate_topology, warmup_ns, workers);
+
+    // Pair the k-th thread of each name in both runs, then group by role
+    TraceDiff diff;
+    std::map<std::string_view, RoleSamples> roles;
+    auto baseline_groups = byComm(baseline_profiles);
+    auto candidate_groups = byComm(candidate_profiles);
+    for (const auto& [comm, group] : baseline_groups)
+    {
+        auto other = candidate_groups.find(comm);
+        std::size_t aligned = 0;
+        if (other != candidate_groups.end())
+        {
+            aligned = std::min(group.size(), other->second.size());
+        }
+        diff.unmatched_baseline += group.size() - aligned;
+        if (aligned == 0)
+        {
+            continue;
+        }
+
+        auto role = threadRole(comm);
+        auto& samples = roles[role];
+        samples.role = std::string{role};
+        for (std::size_t k = 0; k < aligned; ++k)
+        {
+            samples.baseline.push_back(partsOf(*group[k]));
+            samples.candidate.push_back(partsOf(*other->second[k]));
+        }
+        diff.aligned_threads += aligned;
+    }
+    diff.unmatched_candidate = candidate_profiles.size() - diff.aligned_threads;
+
+    // Bootstrap every testable role in chunks, so small and large roles
+    // spread evenly over the workers
+    std::vector<RoleSamples*> tested;
+    for (auto& [role, samples] : roles)
+    {
+        if (samples.baseline.size() >= std::max<std::size_t>(options.min_threads, 1))
+        {
+            samples.deltas.resize(kMetrics * sample_count);
+            tested.push_back(&samples);
+        }
+    }
+
+    auto chunks_per_role = (sample_count + kBootstrapChunk - 1) / kBootstrapChunk;
+    auto total_chunks = tested.size() * chunks_per_role;
+    std::atomic<std::size_t> next{0};
+    runWorkers(std::clamp<std::size_t>(workers, 1, std::max<std::size_t>(total_chunks, 1)),
+               [&](std::size_t /*worker*/)
+               {
+                   for (auto chunk = next.fetch_add(1, std::memory_order_relaxed);
+                        chunk < total_chunks; chunk = next.fetch_add(1, std::memory_order_relaxed))
+                   {
+                       auto role = chunk / chunks_per_role;
+                       auto first = (chunk % chunks_per_role) * kBootstrapChunk;
+                       auto last = std::min(first + kBootstrapChunk, sample_count);
+                       bootstrap(*tested[role], first, last, sample_count,
+                                 mixBits(options.seed ^ mixBits(role)));
+                   }
+               });
+
+    for (auto& [role, samples] : roles)
+    {
+        for (std::size_t m = 0; m < kMetrics; ++m)
+        {
+            MetricParts base;
+            MetricParts cand;
+            for (std::size_t i = 0; i < samples.baseline.size(); ++i)
+            {
+                base.numerator += samples.baseline[i][m].numerator;
+                base.denominator += samples.baseline[i][m].denominator;
+                cand.numerator += samples.candidate[i][m].numerator;
+                cand.denominator += samples.candidate[i][m].denominator;
+            }
+
+            // Nothing to compare, e.g. IPC without PMU samples
+            if (base.denominator <= 0.0 && cand.denominator <= 0.0)
+            {
+                continue;
+            }
+
+            DiffEntry entry;
+            entry.role = samples.role;
+            entry.metric = static_cast<DiffMetric>(m);
+            entry.threads = samples.baseline.size();
+            entry.baseline = ratio(base.numerator, base.denominator);
+            entry.candidate = ratio(cand.numerator, cand.denominator);
+            if (entry.baseline != 0.0)
+            {
+                entry.relative_change = (entry.candidate / entry.baseline) - 1.0;
+            }
+            else if (entry.candidate != 0.0)
+            {
+                entry.relative_change = std::numeric_limits<double>::infinity();
+            }
+
+            auto delta = entry.candidate - entry.baseline;
+            entry.ci_low = delta;
+            entry.ci_high = delta;
+            if (!samples.deltas.empty())
+            {
+                auto deltas = std::span{samples.deltas}.subspan(m * sample_count, sample_count);
+                auto at_or_below = std::ranges::count_if(deltas,
+                                                         [](double d)
+                                                         {
+                                                             return d <= 0.0;
+                                                         });
+                auto at_or_above = std::ranges::count_if(deltas,
+                                                         [](double d)
+                                                         {
+                                                             return d >= 0.0;
+                                                         });
+                entry.p_value = std::min(1.0, 2.0 * static_cast<double>(std::min(at_or_below,
+                                                                                  at_or_above)) /
+                                                  static_cast<double>(sample_count));
+                entry.ci_low = quantile(deltas, options.alpha / 2.0);
+                entry.ci_high = quantile(deltas, 1.0 - (options.alpha / 2.0));
+            }
+
+            entry.regression = entry.p_value < options.alpha && severity(entry) > 0.0;
+            diff.entries.push_back(std::move(entry));
+        }
+    }
+
+    std::ranges::stable_sort(diff.entries,
+                             [](const DiffEntry& a, const DiffEntry& b)
+                             {
+                                 if (a.regression != b.regression)
+                                 {
+                                     return a.regression;
+                                 }
+                                 return severity(a) > severity(b);
+                             });
+    return diff;
+}
+
+}  // namespace threveal::analysis
@@ -0,0 +1,505 @@
+/**
+ *  @file       trace_file.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the trace file format.
+ */
+
+#include "threveal/analysis/trace_file.hpp"
+
+#include "threveal/core/clock.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace threveal::analysis
+{
+
+namespace
+{
+
+using core::TraceError;
+
+constexpr std::string_view kMagic = "threveal-trace";
+constexpr std::string_view kDataMarker = "data\n";
+
+/**
+ *  Upper bound on the text header, so a wrong file is rejected quickly.
+ */
+constexpr std::size_t kMaxHeaderBytes = 64 * 1024;
+
+/**
+ *  Records encoded or decoded per read() or write() call.
+ */
+constexpr std::size_t kRecordsPerChunk = 1024;
+
+// Record field offsets
+constexpr std::size_t kTimestampOffset = 0;
+constexpr std::size_t kPidOffset = 8;
+constexpr std::size_t kTidOffset = 12;
+constexpr std::size_t kSrcCpuOffset = 16;
+constexpr std::size_t kDstCpuOffset = 20;
+constexpr std::size_t kGenerationOffset = 24;
+constexpr std::size_t kWeightOffset = 28;
+constexpr std::size_t kSrcTypeOffset = 32;
+constexpr std::size_t kDstTypeOffset = 33;
+constexpr std::size_t kCommOffset = 34;
+static_assert(kCommOffset + core::kMaxCommLength == kTraceRecordSize);
+
+/**
+ *  Set in the source core type byte for a polled, low-fidelity migration.
+ */
+constexpr std::uint8_t kPolledFlag = 0x80;
+
+template <typename T>
+void putLittleEndian(std::byte* out, T value) noexcept
+{
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out[i] = static_cast<std::byte>((value >> (8 * i)) & 0xff);
+    }
+}
+
+template <typename T>
+auto getLittleEndian(const std::byte* in) noexcept -> T
+{
+    T value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        value |= static_cast<T>(std::to_integer<T>(in[i]) << (8 * i));
+    }
+    return value;
+}
+
+void encodeRecord(const core::MigrationEvent& event, std::byte* out) noexcept
+{
+    putLittleEndian(out + kTimestampOffset, event.timestamp_ns);
+    putLittleEndian(out + kPidOffset, event.pid);
+    putLittleEndian(out + kTidOffset, event.tid);
+    putLittleEndian(out + kSrcCpuOffset, event.src_cpu);
+    putLittleEndian(out + kDstCpuOffset, event.dst_cpu);
+    putLittleEndian(out + kGenerationOffset, event.topology_generation);
+    putLittleEndian(out + kWeightOffset, event.sample_weight);
+    auto src_type = static_cast<std::uint8_t>(event.src_type);
+    if (event.fidelity == core::MigrationFidelity::kPolled)
+    {
+        src_type |= kPolledFlag;
+    }
+    out[kSrcTypeOffset] = static_cast<std::byte>(src_type);
+    out[kDstTypeOffset] = static_cast<std::byte>(event.dst_type);
+    std::memcpy(out + kCommOffset, event.comm.data(), event.comm.size());
+}
+
+auto decodeCoreType(std::byte raw) noexcept -> core::CoreType
+{
+    switch (static_cast<core::CoreType>(raw))
+    {
+        case core::CoreType::kPCore:
+            return core::CoreType::kPCore;
+        case core::CoreType::kECore:
+            return core::CoreType::kECore;
+        default:
+            return core::CoreType::kUnknown;
+    }
+}
+
+auto decodeRecord(const std::byte* in) noexcept -> core::MigrationEvent
+{
+    core::MigrationEvent event{};
+    event.timestamp_ns = getLittleEndian<std::uint64_t>(in + kTimestampOffset);
+    event.pid = getLittleEndian<std::uint32_t>(in + kPidOffset);
+    event.tid = getLittleEndian<std::uint32_t>(in + kTidOffset);
+    event.src_cpu = getLittleEndian<std::uint32_t>(in + kSrcCpuOffset);
+    event.dst_cpu = getLittleEndian<std::uint32_t>(in + kDstCpuOffset);
+    event.topology_generation = getLittleEndian<std::uint32_t>(in + kGenerationOffset);
+    event.sample_weight =
+        std::max<std::uint32_t>(getLittleEndian<std::uint32_t>(in + kWeightOffset), 1);
+    auto src_type = std::to_integer<std::uint8_t>(in[kSrcTypeOffset]);
+    event.src_type = decodeCoreType(static_cast<std::byte>(src_type & ~kPolledFlag));
+    event.fidelity = (src_type & kPolledFlag) != 0 ? core::MigrationFidelity::kPolled
+                                                   : core::MigrationFidelity::kExact;
+    event.dst_type = decodeCoreType(in[kDstTypeOffset]);
+    std::memcpy(event.comm.data(), in + kCommOffset, event.comm.size());
+
+    // Never trust the file to terminate the name
+    event.comm.back() = '\0';
+    return event;
+}
+
+auto writeAll(int fd, std::span<const std::byte> data) -> bool
+{
+    while (!data.empty())
+    {
+        ssize_t written = write(fd, data.data(), data.size());
+        if (written <= 0)
+        {
+            return false;
+        }
+        data = data.subspan(static_cast<std::size_t>(written));
+    }
+    return true;
+}
+
+template <typename T>
+auto parseNumber(std::string_view token) -> std::optional<T>
+{
+    T value{};
+    auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (ec != std::errc{} || ptr != token.data() + token.size())
+    {
+        return std::nullopt;
+    }
+    return value;
+}
+
+/**
+ *  Splits off the first space-separated token.
+ */
+auto nextToken(std::string_view& line) -> std::string_view
+{
+    auto end = line.find(' ');
+    auto token = line.substr(0, end);
+    line.remove_prefix((end == std::string_view::npos) ? line.size() : end + 1);
+    return token;
+}
+
+auto parseClock(std::string_view value)
+    -> std::expected<std::optional<core::ClockSnapshot>, TraceError>
+{
+    if (value == "none")
+    {
+        return std::nullopt;
+    }
+
+    core::ClockSnapshot clock{};
+    auto source = nextToken(value);
+    if (source == core::toString(core::ClockSource::kBoottime))
+    {
+        clock.source = core::ClockSource::kBoottime;
+    }
+    else if (source != core::toString(core::ClockSource::kMonotonic))
+    {
+        return std::unexpected(TraceError::kParseError);
+    }
+
+    for (auto* field : {&clock.trace_ns, &clock.realtime_ns, &clock.monotonic_ns,
+                        &clock.boottime_ns, &clock.uncertainty_ns})
+    {
+        auto parsed = parseNumber<std::uint64_t>(nextToken(value));
+        if (!parsed)
+        {
+            return std::unexpected(TraceError::kParseError);
+        }
+        *field = *parsed;
+    }
+    if (!value.empty())
+    {
+        return std::unexpected(TraceError::kParseError);
+    }
+    return clock;
+}
+
+auto parseCpus(std::string_view value) -> std::optional<std::vector<core::CpuId>>
+{
+    if (value.empty())
+    {
+        return std::vector<core::CpuId>{};
+    }
+    auto parsed = core::parseCpuList(value);
+    if (!parsed)
+    {
+        return std::nullopt;
+    }
+    return std::move(*parsed);
+}
+
+}  // namespace
+
+auto formatTraceHeader(const TraceHeader& header) -> std::expected<std::string, TraceError>
+{
+    if (header.host.find_first_of("\r\n") != std::string::npos)
+    {
+        return std::unexpected(TraceError::kInvalidHeader);
+    }
+
+    std::string out;
+    out += kMagic;
+    out += ' ';
+    out += std::to_string(kTraceFormatVersion);
+    out += "\nhost ";
+    out += header.host;
+    out += "\nclock";
+    if (header.clock)
+    {
+        const auto& clock = *header.clock;
+        out += ' ';
+        out += core::toString(clock.source);
+        for (auto value : {clock.trace_ns, clock.realtime_ns, clock.monotonic_ns,
+                           clock.boottime_ns, clock.uncertainty_ns})
+        {
+            out += ' ';
+            out += std::to_string(value);
+        }
+    }
+    else
+    {
+        out += " none";
+    }
+    out += "\np ";
+    out += core::formatCpuList(header.topology.getPCores());
+    out += "\ne ";
+    out += core::formatCpuList(header.topology.getECores());
+    out += "\nmigrations ";
+    out += std::to_string(header.migration_count);
+    out += '\n';
+    return out;
+}
+
+auto parseTraceHeader(std::string_view text) -> std::expected<TraceHeader, TraceError>
+{
+    // Fixed line order: magic, host, clock, p, e, migrations
+    constexpr std::array<std::string_view, 5> kFields = {"host", "clock", "p", "e", "migrations"};
+    std::array<std::string_view, kFields.size()> values{};
+
+    auto next_line = [&text]() -> std::string_view
+    {
+        auto end = text.find('\n');
+        auto line = text.substr(0, end);
+        text.remove_prefix((end == std::string_view::npos) ? text.size() : end + 1);
+        return line;
+    };
+
+    auto first = next_line();
+    if (nextToken(first) != kMagic)
+    {
+        return std::unexpected(TraceError::kParseError);
+    }
+    if (parseNumber<std::uint32_t>(first) != kTraceFormatVersion)
+    {
+        return std::unexpected(TraceError::kVersionMismatch);
+    }
+
+    for (std::size_t i = 0; i < kFields.size(); ++i)
+    {
+        auto line = next_line();
+        if (!line.starts_with(kFields[i]) ||
+            (line.size() > kFields[i].size() && line[kFields[i].size()] != ' '))
+        {
+            return std::unexpected(TraceError::kParseError);
+        }
+        line.remove_prefix(kFields[i].size());
+        values[i] = line.empty() ? line : line.substr(1);
+    }
+
+    auto clock = parseClock(values[1]);
+    auto p_cores = parseCpus(values[2]);
+    auto e_cores = parseCpus(values[3]);
+    auto count = parseNumber<std::uint64_t>(values[4]);
+    if (!clock || !p_cores || !e_cores || !count)
+    {
+        return std::unexpected(TraceError::kParseError);
+    }
+
+    return TraceHeader{
+        .host = std::string(values[0]),
+        .clock = *clock,
+        .topology = core::TopologyMap{*p_cores, *e_cores},
+        .migration_count = *count,
+    };
+}
+
+auto writeTrace(const std::string& path, const TraceHeader& header,
+                std::span<const core::MigrationEvent> migrations) -> std::expected<void, TraceError>
+{
+    auto counted = header;
+    counted.migration_count = migrations.size();
+    auto text = formatTraceHeader(counted);
+    if (!text)
+    {
+        return std::unexpected(text.error());
+    }
+    *text += kDataMarker;
+
+    constexpr mode_t kReadWrite = 0644;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, kReadWrite);
+    if (fd < 0)
+    {
+        return std::unexpected(TraceError::kOpenFailed);
+    }
+
+    bool ok = writeAll(fd, std::as_bytes(std::span{*text}));
+
+    std::vector<std::byte> chunk(kRecordsPerChunk * kTraceRecordSize);
+    while (ok && !migrations.empty())
+    {
+        auto batch = migrations.first(std::min(migrations.size(), kRecordsPerChunk));
+        for (std::size_t i = 0; i < batch.size(); ++i)
+        {
+            encodeRecord(batch[i], chunk.data() + (i * kTraceRecordSize));
+        }
+        ok = writeAll(fd, std::span{chunk}.first(batch.size() * kTraceRecordSize));
+        migrations = migrations.subspan(batch.size());
+    }
+
+    if (close(fd) != 0 || !ok)
+    {
+        return std::unexpected(TraceError::kWriteFailed);
+    }
+    return {};
+}
+
+TraceReader::TraceReader(int fd, TraceHeader header, std::vector<std::byte> pending) noexcept
+    : fd_(fd),
+      header_(std::move(header)),
+      remaining_(header_.migration_count),
+      buffer_(std::move(pending))
+{
+}
+
+TraceReader::~TraceReader()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+TraceReader::TraceReader(TraceReader&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)),
+      header_(std::move(other.header_)),
+      remaining_(std::exchange(other.remaining_, 0)),
+      buffer_(std::move(other.buffer_)),
+      buffer_pos_(std::exchange(other.buffer_pos_, 0))
+{
+}
+
+auto TraceReader::operator=(TraceReader&& other) noexcept -> TraceReader&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+    fd_ = std::exchange(other.fd_, -1);
+    header_ = std::move(other.header_);
+    remaining_ = std::exchange(other.remaining_, 0);
+    buffer_ = std::move(other.buffer_);
+    buffer_pos_ = std::exchange(other.buffer_pos_, 0);
+    return *this;
+}
+
+auto TraceReader::open(const std::string& path) -> std::expected<TraceReader, TraceError>
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::unexpected(TraceError::kOpenFailed);
+    }
+
+    // Read until the data marker; bytes after it are the first records
+    std::string text;
+    std::array<char, 4096> chunk{};
+    std::size_t marker = std::string::npos;
+    while (marker == std::string::npos && text.size() < kMaxHeaderBytes)
+    {
+        ssize_t bytes_read = ::read(fd, chunk.data(), chunk.size());
+        if (bytes_read <= 0)
+        {
+            break;
+        }
+        auto search_from = text.size() > kDataMarker.size() ? text.size() - kDataMarker.size() : 0;
+        text.append(chunk.data(), static_cast<std::size_t>(bytes_read));
+
+        auto found = text.find(kDataMarker, search_from);
+        while (found != std::string::npos && found != 0 && text[found - 1] != '\n')
+        {
+            found = text.find(kDataMarker, found + 1);
+        }
+        marker = found;
+    }
+
+    if (marker == std::string::npos)
+    {
+        close(fd);
+        return std::unexpected(TraceError::kParseError);
+    }
+
+    auto header = parseTraceHeader(std::string_view{text}.substr(0, marker));
+    if (!header)
+    {
+        close(fd);
+        return std::unexpected(header.error());
+    }
+
+    auto data_start = marker + kDataMarker.size();
+    auto pending = std::as_bytes(std::span{text}.subspan(data_start));
+    return TraceReader{fd, std::move(*header), {pending.begin(), pending.end()}};
+}
+
+auto TraceReader::header() const noexcept -> const TraceHeader&
+{
+    return header_;
+}
+
+auto TraceReader::remaining() const noexcept -> std::uint64_t
+{
+    return remaining_;
+}
+
+auto TraceReader::read(std::span<core::MigrationEvent> out)
+    -> std::expected<std::size_t, TraceError>
+{
+    auto count = static_cast<std::size_t>(std::min<std::uint64_t>(out.size(), remaining_));
+    auto needed = count * kTraceRecordSize;
+
+    // Top up the buffer so it holds every requested record
+    auto buffered = buffer_.size() - buffer_pos_;
+    if (buffered < needed)
+    {
+        buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(buffer_pos_));
+        buffer_pos_ = 0;
+        buffer_.resize(needed);
+        while (buffered < needed)
+        {
+            ssize_t bytes_read = ::read(fd_, buffer_.data() + buffered, needed - buffered);
+            if (bytes_read <= 0)
+            {
+                buffer_.resize(buffered);
+                return std::unexpected(TraceError::kReadFailed);
+            }
+            buffered += static_cast<std::size_t>(bytes_read);
+        }
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        out[i] = decodeRecord(buffer_.data() + buffer_pos_ + (i * kTraceRecordSize));
+    }
+    buffer_pos_ += needed;
+    remaining_ -= count;
+    return count;
+}
+
+}  // namespace threveal::analysis
@@ -7,12 +7,38 @@
 
 #include "threveal/collection/ebpf_loader.hpp"
 
+#include "threveal/collection/thread_activity.hpp"
+#include "threveal/core/clock.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <bpf/bpf.h>
 #include <bpf/libbpf.h>
 #include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <expected>
+#include <fcntl.h>
+#include <filesystem>
+#include <linux/magic.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
 #include <utility>
+#include <vector>
 
 // Suppress warnings from auto-generated skeleton code
 #pragma GCC diagnostic push
@@ -21,79 +47,282 @@
 #include "migration_tracker.skel.h"
 #pragma GCC diagnostic pop
 
+// Shared BPF structures
+#include "bpf_common.h"
+
 namespace threveal::collection
 {
 
 namespace
 {
 
-auto errnoToEbpfError(int err) -> EbpfError
-{
-    // libbpf returns negative errno values
-    int abs_err = (err < 0) ? -err : err;
+/**
+ *  Pin name of the tracepoint link inside the version directory.
+ */
+constexpr std::string_view kLinkPinName = "link";
 
-    if (abs_err == EPERM || abs_err == EACCES)
+/**
+ *  Kernel BTF, which both CO-RE relocation and tp_btf attachment need.
+ */
+constexpr const char* kKernelBtfPath = "/sys/kernel/btf/vmlinux";
+
+/**
+ *  Benchmark runs between ring drains; well below what one ring holds.
+ */
+constexpr std::uint64_t kBenchmarkDrainInterval = 256;
+
+/**
+ *  Bytes requested per read() of a task iterator.
+ */
+constexpr std::size_t kIterReadBytes = 64 * sizeof(thread_state);
+
+/**
+ *  Scale of thread_state::tokens; one token is 1e9 units.
+ */
+constexpr double kTokenUnits = 1e9;
+
+/**
+ *  Mixed into the object hash; bump when the pin directory layout changes.
+ */
+constexpr std::uint64_t kPinLayoutVersion = 1;
+
+constexpr std::uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+constexpr std::uint64_t kFnvPrime = 1099511628211ULL;
+
+auto fnv1a(std::uint64_t hash, std::span<const std::byte> bytes) noexcept -> std::uint64_t
+{
+    for (std::byte byte : bytes)
     {
-        return EbpfError::kPermissionDenied;
+        hash ^= static_cast<std::uint64_t>(byte);
+        hash *= kFnvPrime;
     }
-    return EbpfError::kLoadFailed;
+    return hash;
 }
 
-}  // namespace
+auto versionDirectoryName(std::uint64_t hash) -> std::string
+{
+    constexpr int kHexBase = 16;
+    std::array<char, 2 * sizeof(hash)> digits{};
+    auto [end, ec] = std::to_chars(digits.data(), digits.data() + digits.size(), hash, kHexBase);
+    return std::string(digits.data(), end);
+}
+
+auto linkPinPath(const std::string& pin_dir) -> std::string
+{
+    std::string path = pin_dir;
+    path += '/';
+    path += kLinkPinName;
+    return path;
+}
 
-EbpfLoader::EbpfLoader(migration_tracker_bpf* skel) noexcept : skel_(skel) {}
+auto isBpfFs(const std::string& path) -> bool
+{
+    struct statfs info{};
+    return statfs(path.c_str(), &info) == 0 &&
+           info.f_type == static_cast<decltype(info.f_type)>(BPF_FS_MAGIC);
+}
 
-EbpfLoader::~EbpfLoader()
+auto ensureDirectory(const std::string& path) -> bool
 {
-    if (skel_ == nullptr)
+    constexpr mode_t kOwnerOnly = 0700;
+    return mkdir(path.c_str(), kOwnerOnly) == 0 || errno == EEXIST;
+}
+
+/**
+ *  Removes pins left by other versions of the BPF object.
+ */
+auto removeStaleVersions(const std::filesystem::path& pin_root, std::string_view keep) -> bool
+{
+    std::error_code ec;
+    std::vector<std::filesystem::path> stale;
+    for (std::filesystem::directory_iterator it(pin_root, ec), end; !ec && it != end;
+         it.increment(ec))
     {
-        return;
+        if (it->path().filename() != keep)
+        {
+            stale.push_back(it->path());
+        }
     }
 
-    if (attached_)
+    for (const auto& path : stale)
     {
-        detach();
+        if (!ec)
+        {
+            std::filesystem::remove_all(path, ec);
+        }
     }
+    return !ec;
+}
 
-    migration_tracker_bpf__destroy(skel_);
-    skel_ = nullptr;
+/**
+ *  Points every map at its pin path; libbpf reuses compatible pins on load
+ *  and pins the rest.
+ */
+auto setMapPinPaths(bpf_object* obj, const std::string& pin_dir) -> bool
+{
+    bpf_map* map = nullptr;
+    bpf_object__for_each_map(map, obj)
+    {
+        auto path = pin_dir + "/" + bpf_map__name(map);
+        if (bpf_map__set_pin_path(map, path.c_str()) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-EbpfLoader::EbpfLoader(EbpfLoader&& other) noexcept
-    : skel_(std::exchange(other.skel_, nullptr)), attached_(std::exchange(other.attached_, false))
+void closeAll(std::vector<int>& fds) noexcept
 {
+    for (int fd : fds)
+    {
+        close(fd);
+    }
+    fds.clear();
 }
 
-auto EbpfLoader::operator=(EbpfLoader&& other) noexcept -> EbpfLoader&
+/**
+ *  Fills event_shards with one ring buffer per shard and enables sharding.
+ *
+ *  Rings already present (pinned from an earlier run) are reused so their
+ *  unread events are kept.
+ */
+auto setupRingShards(migration_tracker_bpf* skel, std::uint32_t shards)
+    -> std::expected<std::vector<int>, EbpfError>
 {
-    if (this == &other)
+    int outer_fd = bpf_map__fd(skel->maps.event_shards);
+    int config_fd = bpf_map__fd(skel->maps.migration_config);
+    if (outer_fd < 0 || config_fd < 0)
     {
-        return *this;
+        return std::unexpected(EbpfError::kMapAccessFailed);
     }
 
-    // Clean up current resources
-    if (skel_ != nullptr)
+    std::vector<int> fds;
+    fds.reserve(shards);
+    for (std::uint32_t shard = 0; shard < shards; ++shard)
     {
-        if (attached_)
+        std::uint32_t map_id = 0;
+        int fd = -1;
+        if (bpf_map_lookup_elem(outer_fd, &shard, &map_id) == 0)
+        {
+            fd = bpf_map_get_fd_by_id(map_id);
+        }
+        if (fd < 0)
+        {
+            fd = bpf_map_create(BPF_MAP_TYPE_RINGBUF, "event_shard", 0, 0, RING_SHARD_BYTES,
+                                nullptr);
+            if (fd >= 0 && bpf_map_update_elem(outer_fd, &shard, &fd, BPF_ANY) != 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+        if (fd < 0)
         {
-            detach();
+            closeAll(fds);
+            return std::unexpected(EbpfError::kMapAccessFailed);
         }
-        migration_tracker_bpf__destroy(skel_);
+        fds.push_back(fd);
     }
 
-    // Take ownership
-    skel_ = std::exchange(other.skel_, nullptr);
-    attached_ = std::exchange(other.attached_, false);
+    // Publish the shard count last, once every ring it selects exists
+    std::uint32_t key = CONFIG_RING_SHARDS;
+    if (bpf_map_update_elem(config_fd, &key, &shards, BPF_ANY) != 0)
+    {
+        closeAll(fds);
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
 
-    return *this;
+    return fds;
+}
+
+auto errnoToEbpfError(int err) -> EbpfError
+{
+    // libbpf returns negative errno values
+    int abs_err = (err < 0) ? -err : err;
+
+    if (abs_err == EPERM || abs_err == EACCES)
+    {
+        return EbpfError::kPermissionDenied;
+    }
+    return EbpfError::kLoadFailed;
+}
+
+/**
+ *  A handler and the skeleton slot holding its link.
+ */
+struct Handler
+{
+    bpf_program* program;
+    bpf_link** link;
+};
+
+/**
+ *  Returns the thread lifecycle and activity handlers.
+ *
+ *  They are never pinned, so every process that uses the object attaches
+ *  them itself, also when the migration handler's link is reused.
+ */
+auto unpinnedHandlers(migration_tracker_bpf* skel) -> std::array<Handler, 5>
+{
+    return {{
+        {skel->progs.handle_sched_process_fork, &skel->links.handle_sched_process_fork},
+        {skel->progs.handle_sched_process_exec, &skel->links.handle_sched_process_exec},
+        {skel->progs.handle_sched_process_exit, &skel->links.handle_sched_process_exit},
+        {skel->progs.handle_task_rename, &skel->links.handle_task_rename},
+        {skel->progs.handle_sched_switch, &skel->links.handle_sched_switch},
+    }};
+}
+
+/**
+ *  Destroys the lifecycle and activity links this process holds.
+ */
+void detachUnpinned(migration_tracker_bpf* skel) noexcept
+{
+    for (auto handler : unpinnedHandlers(skel))
+    {
+        bpf_link__destroy(std::exchange(*handler.link, nullptr));
+    }
+}
+
+/**
+ *  Attaches every loaded lifecycle and activity handler.
+ *
+ *  Either all of them are attached or, on failure, none.
+ */
+auto attachUnpinned(migration_tracker_bpf* skel) -> std::expected<void, EbpfError>
+{
+    for (auto handler : unpinnedHandlers(skel))
+    {
+        if (bpf_program__fd(handler.program) < 0 || *handler.link != nullptr)
+        {
+            continue;
+        }
+
+        *handler.link = bpf_program__attach(handler.program);
+        if (*handler.link == nullptr)
+        {
+            int err = errno;
+            detachUnpinned(skel);
+            return std::unexpected(errnoToEbpfError(err));
+        }
+    }
+    return {};
 }
 
-auto EbpfLoader::create() -> std::expected<EbpfLoader, EbpfError>
+/**
+ *  Opens the object and loads it with the migration handler enabled, or
+ *  without it when a pinned link already runs it. The lifecycle handlers
+ *  are loaded either way.
+ */
+auto loadSkeleton(const std::string& pin_dir, bool reuse_link, bool track_activity,
+                  bool benchmark)
+    -> std::expected<migration_tracker_bpf*, EbpfError>
 {
     // Configure options with explicit BTF path for older libbpf versions
     bpf_object_open_opts open_opts{};
     open_opts.sz = sizeof(open_opts);
-    open_opts.btf_custom_path = "/sys/kernel/btf/vmlinux";
+    open_opts.btf_custom_path = kKernelBtfPath;
 
     // Open the BPF object with explicit BTF path
     migration_tracker_bpf* skel = migration_tracker_bpf__open_opts(&open_opts);
@@ -106,6 +335,36 @@ auto EbpfLoader::create() -> std::expected<EbpfLoader, EbpfError>
         return std::unexpected(EbpfError::kOpenFailed);
     }
 
+    if (!pin_dir.empty() && !setMapPinPaths(skel->obj, pin_dir))
+    {
+        migration_tracker_bpf__destroy(skel);
+        return std::unexpected(EbpfError::kPinFailed);
+    }
+
+    // The activity flags belong to this process and are never pinned.
+    // Unless tracking is requested, the map shrinks to one entry and
+    // handle_sched_switch is not loaded
+    if (bpf_map__set_pin_path(skel->maps.thread_activity, nullptr) != 0 ||
+        (!track_activity && bpf_map__set_max_entries(skel->maps.thread_activity, 1) != 0))
+    {
+        migration_tracker_bpf__destroy(skel);
+        return std::unexpected(EbpfError::kOpenFailed);
+    }
+    bpf_program__set_autoload(skel->progs.handle_sched_switch, track_activity);
+
+    // A reused link already runs a verified handler
+    bpf_program__set_autoload(skel->progs.handle_sched_migrate_task_btf, !reuse_link);
+
+    // The benchmark harness is only ever test-run
+    bpf_program__set_autoload(skel->progs.bench_sched_migrate_task, benchmark);
+    bpf_program__set_autoattach(skel->progs.bench_sched_migrate_task, false);
+
+    // Iterators get a short-lived link per read instead
+    bpf_program__set_autoattach(skel->progs.dump_thread_states, false);
+    bpf_program__set_autoattach(skel->progs.drain_suppressed, false);
+    bpf_program__set_autoattach(skel->progs.sync_thread_activity, false);
+    bpf_program__set_autoattach(skel->progs.reset_comm_sent, false);
+
     // Load the BPF program into the kernel
     int err = migration_tracker_bpf__load(skel);
     if (err != 0)
@@ -113,83 +372,879 @@ auto EbpfLoader::create() -> std::expected<EbpfLoader, EbpfError>
         migration_tracker_bpf__destroy(skel);
         return std::unexpected(errnoToEbpfError(err));
     }
+    return skel;
+}
+
+/**
+ *  Run count and total run time the kernel has accounted to a program.
+ */
+struct ProgramRunTime
+{
+    std::uint64_t runs{0};
+    std::uint64_t run_time_ns{0};
+};
+
+auto readRunTime(int prog_fd) -> std::expected<ProgramRunTime, EbpfError>
+{
+    bpf_prog_info info{};
+    std::uint32_t length = sizeof(info);
+    if (bpf_obj_get_info_by_fd(prog_fd, &info, &length) != 0)
+    {
+        return std::unexpected(errnoToEbpfError(errno));
+    }
+    return ProgramRunTime{info.run_cnt, info.run_time_ns};
+}
 
-    return EbpfLoader{skel};
+auto discardSample(void* /*ctx*/, void* /*data*/, std::size_t /*size*/) -> int
+{
+    return 0;
 }
 
-auto EbpfLoader::attach() -> std::expected<void, EbpfError>
+/**
+ *  Runs a task iterator and returns the thread_state records it wrote.
+ */
+auto readThreadStates(bpf_program* iterator) -> std::expected<std::vector<thread_state>, EbpfError>
 {
-    if (skel_ == nullptr)
+    bpf_link* link = bpf_program__attach_iter(iterator, nullptr);
+    if (link == nullptr)
     {
-        return std::unexpected(EbpfError::kInvalidState);
+        return std::unexpected((errno == EPERM || errno == EACCES) ? EbpfError::kPermissionDenied
+                                                                   : EbpfError::kAttachFailed);
     }
 
-    if (attached_)
+    int iter_fd = bpf_iter_create(bpf_link__fd(link));
+    if (iter_fd < 0)
     {
-        return {};
+        bpf_link__destroy(link);
+        return std::unexpected(errnoToEbpfError(iter_fd));
     }
 
-    int err = migration_tracker_bpf__attach(skel_);
-    if (err != 0)
+    // A read may end inside a record, so collect the whole stream first
+    std::vector<std::byte> bytes;
+    ssize_t bytes_read = 0;
+    do
     {
-        return std::unexpected(errnoToEbpfError(err));
+        auto size = bytes.size();
+        bytes.resize(size + kIterReadBytes);
+        bytes_read = read(iter_fd, bytes.data() + size, kIterReadBytes);
+        bytes.resize(size + static_cast<std::size_t>(std::max<ssize_t>(bytes_read, 0)));
+    } while (bytes_read > 0);
+
+    close(iter_fd);
+    bpf_link__destroy(link);
+    if (bytes_read < 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
     }
 
-    attached_ = true;
-    return {};
+    std::vector<thread_state> states(bytes.size() / sizeof(thread_state));
+    std::memcpy(states.data(), bytes.data(), states.size() * sizeof(thread_state));
+    return states;
 }
 
-void EbpfLoader::detach() noexcept
+/**
+ *  Runs a task iterator that updates in-kernel state and writes nothing.
+ */
+auto runTaskIterator(bpf_program* iterator) -> std::expected<void, EbpfError>
 {
-    if (skel_ == nullptr || !attached_)
+    auto records = readThreadStates(iterator);
+    if (!records)
     {
-        return;
+        return std::unexpected(records.error());
     }
-
-    migration_tracker_bpf__detach(skel_);
-    attached_ = false;
+    return {};
 }
 
-auto EbpfLoader::setTargetPid(std::uint32_t pid) -> std::expected<void, EbpfError>
+/**
+ *  Marks every thread covered by the activity blocks as on a CPU.
+ */
+void markAllOnCpu(thread_activity_block* blocks, std::size_t block_count) noexcept
 {
-    if (skel_ == nullptr)
+    for (std::size_t index = 0; index < block_count; ++index)
     {
-        return std::unexpected(EbpfError::kInvalidState);
+        for (auto& on_cpu : blocks[index].on_cpu)
+        {
+            std::atomic_ref<std::uint8_t>(on_cpu).store(1, std::memory_order_relaxed);
+        }
     }
+}
 
-    int map_fd = bpf_map__fd(skel_->maps.migration_config);
-    if (map_fd < 0)
+/**
+ *  Opens a pidfd for any thread, which is how userspace keys task-local
+ *  storage.
+ */
+auto openThreadPidfd(std::uint32_t tid) -> int
+{
+    auto pid = static_cast<pid_t>(tid);
+    int fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0U));
+
+    // Threads other than the leader need PIDFD_THREAD (O_EXCL, Linux 6.9+)
+    if (fd < 0 && errno == EINVAL)
     {
-        return std::unexpected(EbpfError::kMapAccessFailed);
+        fd = static_cast<int>(syscall(SYS_pidfd_open, pid, static_cast<unsigned int>(O_EXCL)));
     }
+    return fd;
+}
 
-    std::uint32_t key = 0;
-    int err = bpf_map_update_elem(map_fd, &key, &pid, BPF_ANY);
-    if (err != 0)
+}  // namespace
+
+EbpfLoader::EbpfLoader(migration_tracker_bpf* skel, std::string pin_dir, int pinned_link_fd,
+                       std::vector<int> shard_fds, core::ClockSource clock) noexcept
+    : skel_(skel),
+      pin_dir_(std::move(pin_dir)),
+      pinned_link_fd_(pinned_link_fd),
+      shard_fds_(std::move(shard_fds)),
+      clock_(clock),
+      reused_pins_(pinned_link_fd >= 0)
+{
+}
+
+EbpfLoader::~EbpfLoader()
+{
+    reset();
+}
+
+EbpfLoader::EbpfLoader(EbpfLoader&& other) noexcept
+    : skel_(std::exchange(other.skel_, nullptr)),
+      pin_dir_(std::move(other.pin_dir_)),
+      pinned_link_fd_(std::exchange(other.pinned_link_fd_, -1)),
+      shard_fds_(std::move(other.shard_fds_)),
+      clock_(other.clock_),
+      activity_(std::exchange(other.activity_, nullptr)),
+      activity_bytes_(std::exchange(other.activity_bytes_, 0)),
+      reused_pins_(std::exchange(other.reused_pins_, false)),
+      attached_(std::exchange(other.attached_, false))
+{
+    other.pin_dir_.clear();
+    other.shard_fds_.clear();
+}
+
+auto EbpfLoader::operator=(EbpfLoader&& other) noexcept -> EbpfLoader&
+{
+    if (this == &other)
     {
-        return std::unexpected(EbpfError::kMapAccessFailed);
+        return *this;
     }
 
-    return {};
+    // Clean up current resources
+    reset();
+
+    // Take ownership
+    skel_ = std::exchange(other.skel_, nullptr);
+    pin_dir_ = std::move(other.pin_dir_);
+    pinned_link_fd_ = std::exchange(other.pinned_link_fd_, -1);
+    shard_fds_ = std::move(other.shard_fds_);
+    clock_ = other.clock_;
+    activity_ = std::exchange(other.activity_, nullptr);
+    activity_bytes_ = std::exchange(other.activity_bytes_, 0);
+    reused_pins_ = std::exchange(other.reused_pins_, false);
+    attached_ = std::exchange(other.attached_, false);
+    other.pin_dir_.clear();
+    other.shard_fds_.clear();
+
+    return *this;
 }
 
-auto EbpfLoader::ringBufferFd() const noexcept -> int
+void EbpfLoader::reset() noexcept
 {
     if (skel_ == nullptr)
     {
-        return -1;
+        return;
     }
-    return bpf_map__fd(skel_->maps.events);
-}
 
-auto EbpfLoader::isAttached() const noexcept -> bool
-{
-    return skel_ != nullptr && attached_;
+    if (attached_)
+    {
+        detach();
+    }
+    if (pinned_link_fd_ >= 0)
+    {
+        close(pinned_link_fd_);
+        pinned_link_fd_ = -1;
+    }
+
+    if (activity_ != nullptr)
+    {
+        munmap(activity_, activity_bytes_);
+        activity_ = nullptr;
+        activity_bytes_ = 0;
+    }
+
+    closeAll(shard_fds_);
+    migration_tracker_bpf__destroy(skel_);
+    skel_ = nullptr;
+    pin_dir_.clear();
+    reused_pins_ = false;
 }
 
-auto EbpfLoader::isValid() const noexcept -> bool
+auto EbpfLoader::create(const EbpfLoaderOptions& options) -> std::expected<EbpfLoader, EbpfError>
 {
-    return skel_ != nullptr;
+    if (options.ring_shards > kMaxRingShards)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    // Prepare the versioned pin directory before paying for the object open
+    std::string pin_dir;
+    if (options.pinned)
+    {
+        auto version = versionDirectoryName(objectVersionHash());
+        pin_dir = options.pin_root + "/" + version;
+
+        if (!ensureDirectory(options.pin_root))
+        {
+            return std::unexpected((errno == EPERM || errno == EACCES)
+                                       ? EbpfError::kPermissionDenied
+                                       : EbpfError::kPinFailed);
+        }
+        if (!isBpfFs(options.pin_root) || !removeStaleVersions(options.pin_root, version) ||
+            !ensureDirectory(pin_dir))
+        {
+            return std::unexpected(EbpfError::kPinFailed);
+        }
+    }
+
+    // A live pinned link means the program is already verified and
+    // attached, so only the maps need to be reopened
+    int pinned_link_fd = -1;
+    if (!pin_dir.empty())
+    {
+        pinned_link_fd = bpf_obj_get(linkPinPath(pin_dir).c_str());
+    }
+
+    auto loaded = loadSkeleton(pin_dir, pinned_link_fd >= 0, options.track_activity,
+                               options.benchmark);
+    if (!loaded)
+    {
+        if (pinned_link_fd >= 0)
+        {
+            close(pinned_link_fd);
+        }
+        return std::unexpected(loaded.error());
+    }
+    migration_tracker_bpf* skel = *loaded;
+
+    // Always written so a pinned config from a sharded run is reset
+    auto shards = setupRingShards(skel, options.ring_shards);
+    if (!shards)
+    {
+        if (pinned_link_fd >= 0)
+        {
+            close(pinned_link_fd);
+        }
+        migration_tracker_bpf__destroy(skel);
+        return std::unexpected(shards.error());
+    }
+
+    // Timestamps must come from the clock every other collector reads
+    auto clock = core::traceClock();
+    auto clock_value = static_cast<std::uint32_t>(clock);
+    std::uint32_t key = CONFIG_CLOCK_SOURCE;
+    if (bpf_map_update_elem(bpf_map__fd(skel->maps.migration_config), &key, &clock_value,
+                            BPF_ANY) != 0)
+    {
+        closeAll(*shards);
+        if (pinned_link_fd >= 0)
+        {
+            close(pinned_link_fd);
+        }
+        migration_tracker_bpf__destroy(skel);
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    EbpfLoader loader{skel, std::move(pin_dir), pinned_link_fd, std::move(*shards), clock};
+
+    // Pinned thread states may record identities sent to an earlier
+    // run's decoder; this run's decoder has to be sent them again
+    if (loader.isPinned())
+    {
+        auto reset = runTaskIterator(skel->progs.reset_comm_sent);
+        if (!reset)
+        {
+            return std::unexpected(reset.error());
+        }
+    }
+
+    // A reused link is already running; attach the hooks that go with it
+    if (loader.reused_pins_)
+    {
+        auto attached = loader.attach();
+        if (!attached)
+        {
+            return std::unexpected(attached.error());
+        }
+    }
+    return loader;
+}
+
+auto EbpfLoader::objectVersionHash() noexcept -> std::uint64_t
+{
+    std::size_t size = 0;
+    const void* elf = migration_tracker_bpf__elf_bytes(&size);
+
+    auto hash = fnv1a(kFnvOffsetBasis, std::as_bytes(std::span{&kPinLayoutVersion, 1}));
+    return fnv1a(hash, std::span{static_cast<const std::byte*>(elf), size});
+}
+
+auto EbpfLoader::unpinAll(std::string_view pin_root) -> std::expected<void, EbpfError>
+{
+    std::string root(pin_root);
+
+    // Refuse anything outside bpffs so a bad path cannot delete regular files
+    std::error_code ec;
+    if (!std::filesystem::exists(root, ec))
+    {
+        return {};
+    }
+    if (!isBpfFs(root))
+    {
+        return std::unexpected(EbpfError::kPinFailed);
+    }
+
+    std::filesystem::remove_all(root, ec);
+    if (ec)
+    {
+        return std::unexpected((ec == std::errc::permission_denied ||
+                                ec == std::errc::operation_not_permitted)
+                                   ? EbpfError::kPermissionDenied
+                                   : EbpfError::kPinFailed);
+    }
+    return {};
+}
+
+auto EbpfLoader::attach() -> std::expected<void, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    if (attached_)
+    {
+        return {};
+    }
+
+    if (!pin_dir_.empty() && pinned_link_fd_ < 0)
+    {
+        // The attachment may still be pinned from an earlier attach()
+        pinned_link_fd_ = bpf_obj_get(linkPinPath(pin_dir_).c_str());
+
+        // The program was not loaded because a pinned link existed, and
+        // that link has since been removed
+        if (pinned_link_fd_ < 0 && reused_pins_)
+        {
+            return std::unexpected(EbpfError::kAttachFailed);
+        }
+    }
+
+    // The lifecycle and activity hooks are not pinned, so they are
+    // attached again even when the migration handler's link is reused
+    auto unpinned = attachUnpinned(skel_);
+    if (!unpinned)
+    {
+        return std::unexpected(unpinned.error());
+    }
+
+    // Threads may have run while the activity handler was not attached
+    if (skel_->links.handle_sched_switch != nullptr)
+    {
+        auto synced = runTaskIterator(skel_->progs.sync_thread_activity);
+        if (!synced)
+        {
+            detachUnpinned(skel_);
+            return std::unexpected(synced.error());
+        }
+    }
+
+    if (pinned_link_fd_ < 0)
+    {
+        bpf_link* link = bpf_program__attach(skel_->progs.handle_sched_migrate_task_btf);
+        if (link == nullptr)
+        {
+            int err = errno;
+            detachUnpinned(skel_);
+            return std::unexpected(errnoToEbpfError(err));
+        }
+        skel_->links.handle_sched_migrate_task_btf = link;
+
+        if (!pin_dir_.empty() && bpf_link__pin(link, linkPinPath(pin_dir_).c_str()) != 0)
+        {
+            bpf_link__destroy(std::exchange(skel_->links.handle_sched_migrate_task_btf, nullptr));
+            detachUnpinned(skel_);
+            return std::unexpected(EbpfError::kPinFailed);
+        }
+    }
+
+    attached_ = true;
+    return {};
+}
+
+void EbpfLoader::detach() noexcept
+{
+    if (skel_ == nullptr || !attached_)
+    {
+        return;
+    }
+
+    bpf_link*& link = skel_->links.handle_sched_migrate_task_btf;
+    if (!pin_dir_.empty())
+    {
+        // Drop our handles only; the pin keeps the handler attached
+        if (pinned_link_fd_ >= 0)
+        {
+            close(pinned_link_fd_);
+            pinned_link_fd_ = -1;
+        }
+        if (link != nullptr)
+        {
+            bpf_link__disconnect(link);
+        }
+    }
+    bpf_link__destroy(std::exchange(link, nullptr));
+
+    // Lifecycle and activity hooks end with this process in either mode
+    detachUnpinned(skel_);
+
+    // Nothing updates the activity flags until the next attach(), so
+    // views report every thread as running meanwhile
+    if (threadActivity())
+    {
+        markAllOnCpu(static_cast<thread_activity_block*>(activity_),
+                     bpf_map__max_entries(skel_->maps.thread_activity));
+    }
+    attached_ = false;
+}
+
+auto EbpfLoader::setTargetPid(std::uint32_t pid) -> std::expected<void, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    int map_fd = bpf_map__fd(skel_->maps.migration_config);
+    if (map_fd < 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    std::uint32_t key = CONFIG_TARGET_PID;
+    int err = bpf_map_update_elem(map_fd, &key, &pid, BPF_ANY);
+    if (err != 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    return {};
+}
+
+auto EbpfLoader::setSampleRate(std::uint32_t rate) -> std::expected<void, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+    if (rate > kMaxSampleRate)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    int map_fd = bpf_map__fd(skel_->maps.migration_config);
+    if (map_fd < 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    std::uint32_t key = CONFIG_SAMPLE_RATE;
+    if (bpf_map_update_elem(map_fd, &key, &rate, BPF_ANY) != 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    return {};
+}
+
+auto EbpfLoader::setTgidSampleRate(std::uint32_t tgid, std::uint32_t rate)
+    -> std::expected<void, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+    if (rate > kMaxSampleRate)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    int map_fd = bpf_map__fd(skel_->maps.tgid_sample_rates);
+    if (map_fd < 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    if (rate == 0)
+    {
+        // Removing an override that was never set is not an error
+        if (bpf_map_delete_elem(map_fd, &tgid) != 0 && errno != ENOENT)
+        {
+            return std::unexpected(EbpfError::kMapAccessFailed);
+        }
+        return {};
+    }
+
+    if (bpf_map_update_elem(map_fd, &tgid, &rate, BPF_ANY) != 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    return {};
+}
+
+auto EbpfLoader::setThreadRateLimit(std::uint32_t events_per_sec, std::uint32_t burst)
+    -> std::expected<void, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    int map_fd = bpf_map__fd(skel_->maps.migration_config);
+    if (map_fd < 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    // Burst first, so the rate never applies with a stale capacity
+    std::uint32_t key = CONFIG_THREAD_BURST;
+    if (bpf_map_update_elem(map_fd, &key, &burst, BPF_ANY) != 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    key = CONFIG_THREAD_RATE;
+    if (bpf_map_update_elem(map_fd, &key, &events_per_sec, BPF_ANY) != 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    return {};
+}
+
+auto EbpfLoader::collectSuppressed()
+    -> std::expected<std::vector<core::SuppressionSummary>, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    auto now = core::readClockNs(clock_);
+
+    // The iterator resets each count it reports
+    auto states = readThreadStates(skel_->progs.drain_suppressed);
+    if (!states)
+    {
+        return std::unexpected(states.error());
+    }
+
+    std::vector<core::SuppressionSummary> summaries;
+    summaries.reserve(states->size());
+    for (const auto& state : *states)
+    {
+        summaries.push_back(core::SuppressionSummary{
+            .timestamp_ns = now,
+            .first_suppressed_ns = state.first_suppressed_ns,
+            .suppressed = state.suppressed,
+            .pid = state.pid,
+            .tid = state.tid,
+        });
+    }
+    return summaries;
+}
+
+auto EbpfLoader::threadStates() const -> std::expected<std::vector<ThreadState>, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    auto states = readThreadStates(skel_->progs.dump_thread_states);
+    if (!states)
+    {
+        return std::unexpected(states.error());
+    }
+
+    std::vector<ThreadState> threads;
+    threads.reserve(states->size());
+    for (const auto& state : *states)
+    {
+        threads.push_back(ThreadState{
+            .pid = state.pid,
+            .tid = state.tid,
+            .last_cpu = state.last_cpu,
+            .last_migration_ns = state.last_migration_ns,
+            .tokens = static_cast<double>(state.tokens) / kTokenUnits,
+            .suppressed = state.suppressed,
+            .phase = state.phase,
+            .comm_sent = (state.flags & THREAD_COMM_SENT) != 0,
+        });
+    }
+    return threads;
+}
+
+auto EbpfLoader::setThreadPhase(std::uint32_t tid, std::uint32_t phase)
+    -> std::expected<void, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    int map_fd = bpf_map__fd(skel_->maps.thread_states);
+    if (map_fd < 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    int pidfd = openThreadPidfd(tid);
+    if (pidfd < 0)
+    {
+        return std::unexpected(errno == ESRCH ? EbpfError::kInvalidState
+                                              : errnoToEbpfError(errno));
+    }
+
+    // Read-modify-write: a migration racing with the update may lose one
+    // token bucket refill, which only matters to that one thread
+    thread_state state{};
+    if (bpf_map_lookup_elem(map_fd, &pidfd, &state) != 0)
+    {
+        state = thread_state{};
+    }
+    state.phase = phase;
+    int err = bpf_map_update_elem(map_fd, &pidfd, &state, BPF_ANY);
+    close(pidfd);
+
+    if (err != 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+    return {};
+}
+
+auto EbpfLoader::setTopology(const core::TopologyMap& topology,
+                             core::TopologyGeneration generation) -> std::expected<void, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    int types_fd = bpf_map__fd(skel_->maps.cpu_core_types);
+    int config_fd = bpf_map__fd(skel_->maps.migration_config);
+    if (types_fd < 0 || config_fd < 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    // Rewrite every slot so offlined CPUs fall back to unknown; topology
+    // changes are rare enough that one update per CPU is acceptable
+    for (core::CpuId cpu = 0; cpu < MAX_TRACKED_CPUS; ++cpu)
+    {
+        auto type = static_cast<std::uint32_t>(
+            topology.getCoreType(cpu).value_or(core::CoreType::kUnknown));
+        if (bpf_map_update_elem(types_fd, &cpu, &type, BPF_ANY) != 0)
+        {
+            return std::unexpected(EbpfError::kMapAccessFailed);
+        }
+    }
+
+    std::uint32_t key = CONFIG_TOPOLOGY_GENERATION;
+    if (bpf_map_update_elem(config_fd, &key, &generation, BPF_ANY) != 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    return {};
+}
+
+auto EbpfLoader::threadActivity() -> std::expected<ThreadActivityMap, EbpfError>
+{
+    if (skel_ == nullptr || bpf_program__fd(skel_->progs.handle_sched_switch) < 0)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    std::size_t blocks = bpf_map__max_entries(skel_->maps.thread_activity);
+    if (activity_ == nullptr)
+    {
+        auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        auto bytes = (blocks * sizeof(thread_activity_block) + page - 1) / page * page;
+        void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            bpf_map__fd(skel_->maps.thread_activity), 0);
+        if (mapped == MAP_FAILED)
+        {
+            return std::unexpected(EbpfError::kMapAccessFailed);
+        }
+        activity_ = mapped;
+        activity_bytes_ = bytes;
+    }
+
+    return ThreadActivityMap{static_cast<thread_activity_block*>(activity_), blocks};
+}
+
+auto EbpfLoader::ringBufferFd() const noexcept -> int
+{
+    if (skel_ == nullptr)
+    {
+        return -1;
+    }
+    return bpf_map__fd(skel_->maps.events);
+}
+
+auto EbpfLoader::ringBufferFds() const -> std::vector<int>
+{
+    if (skel_ == nullptr)
+    {
+        return {};
+    }
+    if (!shard_fds_.empty())
+    {
+        return shard_fds_;
+    }
+    return {bpf_map__fd(skel_->maps.events)};
+}
+
+auto EbpfLoader::ringDrops() const -> std::expected<std::vector<std::uint64_t>, EbpfError>
+{
+    if (skel_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    int drops_fd = bpf_map__fd(skel_->maps.ring_drops);
+    if (drops_fd < 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    std::vector<std::uint64_t> drops(std::max<std::size_t>(shard_fds_.size(), 1), 0);
+    for (std::uint32_t ring = 0; ring < drops.size(); ++ring)
+    {
+        if (bpf_map_lookup_elem(drops_fd, &ring, &drops[ring]) != 0)
+        {
+            return std::unexpected(EbpfError::kMapAccessFailed);
+        }
+    }
+    return drops;
+}
+
+auto EbpfLoader::benchmarkProgram(std::uint64_t runs, std::uint32_t dest_cpu)
+    -> std::expected<ProgramBenchmark, EbpfError>
+{
+    // An attached handler would mix real migrations into the rings
+    int prog_fd = skel_ == nullptr ? -1 : bpf_program__fd(skel_->progs.bench_sched_migrate_task);
+    if (prog_fd < 0 || attached_)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    auto fds = ringBufferFds();
+    ring_buffer* rings = ring_buffer__new(fds.front(), discardSample, nullptr, nullptr);
+    for (std::size_t i = 1; rings != nullptr && i < fds.size(); ++i)
+    {
+        if (ring_buffer__add(rings, fds[i], discardSample, nullptr) != 0)
+        {
+            ring_buffer__free(rings);
+            rings = nullptr;
+        }
+    }
+    if (rings == nullptr)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    // Run times are only accounted while statistics are enabled
+    int stats_fd = bpf_enable_stats(BPF_STATS_RUN_TIME);
+    if (stats_fd < 0)
+    {
+        ring_buffer__free(rings);
+        return std::unexpected(errnoToEbpfError(stats_fd));
+    }
+
+    // The harness's only argument; the task is the calling thread
+    std::array<std::uint64_t, 1> args{dest_cpu};
+    bpf_test_run_opts run_opts{};
+    run_opts.sz = sizeof(run_opts);
+    run_opts.ctx_in = args.data();
+    run_opts.ctx_size_in = sizeof(args);
+
+    auto before = readRunTime(prog_fd);
+    auto start = std::chrono::steady_clock::now();
+    int err = 0;
+    for (std::uint64_t run = 0; before && err == 0 && run < runs; ++run)
+    {
+        err = bpf_prog_test_run_opts(prog_fd, &run_opts);
+        if ((run + 1) % kBenchmarkDrainInterval == 0)
+        {
+            ring_buffer__consume(rings);
+        }
+    }
+    auto wall_time = std::chrono::steady_clock::now() - start;
+    auto after = readRunTime(prog_fd);
+
+    ring_buffer__consume(rings);
+    ring_buffer__free(rings);
+    close(stats_fd);
+
+    if (!before)
+    {
+        return std::unexpected(before.error());
+    }
+    if (err != 0)
+    {
+        return std::unexpected(errnoToEbpfError(err));
+    }
+    if (!after)
+    {
+        return std::unexpected(after.error());
+    }
+
+    ProgramBenchmark result;
+    result.runs = after->runs - before->runs;
+    auto run_time_ns = after->run_time_ns - before->run_time_ns;
+    result.program_time = std::chrono::nanoseconds(static_cast<std::int64_t>(run_time_ns));
+    result.wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(wall_time);
+    return result;
+}
+
+auto EbpfLoader::isAttached() const noexcept -> bool
+{
+    return skel_ != nullptr && attached_;
+}
+
+auto EbpfLoader::isValid() const noexcept -> bool
+{
+    return skel_ != nullptr;
+}
+
+auto EbpfLoader::isPinned() const noexcept -> bool
+{
+    return !pin_dir_.empty();
+}
+
+auto EbpfLoader::reusedPins() const noexcept -> bool
+{
+    return reused_pins_;
+}
+
+auto EbpfLoader::pinDirectory() const noexcept -> const std::string&
+{
+    return pin_dir_;
+}
+
+auto EbpfLoader::clockSource() const noexcept -> core::ClockSource
+{
+    return clock_;
 }
 
 }  // namespace threveal::collection
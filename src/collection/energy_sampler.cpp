@@ -0,0 +1,437 @@
+/**
+ *  @file       energy_sampler.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of periodic RAPL energy sampling.
+ */
+
+#include "threveal/collection/energy_sampler.hpp"
+
+#include "threveal/core/clock.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace threveal::collection
+{
+
+namespace
+{
+
+/**
+ *  Powercap zone directory prefix for Intel RAPL.
+ */
+constexpr std::string_view kRaplZonePrefix = "intel-rapl:";
+
+/**
+ *  Reads a decimal counter from the start of an open sysfs file.
+ *
+ *  Uses pread at offset 0 so the same fd can be re-read every interval
+ *  without seeking or reopening.
+ *
+ *  @param      fd  Open file descriptor for a sysfs attribute.
+ *  @return     The parsed value, or EnergyError::kReadFailed.
+ */
+auto readCounter(int fd) -> std::expected<std::uint64_t, core::EnergyError>
+{
+    std::array<char, 32> buffer{};
+    ssize_t bytes_read = pread(fd, buffer.data(), buffer.size(), 0);
+    if (bytes_read <= 0)
+    {
+        return std::unexpected(errno == EACCES ? core::EnergyError::kPermissionDenied
+                                               : core::EnergyError::kReadFailed);
+    }
+
+    std::uint64_t value = 0;
+    const char* end = buffer.data() + bytes_read;
+    auto [ptr, ec] = std::from_chars(buffer.data(), end, value);
+    if (ec != std::errc{} || ptr == buffer.data())
+    {
+        return std::unexpected(core::EnergyError::kReadFailed);
+    }
+
+    return value;
+}
+
+/**
+ *  Opens a sysfs attribute read-only.
+ *
+ *  @param      path  Path to the attribute.
+ *  @return     The file descriptor, or EnergyError on failure.
+ */
+auto openAttribute(const std::filesystem::path& path) -> std::expected<int, core::EnergyError>
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == EACCES || errno == EPERM)
+        {
+            return std::unexpected(core::EnergyError::kPermissionDenied);
+        }
+        return std::unexpected(core::EnergyError::kPowercapNotFound);
+    }
+    return fd;
+}
+
+/**
+ *  Reads a one-shot sysfs attribute (name, max_energy_range_uj).
+ *
+ *  @param      path  Path to the attribute.
+ *  @return     The first line of the file, or EnergyError on failure.
+ */
+auto readAttribute(const std::filesystem::path& path)
+    -> std::expected<std::string, core::EnergyError>
+{
+    auto fd = openAttribute(path);
+    if (!fd)
+    {
+        return std::unexpected(fd.error());
+    }
+
+    std::array<char, 64> buffer{};
+    ssize_t bytes_read = pread(*fd, buffer.data(), buffer.size(), 0);
+    close(*fd);
+
+    if (bytes_read <= 0)
+    {
+        return std::unexpected(core::EnergyError::kReadFailed);
+    }
+
+    std::string_view content(buffer.data(), static_cast<std::size_t>(bytes_read));
+    auto newline = content.find('\n');
+    return std::string(content.substr(0, newline));
+}
+
+/**
+ *  Maps a powercap zone name to the domain it represents.
+ *
+ *  Package zones are named "package-N"; the PP0 subzone is named "core".
+ *  Other zones (uncore, dram, psys) are not tracked.
+ *
+ *  @param      name  Contents of the zone's name attribute.
+ *  @return     The domain, or std::nullopt if the zone is not tracked.
+ */
+auto domainForZoneName(std::string_view name) -> std::optional<EnergyDomain>
+{
+    if (name.starts_with("package-"))
+    {
+        return EnergyDomain::kPackage;
+    }
+    if (name == "core")
+    {
+        return EnergyDomain::kCores;
+    }
+    return std::nullopt;
+}
+
+/**
+ *  Computes the energy consumed between two counter readings.
+ *
+ *  energy_uj wraps to zero after max_energy_range_uj, which happens every
+ *  few minutes on a busy package.
+ */
+constexpr auto counterDelta(std::uint64_t previous, std::uint64_t current,
+                            std::uint64_t max_range) noexcept -> std::uint64_t
+{
+    if (current >= previous)
+    {
+        return current - previous;
+    }
+    return (max_range - previous) + current;
+}
+
+}  // namespace
+
+EnergySampler::EnergySampler(std::vector<Zone> zones, SampleCallback callback,
+                             std::chrono::microseconds interval) noexcept
+    : zones_(std::move(zones)), callback_(std::move(callback)), interval_(interval)
+{
+}
+
+EnergySampler::~EnergySampler()
+{
+    stop();
+    closeAll();
+}
+
+EnergySampler::EnergySampler(EnergySampler&& other) noexcept
+    : zones_(std::move(other.zones_)),
+      callback_(std::move(other.callback_)),
+      interval_(other.interval_),
+      sampling_thread_(std::move(other.sampling_thread_)),
+      sample_count_(other.sample_count_.load()),
+      running_(other.running_.load())
+{
+    other.zones_.clear();
+    other.sample_count_ = 0;
+    other.running_ = false;
+}
+
+auto EnergySampler::operator=(EnergySampler&& other) noexcept -> EnergySampler&
+{
+    if (this != &other)
+    {
+        stop();
+        closeAll();
+
+        zones_ = std::move(other.zones_);
+        callback_ = std::move(other.callback_);
+        interval_ = other.interval_;
+        sampling_thread_ = std::move(other.sampling_thread_);
+        sample_count_ = other.sample_count_.load();
+        running_ = other.running_.load();
+
+        other.zones_.clear();
+        other.sample_count_ = 0;
+        other.running_ = false;
+    }
+    return *this;
+}
+
+void EnergySampler::closeAll() noexcept
+{
+    for (auto& zone : zones_)
+    {
+        if (zone.fd >= 0)
+        {
+            close(zone.fd);
+            zone.fd = -1;
+        }
+    }
+    zones_.clear();
+}
+
+auto EnergySampler::create(SampleCallback callback, std::chrono::microseconds interval,
+                           std::string_view powercap_root)
+    -> std::expected<EnergySampler, core::EnergyError>
+{
+    namespace fs = std::filesystem;
+
+    if (!callback)
+    {
+        return std::unexpected(core::EnergyError::kInvalidState);
+    }
+
+    // Same floor as the PMU sampler; RAPL itself only updates every ~1ms
+    if (interval < PmuSampler::kMinInterval)
+    {
+        interval = PmuSampler::kMinInterval;
+    }
+
+    std::error_code ec;
+    auto dir_iter = fs::directory_iterator(fs::path(powercap_root), ec);
+    if (ec)
+    {
+        return std::unexpected(core::EnergyError::kPowercapNotFound);
+    }
+
+    std::vector<Zone> zones;
+    auto cleanup = [&zones]()
+    {
+        for (const auto& zone : zones)
+        {
+            close(zone.fd);
+        }
+    };
+
+    for (const auto& entry : dir_iter)
+    {
+        // Zones are symlinks into /sys/devices/virtual/powercap on real systems
+        auto dirname = entry.path().filename().string();
+        if (!dirname.starts_with(kRaplZonePrefix))
+        {
+            continue;
+        }
+
+        auto name = readAttribute(entry.path() / "name");
+        if (!name)
+        {
+            continue;
+        }
+
+        auto domain = domainForZoneName(*name);
+        if (!domain)
+        {
+            continue;
+        }
+
+        auto fd = openAttribute(entry.path() / "energy_uj");
+        if (!fd)
+        {
+            cleanup();
+            return std::unexpected(fd.error());
+        }
+
+        // Baseline reading; the first sample reports energy since create()
+        auto initial = readCounter(*fd);
+        if (!initial)
+        {
+            close(*fd);
+            cleanup();
+            return std::unexpected(initial.error());
+        }
+
+        // Without a range we cannot unwrap; assume the full 64-bit range
+        std::uint64_t max_range = std::numeric_limits<std::uint64_t>::max();
+        if (auto range = readAttribute(entry.path() / "max_energy_range_uj"))
+        {
+            std::from_chars(range->data(), range->data() + range->size(), max_range);
+        }
+
+        zones.push_back(Zone{
+            .domain = *domain,
+            .fd = *fd,
+            .max_range_uj = max_range,
+            .last_uj = *initial,
+        });
+    }
+
+    if (zones.empty())
+    {
+        return std::unexpected(core::EnergyError::kPowercapNotFound);
+    }
+
+    return EnergySampler{std::move(zones), std::move(callback), interval};
+}
+
+auto EnergySampler::start() -> std::expected<void, core::EnergyError>
+{
+    if (running_.load(std::memory_order_acquire) || zones_.empty())
+    {
+        return std::unexpected(core::EnergyError::kInvalidState);
+    }
+
+    // Re-baseline so the first sample covers only the first interval
+    auto baseline = collectSample();
+    if (!baseline)
+    {
+        return std::unexpected(baseline.error());
+    }
+
+    sample_count_.store(0, std::memory_order_relaxed);
+    running_.store(true, std::memory_order_release);
+
+    sampling_thread_ = std::jthread(
+        [this](const std::stop_token& stop_token)
+        {
+            samplingLoop(stop_token);
+        });
+
+    return {};
+}
+
+void EnergySampler::stop() noexcept
+{
+    if (!running_.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    if (sampling_thread_.joinable())
+    {
+        sampling_thread_.request_stop();
+        sampling_thread_.join();
+    }
+
+    running_.store(false, std::memory_order_release);
+}
+
+auto EnergySampler::collectSample() -> std::expected<core::EnergySample, core::EnergyError>
+{
+    if (zones_.empty())
+    {
+        return std::unexpected(core::EnergyError::kInvalidState);
+    }
+
+    core::EnergySample sample{
+        .timestamp_ns = core::traceTimestampNs(),
+        .package_energy_uj = 0,
+        .cores_energy_uj = 0,
+    };
+
+    // Multi-socket systems have one package zone per socket; sum them
+    for (auto& zone : zones_)
+    {
+        auto current = readCounter(zone.fd);
+        if (!current)
+        {
+            return std::unexpected(current.error());
+        }
+
+        auto delta = counterDelta(zone.last_uj, *current, zone.max_range_uj);
+        zone.last_uj = *current;
+
+        if (zone.domain == EnergyDomain::kPackage)
+        {
+            sample.package_energy_uj += delta;
+        }
+        else
+        {
+            sample.cores_energy_uj += delta;
+        }
+    }
+
+    return sample;
+}
+
+auto EnergySampler::hasDomain(EnergyDomain domain) const noexcept -> bool
+{
+    return std::ranges::any_of(zones_,
+                               [domain](const Zone& zone)
+                               {
+                                   return zone.domain == domain;
+                               });
+}
+
+auto EnergySampler::isRunning() const noexcept -> bool
+{
+    return running_.load(std::memory_order_acquire);
+}
+
+auto EnergySampler::sampleCount() const noexcept -> std::uint64_t
+{
+    return sample_count_.load(std::memory_order_relaxed);
+}
+
+auto EnergySampler::interval() const noexcept -> std::chrono::microseconds
+{
+    return interval_;
+}
+
+void EnergySampler::samplingLoop(const std::stop_token& stop_token)
+{
+    while (!stop_token.stop_requested())
+    {
+        std::this_thread::sleep_for(interval_);
+
+        auto sample = collectSample();
+        if (sample)
+        {
+            callback_(*sample);
+            sample_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+}  // namespace threveal::collection
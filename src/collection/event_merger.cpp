@@ -0,0 +1,108 @@
+/**
+ *  @file       event_merger.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the EventMerger class.
+ */
+
+#include "threveal/collection/event_merger.hpp"
+
+#include "threveal/core/events.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace threveal::collection
+{
+
+EventMerger::EventMerger(std::size_t source_count) : queues_(source_count) {}
+
+void EventMerger::push(std::size_t source, const core::MigrationEvent& event)
+{
+    if (source >= queues_.size())
+    {
+        return;
+    }
+
+    if (event.timestamp_ns < last_emitted_ns_)
+    {
+        ++late_events_;
+    }
+
+    // Usually the newest event of its source; search from the back
+    auto& queue = queues_[source];
+    auto position = std::find_if(queue.rbegin(), queue.rend(),
+                                 [&event](const core::MigrationEvent& buffered)
+                                 { return buffered.timestamp_ns <= event.timestamp_ns; });
+    queue.insert(position.base(), event);
+    ++pending_;
+}
+
+auto EventMerger::drainUntil(std::uint64_t watermark_ns, const MergedEventSink& sink)
+    -> std::size_t
+{
+    // Min-heap of (head timestamp, source); each source contributes its head
+    using Head = std::pair<std::uint64_t, std::size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<>> heads;
+
+    for (std::size_t source = 0; source < queues_.size(); ++source)
+    {
+        if (!queues_[source].empty())
+        {
+            heads.emplace(queues_[source].front().timestamp_ns, source);
+        }
+    }
+
+    std::size_t emitted = 0;
+    while (!heads.empty() && heads.top().first <= watermark_ns)
+    {
+        auto source = heads.top().second;
+        heads.pop();
+
+        auto& queue = queues_[source];
+        const auto& event = queue.front();
+        last_emitted_ns_ = std::max(last_emitted_ns_, event.timestamp_ns);
+        if (sink)
+        {
+            sink(event);
+        }
+        queue.pop_front();
+        ++emitted;
+
+        if (!queue.empty())
+        {
+            heads.emplace(queue.front().timestamp_ns, source);
+        }
+    }
+
+    pending_ -= emitted;
+    return emitted;
+}
+
+auto EventMerger::flush(const MergedEventSink& sink) -> std::size_t
+{
+    return drainUntil(std::numeric_limits<std::uint64_t>::max(), sink);
+}
+
+auto EventMerger::pending() const noexcept -> std::size_t
+{
+    return pending_;
+}
+
+auto EventMerger::sourceCount() const noexcept -> std::size_t
+{
+    return queues_.size();
+}
+
+auto EventMerger::lateEvents() const noexcept -> std::uint64_t
+{
+    return late_events_;
+}
+
+}  // namespace threveal::collection
@@ -0,0 +1,266 @@
+/**
+ *  @file       fake_perf_backend.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the in-process PMU model.
+ */
+
+#include "threveal/collection/fake_perf_backend.hpp"
+
+#include "threveal/collection/perf_backend.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace threveal::collection
+{
+
+FakePerfBackend::FakePerfBackend(core::TopologyMap topology, FakePerfBackendOptions options)
+    : topology_(std::move(topology)), options_(options)
+{
+    if (!topology_.getPCores().empty())
+    {
+        default_cpu_ = topology_.getPCores().front();
+    }
+    else if (!topology_.getECores().empty())
+    {
+        default_cpu_ = topology_.getECores().front();
+    }
+}
+
+auto FakePerfBackend::open(PmuEventType event, pid_t tid, int cpu, int group_fd, bool read_group)
+    -> std::expected<int, core::PmuError>
+{
+    std::scoped_lock lock(mutex_);
+    if (open_error_)
+    {
+        return std::unexpected(*open_error_);
+    }
+
+    Counter counter;
+    counter.event = event;
+    counter.tid = tid;
+    counter.cpu = cpu;
+    counter.read_group = read_group;
+
+    // Like perf_event_open(), a new counter starts disabled and a member
+    // follows its leader
+    counter.enabled = (group_fd != -1);
+    if (group_fd != -1)
+    {
+        auto leader = counters_.find(group_fd);
+        if (leader == counters_.end() || leader->second.leader != -1)
+        {
+            return std::unexpected(core::PmuError::kInvalidTarget);
+        }
+        if (leader->second.members.size() + 1 >= kMaxPerfGroupEvents)
+        {
+            return std::unexpected(core::PmuError::kTooManyEvents);
+        }
+        counter.leader = group_fd;
+        leader->second.members.push_back(next_handle_);
+    }
+
+    int fd = next_handle_++;
+    counters_.emplace(fd, std::move(counter));
+    return fd;
+}
+
+void FakePerfBackend::close(int fd) noexcept
+{
+    std::scoped_lock lock(mutex_);
+    auto found = counters_.find(fd);
+    if (found == counters_.end())
+    {
+        return;
+    }
+
+    // A member leaves its leader's group read; members of a closed leader
+    // stop counting
+    if (found->second.leader != -1)
+    {
+        auto leader = counters_.find(found->second.leader);
+        if (leader != counters_.end())
+        {
+            std::erase(leader->second.members, fd);
+        }
+    }
+    counters_.erase(found);
+}
+
+auto FakePerfBackend::read(int fd, std::span<std::uint64_t> values)
+    -> std::expected<std::size_t, core::PmuError>
+{
+    std::scoped_lock lock(mutex_);
+    auto found = counters_.find(fd);
+    if (found == counters_.end() || values.empty())
+    {
+        return std::unexpected(core::PmuError::kReadFailed);
+    }
+
+    if (options_.read_advance.count() > 0)
+    {
+        advanceLocked(options_.read_advance);
+    }
+
+    const auto& counter = found->second;
+    values[0] = valueOf(counter);
+    if (!counter.read_group)
+    {
+        return 1;
+    }
+
+    if (values.size() < counter.members.size() + 1)
+    {
+        return std::unexpected(core::PmuError::kReadFailed);
+    }
+    for (std::size_t i = 0; i < counter.members.size(); ++i)
+    {
+        values[i + 1] = valueOf(counters_.at(counter.members[i]));
+    }
+    return counter.members.size() + 1;
+}
+
+auto FakePerfBackend::control(int fd, PerfControl op, bool group)
+    -> std::expected<void, core::PmuError>
+{
+    std::scoped_lock lock(mutex_);
+    auto found = counters_.find(fd);
+    if (found == counters_.end())
+    {
+        return std::unexpected(core::PmuError::kInvalidState);
+    }
+
+    auto apply = [op](Counter& counter)
+    {
+        switch (op)
+        {
+            case PerfControl::kEnable:
+                counter.enabled = true;
+                break;
+            case PerfControl::kDisable:
+                counter.enabled = false;
+                break;
+            case PerfControl::kReset:
+                counter.p_core_time = std::chrono::nanoseconds{0};
+                counter.e_core_time = std::chrono::nanoseconds{0};
+                break;
+        }
+    };
+
+    apply(found->second);
+    if (group)
+    {
+        for (int member : found->second.members)
+        {
+            apply(counters_.at(member));
+        }
+    }
+    return {};
+}
+
+auto FakePerfBackend::currentCpu(pid_t tid) const noexcept -> core::CpuId
+{
+    std::scoped_lock lock(mutex_);
+    auto found = cpus_.find(tid);
+    return (found == cpus_.end()) ? default_cpu_ : found->second;
+}
+
+void FakePerfBackend::advance(std::chrono::nanoseconds elapsed)
+{
+    std::scoped_lock lock(mutex_);
+    advanceLocked(elapsed);
+}
+
+void FakePerfBackend::setCpu(pid_t tid, core::CpuId cpu)
+{
+    std::scoped_lock lock(mutex_);
+    cpus_[tid] = cpu;
+}
+
+void FakePerfBackend::setOpenError(std::optional<core::PmuError> error)
+{
+    std::scoped_lock lock(mutex_);
+    open_error_ = error;
+}
+
+auto FakePerfBackend::now() const -> std::chrono::nanoseconds
+{
+    std::scoped_lock lock(mutex_);
+    return now_;
+}
+
+auto FakePerfBackend::openHandles() const -> std::size_t
+{
+    std::scoped_lock lock(mutex_);
+    return counters_.size();
+}
+
+auto FakePerfBackend::cpuOf(const Counter& counter) const noexcept -> core::CpuId
+{
+    if (counter.cpu >= 0)
+    {
+        return static_cast<core::CpuId>(counter.cpu);
+    }
+    auto found = cpus_.find(counter.tid);
+    return (found == cpus_.end()) ? default_cpu_ : found->second;
+}
+
+auto FakePerfBackend::isCounting(const Counter& counter) const noexcept -> bool
+{
+    if (!counter.enabled)
+    {
+        return false;
+    }
+    if (counter.leader == -1)
+    {
+        return true;
+    }
+    auto leader = counters_.find(counter.leader);
+    return leader != counters_.end() && leader->second.enabled;
+}
+
+auto FakePerfBackend::valueOf(const Counter& counter) const noexcept -> std::uint64_t
+{
+    return options_.p_core.count(counter.event, counter.p_core_time) +
+           options_.e_core.count(counter.event, counter.e_core_time);
+}
+
+void FakePerfBackend::advanceLocked(std::chrono::nanoseconds elapsed)
+{
+    now_ += elapsed;
+    for (auto& [fd, counter] : counters_)
+    {
+        if (!isCounting(counter))
+        {
+            continue;
+        }
+
+        auto type = topology_.getCoreType(cpuOf(counter));
+        if (!type)
+        {
+            continue;
+        }
+        if (*type == core::CoreType::kPCore)
+        {
+            counter.p_core_time += elapsed;
+        }
+        else if (*type == core::CoreType::kECore)
+        {
+            counter.e_core_time += elapsed;
+        }
+    }
+}
+
+}  // namespace threveal::collection
@@ -0,0 +1,568 @@
+/**
+ *  @file       hfi_monitor.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the HfiMonitor class using thermal generic netlink.
+ */
+
+#include "threveal/collection/hfi_monitor.hpp"
+
+#include "threveal/core/clock.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/thermal.h>
+#include <optional>
+#include <poll.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace threveal::collection
+{
+
+namespace
+{
+
+/**
+ *  Rounds a netlink length up to the 4-byte alignment used by both
+ *  message headers and attributes.
+ *
+ *  The NLMSG_ and NLA_ macros from the uapi headers use C-style casts,
+ *  so the arithmetic is reimplemented here.
+ */
+constexpr auto netlinkAlign(std::size_t len) noexcept -> std::size_t
+{
+    constexpr std::size_t kAlignTo = 4;
+    return (len + kAlignTo - 1) & ~(kAlignTo - 1);
+}
+
+constexpr std::size_t kMessageHeaderLen = netlinkAlign(sizeof(nlmsghdr));
+constexpr std::size_t kGenlHeaderLen = netlinkAlign(sizeof(genlmsghdr));
+constexpr std::size_t kAttributeHeaderLen = netlinkAlign(sizeof(nlattr));
+
+/**
+ *  Receive buffer size; capability events for 256 CPUs fit comfortably.
+ */
+constexpr std::size_t kReceiveBufferSize = 16384;
+
+/**
+ *  Invokes fn(type, payload) for each attribute in a netlink attribute stream.
+ *
+ *  Stops silently at the first malformed attribute.
+ */
+template <typename Fn>
+void forEachAttribute(std::span<const std::byte> data, Fn&& fn)
+{
+    while (data.size() >= kAttributeHeaderLen)
+    {
+        nlattr attr{};
+        std::memcpy(&attr, data.data(), sizeof(attr));
+
+        if (attr.nla_len < kAttributeHeaderLen || attr.nla_len > data.size())
+        {
+            return;
+        }
+
+        auto type = static_cast<std::uint16_t>(attr.nla_type & NLA_TYPE_MASK);
+        fn(type, data.subspan(kAttributeHeaderLen, attr.nla_len - kAttributeHeaderLen));
+
+        auto advance = netlinkAlign(attr.nla_len);
+        if (advance >= data.size())
+        {
+            return;
+        }
+        data = data.subspan(advance);
+    }
+}
+
+/**
+ *  Invokes fn(header, payload) for each message in a netlink datagram.
+ */
+template <typename Fn>
+void forEachMessage(std::span<const std::byte> data, Fn&& fn)
+{
+    while (data.size() >= kMessageHeaderLen)
+    {
+        nlmsghdr header{};
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        if (header.nlmsg_len < kMessageHeaderLen || header.nlmsg_len > data.size())
+        {
+            return;
+        }
+
+        fn(header, data.subspan(kMessageHeaderLen, header.nlmsg_len - kMessageHeaderLen));
+
+        auto advance = netlinkAlign(header.nlmsg_len);
+        if (advance >= data.size())
+        {
+            return;
+        }
+        data = data.subspan(advance);
+    }
+}
+
+template <typename T>
+auto readScalar(std::span<const std::byte> payload) -> std::optional<T>
+{
+    if (payload.size() < sizeof(T))
+    {
+        return std::nullopt;
+    }
+    T value{};
+    std::memcpy(&value, payload.data(), sizeof(T));
+    return value;
+}
+
+/**
+ *  Returns the ID of a CTRL_ATTR_MCAST_GROUPS entry if its name matches.
+ */
+auto multicastGroupId(std::span<const std::byte> group, std::string_view wanted)
+    -> std::optional<std::uint32_t>
+{
+    std::string_view name;
+    std::optional<std::uint32_t> id;
+
+    forEachAttribute(group,
+                     [&](std::uint16_t type, std::span<const std::byte> value)
+                     {
+                         if (type == CTRL_ATTR_MCAST_GRP_NAME)
+                         {
+                             const auto* chars =
+                                 static_cast<const char*>(static_cast<const void*>(value.data()));
+                             name = std::string_view(chars, strnlen(chars, value.size()));
+                         }
+                         else if (type == CTRL_ATTR_MCAST_GRP_ID)
+                         {
+                             id = readScalar<std::uint32_t>(value);
+                         }
+                     });
+
+    return (name == wanted) ? id : std::nullopt;
+}
+
+/**
+ *  Resolved thermal generic netlink identifiers.
+ */
+struct ThermalFamily
+{
+    std::uint16_t family_id;
+    std::uint32_t event_group;
+};
+
+/**
+ *  Asks the generic netlink controller for the thermal family.
+ *
+ *  @param      fd  A bound NETLINK_GENERIC socket.
+ *  @return     The family ID and "event" multicast group, or HfiError.
+ */
+auto resolveThermalFamily(int fd) -> std::expected<ThermalFamily, core::HfiError>
+{
+    constexpr std::string_view kFamilyName = THERMAL_GENL_FAMILY_NAME;
+    constexpr std::string_view kGroupName = THERMAL_GENL_EVENT_GROUP_NAME;
+
+    // Request: nlmsghdr | genlmsghdr | CTRL_ATTR_FAMILY_NAME "thermal\0"
+    std::array<std::byte, 64> request{};
+    auto name_attr_len = kAttributeHeaderLen + kFamilyName.size() + 1;
+    auto total_len = kMessageHeaderLen + kGenlHeaderLen + netlinkAlign(name_attr_len);
+
+    nlmsghdr header{};
+    header.nlmsg_len = static_cast<std::uint32_t>(total_len);
+    header.nlmsg_type = GENL_ID_CTRL;
+    header.nlmsg_flags = NLM_F_REQUEST;
+    header.nlmsg_seq = 1;
+
+    genlmsghdr genl{};
+    genl.cmd = CTRL_CMD_GETFAMILY;
+    genl.version = 1;
+
+    nlattr name_attr{};
+    name_attr.nla_len = static_cast<std::uint16_t>(name_attr_len);
+    name_attr.nla_type = CTRL_ATTR_FAMILY_NAME;
+
+    std::size_t offset = 0;
+    std::memcpy(request.data(), &header, sizeof(header));
+    offset += kMessageHeaderLen;
+    std::memcpy(request.data() + offset, &genl, sizeof(genl));
+    offset += kGenlHeaderLen;
+    std::memcpy(request.data() + offset, &name_attr, sizeof(name_attr));
+    offset += kAttributeHeaderLen;
+    std::memcpy(request.data() + offset, kFamilyName.data(), kFamilyName.size());
+
+    if (send(fd, request.data(), total_len, 0) < 0)
+    {
+        return std::unexpected(core::HfiError::kSocketFailed);
+    }
+
+    // The controller answers synchronously; bound the wait anyway
+    pollfd pfd{.fd = fd, .events = POLLIN, .revents = 0};
+    constexpr int kResolveTimeoutMs = 1000;
+    if (::poll(&pfd, 1, kResolveTimeoutMs) <= 0)
+    {
+        return std::unexpected(core::HfiError::kFamilyNotFound);
+    }
+
+    std::array<std::byte, kReceiveBufferSize> buffer{};
+    ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+    if (received <= 0)
+    {
+        return std::unexpected(core::HfiError::kSocketFailed);
+    }
+
+    std::optional<std::uint16_t> family_id;
+    std::optional<std::uint32_t> event_group;
+
+    auto on_attribute = [&](std::uint16_t type, std::span<const std::byte> value)
+    {
+        if (type == CTRL_ATTR_FAMILY_ID)
+        {
+            family_id = readScalar<std::uint16_t>(value);
+        }
+        else if (type == CTRL_ATTR_MCAST_GROUPS)
+        {
+            // Nested list of { GRP_NAME, GRP_ID } entries
+            forEachAttribute(value,
+                             [&](std::uint16_t, std::span<const std::byte> group)
+                             {
+                                 if (auto id = multicastGroupId(group, kGroupName))
+                                 {
+                                     event_group = id;
+                                 }
+                             });
+        }
+    };
+
+    forEachMessage(std::span(buffer).first(static_cast<std::size_t>(received)),
+                   [&](const nlmsghdr& message, std::span<const std::byte> payload)
+                   {
+                       // NLMSG_ERROR here means the family is not registered
+                       if (message.nlmsg_type == GENL_ID_CTRL && payload.size() >= kGenlHeaderLen)
+                       {
+                           forEachAttribute(payload.subspan(kGenlHeaderLen), on_attribute);
+                       }
+                   });
+
+    if (!family_id || !event_group)
+    {
+        return std::unexpected(core::HfiError::kFamilyNotFound);
+    }
+
+    return ThermalFamily{.family_id = *family_id, .event_group = *event_group};
+}
+
+/**
+ *  Skips leading spaces and tabs.
+ */
+auto skipBlanks(std::string_view str) noexcept -> std::string_view
+{
+    auto start = str.find_first_not_of(" \t\r");
+    return (start == std::string_view::npos) ? std::string_view{} : str.substr(start);
+}
+
+/**
+ *  Parses the next unsigned integer field and advances past it.
+ */
+auto nextField(std::string_view& str) -> std::optional<std::uint32_t>
+{
+    str = skipBlanks(str);
+    std::uint32_t value = 0;
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (ec != std::errc{})
+    {
+        return std::nullopt;
+    }
+    str.remove_prefix(static_cast<std::size_t>(ptr - str.data()));
+    return value;
+}
+
+}  // namespace
+
+HfiMonitor::HfiMonitor(Source source, int fd, std::uint16_t family_id,
+                       HfiCallback callback) noexcept
+    : source_(source), fd_(fd), family_id_(family_id), callback_(std::move(callback))
+{
+}
+
+HfiMonitor::~HfiMonitor()
+{
+    if (fd_ != kInvalidFd)
+    {
+        close(fd_);
+    }
+}
+
+HfiMonitor::HfiMonitor(HfiMonitor&& other) noexcept
+    : source_(other.source_),
+      fd_(std::exchange(other.fd_, kInvalidFd)),
+      family_id_(other.family_id_),
+      callback_(std::move(other.callback_)),
+      pending_line_(std::move(other.pending_line_)),
+      update_count_(std::exchange(other.update_count_, 0))
+{
+}
+
+auto HfiMonitor::operator=(HfiMonitor&& other) noexcept -> HfiMonitor&
+{
+    if (this != &other)
+    {
+        if (fd_ != kInvalidFd)
+        {
+            close(fd_);
+        }
+
+        source_ = other.source_;
+        fd_ = std::exchange(other.fd_, kInvalidFd);
+        family_id_ = other.family_id_;
+        callback_ = std::move(other.callback_);
+        pending_line_ = std::move(other.pending_line_);
+        update_count_ = std::exchange(other.update_count_, 0);
+    }
+    return *this;
+}
+
+auto HfiMonitor::create(HfiCallback callback) -> std::expected<HfiMonitor, core::HfiError>
+{
+    if (!callback)
+    {
+        return std::unexpected(core::HfiError::kInvalidState);
+    }
+
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (fd < 0)
+    {
+        return std::unexpected(core::HfiError::kSocketFailed);
+    }
+
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, static_cast<sockaddr*>(static_cast<void*>(&addr)), sizeof(addr)) < 0)
+    {
+        close(fd);
+        return std::unexpected(core::HfiError::kSocketFailed);
+    }
+
+    auto family = resolveThermalFamily(fd);
+    if (!family)
+    {
+        close(fd);
+        return std::unexpected(family.error());
+    }
+
+    // Capability events are multicast on the "event" group
+    std::uint32_t group = family->event_group;
+    if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0)
+    {
+        close(fd);
+        return std::unexpected(core::HfiError::kSubscribeFailed);
+    }
+
+    return HfiMonitor{Source::kNetlink, fd, family->family_id, std::move(callback)};
+}
+
+auto HfiMonitor::createFromFile(std::string_view path, HfiCallback callback)
+    -> std::expected<HfiMonitor, core::HfiError>
+{
+    if (!callback)
+    {
+        return std::unexpected(core::HfiError::kInvalidState);
+    }
+
+    int fd = open(std::string(path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::unexpected(core::HfiError::kSourceNotFound);
+    }
+
+    return HfiMonitor{Source::kFile, fd, 0, std::move(callback)};
+}
+
+auto HfiMonitor::poll(std::chrono::milliseconds timeout) -> int
+{
+    if (fd_ == kInvalidFd)
+    {
+        return -1;
+    }
+
+    if (source_ == Source::kFile)
+    {
+        return pollFile();
+    }
+    return pollNetlink(timeout);
+}
+
+auto HfiMonitor::pollNetlink(std::chrono::milliseconds timeout) -> int
+{
+    pollfd pfd{.fd = fd_, .events = POLLIN, .revents = 0};
+    int ready = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+    if (ready < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    if (ready == 0)
+    {
+        return 0;
+    }
+
+    int delivered = 0;
+    std::array<std::byte, kReceiveBufferSize> buffer{};
+
+    // Drain everything queued; capability bursts arrive as several datagrams
+    while (true)
+    {
+        ssize_t received = recv(fd_, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        if (received < 0)
+        {
+            // ENOBUFS means the kernel dropped events; keep going with what is left
+            if (errno == ENOBUFS)
+            {
+                continue;
+            }
+            break;
+        }
+
+        forEachMessage(
+            std::span(buffer).first(static_cast<std::size_t>(received)),
+            [&](const nlmsghdr& message, std::span<const std::byte> payload)
+            {
+                if (message.nlmsg_type != family_id_ || payload.size() < kGenlHeaderLen)
+                {
+                    return;
+                }
+
+                genlmsghdr genl{};
+                std::memcpy(&genl, payload.data(), sizeof(genl));
+                if (genl.cmd != THERMAL_GENL_EVENT_CPU_CAPABILITY_CHANGE)
+                {
+                    return;
+                }
+
+                forEachAttribute(
+                    payload.subspan(kGenlHeaderLen),
+                    [&](std::uint16_t type, std::span<const std::byte> value)
+                    {
+                        if (type != THERMAL_GENL_ATTR_CPU_CAPABILITY)
+                        {
+                            return;
+                        }
+
+                        // Flat sequence of (ID, PERFORMANCE, EFFICIENCY) triples
+                        std::uint32_t cpu = 0;
+                        std::uint32_t performance = 0;
+                        forEachAttribute(
+                            value,
+                            [&](std::uint16_t cap_type, std::span<const std::byte> cap_value)
+                            {
+                                auto number = readScalar<std::uint32_t>(cap_value).value_or(0);
+                                switch (cap_type)
+                                {
+                                    case THERMAL_GENL_ATTR_CPU_CAPABILITY_ID:
+                                        cpu = number;
+                                        break;
+                                    case THERMAL_GENL_ATTR_CPU_CAPABILITY_PERFORMANCE:
+                                        performance = number;
+                                        break;
+                                    case THERMAL_GENL_ATTR_CPU_CAPABILITY_EFFICIENCY:
+                                        deliver(cpu, performance, number);
+                                        ++delivered;
+                                        break;
+                                    default:
+                                        break;
+                                }
+                            });
+                    });
+            });
+    }
+
+    return delivered;
+}
+
+auto HfiMonitor::pollFile() -> int
+{
+    std::array<char, 4096> chunk{};
+    while (true)
+    {
+        ssize_t bytes_read = ::read(fd_, chunk.data(), chunk.size());
+        if (bytes_read <= 0)
+        {
+            break;
+        }
+        pending_line_.append(chunk.data(), static_cast<std::size_t>(bytes_read));
+    }
+
+    int delivered = 0;
+    std::size_t line_start = 0;
+    std::size_t newline = 0;
+
+    // Only complete lines are consumed; a trailing partial line waits for more
+    while ((newline = pending_line_.find('\n', line_start)) != std::string::npos)
+    {
+        std::string_view line(pending_line_.data() + line_start, newline - line_start);
+        line_start = newline + 1;
+
+        line = skipBlanks(line);
+        if (line.empty() || line.front() == '#')
+        {
+            continue;
+        }
+
+        auto cpu = nextField(line);
+        auto performance = nextField(line);
+        auto efficiency = nextField(line);
+        if (!cpu || !performance || !efficiency)
+        {
+            continue;
+        }
+
+        deliver(*cpu, *performance, *efficiency);
+        ++delivered;
+    }
+
+    pending_line_.erase(0, line_start);
+    return delivered;
+}
+
+void HfiMonitor::deliver(core::CpuId cpu_id, std::uint32_t performance, std::uint32_t efficiency)
+{
+    core::HfiCapabilityUpdate update{
+        .timestamp_ns = core::traceTimestampNs(),
+        .cpu_id = cpu_id,
+        .performance = performance,
+        .efficiency = efficiency,
+    };
+
+    callback_(update);
+    ++update_count_;
+}
+
+auto HfiMonitor::updateCount() const noexcept -> std::uint64_t
+{
+    return update_count_;
+}
+
+auto HfiMonitor::fileDescriptor() const noexcept -> int
+{
+    return fd_;
+}
+
+auto HfiMonitor::isValid() const noexcept -> bool
+{
+    return fd_ != kInvalidFd;
+}
+
+}  // namespace threveal::collection
@@ -8,27 +8,100 @@
 #include "threveal/collection/migration_tracker.hpp"
 
 #include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/collection/event_merger.hpp"
+#include "threveal/collection/record_decoder.hpp"
+#include "threveal/collection/sampling_controller.hpp"
+#include "threveal/core/clock.hpp"
 #include "threveal/core/events.hpp"
+#include "threveal/core/topology_handle.hpp"
+#include "threveal/core/types.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <bpf/libbpf.h>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
-#include <cstring>
 #include <expected>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <numeric>
 #include <optional>
+#include <span>
 #include <utility>
-
-// Shared BPF structures
-#include "bpf_common.h"
+#include <variant>
+#include <vector>
 
 namespace threveal::collection
 {
 
-MigrationTracker::MigrationTracker(EbpfLoader loader, ring_buffer* ring_buf,
-                                   MigrationCallback callback) noexcept
-    : loader_(std::move(loader)), ring_buf_(ring_buf), callback_(std::move(callback))
+struct MigrationTracker::Consumer
+{
+    /**
+     *  Callback context for one ring.
+     */
+    struct Ring
+    {
+        Consumer* consumer;
+        std::size_t index;
+    };
+
+    explicit Consumer(IdentityResolution resolution) : decoder(resolution) {}
+
+    MigrationCallback callback;
+    SuppressionCallback on_suppressed;
+    ThreadLifecycleCallback on_lifecycle;
+    std::vector<Ring> rings;
+    RecordDecoder decoder;
+    std::optional<EventMerger> merger;
+    std::atomic<std::uint64_t> event_count{0};
+    std::atomic<std::uint64_t> suppressed_count{0};
+
+    // Adaptive sampling state, only touched from poll()
+    std::optional<SamplingController> sampling;
+    std::chrono::steady_clock::time_point last_adjust;
+    std::uint64_t last_drops{0};
+    std::uint64_t last_events{0};
+    double peak_fill{0.0};
+    std::uint32_t sample_rate{1};
+
+    void deliver(const core::MigrationEvent& event)
+    {
+        callback(event);
+        event_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void report(const core::SuppressionSummary& summary)
+    {
+        suppressed_count.fetch_add(summary.suppressed, std::memory_order_relaxed);
+        if (on_suppressed)
+        {
+            on_suppressed(summary);
+        }
+    }
+
+    /**
+     *  Hands out merged migrations up to a watermark. Every ring has been
+     *  read that far, so the identities they need have been decoded.
+     */
+    auto drainMerged(std::uint64_t watermark_ns) -> std::size_t
+    {
+        auto drained = merger->drainUntil(watermark_ns,
+                                          [this](const core::MigrationEvent& event)
+                                          {
+                                              auto resolved = event;
+                                              decoder.resolve(resolved);
+                                              deliver(resolved);
+                                          });
+        decoder.retireExited(watermark_ns);
+        return drained;
+    }
+};
+
+MigrationTracker::MigrationTracker(EbpfLoader loader, std::unique_ptr<Consumer> consumer,
+                                   ring_buffer* ring_buf) noexcept
+    : loader_(std::move(loader)), consumer_(std::move(consumer)), ring_buf_(ring_buf)
 {
 }
 
@@ -48,9 +121,8 @@ MigrationTracker::~MigrationTracker()
 
 MigrationTracker::MigrationTracker(MigrationTracker&& other) noexcept
     : loader_(std::move(other.loader_)),
+      consumer_(std::move(other.consumer_)),
       ring_buf_(std::exchange(other.ring_buf_, nullptr)),
-      callback_(std::move(other.callback_)),
-      event_count_(other.event_count_.load()),
       running_(std::exchange(other.running_, false))
 {
 }
@@ -74,15 +146,15 @@ auto MigrationTracker::operator=(MigrationTracker&& other) noexcept -> Migration
 
     // Take ownership
     loader_ = std::move(other.loader_);
+    consumer_ = std::move(other.consumer_);
     ring_buf_ = std::exchange(other.ring_buf_, nullptr);
-    callback_ = std::move(other.callback_);
-    event_count_ = other.event_count_.load();
     running_ = std::exchange(other.running_, false);
 
     return *this;
 }
 
-auto MigrationTracker::create(MigrationCallback callback)
+auto MigrationTracker::create(MigrationCallback callback,
+                              const EbpfLoaderOptions& loader_options)
     -> std::expected<MigrationTracker, EbpfError>
 {
     if (!callback)
@@ -91,28 +163,56 @@ auto MigrationTracker::create(MigrationCallback callback)
     }
 
     // Create and load the eBPF program
-    auto loader = EbpfLoader::create();
+    auto loader = EbpfLoader::create(loader_options);
     if (!loader)
     {
         return std::unexpected(loader.error());
     }
 
-    // Get the ring buffer file descriptor
-    int ring_fd = loader->ringBufferFd();
-    if (ring_fd < 0)
+    // Get the fd of every ring events are written to
+    auto ring_fds = loader->ringBufferFds();
+    if (ring_fds.empty() || std::ranges::any_of(ring_fds,
+                                                [](int fd)
+                                                {
+                                                    return fd < 0;
+                                                }))
     {
         return std::unexpected(EbpfError::kMapAccessFailed);
     }
 
-    // Create ring buffer consumer with nullptr context initially
-    // The context will be set via the callback closure
-    ring_buffer* ring_buf = ring_buffer__new(ring_fd, ringBufferCallback, nullptr, nullptr);
+    // Contexts must be in place before libbpf holds pointers to them
+    // A thread's records share a ring only if there is one
+    auto consumer = std::make_unique<Consumer>((ring_fds.size() > 1)
+                                                   ? IdentityResolution::kDeferred
+                                                   : IdentityResolution::kOnDecode);
+    consumer->callback = std::move(callback);
+    for (std::size_t index = 0; index < ring_fds.size(); ++index)
+    {
+        consumer->rings.push_back({consumer.get(), index});
+    }
+    if (ring_fds.size() > 1)
+    {
+        consumer->merger.emplace(ring_fds.size());
+    }
+
+    // Register every ring with one consumer
+    ring_buffer* ring_buf =
+        ring_buffer__new(ring_fds[0], ringBufferCallback, &consumer->rings[0], nullptr);
     if (ring_buf == nullptr)
     {
         return std::unexpected(EbpfError::kMapAccessFailed);
     }
+    for (std::size_t index = 1; index < ring_fds.size(); ++index)
+    {
+        if (ring_buffer__add(ring_buf, ring_fds[index], ringBufferCallback,
+                             &consumer->rings[index]) != 0)
+        {
+            ring_buffer__free(ring_buf);
+            return std::unexpected(EbpfError::kMapAccessFailed);
+        }
+    }
 
-    return MigrationTracker{std::move(*loader), ring_buf, std::move(callback)};
+    return MigrationTracker{std::move(*loader), std::move(consumer), ring_buf};
 }
 
 auto MigrationTracker::start() -> std::expected<void, EbpfError>
@@ -150,8 +250,206 @@ auto MigrationTracker::poll(std::chrono::milliseconds timeout) -> int
         return -1;
     }
 
+    // Unread data piles up between polls, so measure before consuming
+    if (consumer_->sampling)
+    {
+        consumer_->peak_fill = std::max(consumer_->peak_fill, ringFillLevel());
+    }
+
     int timeout_ms = static_cast<int>(timeout.count());
-    return ring_buffer__poll(ring_buf_, timeout_ms);
+    int processed = ring_buffer__poll(ring_buf_, timeout_ms);
+    if (processed >= 0 && consumer_->merger)
+    {
+        // poll() only reads rings that signalled; read the rest as well so
+        // every event older than the watermark is buffered before merging.
+        auto now_ns = core::readClockNs(loader_.clockSource());
+        auto slack_ns = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(kMergeSlack).count());
+        int consumed = ring_buffer__consume(ring_buf_);
+        if (consumed < 0)
+        {
+            return consumed;
+        }
+
+        consumer_->drainMerged((now_ns > slack_ns) ? now_ns - slack_ns : 0);
+        processed += consumed;
+    }
+
+    if (processed >= 0)
+    {
+        adjustSampling();
+    }
+    return processed;
+}
+
+auto MigrationTracker::flush() -> int
+{
+    if (ring_buf_ == nullptr)
+    {
+        return -1;
+    }
+
+    int consumed = ring_buffer__consume(ring_buf_);
+    if (consumed < 0)
+    {
+        return consumed;
+    }
+
+    // Counts of threads that were not admitted again never reached a ring
+    if (auto summaries = loader_.collectSuppressed())
+    {
+        for (const auto& summary : *summaries)
+        {
+            consumer_->report(summary);
+        }
+    }
+
+    if (!consumer_->merger)
+    {
+        return consumed;
+    }
+
+    return static_cast<int>(consumer_->drainMerged(std::numeric_limits<std::uint64_t>::max()));
+}
+
+auto MigrationTracker::ringDrops() const -> std::expected<std::vector<std::uint64_t>, EbpfError>
+{
+    return loader_.ringDrops();
+}
+
+void MigrationTracker::enableAdaptiveSampling(const SamplingPolicy& policy)
+{
+    if (consumer_ == nullptr)
+    {
+        return;
+    }
+
+    auto drops = loader_.ringDrops();
+    consumer_->sampling.emplace(policy);
+    consumer_->last_adjust = std::chrono::steady_clock::now();
+    consumer_->last_drops = drops ? std::accumulate(drops->begin(), drops->end(), std::uint64_t{0})
+                                  : 0;
+    consumer_->last_events = consumer_->event_count.load(std::memory_order_relaxed);
+    consumer_->peak_fill = 0.0;
+}
+
+auto MigrationTracker::disableAdaptiveSampling() -> std::expected<void, EbpfError>
+{
+    if (consumer_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    consumer_->sampling.reset();
+    auto result = loader_.setSampleRate(1);
+    if (result)
+    {
+        consumer_->sample_rate = 1;
+    }
+    return result;
+}
+
+auto MigrationTracker::sampleRate() const noexcept -> std::uint32_t
+{
+    return (consumer_ != nullptr) ? consumer_->sample_rate : 1;
+}
+
+auto MigrationTracker::setProcessSampleRate(std::uint32_t pid, std::uint32_t rate)
+    -> std::expected<void, EbpfError>
+{
+    return loader_.setTgidSampleRate(pid, rate);
+}
+
+auto MigrationTracker::ringFillLevel() const -> double
+{
+    if (ring_buf_ == nullptr)
+    {
+        return 0.0;
+    }
+
+    double fullest = 0.0;
+    for (std::size_t index = 0; index < consumer_->rings.size(); ++index)
+    {
+        const ring* shard = ring_buffer__ring(ring_buf_, static_cast<unsigned int>(index));
+        if (shard == nullptr || ring__size(shard) == 0)
+        {
+            continue;
+        }
+        auto fill = static_cast<double>(ring__avail_data_size(shard)) /
+                    static_cast<double>(ring__size(shard));
+        fullest = std::max(fullest, fill);
+    }
+    return fullest;
+}
+
+void MigrationTracker::adjustSampling()
+{
+    auto& consumer = *consumer_;
+    if (!consumer.sampling)
+    {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = now - consumer.last_adjust;
+    if (elapsed < consumer.sampling->policy().interval)
+    {
+        return;
+    }
+
+    auto drops = loader_.ringDrops();
+    auto total_drops = drops ? std::accumulate(drops->begin(), drops->end(), std::uint64_t{0})
+                             : consumer.last_drops;
+    auto total_events = consumer.event_count.load(std::memory_order_relaxed);
+
+    SamplingObservation observation{
+        .fill = consumer.peak_fill,
+        .drops = (total_drops > consumer.last_drops) ? total_drops - consumer.last_drops : 0,
+        .events = total_events - consumer.last_events,
+        .elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed),
+    };
+
+    consumer.last_adjust = now;
+    consumer.last_drops = total_drops;
+    consumer.last_events = total_events;
+    consumer.peak_fill = 0.0;
+
+    auto rate = std::min(consumer.sampling->update(observation), kMaxSampleRate);
+    if (rate != consumer.sample_rate && loader_.setSampleRate(rate))
+    {
+        consumer.sample_rate = rate;
+    }
+}
+
+void MigrationTracker::setSuppressionCallback(SuppressionCallback callback)
+{
+    if (consumer_ != nullptr)
+    {
+        consumer_->on_suppressed = std::move(callback);
+    }
+}
+
+void MigrationTracker::setLifecycleCallback(ThreadLifecycleCallback callback)
+{
+    if (consumer_ != nullptr)
+    {
+        consumer_->on_lifecycle = std::move(callback);
+    }
+}
+
+auto MigrationTracker::setThreadRateLimit(std::uint32_t events_per_sec, std::uint32_t burst)
+    -> std::expected<void, EbpfError>
+{
+    return loader_.setThreadRateLimit(events_per_sec, burst);
+}
+
+auto MigrationTracker::suppressedCount() const noexcept -> std::uint64_t
+{
+    if (consumer_ == nullptr)
+    {
+        return 0;
+    }
+    return consumer_->suppressed_count.load(std::memory_order_relaxed);
 }
 
 auto MigrationTracker::setTargetPid(std::optional<std::uint32_t> pid)
@@ -161,6 +459,17 @@ auto MigrationTracker::setTargetPid(std::optional<std::uint32_t> pid)
     return loader_.setTargetPid(target);
 }
 
+auto MigrationTracker::setTopology(const core::TopologySnapshot& snapshot)
+    -> std::expected<void, EbpfError>
+{
+    // The decoder must know a generation before events can carry it
+    if (consumer_ != nullptr)
+    {
+        consumer_->decoder.setTopologyGeneration(snapshot.generation);
+    }
+    return loader_.setTopology(snapshot.map, snapshot.generation);
+}
+
 auto MigrationTracker::isRunning() const noexcept -> bool
 {
     return running_;
@@ -168,38 +477,54 @@ auto MigrationTracker::isRunning() const noexcept -> bool
 
 auto MigrationTracker::eventCount() const noexcept -> std::uint64_t
 {
-    return event_count_.load(std::memory_order_relaxed);
+    if (consumer_ == nullptr)
+    {
+        return 0;
+    }
+    return consumer_->event_count.load(std::memory_order_relaxed);
 }
 
 auto MigrationTracker::ringBufferCallback(void* ctx, void* data, std::size_t size) -> int
 {
-    if (size < sizeof(migration_event))
+    const auto* ring = static_cast<const Consumer::Ring*>(ctx);
+    if (ring == nullptr || !ring->consumer->callback)
     {
-        return 0;  // Skip malformed event
+        return 0;
     }
 
-    auto* tracker = static_cast<MigrationTracker*>(ctx);
-    if (tracker == nullptr || !tracker->callback_)
+    auto& consumer = *ring->consumer;
+    auto record = consumer.decoder.decode(std::span{static_cast<const std::byte*>(data), size});
+    if (!record || std::holds_alternative<ThreadIdentity>(*record))
     {
-        return 0;
+        return 0;  // Skip malformed or unknown records; identities only feed the decoder
     }
 
-    // Convert raw BPF event to C++ MigrationEvent
-    const auto* raw_event = static_cast<const migration_event*>(data);
-
-    core::MigrationEvent event{};
-    event.timestamp_ns = raw_event->timestamp_ns;
-    event.pid = raw_event->pid;
-    event.tid = raw_event->tid;
-    event.src_cpu = raw_event->src_cpu;
-    event.dst_cpu = raw_event->dst_cpu;
+    if (const auto* summary = std::get_if<core::SuppressionSummary>(&*record))
+    {
+        // Summaries are aggregates, so they bypass the ordered merge
+        consumer.report(*summary);
+        return 0;
+    }
 
-    // Copy command name from BPF event
-    std::memcpy(event.comm.data(), raw_event->comm,
-                std::min(sizeof(event.comm), sizeof(raw_event->comm)));
+    if (const auto* lifecycle = std::get_if<core::ThreadLifecycleEvent>(&*record))
+    {
+        // Consumers key on the thread's start time, so order does not matter
+        if (consumer.on_lifecycle)
+        {
+            consumer.on_lifecycle(*lifecycle);
+        }
+        return 0;
+    }
 
-    tracker->callback_(event);
-    tracker->event_count_.fetch_add(1, std::memory_order_relaxed);
+    const auto& event = std::get<core::MigrationEvent>(*record);
+    if (consumer.merger)
+    {
+        consumer.merger->push(ring->index, event);
+    }
+    else
+    {
+        consumer.deliver(event);
+    }
 
     return 0;  // Continue processing
 }
@@ -0,0 +1,312 @@
+/**
+ *  @file       perf_backend.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the perf_event system call backend.
+ */
+
+#include "threveal/collection/perf_backend.hpp"
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <span>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace threveal::collection
+{
+
+namespace
+{
+
+/**
+ *  Wrapper for the perf_event_open syscall.
+ *
+ *  glibc does not provide a wrapper for perf_event_open(), so we must invoke
+ *  the syscall directly. This is the standard approach used by perf tools.
+ *
+ *  @param      attr      Pointer to perf_event_attr configuration structure.
+ *  @param      pid       Process/thread ID to monitor (-1 for calling thread).
+ *  @param      cpu       CPU to monitor (-1 for any CPU the thread runs on).
+ *  @param      group_fd  File descriptor of group leader (-1 for new group).
+ *  @param      flags     Additional flags (usually 0).
+ *  @return     File descriptor on success, -1 on error with errno set.
+ */
+auto perfEventOpen(perf_event_attr* attr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+    -> int
+{
+    return static_cast<int>(syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags));
+}
+
+/**
+ *  Configures a perf_event_attr structure for a hardware event.
+ *
+ *  Creates an attribute structure with common settings:
+ *  - exclude_kernel=1: Only count user-space events (avoids CAP_SYS_ADMIN)
+ *  - exclude_hv=1: Exclude hypervisor events
+ *
+ *  @param      config  The PERF_COUNT_HW_* constant for the desired event.
+ *  @return     Configured perf_event_attr structure ready for perf_event_open().
+ */
+auto makeHardwareEventAttr(std::uint64_t config) -> perf_event_attr
+{
+    perf_event_attr attr{};
+
+    // Zero-initialize to ensure all fields have defined values.
+    // perf_event_attr has many optional fields that must be zero if unused.
+    std::memset(&attr, 0, sizeof(attr));
+
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);  // Required for kernel version compatibility
+    attr.config = config;      // The specific hardware event (cycles, instructions, etc.)
+
+    // Exclude kernel and hypervisor to avoid needing elevated privileges.
+    // This means we only count events that occur in user-space.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return attr;
+}
+
+/**
+ *  Configures a perf_event_attr structure for a cache event.
+ *
+ *  Cache events use a composite config value encoding three fields:
+ *  - bits 0-7:   cache ID (L1D, L1I, LL, DTLB, ITLB, BPU, NODE)
+ *  - bits 8-15:  operation (READ, WRITE, PREFETCH)
+ *  - bits 16-23: result (ACCESS, MISS)
+ *
+ *  @param      cache_id   The cache level (e.g., PERF_COUNT_HW_CACHE_LL).
+ *  @param      op_id      The operation (e.g., PERF_COUNT_HW_CACHE_OP_READ).
+ *  @param      result_id  The result type (e.g., PERF_COUNT_HW_CACHE_RESULT_MISS).
+ *  @return     Configured perf_event_attr structure ready for perf_event_open().
+ */
+auto makeCacheEventAttr(std::uint64_t cache_id, std::uint64_t op_id, std::uint64_t result_id)
+    -> perf_event_attr
+{
+    perf_event_attr attr{};
+    std::memset(&attr, 0, sizeof(attr));
+
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+
+    // Encode cache_id, operation, and result into the config field.
+    // Example: LLC read misses = LL | (READ << 8) | (MISS << 16)
+    attr.config = cache_id | (op_id << 8) | (result_id << 16);
+
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return attr;
+}
+
+/**
+ *  Creates a perf_event_attr for the given PmuEventType.
+ *
+ *  Maps our PmuEventType enum to the appropriate perf_event configuration.
+ *  Hardware events use PERF_TYPE_HARDWARE, cache events use PERF_TYPE_HW_CACHE.
+ *
+ *  @param      event  The PMU event type to configure.
+ *  @return     Configured perf_event_attr structure for the requested event.
+ */
+auto makeEventAttr(PmuEventType event) -> perf_event_attr
+{
+    switch (event)
+    {
+        case PmuEventType::kCycles:
+            // Total CPU cycles elapsed (affected by frequency scaling)
+            return makeHardwareEventAttr(PERF_COUNT_HW_CPU_CYCLES);
+
+        case PmuEventType::kInstructions:
+            // Retired instructions (completed, not speculative)
+            return makeHardwareEventAttr(PERF_COUNT_HW_INSTRUCTIONS);
+
+        case PmuEventType::kBranchMisses:
+            // Branch predictions that were incorrect
+            return makeHardwareEventAttr(PERF_COUNT_HW_BRANCH_MISSES);
+
+        case PmuEventType::kLlcLoads:
+            // Last-level cache read accesses (hits + misses)
+            return makeCacheEventAttr(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_ACCESS);
+
+        case PmuEventType::kLlcLoadMisses:
+            // Last-level cache read misses (went to memory)
+            return makeCacheEventAttr(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_MISS);
+    }
+
+    // Unreachable if all enum cases handled, but provides safe fallback
+    return makeHardwareEventAttr(PERF_COUNT_HW_CPU_CYCLES);
+}
+
+/**
+ *  Maps errno values from perf_event_open() to PmuError.
+ *
+ *  @param      err  The errno value to translate.
+ *  @return     The corresponding PmuError value.
+ */
+auto errnoToPmuError(int err) -> core::PmuError
+{
+    switch (err)
+    {
+        case EACCES:
+        case EPERM:
+            // User lacks CAP_PERFMON capability or perf_event_paranoid is too high.
+            // Fix: run as root, grant CAP_PERFMON, or set perf_event_paranoid <= 1
+            return core::PmuError::kPermissionDenied;
+
+        case ENOENT:
+        case ENODEV:
+        case EOPNOTSUPP:
+            // The requested event is not available on this CPU or kernel.
+            // This can happen with cache events on some microarchitectures.
+            return core::PmuError::kEventNotSupported;
+
+        case ESRCH:
+        case EINVAL:
+            // Invalid PID/TID specified, or invalid combination of parameters
+            return core::PmuError::kInvalidTarget;
+
+        case EMFILE:
+        case ENFILE:
+            // Too many open file descriptors or PMU hardware counters exhausted.
+            // Most CPUs only have 4-8 programmable counters.
+            return core::PmuError::kTooManyEvents;
+
+        default:
+            return core::PmuError::kOpenFailed;
+    }
+}
+
+/**
+ *  Layout of a PERF_FORMAT_GROUP read.
+ */
+struct GroupReadFormat
+{
+    std::uint64_t nr;
+    std::array<std::uint64_t, kMaxPerfGroupEvents> values;
+};
+
+/**
+ *  Backend issuing perf_event system calls.
+ */
+class SyscallPerfBackend final : public PerfBackend
+{
+  public:
+    auto open(PmuEventType event, pid_t tid, int cpu, int group_fd, bool read_group)
+        -> std::expected<int, core::PmuError> override
+    {
+        auto attr = makeEventAttr(event);
+
+        // A new counter or group starts disabled so the caller can enable
+        // it once set up; members inherit the leader's state
+        attr.disabled = (group_fd == -1) ? 1 : 0;
+        if (read_group)
+        {
+            attr.read_format = PERF_FORMAT_GROUP;
+        }
+
+        int fd = perfEventOpen(&attr, tid, cpu, group_fd, 0);
+        if (fd < 0)
+        {
+            return std::unexpected(errnoToPmuError(errno));
+        }
+        return fd;
+    }
+
+    void close(int fd) noexcept override
+    {
+        ::close(fd);
+    }
+
+    auto read(int fd, std::span<std::uint64_t> values)
+        -> std::expected<std::size_t, core::PmuError> override
+    {
+        // A group read starts with the number of values
+        GroupReadFormat data{};
+        ssize_t bytes_read = ::read(fd, &data, sizeof(data));
+        if (bytes_read < 0 || static_cast<std::size_t>(bytes_read) < sizeof(data.nr))
+        {
+            return std::unexpected(core::PmuError::kReadFailed);
+        }
+
+        if (static_cast<std::size_t>(bytes_read) == sizeof(data.nr))
+        {
+            // A single counter's value, not a group read
+            if (values.empty())
+            {
+                return std::unexpected(core::PmuError::kReadFailed);
+            }
+            values[0] = data.nr;
+            return 1;
+        }
+
+        auto count = static_cast<std::size_t>(data.nr);
+        if (count > values.size() || count > kMaxPerfGroupEvents ||
+            static_cast<std::size_t>(bytes_read) < sizeof(data.nr) * (count + 1))
+        {
+            return std::unexpected(core::PmuError::kReadFailed);
+        }
+        std::copy_n(data.values.begin(), count, values.begin());
+        return count;
+    }
+
+    auto control(int fd, PerfControl op, bool group) -> std::expected<void, core::PmuError> override
+    {
+        unsigned long request = PERF_EVENT_IOC_ENABLE;
+        switch (op)
+        {
+            case PerfControl::kEnable:
+                request = PERF_EVENT_IOC_ENABLE;
+                break;
+            case PerfControl::kDisable:
+                request = PERF_EVENT_IOC_DISABLE;
+                break;
+            case PerfControl::kReset:
+                request = PERF_EVENT_IOC_RESET;
+                break;
+        }
+
+        // FLAG_GROUP applies the change to every member at once
+        unsigned int flags = group ? static_cast<unsigned int>(PERF_IOC_FLAG_GROUP) : 0U;
+        if (ioctl(fd, request, flags) < 0)
+        {
+            return std::unexpected(core::PmuError::kInvalidState);
+        }
+        return {};
+    }
+
+    auto currentCpu(pid_t /*tid*/) const noexcept -> core::CpuId override
+    {
+        // sched_getcpu() returns the CPU number of the calling thread
+        int cpu = sched_getcpu();
+        if (cpu < 0)
+        {
+            return 0;
+        }
+        return static_cast<core::CpuId>(cpu);
+    }
+};
+
+}  // namespace
+
+auto systemPerfBackend() noexcept -> PerfBackend&
+{
+    static SyscallPerfBackend backend;
+    return backend;
+}
+
+}  // namespace threveal::collection
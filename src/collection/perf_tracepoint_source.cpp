@@ -0,0 +1,819 @@
+/**
+ *  @file       perf_tracepoint_source.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of perf_event tracepoint migration capture.
+ */
+
+#include "threveal/collection/perf_tracepoint_source.hpp"
+
+#include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/collection/event_merger.hpp"
+#include "threveal/collection/migration_source.hpp"
+#include "threveal/core/clock.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/topology_handle.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <memory>
+#include <optional>
+#include <poll.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace threveal::collection
+{
+
+namespace
+{
+
+/**
+ *  tracefs mount points tried when none is configured.
+ */
+constexpr std::array<std::string_view, 2> kTracefsRoots = {
+    "/sys/kernel/tracing",
+    "/sys/kernel/debug/tracing",
+};
+
+constexpr std::string_view kFormatPath = "/events/sched/sched_migrate_task/format";
+constexpr const char* kOnlineCpusPath = "/sys/devices/system/cpu/online";
+
+/**
+ *  Offsets in a sample taken with TIME | CPU | RAW; the fields follow the
+ *  header in that order.
+ */
+constexpr std::size_t kSampleTimeOffset = sizeof(perf_event_header);
+constexpr std::size_t kSampleCpuOffset = kSampleTimeOffset + sizeof(std::uint64_t);
+constexpr std::size_t kSampleRawSizeOffset = kSampleCpuOffset + sizeof(std::uint64_t);
+constexpr std::size_t kSampleRawOffset = kSampleRawSizeOffset + sizeof(std::uint32_t);
+
+/**
+ *  Process IDs cached before the cache is dropped; thread IDs get reused,
+ *  so the cache should not outlive many generations of threads.
+ */
+constexpr std::size_t kMaxCachedThreads = 65536;
+
+/**
+ *  Age after which a cached process ID is read again. A reused thread ID
+ *  that kept the old comm is misattributed for at most this long.
+ */
+constexpr std::uint64_t kMaxCachedProcessAgeNs = 1'000'000'000;
+
+/**
+ *  Reads a little-endian value at an offset the caller has bounds-checked.
+ */
+template <typename T>
+auto loadAt(std::span<const std::byte> data, std::size_t offset) noexcept -> T
+{
+    T value{};
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    return value;
+}
+
+/**
+ *  Reads a whole file; tracefs and procfs files report a size of zero.
+ */
+auto readFile(const std::string& path) -> std::optional<std::string>
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::nullopt;
+    }
+
+    std::string content;
+    std::array<char, 4096> buffer{};
+    ssize_t bytes_read = 0;
+    while ((bytes_read = ::read(fd, buffer.data(), buffer.size())) > 0)
+    {
+        content.append(buffer.data(), static_cast<std::size_t>(bytes_read));
+    }
+    ::close(fd);
+
+    if (bytes_read < 0)
+    {
+        return std::nullopt;
+    }
+    return content;
+}
+
+/**
+ *  Parses the number following `key` in a line, e.g. "offset:8;".
+ */
+auto numberAfter(std::string_view line, std::string_view key) -> std::optional<std::size_t>
+{
+    auto pos = line.find(key);
+    if (pos == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+
+    auto digits = line.substr(pos + key.size());
+    digits.remove_prefix(std::min(digits.find_first_not_of(" \t"), digits.size()));
+    std::size_t value = 0;
+    auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    if (ec != std::errc{} || end == digits.data())
+    {
+        return std::nullopt;
+    }
+    return value;
+}
+
+/**
+ *  Returns the name declared by a field, e.g. "comm" for "char comm[16]".
+ */
+auto fieldName(std::string_view declaration) -> std::string_view
+{
+    declaration = declaration.substr(0, declaration.find('['));
+    auto start = declaration.find_last_of(" \t*");
+    return start == std::string_view::npos ? declaration : declaration.substr(start + 1);
+}
+
+/**
+ *  Looks up the process a thread belongs to.
+ */
+auto readTgid(std::uint32_t tid) -> std::optional<std::uint32_t>
+{
+    auto status = readFile("/proc/" + std::to_string(tid) + "/status");
+    if (!status)
+    {
+        return std::nullopt;
+    }
+
+    auto line = std::string_view{*status};
+    auto pos = line.find("\nTgid:");
+    if (pos == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    auto tgid = numberAfter(line.substr(pos), "Tgid:");
+    if (!tgid)
+    {
+        return std::nullopt;
+    }
+    return static_cast<std::uint32_t>(*tgid);
+}
+
+/**
+ *  Returns the online CPUs, or every configured CPU if the list cannot
+ *  be read.
+ */
+auto onlineCpus() -> std::vector<core::CpuId>
+{
+    if (auto content = readFile(kOnlineCpusPath))
+    {
+        auto trimmed = std::string_view{*content};
+        trimmed = trimmed.substr(0, trimmed.find_last_not_of(" \n") + 1);
+        if (auto cpus = core::parseCpuList(trimmed); cpus && !cpus->empty())
+        {
+            return std::move(*cpus);
+        }
+    }
+
+    std::vector<core::CpuId> cpus;
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    for (long cpu = 0; cpu < count; ++cpu)
+    {
+        cpus.push_back(static_cast<core::CpuId>(cpu));
+    }
+    return cpus;
+}
+
+auto readFormat(const std::string& tracefs_root) -> std::optional<MigrateTracepointFormat>
+{
+    if (!tracefs_root.empty())
+    {
+        auto text = readFile(tracefs_root + std::string{kFormatPath});
+        return text ? parseMigrateTracepointFormat(*text) : std::nullopt;
+    }
+
+    for (auto root : kTracefsRoots)
+    {
+        if (auto text = readFile(std::string{root} + std::string{kFormatPath}))
+        {
+            return parseMigrateTracepointFormat(*text);
+        }
+    }
+    return std::nullopt;
+}
+
+auto perfEventOpen(perf_event_attr* attr, int cpu) -> int
+{
+    // Every task on one CPU
+    return static_cast<int>(
+        syscall(SYS_perf_event_open, attr, -1, cpu, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+}  // namespace
+
+auto parseMigrateTracepointFormat(std::string_view text) -> std::optional<MigrateTracepointFormat>
+{
+    MigrateTracepointFormat format;
+    bool has_id = false;
+    bool has_comm = false;
+    bool has_tid = false;
+    bool has_orig = false;
+    bool has_dest = false;
+
+    while (!text.empty())
+    {
+        auto end = text.find('\n');
+        auto line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+        if (line.starts_with("ID:"))
+        {
+            auto id = numberAfter(line, "ID:");
+            has_id = id.has_value();
+            format.id = id.value_or(0);
+            continue;
+        }
+
+        // "\tfield:int orig_cpu;\toffset:32;\tsize:4;\tsigned:1;"
+        auto field_pos = line.find("field:");
+        if (field_pos == std::string_view::npos)
+        {
+            continue;
+        }
+        auto declaration = line.substr(field_pos + 6);
+        declaration = declaration.substr(0, declaration.find(';'));
+        auto offset = numberAfter(line, "offset:");
+        auto size = numberAfter(line, "size:");
+        if (!offset || !size)
+        {
+            continue;
+        }
+
+        TracepointField field{*offset, *size};
+        auto name = fieldName(declaration);
+        if (name == "comm")
+        {
+            format.comm = field;
+            has_comm = field.size > 0;
+        }
+        else if (name == "pid")
+        {
+            format.tid = field;
+            has_tid = field.size == sizeof(std::int32_t);
+        }
+        else if (name == "orig_cpu")
+        {
+            format.orig_cpu = field;
+            has_orig = field.size == sizeof(std::int32_t);
+        }
+        else if (name == "dest_cpu")
+        {
+            format.dest_cpu = field;
+            has_dest = field.size == sizeof(std::int32_t);
+        }
+    }
+
+    if (!has_id || !has_comm || !has_tid || !has_orig || !has_dest)
+    {
+        return std::nullopt;
+    }
+    return format;
+}
+
+auto decodeMigrateSample(std::span<const std::byte> record, const MigrateTracepointFormat& format)
+    -> std::optional<core::MigrationEvent>
+{
+    if (record.size() < kSampleRawOffset)
+    {
+        return std::nullopt;
+    }
+    auto header = loadAt<perf_event_header>(record, 0);
+    if (header.type != PERF_RECORD_SAMPLE || header.size > record.size())
+    {
+        return std::nullopt;
+    }
+
+    auto raw_size = loadAt<std::uint32_t>(record, kSampleRawSizeOffset);
+    if (raw_size > header.size - kSampleRawOffset)
+    {
+        return std::nullopt;
+    }
+    auto raw = record.subspan(kSampleRawOffset, raw_size);
+
+    auto fits = [&raw](const TracepointField& field)
+    {
+        return field.offset + field.size <= raw.size();
+    };
+    if (!fits(format.comm) || !fits(format.tid) || !fits(format.orig_cpu) ||
+        !fits(format.dest_cpu))
+    {
+        return std::nullopt;
+    }
+
+    core::MigrationEvent event{};
+    event.timestamp_ns = loadAt<std::uint64_t>(record, kSampleTimeOffset);
+    event.tid = static_cast<std::uint32_t>(loadAt<std::int32_t>(raw, format.tid.offset));
+    event.src_cpu = static_cast<core::CpuId>(loadAt<std::int32_t>(raw, format.orig_cpu.offset));
+    event.dst_cpu = static_cast<core::CpuId>(loadAt<std::int32_t>(raw, format.dest_cpu.offset));
+
+    // Always leave room for the terminator
+    std::memcpy(event.comm.data(), raw.data() + format.comm.offset,
+                std::min(event.comm.size() - 1, format.comm.size));
+    return event;
+}
+
+PerfRingReader::PerfRingReader(void* base, std::size_t page_bytes, std::size_t data_bytes) noexcept
+    : meta_(base), data_(static_cast<std::byte*>(base) + page_bytes), data_bytes_(data_bytes)
+{
+}
+
+auto PerfRingReader::read(const PerfRecordFn& callback, std::size_t max_records) -> std::size_t
+{
+    if (meta_ == nullptr)
+    {
+        return 0;
+    }
+
+    auto* meta = static_cast<perf_event_mmap_page*>(meta_);
+
+    // Pairs with the kernel's release of data_head after writing records
+    std::uint64_t head = std::atomic_ref{meta->data_head}.load(std::memory_order_acquire);
+    std::uint64_t tail = meta->data_tail;
+
+    std::size_t delivered = 0;
+    while (tail < head && delivered < max_records)
+    {
+        // Records are 8-byte aligned, so a header never wraps
+        auto offset = static_cast<std::size_t>(tail & (data_bytes_ - 1));
+        perf_event_header header{};
+        std::memcpy(&header, data_ + offset, sizeof(header));
+        if (header.size < sizeof(header) || header.size > head - tail)
+        {
+            tail = head;  // Corrupt ring; skip what was written
+            break;
+        }
+
+        std::span<const std::byte> record{data_ + offset, header.size};
+        if (offset + header.size > data_bytes_)
+        {
+            auto first = data_bytes_ - offset;
+            scratch_.resize(header.size);
+            std::memcpy(scratch_.data(), data_ + offset, first);
+            std::memcpy(scratch_.data() + first, data_, header.size - first);
+            record = scratch_;
+        }
+
+        callback(record);
+        tail += header.size;
+        ++delivered;
+    }
+
+    // Hands the space back to the kernel once the records are consumed
+    std::atomic_ref{meta->data_tail}.store(tail, std::memory_order_release);
+    return delivered;
+}
+
+auto PerfRingReader::availableBytes() const noexcept -> std::size_t
+{
+    if (meta_ == nullptr)
+    {
+        return 0;
+    }
+    auto* meta = static_cast<perf_event_mmap_page*>(meta_);
+    auto head = std::atomic_ref{meta->data_head}.load(std::memory_order_acquire);
+    return static_cast<std::size_t>(head - meta->data_tail);
+}
+
+auto PerfRingReader::capacity() const noexcept -> std::size_t
+{
+    return data_bytes_;
+}
+
+struct PerfTracepointSource::State
+{
+    /**
+     *  One CPU's event and its mapped ring.
+     */
+    struct Ring
+    {
+        int fd{-1};
+        void* base{nullptr};
+        std::size_t map_bytes{0};
+        PerfRingReader reader;
+    };
+
+    /**
+     *  A thread's process as read from /proc, with what identified the
+     *  thread at the time.
+     */
+    struct CachedProcess
+    {
+        std::uint32_t tgid{0};
+        std::uint64_t read_ns{0};
+        std::array<char, core::kMaxCommLength> comm{};
+    };
+
+    State() = default;
+    State(const State&) = delete;
+    auto operator=(const State&) -> State& = delete;
+    State(State&&) = delete;
+    auto operator=(State&&) -> State& = delete;
+
+    ~State()
+    {
+        for (auto& ring : rings)
+        {
+            if (ring.base != nullptr)
+            {
+                munmap(ring.base, ring.map_bytes);
+            }
+            if (ring.fd >= 0)
+            {
+                ::close(ring.fd);
+            }
+        }
+    }
+
+    MigrationCallback callback;
+    MigrateTracepointFormat format;
+    core::ClockSource clock{core::ClockSource::kMonotonic};
+    std::vector<Ring> rings;
+    std::optional<EventMerger> merger;
+    std::optional<std::uint32_t> target_pid;
+    std::optional<core::TopologySnapshot> topology;
+    std::unordered_map<std::uint32_t, CachedProcess> tgids;
+    std::atomic<std::uint64_t> event_count{0};
+    std::atomic<std::uint64_t> lost{0};
+
+    void deliver(const core::MigrationEvent& event)
+    {
+        callback(event);
+        event_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     *  Returns the process of a migrated thread, or 0 if it has already
+     *  exited.
+     *
+     *  A cached entry is trusted only while the thread keeps the comm it
+     *  had when the entry was read and the entry is younger than
+     *  kMaxCachedProcessAgeNs; otherwise the thread ID may have been
+     *  reused and /proc is read again.
+     */
+    auto processOf(const core::MigrationEvent& event) -> std::uint32_t
+    {
+        auto it = tgids.find(event.tid);
+        if (it != tgids.end())
+        {
+            const auto& cached = it->second;
+            bool fresh = event.timestamp_ns < cached.read_ns ||
+                         event.timestamp_ns - cached.read_ns <= kMaxCachedProcessAgeNs;
+            if (fresh && cached.comm == event.comm)
+            {
+                return cached.tgid;
+            }
+        }
+
+        auto tgid = readTgid(event.tid);
+        if (!tgid)
+        {
+            if (it != tgids.end())
+            {
+                tgids.erase(it);
+            }
+            return 0;
+        }
+        if (it == tgids.end() && tgids.size() >= kMaxCachedThreads)
+        {
+            tgids.clear();
+        }
+        tgids.insert_or_assign(event.tid, CachedProcess{.tgid = *tgid,
+                                                         .read_ns = event.timestamp_ns,
+                                                         .comm = event.comm});
+        return *tgid;
+    }
+
+    void handle(std::size_t index, std::span<const std::byte> record)
+    {
+        auto header = loadAt<perf_event_header>(record, 0);
+        if (header.type == PERF_RECORD_LOST && record.size() >= sizeof(header) + 16)
+        {
+            // { header, id, lost }
+            lost.fetch_add(loadAt<std::uint64_t>(record, sizeof(header) + 8),
+                           std::memory_order_relaxed);
+            return;
+        }
+
+        auto event = decodeMigrateSample(record, format);
+        if (!event)
+        {
+            return;
+        }
+
+        event->pid = processOf(*event);
+        if (target_pid && event->pid != *target_pid)
+        {
+            return;
+        }
+
+        if (topology)
+        {
+            event->topology_generation = topology->generation;
+            event->src_type =
+                topology->map.getCoreType(event->src_cpu).value_or(core::CoreType::kUnknown);
+            event->dst_type =
+                topology->map.getCoreType(event->dst_cpu).value_or(core::CoreType::kUnknown);
+        }
+
+        if (merger)
+        {
+            merger->push(index, *event);
+        }
+        else
+        {
+            deliver(*event);
+        }
+    }
+};
+
+PerfTracepointSource::PerfTracepointSource(std::unique_ptr<State> state) noexcept
+    : state_(std::move(state))
+{
+}
+
+PerfTracepointSource::~PerfTracepointSource()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+PerfTracepointSource::PerfTracepointSource(PerfTracepointSource&& other) noexcept
+    : state_(std::move(other.state_)), running_(std::exchange(other.running_, false))
+{
+}
+
+auto PerfTracepointSource::operator=(PerfTracepointSource&& other) noexcept
+    -> PerfTracepointSource&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    if (running_)
+    {
+        stop();
+    }
+    state_ = std::move(other.state_);
+    running_ = std::exchange(other.running_, false);
+    return *this;
+}
+
+auto PerfTracepointSource::create(MigrationCallback callback, const PerfTracepointOptions& options)
+    -> std::expected<PerfTracepointSource, EbpfError>
+{
+    if (!callback)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    auto format = readFormat(options.tracefs_root);
+    if (!format)
+    {
+        return std::unexpected(EbpfError::kOpenFailed);
+    }
+
+    auto state = std::make_unique<State>();
+    state->callback = std::move(callback);
+    state->format = *format;
+    state->clock = core::traceClock();
+    state->target_pid = options.target_pid;
+
+    auto page_bytes = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto data_bytes = std::bit_ceil(std::max<std::size_t>(options.ring_pages, 1)) * page_bytes;
+
+    perf_event_attr attr{};
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = format->id;
+    attr.sample_period = 1;
+    attr.sample_type = PERF_SAMPLE_TIME | PERF_SAMPLE_CPU | PERF_SAMPLE_RAW;
+    attr.disabled = 1;
+
+    // Wake the consumer once a quarter of the ring is filled, not per sample
+    attr.watermark = 1;
+    attr.wakeup_watermark = static_cast<std::uint32_t>(data_bytes / 4);
+
+    // Timestamps on the trace clock, comparable with every other source
+    attr.use_clockid = 1;
+    attr.clockid = core::toClockId(state->clock);
+
+    for (auto cpu : onlineCpus())
+    {
+        auto& ring = state->rings.emplace_back();
+        ring.fd = perfEventOpen(&attr, static_cast<int>(cpu));
+        if (ring.fd < 0)
+        {
+            return std::unexpected((errno == EACCES || errno == EPERM)
+                                       ? EbpfError::kPermissionDenied
+                                       : EbpfError::kAttachFailed);
+        }
+
+        ring.map_bytes = page_bytes + data_bytes;
+        void* base = mmap(nullptr, ring.map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd, 0);
+        if (base == MAP_FAILED)
+        {
+            return std::unexpected(EbpfError::kMapAccessFailed);
+        }
+        ring.base = base;
+        ring.reader = PerfRingReader{base, page_bytes, data_bytes};
+    }
+
+    if (state->rings.size() > 1)
+    {
+        state->merger.emplace(state->rings.size());
+    }
+    return PerfTracepointSource{std::move(state)};
+}
+
+auto PerfTracepointSource::start() -> std::expected<void, EbpfError>
+{
+    if (state_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+    if (running_)
+    {
+        return {};
+    }
+
+    for (const auto& ring : state_->rings)
+    {
+        if (ioctl(ring.fd, PERF_EVENT_IOC_ENABLE, 0) < 0)
+        {
+            for (const auto& enabled : state_->rings)
+            {
+                ioctl(enabled.fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+            return std::unexpected(EbpfError::kAttachFailed);
+        }
+    }
+
+    running_ = true;
+    return {};
+}
+
+void PerfTracepointSource::stop() noexcept
+{
+    if (!running_)
+    {
+        return;
+    }
+
+    for (const auto& ring : state_->rings)
+    {
+        ioctl(ring.fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    running_ = false;
+}
+
+auto PerfTracepointSource::poll(std::chrono::milliseconds timeout) -> int
+{
+    if (state_ == nullptr)
+    {
+        return -1;
+    }
+
+    std::vector<pollfd> fds;
+    fds.reserve(state_->rings.size());
+    for (const auto& ring : state_->rings)
+    {
+        fds.push_back({ring.fd, POLLIN, 0});
+    }
+    if (::poll(fds.data(), fds.size(), static_cast<int>(timeout.count())) < 0 && errno != EINTR)
+    {
+        return -1;
+    }
+
+    // Read every ring, not just those that woke us, so every event older
+    // than the watermark is buffered before merging
+    int processed = readRings();
+    if (state_->merger)
+    {
+        auto now_ns = core::readClockNs(state_->clock);
+        auto slack_ns = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(kMergeSlack).count());
+        state_->merger->drainUntil((now_ns > slack_ns) ? now_ns - slack_ns : 0,
+                                   [this](const core::MigrationEvent& event)
+                                   {
+                                       state_->deliver(event);
+                                   });
+    }
+    return processed;
+}
+
+auto PerfTracepointSource::flush() -> int
+{
+    if (state_ == nullptr)
+    {
+        return -1;
+    }
+
+    int processed = readRings();
+    if (!state_->merger)
+    {
+        return processed;
+    }
+
+    return static_cast<int>(state_->merger->flush(
+        [this](const core::MigrationEvent& event)
+        {
+            state_->deliver(event);
+        }));
+}
+
+auto PerfTracepointSource::setTargetPid(std::optional<std::uint32_t> pid)
+    -> std::expected<void, EbpfError>
+{
+    if (state_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+    state_->target_pid = pid;
+    return {};
+}
+
+auto PerfTracepointSource::setTopology(const core::TopologySnapshot& snapshot)
+    -> std::expected<void, EbpfError>
+{
+    if (state_ == nullptr)
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+    state_->topology = snapshot;
+    return {};
+}
+
+auto PerfTracepointSource::isRunning() const noexcept -> bool
+{
+    return running_;
+}
+
+auto PerfTracepointSource::eventCount() const noexcept -> std::uint64_t
+{
+    if (state_ == nullptr)
+    {
+        return 0;
+    }
+    return state_->event_count.load(std::memory_order_relaxed);
+}
+
+auto PerfTracepointSource::lostCount() const noexcept -> std::uint64_t
+{
+    if (state_ == nullptr)
+    {
+        return 0;
+    }
+    return state_->lost.load(std::memory_order_relaxed);
+}
+
+auto PerfTracepointSource::cpuCount() const noexcept -> std::size_t
+{
+    return state_ == nullptr ? 0 : state_->rings.size();
+}
+
+auto PerfTracepointSource::readRings() -> int
+{
+    std::size_t processed = 0;
+    for (std::size_t index = 0; index < state_->rings.size(); ++index)
+    {
+        processed += state_->rings[index].reader.read(
+            [this, index](std::span<const std::byte> record)
+            {
+                state_->handle(index, record);
+            });
+    }
+    return static_cast<int>(processed);
+}
+
+}  // namespace threveal::collection
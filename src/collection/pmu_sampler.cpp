@@ -7,7 +7,9 @@
 
 #include "threveal/collection/pmu_sampler.hpp"
 
+#include "threveal/collection/perf_backend.hpp"
 #include "threveal/collection/pmu_group.hpp"
+#include "threveal/core/clock.hpp"
 #include "threveal/core/errors.hpp"
 #include "threveal/core/events.hpp"
 #include "threveal/core/types.hpp"
@@ -17,58 +19,22 @@
 #include <cstdint>
 #include <expected>
 #include <functional>
-#include <sched.h>
+#include <optional>
 #include <stop_token>
 #include <sys/types.h>
 #include <thread>
-#include <time.h>
 #include <utility>
 
 namespace threveal::collection
 {
 
-namespace
-{
-
-/**
- *  Gets the current timestamp in nanoseconds since boot.
- *
- *  @return     Nanoseconds since boot.
- */
-auto getTimestampNs() noexcept -> std::uint64_t
-{
-    timespec ts{};
-
-    // CLOCK_MONOTONIC matches bpf_ktime_get_ns() used in eBPF programs
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-
-    // Convert to nanoseconds, handling potential overflow for long uptimes
-    constexpr std::uint64_t kNsPerSecond = 1'000'000'000ULL;
-    return (static_cast<std::uint64_t>(ts.tv_sec) * kNsPerSecond) +
-           static_cast<std::uint64_t>(ts.tv_nsec);
-}
-
-/**
- *  Gets the CPU ID where the calling thread is currently running.
- *
- *  @return     The current CPU ID, or 0 if detection fails.
- */
-auto getCurrentCpu() noexcept -> core::CpuId
-{
-    // sched_getcpu() returns the CPU number of the calling thread
-    int cpu = sched_getcpu();
-    if (cpu < 0)
-    {
-        return 0;
-    }
-    return static_cast<core::CpuId>(cpu);
-}
-
-}  // namespace
-
 PmuSampler::PmuSampler(pid_t tid, PmuGroup group, SampleCallback callback,
-                       std::chrono::microseconds interval) noexcept
-    : tid_(tid), group_(std::move(group)), callback_(std::move(callback)), interval_(interval)
+                       std::chrono::microseconds interval, PerfBackend& backend) noexcept
+    : tid_(tid),
+      group_(std::move(group)),
+      callback_(std::move(callback)),
+      interval_(interval),
+      backend_(&backend)
 {
 }
 
@@ -83,13 +49,21 @@ PmuSampler::PmuSampler(PmuSampler&& other) noexcept
       group_(std::move(other.group_)),
       callback_(std::move(other.callback_)),
       interval_(other.interval_),
+      backend_(other.backend_),
+      idle_(std::move(other.idle_)),
+      last_cycles_(other.last_cycles_),
+      idle_intervals_(other.idle_intervals_),
+      has_last_(other.has_last_),
       sampling_thread_(std::move(other.sampling_thread_)),
       sample_count_(other.sample_count_.load()),
+      suppressed_count_(other.suppressed_count_.load()),
       running_(other.running_.load())
 {
     // Invalidate source
     other.tid_ = 0;
+    other.idle_.reset();
     other.sample_count_ = 0;
+    other.suppressed_count_ = 0;
     other.running_ = false;
 }
 
@@ -104,20 +78,28 @@ auto PmuSampler::operator=(PmuSampler&& other) noexcept -> PmuSampler&
         group_ = std::move(other.group_);
         callback_ = std::move(other.callback_);
         interval_ = other.interval_;
+        backend_ = other.backend_;
+        idle_ = std::move(other.idle_);
+        last_cycles_ = other.last_cycles_;
+        idle_intervals_ = other.idle_intervals_;
+        has_last_ = other.has_last_;
         sampling_thread_ = std::move(other.sampling_thread_);
         sample_count_ = other.sample_count_.load();
+        suppressed_count_ = other.suppressed_count_.load();
         running_ = other.running_.load();
 
         // Invalidate source
         other.tid_ = 0;
+        other.idle_.reset();
         other.sample_count_ = 0;
+        other.suppressed_count_ = 0;
         other.running_ = false;
     }
     return *this;
 }
 
-auto PmuSampler::create(pid_t tid, SampleCallback callback, std::chrono::microseconds interval)
-    -> std::expected<PmuSampler, core::PmuError>
+auto PmuSampler::create(pid_t tid, SampleCallback callback, std::chrono::microseconds interval,
+                        PerfBackend& backend) -> std::expected<PmuSampler, core::PmuError>
 {
     // Validate callback is not empty
     if (!callback)
@@ -132,13 +114,13 @@ auto PmuSampler::create(pid_t tid, SampleCallback callback, std::chrono::microse
     }
 
     // Create PMU counter group for the target thread
-    auto group = PmuGroup::create(tid);
+    auto group = PmuGroup::create(tid, -1, backend);
     if (!group)
     {
         return std::unexpected(group.error());
     }
 
-    return PmuSampler{tid, std::move(*group), std::move(callback), interval};
+    return PmuSampler{tid, std::move(*group), std::move(callback), interval, backend};
 }
 
 auto PmuSampler::start() -> std::expected<void, core::PmuError>
@@ -165,6 +147,12 @@ auto PmuSampler::start() -> std::expected<void, core::PmuError>
 
     // Reset sample count for this session
     sample_count_.store(0, std::memory_order_relaxed);
+    suppressed_count_.store(0, std::memory_order_relaxed);
+
+    // The first sample of a session is always emitted
+    last_cycles_ = 0;
+    idle_intervals_ = 0;
+    has_last_ = false;
 
     // Mark as running before starting thread
     running_.store(true, std::memory_order_release);
@@ -203,6 +191,19 @@ void PmuSampler::stop() noexcept
     running_.store(false, std::memory_order_release);
 }
 
+auto PmuSampler::setIdleSuppression(IdleSuppression suppression)
+    -> std::expected<void, core::PmuError>
+{
+    // The sampling thread reads the settings without a lock
+    if (running_.load(std::memory_order_acquire))
+    {
+        return std::unexpected(core::PmuError::kInvalidState);
+    }
+
+    idle_ = std::move(suppression);
+    return {};
+}
+
 auto PmuSampler::isRunning() const noexcept -> bool
 {
     return running_.load(std::memory_order_acquire);
@@ -213,6 +214,11 @@ auto PmuSampler::sampleCount() const noexcept -> std::uint64_t
     return sample_count_.load(std::memory_order_relaxed);
 }
 
+auto PmuSampler::suppressedCount() const noexcept -> std::uint64_t
+{
+    return suppressed_count_.load(std::memory_order_relaxed);
+}
+
 auto PmuSampler::interval() const noexcept -> std::chrono::microseconds
 {
     return interval_;
@@ -240,6 +246,19 @@ void PmuSampler::samplingLoop(const std::stop_token& stop_token)
 
 auto PmuSampler::collectSample() -> bool
 {
+    // Idle intervals may be skipped, except for the first and heartbeats
+    bool heartbeat = idle_ && idle_->heartbeat_intervals != 0 &&
+                     idle_intervals_ + 1 >= idle_->heartbeat_intervals;
+    bool may_skip = idle_ && has_last_ && !heartbeat;
+
+    // A thread that did not run cannot have moved its counters
+    if (may_skip && idle_->ran_since_last_check && !idle_->ran_since_last_check(tid_))
+    {
+        ++idle_intervals_;
+        suppressed_count_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
     // Read PMU counters atomically
     auto reading = group_.read();
     if (!reading)
@@ -248,11 +267,22 @@ auto PmuSampler::collectSample() -> bool
         return false;
     }
 
+    // Cycles only count while the thread runs
+    if (may_skip && reading->cycles == last_cycles_)
+    {
+        ++idle_intervals_;
+        suppressed_count_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    last_cycles_ = reading->cycles;
+    idle_intervals_ = 0;
+    has_last_ = true;
+
     // Get timestamp as close to the PMU read as possible
-    auto timestamp = getTimestampNs();
+    auto timestamp = core::traceTimestampNs();
 
     // Get current CPU for the target thread
-    auto cpu_id = getCurrentCpu();
+    auto cpu_id = backend_->currentCpu(tid_);
 
     // Build the PmuSample structure
     core::PmuSample sample{
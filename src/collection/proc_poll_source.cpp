@@ -0,0 +1,511 @@
+/**
+ *  @file       proc_poll_source.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of /proc polling migration detection.
+ */
+
+#include "threveal/collection/proc_poll_source.hpp"
+
+#include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/collection/migration_source.hpp"
+#include "threveal/core/clock.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology_handle.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace threveal::collection
+{
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+/**
+ *  Fields between the end of the command name and the processor field:
+ *  state is field 3, processor is field 39.
+ */
+constexpr int kFieldsBeforeProcessor = 36;
+
+/**
+ *  Bytes before the end of the command name: a 10-digit ID, " (" and a
+ *  kernel thread name of up to 64 characters. Only numbers follow it, so
+ *  the last ')' is found without scanning the whole line.
+ */
+constexpr std::size_t kCommEndLimit = 80;
+
+constexpr std::uint64_t kSpaces = 0x2020202020202020;
+constexpr std::uint64_t kLowBits = 0x7f7f7f7f7f7f7f7f;
+
+/**
+ *  Counts the spaces in eight bytes.
+ */
+constexpr auto countSpaces(std::uint64_t word) noexcept -> int
+{
+    // High bit of each byte set if the byte is not a space
+    auto diff = word ^ kSpaces;
+    auto nonzero = ((diff & kLowBits) + kLowBits) | diff;
+    return std::popcount(~(nonzero | kLowBits));
+}
+
+/**
+ *  Parses a directory name that is a process or thread ID.
+ */
+auto parseId(std::string_view name) noexcept -> std::optional<std::uint32_t>
+{
+    std::uint32_t id = 0;
+    auto [end, ec] = std::from_chars(name.data(), name.data() + name.size(), id);
+    if (ec != std::errc{} || end != name.data() + name.size())
+    {
+        return std::nullopt;
+    }
+    return id;
+}
+
+/**
+ *  Copies the command name between the first '(' and the last ')'.
+ */
+void copyComm(std::string_view stat, std::array<char, core::kMaxCommLength>& comm) noexcept
+{
+    auto open = stat.find('(');
+    auto close = stat.rfind(')');
+    if (open == std::string_view::npos || close == std::string_view::npos || close <= open)
+    {
+        return;
+    }
+
+    auto name = stat.substr(open + 1, close - open - 1);
+    comm.fill('\0');
+    std::memcpy(comm.data(), name.data(), std::min(name.size(), comm.size() - 1));
+}
+
+}  // namespace
+
+auto parseStatProcessor(std::string_view stat) noexcept -> std::optional<core::CpuId>
+{
+    auto close = stat.rfind(')', kCommEndLimit);
+    if (close == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+
+    // ") S 1 1 ..." - each space after the parenthesis starts a field
+    const char* it = stat.data() + close + 1;
+    const char* end = stat.data() + stat.size();
+    int spaces = 0;
+    while (end - it >= 8)
+    {
+        std::uint64_t word = 0;
+        std::memcpy(&word, it, sizeof(word));
+        auto count = countSpaces(word);
+        if (spaces + count > kFieldsBeforeProcessor)
+        {
+            break;  // The field starts within these bytes
+        }
+        spaces += count;
+        it += sizeof(word);
+    }
+    while (it != end && spaces <= kFieldsBeforeProcessor)
+    {
+        if (*it++ == ' ')
+        {
+            ++spaces;
+        }
+    }
+    if (spaces <= kFieldsBeforeProcessor)
+    {
+        return std::nullopt;
+    }
+
+    core::CpuId cpu = 0;
+    const char* digits = it;
+    while (it != end && *it >= '0' && *it <= '9')
+    {
+        cpu = (cpu * 10) + static_cast<core::CpuId>(*it++ - '0');
+    }
+    if (it == digits || it == end)
+    {
+        return std::nullopt;  // No digits, or the field may be cut short
+    }
+    return cpu;
+}
+
+ProcPollSource::ProcPollSource(MigrationCallback callback, ProcPollOptions options)
+    : callback_(std::move(callback)),
+      options_(std::move(options)),
+      buffer_(kBatchSize * kStatBytes)
+{
+}
+
+ProcPollSource::~ProcPollSource()
+{
+    release();
+}
+
+ProcPollSource::ProcPollSource(ProcPollSource&& other) noexcept
+    : callback_(std::move(other.callback_)),
+      options_(std::move(other.options_)),
+      topology_(std::move(other.topology_)),
+      threads_(std::move(other.threads_)),
+      buffer_(std::move(other.buffer_)),
+      cursor_(std::exchange(other.cursor_, 0)),
+      epoch_(std::exchange(other.epoch_, 0)),
+      next_tick_(other.next_tick_),
+      next_rescan_(other.next_rescan_),
+      event_count_(std::exchange(other.event_count_, 0)),
+      running_(std::exchange(other.running_, false))
+{
+    other.threads_.clear();
+}
+
+auto ProcPollSource::operator=(ProcPollSource&& other) noexcept -> ProcPollSource&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    release();
+    callback_ = std::move(other.callback_);
+    options_ = std::move(other.options_);
+    topology_ = std::move(other.topology_);
+    threads_ = std::exchange(other.threads_, {});
+    buffer_ = std::move(other.buffer_);
+    cursor_ = std::exchange(other.cursor_, 0);
+    epoch_ = std::exchange(other.epoch_, 0);
+    next_tick_ = other.next_tick_;
+    next_rescan_ = other.next_rescan_;
+    event_count_ = std::exchange(other.event_count_, 0);
+    running_ = std::exchange(other.running_, false);
+    return *this;
+}
+
+auto ProcPollSource::create(MigrationCallback callback, const ProcPollOptions& options)
+    -> std::expected<ProcPollSource, EbpfError>
+{
+    if (!callback || options.interval <= std::chrono::milliseconds::zero())
+    {
+        return std::unexpected(EbpfError::kInvalidState);
+    }
+
+    std::error_code ec;
+    if (!fs::is_directory(options.proc_root, ec))
+    {
+        return std::unexpected(EbpfError::kOpenFailed);
+    }
+
+    return ProcPollSource{std::move(callback), options};
+}
+
+auto ProcPollSource::start() -> std::expected<void, EbpfError>
+{
+    if (running_)
+    {
+        return {};
+    }
+
+    rescan();
+    auto now = std::chrono::steady_clock::now();
+    next_tick_ = now + options_.interval;
+    next_rescan_ = now + options_.rescan_interval;
+    running_ = true;
+    return {};
+}
+
+void ProcPollSource::stop() noexcept
+{
+    release();
+    running_ = false;
+}
+
+auto ProcPollSource::poll(std::chrono::milliseconds timeout) -> int
+{
+    if (!running_)
+    {
+        return 0;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now < next_tick_)
+    {
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+            next_tick_ - now, timeout));
+        now = std::chrono::steady_clock::now();
+        if (now < next_tick_)
+        {
+            return 0;
+        }
+    }
+
+    if (now >= next_rescan_)
+    {
+        rescan();
+        next_rescan_ = now + options_.rescan_interval;
+    }
+
+    // A late tick is not made up for; the next one is a full interval away
+    next_tick_ = std::max(next_tick_ + options_.interval, now);
+    return static_cast<int>(tick(core::traceTimestampNs()));
+}
+
+auto ProcPollSource::flush() -> int
+{
+    return 0;
+}
+
+auto ProcPollSource::setTargetPid(std::optional<std::uint32_t> pid)
+    -> std::expected<void, EbpfError>
+{
+    options_.target_pid = pid;
+    next_rescan_ = {};
+    return {};
+}
+
+auto ProcPollSource::setTopology(const core::TopologySnapshot& snapshot)
+    -> std::expected<void, EbpfError>
+{
+    topology_ = snapshot;
+    return {};
+}
+
+auto ProcPollSource::isRunning() const noexcept -> bool
+{
+    return running_;
+}
+
+auto ProcPollSource::eventCount() const noexcept -> std::uint64_t
+{
+    return event_count_;
+}
+
+auto ProcPollSource::threadCount() const noexcept -> std::size_t
+{
+    return threads_.size();
+}
+
+auto ProcPollSource::tick(std::uint64_t now_ns) -> std::size_t
+{
+    if (threads_.empty())
+    {
+        return 0;
+    }
+
+    auto count = threads_.size();
+    if (options_.max_reads_per_tick != 0)
+    {
+        count = std::min(count, options_.max_reads_per_tick);
+    }
+
+    std::size_t reported = 0;
+    bool exited = false;
+    std::array<ssize_t, kBatchSize> lengths{};
+
+    for (std::size_t done = 0; done < count; done += kBatchSize)
+    {
+        auto batch = std::min(kBatchSize, count - done);
+
+        // All reads of the batch first, then all scans
+        for (std::size_t i = 0; i < batch; ++i)
+        {
+            const auto& thread = threads_[(cursor_ + done + i) % threads_.size()];
+            lengths[i] = pread(thread.fd, buffer_.data() + (i * kStatBytes), kStatBytes, 0);
+        }
+
+        for (std::size_t i = 0; i < batch; ++i)
+        {
+            auto& thread = threads_[(cursor_ + done + i) % threads_.size()];
+            if (lengths[i] <= 0)
+            {
+                // The thread exited; its ID may already belong to another
+                ::close(thread.fd);
+                thread.fd = -1;
+                exited = true;
+                continue;
+            }
+
+            auto cpu = parseStatProcessor(
+                {buffer_.data() + (i * kStatBytes), static_cast<std::size_t>(lengths[i])});
+            if (!cpu || *cpu == thread.cpu)
+            {
+                continue;
+            }
+
+            core::MigrationEvent event{};
+            event.timestamp_ns = now_ns;
+            event.pid = thread.pid;
+            event.tid = thread.tid;
+            event.src_cpu = thread.cpu;
+            event.dst_cpu = *cpu;
+            event.comm = thread.comm;
+            event.fidelity = core::MigrationFidelity::kPolled;
+            if (topology_)
+            {
+                event.topology_generation = topology_->generation;
+                event.src_type =
+                    topology_->map.getCoreType(event.src_cpu).value_or(core::CoreType::kUnknown);
+                event.dst_type =
+                    topology_->map.getCoreType(event.dst_cpu).value_or(core::CoreType::kUnknown);
+            }
+
+            thread.cpu = *cpu;
+            callback_(event);
+            ++event_count_;
+            ++reported;
+        }
+    }
+
+    cursor_ = (cursor_ + count) % threads_.size();
+    if (exited)
+    {
+        std::erase_if(threads_,
+                      [](const Thread& thread)
+                      {
+                          return thread.fd < 0;
+                      });
+        cursor_ = threads_.empty() ? 0 : cursor_ % threads_.size();
+    }
+    return reported;
+}
+
+void ProcPollSource::rescan()
+{
+    ++epoch_;
+    auto known = threads_.size();
+
+    if (options_.target_pid)
+    {
+        listProcess(*options_.target_pid, known);
+    }
+    else
+    {
+        std::error_code ec;
+        for (fs::directory_iterator it(options_.proc_root, ec), end; !ec && it != end;
+             it.increment(ec))
+        {
+            if (auto pid = parseId(it->path().filename().native()))
+            {
+                listProcess(*pid, known);
+            }
+        }
+    }
+
+    // Threads no longer listed have exited; new ones were appended
+    for (std::size_t i = 0; i < known; ++i)
+    {
+        if (threads_[i].epoch != epoch_)
+        {
+            ::close(threads_[i].fd);
+            threads_[i].fd = -1;
+        }
+    }
+    std::erase_if(threads_,
+                  [](const Thread& thread)
+                  {
+                      return thread.fd < 0;
+                  });
+    std::sort(threads_.begin(), threads_.end(),
+              [](const Thread& lhs, const Thread& rhs)
+              {
+                  return lhs.tid < rhs.tid;
+              });
+    cursor_ = threads_.empty() ? 0 : cursor_ % threads_.size();
+}
+
+void ProcPollSource::listProcess(std::uint32_t pid, std::size_t known)
+{
+    // Only the first `known` threads are sorted; the rest were just opened
+    auto sorted_end = threads_.begin() + static_cast<std::ptrdiff_t>(known);
+
+    std::error_code ec;
+    auto task_dir = fs::path(options_.proc_root) / std::to_string(pid) / "task";
+    for (fs::directory_iterator it(task_dir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        auto tid = parseId(it->path().filename().native());
+        if (!tid)
+        {
+            continue;
+        }
+
+        auto found = std::lower_bound(threads_.begin(), sorted_end, *tid,
+                                      [](const Thread& thread, std::uint32_t value)
+                                      {
+                                          return thread.tid < value;
+                                      });
+        if (found != sorted_end && found->tid == *tid)
+        {
+            found->epoch = epoch_;
+            continue;
+        }
+
+        // open() may reallocate
+        auto offset = sorted_end - threads_.begin();
+        open(pid, *tid);
+        sorted_end = threads_.begin() + offset;
+    }
+}
+
+auto ProcPollSource::open(std::uint32_t pid, std::uint32_t tid) -> bool
+{
+    auto path = options_.proc_root + "/" + std::to_string(pid) + "/task/" + std::to_string(tid) +
+                "/stat";
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // The first read only sets where the thread is
+    std::array<char, kStatBytes> stat{};
+    auto length = pread(fd, stat.data(), stat.size(), 0);
+    auto cpu = (length > 0)
+                   ? parseStatProcessor({stat.data(), static_cast<std::size_t>(length)})
+                   : std::nullopt;
+    if (!cpu)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    Thread thread;
+    thread.pid = pid;
+    thread.tid = tid;
+    thread.fd = fd;
+    thread.cpu = *cpu;
+    thread.epoch = epoch_;
+    copyComm({stat.data(), static_cast<std::size_t>(length)}, thread.comm);
+    threads_.push_back(thread);
+    return true;
+}
+
+void ProcPollSource::release() noexcept
+{
+    for (const auto& thread : threads_)
+    {
+        ::close(thread.fd);
+    }
+    threads_.clear();
+    cursor_ = 0;
+}
+
+}  // namespace threveal::collection
@@ -0,0 +1,307 @@
+/**
+ *  @file       record_decoder.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of ring buffer record decoding.
+ */
+
+#include "threveal/collection/record_decoder.hpp"
+
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+
+// Shared BPF structures
+#include "bpf_common.h"
+
+namespace threveal::collection
+{
+
+namespace
+{
+
+/**
+ *  Converts a CORE_TYPE_* value from the BPF map to a CoreType.
+ */
+auto toCoreType(__u8 raw) noexcept -> core::CoreType
+{
+    switch (raw)
+    {
+        case CORE_TYPE_PCORE:
+            return core::CoreType::kPCore;
+        case CORE_TYPE_ECORE:
+            return core::CoreType::kECore;
+        default:
+            return core::CoreType::kUnknown;
+    }
+}
+
+static_assert(sizeof(migration_record) == 24, "migration records must stay compact");
+
+/**
+ *  Copies a record out of the ring; ring data is only 8-byte aligned.
+ */
+template <typename Raw>
+auto copyRecord(std::span<const std::byte> data) noexcept -> std::optional<Raw>
+{
+    if (data.size() < sizeof(Raw))
+    {
+        return std::nullopt;
+    }
+
+    Raw raw{};
+    std::memcpy(&raw, data.data(), sizeof(raw));
+    return raw;
+}
+
+/**
+ *  Restores a generation from its low 16 bits, assuming it is the latest
+ *  one up to `newest` with those bits.
+ */
+auto widenGeneration(std::uint16_t low, core::TopologyGeneration newest) noexcept
+    -> core::TopologyGeneration
+{
+    auto behind = static_cast<std::uint16_t>(static_cast<std::uint16_t>(newest) - low);
+    return behind <= newest ? newest - behind : low;
+}
+
+auto unpackCpu(__u16 packed) noexcept -> core::CpuId
+{
+    return packed & RECORD_CPU_MASK;
+}
+
+auto unpackCoreType(__u16 packed) noexcept -> core::CoreType
+{
+    return toCoreType(static_cast<__u8>(packed >> RECORD_CPU_BITS));
+}
+
+auto decodeSuppressed(const suppressed_record& raw) noexcept -> core::SuppressionSummary
+{
+    return core::SuppressionSummary{
+        .timestamp_ns = raw.timestamp_ns,
+        .first_suppressed_ns = raw.first_suppressed_ns,
+        .suppressed = raw.suppressed,
+        .pid = raw.pid,
+        .tid = raw.tid,
+    };
+}
+
+auto decodeIdentity(const thread_identity_record& raw) noexcept -> ThreadIdentity
+{
+    ThreadIdentity identity;
+    identity.pid = raw.pid;
+    identity.tid = raw.tid;
+
+    // Always leave room for the terminator
+    std::memcpy(identity.comm.data(), raw.comm,
+                std::min(identity.comm.size() - 1, sizeof(raw.comm)));
+    return identity;
+}
+
+auto decodeLifecycle(const thread_lifecycle_record& raw) noexcept
+    -> std::optional<core::ThreadLifecycleEvent>
+{
+    if (raw.kind < THREAD_EVENT_FORK || raw.kind > THREAD_EVENT_RENAME)
+    {
+        return std::nullopt;
+    }
+
+    core::ThreadLifecycleEvent event{};
+    event.timestamp_ns = raw.timestamp_ns;
+    event.start_time_ns = raw.start_time_ns;
+    event.pid = raw.pid;
+    event.tid = raw.tid;
+    event.kind = static_cast<core::ThreadLifecycleKind>(raw.kind);
+    std::memcpy(event.comm.data(), raw.comm, std::min(event.comm.size() - 1, sizeof(raw.comm)));
+    return event;
+}
+
+}  // namespace
+
+RecordDecoder::RecordDecoder(IdentityResolution resolution) noexcept : resolution_(resolution) {}
+
+auto RecordDecoder::decode(std::span<const std::byte> data) -> std::optional<RingRecord>
+{
+    auto header = copyRecord<record_header>(data);
+    if (!header || header->size < sizeof(record_header) || header->size > data.size())
+    {
+        return std::nullopt;
+    }
+
+    // Only trust the bytes the header claims
+    data = data.first(header->size);
+
+    switch (header->type)
+    {
+        case RECORD_MIGRATION:
+            if (auto raw = copyRecord<migration_record>(data))
+            {
+                return decodeMigration(*raw);
+            }
+            break;
+        case RECORD_SUPPRESSED:
+            if (auto raw = copyRecord<suppressed_record>(data))
+            {
+                return decodeSuppressed(*raw);
+            }
+            break;
+        case RECORD_THREAD_IDENTITY:
+            if (auto raw = copyRecord<thread_identity_record>(data))
+            {
+                auto identity = decodeIdentity(*raw);
+                learn(identity);
+                return identity;
+            }
+            break;
+        case RECORD_THREAD_LIFECYCLE:
+            if (auto raw = copyRecord<thread_lifecycle_record>(data))
+            {
+                auto event = decodeLifecycle(*raw);
+                if (event)
+                {
+                    track(*event);
+                }
+                return event;
+            }
+            break;
+        default:
+            break;
+    }
+    return std::nullopt;
+}
+
+auto RecordDecoder::decodeMigration(const migration_record& raw) -> core::MigrationEvent
+{
+    core::MigrationEvent event{};
+    event.timestamp_ns = raw.timestamp_ns;
+    event.tid = raw.tid;
+    event.src_cpu = unpackCpu(raw.src);
+    event.dst_cpu = unpackCpu(raw.dst);
+    event.topology_generation =
+        widenGeneration(raw.topology_generation, generation_.load(std::memory_order_acquire));
+    event.src_type = unpackCoreType(raw.src);
+    event.dst_type = unpackCoreType(raw.dst);
+    event.sample_weight = std::max<std::uint32_t>(raw.sample_weight, 1);
+
+    if (resolution_ == IdentityResolution::kOnDecode)
+    {
+        resolve(event);
+    }
+    return event;
+}
+
+void RecordDecoder::resolve(core::MigrationEvent& event)
+{
+    if (auto it = threads_.find(event.tid); it != threads_.end())
+    {
+        event.pid = it->second.identity.pid;
+        event.comm = it->second.identity.comm;
+    }
+    else
+    {
+        ++unresolved_;
+    }
+}
+
+void RecordDecoder::learn(const ThreadIdentity& identity)
+{
+    auto [it, inserted] = threads_.try_emplace(identity.tid, Thread{identity, std::nullopt});
+
+    // An identity read after its thread's exit is older than the exit's
+    if (!inserted && !it->second.exit_ns)
+    {
+        it->second.identity = identity;
+    }
+}
+
+void RecordDecoder::track(const core::ThreadLifecycleEvent& event)
+{
+    ThreadIdentity identity{event.pid, event.tid, event.comm};
+    auto it = threads_.find(event.tid);
+
+    if (event.kind == core::ThreadLifecycleKind::kExit)
+    {
+        if (resolution_ == IdentityResolution::kOnDecode)
+        {
+            // The thread ID is free for reuse; a new thread sends its own identity
+            threads_.erase(event.tid);
+            return;
+        }
+
+        // Migrations before the exit may still be buffered in other rings
+        if (it == threads_.end())
+        {
+            threads_.emplace(event.tid, Thread{identity, event.timestamp_ns});
+            ++exited_;
+        }
+        else if (!it->second.exit_ns)
+        {
+            it->second = Thread{identity, event.timestamp_ns};
+            ++exited_;
+        }
+        return;
+    }
+
+    if (it == threads_.end())
+    {
+        threads_.emplace(event.tid, Thread{identity, std::nullopt});
+    }
+    else if (!it->second.exit_ns)
+    {
+        it->second.identity = identity;
+    }
+    else if (event.timestamp_ns > *it->second.exit_ns)
+    {
+        // A new thread reusing the ID of one that has not been retired yet
+        it->second = Thread{identity, std::nullopt};
+        --exited_;
+    }
+}
+
+void RecordDecoder::retireExited(std::uint64_t watermark_ns)
+{
+    if (exited_ == 0)
+    {
+        return;
+    }
+
+    exited_ -= std::erase_if(threads_,
+                             [watermark_ns](const auto& entry)
+                             {
+                                 const auto& exit_ns = entry.second.exit_ns;
+                                 return exit_ns && *exit_ns <= watermark_ns;
+                             });
+}
+
+void RecordDecoder::setTopologyGeneration(core::TopologyGeneration generation) noexcept
+{
+    generation_.store(generation, std::memory_order_release);
+}
+
+auto RecordDecoder::identity(std::uint32_t tid) const -> std::optional<ThreadIdentity>
+{
+    if (auto it = threads_.find(tid); it != threads_.end() && !it->second.exit_ns)
+    {
+        return it->second.identity;
+    }
+    return std::nullopt;
+}
+
+auto RecordDecoder::threadCount() const noexcept -> std::size_t
+{
+    return threads_.size() - exited_;
+}
+
+auto RecordDecoder::unresolvedMigrations() const noexcept -> std::uint64_t
+{
+    return unresolved_;
+}
+
+}  // namespace threveal::collection
@@ -0,0 +1,565 @@
+/**
+ *  @file       ringbuf_emulator.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the BPF ring buffer emulator.
+ *
+ *  The reservation and commit paths follow kernel/bpf/ringbuf.c and the
+ *  consumer follows ringbuf_process_ring() in libbpf, including where
+ *  each of them uses acquire and release ordering.
+ */
+
+#include "threveal/collection/ringbuf_emulator.hpp"
+
+#include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/core/clock.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <new>
+#include <poll.h>
+#include <span>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Shared BPF structures
+#include "bpf_common.h"
+
+namespace threveal::collection
+{
+
+namespace
+{
+
+/**
+ *  Length word flags, as BPF_RINGBUF_BUSY_BIT and BPF_RINGBUF_DISCARD_BIT.
+ */
+constexpr std::uint32_t kBusyBit = 1U << 31;
+constexpr std::uint32_t kDiscardBit = 1U << 30;
+
+/**
+ *  Spins on the reservation lock before yielding the CPU to its holder.
+ */
+constexpr int kLockSpins = 64;
+
+/**
+ *  Migrations a paced producer writes between two clock checks.
+ */
+constexpr std::uint64_t kPaceBatch = 256;
+
+static_assert(kDefaultRingbufBytes == RING_SHARD_BYTES);
+
+/**
+ *  First page: the only position the consumer writes.
+ */
+struct ConsumerPage
+{
+    std::atomic<std::uint64_t> consumer_pos{0};
+};
+
+/**
+ *  Second page: the producer position, followed by state the kernel
+ *  keeps in struct bpf_ringbuf and never exposes.
+ */
+struct ProducerPage
+{
+    std::atomic<std::uint64_t> producer_pos{0};
+
+    alignas(64) std::atomic<bool> locked{false};
+
+    /**
+     *  Oldest record that may still be busy; guarded by locked.
+     */
+    std::uint64_t pending_pos{0};
+
+    alignas(64) std::atomic<std::uint64_t> drops{0};
+    std::atomic<std::uint64_t> wakeups{0};
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+static_assert(std::atomic_ref<std::uint32_t>::is_always_lock_free);
+
+auto consumerPage(std::byte* base) noexcept -> ConsumerPage&
+{
+    return *std::launder(static_cast<ConsumerPage*>(static_cast<void*>(base)));
+}
+
+auto producerPage(std::byte* base, std::size_t page_bytes) noexcept -> ProducerPage&
+{
+    return *std::launder(static_cast<ProducerPage*>(static_cast<void*>(base + page_bytes)));
+}
+
+/**
+ *  Bytes a record occupies; the length word may still carry flags.
+ */
+constexpr auto recordBytes(std::uint32_t length) noexcept -> std::uint64_t
+{
+    auto size = static_cast<std::uint64_t>(length & ~(kBusyBit | kDiscardBit));
+    return (size + kRingbufHeaderSize + 7) & ~std::uint64_t{7};
+}
+
+/**
+ *  Length word of the record header at `header`.
+ */
+auto lengthOf(std::byte* header) noexcept -> std::atomic_ref<std::uint32_t>
+{
+    auto* word = static_cast<std::uint32_t*>(static_cast<void*>(header));
+    return std::atomic_ref<std::uint32_t>(*word);
+}
+
+/**
+ *  Takes the reservation lock; yields after a while so a preempted holder
+ *  can finish on a busy machine.
+ */
+void lock(std::atomic<bool>& locked) noexcept
+{
+    int spins = 0;
+    while (locked.exchange(true, std::memory_order_acquire))
+    {
+        while (locked.load(std::memory_order_relaxed))
+        {
+            if (++spins == kLockSpins)
+            {
+                spins = 0;
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+/**
+ *  Writes one CPU's share of produceMigrations().
+ */
+auto produceOn(RingbufEmulator& ring, const RingbufProducerOptions& options, std::size_t cpu)
+    -> RingbufProducerStats
+{
+    auto tid = options.pid + 1 + static_cast<std::uint32_t>(cpu);
+
+    thread_identity_record identity{};
+    identity.header.type = RECORD_THREAD_IDENTITY;
+    identity.header.size = sizeof(identity);
+    identity.tid = tid;
+    identity.pid = options.pid;
+    std::memcpy(identity.comm, options.comm.data(),
+                std::min(options.comm.size(), sizeof(identity.comm) - 1));
+    bool identity_sent = false;
+
+    migration_record raw{};
+    raw.header.type = RECORD_MIGRATION;
+    raw.header.size = sizeof(raw);
+    raw.tid = tid;
+    raw.src = static_cast<__u16>((cpu + 1) % options.threads);
+    raw.dst = static_cast<__u16>(cpu);
+    raw.sample_weight = 1;
+
+    // Each thread paces itself to its share of the total rate
+    auto rate = options.events_per_sec / static_cast<double>(options.threads);
+    auto start = std::chrono::steady_clock::now();
+
+    RingbufProducerStats stats;
+    for (std::uint64_t n = 0; n < options.events_per_thread; ++n)
+    {
+        if (rate > 0.0 && n % kPaceBatch == 0)
+        {
+            auto due = std::chrono::duration<double>(static_cast<double>(n) / rate);
+            std::this_thread::sleep_until(
+                start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(due));
+        }
+
+        // Like the BPF program, retry the identity until it gets through
+        if (!identity_sent)
+        {
+            identity_sent = ring.output(std::as_bytes(std::span{&identity, 1}));
+            if (!identity_sent)
+            {
+                ++stats.dropped_identities;
+            }
+        }
+
+        auto record = ring.reserve(sizeof(raw));
+        if (record.empty())
+        {
+            ++stats.dropped;
+            continue;
+        }
+        raw.timestamp_ns = core::traceTimestampNs();
+        std::memcpy(record.data(), &raw, sizeof(raw));
+        ring.submit(record);
+        ++stats.submitted;
+    }
+    return stats;
+}
+
+}  // namespace
+
+RingbufEmulator::RingbufEmulator(std::byte* base, std::size_t map_size, std::size_t page_bytes,
+                                 std::size_t data_bytes, int memfd, int event_fd,
+                                 RingbufWakeup wakeup) noexcept
+    : base_(base),
+      map_size_(map_size),
+      page_bytes_(page_bytes),
+      data_bytes_(data_bytes),
+      memfd_(memfd),
+      event_fd_(event_fd),
+      wakeup_(wakeup)
+{
+}
+
+RingbufEmulator::~RingbufEmulator()
+{
+    release();
+}
+
+RingbufEmulator::RingbufEmulator(RingbufEmulator&& other) noexcept
+    : base_(std::exchange(other.base_, nullptr)),
+      map_size_(std::exchange(other.map_size_, 0)),
+      page_bytes_(std::exchange(other.page_bytes_, 0)),
+      data_bytes_(std::exchange(other.data_bytes_, 0)),
+      memfd_(std::exchange(other.memfd_, -1)),
+      event_fd_(std::exchange(other.event_fd_, -1)),
+      wakeup_(other.wakeup_)
+{
+}
+
+auto RingbufEmulator::operator=(RingbufEmulator&& other) noexcept -> RingbufEmulator&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    release();
+    base_ = std::exchange(other.base_, nullptr);
+    map_size_ = std::exchange(other.map_size_, 0);
+    page_bytes_ = std::exchange(other.page_bytes_, 0);
+    data_bytes_ = std::exchange(other.data_bytes_, 0);
+    memfd_ = std::exchange(other.memfd_, -1);
+    event_fd_ = std::exchange(other.event_fd_, -1);
+    wakeup_ = other.wakeup_;
+    return *this;
+}
+
+void RingbufEmulator::release() noexcept
+{
+    if (base_ != nullptr)
+    {
+        munmap(base_, map_size_);
+        base_ = nullptr;
+    }
+    if (memfd_ >= 0)
+    {
+        close(memfd_);
+        memfd_ = -1;
+    }
+    if (event_fd_ >= 0)
+    {
+        close(event_fd_);
+        event_fd_ = -1;
+    }
+}
+
+auto RingbufEmulator::create(const RingbufEmulatorOptions& options)
+    -> std::expected<RingbufEmulator, EbpfError>
+{
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto data_bytes = std::bit_ceil(std::max(options.data_bytes, page));
+
+    // Like the kernel, the data area follows the two position pages and
+    // is mapped a second time right after itself
+    auto file_size = (2 * page) + data_bytes;
+    auto map_size = file_size + data_bytes;
+
+    int memfd = memfd_create("threveal-ringbuf", MFD_CLOEXEC);
+    if (memfd < 0)
+    {
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+    if (ftruncate(memfd, static_cast<off_t>(file_size)) < 0)
+    {
+        close(memfd);
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    // Reserve the whole range first so both data mappings are adjacent
+    void* region = mmap(nullptr, map_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        close(memfd);
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+    auto* base = static_cast<std::byte*>(region);
+    if (mmap(base, file_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd, 0) ==
+            MAP_FAILED ||
+        mmap(base + file_size, data_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd,
+             static_cast<off_t>(2 * page)) == MAP_FAILED)
+    {
+        munmap(region, map_size);
+        close(memfd);
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    int event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (event_fd < 0)
+    {
+        munmap(region, map_size);
+        close(memfd);
+        return std::unexpected(EbpfError::kMapAccessFailed);
+    }
+
+    // ftruncate() zero-filled the file; this only starts the objects' lifetimes
+    new (base) ConsumerPage{};
+    new (base + page) ProducerPage{};
+
+    return RingbufEmulator{base, map_size, page, data_bytes, memfd, event_fd, options.wakeup};
+}
+
+auto RingbufEmulator::reserve(std::size_t size) noexcept -> std::span<std::byte>
+{
+    auto& consumer = consumerPage(base_);
+    auto& producer = producerPage(base_, page_bytes_);
+    auto* data = base_ + (2 * page_bytes_);
+    auto mask = static_cast<std::uint64_t>(data_bytes_ - 1);
+
+    if (size == 0 || size > data_bytes_ - kRingbufHeaderSize)
+    {
+        producer.drops.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+    auto length = recordBytes(static_cast<std::uint32_t>(size));
+    auto cons_pos = consumer.consumer_pos.load(std::memory_order_acquire);
+
+    lock(producer.locked);
+
+    // Skip records committed since the last reservation; the oldest busy
+    // one bounds how far the producer may run ahead
+    auto prod_pos = producer.producer_pos.load(std::memory_order_relaxed);
+    auto pend_pos = producer.pending_pos;
+    while (pend_pos < prod_pos)
+    {
+        auto header_length = lengthOf(data + (pend_pos & mask)).load(std::memory_order_acquire);
+        if ((header_length & kBusyBit) != 0)
+        {
+            break;
+        }
+        pend_pos += recordBytes(header_length);
+    }
+    producer.pending_pos = pend_pos;
+
+    auto new_prod_pos = prod_pos + length;
+    if (new_prod_pos - cons_pos > mask || new_prod_pos - pend_pos > mask)
+    {
+        producer.locked.store(false, std::memory_order_release);
+        producer.drops.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+
+    auto* header = data + (prod_pos & mask);
+    lengthOf(header).store(static_cast<std::uint32_t>(size) | kBusyBit, std::memory_order_relaxed);
+    auto header_offset = static_cast<std::size_t>(header - base_);
+    auto page_offset = static_cast<std::uint32_t>(header_offset / page_bytes_);
+    std::memcpy(header + sizeof(std::uint32_t), &page_offset, sizeof(page_offset));
+
+    // Publishing the position makes the busy header visible to the consumer
+    producer.producer_pos.store(new_prod_pos, std::memory_order_release);
+    producer.locked.store(false, std::memory_order_release);
+
+    return std::span{header + kRingbufHeaderSize, size};
+}
+
+void RingbufEmulator::submit(std::span<std::byte> record) noexcept
+{
+    commit(record, false);
+}
+
+void RingbufEmulator::discard(std::span<std::byte> record) noexcept
+{
+    commit(record, true);
+}
+
+void RingbufEmulator::commit(std::span<std::byte> record, bool discarded) noexcept
+{
+    auto& consumer = consumerPage(base_);
+    auto& producer = producerPage(base_, page_bytes_);
+    auto* data = base_ + (2 * page_bytes_);
+    auto* header = record.data() - kRingbufHeaderSize;
+
+    auto length = lengthOf(header);
+    auto new_length = length.load(std::memory_order_relaxed) & ~kBusyBit;
+    if (discarded)
+    {
+        new_length |= kDiscardBit;
+    }
+    length.exchange(new_length, std::memory_order_acq_rel);
+
+    // Wake the consumer only if it is waiting on exactly this record
+    auto rec_pos = static_cast<std::uint64_t>(header - data);
+    auto cons_pos = consumer.consumer_pos.load(std::memory_order_acquire) &
+                    static_cast<std::uint64_t>(data_bytes_ - 1);
+    bool wake = (wakeup_ == RingbufWakeup::kForce) ||
+                (wakeup_ == RingbufWakeup::kAdaptive && cons_pos == rec_pos);
+    if (wake)
+    {
+        producer.wakeups.fetch_add(1, std::memory_order_relaxed);
+        eventfd_write(event_fd_, 1);
+    }
+}
+
+auto RingbufEmulator::output(std::span<const std::byte> record) noexcept -> bool
+{
+    auto reserved = reserve(record.size());
+    if (reserved.empty())
+    {
+        return false;
+    }
+    std::ranges::copy(record, reserved.begin());
+    submit(reserved);
+    return true;
+}
+
+auto RingbufEmulator::consume(const RingbufSampleFn& callback, std::size_t max_records) -> long
+{
+    auto& consumer = consumerPage(base_);
+    auto& producer = producerPage(base_, page_bytes_);
+    auto* data = base_ + (2 * page_bytes_);
+    auto mask = static_cast<std::uint64_t>(data_bytes_ - 1);
+
+    long count = 0;
+    auto cons_pos = consumer.consumer_pos.load(std::memory_order_acquire);
+    bool got_new_data = true;
+    while (got_new_data)
+    {
+        got_new_data = false;
+        auto prod_pos = producer.producer_pos.load(std::memory_order_acquire);
+        while (cons_pos < prod_pos)
+        {
+            auto* header = data + (cons_pos & mask);
+            auto length = lengthOf(header).load(std::memory_order_acquire);
+
+            // A busy record holds back everything after it
+            if ((length & kBusyBit) != 0)
+            {
+                return count;
+            }
+
+            got_new_data = true;
+            cons_pos += recordBytes(length);
+            if ((length & kDiscardBit) == 0)
+            {
+                // The second mapping keeps records that wrap contiguous
+                int result = callback(std::span<const std::byte>{header + kRingbufHeaderSize,
+                                                                 length & ~kDiscardBit});
+                if (result < 0)
+                {
+                    consumer.consumer_pos.store(cons_pos, std::memory_order_release);
+                    return result;
+                }
+                ++count;
+            }
+            consumer.consumer_pos.store(cons_pos, std::memory_order_release);
+
+            if (static_cast<std::size_t>(count) >= max_records)
+            {
+                return count;
+            }
+        }
+    }
+    return count;
+}
+
+auto RingbufEmulator::poll(const RingbufSampleFn& callback, std::chrono::milliseconds timeout)
+    -> long
+{
+    pollfd descriptor{};
+    descriptor.fd = event_fd_;
+    descriptor.events = POLLIN;
+    int ready = ::poll(&descriptor, 1, static_cast<int>(timeout.count()));
+    if (ready < 0)
+    {
+        return (errno == EINTR) ? 0 : -errno;
+    }
+    if (ready == 0)
+    {
+        return 0;
+    }
+
+    // Clear the wakeup before reading so one arriving meanwhile is kept
+    eventfd_t wakeups = 0;
+    eventfd_read(event_fd_, &wakeups);
+    return consume(callback);
+}
+
+auto RingbufEmulator::eventFd() const noexcept -> int
+{
+    return event_fd_;
+}
+
+auto RingbufEmulator::capacity() const noexcept -> std::size_t
+{
+    return data_bytes_;
+}
+
+auto RingbufEmulator::availableBytes() const noexcept -> std::size_t
+{
+    const auto& consumer = consumerPage(base_);
+    const auto& producer = producerPage(base_, page_bytes_);
+    auto cons_pos = consumer.consumer_pos.load(std::memory_order_acquire);
+    auto prod_pos = producer.producer_pos.load(std::memory_order_acquire);
+    return static_cast<std::size_t>(prod_pos - cons_pos);
+}
+
+auto RingbufEmulator::drops() const noexcept -> std::uint64_t
+{
+    const auto& producer = producerPage(base_, page_bytes_);
+    return producer.drops.load(std::memory_order_relaxed);
+}
+
+auto RingbufEmulator::wakeups() const noexcept -> std::uint64_t
+{
+    const auto& producer = producerPage(base_, page_bytes_);
+    return producer.wakeups.load(std::memory_order_relaxed);
+}
+
+auto produceMigrations(RingbufEmulator& ring, const RingbufProducerOptions& options)
+    -> RingbufProducerStats
+{
+    if (options.threads == 0)
+    {
+        return {};
+    }
+
+    std::vector<RingbufProducerStats> per_thread(options.threads);
+    {
+        std::vector<std::jthread> workers;
+        workers.reserve(options.threads);
+        for (std::size_t cpu = 0; cpu < options.threads; ++cpu)
+        {
+            workers.emplace_back(
+                [&ring, &options, &per_thread, cpu]
+                {
+                    per_thread[cpu] = produceOn(ring, options, cpu);
+                });
+        }
+    }
+
+    RingbufProducerStats total;
+    for (const auto& stats : per_thread)
+    {
+        total.submitted += stats.submitted;
+        total.dropped += stats.dropped;
+        total.dropped_identities += stats.dropped_identities;
+    }
+    return total;
+}
+
+}  // namespace threveal::collection
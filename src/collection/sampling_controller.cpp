@@ -0,0 +1,59 @@
+/**
+ *  @file       sampling_controller.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the SamplingController class.
+ */
+
+#include "threveal/collection/sampling_controller.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace threveal::collection
+{
+
+SamplingController::SamplingController(SamplingPolicy policy) noexcept : policy_(policy)
+{
+    policy_.max_rate = std::max<std::uint32_t>(policy_.max_rate, 1);
+}
+
+auto SamplingController::update(const SamplingObservation& observation) noexcept
+    -> std::uint32_t
+{
+    using Seconds = std::chrono::duration<double>;
+
+    double seconds = std::chrono::duration_cast<Seconds>(observation.elapsed).count();
+    double events_per_sec =
+        (seconds > 0.0) ? static_cast<double>(observation.events) / seconds : 0.0;
+    bool has_budget = policy_.event_budget_per_sec > 0.0;
+
+    bool overloaded = observation.drops > 0 || observation.fill >= policy_.high_fill ||
+                      (has_budget && events_per_sec > policy_.event_budget_per_sec);
+    if (overloaded)
+    {
+        rate_ = (rate_ > policy_.max_rate / 2) ? policy_.max_rate : rate_ * 2;
+        return rate_;
+    }
+
+    // Halving the rate roughly doubles the delivered events
+    bool fits_budget = !has_budget || events_per_sec * 2.0 <= policy_.event_budget_per_sec;
+    if (rate_ > 1 && observation.fill <= policy_.low_fill && fits_budget)
+    {
+        rate_ /= 2;
+    }
+    return rate_;
+}
+
+auto SamplingController::rate() const noexcept -> std::uint32_t
+{
+    return rate_;
+}
+
+auto SamplingController::policy() const noexcept -> const SamplingPolicy&
+{
+    return policy_;
+}
+
+}  // namespace threveal::collection
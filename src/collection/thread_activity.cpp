@@ -0,0 +1,55 @@
+/**
+ *  @file       thread_activity.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the thread activity view.
+ */
+
+#include "threveal/collection/thread_activity.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Shared BPF structures
+#include "bpf_common.h"
+
+namespace threveal::collection
+{
+
+ThreadActivityMap::ThreadActivityMap(thread_activity_block* blocks,
+                                     std::size_t block_count) noexcept
+    : blocks_(blocks), block_count_(blocks != nullptr ? block_count : 0)
+{
+}
+
+auto ThreadActivityMap::ranSinceLastCheck(std::uint32_t tid) const noexcept -> bool
+{
+    auto index = static_cast<std::size_t>(tid) / ACTIVITY_BLOCK_THREADS;
+    if (index >= block_count_)
+    {
+        return true;
+    }
+
+    auto& block = blocks_[index];
+    auto slot = tid % ACTIVITY_BLOCK_THREADS;
+
+    // on_cpu first: a thread switched out after this load has set ran
+    bool on_cpu = std::atomic_ref<std::uint8_t>(block.on_cpu[slot]).load(
+                      std::memory_order_acquire) != 0;
+    bool ran = std::atomic_ref<std::uint8_t>(block.ran[slot]).exchange(
+                   0, std::memory_order_acq_rel) != 0;
+    return ran || on_cpu;
+}
+
+auto ThreadActivityMap::isMapped() const noexcept -> bool
+{
+    return blocks_ != nullptr;
+}
+
+auto ThreadActivityMap::capacity() const noexcept -> std::size_t
+{
+    return block_count_ * ACTIVITY_BLOCK_THREADS;
+}
+
+}  // namespace threveal::collection
@@ -0,0 +1,213 @@
+/**
+ *  @file       topology_watcher.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the TopologyWatcher class.
+ */
+
+#include "threveal/collection/topology_watcher.hpp"
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/topology_handle.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <expected>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+namespace threveal::collection
+{
+
+TopologyWatcher::TopologyWatcher(core::TopologyHandle& handle, TopologyChangeCallback on_change,
+                                 std::chrono::milliseconds interval,
+                                 TopologyLoader loader) noexcept
+    : handle_(&handle),
+      on_change_(std::move(on_change)),
+      interval_(interval),
+      loader_(std::move(loader))
+{
+}
+
+TopologyWatcher::~TopologyWatcher()
+{
+    stop();
+}
+
+TopologyWatcher::TopologyWatcher(TopologyWatcher&& other) noexcept
+    : handle_(other.handle_),
+      on_change_(std::move(other.on_change_)),
+      interval_(other.interval_),
+      loader_(std::move(other.loader_)),
+      watch_thread_(std::move(other.watch_thread_)),
+      change_count_(other.change_count_.load()),
+      running_(other.running_.load())
+{
+    other.change_count_ = 0;
+    other.running_ = false;
+}
+
+auto TopologyWatcher::operator=(TopologyWatcher&& other) noexcept -> TopologyWatcher&
+{
+    if (this != &other)
+    {
+        stop();
+
+        handle_ = other.handle_;
+        on_change_ = std::move(other.on_change_);
+        interval_ = other.interval_;
+        loader_ = std::move(other.loader_);
+        watch_thread_ = std::move(other.watch_thread_);
+        change_count_ = other.change_count_.load();
+        running_ = other.running_.load();
+
+        other.change_count_ = 0;
+        other.running_ = false;
+    }
+    return *this;
+}
+
+auto TopologyWatcher::create(core::TopologyHandle& handle, TopologyChangeCallback on_change,
+                             std::chrono::milliseconds interval, TopologyLoader loader)
+    -> std::expected<TopologyWatcher, core::TopologyError>
+{
+    if (!loader)
+    {
+        return std::unexpected(core::TopologyError::kInvalidState);
+    }
+
+    // Fail early if the topology source is unusable on this system
+    auto initial = loader();
+    if (!initial)
+    {
+        return std::unexpected(initial.error());
+    }
+
+    // Enforce minimum interval to keep sysfs rescans cheap
+    if (interval < kMinInterval)
+    {
+        interval = kMinInterval;
+    }
+
+    TopologyWatcher watcher{handle, std::move(on_change), interval, std::move(loader)};
+
+    if (*initial != handle.load()->map)
+    {
+        watcher.publishChange(std::move(*initial));
+    }
+
+    return watcher;
+}
+
+auto TopologyWatcher::start() -> std::expected<void, core::TopologyError>
+{
+    if (running_.load(std::memory_order_acquire))
+    {
+        return std::unexpected(core::TopologyError::kInvalidState);
+    }
+
+    running_.store(true, std::memory_order_release);
+
+    watch_thread_ = std::jthread(
+        [this](const std::stop_token& stop_token)
+        {
+            watchLoop(stop_token);
+        });
+
+    return {};
+}
+
+void TopologyWatcher::stop() noexcept
+{
+    if (!running_.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    if (watch_thread_.joinable())
+    {
+        watch_thread_.request_stop();
+        watch_thread_.join();
+    }
+
+    running_.store(false, std::memory_order_release);
+}
+
+auto TopologyWatcher::checkNow() -> bool
+{
+    auto fresh = loader_();
+    if (!fresh)
+    {
+        return false;
+    }
+
+    // The handle is only written from here, so comparing then publishing is safe
+    auto current = handle_->load();
+    if (*fresh == current->map)
+    {
+        return false;
+    }
+
+    publishChange(std::move(*fresh));
+    return true;
+}
+
+void TopologyWatcher::publishChange(core::TopologyMap map)
+{
+    handle_->publish(std::move(map));
+    change_count_.fetch_add(1, std::memory_order_relaxed);
+
+    if (on_change_)
+    {
+        on_change_(*handle_->load());
+    }
+}
+
+void TopologyWatcher::watchLoop(const std::stop_token& stop_token)
+{
+    // Wait on a condition variable rather than sleeping, so stop() does not
+    // have to wait out a full interval
+    std::mutex mutex;
+    std::condition_variable_any wakeup;
+
+    while (!stop_token.stop_requested())
+    {
+        {
+            std::unique_lock lock(mutex);
+            wakeup.wait_for(lock, stop_token, interval_,
+                            []
+                            {
+                                return false;
+                            });
+        }
+
+        if (stop_token.stop_requested())
+        {
+            break;
+        }
+
+        checkNow();
+    }
+}
+
+auto TopologyWatcher::isRunning() const noexcept -> bool
+{
+    return running_.load(std::memory_order_acquire);
+}
+
+auto TopologyWatcher::changeCount() const noexcept -> std::uint64_t
+{
+    return change_count_.load(std::memory_order_relaxed);
+}
+
+auto TopologyWatcher::interval() const noexcept -> std::chrono::milliseconds
+{
+    return interval_;
+}
+
+}  // namespace threveal::collection
@@ -0,0 +1,81 @@
+/**
+ *  @file       clock.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the trace clock.
+ */
+
+#include "threveal/core/clock.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <time.h>
+
+namespace threveal::core
+{
+
+namespace
+{
+
+std::atomic<ClockSource> g_trace_clock{ClockSource::kMonotonic};
+
+}  // namespace
+
+auto readClockNs(clockid_t clock_id) noexcept -> std::uint64_t
+{
+    timespec ts{};
+    clock_gettime(clock_id, &ts);
+
+    // Convert to nanoseconds, handling potential overflow for long uptimes
+    constexpr std::uint64_t kNsPerSecond = 1'000'000'000ULL;
+    return (static_cast<std::uint64_t>(ts.tv_sec) * kNsPerSecond) +
+           static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+void setTraceClock(ClockSource source) noexcept
+{
+    g_trace_clock.store(source, std::memory_order_relaxed);
+}
+
+auto traceClock() noexcept -> ClockSource
+{
+    return g_trace_clock.load(std::memory_order_relaxed);
+}
+
+auto traceTimestampNs() noexcept -> std::uint64_t
+{
+    return readClockNs(traceClock());
+}
+
+auto captureClockSnapshot(ClockSource source, std::size_t attempts) -> ClockSnapshot
+{
+    auto clock_id = toClockId(source);
+
+    ClockSnapshot best{.source = source,
+                       .uncertainty_ns = std::numeric_limits<std::uint64_t>::max()};
+    for (std::size_t attempt = 0; attempt < std::max<std::size_t>(attempts, 1); ++attempt)
+    {
+        auto before = readClockNs(clock_id);
+        auto realtime = readClockNs(CLOCK_REALTIME);
+        auto monotonic = readClockNs(CLOCK_MONOTONIC);
+        auto boottime = readClockNs(CLOCK_BOOTTIME);
+        auto after = readClockNs(clock_id);
+
+        auto width = after - before;
+        if (width < best.uncertainty_ns)
+        {
+            // Attribute the other readings to the middle of the bracket
+            best.trace_ns = before + (width / 2);
+            best.realtime_ns = realtime;
+            best.monotonic_ns = monotonic;
+            best.boottime_ns = boottime;
+            best.uncertainty_ns = width;
+        }
+    }
+    return best;
+}
+
+}  // namespace threveal::core
@@ -8,26 +8,23 @@
 #include "threveal/core/events.hpp"
 
 #include "threveal/core/topology.hpp"
+#include "threveal/core/topology_handle.hpp"
 #include "threveal/core/types.hpp"
 
 namespace threveal::core
 {
 
-auto classifyMigration(const MigrationEvent& event, const TopologyMap& topology) -> MigrationType
+auto classifyCoreTypes(CoreType src_type, CoreType dst_type) noexcept -> MigrationType
 {
-    auto src_type = topology.getCoreType(event.src_cpu);
-    auto dst_type = topology.getCoreType(event.dst_cpu);
-
-    // If either CPU lookup fails, we can't classify
-    if (!src_type || !dst_type)
+    if (src_type == CoreType::kUnknown || dst_type == CoreType::kUnknown)
     {
         return MigrationType::kUnknown;
     }
 
     // Classify based on source and destination core types
-    if (*src_type == CoreType::kPCore)
+    if (src_type == CoreType::kPCore)
     {
-        if (*dst_type == CoreType::kPCore)
+        if (dst_type == CoreType::kPCore)
         {
             return MigrationType::kPToP;
         }
@@ -35,11 +32,36 @@ auto classifyMigration(const MigrationEvent& event, const TopologyMap& topology)
     }
 
     // Source is E-core
-    if (*dst_type == CoreType::kPCore)
+    if (dst_type == CoreType::kPCore)
     {
         return MigrationType::kEToP;
     }
     return MigrationType::kEToE;
 }
 
+auto classifyMigration(const MigrationEvent& event, const TopologyMap& topology) -> MigrationType
+{
+    auto src_type = topology.getCoreType(event.src_cpu);
+    auto dst_type = topology.getCoreType(event.dst_cpu);
+
+    // If either CPU lookup fails, we can't classify
+    if (!src_type || !dst_type)
+    {
+        return MigrationType::kUnknown;
+    }
+
+    return classifyCoreTypes(*src_type, *dst_type);
+}
+
+auto classifyMigration(const MigrationEvent& event, const TopologyHandle& handle) -> MigrationType
+{
+    if (event.src_type != CoreType::kUnknown && event.dst_type != CoreType::kUnknown)
+    {
+        return classifyCoreTypes(event.src_type, event.dst_type);
+    }
+
+    auto snapshot = handle.load();
+    return classifyMigration(event, snapshot->map);
+}
+
 }  // namespace threveal::core
@@ -11,15 +11,20 @@
 #include "threveal/core/types.hpp"
 
 #include <algorithm>
+#include <array>
 #include <charconv>
 #include <cstddef>
+#include <dirent.h>
 #include <expected>
-#include <filesystem>
-#include <fstream>
+#include <fcntl.h>
+#include <functional>
+#include <optional>
 #include <span>
 #include <string>
 #include <string_view>
 #include <system_error>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 namespace threveal::core
@@ -28,30 +33,6 @@ namespace threveal::core
 namespace
 {
 
-/**
- *  Trims leading and trailing whitespace from a string view.
- *
- *  @param      str  The string view to trim.
- *  @return     A string view with whitespace removed from both ends.
- */
-[[nodiscard]] constexpr auto trim(std::string_view str) noexcept -> std::string_view
-{
-    const char* whitespace = " \t\n\r";
-
-    // Find first non-whitespace character
-    auto start = str.find_first_not_of(whitespace);
-    if (start == std::string_view::npos)
-    {
-        // String is all whitespace
-        return {};
-    }
-
-    // Find last non-whitespace character
-    auto end = str.find_last_not_of(whitespace);
-
-    return str.substr(start, end - start + 1);
-}
-
 /**
  *  Parses a single unsigned integer from a string view.
  *
@@ -145,127 +126,185 @@ namespace
     return {};
 }
 
-// Sysfs paths for Intel hybrid CPU topology detection
-constexpr std::string_view kPCoreSysfsPath = "/sys/devices/cpu_core/cpus";
-constexpr std::string_view kECoreSysfsPath = "/sys/devices/cpu_atom/cpus";
-constexpr std::string_view kCpuBasePath = "/sys/devices/system/cpu";
+// Sysfs locations, relative to the sysfs root
+constexpr std::string_view kDefaultSysfsRoot = "/sys";
+constexpr const char* kDevicesDir = "devices";
+constexpr const char* kCpuDir = "system/cpu";
+constexpr const char* kPCoreListFile = "cpu_core/cpus";
+constexpr const char* kECoreListFile = "cpu_atom/cpus";
+constexpr const char* kPresentListFile = "present";
+constexpr const char* kOnlineListFile = "online";
+constexpr const char* kIsolatedListFile = "isolated";
+
+// Stack buffer sizes; CPU lists are compact ranges even on 256-CPU hosts
+constexpr std::size_t kListBufferSize = 4096;
+constexpr std::size_t kValueBufferSize = 64;
+constexpr std::size_t kPathBufferSize = 64;
 
 /**
- *  Reads the entire contents of a file into a string.
- *
- *  @param      path  The filesystem path to read.
- *  @return     The file contents on success, or TopologyError indicating
- *              why the read failed.
+ *  Owning wrapper for a directory file descriptor.
  */
-[[nodiscard]] auto readFileContents(std::string_view path)
-    -> std::expected<std::string, TopologyError>
+class DirectoryFd
 {
-    std::ifstream file{std::string(path)};
+  public:
+    explicit DirectoryFd(int fd) noexcept : fd_(fd) {}
 
-    if (!file.is_open())
+    ~DirectoryFd()
     {
-        // Could be permission denied or file not found
-        return std::unexpected(TopologyError::kSysfsNotFound);
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
     }
 
-    std::string content;
-    if (!std::getline(file, content))
+    DirectoryFd(const DirectoryFd&) = delete;
+    auto operator=(const DirectoryFd&) -> DirectoryFd& = delete;
+    DirectoryFd(DirectoryFd&&) = delete;
+    auto operator=(DirectoryFd&&) -> DirectoryFd& = delete;
+
+    [[nodiscard]] auto get() const noexcept -> int
     {
-        // File exists but is empty or unreadable
-        return std::unexpected(TopologyError::kParseError);
+        return fd_;
+    }
+
+    [[nodiscard]] auto isValid() const noexcept -> bool
+    {
+        return fd_ >= 0;
+    }
+
+  private:
+    int fd_;
+};
+
+/**
+ *  Reads a small sysfs file relative to a directory descriptor.
+ *
+ *  Sysfs attributes are returned in a single read(), so no loop is needed.
+ *
+ *  @param      dir_fd         Directory the path is relative to.
+ *  @param      relative_path  Null-terminated path below dir_fd.
+ *  @param      buffer         Caller-provided storage for the contents.
+ *  @return     The trimmed contents (a view into buffer), or std::nullopt
+ *              if the file cannot be opened or read.
+ */
+[[nodiscard]] auto readAt(int dir_fd, const char* relative_path, std::span<char> buffer)
+    -> std::optional<std::string_view>
+{
+    int fd = openat(dir_fd, relative_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::nullopt;
     }
 
-    return content;
+    ssize_t bytes_read = read(fd, buffer.data(), buffer.size());
+    close(fd);
+
+    if (bytes_read < 0)
+    {
+        return std::nullopt;
+    }
+
+    return trim(std::string_view(buffer.data(), static_cast<std::size_t>(bytes_read)));
 }
 
 /**
- *  Loads topology using per-CPU core_type files (Linux 5.18+).
+ *  Builds "cpu<N>/topology/<leaf>" into a stack buffer.
  *
- *  @return     A populated TopologyMap on success, or TopologyError
- *              indicating why detection failed.
+ *  @param      buffer  Storage for the null-terminated path.
+ *  @param      cpu     The logical CPU.
+ *  @param      leaf    Attribute name below topology/.
+ *  @return     Pointer to the path in buffer.
  */
-[[nodiscard]] auto loadFromCoreType() -> std::expected<TopologyMap, TopologyError>
+[[nodiscard]] auto cpuTopologyPath(std::span<char> buffer, CpuId cpu, std::string_view leaf)
+    -> const char*
 {
-    namespace fs = std::filesystem;
+    constexpr std::string_view kPrefix = "cpu";
+    constexpr std::string_view kMiddle = "/topology/";
 
-    std::vector<CpuId> p_cores;
-    std::vector<CpuId> e_cores;
+    auto* out = std::ranges::copy(kPrefix, buffer.data()).out;
+    out = std::to_chars(out, buffer.data() + buffer.size(), cpu).ptr;
+    out = std::ranges::copy(kMiddle, out).out;
+    out = std::ranges::copy(leaf, out).out;
+    *out = '\0';
 
-    std::error_code ec;
-    auto dir_iter = fs::directory_iterator(kCpuBasePath, ec);
-    if (ec)
+    return buffer.data();
+}
+
+/**
+ *  Reads and parses an optional CPU list relative to a directory.
+ *
+ *  @return     The parsed list, or std::nullopt if missing or malformed.
+ */
+[[nodiscard]] auto readCpuListAt(int dir_fd, const char* relative_path, std::span<char> buffer)
+    -> std::optional<std::vector<CpuId>>
+{
+    auto content = readAt(dir_fd, relative_path, buffer);
+    if (!content)
     {
-        return std::unexpected(TopologyError::kSysfsNotFound);
+        return std::nullopt;
     }
 
-    for (const auto& entry : dir_iter)
+    // An empty list (e.g. no isolated CPUs) is valid
+    if (content->empty())
     {
-        // Skip non-directories
-        if (!entry.is_directory(ec) || ec)
-        {
-            continue;
-        }
+        return std::vector<CpuId>{};
+    }
 
-        // Check for cpu[0-9]+ pattern
-        auto filename = entry.path().filename().string();
-        if (filename.size() < 4 || filename.substr(0, 3) != "cpu")
-        {
-            continue;
-        }
+    auto parsed = parseCpuList(*content);
+    if (!parsed)
+    {
+        return std::nullopt;
+    }
+    return std::move(*parsed);
+}
 
-        // Parse the CPU ID from directory name
-        auto cpu_id_str = std::string_view(filename).substr(3);
-        auto cpu_id = parseNumber(cpu_id_str);
-        if (!cpu_id)
-        {
-            // Not a numeric CPU directory
-            continue;
-        }
+/**
+ *  Lists the CPUs that have a cpu<N> directory below dir_fd.
+ *
+ *  @param      dir_fd  The sysfs cpu directory; not closed or moved.
+ *  @return     The CPU IDs in ascending order, empty if the directory
+ *              cannot be read.
+ */
+[[nodiscard]] auto listCpuDirectories(int dir_fd) -> std::vector<CpuId>
+{
+    std::vector<CpuId> cpus;
 
-        // Read this CPU's core_type file
-        auto core_type_path = entry.path() / "topology" / "core_type";
-        auto core_type_content = readFileContents(core_type_path.string());
-        if (!core_type_content)
-        {
-            // core_type not available for this CPU
-            continue;
-        }
+    // fdopendir() takes ownership, so hand it a duplicate
+    int fd = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return cpus;
+    }
+    DIR* dir = fdopendir(fd);
+    if (dir == nullptr)
+    {
+        close(fd);
+        return cpus;
+    }
 
-        auto core_type = parseCoreType(*core_type_content);
-        if (!core_type)
+    constexpr std::string_view kPrefix = "cpu";
+    while (const dirent* entry = readdir(dir))
+    {
+        if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
         {
-            // Unknown core type string
             continue;
         }
 
-        // Classify the CPU
-        if (*core_type == CoreType::kPCore)
+        // Only cpu[0-9]+; skips cpufreq, cpuidle and the like
+        std::string_view name(entry->d_name);
+        if (!name.starts_with(kPrefix) || name.size() == kPrefix.size())
         {
-            p_cores.push_back(*cpu_id);
+            continue;
         }
-        else if (*core_type == CoreType::kECore)
+        if (auto cpu = parseNumber(name.substr(kPrefix.size())))
         {
-            e_cores.push_back(*cpu_id);
+            cpus.push_back(*cpu);
         }
     }
+    closedir(dir);
 
-    // Validate that we found CPUs
-    if (p_cores.empty() && e_cores.empty())
-    {
-        return std::unexpected(TopologyError::kSysfsNotFound);
-    }
-
-    // Validate hybrid configuration
-    if (p_cores.empty() || e_cores.empty())
-    {
-        return std::unexpected(TopologyError::kNotHybridCpu);
-    }
-
-    // Sort for consistent ordering
-    std::ranges::sort(p_cores);
-    std::ranges::sort(e_cores);
-
-    return TopologyMap{p_cores, e_cores};
+    std::ranges::sort(cpus);
+    return cpus;
 }
 
 }  // namespace
@@ -339,42 +378,189 @@ auto TopologyMap::isSmtSibling(CpuId cpu_a, CpuId cpu_b) const noexcept -> bool
 
 auto TopologyMap::loadFromSysfs() -> std::expected<TopologyMap, TopologyError>
 {
+    return loadFromSysfsRoot(kDefaultSysfsRoot);
+}
+
+auto TopologyMap::loadFromSysfsRoot(std::string_view sysfs_root)
+    -> std::expected<TopologyMap, TopologyError>
+{
+    auto devices_path = std::string(sysfs_root) + "/" + kDevicesDir;
+    DirectoryFd devices{open(devices_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    if (!devices.isValid())
+    {
+        return std::unexpected(TopologyError::kSysfsNotFound);
+    }
+
+    DirectoryFd cpu_dir{openat(devices.get(), kCpuDir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    if (!cpu_dir.isValid())
+    {
+        return std::unexpected(TopologyError::kSysfsNotFound);
+    }
+
+    std::array<char, kListBufferSize> list_buffer{};
+    std::vector<CpuId> p_cores;
+    std::vector<CpuId> e_cores;
+
     // Primary method: use cpu_core/cpu_atom sysfs entries (Linux 5.13+)
-    auto p_core_content = readFileContents(kPCoreSysfsPath);
+    auto p_core_content = readAt(devices.get(), kPCoreListFile, list_buffer);
+    bool use_core_type = !p_core_content.has_value();
     if (p_core_content)
     {
-        // P-cores sysfs exists, continue with primary method
-        auto p_cores = parseCpuList(*p_core_content);
-        if (!p_cores)
+        auto parsed_p = parseCpuList(*p_core_content);
+        if (!parsed_p)
         {
-            return std::unexpected(p_cores.error());
+            return std::unexpected(parsed_p.error());
         }
+        p_cores = std::move(*parsed_p);
 
-        auto e_core_content = readFileContents(kECoreSysfsPath);
+        auto e_core_content = readAt(devices.get(), kECoreListFile, list_buffer);
         if (!e_core_content)
         {
             // P-cores exist but E-cores don't - not a hybrid CPU
             return std::unexpected(TopologyError::kNotHybridCpu);
         }
 
-        auto e_cores = parseCpuList(*e_core_content);
-        if (!e_cores)
+        auto parsed_e = parseCpuList(*e_core_content);
+        if (!parsed_e)
+        {
+            return std::unexpected(parsed_e.error());
+        }
+        e_cores = std::move(*parsed_e);
+    }
+
+    auto present = readCpuListAt(cpu_dir.get(), kPresentListFile, list_buffer);
+    auto online = readCpuListAt(cpu_dir.get(), kOnlineListFile, list_buffer);
+    auto isolated = readCpuListAt(cpu_dir.get(), kIsolatedListFile, list_buffer);
+
+    std::vector<CpuId> cpus;
+    if (present)
+    {
+        cpus = std::move(*present);
+    }
+    else if (use_core_type)
+    {
+        // Without a present list or PMU lists, walk the cpu<N> directories
+        cpus = listCpuDirectories(cpu_dir.get());
+    }
+    else
+    {
+        // Without a present list, visit the CPUs the PMU lists name
+        cpus = p_cores;
+        cpus.insert(cpus.end(), e_cores.begin(), e_cores.end());
+        std::ranges::sort(cpus);
+    }
+
+    // Single pass over per-CPU files: core_type (fallback, Linux 5.18+) and core_id
+    std::array<char, kPathBufferSize> path{};
+    std::array<char, kValueBufferSize> value{};
+    std::vector<std::pair<CpuId, CpuId>> core_ids;
+    core_ids.reserve(cpus.size());
+
+    for (CpuId cpu : cpus)
+    {
+        if (use_core_type)
+        {
+            // CPUs without a readable or known core_type are left unclassified
+            auto content = readAt(cpu_dir.get(), cpuTopologyPath(path, cpu, "core_type"), value);
+            if (content)
+            {
+                auto core_type = parseCoreType(*content);
+                if (core_type == CoreType::kPCore)
+                {
+                    p_cores.push_back(cpu);
+                }
+                else if (core_type == CoreType::kECore)
+                {
+                    e_cores.push_back(cpu);
+                }
+            }
+        }
+
+        auto core_id_content = readAt(cpu_dir.get(), cpuTopologyPath(path, cpu, "core_id"), value);
+        if (core_id_content)
+        {
+            if (auto core_id = parseNumber(*core_id_content))
+            {
+                core_ids.emplace_back(cpu, *core_id);
+            }
+        }
+    }
+
+    if (use_core_type)
+    {
+        // Validate that we found CPUs
+        if (p_cores.empty() && e_cores.empty())
+        {
+            return std::unexpected(TopologyError::kSysfsNotFound);
+        }
+
+        // Validate hybrid configuration
+        if (p_cores.empty() || e_cores.empty())
         {
-            return std::unexpected(e_cores.error());
+            return std::unexpected(TopologyError::kNotHybridCpu);
         }
+    }
+
+    TopologyMap map{p_cores, e_cores};
 
-        TopologyMap map{*p_cores, *e_cores};
-        map.loadSmtData();
-        return map;
+    // SMT data covers every CPU up to the highest classified one
+    map.physical_core_id_.assign(map.cpu_to_type_.size(), kInvalidCpuId);
+    for (auto [cpu, core_id] : core_ids)
+    {
+        if (cpu < map.physical_core_id_.size())
+        {
+            map.physical_core_id_[cpu] = core_id;
+        }
     }
 
-    // Fallback: use per-CPU core_type files (Linux 5.18+)
-    auto fallback_result = loadFromCoreType();
-    if (fallback_result)
+    if (online)
     {
-        fallback_result->loadSmtData();
+        map = map.withOnlineCpus(*online);
     }
-    return fallback_result;
+    if (isolated)
+    {
+        map = map.withIsolatedCpus(*isolated);
+    }
+
+    return map;
+}
+
+auto TopologyMap::isIsolated(CpuId cpu_id) const noexcept -> bool
+{
+    return std::ranges::binary_search(isolated_, cpu_id);
+}
+
+auto TopologyMap::getIsolatedCpus() const noexcept -> std::span<const CpuId>
+{
+    return isolated_;
+}
+
+auto TopologyMap::withOnlineCpus(std::span<const CpuId> online) const -> TopologyMap
+{
+    std::vector<CpuId> sorted_online(online.begin(), online.end());
+    std::ranges::sort(sorted_online);
+
+    auto is_online = [&sorted_online](CpuId cpu)
+    {
+        return std::ranges::binary_search(sorted_online, cpu);
+    };
+
+    TopologyMap result = *this;
+    std::erase_if(result.p_cores_, std::not_fn(is_online));
+    std::erase_if(result.e_cores_, std::not_fn(is_online));
+
+    // Rebuild from scratch so dropped CPUs read as kUnknown
+    result.cpu_to_type_.clear();
+    result.buildLookupTable();
+    return result;
+}
+
+auto TopologyMap::withIsolatedCpus(std::span<const CpuId> isolated) const -> TopologyMap
+{
+    TopologyMap result = *this;
+    result.isolated_.assign(isolated.begin(), isolated.end());
+    std::ranges::sort(result.isolated_);
+    return result;
 }
 
 void TopologyMap::buildLookupTable()
@@ -407,42 +593,16 @@ void TopologyMap::buildLookupTable()
     }
 }
 
-void TopologyMap::loadSmtData()
+auto TopologyMap::getPhysicalCoreIds() const noexcept -> std::span<const CpuId>
 {
-    namespace fs = std::filesystem;
-
-    // Find max CPU ID to size the vector
-    CpuId max_cpu = 0;
-    for (CpuId cpu : p_cores_)
-    {
-        max_cpu = std::max(max_cpu, cpu);
-    }
-    for (CpuId cpu : e_cores_)
-    {
-        max_cpu = std::max(max_cpu, cpu);
-    }
-
-    // Initialize with invalid values
-    physical_core_id_.resize(max_cpu + 1, kInvalidCpuId);
-
-    // Read physical core ID for each CPU
-    for (CpuId cpu = 0; cpu <= max_cpu; ++cpu)
-    {
-        auto path = fs::path(kCpuBasePath) / ("cpu" + std::to_string(cpu)) / "topology" / "core_id";
-        auto content = readFileContents(path.string());
-        if (!content)
-        {
-            continue;
-        }
-
-        auto core_id = parseNumber(trim(*content));
-        if (!core_id)
-        {
-            continue;
-        }
+    return physical_core_id_;
+}
 
-        physical_core_id_[cpu] = *core_id;
-    }
+auto TopologyMap::withPhysicalCoreIds(std::span<const CpuId> core_ids) const -> TopologyMap
+{
+    TopologyMap result = *this;
+    result.physical_core_id_.assign(core_ids.begin(), core_ids.end());
+    return result;
 }
 
 auto parseCpuList(std::string_view content) -> std::expected<std::vector<CpuId>, TopologyError>
@@ -491,6 +651,41 @@ auto parseCpuList(std::string_view content) -> std::expected<std::vector<CpuId>,
     return result;
 }
 
+auto formatCpuList(std::span<const CpuId> cpus) -> std::string
+{
+    std::vector<CpuId> sorted(cpus.begin(), cpus.end());
+    std::ranges::sort(sorted);
+    auto duplicates = std::ranges::unique(sorted);
+    sorted.erase(duplicates.begin(), duplicates.end());
+
+    std::string result;
+    std::size_t i = 0;
+    while (i < sorted.size())
+    {
+        // Extend the run while IDs are consecutive
+        std::size_t run_end = i;
+        while (run_end + 1 < sorted.size() && sorted[run_end + 1] == sorted[run_end] + 1)
+        {
+            ++run_end;
+        }
+
+        if (!result.empty())
+        {
+            result += ',';
+        }
+        result += std::to_string(sorted[i]);
+        if (run_end > i)
+        {
+            result += '-';
+            result += std::to_string(sorted[run_end]);
+        }
+
+        i = run_end + 1;
+    }
+
+    return result;
+}
+
 auto parseCoreType(std::string_view content) -> std::expected<CoreType, TopologyError>
 {
     auto trimmed = trim(content);
@@ -0,0 +1,290 @@
+/**
+ *  @file       topology_cache.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the persistent topology snapshot.
+ */
+
+#include "threveal/core/topology_cache.hpp"
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <expected>
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace threveal::core
+{
+
+namespace
+{
+
+constexpr std::string_view kHeader = "threveal-topology 1";
+constexpr std::string_view kUnknownCoreId = "-";
+
+/**
+ *  Reads a whole file.
+ *
+ *  @param      path           File to read.
+ *  @param      require_owner  Reject files not owned by the effective user.
+ *  @return     The contents, or std::nullopt on any failure.
+ */
+[[nodiscard]] auto readWholeFile(const std::string& path, bool require_owner)
+    -> std::optional<std::string>
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0)
+    {
+        return std::nullopt;
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || (require_owner && info.st_uid != geteuid()))
+    {
+        close(fd);
+        return std::nullopt;
+    }
+
+    std::string content;
+    std::array<char, 4096> chunk{};
+    ssize_t bytes_read = 0;
+    while ((bytes_read = read(fd, chunk.data(), chunk.size())) > 0)
+    {
+        content.append(chunk.data(), static_cast<std::size_t>(bytes_read));
+    }
+    close(fd);
+
+    if (bytes_read < 0)
+    {
+        return std::nullopt;
+    }
+    return content;
+}
+
+/**
+ *  Atomically replaces a file with new contents.
+ *
+ *  @return     True if the file was written and renamed into place.
+ */
+auto writeFileAtomically(const std::string& path, std::string_view content) -> bool
+{
+    auto temp_path = path + "." + std::to_string(getpid()) + ".tmp";
+
+    constexpr mode_t kOwnerReadWrite = 0600;
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW,
+                  kOwnerReadWrite);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    while (!content.empty())
+    {
+        ssize_t written = write(fd, content.data(), content.size());
+        if (written <= 0)
+        {
+            ok = false;
+            break;
+        }
+        content.remove_prefix(static_cast<std::size_t>(written));
+    }
+    close(fd);
+
+    if (!ok || rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ *  Parses a possibly empty CPU list.
+ */
+[[nodiscard]] auto parseOptionalCpuList(std::string_view content)
+    -> std::expected<std::vector<CpuId>, TopologyError>
+{
+    if (trim(content).empty())
+    {
+        return std::vector<CpuId>{};
+    }
+    return parseCpuList(content);
+}
+
+/**
+ *  Parses the space-separated core ID line.
+ */
+[[nodiscard]] auto parseCoreIds(std::string_view content)
+    -> std::expected<std::vector<CpuId>, TopologyError>
+{
+    std::vector<CpuId> core_ids;
+
+    while (!(content = trim(content)).empty())
+    {
+        auto token = content.substr(0, content.find(' '));
+        content.remove_prefix(token.size());
+
+        if (token == kUnknownCoreId)
+        {
+            core_ids.push_back(kInvalidCpuId);
+            continue;
+        }
+
+        CpuId value{};
+        auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (ec != std::errc{} || ptr != token.data() + token.size())
+        {
+            return std::unexpected(TopologyError::kParseError);
+        }
+        core_ids.push_back(value);
+    }
+
+    return core_ids;
+}
+
+}  // namespace
+
+auto defaultTopologyCachePath() -> std::string
+{
+    const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir != nullptr && *runtime_dir != '\0')
+    {
+        return std::string(runtime_dir) + "/threveal-topology.cache";
+    }
+    return "/tmp/threveal-topology-" + std::to_string(geteuid()) + ".cache";
+}
+
+auto topologyCacheKey(const TopologyCacheOptions& options) -> std::optional<std::string>
+{
+    auto boot_id = readWholeFile(options.boot_id_path, false);
+    if (!boot_id || trim(*boot_id).empty())
+    {
+        return std::nullopt;
+    }
+
+    // Hotplug and isolation change within a boot, so they are part of the key
+    auto cpu_dir = options.sysfs_root + "/devices/system/cpu/";
+    auto online = readWholeFile(cpu_dir + "online", false).value_or("");
+    auto isolated = readWholeFile(cpu_dir + "isolated", false).value_or("");
+
+    std::string key(trim(*boot_id));
+    key += ';';
+    key += trim(online);
+    key += ';';
+    key += trim(isolated);
+    return key;
+}
+
+auto serializeTopology(const TopologyMap& map, std::string_view key) -> std::string
+{
+    std::string out;
+    out += kHeader;
+    out += "\nkey ";
+    out += key;
+    out += "\np ";
+    out += formatCpuList(map.getPCores());
+    out += "\ne ";
+    out += formatCpuList(map.getECores());
+    out += "\nisolated ";
+    out += formatCpuList(map.getIsolatedCpus());
+    out += "\ncore_ids";
+    for (CpuId core_id : map.getPhysicalCoreIds())
+    {
+        out += ' ';
+        out += (core_id == kInvalidCpuId) ? std::string(kUnknownCoreId) : std::to_string(core_id);
+    }
+    out += '\n';
+    return out;
+}
+
+auto deserializeTopology(std::string_view data, std::string_view key)
+    -> std::expected<TopologyMap, TopologyError>
+{
+    // Fixed line order: header, key, p, e, isolated, core_ids
+    constexpr std::array<std::string_view, 5> kFields = {"key", "p", "e", "isolated",
+                                                         "core_ids"};
+    std::array<std::string_view, kFields.size()> values{};
+
+    auto next_line = [&data]() -> std::string_view
+    {
+        auto end = data.find('\n');
+        auto line = data.substr(0, end);
+        data.remove_prefix((end == std::string_view::npos) ? data.size() : end + 1);
+        return line;
+    };
+
+    if (next_line() != kHeader)
+    {
+        return std::unexpected(TopologyError::kParseError);
+    }
+
+    for (std::size_t i = 0; i < kFields.size(); ++i)
+    {
+        auto line = next_line();
+        if (!line.starts_with(kFields[i]) ||
+            (line.size() > kFields[i].size() && line[kFields[i].size()] != ' '))
+        {
+            return std::unexpected(TopologyError::kParseError);
+        }
+        line.remove_prefix(kFields[i].size());
+        values[i] = line.empty() ? line : line.substr(1);
+    }
+
+    if (values[0] != key)
+    {
+        return std::unexpected(TopologyError::kParseError);
+    }
+
+    // Filtering offline or isolated CPUs may leave either core list empty
+    auto p_cores = parseOptionalCpuList(values[1]);
+    auto e_cores = parseOptionalCpuList(values[2]);
+    auto isolated = parseOptionalCpuList(values[3]);
+    auto core_ids = parseCoreIds(values[4]);
+    if (!p_cores || !e_cores || !isolated || !core_ids)
+    {
+        return std::unexpected(TopologyError::kParseError);
+    }
+
+    return TopologyMap{*p_cores, *e_cores}.withIsolatedCpus(*isolated).withPhysicalCoreIds(
+        *core_ids);
+}
+
+auto loadTopologyCached(const TopologyCacheOptions& options)
+    -> std::expected<TopologyMap, TopologyError>
+{
+    auto key = topologyCacheKey(options);
+    auto cache_path = options.cache_path.empty() ? defaultTopologyCachePath() : options.cache_path;
+
+    if (key)
+    {
+        if (auto cached = readWholeFile(cache_path, true))
+        {
+            if (auto map = deserializeTopology(*cached, *key))
+            {
+                return map;
+            }
+        }
+    }
+
+    auto probed = TopologyMap::loadFromSysfsRoot(options.sysfs_root);
+    if (probed && key)
+    {
+        writeFileAtomically(cache_path, serializeTopology(*probed, *key));
+    }
+    return probed;
+}
+
+}  // namespace threveal::core
@@ -0,0 +1,48 @@
+/**
+ *  @file       topology_handle.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the TopologyHandle class.
+ */
+
+#include "threveal/core/topology_handle.hpp"
+
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace threveal::core
+{
+
+TopologyHandle::TopologyHandle(TopologyMap initial)
+    : current_(std::make_shared<const TopologySnapshot>(
+          TopologySnapshot{.map = std::move(initial), .generation = 1}))
+{
+}
+
+auto TopologyHandle::load() const noexcept -> std::shared_ptr<const TopologySnapshot>
+{
+    return current_.load(std::memory_order_acquire);
+}
+
+auto TopologyHandle::publish(TopologyMap map) -> TopologyGeneration
+{
+    std::lock_guard lock(publish_mutex_);
+
+    auto next = current_.load(std::memory_order_relaxed)->generation + 1;
+    current_.store(std::make_shared<const TopologySnapshot>(
+                       TopologySnapshot{.map = std::move(map), .generation = next}),
+                   std::memory_order_release);
+    return next;
+}
+
+auto TopologyHandle::generation() const noexcept -> TopologyGeneration
+{
+    return load()->generation;
+}
+
+}  // namespace threveal::core
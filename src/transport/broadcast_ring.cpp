@@ -0,0 +1,484 @@
+/**
+ *  @file       broadcast_ring.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the shared-memory broadcast ring.
+ */
+
+#include "threveal/transport/broadcast_ring.hpp"
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <new>
+#include <span>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+
+namespace threveal::transport
+{
+
+namespace
+{
+
+using core::MigrationEvent;
+using core::TransportError;
+
+/**
+ *  "THRB" in little-endian byte order.
+ */
+constexpr std::uint32_t kRingMagic = 0x42524854;
+
+constexpr std::uint32_t kRingVersion = 1;
+
+/**
+ *  Largest ring accepted from a publisher (1 GiB of records).
+ */
+constexpr std::size_t kMaxBroadcastSlots = std::size_t{1} << 24;
+
+constexpr std::size_t kSlotWords = (kBroadcastSlotSize / sizeof(std::uint64_t)) - 1;
+
+}  // namespace
+
+/**
+ *  Ring header at the start of the memfd; the slots follow it.
+ *
+ *  The publisher's write position sits on its own cache line so that
+ *  polling subscribers do not share a line with the constant fields.
+ */
+struct BroadcastRingLayout
+{
+    std::uint32_t magic{kRingMagic};
+    std::uint32_t version{kRingVersion};
+    std::uint32_t slot_size{kBroadcastSlotSize};
+    std::uint32_t reserved{0};
+    std::uint64_t capacity{0};
+
+    /**
+     *  Number of migrations published; slot i holds migration n when
+     *  n % capacity == i.
+     */
+    alignas(kBroadcastSlotSize) std::atomic<std::uint64_t> head{0};
+};
+
+namespace
+{
+
+/**
+ *  One migration guarded by a sequence lock.
+ *
+ *  seq is 2n + 1 while migration n is being written and 2n + 2 once it is
+ *  complete. The payload is copied word by word with relaxed atomics so
+ *  that a torn read is well-defined and caught by re-checking seq.
+ */
+struct alignas(kBroadcastSlotSize) BroadcastSlot
+{
+    std::atomic<std::uint64_t> seq{0};
+    std::array<std::atomic<std::uint64_t>, kSlotWords> words{};
+};
+
+static_assert(sizeof(BroadcastSlot) == kBroadcastSlotSize);
+static_assert(sizeof(BroadcastRingLayout) % kBroadcastSlotSize == 0);
+static_assert(std::is_trivially_copyable_v<MigrationEvent>);
+static_assert(sizeof(MigrationEvent) <= kSlotWords * sizeof(std::uint64_t));
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "shared-memory atomics must be address-free");
+
+auto slotsOf(BroadcastRingLayout* ring) noexcept -> BroadcastSlot*
+{
+    return static_cast<BroadcastSlot*>(static_cast<void*>(ring + 1));
+}
+
+auto slotsOf(const BroadcastRingLayout* ring) noexcept -> const BroadcastSlot*
+{
+    return static_cast<const BroadcastSlot*>(static_cast<const void*>(ring + 1));
+}
+
+auto mapSize(std::size_t capacity) noexcept -> std::size_t
+{
+    return sizeof(BroadcastRingLayout) + (capacity * sizeof(BroadcastSlot));
+}
+
+/**
+ *  Returns the oldest migration that can still be in the ring.
+ */
+auto oldestAvailable(std::uint64_t head, std::uint64_t capacity) noexcept -> std::uint64_t
+{
+    return (head > capacity) ? head - capacity : 0;
+}
+
+}  // namespace
+
+// --- BroadcastPublisher ---
+
+BroadcastPublisher::BroadcastPublisher(int fd, BroadcastRingLayout* ring,
+                                       std::size_t map_size) noexcept
+    : fd_(fd), ring_(ring), map_size_(map_size)
+{
+}
+
+BroadcastPublisher::~BroadcastPublisher()
+{
+    if (ring_ != nullptr)
+    {
+        munmap(ring_, map_size_);
+    }
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+BroadcastPublisher::BroadcastPublisher(BroadcastPublisher&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)),
+      ring_(std::exchange(other.ring_, nullptr)),
+      map_size_(std::exchange(other.map_size_, 0))
+{
+}
+
+auto BroadcastPublisher::operator=(BroadcastPublisher&& other) noexcept -> BroadcastPublisher&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    if (ring_ != nullptr)
+    {
+        munmap(ring_, map_size_);
+    }
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+    fd_ = std::exchange(other.fd_, -1);
+    ring_ = std::exchange(other.ring_, nullptr);
+    map_size_ = std::exchange(other.map_size_, 0);
+    return *this;
+}
+
+auto BroadcastPublisher::create(const std::string& name, std::size_t slots)
+    -> std::expected<BroadcastPublisher, TransportError>
+{
+    auto capacity = std::bit_ceil(std::clamp<std::size_t>(slots, 2, kMaxBroadcastSlots));
+    auto size = mapSize(capacity);
+
+    int fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+    {
+        return std::unexpected(TransportError::kMapFailed);
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) < 0)
+    {
+        close(fd);
+        return std::unexpected(TransportError::kMapFailed);
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED)
+    {
+        close(fd);
+        return std::unexpected(TransportError::kMapFailed);
+    }
+
+    // ftruncate() zero-filled the file; this only starts the objects' lifetimes
+    auto* ring = new (memory) BroadcastRingLayout{};
+    ring->capacity = capacity;
+    auto* slots_begin = slotsOf(ring);
+    for (std::size_t i = 0; i < capacity; ++i)
+    {
+        new (slots_begin + i) BroadcastSlot{};
+    }
+
+    // Subscribers must not resize the ring or write to it; kernels before
+    // 5.1 lack the write seal, so fall back to fixing the size only
+    constexpr int kSizeSeals = F_SEAL_SHRINK | F_SEAL_GROW;
+    if (fcntl(fd, F_ADD_SEALS, kSizeSeals | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0 &&
+        fcntl(fd, F_ADD_SEALS, kSizeSeals | F_SEAL_SEAL) < 0)
+    {
+        munmap(memory, size);
+        close(fd);
+        return std::unexpected(TransportError::kMapFailed);
+    }
+
+    return BroadcastPublisher{fd, ring, size};
+}
+
+void BroadcastPublisher::publish(const MigrationEvent& event) noexcept
+{
+    std::array<std::uint64_t, kSlotWords> words{};
+    std::memcpy(words.data(), &event, sizeof(event));
+
+    // Single writer: nobody else moves head
+    auto n = ring_->head.load(std::memory_order_relaxed);
+    auto& slot = slotsOf(ring_)[n & (ring_->capacity - 1)];
+
+    slot.seq.store((2 * n) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0; i < kSlotWords; ++i)
+    {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.seq.store((2 * n) + 2, std::memory_order_release);
+    ring_->head.store(n + 1, std::memory_order_release);
+}
+
+void BroadcastPublisher::publish(std::span<const MigrationEvent> events) noexcept
+{
+    for (const auto& event : events)
+    {
+        publish(event);
+    }
+}
+
+auto BroadcastPublisher::fd() const noexcept -> int
+{
+    return fd_;
+}
+
+auto BroadcastPublisher::capacity() const noexcept -> std::size_t
+{
+    return ring_->capacity;
+}
+
+auto BroadcastPublisher::published() const noexcept -> std::uint64_t
+{
+    return ring_->head.load(std::memory_order_relaxed);
+}
+
+// --- BroadcastSubscriber ---
+
+BroadcastSubscriber::BroadcastSubscriber(void* mapping, std::size_t map_size,
+                                         std::uint64_t cursor) noexcept
+    : mapping_(mapping),
+      ring_(static_cast<const BroadcastRingLayout*>(mapping)),
+      map_size_(map_size),
+      cursor_(cursor)
+{
+}
+
+BroadcastSubscriber::~BroadcastSubscriber()
+{
+    if (mapping_ != nullptr)
+    {
+        munmap(mapping_, map_size_);
+    }
+}
+
+BroadcastSubscriber::BroadcastSubscriber(BroadcastSubscriber&& other) noexcept
+    : mapping_(std::exchange(other.mapping_, nullptr)),
+      ring_(std::exchange(other.ring_, nullptr)),
+      map_size_(std::exchange(other.map_size_, 0)),
+      cursor_(other.cursor_),
+      overruns_(other.overruns_)
+{
+}
+
+auto BroadcastSubscriber::operator=(BroadcastSubscriber&& other) noexcept
+    -> BroadcastSubscriber&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    if (mapping_ != nullptr)
+    {
+        munmap(mapping_, map_size_);
+    }
+    mapping_ = std::exchange(other.mapping_, nullptr);
+    ring_ = std::exchange(other.ring_, nullptr);
+    map_size_ = std::exchange(other.map_size_, 0);
+    cursor_ = other.cursor_;
+    overruns_ = other.overruns_;
+    return *this;
+}
+
+auto BroadcastSubscriber::attach(int fd, Start start)
+    -> std::expected<BroadcastSubscriber, TransportError>
+{
+    struct stat info{};
+    if (fstat(fd, &info) < 0 || info.st_size < static_cast<off_t>(sizeof(BroadcastRingLayout)))
+    {
+        return std::unexpected(TransportError::kMapFailed);
+    }
+
+    auto size = static_cast<std::size_t>(info.st_size);
+    void* memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED)
+    {
+        return std::unexpected(TransportError::kMapFailed);
+    }
+
+    const auto* ring = static_cast<const BroadcastRingLayout*>(memory);
+    bool compatible = ring->magic == kRingMagic && ring->version == kRingVersion &&
+                      ring->slot_size == kBroadcastSlotSize &&
+                      std::has_single_bit(ring->capacity) &&
+                      ring->capacity <= kMaxBroadcastSlots && mapSize(ring->capacity) == size;
+    if (!compatible)
+    {
+        munmap(memory, size);
+        return std::unexpected(TransportError::kMapFailed);
+    }
+
+    auto head = ring->head.load(std::memory_order_acquire);
+    auto cursor = (start == Start::kLatest) ? head : oldestAvailable(head, ring->capacity);
+    return BroadcastSubscriber{memory, size, cursor};
+}
+
+auto BroadcastSubscriber::attach(const std::string& path, Start start)
+    -> std::expected<BroadcastSubscriber, TransportError>
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::unexpected(TransportError::kMapFailed);
+    }
+    auto subscriber = attach(fd, start);
+    close(fd);
+    return subscriber;
+}
+
+auto BroadcastSubscriber::read(std::span<MigrationEvent> out) noexcept -> std::size_t
+{
+    const auto* slots = slotsOf(ring_);
+    auto capacity = ring_->capacity;
+    auto head = ring_->head.load(std::memory_order_acquire);
+
+    // Skip whatever the publisher has already overwritten, counting it as lost
+    auto skipTo = [this](std::uint64_t cursor)
+    {
+        overruns_ += cursor - cursor_;
+        cursor_ = cursor;
+    };
+    if (oldestAvailable(head, capacity) > cursor_)
+    {
+        skipTo(oldestAvailable(head, capacity));
+    }
+
+    std::size_t count = 0;
+    std::array<std::uint64_t, kSlotWords> words{};
+    while (count < out.size() && cursor_ < head)
+    {
+        const auto& slot = slots[cursor_ & (capacity - 1)];
+        auto expected = (2 * cursor_) + 2;
+
+        auto before = slot.seq.load(std::memory_order_acquire);
+        if (before == expected)
+        {
+            for (std::size_t i = 0; i < kSlotWords; ++i)
+            {
+                words[i] = slot.words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == expected)
+            {
+                std::memcpy(static_cast<void*>(&out[count]), words.data(), sizeof(MigrationEvent));
+                ++count;
+                ++cursor_;
+                continue;
+            }
+        }
+
+        // The publisher lapped this reader while it was copying the slot
+        head = ring_->head.load(std::memory_order_acquire);
+        skipTo(std::max(cursor_ + 1, oldestAvailable(head, capacity)));
+    }
+    return count;
+}
+
+auto BroadcastSubscriber::backlog() const noexcept -> std::uint64_t
+{
+    auto head = ring_->head.load(std::memory_order_acquire);
+    return (head > cursor_) ? head - cursor_ : 0;
+}
+
+auto BroadcastSubscriber::overruns() const noexcept -> std::uint64_t
+{
+    return overruns_;
+}
+
+// --- Descriptor passing ---
+
+auto sendDescriptor(int socket_fd, int fd) -> std::expected<void, TransportError>
+{
+    char marker = 'F';
+    iovec data{.iov_base = &marker, .iov_len = 1};
+
+    alignas(cmsghdr) std::array<std::byte, CMSG_SPACE(sizeof(int))> control{};
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    auto* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    ssize_t sent = 0;
+    do
+    {
+        sent = sendmsg(socket_fd, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent != 1)
+    {
+        return std::unexpected(TransportError::kDisconnected);
+    }
+    return {};
+}
+
+auto receiveDescriptor(int socket_fd) -> std::expected<int, TransportError>
+{
+    char marker = 0;
+    iovec data{.iov_base = &marker, .iov_len = 1};
+
+    alignas(cmsghdr) std::array<std::byte, CMSG_SPACE(sizeof(int))> control{};
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    ssize_t received = 0;
+    do
+    {
+        received = recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    if (received <= 0)
+    {
+        return std::unexpected(TransportError::kDisconnected);
+    }
+
+    auto* header = CMSG_FIRSTHDR(&message);
+    if (header == nullptr || header->cmsg_level != SOL_SOCKET ||
+        header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(int)))
+    {
+        return std::unexpected(TransportError::kProtocolError);
+    }
+
+    int fd = -1;
+    std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+    return fd;
+}
+
+}  // namespace threveal::transport
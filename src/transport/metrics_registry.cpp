@@ -0,0 +1,326 @@
+/**
+ *  @file       metrics_registry.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the monitoring counters and their OpenMetrics
+ *  rendering.
+ */
+
+#include "threveal/transport/metrics_registry.hpp"
+
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+
+namespace threveal::transport
+{
+
+namespace
+{
+
+/**
+ *  Threads whose last migration is remembered for residency accounting.
+ */
+constexpr std::size_t kResidencySlots = 4096;
+
+constexpr std::array<std::string_view, 5> kMigrationTypeLabels = {
+    "unknown", "p_to_p", "p_to_e", "e_to_p", "e_to_e"};
+
+constexpr std::array<std::string_view, 3> kDropReasonLabels = {
+    "ring_full", "suppressed", "stream_queue"};
+
+constexpr std::array kCoreTypeOrder = {core::CoreType::kUnknown, core::CoreType::kPCore,
+                                       core::CoreType::kECore};
+
+constexpr double kNanosecondsPerSecond = 1e9;
+
+auto coreIndex(core::CoreType type) noexcept -> std::size_t
+{
+    auto index = static_cast<std::size_t>(type);
+    return (index < kCoreTypeOrder.size()) ? index : 0;
+}
+
+void appendNumber(std::string& out, std::uint64_t value)
+{
+    std::array<char, std::numeric_limits<std::uint64_t>::digits10 + 2> buffer{};
+    auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    out.append(buffer.data(), result.ptr);
+}
+
+void appendNumber(std::string& out, double value)
+{
+    std::array<char, 32> buffer{};
+    auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    out.append(buffer.data(), result.ptr);
+}
+
+void appendSeconds(std::string& out, std::uint64_t nanoseconds)
+{
+    appendNumber(out, static_cast<double>(nanoseconds) / kNanosecondsPerSecond);
+}
+
+/**
+ *  Writes the metadata lines of a metric family.
+ */
+void appendFamily(std::string& out, std::string_view name, std::string_view type,
+                  std::string_view unit, std::string_view help)
+{
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+    if (!unit.empty())
+    {
+        out.append("# UNIT ").append(name).append(" ").append(unit).append("\n");
+    }
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+}
+
+/**
+ *  Writes the start of a sample line up to the value.
+ */
+void appendSample(std::string& out, std::string_view name, std::string_view label,
+                  std::string_view value)
+{
+    out.append(name).append("{").append(label).append("=\"").append(value).append("\"} ");
+}
+
+}  // namespace
+
+MetricsRegistry::MetricsRegistry(std::size_t max_processes)
+    : max_processes_(max_processes),
+      slots_(std::bit_ceil(std::max<std::size_t>(max_processes * 2, 2))),
+      slot_mask_(slots_.size() - 1),
+      residency_cache_(kResidencySlots)
+{
+}
+
+void MetricsRegistry::recordMigration(const core::MigrationEvent& event) noexcept
+{
+    auto type = core::classifyCoreTypes(event.src_type, event.dst_type);
+    auto weight = std::max<std::uint32_t>(event.sample_weight, 1);
+    slotFor(event.pid)
+        .migrations[static_cast<std::size_t>(type)]
+        .fetch_add(weight, std::memory_order_relaxed);
+
+    // The thread ran on the source core type since its previous migration
+    auto& entry = residency_cache_[event.tid & (kResidencySlots - 1)];
+    if (entry.valid && entry.tid == event.tid && event.timestamp_ns > entry.since_ns)
+    {
+        residency_ns_[coreIndex(event.src_type)].fetch_add(event.timestamp_ns - entry.since_ns,
+                                                            std::memory_order_relaxed);
+    }
+    entry.tid = event.tid;
+    entry.valid = true;
+    entry.since_ns = event.timestamp_ns;
+}
+
+void MetricsRegistry::recordPmuSample(const core::PmuSample& sample, core::CoreType type) noexcept
+{
+    auto index = coreIndex(type);
+    instructions_[index].fetch_add(sample.instructions, std::memory_order_relaxed);
+    cycles_[index].fetch_add(sample.cycles, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::setDropped(DropReason reason, std::uint64_t total) noexcept
+{
+    auto& counter = dropped_[static_cast<std::size_t>(reason) % kDropReasons];
+    auto current = counter.load(std::memory_order_relaxed);
+    while (total > current &&
+           !counter.compare_exchange_weak(current, total, std::memory_order_relaxed))
+    {
+    }
+}
+
+void MetricsRegistry::addCollectorTime(std::chrono::nanoseconds busy) noexcept
+{
+    if (busy.count() > 0)
+    {
+        collector_ns_.fetch_add(static_cast<std::uint64_t>(busy.count()),
+                                std::memory_order_relaxed);
+    }
+}
+
+void MetricsRegistry::recordScrape(std::chrono::nanoseconds duration) noexcept
+{
+    scrapes_.fetch_add(1, std::memory_order_relaxed);
+    last_scrape_ns_.store(static_cast<std::uint64_t>(std::max<std::int64_t>(duration.count(), 0)),
+                          std::memory_order_relaxed);
+}
+
+void MetricsRegistry::render(std::string& out) const
+{
+    appendFamily(out, "threveal_migrations", "counter", "",
+                 "Scheduler migrations by direction and process, scaled by sample weight.");
+    auto appendProcess = [&out](const ProcessSlot& slot, std::string_view tgid)
+    {
+        for (std::size_t type = 0; type < kMigrationTypes; ++type)
+        {
+            auto count = slot.migrations[type].load(std::memory_order_relaxed);
+            if (count == 0)
+            {
+                continue;
+            }
+            out.append("threveal_migrations_total{type=\"")
+                .append(kMigrationTypeLabels[type])
+                .append("\",tgid=\"")
+                .append(tgid)
+                .append("\"} ");
+            appendNumber(out, count);
+            out.push_back('\n');
+        }
+    };
+
+    std::string tgid;
+    for (const auto& slot : slots_)
+    {
+        auto key = slot.key.load(std::memory_order_relaxed);
+        if (key != 0)
+        {
+            tgid.clear();
+            appendNumber(tgid, std::uint64_t{key - 1});
+            appendProcess(slot, tgid);
+        }
+    }
+    appendProcess(overflow_, "other");
+
+    appendFamily(out, "threveal_core_residency_seconds", "counter", "seconds",
+                 "Thread time between migrations, by the core type it ran on.");
+    for (auto type : kCoreTypeOrder)
+    {
+        appendSample(out, "threveal_core_residency_seconds_total", "core_type",
+                     core::toString(type));
+        appendSeconds(out, residency_ns_[coreIndex(type)].load(std::memory_order_relaxed));
+        out.push_back('\n');
+    }
+
+    appendFamily(out, "threveal_instructions", "counter", "",
+                 "Retired instructions in PMU samples, by core type.");
+    for (auto type : kCoreTypeOrder)
+    {
+        appendSample(out, "threveal_instructions_total", "core_type", core::toString(type));
+        appendNumber(out, instructions_[coreIndex(type)].load(std::memory_order_relaxed));
+        out.push_back('\n');
+    }
+
+    appendFamily(out, "threveal_cycles", "counter", "", "CPU cycles in PMU samples, by core type.");
+    for (auto type : kCoreTypeOrder)
+    {
+        appendSample(out, "threveal_cycles_total", "core_type", core::toString(type));
+        appendNumber(out, cycles_[coreIndex(type)].load(std::memory_order_relaxed));
+        out.push_back('\n');
+    }
+
+    appendFamily(out, "threveal_ipc", "gauge", "", "Instructions per cycle since start.");
+    for (auto type : kCoreTypeOrder)
+    {
+        auto instructions = instructions_[coreIndex(type)].load(std::memory_order_relaxed);
+        auto cycles = cycles_[coreIndex(type)].load(std::memory_order_relaxed);
+        appendSample(out, "threveal_ipc", "core_type", core::toString(type));
+        appendNumber(out, (cycles == 0) ? 0.0
+                                        : static_cast<double>(instructions) /
+                                              static_cast<double>(cycles));
+        out.push_back('\n');
+    }
+
+    appendFamily(out, "threveal_dropped_events", "counter", "",
+                 "Events lost before reaching the consumer, by reason.");
+    for (std::size_t reason = 0; reason < kDropReasons; ++reason)
+    {
+        appendSample(out, "threveal_dropped_events_total", "reason", kDropReasonLabels[reason]);
+        appendNumber(out, dropped_[reason].load(std::memory_order_relaxed));
+        out.push_back('\n');
+    }
+
+    appendFamily(out, "threveal_collector_cpu_seconds", "counter", "seconds",
+                 "Time the collector spent handling events.");
+    out.append("threveal_collector_cpu_seconds_total ");
+    appendSeconds(out, collector_ns_.load(std::memory_order_relaxed));
+    out.push_back('\n');
+
+    appendFamily(out, "threveal_scrapes", "counter", "", "Completed metric scrapes.");
+    out.append("threveal_scrapes_total ");
+    appendNumber(out, scrapes_.load(std::memory_order_relaxed));
+    out.push_back('\n');
+
+    appendFamily(out, "threveal_last_scrape_duration_seconds", "gauge", "seconds",
+                 "Time taken to render the previous scrape.");
+    out.append("threveal_last_scrape_duration_seconds ");
+    appendSeconds(out, last_scrape_ns_.load(std::memory_order_relaxed));
+    out.append("\n# EOF\n");
+}
+
+auto MetricsRegistry::seriesCount() const noexcept -> std::size_t
+{
+    // Residency, instructions, cycles and IPC per core type, drops, and
+    // the three collector and scrape series
+    std::size_t count = (4 * kCoreTypes) + kDropReasons + 3;
+
+    auto countProcess = [](const ProcessSlot& slot)
+    {
+        return static_cast<std::size_t>(
+            std::count_if(slot.migrations.begin(), slot.migrations.end(),
+                          [](const std::atomic<std::uint64_t>& counter)
+                          {
+                              return counter.load(std::memory_order_relaxed) != 0;
+                          }));
+    };
+    for (const auto& slot : slots_)
+    {
+        if (slot.key.load(std::memory_order_relaxed) != 0)
+        {
+            count += countProcess(slot);
+        }
+    }
+    return count + countProcess(overflow_);
+}
+
+auto MetricsRegistry::slotFor(std::uint32_t tgid) noexcept -> ProcessSlot&
+{
+    if (tgid == std::numeric_limits<std::uint32_t>::max())
+    {
+        return overflow_;
+    }
+
+    // Fibonacci hashing spreads consecutive PIDs across the table
+    auto key = tgid + 1;
+    auto start = static_cast<std::size_t>(key * 2654435761U);
+    for (std::size_t probe = 0; probe <= slot_mask_; ++probe)
+    {
+        auto& slot = slots_[(start + probe) & slot_mask_];
+        auto current = slot.key.load(std::memory_order_relaxed);
+        if (current == key)
+        {
+            return slot;
+        }
+        if (current != 0)
+        {
+            continue;
+        }
+
+        if (used_slots_.load(std::memory_order_relaxed) >= max_processes_)
+        {
+            return overflow_;
+        }
+        if (slot.key.compare_exchange_strong(current, key, std::memory_order_relaxed))
+        {
+            used_slots_.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+        if (current == key)
+        {
+            return slot;
+        }
+    }
+    return overflow_;
+}
+
+}  // namespace threveal::transport
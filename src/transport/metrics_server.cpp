@@ -0,0 +1,526 @@
+/**
+ *  @file       metrics_server.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the OpenMetrics HTTP responder.
+ */
+
+#include "threveal/transport/metrics_server.hpp"
+
+#include "threveal/core/errors.hpp"
+#include "threveal/transport/metrics_registry.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <netinet/in.h>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+namespace threveal::transport
+{
+
+namespace
+{
+
+using core::TransportError;
+
+/**
+ *  Largest request head accepted; scrapers send a few hundred bytes.
+ */
+constexpr std::size_t kMaxRequestSize = 8 * 1024;
+
+constexpr std::size_t kReadSize = 4096;
+
+constexpr std::size_t kMaxEvents = 64;
+
+constexpr std::string_view kHeaderEnd = "\r\n\r\n";
+
+/**
+ *  epoll_wait() timeout used by run(), bounding how long a stop request
+ *  waits.
+ */
+constexpr std::chrono::milliseconds kRunPollInterval{100};
+
+auto asciiLower(char c) noexcept -> char
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+auto equalsIgnoreCase(std::string_view a, std::string_view b) noexcept -> bool
+{
+    return std::ranges::equal(a, b,
+                              [](char x, char y)
+                              {
+                                  return asciiLower(x) == asciiLower(y);
+                              });
+}
+
+auto trim(std::string_view text) noexcept -> std::string_view
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+    {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+    {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+/**
+ *  Returns the value of a header field, or an empty view if absent.
+ */
+auto headerValue(std::string_view headers, std::string_view name) noexcept -> std::string_view
+{
+    while (!headers.empty())
+    {
+        auto end = headers.find("\r\n");
+        auto line = headers.substr(0, end);
+        headers = (end == std::string_view::npos) ? std::string_view{} : headers.substr(end + 2);
+
+        auto colon = line.find(':');
+        if (colon != std::string_view::npos && equalsIgnoreCase(line.substr(0, colon), name))
+        {
+            return trim(line.substr(colon + 1));
+        }
+    }
+    return {};
+}
+
+/**
+ *  Appends a complete response.
+ */
+void appendResponse(std::string& out, std::string_view status, std::string_view content_type,
+                    std::string_view body, bool include_body, bool close)
+{
+    out.append("HTTP/1.1 ").append(status).append("\r\n");
+    out.append("Content-Type: ").append(content_type).append("\r\n");
+    out.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+    if (status.starts_with("405"))
+    {
+        out.append("Allow: GET, HEAD\r\n");
+    }
+    if (close)
+    {
+        out.append("Connection: close\r\n");
+    }
+    out.append("\r\n");
+    if (include_body)
+    {
+        out.append(body);
+    }
+}
+
+void appendError(std::string& out, std::string_view status, bool include_body, bool close)
+{
+    auto body = std::string{status}.append("\n");
+    appendResponse(out, status, "text/plain; charset=utf-8", body, include_body, close);
+}
+
+}  // namespace
+
+MetricsServer::MetricsServer(int listen_fd, int epoll_fd, StreamEndpoint endpoint,
+                             MetricsRegistry& registry, MetricsServerOptions options) noexcept
+    : listen_fd_(listen_fd),
+      epoll_fd_(epoll_fd),
+      endpoint_(std::move(endpoint)),
+      registry_(&registry),
+      options_(options)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    closeAll();
+}
+
+MetricsServer::MetricsServer(MetricsServer&& other) noexcept
+    : listen_fd_(std::exchange(other.listen_fd_, -1)),
+      epoll_fd_(std::exchange(other.epoll_fd_, -1)),
+      endpoint_(std::move(other.endpoint_)),
+      registry_(other.registry_),
+      options_(other.options_),
+      connections_(std::move(other.connections_)),
+      body_(std::move(other.body_)),
+      scrapes_(other.scrapes_)
+{
+    other.connections_.clear();
+}
+
+auto MetricsServer::operator=(MetricsServer&& other) noexcept -> MetricsServer&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    closeAll();
+    listen_fd_ = std::exchange(other.listen_fd_, -1);
+    epoll_fd_ = std::exchange(other.epoll_fd_, -1);
+    endpoint_ = std::move(other.endpoint_);
+    registry_ = other.registry_;
+    options_ = other.options_;
+    connections_ = std::move(other.connections_);
+    other.connections_.clear();
+    body_ = std::move(other.body_);
+    scrapes_ = other.scrapes_;
+    return *this;
+}
+
+auto MetricsServer::create(const StreamEndpoint& endpoint, MetricsRegistry& registry,
+                           MetricsServerOptions options)
+    -> std::expected<MetricsServer, TransportError>
+{
+    auto fd = listenStream(endpoint);
+    if (!fd)
+    {
+        return std::unexpected(fd.error());
+    }
+
+    // The server owns the socket from here, so failures below clean it up
+    MetricsServer server{*fd, epoll_create1(EPOLL_CLOEXEC), endpoint, registry, options};
+    if (server.epoll_fd_ < 0)
+    {
+        return std::unexpected(TransportError::kSocketFailed);
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = server.listen_fd_;
+    if (epoll_ctl(server.epoll_fd_, EPOLL_CTL_ADD, server.listen_fd_, &event) < 0)
+    {
+        return std::unexpected(TransportError::kSocketFailed);
+    }
+
+    // Report the port the kernel picked
+    if (endpoint.kind == StreamEndpoint::Kind::kTcp)
+    {
+        sockaddr_in addr{};
+        socklen_t length = sizeof(addr);
+        if (getsockname(server.listen_fd_, static_cast<sockaddr*>(static_cast<void*>(&addr)),
+                        &length) < 0)
+        {
+            return std::unexpected(TransportError::kBindFailed);
+        }
+        server.endpoint_.port = ntohs(addr.sin_port);
+    }
+    return server;
+}
+
+auto MetricsServer::endpoint() const noexcept -> const StreamEndpoint&
+{
+    return endpoint_;
+}
+
+auto MetricsServer::poll(std::chrono::milliseconds timeout)
+    -> std::expected<std::size_t, TransportError>
+{
+    std::array<epoll_event, kMaxEvents> events{};
+    int ready = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()),
+                           static_cast<int>(timeout.count()));
+    if (ready < 0)
+    {
+        if (errno == EINTR)
+        {
+            return 0;
+        }
+        return std::unexpected(TransportError::kPollFailed);
+    }
+
+    std::size_t served = 0;
+    for (const auto& event : std::span{events}.first(static_cast<std::size_t>(ready)))
+    {
+        int fd = event.data.fd;
+        if (fd == listen_fd_)
+        {
+            acceptConnections();
+            continue;
+        }
+
+        auto found = connections_.find(fd);
+        if (found == connections_.end())
+        {
+            continue;
+        }
+        if ((event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0)
+        {
+            served += receive(fd, found->second);
+        }
+        flush(fd, found->second);
+    }
+
+    closeIdle();
+    return served;
+}
+
+auto MetricsServer::run(std::stop_token stop) -> std::expected<void, TransportError>
+{
+    while (!stop.stop_requested())
+    {
+        auto polled = poll(kRunPollInterval);
+        if (!polled)
+        {
+            return std::unexpected(polled.error());
+        }
+    }
+    return {};
+}
+
+auto MetricsServer::scrapes() const noexcept -> std::uint64_t
+{
+    return scrapes_;
+}
+
+auto MetricsServer::connections() const noexcept -> std::size_t
+{
+    return connections_.size();
+}
+
+void MetricsServer::acceptConnections()
+{
+    while (auto fd = acceptStream(listen_fd_))
+    {
+        if (connections_.size() >= options_.max_connections)
+        {
+            close(*fd);
+            continue;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = *fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, *fd, &event) < 0)
+        {
+            close(*fd);
+            continue;
+        }
+
+        Connection connection;
+        connection.last_active = std::chrono::steady_clock::now();
+        connections_.emplace(*fd, std::move(connection));
+    }
+}
+
+auto MetricsServer::receive(int fd, Connection& connection) -> std::size_t
+{
+    std::array<char, kReadSize> buffer{};
+    bool shut_down = false;
+    while (connection.incoming.size() <= kMaxRequestSize)
+    {
+        ssize_t received = recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        if (received == 0)
+        {
+            shut_down = true;
+            break;
+        }
+        if (received < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                connection.outgoing.clear();
+                connection.close_after = true;
+                return 0;
+            }
+            break;
+        }
+        connection.incoming.append(buffer.data(), static_cast<std::size_t>(received));
+        connection.last_active = std::chrono::steady_clock::now();
+    }
+
+    // Pipelined requests are answered in order
+    std::size_t served = 0;
+    std::size_t pos = 0;
+    auto pending = std::string_view{connection.incoming};
+    while (true)
+    {
+        auto end = pending.find(kHeaderEnd, pos);
+        if (end == std::string_view::npos)
+        {
+            break;
+        }
+        if (respond(connection, pending.substr(pos, end - pos)))
+        {
+            ++served;
+        }
+        pos = end + kHeaderEnd.size();
+        if (connection.close_after)
+        {
+            pos = pending.size();
+            break;
+        }
+    }
+    connection.incoming.erase(0, pos);
+
+    // Answer what was sent before the client shut down its side
+    connection.close_after = connection.close_after || shut_down;
+
+    if (connection.incoming.size() > kMaxRequestSize)
+    {
+        appendError(connection.outgoing, "431 Request Header Fields Too Large", true, true);
+        connection.incoming.clear();
+        connection.close_after = true;
+    }
+    return served;
+}
+
+auto MetricsServer::respond(Connection& connection, std::string_view request) -> bool
+{
+    auto line_end = request.find("\r\n");
+    auto line = request.substr(0, line_end);
+    auto headers =
+        (line_end == std::string_view::npos) ? std::string_view{} : request.substr(line_end + 2);
+
+    // Request line: method, target and version separated by single spaces
+    auto first = line.find(' ');
+    auto second = (first == std::string_view::npos) ? first : line.find(' ', first + 1);
+    if (second == std::string_view::npos)
+    {
+        connection.close_after = true;
+        appendError(connection.outgoing, "400 Bad Request", true, true);
+        return false;
+    }
+    auto method = line.substr(0, first);
+    auto target = line.substr(first + 1, second - first - 1);
+    auto version = line.substr(second + 1);
+    if (!version.starts_with("HTTP/1."))
+    {
+        connection.close_after = true;
+        appendError(connection.outgoing, "400 Bad Request", true, true);
+        return false;
+    }
+
+    // Request bodies are not read, so they would be parsed as requests
+    auto content_length = headerValue(headers, "Content-Length");
+    if ((!content_length.empty() && content_length != "0") ||
+        !headerValue(headers, "Transfer-Encoding").empty())
+    {
+        connection.close_after = true;
+        appendError(connection.outgoing, "400 Bad Request", true, true);
+        return false;
+    }
+
+    auto persistence = headerValue(headers, "Connection");
+    connection.close_after = (version == "HTTP/1.0") ? !equalsIgnoreCase(persistence, "keep-alive")
+                                                     : equalsIgnoreCase(persistence, "close");
+
+    bool head = (method == "HEAD");
+    if (target.substr(0, target.find('?')) != kMetricsPath)
+    {
+        appendError(connection.outgoing, "404 Not Found", !head, connection.close_after);
+        return false;
+    }
+    if (method != "GET" && !head)
+    {
+        appendError(connection.outgoing, "405 Method Not Allowed", true, connection.close_after);
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    body_.clear();
+    registry_->render(body_);
+    appendResponse(connection.outgoing, "200 OK", kOpenMetricsContentType, body_, !head,
+                   connection.close_after);
+    ++scrapes_;
+    registry_->recordScrape(std::chrono::steady_clock::now() - start);
+    return true;
+}
+
+void MetricsServer::flush(int fd, Connection& connection)
+{
+    while (!connection.outgoing.empty())
+    {
+        ssize_t sent = send(fd, connection.outgoing.data(), connection.outgoing.size(),
+                            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                connection.outgoing.clear();
+                connection.close_after = true;
+            }
+            break;
+        }
+        connection.outgoing.erase(0, static_cast<std::size_t>(sent));
+        connection.last_active = std::chrono::steady_clock::now();
+    }
+
+    if (connection.close_after && connection.outgoing.empty())
+    {
+        close(fd);
+        connections_.erase(fd);
+        return;
+    }
+
+    // Wait for the socket to drain only while a response is pending
+    bool writing = !connection.outgoing.empty();
+    if (writing != connection.writing)
+    {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | (writing ? EPOLLOUT : 0U);
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event);
+        connection.writing = writing;
+    }
+}
+
+void MetricsServer::closeIdle()
+{
+    auto now = std::chrono::steady_clock::now();
+    std::erase_if(connections_,
+                  [this, now](const auto& entry)
+                  {
+                      if (now - entry.second.last_active < options_.idle_timeout)
+                      {
+                          return false;
+                      }
+                      close(entry.first);
+                      return true;
+                  });
+}
+
+void MetricsServer::closeAll() noexcept
+{
+    for (const auto& entry : connections_)
+    {
+        close(entry.first);
+    }
+    connections_.clear();
+
+    if (epoll_fd_ >= 0)
+    {
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+    if (listen_fd_ >= 0)
+    {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        if (endpoint_.kind == StreamEndpoint::Kind::kUnix)
+        {
+            unlink(endpoint_.path.c_str());
+        }
+    }
+}
+
+}  // namespace threveal::transport
@@ -0,0 +1,427 @@
+/**
+ *  @file       stream_aggregator.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the stream aggregator.
+ */
+
+#include "threveal/transport/stream_aggregator.hpp"
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <netinet/in.h>
+#include <poll.h>
+#include <span>
+#include <stop_token>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace threveal::transport
+{
+
+namespace
+{
+
+using core::TransportError;
+
+/**
+ *  Bytes read from one producer per poll(), so a busy producer cannot
+ *  starve the others.
+ */
+constexpr std::size_t kMaxReadPerPoll = 1024 * 1024;
+
+constexpr std::size_t kReadSize = 64 * 1024;
+
+/**
+ *  poll() timeout used by run(), bounding how long a stop request waits.
+ */
+constexpr std::chrono::milliseconds kRunPollInterval{100};
+
+}  // namespace
+
+StreamAggregator::StreamAggregator(int listen_fd, StreamEndpoint endpoint,
+                                   StreamAggregatorOptions options)
+    : listen_fd_(listen_fd), endpoint_(std::move(endpoint)), options_(options)
+{
+}
+
+StreamAggregator::~StreamAggregator()
+{
+    closeAll();
+}
+
+StreamAggregator::StreamAggregator(StreamAggregator&& other) noexcept
+    : listen_fd_(std::exchange(other.listen_fd_, -1)),
+      endpoint_(std::move(other.endpoint_)),
+      options_(other.options_),
+      connections_(std::move(other.connections_)),
+      producers_(std::move(other.producers_)),
+      decoded_(std::move(other.decoded_)),
+      store_(std::move(other.store_)),
+      protocol_errors_(other.protocol_errors_)
+{
+}
+
+auto StreamAggregator::operator=(StreamAggregator&& other) noexcept -> StreamAggregator&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    closeAll();
+    listen_fd_ = std::exchange(other.listen_fd_, -1);
+    endpoint_ = std::move(other.endpoint_);
+    options_ = other.options_;
+    connections_ = std::move(other.connections_);
+    producers_ = std::move(other.producers_);
+    decoded_ = std::move(other.decoded_);
+    store_ = std::move(other.store_);
+    protocol_errors_ = other.protocol_errors_;
+    return *this;
+}
+
+auto StreamAggregator::create(const StreamEndpoint& endpoint, StreamAggregatorOptions options)
+    -> std::expected<StreamAggregator, TransportError>
+{
+    auto fd = listenStream(endpoint);
+    if (!fd)
+    {
+        return std::unexpected(fd.error());
+    }
+
+    // Report the port the kernel picked
+    auto bound = endpoint;
+    if (endpoint.kind == StreamEndpoint::Kind::kTcp)
+    {
+        sockaddr_in addr{};
+        socklen_t length = sizeof(addr);
+        if (getsockname(*fd, static_cast<sockaddr*>(static_cast<void*>(&addr)), &length) < 0)
+        {
+            close(*fd);
+            return std::unexpected(TransportError::kBindFailed);
+        }
+        bound.port = ntohs(addr.sin_port);
+    }
+
+    options.initial_credits = std::max<std::uint32_t>(options.initial_credits, 1);
+    return StreamAggregator{*fd, std::move(bound), options};
+}
+
+auto StreamAggregator::endpoint() const noexcept -> const StreamEndpoint&
+{
+    return endpoint_;
+}
+
+auto StreamAggregator::poll(std::chrono::milliseconds timeout)
+    -> std::expected<std::size_t, TransportError>
+{
+    std::vector<pollfd> fds;
+    fds.reserve(connections_.size() + 1);
+    fds.push_back(pollfd{.fd = listen_fd_, .events = POLLIN, .revents = 0});
+    for (const auto& connection : connections_)
+    {
+        auto events = static_cast<short>(POLLIN | (connection.outgoing.empty() ? 0 : POLLOUT));
+        fds.push_back(pollfd{.fd = connection.fd, .events = events, .revents = 0});
+    }
+
+    if (::poll(fds.data(), fds.size(), static_cast<int>(timeout.count())) < 0)
+    {
+        if (errno == EINTR)
+        {
+            return 0;
+        }
+        return std::unexpected(TransportError::kPollFailed);
+    }
+
+    std::size_t ingested = 0;
+    for (std::size_t i = 0; i < connections_.size(); ++i)
+    {
+        auto& connection = connections_[i];
+        if ((fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+        {
+            auto received = receive(connection);
+            if (!received)
+            {
+                ++protocol_errors_;
+                closeConnection(connection);
+                continue;
+            }
+            ingested += *received;
+        }
+        sendCredits(connection);
+    }
+
+    if ((fds[0].revents & POLLIN) != 0)
+    {
+        acceptProducers();
+    }
+
+    std::erase_if(connections_,
+                  [](const Connection& connection)
+                  {
+                      return connection.fd < 0;
+                  });
+    return ingested;
+}
+
+auto StreamAggregator::run(std::stop_token stop) -> std::expected<void, TransportError>
+{
+    while (!stop.stop_requested())
+    {
+        auto polled = poll(kRunPollInterval);
+        if (!polled)
+        {
+            return std::unexpected(polled.error());
+        }
+    }
+    return {};
+}
+
+auto StreamAggregator::store() noexcept -> analysis::EventStore&
+{
+    return store_;
+}
+
+auto StreamAggregator::store() const noexcept -> const analysis::EventStore&
+{
+    return store_;
+}
+
+auto StreamAggregator::producers() const noexcept -> std::span<const ProducerInfo>
+{
+    return producers_;
+}
+
+auto StreamAggregator::protocolErrors() const noexcept -> std::uint64_t
+{
+    return protocol_errors_;
+}
+
+void StreamAggregator::acceptProducers()
+{
+    while (auto fd = acceptStream(listen_fd_))
+    {
+        if (connections_.size() >= options_.max_producers)
+        {
+            close(*fd);
+            continue;
+        }
+        Connection connection;
+        connection.fd = *fd;
+        connections_.push_back(std::move(connection));
+    }
+}
+
+auto StreamAggregator::receive(Connection& connection)
+    -> std::expected<std::size_t, TransportError>
+{
+    std::array<std::byte, kReadSize> buffer{};
+    std::size_t total = 0;
+    bool closed = false;
+
+    while (total < kMaxReadPerPoll)
+    {
+        ssize_t received = recv(connection.fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        if (received == 0)
+        {
+            closed = true;
+            break;
+        }
+        if (received < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            closed = (errno != EAGAIN && errno != EWOULDBLOCK);
+            break;
+        }
+        connection.incoming.insert(connection.incoming.end(), buffer.begin(),
+                                   buffer.begin() + received);
+        total += static_cast<std::size_t>(received);
+    }
+
+    // Handle every complete frame, including those sent just before a close
+    std::size_t ingested = 0;
+    std::size_t pos = 0;
+    auto bytes = std::span<const std::byte>{connection.incoming};
+    while (bytes.size() - pos >= kFrameHeaderSize)
+    {
+        auto header = decodeFrameHeader(bytes.subspan(pos).first<kFrameHeaderSize>());
+        if (!header)
+        {
+            return std::unexpected(header.error());
+        }
+        if (bytes.size() - pos - kFrameHeaderSize < header->payload_size)
+        {
+            break;
+        }
+
+        auto handled = handleFrame(
+            connection, *header, bytes.subspan(pos + kFrameHeaderSize, header->payload_size));
+        if (!handled)
+        {
+            return std::unexpected(handled.error());
+        }
+        ingested += *handled;
+        pos += kFrameHeaderSize + header->payload_size;
+    }
+    connection.incoming.erase(connection.incoming.begin(),
+                              connection.incoming.begin() + static_cast<std::ptrdiff_t>(pos));
+
+    if (closed)
+    {
+        closeConnection(connection);
+    }
+    return ingested;
+}
+
+auto StreamAggregator::handleFrame(Connection& connection, const FrameHeader& header,
+                                   std::span<const std::byte> payload)
+    -> std::expected<std::size_t, TransportError>
+{
+    switch (header.type)
+    {
+        case FrameType::kHello:
+        {
+            if (connection.producer >= 0)
+            {
+                return std::unexpected(TransportError::kProtocolError);
+            }
+
+            auto text = std::string_view{static_cast<const char*>(static_cast<const void*>(
+                                             payload.data())),
+                                         payload.size()};
+            auto metadata = analysis::parseTraceHeader(text);
+            if (!metadata)
+            {
+                return std::unexpected(TransportError::kProtocolError);
+            }
+
+            // The first producer with clock offsets defines the store's clock
+            if (!store_.clockSnapshot() && metadata->clock)
+            {
+                store_.setClockSnapshot(*metadata->clock);
+            }
+
+            connection.producer = static_cast<std::ptrdiff_t>(producers_.size());
+            producers_.push_back(ProducerInfo{.metadata = std::move(*metadata)});
+            connection.owed_credits += options_.initial_credits;
+            return 0;
+        }
+
+        case FrameType::kChunk:
+        {
+            if (connection.producer < 0)
+            {
+                return std::unexpected(TransportError::kProtocolError);
+            }
+
+            decoded_.clear();
+            auto decoded = decodeMigrationChunk(payload, header.count, decoded_);
+            if (!decoded)
+            {
+                return std::unexpected(decoded.error());
+            }
+
+            for (const auto& event : decoded_)
+            {
+                store_.addMigration(event);
+            }
+
+            auto& producer = producers_[static_cast<std::size_t>(connection.producer)];
+            ++producer.chunks;
+            producer.migrations += decoded_.size();
+
+            // The chunk is stored, so the producer may send another
+            ++connection.owed_credits;
+            return decoded_.size();
+        }
+
+        case FrameType::kCredit:
+            break;
+    }
+    return std::unexpected(TransportError::kProtocolError);
+}
+
+void StreamAggregator::sendCredits(Connection& connection)
+{
+    if (connection.fd < 0)
+    {
+        return;
+    }
+
+    if (connection.owed_credits > 0)
+    {
+        auto frame = encodeFrameHeader(FrameHeader{
+            .type = FrameType::kCredit, .payload_size = 0, .count = connection.owed_credits});
+        connection.outgoing.insert(connection.outgoing.end(), frame.begin(), frame.end());
+        connection.owed_credits = 0;
+    }
+
+    if (connection.outgoing.empty())
+    {
+        return;
+    }
+
+    ssize_t sent = send(connection.fd, connection.outgoing.data(), connection.outgoing.size(),
+                        MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            closeConnection(connection);
+        }
+        return;
+    }
+    connection.outgoing.erase(connection.outgoing.begin(), connection.outgoing.begin() + sent);
+}
+
+void StreamAggregator::closeConnection(Connection& connection) noexcept
+{
+    if (connection.fd >= 0)
+    {
+        close(connection.fd);
+        connection.fd = -1;
+    }
+    if (connection.producer >= 0)
+    {
+        producers_[static_cast<std::size_t>(connection.producer)].connected = false;
+    }
+}
+
+void StreamAggregator::closeAll() noexcept
+{
+    for (auto& connection : connections_)
+    {
+        closeConnection(connection);
+    }
+    connections_.clear();
+
+    if (listen_fd_ >= 0)
+    {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        if (endpoint_.kind == StreamEndpoint::Kind::kUnix)
+        {
+            unlink(endpoint_.path.c_str());
+        }
+    }
+}
+
+}  // namespace threveal::transport
@@ -0,0 +1,507 @@
+/**
+ *  @file       stream_protocol.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the stream wire format and socket setup.
+ */
+
+#include "threveal/transport/stream_protocol.hpp"
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <limits>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace threveal::transport
+{
+
+namespace
+{
+
+using core::TransportError;
+
+// Frame header field offsets
+constexpr std::size_t kMagicOffset = 0;
+constexpr std::size_t kVersionOffset = 4;
+constexpr std::size_t kTypeOffset = 6;
+constexpr std::size_t kPayloadSizeOffset = 8;
+constexpr std::size_t kCountOffset = 12;
+
+/**
+ *  Smallest encoded record: eight one-byte fields and a repeated name.
+ */
+constexpr std::size_t kMinRecordSize = 9;
+
+/**
+ *  A 64-bit varint takes at most ten bytes.
+ */
+constexpr int kMaxVarintBytes = 10;
+
+/**
+ *  Set in a record's core type field for a polled, low-fidelity migration.
+ */
+constexpr std::uint64_t kPolledFlag = 0x100;
+
+template <typename T>
+void putLittleEndian(std::byte* out, T value) noexcept
+{
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out[i] = static_cast<std::byte>((value >> (8 * i)) & 0xff);
+    }
+}
+
+template <typename T>
+auto getLittleEndian(const std::byte* in) noexcept -> T
+{
+    T value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        value |= static_cast<T>(std::to_integer<T>(in[i]) << (8 * i));
+    }
+    return value;
+}
+
+void putVarint(std::vector<std::byte>& out, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<std::byte>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::byte>(value));
+}
+
+/**
+ *  Maps signed deltas to unsigned values with small magnitudes first.
+ */
+auto zigzag(std::int64_t value) noexcept -> std::uint64_t
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+auto unzigzag(std::uint64_t value) noexcept -> std::int64_t
+{
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+/**
+ *  Sequential reader over a chunk payload.
+ */
+class PayloadReader
+{
+  public:
+    explicit PayloadReader(std::span<const std::byte> payload) noexcept : payload_(payload) {}
+
+    [[nodiscard]] auto varint() noexcept -> std::optional<std::uint64_t>
+    {
+        std::uint64_t value = 0;
+        for (int i = 0; i < kMaxVarintBytes && pos_ < payload_.size(); ++i)
+        {
+            auto byte = std::to_integer<std::uint64_t>(payload_[pos_++]);
+            value |= (byte & 0x7f) << (7 * i);
+            if ((byte & 0x80) == 0)
+            {
+                return value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    [[nodiscard]] auto varint32() noexcept -> std::optional<std::uint32_t>
+    {
+        auto value = varint();
+        if (!value || *value > std::numeric_limits<std::uint32_t>::max())
+        {
+            return std::nullopt;
+        }
+        return static_cast<std::uint32_t>(*value);
+    }
+
+    [[nodiscard]] auto bytes(std::size_t count) noexcept
+        -> std::optional<std::span<const std::byte>>
+    {
+        if (payload_.size() - pos_ < count)
+        {
+            return std::nullopt;
+        }
+        auto result = payload_.subspan(pos_, count);
+        pos_ += count;
+        return result;
+    }
+
+    [[nodiscard]] auto done() const noexcept -> bool
+    {
+        return pos_ == payload_.size();
+    }
+
+  private:
+    std::span<const std::byte> payload_;
+    std::size_t pos_{0};
+};
+
+auto decodeCoreType(std::uint64_t raw) noexcept -> core::CoreType
+{
+    switch (static_cast<core::CoreType>(raw))
+    {
+        case core::CoreType::kPCore:
+            return core::CoreType::kPCore;
+        case core::CoreType::kECore:
+            return core::CoreType::kECore;
+        default:
+            return core::CoreType::kUnknown;
+    }
+}
+
+auto decodeRecord(PayloadReader& reader, core::MigrationEvent& event,
+                  std::uint64_t& previous_timestamp) -> bool
+{
+    auto delta = reader.varint();
+    auto pid = reader.varint32();
+    auto tid_delta = reader.varint();
+    auto src_cpu = reader.varint32();
+    auto dst_cpu = reader.varint32();
+    auto generation = reader.varint32();
+    auto weight = reader.varint32();
+    auto types = reader.varint();
+    auto comm_tag = reader.varint();
+    if (!delta || !pid || !tid_delta || !src_cpu || !dst_cpu || !generation || !weight ||
+        !types || !comm_tag || *comm_tag > core::kMaxCommLength)
+    {
+        return false;
+    }
+
+    auto tid = static_cast<std::int64_t>(*pid) + unzigzag(*tid_delta);
+    if (tid < 0 || tid > std::numeric_limits<std::uint32_t>::max())
+    {
+        return false;
+    }
+
+    previous_timestamp += static_cast<std::uint64_t>(unzigzag(*delta));
+    event.timestamp_ns = previous_timestamp;
+    event.pid = *pid;
+    event.tid = static_cast<std::uint32_t>(tid);
+    event.src_cpu = *src_cpu;
+    event.dst_cpu = *dst_cpu;
+    event.topology_generation = *generation;
+    event.sample_weight = std::max<std::uint32_t>(*weight, 1);
+    event.src_type = decodeCoreType(*types & 0x0f);
+    event.dst_type = decodeCoreType((*types >> 4) & 0x0f);
+    event.fidelity = (*types & kPolledFlag) != 0 ? core::MigrationFidelity::kPolled
+                                                 : core::MigrationFidelity::kExact;
+
+    // Tag 0 repeats the previous name; otherwise it is the length plus one
+    if (*comm_tag != 0)
+    {
+        auto name = reader.bytes(static_cast<std::size_t>(*comm_tag - 1));
+        if (!name)
+        {
+            return false;
+        }
+        event.comm.fill('\0');
+        std::memcpy(event.comm.data(), name->data(), name->size());
+    }
+    return true;
+}
+
+/**
+ *  Socket address of an endpoint.
+ */
+struct SocketAddress
+{
+    sockaddr_storage storage{};
+    socklen_t length{0};
+    int domain{AF_UNIX};
+
+    [[nodiscard]] auto get() const noexcept -> const sockaddr*
+    {
+        return static_cast<const sockaddr*>(static_cast<const void*>(&storage));
+    }
+};
+
+auto toSocketAddress(const StreamEndpoint& endpoint) -> std::expected<SocketAddress, TransportError>
+{
+    SocketAddress result;
+
+    if (endpoint.kind == StreamEndpoint::Kind::kUnix)
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+
+        // Leave room for the terminator
+        if (endpoint.path.empty() || endpoint.path.size() >= sizeof(addr.sun_path))
+        {
+            return std::unexpected(TransportError::kInvalidEndpoint);
+        }
+        std::ranges::copy(endpoint.path, std::begin(addr.sun_path));
+
+        std::memcpy(&result.storage, &addr, sizeof(addr));
+        result.length = sizeof(addr);
+        result.domain = AF_UNIX;
+        return result;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(endpoint.port);
+    if (inet_pton(AF_INET, endpoint.address.c_str(), &addr.sin_addr) != 1)
+    {
+        return std::unexpected(TransportError::kInvalidEndpoint);
+    }
+
+    std::memcpy(&result.storage, &addr, sizeof(addr));
+    result.length = sizeof(addr);
+    result.domain = AF_INET;
+    return result;
+}
+
+/**
+ *  Sends small credit frames without waiting for a full segment.
+ */
+void disableNagle(int fd, int domain) noexcept
+{
+    if (domain == AF_INET)
+    {
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+}
+
+}  // namespace
+
+auto encodeFrameHeader(const FrameHeader& header) noexcept
+    -> std::array<std::byte, kFrameHeaderSize>
+{
+    std::array<std::byte, kFrameHeaderSize> bytes{};
+    putLittleEndian(bytes.data() + kMagicOffset, kStreamMagic);
+    putLittleEndian(bytes.data() + kVersionOffset, kStreamVersion);
+    bytes[kTypeOffset] = static_cast<std::byte>(header.type);
+    putLittleEndian(bytes.data() + kPayloadSizeOffset, header.payload_size);
+    putLittleEndian(bytes.data() + kCountOffset, header.count);
+    return bytes;
+}
+
+auto decodeFrameHeader(std::span<const std::byte, kFrameHeaderSize> bytes)
+    -> std::expected<FrameHeader, TransportError>
+{
+    if (getLittleEndian<std::uint32_t>(bytes.data() + kMagicOffset) != kStreamMagic ||
+        getLittleEndian<std::uint16_t>(bytes.data() + kVersionOffset) != kStreamVersion)
+    {
+        return std::unexpected(TransportError::kProtocolError);
+    }
+
+    FrameHeader header;
+    header.payload_size = getLittleEndian<std::uint32_t>(bytes.data() + kPayloadSizeOffset);
+    header.count = getLittleEndian<std::uint32_t>(bytes.data() + kCountOffset);
+    if (header.payload_size > kMaxFramePayload)
+    {
+        return std::unexpected(TransportError::kProtocolError);
+    }
+
+    switch (static_cast<FrameType>(bytes[kTypeOffset]))
+    {
+        case FrameType::kHello:
+            header.type = FrameType::kHello;
+            break;
+        case FrameType::kCredit:
+            header.type = FrameType::kCredit;
+            break;
+        case FrameType::kChunk:
+            header.type = FrameType::kChunk;
+            break;
+        default:
+            return std::unexpected(TransportError::kProtocolError);
+    }
+    return header;
+}
+
+void encodeMigrationChunk(std::span<const core::MigrationEvent> events,
+                          std::vector<std::byte>& out)
+{
+    std::uint64_t previous_timestamp = 0;
+    std::string_view previous_comm;
+
+    for (const auto& event : events)
+    {
+        putVarint(out, zigzag(static_cast<std::int64_t>(event.timestamp_ns - previous_timestamp)));
+        putVarint(out, event.pid);
+        putVarint(out, zigzag(static_cast<std::int64_t>(event.tid) -
+                              static_cast<std::int64_t>(event.pid)));
+        putVarint(out, event.src_cpu);
+        putVarint(out, event.dst_cpu);
+        putVarint(out, event.topology_generation);
+        putVarint(out, event.sample_weight);
+        putVarint(out, static_cast<std::uint64_t>(event.src_type) |
+                           (static_cast<std::uint64_t>(event.dst_type) << 4) |
+                           (event.fidelity == core::MigrationFidelity::kPolled ? kPolledFlag : 0));
+
+        auto comm = event.commAsStringView();
+        if (!previous_comm.data() || comm != previous_comm)
+        {
+            putVarint(out, comm.size() + 1);
+            auto bytes = std::as_bytes(std::span{comm});
+            out.insert(out.end(), bytes.begin(), bytes.end());
+        }
+        else
+        {
+            putVarint(out, 0);
+        }
+
+        previous_timestamp = event.timestamp_ns;
+        previous_comm = comm;
+    }
+}
+
+auto decodeMigrationChunk(std::span<const std::byte> payload, std::uint32_t count,
+                          std::vector<core::MigrationEvent>& out)
+    -> std::expected<void, TransportError>
+{
+    // Reject impossible counts before reserving memory for them
+    if (count > payload.size() / kMinRecordSize)
+    {
+        return std::unexpected(TransportError::kProtocolError);
+    }
+
+    PayloadReader reader{payload};
+    std::uint64_t previous_timestamp = 0;
+    core::MigrationEvent event{};
+
+    out.reserve(out.size() + count);
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        if (!decodeRecord(reader, event, previous_timestamp))
+        {
+            return std::unexpected(TransportError::kProtocolError);
+        }
+        out.push_back(event);
+    }
+
+    if (!reader.done())
+    {
+        return std::unexpected(TransportError::kProtocolError);
+    }
+    return {};
+}
+
+auto StreamEndpoint::unixSocket(std::string path) -> StreamEndpoint
+{
+    StreamEndpoint endpoint;
+    endpoint.path = std::move(path);
+    return endpoint;
+}
+
+auto StreamEndpoint::tcp(std::string address, std::uint16_t port) -> StreamEndpoint
+{
+    StreamEndpoint endpoint;
+    endpoint.kind = Kind::kTcp;
+    endpoint.address = std::move(address);
+    endpoint.port = port;
+    return endpoint;
+}
+
+auto connectStream(const StreamEndpoint& endpoint) -> std::expected<int, TransportError>
+{
+    auto address = toSocketAddress(endpoint);
+    if (!address)
+    {
+        return std::unexpected(address.error());
+    }
+
+    int fd = socket(address->domain, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return std::unexpected(TransportError::kSocketFailed);
+    }
+
+    // Connect while blocking; the aggregator is local, so this is quick
+    if (connect(fd, address->get(), address->length) < 0)
+    {
+        close(fd);
+        return std::unexpected(TransportError::kConnectFailed);
+    }
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        close(fd);
+        return std::unexpected(TransportError::kSocketFailed);
+    }
+
+    disableNagle(fd, address->domain);
+    return fd;
+}
+
+auto listenStream(const StreamEndpoint& endpoint) -> std::expected<int, TransportError>
+{
+    auto address = toSocketAddress(endpoint);
+    if (!address)
+    {
+        return std::unexpected(address.error());
+    }
+
+    int fd = socket(address->domain, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+    {
+        return std::unexpected(TransportError::kSocketFailed);
+    }
+
+    if (address->domain == AF_UNIX)
+    {
+        // A previous aggregator that crashed leaves its socket file behind
+        struct stat info{};
+        if (lstat(endpoint.path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+        {
+            unlink(endpoint.path.c_str());
+        }
+    }
+    else
+    {
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    }
+
+    if (bind(fd, address->get(), address->length) < 0 || listen(fd, SOMAXCONN) < 0)
+    {
+        close(fd);
+        return std::unexpected(TransportError::kBindFailed);
+    }
+    return fd;
+}
+
+auto acceptStream(int listen_fd) -> std::optional<int>
+{
+    sockaddr_storage peer{};
+    socklen_t length = sizeof(peer);
+    int fd = accept4(listen_fd, static_cast<sockaddr*>(static_cast<void*>(&peer)), &length,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::nullopt;
+    }
+
+    disableNagle(fd, peer.ss_family);
+    return fd;
+}
+
+}  // namespace threveal::transport
@@ -0,0 +1,480 @@
+/**
+ *  @file       stream_sink.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Implementation of the stream producer.
+ */
+
+#include "threveal/transport/stream_sink.hpp"
+
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <poll.h>
+#include <span>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace threveal::transport
+{
+
+namespace
+{
+
+using core::TransportError;
+
+/**
+ *  Upper bound on an encoded migration, used to keep chunks below
+ *  kMaxFramePayload.
+ */
+constexpr std::size_t kMaxEncodedMigration = 64;
+
+/**
+ *  iovec entries per sendmsg(): the hello frame plus two per chunk.
+ */
+constexpr std::size_t kMaxIovecs = 65;
+
+constexpr std::size_t kCreditReadSize = 256;
+
+auto makeIovec(std::span<std::byte> bytes) noexcept -> iovec
+{
+    return iovec{.iov_base = bytes.data(), .iov_len = bytes.size()};
+}
+
+}  // namespace
+
+StreamSink::StreamSink(StreamEndpoint endpoint, std::vector<std::byte> hello,
+                       StreamSinkOptions options) noexcept
+    : endpoint_(std::move(endpoint)), options_(options), hello_(std::move(hello))
+{
+}
+
+StreamSink::~StreamSink()
+{
+    disconnect();
+}
+
+StreamSink::StreamSink(StreamSink&& other) noexcept
+    : endpoint_(std::move(other.endpoint_)),
+      options_(other.options_),
+      hello_(std::move(other.hello_)),
+      fd_(std::exchange(other.fd_, -1)),
+      open_chunk_(std::move(other.open_chunk_)),
+      queue_(std::move(other.queue_)),
+      hello_sent_(other.hello_sent_),
+      front_sent_(other.front_sent_),
+      credits_(other.credits_),
+      credit_buffer_(std::move(other.credit_buffer_)),
+      next_connect_(other.next_connect_),
+      backoff_(other.backoff_),
+      ever_connected_(other.ever_connected_),
+      sent_chunks_(other.sent_chunks_),
+      dropped_migrations_(other.dropped_migrations_),
+      reconnects_(other.reconnects_)
+{
+}
+
+auto StreamSink::operator=(StreamSink&& other) noexcept -> StreamSink&
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    disconnect();
+    endpoint_ = std::move(other.endpoint_);
+    options_ = other.options_;
+    hello_ = std::move(other.hello_);
+    fd_ = std::exchange(other.fd_, -1);
+    open_chunk_ = std::move(other.open_chunk_);
+    queue_ = std::move(other.queue_);
+    hello_sent_ = other.hello_sent_;
+    front_sent_ = other.front_sent_;
+    credits_ = other.credits_;
+    credit_buffer_ = std::move(other.credit_buffer_);
+    next_connect_ = other.next_connect_;
+    backoff_ = other.backoff_;
+    ever_connected_ = other.ever_connected_;
+    sent_chunks_ = other.sent_chunks_;
+    dropped_migrations_ = other.dropped_migrations_;
+    reconnects_ = other.reconnects_;
+    return *this;
+}
+
+auto StreamSink::create(StreamEndpoint endpoint, const analysis::TraceHeader& metadata,
+                        StreamSinkOptions options) -> std::expected<StreamSink, TransportError>
+{
+    auto text = analysis::formatTraceHeader(metadata);
+    if (!text || text->size() > kMaxFramePayload)
+    {
+        return std::unexpected(TransportError::kInvalidEndpoint);
+    }
+
+    constexpr std::size_t kMaxChunkMigrations = kMaxFramePayload / kMaxEncodedMigration;
+    options.chunk_migrations =
+        std::clamp<std::size_t>(options.chunk_migrations, 1, kMaxChunkMigrations);
+    options.max_queued_chunks = std::max<std::size_t>(options.max_queued_chunks, 1);
+    options.reconnect_min = std::max(options.reconnect_min, std::chrono::milliseconds{1});
+    options.reconnect_max = std::max(options.reconnect_max, options.reconnect_min);
+
+    auto header = encodeFrameHeader(FrameHeader{.type = FrameType::kHello,
+                                                .payload_size =
+                                                    static_cast<std::uint32_t>(text->size()),
+                                                .count = 0});
+    std::vector<std::byte> hello(header.begin(), header.end());
+    auto payload = std::as_bytes(std::span{*text});
+    hello.insert(hello.end(), payload.begin(), payload.end());
+
+    // An unreachable aggregator is retried later; a bad address never works
+    StreamSink sink{std::move(endpoint), std::move(hello), options};
+    auto connected = sink.tryConnect();
+    if (!connected && connected.error() == TransportError::kInvalidEndpoint)
+    {
+        return std::unexpected(connected.error());
+    }
+    return sink;
+}
+
+auto StreamSink::push(std::span<const core::MigrationEvent> events)
+    -> std::expected<std::size_t, TransportError>
+{
+    enqueue(events);
+    return pump();
+}
+
+auto StreamSink::pump() -> std::expected<std::size_t, TransportError>
+{
+    if (fd_ < 0 && !tryConnect())
+    {
+        return std::unexpected(TransportError::kDisconnected);
+    }
+
+    if (!readCredits())
+    {
+        disconnect();
+        return std::unexpected(TransportError::kDisconnected);
+    }
+    return writeQueued();
+}
+
+auto StreamSink::flush(std::chrono::milliseconds timeout) -> std::expected<void, TransportError>
+{
+    sealOpenChunk();
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true)
+    {
+        // A disconnect is retried until the deadline
+        auto written = pump();
+        if (queue_.empty())
+        {
+            return {};
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+        {
+            return std::unexpected(TransportError::kTimedOut);
+        }
+
+        auto wake = written ? deadline : std::min(deadline, next_connect_);
+        auto wait_ms = std::chrono::ceil<std::chrono::milliseconds>(wake - now).count();
+
+        if (fd_ < 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{wait_ms});
+            continue;
+        }
+
+        // Wait for credits, or for socket space if credits are in hand
+        pollfd pfd{.fd = fd_, .events = POLLIN, .revents = 0};
+        if (credits_ > 0 || front_sent_ > 0 || hello_sent_ < hello_.size())
+        {
+            pfd.events |= POLLOUT;
+        }
+        if (poll(&pfd, 1, static_cast<int>(wait_ms)) < 0 && errno != EINTR)
+        {
+            return std::unexpected(TransportError::kPollFailed);
+        }
+    }
+}
+
+auto StreamSink::isConnected() const noexcept -> bool
+{
+    return fd_ >= 0;
+}
+
+auto StreamSink::credits() const noexcept -> std::uint64_t
+{
+    return credits_;
+}
+
+auto StreamSink::queuedChunks() const noexcept -> std::size_t
+{
+    return queue_.size();
+}
+
+auto StreamSink::sentChunks() const noexcept -> std::uint64_t
+{
+    return sent_chunks_;
+}
+
+auto StreamSink::droppedMigrations() const noexcept -> std::uint64_t
+{
+    return dropped_migrations_;
+}
+
+auto StreamSink::reconnects() const noexcept -> std::uint64_t
+{
+    return reconnects_;
+}
+
+void StreamSink::enqueue(std::span<const core::MigrationEvent> events)
+{
+    // Top up a partial chunk left by an earlier push first
+    if (!open_chunk_.empty())
+    {
+        auto take = std::min(events.size(), options_.chunk_migrations - open_chunk_.size());
+        open_chunk_.insert(open_chunk_.end(), events.begin(),
+                           events.begin() + static_cast<std::ptrdiff_t>(take));
+        events = events.subspan(take);
+        if (open_chunk_.size() == options_.chunk_migrations)
+        {
+            sealOpenChunk();
+        }
+    }
+
+    while (events.size() >= options_.chunk_migrations)
+    {
+        queueChunk(events.first(options_.chunk_migrations));
+        events = events.subspan(options_.chunk_migrations);
+    }
+
+    open_chunk_.insert(open_chunk_.end(), events.begin(), events.end());
+    dropExcessChunks();
+}
+
+void StreamSink::sealOpenChunk()
+{
+    if (open_chunk_.empty())
+    {
+        return;
+    }
+
+    queueChunk(open_chunk_);
+    open_chunk_.clear();
+    dropExcessChunks();
+}
+
+void StreamSink::queueChunk(std::span<const core::MigrationEvent> events)
+{
+    Chunk chunk;
+    encodeMigrationChunk(events, chunk.payload);
+    chunk.migrations = static_cast<std::uint32_t>(events.size());
+    chunk.header = encodeFrameHeader(
+        FrameHeader{.type = FrameType::kChunk,
+                    .payload_size = static_cast<std::uint32_t>(chunk.payload.size()),
+                    .count = chunk.migrations});
+    queue_.push_back(std::move(chunk));
+}
+
+void StreamSink::dropExcessChunks()
+{
+    // Never drop a chunk that is half written
+    while (queue_.size() > options_.max_queued_chunks)
+    {
+        auto victim = queue_.begin() + ((front_sent_ > 0) ? 1 : 0);
+        dropped_migrations_ += victim->migrations;
+        queue_.erase(victim);
+    }
+}
+
+void StreamSink::disconnect() noexcept
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+auto StreamSink::tryConnect() -> std::expected<void, TransportError>
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now < next_connect_)
+    {
+        return std::unexpected(TransportError::kDisconnected);
+    }
+
+    auto fd = connectStream(endpoint_);
+    if (!fd)
+    {
+        backoff_ = (backoff_.count() == 0) ? options_.reconnect_min
+                                           : std::min(backoff_ * 2, options_.reconnect_max);
+        next_connect_ = now + backoff_;
+        return std::unexpected(fd.error());
+    }
+
+    fd_ = *fd;
+    backoff_ = std::chrono::milliseconds{0};
+    reconnects_ += ever_connected_ ? 1 : 0;
+    ever_connected_ = true;
+
+    // Credits belong to the old connection; a half-written chunk is resent
+    hello_sent_ = 0;
+    front_sent_ = 0;
+    credits_ = 0;
+    credit_buffer_.clear();
+    return {};
+}
+
+auto StreamSink::readCredits() -> bool
+{
+    std::array<std::byte, kCreditReadSize> buffer{};
+    while (true)
+    {
+        ssize_t received = recv(fd_, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        if (received == 0)
+        {
+            return false;
+        }
+        if (received < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return false;
+            }
+            break;
+        }
+        credit_buffer_.insert(credit_buffer_.end(), buffer.begin(),
+                              buffer.begin() + static_cast<std::ptrdiff_t>(received));
+    }
+
+    std::size_t pos = 0;
+    while (credit_buffer_.size() - pos >= kFrameHeaderSize)
+    {
+        auto frame =
+            decodeFrameHeader(std::span{credit_buffer_}.subspan(pos).first<kFrameHeaderSize>());
+        if (!frame || frame->type != FrameType::kCredit || frame->payload_size != 0)
+        {
+            return false;
+        }
+        credits_ += frame->count;
+        pos += kFrameHeaderSize;
+    }
+    credit_buffer_.erase(credit_buffer_.begin(),
+                         credit_buffer_.begin() + static_cast<std::ptrdiff_t>(pos));
+    return true;
+}
+
+auto StreamSink::writeQueued() -> std::expected<std::size_t, TransportError>
+{
+    std::array<iovec, kMaxIovecs> iov{};
+    std::size_t count = 0;
+
+    if (hello_sent_ < hello_.size())
+    {
+        iov[count++] = makeIovec(std::span{hello_}.subspan(hello_sent_));
+    }
+
+    // Gather every chunk a credit allows, without copying
+    auto credits = credits_;
+    std::size_t offset = front_sent_;
+    for (auto& chunk : queue_)
+    {
+        if (count + 2 > iov.size())
+        {
+            break;
+        }
+        if (offset == 0)
+        {
+            if (credits == 0)
+            {
+                break;
+            }
+            --credits;
+        }
+
+        std::span<std::byte> header = chunk.header;
+        if (offset < header.size())
+        {
+            iov[count++] = makeIovec(header.subspan(offset));
+            offset = 0;
+        }
+        else
+        {
+            offset -= header.size();
+        }
+        iov[count++] = makeIovec(std::span{chunk.payload}.subspan(offset));
+        offset = 0;
+    }
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    msghdr message{};
+    message.msg_iov = iov.data();
+    message.msg_iovlen = count;
+
+    ssize_t sent = sendmsg(fd_, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return 0;
+        }
+        disconnect();
+        return std::unexpected(TransportError::kDisconnected);
+    }
+
+    // Account for what the kernel took, which may end mid-frame
+    auto remaining = static_cast<std::size_t>(sent);
+    auto hello_part = std::min(remaining, hello_.size() - hello_sent_);
+    hello_sent_ += hello_part;
+    remaining -= hello_part;
+
+    std::size_t completed = 0;
+    while (remaining > 0)
+    {
+        auto& chunk = queue_.front();
+        if (front_sent_ == 0)
+        {
+            --credits_;
+        }
+
+        auto size = chunk.header.size() + chunk.payload.size();
+        auto part = std::min(remaining, size - front_sent_);
+        front_sent_ += part;
+        remaining -= part;
+
+        if (front_sent_ == size)
+        {
+            queue_.pop_front();
+            front_sent_ = 0;
+            ++sent_chunks_;
+            ++completed;
+        }
+    }
+    return completed;
+}
+
+}  // namespace threveal::transport
@@ -0,0 +1,230 @@
+/**
+ *  @file       test_arrow_export.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the Arrow IPC export.
+ */
+
+#include "threveal/analysis/arrow_export.hpp"
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+using threveal::analysis::ArrowFormat;
+using threveal::analysis::ArrowTable;
+using threveal::analysis::ArrowWriter;
+using threveal::analysis::EventStore;
+using threveal::analysis::exportArrow;
+using threveal::analysis::kArrowBatchRows;
+using threveal::analysis::TraceHeader;
+using threveal::core::CpuId;
+using threveal::core::MigrationEvent;
+using threveal::core::PmuSample;
+using threveal::core::TopologyMap;
+using threveal::core::TraceError;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+auto tempPath(const char* name) -> std::string
+{
+    return (fs::temp_directory_path() /
+            ("threveal_" + std::string(name) + "_" + std::to_string(getpid()) + ".arrow"))
+        .string();
+}
+
+auto readFile(const std::string& path) -> std::vector<char>
+{
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+auto readU32(const std::vector<char>& bytes, std::size_t pos) -> std::uint32_t
+{
+    std::uint32_t value = 0;
+    std::memcpy(&value, bytes.data() + pos, sizeof(value));
+    return value;
+}
+
+auto readU64(const std::vector<char>& bytes, std::size_t pos) -> std::uint64_t
+{
+    std::uint64_t value = 0;
+    std::memcpy(&value, bytes.data() + pos, sizeof(value));
+    return value;
+}
+
+auto makeHeader() -> TraceHeader
+{
+    std::vector<CpuId> p_cores = {0, 1};
+    std::vector<CpuId> e_cores = {2, 3};
+    TraceHeader header;
+    header.host = "node-1";
+    header.topology = TopologyMap{p_cores, e_cores};
+    return header;
+}
+
+auto makeMigrations(std::size_t count) -> std::vector<MigrationEvent>
+{
+    std::vector<MigrationEvent> events(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        events[i].timestamp_ns = 5000 + i;
+        events[i].pid = 10;
+        events[i].tid = 11;
+        std::strncpy(events[i].comm.data(), "worker", events[i].comm.size() - 1);
+    }
+    return events;
+}
+
+auto makeSamples(std::size_t count) -> std::vector<PmuSample>
+{
+    std::vector<PmuSample> samples(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        samples[i].timestamp_ns = i;
+        samples[i].tid = 11;
+        samples[i].instructions = 2 * i;
+        samples[i].cycles = i;
+    }
+    return samples;
+}
+
+}  // namespace
+
+TEST_CASE("ArrowWriter frames files with magic and footer", "[analysis][ArrowExport]")
+{
+    auto path = tempPath("arrow_file");
+    auto events = makeMigrations(3);
+    {
+        auto writer = ArrowWriter::open(path, ArrowTable::kMigrations, makeHeader());
+        REQUIRE(writer.has_value());
+        REQUIRE(writer->write(events).has_value());
+        REQUIRE(writer->rows() == 3);
+        REQUIRE(writer->batches() == 1);
+        REQUIRE(writer->finish().has_value());
+    }
+
+    auto bytes = readFile(path);
+    REQUIRE(bytes.size() % 8 == 2);
+    REQUIRE(std::string_view(bytes.data(), 8) == std::string_view("ARROW1\0\0", 8));
+    REQUIRE(std::string_view(bytes.data() + bytes.size() - 6, 6) == "ARROW1");
+
+    // The footer ends right before its length and the trailing magic
+    auto footer_size = readU32(bytes, bytes.size() - 10);
+    REQUIRE(footer_size % 8 == 0);
+    REQUIRE(footer_size + 10 + 8 < bytes.size());
+
+    // End-of-stream marker before the footer
+    auto eos = bytes.size() - 10 - footer_size - 8;
+    REQUIRE(readU32(bytes, eos) == 0xffffffff);
+    REQUIRE(readU32(bytes, eos + 4) == 0);
+    fs::remove(path);
+}
+
+TEST_CASE("ArrowWriter aligns column buffers", "[analysis][ArrowExport]")
+{
+    auto path = tempPath("arrow_stream");
+    auto events = makeMigrations(5);
+    {
+        auto writer =
+            ArrowWriter::open(path, ArrowTable::kMigrations, makeHeader(), ArrowFormat::kStream);
+        REQUIRE(writer.has_value());
+        REQUIRE(writer->write(events).has_value());
+    }
+
+    // The destructor finished the stream
+    auto bytes = readFile(path);
+    REQUIRE(readU32(bytes, bytes.size() - 8) == 0xffffffff);
+    REQUIRE(readU32(bytes, bytes.size() - 4) == 0);
+
+    // Schema message without a body, then the record batch
+    REQUIRE(readU32(bytes, 0) == 0xffffffff);
+    auto schema_size = readU32(bytes, 4);
+    auto batch = 8 + std::size_t{schema_size};
+    REQUIRE(batch % 64 == 0);
+    REQUIRE(readU32(bytes, batch) == 0xffffffff);
+
+    // The first buffer after the empty validity bitmap holds timestamp_ns
+    auto body = batch + 8 + readU32(bytes, batch + 4);
+    REQUIRE(body % 64 == 0);
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+        REQUIRE(readU64(bytes, body + (i * 8)) == events[i].timestamp_ns);
+    }
+    fs::remove(path);
+}
+
+TEST_CASE("ArrowWriter splits large writes into batches", "[analysis][ArrowExport]")
+{
+    auto path = tempPath("arrow_split");
+    auto samples = makeSamples(kArrowBatchRows + 10);
+
+    auto writer = ArrowWriter::open(path, ArrowTable::kPmuSamples, makeHeader());
+    REQUIRE(writer.has_value());
+    REQUIRE(writer->write(samples).has_value());
+    REQUIRE(writer->batches() == 2);
+    REQUIRE(writer->rows() == kArrowBatchRows + 10);
+    REQUIRE(writer->finish().has_value());
+    REQUIRE(writer->finish().has_value());
+    fs::remove(path);
+}
+
+TEST_CASE("ArrowWriter rejects mismatched records and headers", "[analysis][ArrowExport]")
+{
+    auto path = tempPath("arrow_reject");
+
+    auto writer = ArrowWriter::open(path, ArrowTable::kPmuSamples, makeHeader());
+    REQUIRE(writer.has_value());
+    auto events = makeMigrations(1);
+    REQUIRE(writer->write(events).error() == TraceError::kSchemaMismatch);
+    REQUIRE(writer->finish().has_value());
+
+    auto header = makeHeader();
+    header.host = "bad\nhost";
+    REQUIRE(ArrowWriter::open(path, ArrowTable::kMigrations, header).error() ==
+            TraceError::kInvalidHeader);
+    REQUIRE(ArrowWriter::open("/nonexistent/dir/trace.arrow", ArrowTable::kMigrations,
+                              makeHeader())
+                .error() == TraceError::kOpenFailed);
+    fs::remove(path);
+}
+
+TEST_CASE("exportArrow writes both tables of a store", "[analysis][ArrowExport]")
+{
+    auto migrations_path = tempPath("arrow_migrations");
+    auto pmu_path = tempPath("arrow_pmu");
+
+    EventStore store;
+    for (const auto& event : makeMigrations(4))
+    {
+        store.addMigration(event);
+    }
+    for (const auto& sample : makeSamples(6))
+    {
+        store.addPmuSample(sample);
+    }
+
+    REQUIRE(exportArrow(store, makeHeader(), migrations_path, pmu_path).has_value());
+    REQUIRE(fs::file_size(migrations_path) > 0);
+    REQUIRE(fs::file_size(pmu_path) > 0);
+    REQUIRE(readFile(pmu_path).size() % 8 == 2);
+    fs::remove(migrations_path);
+    fs::remove(pmu_path);
+}
@@ -0,0 +1,218 @@
+/**
+ *  @file       test_broadcast_ring.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the shared-memory broadcast ring.
+ */
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/transport/broadcast_ring.hpp"
+
+#include <array>
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using threveal::core::MigrationEvent;
+using threveal::core::TransportError;
+using threveal::transport::BroadcastPublisher;
+using threveal::transport::BroadcastSubscriber;
+using threveal::transport::receiveDescriptor;
+using threveal::transport::sendDescriptor;
+
+namespace
+{
+
+auto makeMigration(std::uint64_t n) -> MigrationEvent
+{
+    MigrationEvent event{};
+    event.timestamp_ns = n;
+    event.pid = 100;
+    event.tid = static_cast<std::uint32_t>(n);
+    event.src_cpu = 1;
+    event.dst_cpu = 2;
+    event.sample_weight = static_cast<std::uint32_t>(n * 3);
+    std::strncpy(event.comm.data(), "worker", event.comm.size() - 1);
+    return event;
+}
+
+}  // namespace
+
+TEST_CASE("BroadcastRing delivers migrations to every subscriber", "[transport][BroadcastRing]")
+{
+    auto publisher = BroadcastPublisher::create("threveal-test", 10);
+    REQUIRE(publisher.has_value());
+    REQUIRE(publisher->capacity() == 16);
+
+    auto first = BroadcastSubscriber::attach(publisher->fd());
+    auto second = BroadcastSubscriber::attach(publisher->fd());
+    REQUIRE(first.has_value());
+    REQUIRE(second.has_value());
+
+    for (std::uint64_t n = 0; n < 5; ++n)
+    {
+        publisher->publish(makeMigration(n));
+    }
+    REQUIRE(publisher->published() == 5);
+    REQUIRE(first->backlog() == 5);
+
+    std::array<MigrationEvent, 3> out{};
+    REQUIRE(first->read(out) == 3);
+    REQUIRE(out[2].tid == 2);
+    REQUIRE(out[2].sample_weight == 6);
+    REQUIRE(out[2].commAsStringView() == "worker");
+    REQUIRE(first->read(out) == 2);
+    REQUIRE(out[1].timestamp_ns == 4);
+    REQUIRE(first->read(out) == 0);
+
+    // The second cursor is independent of the first
+    REQUIRE(second->read(out) == 3);
+    REQUIRE(out[0].timestamp_ns == 0);
+    REQUIRE(first->overruns() == 0);
+    REQUIRE(second->overruns() == 0);
+}
+
+TEST_CASE("BroadcastRing subscribers choose where to start", "[transport][BroadcastRing]")
+{
+    auto publisher = BroadcastPublisher::create("threveal-test", 8);
+    REQUIRE(publisher.has_value());
+    for (std::uint64_t n = 0; n < 20; ++n)
+    {
+        publisher->publish(makeMigration(n));
+    }
+
+    auto latest = BroadcastSubscriber::attach(publisher->fd());
+    REQUIRE(latest.has_value());
+    REQUIRE(latest->backlog() == 0);
+
+    auto oldest = BroadcastSubscriber::attach(publisher->fd(), BroadcastSubscriber::Start::kOldest);
+    REQUIRE(oldest.has_value());
+    REQUIRE(oldest->backlog() == 8);
+
+    std::array<MigrationEvent, 16> out{};
+    REQUIRE(oldest->read(out) == 8);
+    REQUIRE(out[0].timestamp_ns == 12);
+    REQUIRE(oldest->overruns() == 0);
+}
+
+TEST_CASE("BroadcastRing counts migrations lost to a slow reader", "[transport][BroadcastRing]")
+{
+    auto publisher = BroadcastPublisher::create("threveal-test", 8);
+    REQUIRE(publisher.has_value());
+    auto subscriber = BroadcastSubscriber::attach(publisher->fd());
+    REQUIRE(subscriber.has_value());
+
+    for (std::uint64_t n = 0; n < 30; ++n)
+    {
+        publisher->publish(makeMigration(n));
+    }
+
+    std::array<MigrationEvent, 32> out{};
+    REQUIRE(subscriber->read(out) == 8);
+    REQUIRE(subscriber->overruns() == 22);
+    REQUIRE(out[0].timestamp_ns == 22);
+    REQUIRE(out[7].timestamp_ns == 29);
+}
+
+TEST_CASE("BroadcastRing readers never see torn records", "[transport][BroadcastRing]")
+{
+    constexpr std::uint64_t kCount = 200'000;
+    auto publisher = BroadcastPublisher::create("threveal-test", 64);
+    REQUIRE(publisher.has_value());
+    auto subscriber = BroadcastSubscriber::attach(publisher->fd());
+    REQUIRE(subscriber.has_value());
+
+    std::atomic<bool> done{false};
+    std::thread writer(
+        [&publisher, &done]()
+        {
+            for (std::uint64_t n = 0; n < kCount; ++n)
+            {
+                publisher->publish(makeMigration(n));
+            }
+            done.store(true);
+        });
+
+    // Every record read must be internally consistent and in order
+    std::uint64_t read = 0;
+    std::uint64_t last = 0;
+    bool consistent = true;
+    std::array<MigrationEvent, 16> out{};
+    while (!done.load() || subscriber->backlog() > 0)
+    {
+        auto count = subscriber->read(out);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            consistent = consistent && out[i].tid == out[i].timestamp_ns &&
+                         out[i].sample_weight == out[i].timestamp_ns * 3 &&
+                         (read == 0 || out[i].timestamp_ns > last);
+            last = out[i].timestamp_ns;
+            ++read;
+        }
+    }
+    writer.join();
+
+    REQUIRE(consistent);
+    REQUIRE(read + subscriber->overruns() == kCount);
+}
+
+TEST_CASE("BroadcastRing subscribers cannot write or resize", "[transport][BroadcastRing]")
+{
+    auto publisher = BroadcastPublisher::create("threveal-test", 8);
+    REQUIRE(publisher.has_value());
+
+    REQUIRE(ftruncate(publisher->fd(), 1) < 0);
+    REQUIRE(mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, publisher->fd(), 0) ==
+            MAP_FAILED);
+}
+
+TEST_CASE("BroadcastRing rejects foreign descriptors", "[transport][BroadcastRing]")
+{
+    int fd = memfd_create("threveal-foreign", MFD_CLOEXEC);
+    REQUIRE(fd >= 0);
+    REQUIRE(ftruncate(fd, 4096) == 0);
+    REQUIRE(BroadcastSubscriber::attach(fd).error() == TransportError::kMapFailed);
+    close(fd);
+
+    REQUIRE(BroadcastSubscriber::attach(std::string("/nonexistent/ring")).error() ==
+            TransportError::kMapFailed);
+}
+
+TEST_CASE("BroadcastRing descriptors pass over Unix sockets", "[transport][BroadcastRing]")
+{
+    auto publisher = BroadcastPublisher::create("threveal-test", 8);
+    REQUIRE(publisher.has_value());
+
+    std::array<int, 2> pair{};
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair.data()) == 0);
+    REQUIRE(sendDescriptor(pair[0], publisher->fd()).has_value());
+
+    auto received = receiveDescriptor(pair[1]);
+    REQUIRE(received.has_value());
+    auto subscriber = BroadcastSubscriber::attach(*received);
+    close(*received);
+    REQUIRE(subscriber.has_value());
+
+    publisher->publish(makeMigration(7));
+    std::array<MigrationEvent, 1> out{};
+    REQUIRE(subscriber->read(out) == 1);
+    REQUIRE(out[0].tid == 7);
+
+    // Plain data without a descriptor
+    char byte = 'x';
+    REQUIRE(send(pair[0], &byte, 1, MSG_NOSIGNAL) == 1);
+    REQUIRE(receiveDescriptor(pair[1]).error() == TransportError::kProtocolError);
+
+    close(pair[0]);
+    REQUIRE(receiveDescriptor(pair[1]).error() == TransportError::kDisconnected);
+    close(pair[1]);
+}
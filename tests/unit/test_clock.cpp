@@ -0,0 +1,98 @@
+/**
+ *  @file       test_clock.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the trace clock.
+ */
+
+#include "threveal/core/clock.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <time.h>
+
+using threveal::core::captureClockSnapshot;
+using threveal::core::ClockSnapshot;
+using threveal::core::ClockSource;
+using threveal::core::readClockNs;
+using threveal::core::setTraceClock;
+using threveal::core::toClockId;
+using threveal::core::traceClock;
+using threveal::core::traceTimestampNs;
+
+TEST_CASE("ClockSource toString", "[core][Clock]")
+{
+    REQUIRE(toString(ClockSource::kMonotonic) == "monotonic");
+    REQUIRE(toString(ClockSource::kBoottime) == "boottime");
+}
+
+TEST_CASE("ClockSource maps to clock IDs", "[core][Clock]")
+{
+    REQUIRE(toClockId(ClockSource::kMonotonic) == CLOCK_MONOTONIC);
+    REQUIRE(toClockId(ClockSource::kBoottime) == CLOCK_BOOTTIME);
+}
+
+TEST_CASE("Trace clock selection", "[core][Clock]")
+{
+    REQUIRE(traceClock() == ClockSource::kMonotonic);
+
+    setTraceClock(ClockSource::kBoottime);
+    REQUIRE(traceClock() == ClockSource::kBoottime);
+
+    // Boottime never runs behind monotonic
+    auto monotonic = readClockNs(ClockSource::kMonotonic);
+    REQUIRE(traceTimestampNs() >= monotonic);
+
+    setTraceClock(ClockSource::kMonotonic);
+    REQUIRE(traceClock() == ClockSource::kMonotonic);
+}
+
+TEST_CASE("readClockNs is monotonic", "[core][Clock]")
+{
+    auto first = readClockNs(ClockSource::kBoottime);
+    auto second = readClockNs(ClockSource::kBoottime);
+    REQUIRE(second >= first);
+}
+
+TEST_CASE("captureClockSnapshot brackets the trace clock", "[core][Clock]")
+{
+    auto before = readClockNs(ClockSource::kBoottime);
+    auto snapshot = captureClockSnapshot(ClockSource::kBoottime);
+    auto after = readClockNs(ClockSource::kBoottime);
+
+    REQUIRE(snapshot.source == ClockSource::kBoottime);
+    REQUIRE(snapshot.trace_ns >= before);
+    REQUIRE(snapshot.trace_ns <= after);
+    REQUIRE(snapshot.boottime_ns >= snapshot.monotonic_ns);
+    REQUIRE(snapshot.uncertainty_ns <= after - before);
+
+    // The snapshot instant maps exactly onto its wall-clock reading
+    auto realtime = snapshot.toRealtimeNs(snapshot.trace_ns);
+    REQUIRE(realtime == snapshot.realtime_ns);
+}
+
+TEST_CASE("ClockSnapshot offsets", "[core][Clock]")
+{
+    ClockSnapshot snapshot{
+        .source = ClockSource::kMonotonic,
+        .trace_ns = 1'000,
+        .realtime_ns = 1'700'000'000'000'000'000,
+        .monotonic_ns = 1'000,
+        .boottime_ns = 6'000,
+        .uncertainty_ns = 50,
+    };
+
+    REQUIRE(snapshot.realtimeOffsetNs() == 1'699'999'999'999'999'000);
+    REQUIRE(snapshot.toRealtimeNs(2'000) == 1'700'000'000'000'001'000);
+    REQUIRE(snapshot.suspendedNs() == 5'000);
+
+    snapshot.boottime_ns = 0;
+    REQUIRE(snapshot.suspendedNs() == 0);
+}
+
+TEST_CASE("captureClockSnapshot makes at least one attempt", "[core][Clock]")
+{
+    auto snapshot = captureClockSnapshot(ClockSource::kMonotonic, 0);
+    REQUIRE(snapshot.trace_ns > 0);
+    REQUIRE(snapshot.realtime_ns > 0);
+}
@@ -6,16 +6,33 @@
  *
  *  Note: eBPF operations require CAP_BPF or root privileges.
  *  Tests that require privileges will be skipped if permissions are insufficient.
+ *
+ *  The BPF_PROG_RUN benchmark of the migration handler is hidden; run it
+ *  with the "[benchmark]" tag.
  */
 
 #include "threveal/collection/ebpf_loader.hpp"
 
+#include <algorithm>
+#include <array>
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 #include <utility>
 
 using threveal::collection::EbpfError;
 using threveal::collection::EbpfLoader;
+using threveal::collection::EbpfLoaderOptions;
+using threveal::collection::kMaxRingShards;
+using threveal::collection::kMaxSampleRate;
+using threveal::collection::ThreadState;
 using threveal::collection::toString;
 
 namespace
@@ -36,6 +53,7 @@ TEST_CASE("EbpfError toString", "[collection][EbpfError]")
     REQUIRE(toString(EbpfError::kInvalidState) == "BPF program in invalid state");
     REQUIRE(toString(EbpfError::kMapAccessFailed) == "failed to access BPF map");
     REQUIRE(toString(EbpfError::kPermissionDenied) == "permission denied for BPF operations");
+    REQUIRE(toString(EbpfError::kPinFailed) == "failed to pin BPF objects");
 }
 
 TEST_CASE("EbpfLoader creation requires privileges", "[collection][EbpfLoader]")
@@ -150,3 +168,390 @@ TEST_CASE("EbpfLoader setTargetPid", "[collection][EbpfLoader]")
         REQUIRE(loader->setTargetPid(0).has_value());
     }
 }
+
+TEST_CASE("EbpfLoader pinned mode rejects non-bpffs roots", "[collection][EbpfLoader][pin]")
+{
+    auto root = std::filesystem::temp_directory_path() /
+                ("threveal_pin_" + std::to_string(getpid()));
+
+    auto loader = EbpfLoader::create(EbpfLoaderOptions{.pinned = true, .pin_root = root.string()});
+    REQUIRE_FALSE(loader.has_value());
+    REQUIRE(loader.error() == EbpfError::kPinFailed);
+
+    SECTION("unpinAll refuses to remove regular directories")
+    {
+        auto result = EbpfLoader::unpinAll(root.string());
+        REQUIRE_FALSE(result.has_value());
+        REQUIRE(result.error() == EbpfError::kPinFailed);
+        REQUIRE(std::filesystem::exists(root));
+    }
+
+    SECTION("unpinAll accepts a missing root")
+    {
+        REQUIRE(EbpfLoader::unpinAll(root.string() + "_missing").has_value());
+    }
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("EbpfLoader objectVersionHash is stable", "[collection][EbpfLoader][pin]")
+{
+    REQUIRE(EbpfLoader::objectVersionHash() == EbpfLoader::objectVersionHash());
+    REQUIRE(EbpfLoader::objectVersionHash() != 0);
+}
+
+TEST_CASE("EbpfLoader pinned mode reuses pins", "[collection][EbpfLoader][pin]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    std::string root = "/sys/fs/bpf/threveal_test_" + std::to_string(getpid());
+    EbpfLoaderOptions options{.pinned = true, .pin_root = root};
+
+    {
+        auto cold = EbpfLoader::create(options);
+        REQUIRE(cold.has_value());
+        REQUIRE(cold->isPinned());
+        REQUIRE_FALSE(cold->reusedPins());
+        REQUIRE(cold->setTargetPid(4321).has_value());
+        REQUIRE(cold->attach().has_value());
+    }
+
+    {
+        auto warm = EbpfLoader::create(options);
+        REQUIRE(warm.has_value());
+        REQUIRE(warm->reusedPins());
+        REQUIRE(warm->isAttached());
+        REQUIRE(std::filesystem::exists(warm->pinDirectory() + "/migration_config"));
+
+        // The rename hook marks a thread's new name as sent; a new process
+        // has no state yet, so only an attached hook can set the flag
+        auto renamedChild = [&warm]
+        {
+            pid_t child = fork();
+            if (child == 0)
+            {
+                auto tid = static_cast<std::uint32_t>(getpid());
+                bool sent = false;
+                if (warm->setThreadPhase(tid, 1) && prctl(PR_SET_NAME, "threveal_warm") == 0)
+                {
+                    auto states = warm->threadStates();
+                    auto self = [tid](const ThreadState& state)
+                    {
+                        return state.tid == tid && state.comm_sent;
+                    };
+                    sent = states && std::ranges::any_of(*states, self);
+                }
+                _exit(sent ? 0 : 1);
+            }
+            int status = 0;
+            return child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) &&
+                   WEXITSTATUS(status) == 0;
+        };
+        REQUIRE(warm->setTargetPid(0).has_value());
+        REQUIRE(renamedChild());
+
+        warm->detach();
+        REQUIRE(warm->attach().has_value());
+        REQUIRE(warm->isAttached());
+        REQUIRE(renamedChild());
+    }
+
+    REQUIRE(EbpfLoader::unpinAll(root).has_value());
+    REQUIRE_FALSE(std::filesystem::exists(root));
+}
+
+TEST_CASE("EbpfLoader warm start resends thread identities", "[collection][EbpfLoader][pin]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    std::string root = "/sys/fs/bpf/threveal_identity_" + std::to_string(getpid());
+    EbpfLoaderOptions options{.pinned = true, .pin_root = root};
+    auto tid = static_cast<std::uint32_t>(gettid());
+    std::array<char, 16> name{};
+    REQUIRE(prctl(PR_GET_NAME, name.data()) == 0);
+
+    auto self = [tid](const EbpfLoader& loader)
+    {
+        auto states = loader.threadStates();
+        REQUIRE(states.has_value());
+        auto state = std::ranges::find(*states, tid, &ThreadState::tid);
+        REQUIRE(state != states->end());
+        return *state;
+    };
+
+    {
+        // The rename hook sends the thread's name with its lifecycle record
+        auto cold = EbpfLoader::create(options);
+        REQUIRE(cold.has_value());
+        REQUIRE(cold->setTargetPid(static_cast<std::uint32_t>(getpid())).has_value());
+        REQUIRE(cold->attach().has_value());
+        REQUIRE(cold->setThreadPhase(tid, 3).has_value());
+        REQUIRE(prctl(PR_SET_NAME, "threveal_cold") == 0);
+        REQUIRE(self(*cold).comm_sent);
+
+        // Keep the pinned handler from sending the name again
+        REQUIRE(cold->setTargetPid(1).has_value());
+    }
+
+    {
+        // The state survives, but the new run has not seen the name
+        auto warm = EbpfLoader::create(options);
+        REQUIRE(warm.has_value());
+        REQUIRE(warm->reusedPins());
+        auto state = self(*warm);
+        REQUIRE(state.phase == 3);
+        REQUIRE_FALSE(state.comm_sent);
+    }
+
+    REQUIRE(prctl(PR_SET_NAME, name.data()) == 0);
+    REQUIRE(EbpfLoader::unpinAll(root).has_value());
+}
+
+TEST_CASE("EbpfLoader rejects too many ring shards", "[collection][EbpfLoader][shards]")
+{
+    auto loader = EbpfLoader::create(EbpfLoaderOptions{.ring_shards = kMaxRingShards + 1});
+    REQUIRE_FALSE(loader.has_value());
+    REQUIRE(loader.error() == EbpfError::kInvalidState);
+}
+
+TEST_CASE("EbpfLoader sharded rings", "[collection][EbpfLoader][shards]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    SECTION("Shared ring by default")
+    {
+        auto loader = EbpfLoader::create();
+        REQUIRE(loader.has_value());
+        REQUIRE(loader->ringBufferFds().size() == 1);
+        REQUIRE(loader->ringBufferFds().front() == loader->ringBufferFd());
+    }
+
+    SECTION("One ring and one drop counter per shard")
+    {
+        auto loader = EbpfLoader::create(EbpfLoaderOptions{.ring_shards = 4});
+        REQUIRE(loader.has_value());
+
+        auto fds = loader->ringBufferFds();
+        REQUIRE(fds.size() == 4);
+        for (int fd : fds)
+        {
+            REQUIRE(fd >= 0);
+        }
+
+        auto drops = loader->ringDrops();
+        REQUIRE(drops.has_value());
+        REQUIRE(drops->size() == 4);
+    }
+}
+
+TEST_CASE("EbpfLoader sampling rates", "[collection][EbpfLoader][sampling]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    auto loader = EbpfLoader::create();
+    REQUIRE(loader.has_value());
+
+    REQUIRE(loader->setSampleRate(8).has_value());
+    REQUIRE(loader->setSampleRate(1).has_value());
+    REQUIRE(loader->setSampleRate(kMaxSampleRate + 1).error() == EbpfError::kInvalidState);
+
+    REQUIRE(loader->setTgidSampleRate(1234, 4).has_value());
+    REQUIRE(loader->setTgidSampleRate(1234, 0).has_value());
+    REQUIRE(loader->setTgidSampleRate(1234, 0).has_value());
+}
+
+TEST_CASE("EbpfLoader thread rate limit", "[collection][EbpfLoader][rate_limit]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    auto loader = EbpfLoader::create();
+    REQUIRE(loader.has_value());
+
+    REQUIRE(loader->setThreadRateLimit(100, 10).has_value());
+
+    // Nothing is attached, so no thread has been throttled yet
+    auto summaries = loader->collectSuppressed();
+    REQUIRE(summaries.has_value());
+    REQUIRE(summaries->empty());
+
+    REQUIRE(loader->setThreadRateLimit(0, 0).has_value());
+}
+
+TEST_CASE("EbpfLoader thread states", "[collection][EbpfLoader][thread_state]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    auto loader = EbpfLoader::create();
+    REQUIRE(loader.has_value());
+
+    // Setting a phase creates the calling thread's state
+    auto tid = static_cast<std::uint32_t>(gettid());
+    REQUIRE(loader->setThreadPhase(tid, 7).has_value());
+
+    auto states = loader->threadStates();
+    REQUIRE(states.has_value());
+    auto self = std::ranges::find(*states, tid, &ThreadState::tid);
+    REQUIRE(self != states->end());
+    REQUIRE(self->pid == static_cast<std::uint32_t>(getpid()));
+    REQUIRE(self->phase == 7);
+    REQUIRE(self->suppressed == 0);
+
+    REQUIRE(loader->setThreadPhase(0x7fffffff, 1).error() == EbpfError::kInvalidState);
+}
+
+TEST_CASE("EbpfLoader thread activity", "[collection][EbpfLoader][activity]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    SECTION("Only with track_activity")
+    {
+        auto loader = EbpfLoader::create();
+        REQUIRE(loader.has_value());
+        REQUIRE(loader->threadActivity().error() == EbpfError::kInvalidState);
+    }
+
+    SECTION("Switched-out threads are marked")
+    {
+        if (!std::filesystem::exists("/sys/kernel/btf/vmlinux"))
+        {
+            SKIP("Activity tracking needs tp_btf");
+        }
+
+        auto loader = EbpfLoader::create(EbpfLoaderOptions{.track_activity = true});
+        REQUIRE(loader.has_value());
+        auto activity = loader->threadActivity();
+        REQUIRE(activity.has_value());
+        REQUIRE(activity->isMapped());
+        REQUIRE(loader->attach().has_value());
+
+        // Sleeping switches this thread out
+        auto tid = static_cast<std::uint32_t>(gettid());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(activity->ranSinceLastCheck(tid));
+    }
+
+    SECTION("Detached views report every thread")
+    {
+        auto loader = EbpfLoader::create(EbpfLoaderOptions{.track_activity = true});
+        REQUIRE(loader.has_value());
+        REQUIRE(loader->attach().has_value());
+        auto activity = loader->threadActivity();
+        REQUIRE(activity.has_value());
+
+        // Nobody updates the flags while detached, so none can be trusted
+        loader->detach();
+        REQUIRE(activity->ranSinceLastCheck(1));
+        REQUIRE(activity->ranSinceLastCheck(1));
+
+        REQUIRE(loader->attach().has_value());
+        auto tid = static_cast<std::uint32_t>(gettid());
+        REQUIRE(activity->ranSinceLastCheck(tid));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(activity->ranSinceLastCheck(tid));
+    }
+
+    SECTION("Warm starts track activity too")
+    {
+        std::string root = "/sys/fs/bpf/threveal_activity_" + std::to_string(getpid());
+        EbpfLoaderOptions options{.pinned = true, .pin_root = root, .track_activity = true};
+        {
+            auto cold = EbpfLoader::create(options);
+            REQUIRE(cold.has_value());
+            REQUIRE(cold->attach().has_value());
+        }
+
+        {
+            auto warm = EbpfLoader::create(options);
+            REQUIRE(warm.has_value());
+            REQUIRE(warm->reusedPins());
+            auto activity = warm->threadActivity();
+            REQUIRE(activity.has_value());
+
+            auto tid = static_cast<std::uint32_t>(gettid());
+            REQUIRE(activity->ranSinceLastCheck(tid));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            REQUIRE(activity->ranSinceLastCheck(tid));
+        }
+
+        REQUIRE(EbpfLoader::unpinAll(root).has_value());
+    }
+}
+
+TEST_CASE("EbpfLoader benchmarks the migration handler", "[collection][EbpfLoader][program]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    EbpfLoaderOptions options{.benchmark = true};
+    auto loader = EbpfLoader::create(options);
+    REQUIRE(loader.has_value());
+
+    auto result = loader->benchmarkProgram(1000, 1);
+    REQUIRE(result.has_value());
+    REQUIRE(result->runs == 1000);
+    REQUIRE(result->wall_time >= result->program_time);
+
+    // Runs act on the calling thread, not on a placeholder task
+    auto tid = static_cast<std::uint32_t>(gettid());
+    auto states = loader->threadStates();
+    REQUIRE(states.has_value());
+    auto self = std::ranges::find(*states, tid, &ThreadState::tid);
+    REQUIRE(self != states->end());
+    REQUIRE(self->pid == static_cast<std::uint32_t>(getpid()));
+    REQUIRE(self->last_cpu == 1);
+    REQUIRE(self->comm_sent);
+
+    // Test runs would race with real migrations once attached
+    REQUIRE(loader->attach().has_value());
+    REQUIRE(loader->benchmarkProgram(1).error() == EbpfError::kInvalidState);
+
+    auto plain = EbpfLoader::create();
+    REQUIRE(plain.has_value());
+    REQUIRE(plain->benchmarkProgram(1).error() == EbpfError::kInvalidState);
+}
+
+TEST_CASE("EbpfLoader migration handler cost", "[.][benchmark][EbpfLoader]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    EbpfLoaderOptions options{.benchmark = true};
+    auto loader = EbpfLoader::create(options);
+    REQUIRE(loader.has_value());
+
+    // Reported once in kernel time, then measured with the system calls
+    constexpr std::uint64_t kRuns = 100'000;
+    auto result = loader->benchmarkProgram(kRuns);
+    REQUIRE(result.has_value());
+    WARN("ns per invocation: " << result->program_time.count() / static_cast<long>(kRuns));
+
+    BENCHMARK("BPF_PROG_RUN 1000 migrations")
+    {
+        return loader->benchmarkProgram(1000)->runs;
+    };
+}
@@ -0,0 +1,193 @@
+/**
+ *  @file       test_energy_attribution.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for RAPL energy attribution.
+ */
+
+#include "threveal/analysis/energy_attribution.hpp"
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <cstdint>
+#include <vector>
+
+using Catch::Matchers::WithinAbs;
+using Catch::Matchers::WithinRel;
+using threveal::analysis::attributeEnergy;
+using threveal::analysis::EnergyAttributionOptions;
+using threveal::analysis::estimatePlacementEnergyDelta;
+using threveal::analysis::EventStore;
+using threveal::analysis::ThreadPlacement;
+using threveal::core::CoreType;
+using threveal::core::CpuId;
+using threveal::core::EnergySample;
+using threveal::core::PmuSample;
+using threveal::core::TopologyMap;
+
+namespace
+{
+
+// P-cores 0-3, E-cores 4-7
+auto makeTopology() -> TopologyMap
+{
+    std::vector<CpuId> p_cores = {0, 1, 2, 3};
+    std::vector<CpuId> e_cores = {4, 5, 6, 7};
+    return TopologyMap{p_cores, e_cores};
+}
+
+auto makePmuSample(std::uint64_t timestamp_ns, std::uint32_t tid, CpuId cpu,
+                   std::uint64_t instructions, std::uint64_t cycles) -> PmuSample
+{
+    return PmuSample{
+        .timestamp_ns = timestamp_ns,
+        .tid = tid,
+        .cpu_id = cpu,
+        .instructions = instructions,
+        .cycles = cycles,
+        .llc_misses = 0,
+        .llc_references = 0,
+        .branch_misses = 0,
+    };
+}
+
+auto makeEnergySample(std::uint64_t timestamp_ns, std::uint64_t cores_uj) -> EnergySample
+{
+    return EnergySample{
+        .timestamp_ns = timestamp_ns,
+        .package_energy_uj = cores_uj * 2,
+        .cores_energy_uj = cores_uj,
+    };
+}
+
+}  // namespace
+
+TEST_CASE("attributeEnergy splits energy by cycles", "[analysis][energy]")
+{
+    auto topology = makeTopology();
+    EventStore store;
+
+    store.addEnergySample(makeEnergySample(1000, 0));
+    store.addPmuSample(makePmuSample(1500, 10, 0, 3000, 3000));  // P-core
+    store.addPmuSample(makePmuSample(1500, 20, 4, 1000, 1000));  // E-core
+    store.addEnergySample(makeEnergySample(2000, 4'000'000));    // 4 J
+
+    auto profiles = attributeEnergy(store, topology);
+
+    REQUIRE(profiles.size() == 2);
+    REQUIRE(profiles[0].tid == 10);
+    REQUIRE(profiles[1].tid == 20);
+
+    REQUIRE_THAT(profiles[0].p_core.energy_joules, WithinRel(3.0, 1e-9));
+    REQUIRE_THAT(profiles[0].e_core.energy_joules, WithinAbs(0.0, 1e-12));
+    REQUIRE_THAT(profiles[1].e_core.energy_joules, WithinRel(1.0, 1e-9));
+
+    REQUIRE(profiles[0].p_core.instructions == 3000);
+    REQUIRE_THAT(profiles[0].p_core.instructionsPerJoule(), WithinRel(1000.0, 1e-9));
+}
+
+TEST_CASE("attributeEnergy falls back to package domain", "[analysis][energy]")
+{
+    auto topology = makeTopology();
+    EventStore store;
+
+    store.addEnergySample(EnergySample{.timestamp_ns = 0, .package_energy_uj = 0,
+                                       .cores_energy_uj = 0});
+    store.addPmuSample(makePmuSample(50, 10, 1, 100, 100));
+    store.addEnergySample(EnergySample{.timestamp_ns = 100, .package_energy_uj = 2'000'000,
+                                       .cores_energy_uj = 0});
+
+    auto profiles = attributeEnergy(store, topology);
+
+    REQUIRE(profiles.size() == 1);
+    REQUIRE_THAT(profiles[0].p_core.energy_joules, WithinRel(2.0, 1e-9));
+}
+
+TEST_CASE("attributeEnergy applies core type weights", "[analysis][energy]")
+{
+    auto topology = makeTopology();
+    EventStore store;
+
+    store.addEnergySample(makeEnergySample(0, 0));
+    store.addPmuSample(makePmuSample(50, 10, 0, 1000, 1000));
+    store.addPmuSample(makePmuSample(50, 10, 5, 1000, 1000));
+    store.addEnergySample(makeEnergySample(100, 3'000'000));
+
+    EnergyAttributionOptions options{.p_core_cycle_weight = 2.0, .e_core_cycle_weight = 1.0};
+    auto profiles = attributeEnergy(store, topology, options);
+
+    REQUIRE(profiles.size() == 1);
+    REQUIRE_THAT(profiles[0].p_core.energy_joules, WithinRel(2.0, 1e-9));
+    REQUIRE_THAT(profiles[0].e_core.energy_joules, WithinRel(1.0, 1e-9));
+    REQUIRE_THAT(profiles[0].totalEnergyJoules(), WithinRel(3.0, 1e-9));
+}
+
+TEST_CASE("attributeEnergy ignores samples outside energy intervals", "[analysis][energy]")
+{
+    auto topology = makeTopology();
+    EventStore store;
+
+    // Before the first energy sample: no interval to attribute to
+    store.addPmuSample(makePmuSample(10, 10, 0, 1000, 1000));
+    store.addEnergySample(makeEnergySample(100, 0));
+    // Unknown CPU is skipped
+    store.addPmuSample(makePmuSample(150, 30, 99, 1000, 1000));
+    store.addPmuSample(makePmuSample(150, 20, 4, 500, 500));
+    store.addEnergySample(makeEnergySample(200, 1'000'000));
+    // After the last energy sample
+    store.addPmuSample(makePmuSample(300, 10, 0, 1000, 1000));
+
+    auto profiles = attributeEnergy(store, topology);
+
+    REQUIRE(profiles.size() == 1);
+    REQUIRE(profiles[0].tid == 20);
+    REQUIRE_THAT(profiles[0].e_core.energy_joules, WithinRel(1.0, 1e-9));
+}
+
+TEST_CASE("estimatePlacementEnergyDelta re-costs instructions", "[analysis][energy]")
+{
+    auto topology = makeTopology();
+    EventStore store;
+
+    // tid 10: 1000 instr/J on P, 4000 instr/J on E
+    store.addEnergySample(makeEnergySample(0, 0));
+    store.addPmuSample(makePmuSample(50, 10, 0, 2000, 1000));
+    store.addEnergySample(makeEnergySample(100, 2'000'000));
+    store.addPmuSample(makePmuSample(150, 10, 4, 4000, 1000));
+    store.addEnergySample(makeEnergySample(200, 1'000'000));
+
+    // tid 20 only ever ran on P-cores: 1000 instr/J
+    store.addPmuSample(makePmuSample(250, 20, 1, 1000, 1000));
+    store.addEnergySample(makeEnergySample(300, 1'000'000));
+
+    auto profiles = attributeEnergy(store, topology);
+    REQUIRE(profiles.size() == 2);
+
+    SECTION("thread with history on target uses its own efficiency")
+    {
+        std::vector<ThreadPlacement> plan = {{.tid = 10, .target = CoreType::kECore}};
+
+        // 6000 instr at 4000 instr/J = 1.5 J, measured 3 J
+        REQUIRE_THAT(estimatePlacementEnergyDelta(profiles, plan), WithinRel(-1.5, 1e-9));
+    }
+
+    SECTION("thread without history uses aggregate efficiency")
+    {
+        std::vector<ThreadPlacement> plan = {{.tid = 20, .target = CoreType::kECore}};
+
+        // 1000 instr at 4000 instr/J = 0.25 J, measured 1 J
+        REQUIRE_THAT(estimatePlacementEnergyDelta(profiles, plan), WithinRel(-0.75, 1e-9));
+    }
+
+    SECTION("unknown threads are ignored")
+    {
+        std::vector<ThreadPlacement> plan = {{.tid = 99, .target = CoreType::kPCore}};
+
+        REQUIRE_THAT(estimatePlacementEnergyDelta(profiles, plan), WithinAbs(0.0, 1e-12));
+    }
+}
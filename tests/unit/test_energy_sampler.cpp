@@ -0,0 +1,243 @@
+/**
+ *  @file       test_energy_sampler.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for EnergySampler.
+ *
+ *  Tests run against a fake powercap tree in a temporary directory, so they
+ *  do not require RAPL hardware or root access to energy_uj.
+ */
+
+#include "threveal/collection/energy_sampler.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+
+using threveal::collection::EnergyDomain;
+using threveal::collection::EnergySampler;
+using threveal::core::EnergyError;
+using threveal::core::EnergySample;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+/**
+ *  Fake /sys/class/powercap tree that is removed on destruction.
+ */
+class FakePowercap
+{
+  public:
+    FakePowercap()
+        : root_(fs::temp_directory_path() /
+                ("threveal_powercap_" + std::to_string(getpid()) + "_" +
+                 std::to_string(counter_++)))
+    {
+        fs::create_directories(root_);
+    }
+
+    ~FakePowercap()
+    {
+        std::error_code ec;
+        fs::remove_all(root_, ec);
+    }
+
+    FakePowercap(const FakePowercap&) = delete;
+    auto operator=(const FakePowercap&) -> FakePowercap& = delete;
+    FakePowercap(FakePowercap&&) = delete;
+    auto operator=(FakePowercap&&) -> FakePowercap& = delete;
+
+    void addZone(std::string_view zone, std::string_view name, std::uint64_t energy_uj,
+                 std::uint64_t max_range_uj)
+    {
+        auto dir = root_ / zone;
+        fs::create_directories(dir);
+        writeFile(dir / "name", std::string(name));
+        writeFile(dir / "max_energy_range_uj", std::to_string(max_range_uj));
+        setEnergy(zone, energy_uj);
+    }
+
+    void setEnergy(std::string_view zone, std::uint64_t energy_uj)
+    {
+        writeFile(root_ / zone / "energy_uj", std::to_string(energy_uj));
+    }
+
+    [[nodiscard]] auto path() const -> std::string
+    {
+        return root_.string();
+    }
+
+  private:
+    static void writeFile(const fs::path& path, const std::string& content)
+    {
+        std::ofstream file(path, std::ios::trunc);
+        file << content << '\n';
+    }
+
+    static inline int counter_ = 0;
+    fs::path root_;
+};
+
+auto noopCallback() -> EnergySampler::SampleCallback
+{
+    return [](const EnergySample&) {};
+}
+
+}  // namespace
+
+TEST_CASE("EnergyDomain toString", "[collection][EnergyDomain]")
+{
+    REQUIRE(threveal::collection::toString(EnergyDomain::kPackage) == "energy-pkg");
+    REQUIRE(threveal::collection::toString(EnergyDomain::kCores) == "energy-cores");
+}
+
+TEST_CASE("EnergySampler rejects null callback", "[collection][EnergySampler]")
+{
+    FakePowercap powercap;
+    powercap.addZone("intel-rapl:0", "package-0", 1000, 1'000'000);
+
+    EnergySampler::SampleCallback null_callback;
+    auto sampler = EnergySampler::create(null_callback, std::chrono::milliseconds(1),
+                                         powercap.path());
+
+    REQUIRE_FALSE(sampler.has_value());
+    REQUIRE(sampler.error() == EnergyError::kInvalidState);
+}
+
+TEST_CASE("EnergySampler fails without RAPL zones", "[collection][EnergySampler]")
+{
+    SECTION("missing root")
+    {
+        auto sampler = EnergySampler::create(noopCallback(), std::chrono::milliseconds(1),
+                                             "/nonexistent/powercap");
+        REQUIRE_FALSE(sampler.has_value());
+        REQUIRE(sampler.error() == EnergyError::kPowercapNotFound);
+    }
+
+    SECTION("only untracked zones")
+    {
+        FakePowercap powercap;
+        powercap.addZone("intel-rapl:0:1", "uncore", 1000, 1'000'000);
+        powercap.addZone("intel-rapl-mmio:0", "package-0", 1000, 1'000'000);
+
+        auto sampler = EnergySampler::create(noopCallback(), std::chrono::milliseconds(1),
+                                             powercap.path());
+        REQUIRE_FALSE(sampler.has_value());
+        REQUIRE(sampler.error() == EnergyError::kPowercapNotFound);
+    }
+}
+
+TEST_CASE("EnergySampler discovers package and core domains", "[collection][EnergySampler]")
+{
+    FakePowercap powercap;
+    powercap.addZone("intel-rapl:0", "package-0", 1000, 1'000'000);
+    powercap.addZone("intel-rapl:0:0", "core", 500, 1'000'000);
+    powercap.addZone("intel-rapl:0:1", "uncore", 100, 1'000'000);
+
+    auto sampler =
+        EnergySampler::create(noopCallback(), std::chrono::milliseconds(1), powercap.path());
+
+    REQUIRE(sampler.has_value());
+    REQUIRE(sampler->hasDomain(EnergyDomain::kPackage));
+    REQUIRE(sampler->hasDomain(EnergyDomain::kCores));
+}
+
+TEST_CASE("EnergySampler reports energy deltas", "[collection][EnergySampler]")
+{
+    FakePowercap powercap;
+    powercap.addZone("intel-rapl:0", "package-0", 1000, 1'000'000);
+    powercap.addZone("intel-rapl:0:0", "core", 500, 1'000'000);
+
+    auto sampler =
+        EnergySampler::create(noopCallback(), std::chrono::milliseconds(1), powercap.path());
+    REQUIRE(sampler.has_value());
+
+    powercap.setEnergy("intel-rapl:0", 4000);
+    powercap.setEnergy("intel-rapl:0:0", 2500);
+
+    auto first = sampler->collectSample();
+    REQUIRE(first.has_value());
+    REQUIRE(first->package_energy_uj == 3000);
+    REQUIRE(first->cores_energy_uj == 2000);
+
+    powercap.setEnergy("intel-rapl:0", 4100);
+
+    auto second = sampler->collectSample();
+    REQUIRE(second.has_value());
+    REQUIRE(second->package_energy_uj == 100);
+    REQUIRE(second->cores_energy_uj == 0);
+    REQUIRE(second->timestamp_ns >= first->timestamp_ns);
+}
+
+TEST_CASE("EnergySampler handles counter wraparound", "[collection][EnergySampler]")
+{
+    FakePowercap powercap;
+    powercap.addZone("intel-rapl:0", "package-0", 999'900, 1'000'000);
+
+    auto sampler =
+        EnergySampler::create(noopCallback(), std::chrono::milliseconds(1), powercap.path());
+    REQUIRE(sampler.has_value());
+
+    powercap.setEnergy("intel-rapl:0", 50);
+
+    auto sample = sampler->collectSample();
+    REQUIRE(sample.has_value());
+    REQUIRE(sample->package_energy_uj == 150);
+}
+
+TEST_CASE("EnergySampler sums multiple packages", "[collection][EnergySampler]")
+{
+    FakePowercap powercap;
+    powercap.addZone("intel-rapl:0", "package-0", 0, 1'000'000);
+    powercap.addZone("intel-rapl:1", "package-1", 0, 1'000'000);
+
+    auto sampler =
+        EnergySampler::create(noopCallback(), std::chrono::milliseconds(1), powercap.path());
+    REQUIRE(sampler.has_value());
+
+    powercap.setEnergy("intel-rapl:0", 300);
+    powercap.setEnergy("intel-rapl:1", 200);
+
+    auto sample = sampler->collectSample();
+    REQUIRE(sample.has_value());
+    REQUIRE(sample->package_energy_uj == 500);
+}
+
+TEST_CASE("EnergySampler start and stop", "[collection][EnergySampler]")
+{
+    FakePowercap powercap;
+    powercap.addZone("intel-rapl:0", "package-0", 0, 1'000'000);
+
+    std::atomic<int> delivered{0};
+    auto sampler = EnergySampler::create(
+        [&delivered](const EnergySample&)
+        {
+            delivered.fetch_add(1);
+        },
+        std::chrono::milliseconds(1), powercap.path());
+    REQUIRE(sampler.has_value());
+
+    REQUIRE(sampler->start().has_value());
+    REQUIRE(sampler->isRunning());
+
+    // Starting twice is rejected
+    REQUIRE_FALSE(sampler->start().has_value());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    sampler->stop();
+
+    REQUIRE_FALSE(sampler->isRunning());
+    REQUIRE(sampler->sampleCount() > 0);
+    REQUIRE(delivered.load() == static_cast<int>(sampler->sampleCount()));
+}
@@ -9,8 +9,12 @@
 
 #include <catch2/catch_test_macros.hpp>
 
+using threveal::core::EnergyError;
+using threveal::core::HfiError;
 using threveal::core::PmuError;
 using threveal::core::TopologyError;
+using threveal::core::TraceError;
+using threveal::core::TransportError;
 using threveal::core::toString;
 
 TEST_CASE("TopologyError toString", "[errors][TopologyError]")
@@ -20,6 +24,7 @@ TEST_CASE("TopologyError toString", "[errors][TopologyError]")
     REQUIRE(toString(TopologyError::kParseError) == "failed to parse CPU list format");
     REQUIRE(toString(TopologyError::kInvalidCpuId) == "invalid CPU ID");
     REQUIRE(toString(TopologyError::kPermissionDenied) == "permission denied accessing sysfs");
+    REQUIRE(toString(TopologyError::kInvalidState) == "topology watcher in invalid state");
 }
 
 TEST_CASE("PmuError toString", "[errors][PmuError]")
@@ -32,3 +37,45 @@ TEST_CASE("PmuError toString", "[errors][PmuError]")
     REQUIRE(toString(PmuError::kTooManyEvents) == "too many PMU events for available counters");
     REQUIRE(toString(PmuError::kInvalidState) == "PMU counter in invalid state");
 }
+
+TEST_CASE("EnergyError toString", "[errors][EnergyError]")
+{
+    REQUIRE(toString(EnergyError::kPowercapNotFound) == "RAPL powercap domains not found");
+    REQUIRE(toString(EnergyError::kReadFailed) == "failed to read energy counter");
+    REQUIRE(toString(EnergyError::kPermissionDenied) ==
+            "permission denied reading energy counters");
+    REQUIRE(toString(EnergyError::kInvalidState) == "energy sampler in invalid state");
+}
+
+TEST_CASE("HfiError toString", "[errors][HfiError]")
+{
+    REQUIRE(toString(HfiError::kSocketFailed) == "failed to create netlink socket");
+    REQUIRE(toString(HfiError::kFamilyNotFound) == "thermal netlink family not available");
+    REQUIRE(toString(HfiError::kSubscribeFailed) == "failed to join thermal event group");
+    REQUIRE(toString(HfiError::kSourceNotFound) == "HFI replay file not found");
+    REQUIRE(toString(HfiError::kInvalidState) == "HFI monitor in invalid state");
+}
+
+TEST_CASE("TraceError toString", "[errors][TraceError]")
+{
+    REQUIRE(toString(TraceError::kOpenFailed) == "failed to open trace file");
+    REQUIRE(toString(TraceError::kReadFailed) == "failed to read trace file");
+    REQUIRE(toString(TraceError::kWriteFailed) == "failed to write trace file");
+    REQUIRE(toString(TraceError::kParseError) == "malformed trace header");
+    REQUIRE(toString(TraceError::kVersionMismatch) == "unsupported trace format version");
+    REQUIRE(toString(TraceError::kInvalidHeader) == "trace header cannot be written");
+    REQUIRE(toString(TraceError::kSchemaMismatch) == "records do not match the trace schema");
+}
+
+TEST_CASE("TransportError toString", "[errors][TransportError]")
+{
+    REQUIRE(toString(TransportError::kInvalidEndpoint) == "invalid stream endpoint");
+    REQUIRE(toString(TransportError::kSocketFailed) == "failed to create socket");
+    REQUIRE(toString(TransportError::kConnectFailed) == "failed to connect to aggregator");
+    REQUIRE(toString(TransportError::kBindFailed) == "failed to listen on endpoint");
+    REQUIRE(toString(TransportError::kDisconnected) == "stream peer disconnected");
+    REQUIRE(toString(TransportError::kPollFailed) == "failed to wait for socket");
+    REQUIRE(toString(TransportError::kProtocolError) == "stream protocol violation");
+    REQUIRE(toString(TransportError::kTimedOut) == "stream operation timed out");
+    REQUIRE(toString(TransportError::kMapFailed) == "failed to map shared memory");
+}
@@ -0,0 +1,159 @@
+/**
+ *  @file       test_event_merger.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for EventMerger.
+ */
+
+#include "threveal/collection/event_merger.hpp"
+#include "threveal/core/events.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+using threveal::collection::EventMerger;
+using threveal::core::MigrationEvent;
+
+namespace
+{
+
+auto makeEvent(std::uint64_t timestamp_ns, std::uint32_t cpu) -> MigrationEvent
+{
+    MigrationEvent event{};
+    event.timestamp_ns = timestamp_ns;
+    event.src_cpu = cpu;
+    event.dst_cpu = cpu;
+    return event;
+}
+
+class Recorder
+{
+  public:
+    void operator()(const MigrationEvent& event)
+    {
+        timestamps.push_back(event.timestamp_ns);
+    }
+
+    std::vector<std::uint64_t> timestamps;
+};
+
+}  // namespace
+
+TEST_CASE("EventMerger interleaves sources by timestamp", "[collection][EventMerger]")
+{
+    EventMerger merger{3};
+    REQUIRE(merger.sourceCount() == 3);
+
+    merger.push(0, makeEvent(10, 0));
+    merger.push(0, makeEvent(40, 0));
+    merger.push(1, makeEvent(20, 1));
+    merger.push(1, makeEvent(50, 1));
+    merger.push(2, makeEvent(30, 2));
+    REQUIRE(merger.pending() == 5);
+
+    std::vector<std::uint64_t> timestamps;
+    auto emitted = merger.flush(
+        [&timestamps](const MigrationEvent& event)
+        {
+            timestamps.push_back(event.timestamp_ns);
+        });
+
+    REQUIRE(emitted == 5);
+    REQUIRE(timestamps == std::vector<std::uint64_t>{10, 20, 30, 40, 50});
+    REQUIRE(merger.pending() == 0);
+}
+
+TEST_CASE("EventMerger orders events within a source", "[collection][EventMerger]")
+{
+    // CPUs sharing a ring can commit their records out of order
+    EventMerger merger{2};
+    merger.push(0, makeEvent(10, 0));
+    merger.push(0, makeEvent(30, 2));
+    merger.push(0, makeEvent(20, 0));
+    merger.push(0, makeEvent(30, 0));
+    merger.push(0, makeEvent(5, 2));
+    merger.push(1, makeEvent(25, 1));
+
+    std::vector<MigrationEvent> events;
+    REQUIRE(merger.drainUntil(30,
+                              [&events](const MigrationEvent& event)
+                              {
+                                  events.push_back(event);
+                              }) == 6);
+
+    std::vector<std::uint64_t> timestamps;
+    for (const auto& event : events)
+    {
+        timestamps.push_back(event.timestamp_ns);
+    }
+    REQUIRE(timestamps == std::vector<std::uint64_t>{5, 10, 20, 25, 30, 30});
+
+    // Equal timestamps keep their arrival order
+    REQUIRE(events[4].src_cpu == 2);
+    REQUIRE(events[5].src_cpu == 0);
+    REQUIRE(merger.lateEvents() == 0);
+}
+
+TEST_CASE("EventMerger holds events above the watermark", "[collection][EventMerger]")
+{
+    EventMerger merger{2};
+    merger.push(0, makeEvent(100, 0));
+    merger.push(0, makeEvent(300, 0));
+    merger.push(1, makeEvent(200, 1));
+
+    std::vector<std::uint64_t> timestamps;
+    auto sink = [&timestamps](const MigrationEvent& event)
+    {
+        timestamps.push_back(event.timestamp_ns);
+    };
+
+    REQUIRE(merger.drainUntil(250, sink) == 2);
+    REQUIRE(timestamps == std::vector<std::uint64_t>{100, 200});
+    REQUIRE(merger.pending() == 1);
+
+    SECTION("Later events from another source still come out in order")
+    {
+        merger.push(1, makeEvent(280, 1));
+        REQUIRE(merger.drainUntil(1000, sink) == 2);
+        REQUIRE(timestamps == std::vector<std::uint64_t>{100, 200, 280, 300});
+        REQUIRE(merger.lateEvents() == 0);
+    }
+
+    SECTION("Events older than the last emitted one are counted as late")
+    {
+        merger.push(1, makeEvent(150, 1));
+        REQUIRE(merger.lateEvents() == 1);
+        REQUIRE(merger.flush(sink) == 2);
+        REQUIRE(timestamps.back() == 300);
+    }
+}
+
+TEST_CASE("EventMerger edge cases", "[collection][EventMerger]")
+{
+    SECTION("Empty merger emits nothing")
+    {
+        EventMerger merger{4};
+        Recorder recorder;
+        REQUIRE(merger.flush(recorder) == 0);
+    }
+
+    SECTION("Out-of-range source is ignored")
+    {
+        EventMerger merger{1};
+        merger.push(1, makeEvent(10, 1));
+        REQUIRE(merger.pending() == 0);
+    }
+
+    SECTION("Equal timestamps are all emitted")
+    {
+        EventMerger merger{2};
+        merger.push(0, makeEvent(10, 0));
+        merger.push(1, makeEvent(10, 1));
+
+        Recorder recorder;
+        REQUIRE(merger.drainUntil(10, std::ref(recorder)) == 2);
+        REQUIRE(recorder.timestamps.size() == 2);
+    }
+}
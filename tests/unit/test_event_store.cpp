@@ -6,16 +6,26 @@
  */
 
 #include "threveal/analysis/event_store.hpp"
+#include "threveal/core/clock.hpp"
 #include "threveal/core/events.hpp"
 #include "threveal/core/types.hpp"
 
 #include <catch2/catch_test_macros.hpp>
+#include <chrono>
 #include <cstdint>
 
 using threveal::analysis::EventStore;
+using threveal::analysis::PmuDownsampling;
+using threveal::analysis::PmuDownsamplingMode;
+using threveal::core::ClockSnapshot;
 using threveal::core::CpuId;
+using threveal::core::EnergySample;
+using threveal::core::HfiCapabilityUpdate;
 using threveal::core::MigrationEvent;
 using threveal::core::PmuSample;
+using threveal::core::ThreadKey;
+using threveal::core::ThreadLifecycleEvent;
+using threveal::core::ThreadLifecycleKind;
 
 namespace
 {
@@ -57,6 +67,7 @@ TEST_CASE("EventStore starts empty", "[analysis][EventStore]")
     REQUIRE(store.pmuSampleCount() == 0);
     REQUIRE(store.allMigrations().empty());
     REQUIRE(store.allPmuSamples().empty());
+    REQUIRE_FALSE(store.clockSnapshot().has_value());
 }
 
 TEST_CASE("EventStore stores migrations", "[analysis][EventStore]")
@@ -72,6 +83,20 @@ TEST_CASE("EventStore stores migrations", "[analysis][EventStore]")
     REQUIRE(store.allMigrations()[1].timestamp_ns == 2000);
 }
 
+TEST_CASE("EventStore estimates migrations from sample weights", "[analysis][EventStore]")
+{
+    EventStore store;
+    REQUIRE(store.estimatedMigrationCount() == 0);
+
+    auto sampled = makeMigration(1000, 42, 0, 12);
+    sampled.sample_weight = 16;
+    store.addMigration(sampled);
+    store.addMigration(makeMigration(2000, 42, 12, 0));
+
+    REQUIRE(store.migrationCount() == 2);
+    REQUIRE(store.estimatedMigrationCount() == 17);
+}
+
 TEST_CASE("EventStore maintains migrations sorted by timestamp", "[analysis][EventStore]")
 {
     EventStore store;
@@ -396,6 +421,170 @@ TEST_CASE("EventStore PMU correlation with empty store", "[analysis][EventStore]
     }
 }
 
+TEST_CASE("EventStore maintains energy samples sorted by timestamp", "[analysis][EventStore]")
+{
+    EventStore store;
+
+    store.addEnergySample(EnergySample{.timestamp_ns = 3000, .package_energy_uj = 3,
+                                       .cores_energy_uj = 0});
+    store.addEnergySample(EnergySample{.timestamp_ns = 1000, .package_energy_uj = 1,
+                                       .cores_energy_uj = 0});
+    store.addEnergySample(EnergySample{.timestamp_ns = 2000, .package_energy_uj = 2,
+                                       .cores_energy_uj = 0});
+
+    REQUIRE(store.energySampleCount() == 3);
+    auto all = store.allEnergySamples();
+    REQUIRE(all[0].timestamp_ns == 1000);
+    REQUIRE(all[1].timestamp_ns == 2000);
+    REQUIRE(all[2].timestamp_ns == 3000);
+}
+
+TEST_CASE("EventStore looks up HFI capability at a timestamp", "[analysis][EventStore]")
+{
+    EventStore store;
+
+    store.addHfiUpdate(HfiCapabilityUpdate{.timestamp_ns = 2000, .cpu_id = 0, .performance = 900,
+                                           .efficiency = 300});
+    store.addHfiUpdate(HfiCapabilityUpdate{.timestamp_ns = 1000, .cpu_id = 0, .performance = 1023,
+                                           .efficiency = 200});
+    store.addHfiUpdate(HfiCapabilityUpdate{.timestamp_ns = 1500, .cpu_id = 4, .performance = 400,
+                                           .efficiency = 1023});
+
+    REQUIRE(store.hfiUpdateCount() == 3);
+    REQUIRE(store.allHfiUpdates()[0].timestamp_ns == 1000);
+
+    SECTION("No update before the first one")
+    {
+        REQUIRE_FALSE(store.hfiCapabilityAt(0, 999).has_value());
+    }
+
+    SECTION("Latest update at or before the timestamp wins")
+    {
+        auto at_1500 = store.hfiCapabilityAt(0, 1500);
+        REQUIRE(at_1500.has_value());
+        REQUIRE(at_1500->performance == 1023);
+
+        auto at_2000 = store.hfiCapabilityAt(0, 2000);
+        REQUIRE(at_2000.has_value());
+        REQUIRE(at_2000->performance == 900);
+    }
+
+    SECTION("Updates for other CPUs are ignored")
+    {
+        auto result = store.hfiCapabilityAt(4, 5000);
+        REQUIRE(result.has_value());
+        REQUIRE(result->efficiency == 1023);
+        REQUIRE_FALSE(store.hfiCapabilityAt(1, 5000).has_value());
+    }
+}
+
+TEST_CASE("EventStore keeps threads that reused an ID apart", "[analysis][EventStore]")
+{
+    EventStore store;
+    auto lifecycle = [&store](ThreadLifecycleKind kind, std::uint64_t start_ns, std::uint64_t ts)
+    {
+        store.addThreadLifecycle(ThreadLifecycleEvent{.timestamp_ns = ts,
+                                                      .start_time_ns = start_ns,
+                                                      .pid = 42,
+                                                      .tid = 42,
+                                                      .kind = kind,
+                                                      .comm = {}});
+    };
+
+    // Thread 42 runs from 100 to 2500; a new thread 42 starts at 4000
+    lifecycle(ThreadLifecycleKind::kFork, 100, 100);
+    lifecycle(ThreadLifecycleKind::kExit, 100, 2500);
+    lifecycle(ThreadLifecycleKind::kFork, 4000, 4000);
+
+    store.addMigration(makeMigration(1000, 42, 0, 1));
+    store.addMigration(makeMigration(2000, 42, 1, 0));
+    store.addMigration(makeMigration(5000, 42, 0, 1));
+    store.addPmuSample(makePmuSample(1500, 42, 1));
+    store.addPmuSample(makePmuSample(3000, 42, 0));
+    store.addPmuSample(makePmuSample(6000, 42, 1));
+
+    auto first = store.threadAt(42, 1000);
+    auto second = store.threadAt(42, 5000);
+    REQUIRE(first == ThreadKey{42, 100});
+    REQUIRE(second == ThreadKey{42, 4000});
+    REQUIRE(store.threads().threadCount() == 2);
+
+    REQUIRE(store.migrationsForThread(42).size() == 3);
+    REQUIRE(store.migrationsForThread(first).size() == 2);
+    REQUIRE(store.migrationsForThread(second).size() == 1);
+    REQUIRE(store.pmuSamplesForThread(first).size() == 1);
+    REQUIRE(store.pmuSamplesForThread(second).size() == 1);
+
+    // Samples of the other thread with the same ID are not correlated
+    auto last_of_first = store.allMigrations()[1];
+    REQUIRE_FALSE(store.pmuAfterMigration(last_of_first).has_value());
+    auto only_of_second = store.allMigrations()[2];
+    REQUIRE_FALSE(store.pmuBeforeMigration(only_of_second).has_value());
+    REQUIRE(store.pmuAfterMigration(only_of_second)->timestamp_ns == 6000);
+
+    store.clear();
+    REQUIRE(store.threads().threadCount() == 0);
+}
+
+TEST_CASE("EventStore downsamples PMU samples at ingest", "[analysis][EventStore]")
+{
+    constexpr std::uint64_t kMs = 1'000'000;
+
+    PmuDownsampling policy;
+    policy.mode = PmuDownsamplingMode::kReservoir;
+    policy.migration_window = std::chrono::milliseconds(2);
+    policy.settle_time = std::chrono::milliseconds(10);
+    policy.reservoir_size = 50;
+    EventStore store(policy);
+
+    for (std::uint64_t ms = 0; ms < 20000; ++ms)
+    {
+        store.addPmuSample(makePmuSample(ms * kMs, 7, 0));
+        if (ms == 10005)
+        {
+            store.addMigration(makeMigration(10000 * kMs, 7, 0, 4));
+        }
+    }
+
+    // Changes are stored in batches; the budget is never exceeded
+    REQUIRE(store.pmuSampleCount() <= 5 + 50);
+
+    store.flushPmuSamples();
+    REQUIRE(store.pmuSampleCount() == 5 + 50);
+    REQUIRE(store.downsampledPmuSampleCount() == 20000 - 55);
+
+    // The migration still finds its neighbours
+    auto migration = store.allMigrations()[0];
+    REQUIRE(store.pmuBeforeMigration(migration)->timestamp_ns == 10000 * kMs);
+    REQUIRE(store.pmuAfterMigration(migration)->timestamp_ns == 10000 * kMs);
+
+    SECTION("An exit decides the thread's samples")
+    {
+        store.addPmuSample(makePmuSample(20000 * kMs, 7, 0));
+        store.addThreadLifecycle(ThreadLifecycleEvent{
+            .timestamp_ns = 20001 * kMs,
+            .start_time_ns = 0,
+            .pid = 7,
+            .tid = 7,
+            .kind = ThreadLifecycleKind::kExit,
+            .comm = {},
+        });
+        store.flushPmuSamples();
+        REQUIRE(store.pmuSampleCount() + store.downsampledPmuSampleCount() == 20001);
+    }
+
+    SECTION("Clear keeps the policy")
+    {
+        store.clear();
+        REQUIRE(store.pmuSampleCount() == 0);
+        REQUIRE(store.downsampledPmuSampleCount() == 0);
+        store.addPmuSample(makePmuSample(kMs, 7, 0));
+        REQUIRE(store.pmuSampleCount() == 0);
+        store.flushPmuSamples();
+        REQUIRE(store.pmuSampleCount() == 1);
+    }
+}
+
 TEST_CASE("EventStore clear removes all events", "[analysis][EventStore]")
 {
     EventStore store;
@@ -403,14 +592,24 @@ TEST_CASE("EventStore clear removes all events", "[analysis][EventStore]")
     store.addMigration(makeMigration(1000, 42, 0, 1));
     store.addMigration(makeMigration(2000, 42, 1, 0));
     store.addPmuSample(makePmuSample(1500, 42, 0));
+    store.addEnergySample(EnergySample{.timestamp_ns = 1500, .package_energy_uj = 1,
+                                       .cores_energy_uj = 0});
+    store.addHfiUpdate(HfiCapabilityUpdate{.timestamp_ns = 1500, .cpu_id = 0, .performance = 1,
+                                           .efficiency = 1});
+    store.setClockSnapshot(ClockSnapshot{.trace_ns = 1000, .realtime_ns = 5000});
 
     REQUIRE(store.migrationCount() == 2);
+    REQUIRE(store.clockSnapshot().has_value());
     REQUIRE(store.pmuSampleCount() == 1);
+    REQUIRE(store.energySampleCount() == 1);
 
     store.clear();
 
     REQUIRE(store.migrationCount() == 0);
     REQUIRE(store.pmuSampleCount() == 0);
+    REQUIRE(store.energySampleCount() == 0);
+    REQUIRE(store.hfiUpdateCount() == 0);
     REQUIRE(store.allMigrations().empty());
     REQUIRE(store.allPmuSamples().empty());
+    REQUIRE_FALSE(store.clockSnapshot().has_value());
 }
@@ -15,7 +15,9 @@
 #include <vector>
 
 using Catch::Matchers::WithinRel;
+using threveal::core::classifyCoreTypes;
 using threveal::core::classifyMigration;
+using threveal::core::CoreType;
 using threveal::core::CpuId;
 using threveal::core::MigrationEvent;
 using threveal::core::MigrationType;
@@ -226,6 +228,15 @@ TEST_CASE("classifyMigration with hybrid topology", "[events][classifyMigration]
     }
 }
 
+TEST_CASE("classifyCoreTypes maps type pairs", "[events][classifyMigration]")
+{
+    REQUIRE(classifyCoreTypes(CoreType::kPCore, CoreType::kPCore) == MigrationType::kPToP);
+    REQUIRE(classifyCoreTypes(CoreType::kPCore, CoreType::kECore) == MigrationType::kPToE);
+    REQUIRE(classifyCoreTypes(CoreType::kECore, CoreType::kPCore) == MigrationType::kEToP);
+    REQUIRE(classifyCoreTypes(CoreType::kECore, CoreType::kECore) == MigrationType::kEToE);
+    REQUIRE(classifyCoreTypes(CoreType::kUnknown, CoreType::kPCore) == MigrationType::kUnknown);
+}
+
 TEST_CASE("MigrationEvent commAsStringView", "[events][MigrationEvent]")
 {
     SECTION("normal command name")
@@ -0,0 +1,312 @@
+/**
+ *  @file       test_fleet_aggregate.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for fleet-wide migration aggregation.
+ */
+
+#include "threveal/analysis/fleet_aggregate.hpp"
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/clock.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+using Catch::Matchers::WithinAbs;
+using Catch::Matchers::WithinRel;
+using threveal::analysis::DistinctCounter;
+using threveal::analysis::FleetAggregate;
+using threveal::analysis::FleetAggregateOptions;
+using threveal::analysis::FleetMergeOptions;
+using threveal::analysis::mergeTraceFiles;
+using threveal::analysis::threadRole;
+using threveal::analysis::TraceHeader;
+using threveal::analysis::TraceReader;
+using threveal::analysis::writeTrace;
+using threveal::core::ClockSnapshot;
+using threveal::core::CoreType;
+using threveal::core::CpuId;
+using threveal::core::MigrationEvent;
+using threveal::core::TopologyMap;
+using threveal::core::TraceError;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+/**
+ *  Temporary directory of per-host traces.
+ */
+class FleetFixture
+{
+  public:
+    FleetFixture()
+        : root_(fs::temp_directory_path() /
+                ("threveal_fleet_" + std::to_string(getpid()) + "_" + std::to_string(counter_++)))
+    {
+        fs::create_directories(root_);
+    }
+
+    ~FleetFixture()
+    {
+        std::error_code ec;
+        fs::remove_all(root_, ec);
+    }
+
+    FleetFixture(const FleetFixture&) = delete;
+    auto operator=(const FleetFixture&) -> FleetFixture& = delete;
+    FleetFixture(FleetFixture&&) = delete;
+    auto operator=(FleetFixture&&) -> FleetFixture& = delete;
+
+    /**
+     *  Writes a trace for a host whose P-cores are 0-1 and E-cores 2-3,
+     *  or the reverse when swapped is set.
+     */
+    auto addHost(const std::string& host, const std::vector<MigrationEvent>& migrations,
+                 bool swapped = false) -> std::string
+    {
+        std::vector<CpuId> low = {0, 1};
+        std::vector<CpuId> high = {2, 3};
+        TraceHeader header{
+            .host = host,
+            .clock = ClockSnapshot{.trace_ns = 0, .realtime_ns = 1'000'000},
+            .topology = swapped ? TopologyMap{high, low} : TopologyMap{low, high},
+        };
+
+        auto path = (root_ / (host + ".trace")).string();
+        REQUIRE(writeTrace(path, header, migrations).has_value());
+        return path;
+    }
+
+    [[nodiscard]] auto root() const -> const fs::path&
+    {
+        return root_;
+    }
+
+  private:
+    static inline int counter_ = 0;
+    fs::path root_;
+};
+
+// Unstamped migration, classified from the host topology
+auto makeMigration(std::string_view comm, std::uint32_t tid, CpuId src, CpuId dst)
+    -> MigrationEvent
+{
+    MigrationEvent event{};
+    event.timestamp_ns = 100 + tid;
+    event.tid = tid;
+    event.src_cpu = src;
+    event.dst_cpu = dst;
+    std::memcpy(event.comm.data(), comm.data(), comm.size());
+    return event;
+}
+
+auto findRole(const FleetAggregate& aggregate, std::string_view role)
+    -> const threveal::analysis::RoleAggregate*
+{
+    for (const auto& entry : aggregate.roles())
+    {
+        if (entry.role == role)
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+TEST_CASE("threadRole strips pool indices", "[analysis][FleetAggregate]")
+{
+    REQUIRE(threadRole("worker-12") == "worker");
+    REQUIRE(threadRole("worker_3") == "worker");
+    REQUIRE(threadRole("kworker/3:1") == "kworker");
+    REQUIRE(threadRole("nginx") == "nginx");
+    REQUIRE(threadRole("1234") == "1234");
+    REQUIRE(threadRole("") == "");
+}
+
+TEST_CASE("DistinctCounter estimates and merges", "[analysis][FleetAggregate]")
+{
+    DistinctCounter empty;
+    REQUIRE(empty.estimate() == 0.0);
+
+    DistinctCounter first;
+    DistinctCounter second;
+    for (std::uint64_t i = 0; i < 1000; ++i)
+    {
+        // Any well-mixed 64-bit hash will do (splitmix64)
+        auto hash = (i + 1) * 0x9e3779b97f4a7c15ULL;
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        hash ^= hash >> 31;
+        first.add(hash);
+        if (i >= 500)
+        {
+            second.add(hash);
+            second.add(hash);
+        }
+    }
+
+    REQUIRE_THAT(first.estimate(), WithinRel(1000.0, 0.2));
+    REQUIRE_THAT(second.estimate(), WithinRel(500.0, 0.2));
+
+    second.merge(first);
+    REQUIRE_THAT(second.estimate(), WithinAbs(first.estimate(), 1e-9));
+}
+
+TEST_CASE("FleetAggregate normalises per-host topologies", "[analysis][FleetAggregate]")
+{
+    FleetFixture fleet;
+
+    // CPU 0 -> 2 is P->E on one host and E->P on the other
+    auto normal = fleet.addHost("a", {makeMigration("worker-1", 1, 0, 2)});
+    auto swapped = fleet.addHost("b", {makeMigration("worker-2", 2, 0, 2)}, true);
+
+    FleetAggregate aggregate;
+    for (const auto& path : {normal, swapped})
+    {
+        auto reader = TraceReader::open(path);
+        REQUIRE(reader.has_value());
+        REQUIRE(aggregate.addTrace(*reader).has_value());
+    }
+
+    REQUIRE(aggregate.hostCount() == 2);
+    REQUIRE(aggregate.roles().size() == 1);
+
+    const auto& worker = aggregate.roles().front();
+    REQUIRE(worker.role == "worker");
+    REQUIRE(worker.migrations == 2);
+    REQUIRE(worker.p_to_e == 1);
+    REQUIRE(worker.e_to_p == 1);
+    REQUIRE_THAT(worker.hosts.estimate(), WithinRel(2.0, 0.1));
+    REQUIRE_THAT(worker.threads.estimate(), WithinRel(2.0, 0.1));
+    REQUIRE(worker.first_seen_realtime_ns == 1'000'101);
+    REQUIRE(worker.last_seen_realtime_ns == 1'000'102);
+}
+
+TEST_CASE("FleetAggregate prefers stamped core types", "[analysis][FleetAggregate]")
+{
+    FleetFixture fleet;
+
+    auto event = makeMigration("db", 1, 0, 2);
+    event.src_type = CoreType::kECore;
+    event.dst_type = CoreType::kPCore;
+    event.sample_weight = 4;
+    auto path = fleet.addHost("a", {event});
+
+    FleetAggregate aggregate;
+    auto reader = TraceReader::open(path);
+    REQUIRE(reader.has_value());
+    REQUIRE(aggregate.addTrace(*reader).has_value());
+
+    REQUIRE(aggregate.totals().e_to_p == 4);
+    REQUIRE(aggregate.totals().p_to_e == 0);
+}
+
+TEST_CASE("FleetAggregate stays within capacity", "[analysis][FleetAggregate]")
+{
+    FleetFixture fleet;
+
+    // Role "r<n>" has n P->E migrations
+    std::vector<MigrationEvent> migrations;
+    for (std::uint32_t n = 1; n <= 5; ++n)
+    {
+        auto comm = "r" + std::string(1, static_cast<char>('a' + n));
+        for (std::uint32_t i = 0; i < n; ++i)
+        {
+            migrations.push_back(makeMigration(comm, (n * 10) + i, 0, 2));
+        }
+    }
+    auto path = fleet.addHost("a", migrations);
+
+    FleetAggregate aggregate{FleetAggregateOptions{.capacity = 2}};
+    auto reader = TraceReader::open(path);
+    REQUIRE(reader.has_value());
+    REQUIRE(aggregate.addTrace(*reader).has_value());
+
+    REQUIRE(aggregate.roles().size() == 2);
+    REQUIRE(aggregate.roles()[0].role == "rf");
+    REQUIRE(aggregate.roles()[0].p_to_e == 5);
+    REQUIRE(aggregate.roles()[1].role == "re");
+    REQUIRE(aggregate.errorBound() == 3);
+
+    // Totals are exact regardless of capacity
+    REQUIRE(aggregate.totals().p_to_e == 15);
+}
+
+TEST_CASE("mergeTraceFiles aggregates hosts in parallel", "[analysis][FleetAggregate]")
+{
+    FleetFixture fleet;
+
+    std::vector<std::string> paths;
+    for (int host = 0; host < 16; ++host)
+    {
+        paths.push_back(fleet.addHost("host" + std::to_string(host),
+                                      {makeMigration("worker-1", 1, 0, 2),
+                                       makeMigration("worker-2", 2, 0, 1),
+                                       makeMigration("logger", 3, 2, 0)}));
+    }
+
+    FleetMergeOptions options{.threads = 4};
+    auto result = mergeTraceFiles(paths, options);
+    REQUIRE(result.has_value());
+    REQUIRE(result->hostCount() == 16);
+    REQUIRE(result->skippedTraces() == 0);
+    REQUIRE(result->totals().migrations == 48);
+
+    const auto* worker = findRole(*result, "worker");
+    REQUIRE(worker != nullptr);
+    REQUIRE(worker->p_to_e == 16);
+    REQUIRE(worker->p_to_p == 16);
+    REQUIRE_THAT(worker->hosts.estimate(), WithinRel(16.0, 0.1));
+    REQUIRE_THAT(worker->threads.estimate(), WithinRel(32.0, 0.1));
+
+    const auto* logger = findRole(*result, "logger");
+    REQUIRE(logger != nullptr);
+    REQUIRE(logger->e_to_p == 16);
+
+    // Workers rank first: they lose the most to P->E migrations
+    REQUIRE(result->roles().front().role == "worker");
+}
+
+TEST_CASE("mergeTraceFiles skips unreadable traces", "[analysis][FleetAggregate]")
+{
+    FleetFixture fleet;
+    auto good = fleet.addHost("a", {makeMigration("worker", 1, 0, 2)});
+    auto missing = (fleet.root() / "missing.trace").string();
+
+    SECTION("Some traces readable")
+    {
+        std::vector<std::string> paths = {missing, good};
+        auto result = mergeTraceFiles(paths, FleetMergeOptions{.threads = 2});
+        REQUIRE(result.has_value());
+        REQUIRE(result->hostCount() == 1);
+        REQUIRE(result->skippedTraces() == 1);
+    }
+
+    SECTION("No trace readable")
+    {
+        std::vector<std::string> paths = {missing};
+        REQUIRE(mergeTraceFiles(paths).error() == TraceError::kOpenFailed);
+    }
+
+    SECTION("No traces")
+    {
+        auto result = mergeTraceFiles({});
+        REQUIRE(result.has_value());
+        REQUIRE(result->hostCount() == 0);
+    }
+}
@@ -0,0 +1,228 @@
+/**
+ *  @file       test_hfi_analysis.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for HFI-aware migration analysis.
+ */
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/analysis/hfi_analysis.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <cstdint>
+#include <vector>
+
+using Catch::Matchers::WithinRel;
+using threveal::analysis::classifyHfiMigrations;
+using threveal::analysis::compareIpcRatios;
+using threveal::analysis::EventStore;
+using threveal::analysis::HfiAnalysisOptions;
+using threveal::analysis::HfiVerdict;
+using threveal::analysis::summarizeHfiVerdicts;
+using threveal::analysis::toString;
+using threveal::core::CpuId;
+using threveal::core::HfiCapabilityUpdate;
+using threveal::core::MigrationEvent;
+using threveal::core::PmuSample;
+using threveal::core::TopologyMap;
+
+namespace
+{
+
+// P-cores 0-3, E-cores 4-7
+auto makeTopology() -> TopologyMap
+{
+    std::vector<CpuId> p_cores = {0, 1, 2, 3};
+    std::vector<CpuId> e_cores = {4, 5, 6, 7};
+    return TopologyMap{p_cores, e_cores};
+}
+
+auto makeMigration(std::uint64_t timestamp_ns, CpuId src, CpuId dst) -> MigrationEvent
+{
+    return MigrationEvent{
+        .timestamp_ns = timestamp_ns,
+        .pid = 1,
+        .tid = 1,
+        .src_cpu = src,
+        .dst_cpu = dst,
+        .comm = {},
+    };
+}
+
+auto makeUpdate(std::uint64_t timestamp_ns, CpuId cpu, std::uint32_t performance,
+                std::uint32_t efficiency = 512) -> HfiCapabilityUpdate
+{
+    return HfiCapabilityUpdate{
+        .timestamp_ns = timestamp_ns,
+        .cpu_id = cpu,
+        .performance = performance,
+        .efficiency = efficiency,
+    };
+}
+
+auto makePmuSample(std::uint64_t timestamp_ns, CpuId cpu, std::uint64_t instructions,
+                   std::uint64_t cycles) -> PmuSample
+{
+    return PmuSample{
+        .timestamp_ns = timestamp_ns,
+        .tid = 1,
+        .cpu_id = cpu,
+        .instructions = instructions,
+        .cycles = cycles,
+        .llc_misses = 0,
+        .llc_references = 0,
+        .branch_misses = 0,
+    };
+}
+
+}  // namespace
+
+TEST_CASE("HfiVerdict toString", "[analysis][hfi]")
+{
+    REQUIRE(toString(HfiVerdict::kFollowed) == "followed");
+    REQUIRE(toString(HfiVerdict::kAgainst) == "against");
+    REQUIRE(toString(HfiVerdict::kNeutral) == "neutral");
+    REQUIRE(toString(HfiVerdict::kEfficiency) == "efficiency");
+    REQUIRE(toString(HfiVerdict::kUnknown) == "unknown");
+}
+
+TEST_CASE("classifyHfiMigrations judges against capability at migration time",
+          "[analysis][hfi]")
+{
+    EventStore store;
+    store.addHfiUpdate(makeUpdate(100, 0, 1023));
+    store.addHfiUpdate(makeUpdate(100, 1, 1000));
+    store.addHfiUpdate(makeUpdate(100, 4, 500));
+
+    store.addMigration(makeMigration(1000, 4, 0));  // toward higher capability
+    store.addMigration(makeMigration(2000, 0, 4));  // toward lower capability
+    store.addMigration(makeMigration(3000, 0, 1));  // within neutral band
+    store.addMigration(makeMigration(4000, 0, 7));  // no capability for CPU 7
+
+    // P-core 0 is throttled below the E-core after the first migrations
+    store.addHfiUpdate(makeUpdate(4500, 0, 300));
+    store.addMigration(makeMigration(5000, 0, 4));
+
+    auto verdicts = classifyHfiMigrations(store);
+    REQUIRE(verdicts.size() == 5);
+
+    REQUIRE(verdicts[0].verdict == HfiVerdict::kFollowed);
+    REQUIRE(verdicts[0].src_performance == 500U);
+    REQUIRE(verdicts[0].dst_performance == 1023U);
+    REQUIRE(verdicts[1].verdict == HfiVerdict::kAgainst);
+    REQUIRE(verdicts[2].verdict == HfiVerdict::kNeutral);
+    REQUIRE(verdicts[3].verdict == HfiVerdict::kUnknown);
+    REQUIRE_FALSE(verdicts[3].dst_performance.has_value());
+    REQUIRE(verdicts[4].verdict == HfiVerdict::kFollowed);
+
+    auto summary = summarizeHfiVerdicts(verdicts);
+    REQUIRE(summary.followed == 2);
+    REQUIRE(summary.against == 1);
+    REQUIRE(summary.neutral == 1);
+    REQUIRE(summary.unknown == 1);
+    REQUIRE_THAT(summary.followRate(), WithinRel(2.0 / 3.0, 1e-9));
+}
+
+TEST_CASE("classifyHfiMigrations respects neutral band", "[analysis][hfi]")
+{
+    EventStore store;
+    store.addHfiUpdate(makeUpdate(100, 0, 1000));
+    store.addHfiUpdate(makeUpdate(100, 1, 1010));
+    store.addMigration(makeMigration(1000, 0, 1));
+
+    auto with_band = classifyHfiMigrations(store);
+    REQUIRE(with_band[0].verdict == HfiVerdict::kNeutral);
+
+    auto without_band = classifyHfiMigrations(store, HfiAnalysisOptions{.neutral_band = 0});
+    REQUIRE(without_band[0].verdict == HfiVerdict::kFollowed);
+}
+
+TEST_CASE("classifyHfiMigrations credits moves justified by efficiency", "[analysis][hfi]")
+{
+    EventStore store;
+    store.addHfiUpdate(makeUpdate(100, 0, 1023, 300));
+    store.addHfiUpdate(makeUpdate(100, 4, 500, 900));
+    store.addHfiUpdate(makeUpdate(100, 5, 500, 300));
+
+    store.addMigration(makeMigration(1000, 0, 4));  // slower but more efficient
+    store.addMigration(makeMigration(2000, 0, 5));  // slower and no more efficient
+    store.addMigration(makeMigration(3000, 5, 4));  // same speed, more efficient
+
+    auto verdicts = classifyHfiMigrations(store);
+    REQUIRE(verdicts.size() == 3);
+
+    REQUIRE(verdicts[0].verdict == HfiVerdict::kEfficiency);
+    REQUIRE(verdicts[0].src_efficiency == 300U);
+    REQUIRE(verdicts[0].dst_efficiency == 900U);
+    REQUIRE(verdicts[1].verdict == HfiVerdict::kAgainst);
+    REQUIRE(verdicts[2].verdict == HfiVerdict::kEfficiency);
+
+    auto summary = summarizeHfiVerdicts(verdicts);
+    REQUIRE(summary.efficiency == 2);
+    REQUIRE(summary.against == 1);
+    REQUIRE_THAT(summary.followRate(), WithinRel(2.0 / 3.0, 1e-9));
+}
+
+TEST_CASE("summarizeHfiVerdicts on empty input", "[analysis][hfi]")
+{
+    auto summary = summarizeHfiVerdicts({});
+
+    REQUIRE(summary.followed == 0);
+    REQUIRE(summary.unknown == 0);
+    REQUIRE(summary.followRate() == 0.0);
+}
+
+TEST_CASE("summarizeHfiVerdicts scales by sample weight", "[analysis][hfi]")
+{
+    EventStore store;
+    store.addHfiUpdate(makeUpdate(100, 0, 1000));
+    store.addHfiUpdate(makeUpdate(100, 4, 400));
+
+    auto sampled = makeMigration(1000, 4, 0);
+    sampled.sample_weight = 8;
+    store.addMigration(sampled);
+    store.addMigration(makeMigration(2000, 0, 4));
+
+    auto summary = summarizeHfiVerdicts(classifyHfiMigrations(store));
+    REQUIRE(summary.followed == 8);
+    REQUIRE(summary.against == 1);
+    REQUIRE_THAT(summary.followRate(), WithinRel(8.0 / 9.0, 1e-9));
+}
+
+TEST_CASE("compareIpcRatios compares measured and predicted ratios", "[analysis][hfi]")
+{
+    auto topology = makeTopology();
+    EventStore store;
+
+    store.addHfiUpdate(makeUpdate(100, 0, 1000));
+    store.addHfiUpdate(makeUpdate(100, 4, 500));
+
+    store.addPmuSample(makePmuSample(1000, 0, 3000, 1000));  // IPC 3.0
+    store.addPmuSample(makePmuSample(1000, 4, 1500, 1000));  // IPC 1.5
+    store.addPmuSample(makePmuSample(50, 4, 9000, 1000));    // before any HFI update
+    store.addPmuSample(makePmuSample(1000, 99, 9000, 1000)); // not in topology
+
+    auto comparison = compareIpcRatios(store, topology);
+    REQUIRE(comparison.has_value());
+
+    REQUIRE_THAT(comparison->p_core_ipc, WithinRel(3.0, 1e-9));
+    REQUIRE_THAT(comparison->e_core_ipc, WithinRel(1.5, 1e-9));
+    REQUIRE_THAT(comparison->measuredRatio(), WithinRel(2.0, 1e-9));
+    REQUIRE_THAT(comparison->predictedRatio(), WithinRel(2.0, 1e-9));
+}
+
+TEST_CASE("compareIpcRatios requires samples on both core types", "[analysis][hfi]")
+{
+    auto topology = makeTopology();
+    EventStore store;
+
+    store.addHfiUpdate(makeUpdate(100, 0, 1000));
+    store.addPmuSample(makePmuSample(1000, 0, 3000, 1000));
+
+    REQUIRE_FALSE(compareIpcRatios(store, topology).has_value());
+}
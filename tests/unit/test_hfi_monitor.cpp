@@ -0,0 +1,188 @@
+/**
+ *  @file       test_hfi_monitor.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for HfiMonitor.
+ *
+ *  The file-backed source is used throughout, so these tests do not need
+ *  HFI hardware or the thermal netlink family.
+ */
+
+#include "threveal/collection/hfi_monitor.hpp"
+#include "threveal/core/events.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+using threveal::collection::HfiMonitor;
+using threveal::core::HfiCapabilityUpdate;
+using threveal::core::HfiError;
+using threveal::core::toString;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+/**
+ *  Replay file in the temp directory that is removed on destruction.
+ */
+class ReplayFile
+{
+  public:
+    ReplayFile()
+        : path_(fs::temp_directory_path() /
+                ("threveal_hfi_" + std::to_string(getpid()) + "_" + std::to_string(counter_++)))
+    {
+        std::ofstream{path_};
+    }
+
+    ~ReplayFile()
+    {
+        std::error_code ec;
+        fs::remove(path_, ec);
+    }
+
+    ReplayFile(const ReplayFile&) = delete;
+    auto operator=(const ReplayFile&) -> ReplayFile& = delete;
+    ReplayFile(ReplayFile&&) = delete;
+    auto operator=(ReplayFile&&) -> ReplayFile& = delete;
+
+    void append(std::string_view text) const
+    {
+        std::ofstream out(path_, std::ios::app);
+        out << text;
+    }
+
+    [[nodiscard]] auto path() const -> std::string
+    {
+        return path_.string();
+    }
+
+  private:
+    static inline int counter_ = 0;
+    fs::path path_;
+};
+
+}  // namespace
+
+TEST_CASE("HfiMonitor::createFromFile rejects missing file", "[collection][HfiMonitor]")
+{
+    auto result = HfiMonitor::createFromFile("/nonexistent/threveal_hfi",
+                                             [](const HfiCapabilityUpdate&) {});
+
+    REQUIRE_FALSE(result.has_value());
+    REQUIRE(result.error() == HfiError::kSourceNotFound);
+}
+
+TEST_CASE("HfiMonitor::createFromFile rejects empty callback", "[collection][HfiMonitor]")
+{
+    ReplayFile file;
+
+    auto result = HfiMonitor::createFromFile(file.path(), nullptr);
+
+    REQUIRE_FALSE(result.has_value());
+    REQUIRE(result.error() == HfiError::kInvalidState);
+}
+
+TEST_CASE("HfiMonitor replays updates from file", "[collection][HfiMonitor]")
+{
+    ReplayFile file;
+    file.append("# cpu perf eff\n"
+                "0 1023 256\n"
+                "\n"
+                "4 512 1023\n");
+
+    std::vector<HfiCapabilityUpdate> updates;
+    auto monitor = HfiMonitor::createFromFile(file.path(),
+                                              [&](const HfiCapabilityUpdate& update)
+                                              {
+                                                  updates.push_back(update);
+                                              });
+    REQUIRE(monitor.has_value());
+    REQUIRE(monitor->isValid());
+
+    REQUIRE(monitor->poll(std::chrono::milliseconds{0}) == 2);
+    REQUIRE(monitor->updateCount() == 2);
+    REQUIRE(updates.size() == 2);
+
+    REQUIRE(updates[0].cpu_id == 0);
+    REQUIRE(updates[0].performance == 1023);
+    REQUIRE(updates[0].efficiency == 256);
+    REQUIRE(updates[1].cpu_id == 4);
+    REQUIRE(updates[1].performance == 512);
+    REQUIRE(updates[1].efficiency == 1023);
+    REQUIRE(updates[0].timestamp_ns > 0);
+    REQUIRE(updates[1].timestamp_ns >= updates[0].timestamp_ns);
+}
+
+TEST_CASE("HfiMonitor picks up appended and partial lines", "[collection][HfiMonitor]")
+{
+    ReplayFile file;
+
+    std::vector<HfiCapabilityUpdate> updates;
+    auto monitor = HfiMonitor::createFromFile(file.path(),
+                                              [&](const HfiCapabilityUpdate& update)
+                                              {
+                                                  updates.push_back(update);
+                                              });
+    REQUIRE(monitor.has_value());
+
+    REQUIRE(monitor->poll(std::chrono::milliseconds{0}) == 0);
+
+    file.append("2 800");
+    REQUIRE(monitor->poll(std::chrono::milliseconds{0}) == 0);
+
+    file.append(" 400\n3 garbage\n");
+    REQUIRE(monitor->poll(std::chrono::milliseconds{0}) == 1);
+    REQUIRE(updates.size() == 1);
+    REQUIRE(updates[0].cpu_id == 2);
+    REQUIRE(updates[0].performance == 800);
+    REQUIRE(updates[0].efficiency == 400);
+}
+
+TEST_CASE("HfiMonitor move semantics", "[collection][HfiMonitor]")
+{
+    ReplayFile file;
+    file.append("1 100 200\n");
+
+    int calls = 0;
+    auto monitor = HfiMonitor::createFromFile(file.path(),
+                                              [&](const HfiCapabilityUpdate&)
+                                              {
+                                                  ++calls;
+                                              });
+    REQUIRE(monitor.has_value());
+
+    HfiMonitor moved = std::move(*monitor);
+    REQUIRE(moved.isValid());
+    REQUIRE_FALSE(monitor->isValid());  // NOLINT(bugprone-use-after-move)
+    REQUIRE(monitor->poll(std::chrono::milliseconds{0}) == -1);
+
+    REQUIRE(moved.poll(std::chrono::milliseconds{0}) == 1);
+    REQUIRE(calls == 1);
+}
+
+TEST_CASE("HfiMonitor::create reports missing netlink support cleanly", "[collection][HfiMonitor]")
+{
+    auto result = HfiMonitor::create([](const HfiCapabilityUpdate&) {});
+
+    if (!result)
+    {
+        // Containers and non-HFI kernels lack the thermal family
+        REQUIRE((result.error() == HfiError::kSocketFailed ||
+                 result.error() == HfiError::kFamilyNotFound ||
+                 result.error() == HfiError::kSubscribeFailed));
+        SKIP("Thermal netlink unavailable: " << toString(result.error()));
+    }
+
+    REQUIRE(result->isValid());
+    REQUIRE(result->fileDescriptor() >= 0);
+    REQUIRE(result->poll(std::chrono::milliseconds{0}) >= 0);
+}
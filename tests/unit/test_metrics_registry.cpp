@@ -0,0 +1,133 @@
+/**
+ *  @file       test_metrics_registry.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the monitoring counters.
+ */
+
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+#include "threveal/transport/metrics_registry.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using threveal::core::CoreType;
+using threveal::core::MigrationEvent;
+using threveal::core::PmuSample;
+using threveal::transport::DropReason;
+using threveal::transport::MetricsRegistry;
+
+namespace
+{
+
+auto makeMigration(std::uint32_t pid, std::uint64_t timestamp_ns, CoreType src, CoreType dst)
+    -> MigrationEvent
+{
+    MigrationEvent event{};
+    event.timestamp_ns = timestamp_ns;
+    event.pid = pid;
+    event.tid = pid;
+    event.src_type = src;
+    event.dst_type = dst;
+    event.sample_weight = 1;
+    return event;
+}
+
+auto render(const MetricsRegistry& registry) -> std::string
+{
+    std::string text;
+    registry.render(text);
+    return text;
+}
+
+auto contains(const std::string& text, const std::string& line) -> bool
+{
+    return text.find(line + "\n") != std::string::npos;
+}
+
+}  // namespace
+
+TEST_CASE("MetricsRegistry renders an empty registry", "[transport][MetricsRegistry]")
+{
+    MetricsRegistry registry;
+    auto text = render(registry);
+
+    REQUIRE(text.starts_with("# TYPE threveal_migrations counter\n"));
+    REQUIRE(text.ends_with("\n# EOF\n"));
+    REQUIRE(text.find("threveal_migrations_total{") == std::string::npos);
+    REQUIRE(contains(text, "threveal_ipc{core_type=\"P-core\"} 0"));
+    REQUIRE(contains(text, "threveal_dropped_events_total{reason=\"ring_full\"} 0"));
+    REQUIRE(contains(text, "# UNIT threveal_core_residency_seconds seconds"));
+    REQUIRE(registry.seriesCount() == 18);
+}
+
+TEST_CASE("MetricsRegistry counts migrations by type and process", "[transport][MetricsRegistry]")
+{
+    MetricsRegistry registry;
+    registry.recordMigration(makeMigration(42, 100, CoreType::kPCore, CoreType::kECore));
+    registry.recordMigration(makeMigration(42, 200, CoreType::kPCore, CoreType::kECore));
+    auto weighted = makeMigration(7, 300, CoreType::kECore, CoreType::kPCore);
+    weighted.sample_weight = 10;
+    registry.recordMigration(weighted);
+
+    auto text = render(registry);
+    REQUIRE(contains(text, "threveal_migrations_total{type=\"p_to_e\",tgid=\"42\"} 2"));
+    REQUIRE(contains(text, "threveal_migrations_total{type=\"e_to_p\",tgid=\"7\"} 10"));
+    REQUIRE(registry.seriesCount() == 20);
+}
+
+TEST_CASE("MetricsRegistry folds processes beyond its capacity", "[transport][MetricsRegistry]")
+{
+    MetricsRegistry registry(2);
+    for (std::uint32_t pid = 1; pid <= 4; ++pid)
+    {
+        registry.recordMigration(makeMigration(pid, pid, CoreType::kPCore, CoreType::kPCore));
+    }
+
+    auto text = render(registry);
+    REQUIRE(contains(text, "threveal_migrations_total{type=\"p_to_p\",tgid=\"1\"} 1"));
+    REQUIRE(contains(text, "threveal_migrations_total{type=\"p_to_p\",tgid=\"2\"} 1"));
+    REQUIRE(contains(text, "threveal_migrations_total{type=\"p_to_p\",tgid=\"other\"} 2"));
+}
+
+TEST_CASE("MetricsRegistry credits residency to the core type left",
+          "[transport][MetricsRegistry]")
+{
+    MetricsRegistry registry;
+    registry.recordMigration(makeMigration(5, 1'000'000'000, CoreType::kECore, CoreType::kPCore));
+    registry.recordMigration(makeMigration(5, 3'000'000'000, CoreType::kPCore, CoreType::kECore));
+    registry.recordMigration(makeMigration(5, 3'500'000'000, CoreType::kECore, CoreType::kPCore));
+
+    auto text = render(registry);
+    REQUIRE(contains(text, "threveal_core_residency_seconds_total{core_type=\"P-core\"} 2"));
+    REQUIRE(contains(text, "threveal_core_residency_seconds_total{core_type=\"E-core\"} 0.5"));
+}
+
+TEST_CASE("MetricsRegistry derives IPC and keeps drops monotonic",
+          "[transport][MetricsRegistry]")
+{
+    MetricsRegistry registry;
+    PmuSample sample{};
+    sample.instructions = 300;
+    sample.cycles = 200;
+    registry.recordPmuSample(sample, CoreType::kPCore);
+
+    registry.setDropped(DropReason::kRingFull, 5);
+    registry.setDropped(DropReason::kRingFull, 3);
+    registry.setDropped(DropReason::kStreamQueue, 9);
+    registry.addCollectorTime(std::chrono::milliseconds(250));
+    registry.recordScrape(std::chrono::milliseconds(2));
+
+    auto text = render(registry);
+    REQUIRE(contains(text, "threveal_instructions_total{core_type=\"P-core\"} 300"));
+    REQUIRE(contains(text, "threveal_ipc{core_type=\"P-core\"} 1.5"));
+    REQUIRE(contains(text, "threveal_dropped_events_total{reason=\"ring_full\"} 5"));
+    REQUIRE(contains(text, "threveal_dropped_events_total{reason=\"stream_queue\"} 9"));
+    REQUIRE(contains(text, "threveal_collector_cpu_seconds_total 0.25"));
+    REQUIRE(contains(text, "threveal_scrapes_total 1"));
+    REQUIRE(contains(text, "threveal_last_scrape_duration_seconds 0.002"));
+}
@@ -0,0 +1,261 @@
+/**
+ *  @file       test_metrics_server.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the OpenMetrics HTTP responder.
+ *
+ *  The scrape benchmark is hidden; run it with the "[benchmark]" tag.
+ */
+
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+#include "threveal/transport/metrics_registry.hpp"
+#include "threveal/transport/metrics_server.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+
+#include <array>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using threveal::core::CoreType;
+using threveal::core::MigrationEvent;
+using threveal::transport::connectStream;
+using threveal::transport::MetricsRegistry;
+using threveal::transport::MetricsServer;
+using threveal::transport::MetricsServerOptions;
+using threveal::transport::StreamEndpoint;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+auto socketPath(const char* name) -> std::string
+{
+    return (fs::temp_directory_path() /
+            ("threveal_" + std::string(name) + "_" + std::to_string(getpid()) + ".sock"))
+        .string();
+}
+
+/**
+ *  Fills a registry with `processes` tgids migrating in every direction.
+ */
+void populate(MetricsRegistry& registry, std::uint32_t processes)
+{
+    constexpr std::array kTypes = {CoreType::kUnknown, CoreType::kPCore, CoreType::kECore};
+    MigrationEvent event{};
+    event.sample_weight = 1;
+    for (std::uint32_t pid = 1; pid <= processes; ++pid)
+    {
+        event.pid = pid;
+        event.tid = pid;
+        for (auto src : kTypes)
+        {
+            for (auto dst : kTypes)
+            {
+                event.src_type = src;
+                event.dst_type = dst;
+                ++event.timestamp_ns;
+                registry.recordMigration(event);
+            }
+        }
+    }
+}
+
+/**
+ *  Sends a request and polls the server until a whole response arrives,
+ *  or with `until_close` until the server closes the connection.
+ */
+auto exchange(MetricsServer& server, int fd, std::string_view request, bool until_close = false)
+    -> std::string
+{
+    if (!request.empty())
+    {
+        REQUIRE(send(fd, request.data(), request.size(), MSG_NOSIGNAL) ==
+                static_cast<ssize_t>(request.size()));
+    }
+
+    std::string response;
+    for (int i = 0; i < 500; ++i)
+    {
+        REQUIRE(server.poll(std::chrono::milliseconds(10)).has_value());
+
+        std::array<char, 64 * 1024> buffer{};
+        ssize_t received = 0;
+        while ((received = recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT)) > 0)
+        {
+            response.append(buffer.data(), static_cast<std::size_t>(received));
+        }
+        if (received == 0)
+        {
+            break;
+        }
+
+        auto head_end = response.find("\r\n\r\n");
+        auto length_pos = response.find("Content-Length: ");
+        if (!until_close && head_end != std::string::npos && length_pos != std::string::npos)
+        {
+            auto length = std::stoul(response.substr(length_pos + 16));
+            bool head = request.starts_with("HEAD");
+            if (head || response.size() >= head_end + 4 + length)
+            {
+                break;
+            }
+        }
+    }
+    return response;
+}
+
+}  // namespace
+
+TEST_CASE("MetricsServer serves metrics over a Unix socket", "[transport][MetricsServer]")
+{
+    MetricsRegistry registry;
+    populate(registry, 3);
+
+    auto path = socketPath("metrics");
+    {
+        auto server = MetricsServer::create(StreamEndpoint::unixSocket(path), registry);
+        REQUIRE(server.has_value());
+        REQUIRE(fs::exists(path));
+
+        auto client = connectStream(server->endpoint());
+        REQUIRE(client.has_value());
+
+        auto response =
+            exchange(*server, *client, "GET /metrics HTTP/1.1\r\nHost: x\r\n\r\n");
+        REQUIRE(response.starts_with("HTTP/1.1 200 OK\r\n"));
+        REQUIRE(response.find("Content-Type: application/openmetrics-text") !=
+                std::string::npos);
+        REQUIRE(response.find("threveal_migrations_total{type=\"p_to_e\",tgid=\"2\"} 1") !=
+                std::string::npos);
+        REQUIRE(response.ends_with("# EOF\n"));
+
+        // The connection stays open for the next scrape, which sees the first
+        response = exchange(*server, *client, "GET /metrics?x=1 HTTP/1.1\r\n\r\n");
+        REQUIRE(response.find("threveal_scrapes_total 1\n") != std::string::npos);
+        REQUIRE(server->scrapes() == 2);
+        REQUIRE(server->connections() == 1);
+        close(*client);
+    }
+    REQUIRE(!fs::exists(path));
+}
+
+TEST_CASE("MetricsServer answers HEAD and rejects other requests",
+          "[transport][MetricsServer]")
+{
+    MetricsRegistry registry;
+    auto server = MetricsServer::create(StreamEndpoint::tcp("127.0.0.1", 0), registry);
+    REQUIRE(server.has_value());
+    REQUIRE(server->endpoint().port != 0);
+
+    auto client = connectStream(server->endpoint());
+    REQUIRE(client.has_value());
+
+    auto response = exchange(*server, *client, "HEAD /metrics HTTP/1.1\r\n\r\n");
+    REQUIRE(response.starts_with("HTTP/1.1 200 OK\r\n"));
+    REQUIRE(response.ends_with("\r\n\r\n"));
+
+    response = exchange(*server, *client, "GET /other HTTP/1.1\r\n\r\n");
+    REQUIRE(response.starts_with("HTTP/1.1 404 Not Found\r\n"));
+
+    response = exchange(*server, *client, "DELETE /metrics HTTP/1.1\r\n\r\n");
+    REQUIRE(response.starts_with("HTTP/1.1 405 Method Not Allowed\r\n"));
+    REQUIRE(response.find("Allow: GET, HEAD\r\n") != std::string::npos);
+
+    // A malformed request line closes the connection after the response
+    response = exchange(*server, *client, "garbage\r\n\r\n");
+    REQUIRE(response.starts_with("HTTP/1.1 400 Bad Request\r\n"));
+    REQUIRE(response.find("Connection: close\r\n") != std::string::npos);
+    REQUIRE(server->connections() == 0);
+    REQUIRE(server->scrapes() == 1);
+    close(*client);
+}
+
+TEST_CASE("MetricsServer closes connections on request", "[transport][MetricsServer]")
+{
+    MetricsRegistry registry;
+    auto server = MetricsServer::create(StreamEndpoint::tcp("127.0.0.1", 0), registry);
+    REQUIRE(server.has_value());
+
+    auto client = connectStream(server->endpoint());
+    REQUIRE(client.has_value());
+
+    // Pipelined requests are answered in order, then the server closes
+    auto response = exchange(*server, *client,
+                             "GET /nope HTTP/1.1\r\n\r\n"
+                             "GET /metrics HTTP/1.0\r\n\r\n",
+                             true);
+    auto second = response.find("HTTP/1.1 200 OK\r\n");
+    REQUIRE(response.starts_with("HTTP/1.1 404 Not Found\r\n"));
+    REQUIRE(second != std::string::npos);
+    for (int i = 0; i < 50 && server->connections() > 0; ++i)
+    {
+        REQUIRE(server->poll(std::chrono::milliseconds(10)).has_value());
+    }
+    REQUIRE(server->connections() == 0);
+    close(*client);
+}
+
+TEST_CASE("MetricsServer limits request size and idle time", "[transport][MetricsServer]")
+{
+    MetricsRegistry registry;
+    MetricsServerOptions options;
+    options.idle_timeout = std::chrono::milliseconds(50);
+    auto server =
+        MetricsServer::create(StreamEndpoint::tcp("127.0.0.1", 0), registry, options);
+    REQUIRE(server.has_value());
+
+    auto oversized = connectStream(server->endpoint());
+    REQUIRE(oversized.has_value());
+    auto request = "GET /metrics HTTP/1.1\r\nX-Padding: " + std::string(9000, 'a');
+    auto response = exchange(*server, *oversized, request);
+    REQUIRE(response.starts_with("HTTP/1.1 431 "));
+    close(*oversized);
+
+    auto idle = connectStream(server->endpoint());
+    REQUIRE(idle.has_value());
+    REQUIRE(server->poll(std::chrono::milliseconds(10)).has_value());
+    REQUIRE(server->connections() == 1);
+    for (int i = 0; i < 50 && server->connections() > 0; ++i)
+    {
+        REQUIRE(server->poll(std::chrono::milliseconds(10)).has_value());
+    }
+    REQUIRE(server->connections() == 0);
+    close(*idle);
+}
+
+TEST_CASE("MetricsRegistry renders 10k series", "[.][benchmark][MetricsServer]")
+{
+    // 2000 processes in all five migration types
+    MetricsRegistry registry(2000);
+    populate(registry, 2000);
+    REQUIRE(registry.seriesCount() >= 10'000);
+
+    std::string text;
+    BENCHMARK("render 10k series")
+    {
+        text.clear();
+        registry.render(text);
+        return text.size();
+    };
+
+    auto server = MetricsServer::create(StreamEndpoint::tcp("127.0.0.1", 0), registry);
+    REQUIRE(server.has_value());
+    auto client = connectStream(server->endpoint());
+    REQUIRE(client.has_value());
+
+    BENCHMARK("scrape 10k series over TCP")
+    {
+        return exchange(*server, *client, "GET /metrics HTTP/1.1\r\n\r\n").size();
+    };
+    close(*client);
+}
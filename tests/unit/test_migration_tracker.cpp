@@ -20,6 +20,7 @@
 #include <vector>
 
 using threveal::collection::EbpfError;
+using threveal::collection::EbpfLoaderOptions;
 using threveal::collection::MigrationCallback;
 using threveal::collection::MigrationTracker;
 using threveal::core::MigrationEvent;
@@ -221,3 +222,38 @@ TEST_CASE("MigrationTracker poll returns without error", "[collection][Migration
 
     tracker->stop();
 }
+
+TEST_CASE("MigrationTracker merges sharded rings in order", "[collection][MigrationTracker]")
+{
+    if (!hasEbpfPrivileges())
+    {
+        SKIP("eBPF operations require root privileges");
+    }
+
+    EventCollector collector;
+    auto tracker = MigrationTracker::create(
+        [&collector](const MigrationEvent& event)
+        {
+            collector.addEvent(event);
+        },
+        EbpfLoaderOptions{.ring_shards = 4});
+    REQUIRE(tracker.has_value());
+    REQUIRE(tracker->start().has_value());
+
+    for (int i = 0; i < 10; ++i)
+    {
+        REQUIRE(tracker->poll(std::chrono::milliseconds(10)) >= 0);
+    }
+    tracker->stop();
+    REQUIRE(tracker->flush() >= 0);
+
+    auto events = collector.events();
+    for (std::size_t i = 1; i < events.size(); ++i)
+    {
+        REQUIRE(events[i - 1].timestamp_ns <= events[i].timestamp_ns);
+    }
+
+    auto drops = tracker->ringDrops();
+    REQUIRE(drops.has_value());
+    REQUIRE(drops->size() == 4);
+}
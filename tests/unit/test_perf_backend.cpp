@@ -0,0 +1,179 @@
+/**
+ *  @file       test_perf_backend.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the perf_event backends.
+ */
+
+#include "threveal/collection/fake_perf_backend.hpp"
+#include "threveal/collection/perf_backend.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+using threveal::collection::FakePerfBackend;
+using threveal::collection::FakePerfBackendOptions;
+using threveal::collection::kFakeECoreModel;
+using threveal::collection::kFakePCoreModel;
+using threveal::collection::PerfControl;
+using threveal::collection::PmuEventType;
+using threveal::collection::systemPerfBackend;
+using threveal::core::CpuId;
+using threveal::core::PmuError;
+using threveal::core::TopologyMap;
+
+namespace
+{
+
+auto makeTopology() -> TopologyMap
+{
+    std::vector<CpuId> p_cores = {0, 1};
+    std::vector<CpuId> e_cores = {2, 3};
+    return TopologyMap{p_cores, e_cores};
+}
+
+constexpr auto kMillisecond = std::chrono::milliseconds(1);
+
+}  // namespace
+
+TEST_CASE("FakePmuModel derives every event from time", "[collection][FakePerfBackend]")
+{
+    // 1 ms at 4 GHz with IPC 2.0
+    REQUIRE(kFakePCoreModel.count(PmuEventType::kCycles, kMillisecond) == 4'000'000);
+    REQUIRE(kFakePCoreModel.count(PmuEventType::kInstructions, kMillisecond) == 8'000'000);
+    REQUIRE(kFakePCoreModel.count(PmuEventType::kLlcLoads, kMillisecond) == 160'000);
+    REQUIRE(kFakePCoreModel.count(PmuEventType::kLlcLoadMisses, kMillisecond) == 40'000);
+    REQUIRE(kFakePCoreModel.count(PmuEventType::kBranchMisses, kMillisecond) == 40'000);
+    REQUIRE(kFakeECoreModel.count(PmuEventType::kCycles, kMillisecond) == 3'000'000);
+    REQUIRE(kFakeECoreModel.count(PmuEventType::kInstructions, kMillisecond) == 3'600'000);
+}
+
+TEST_CASE("FakePerfBackend counts only while enabled", "[collection][FakePerfBackend]")
+{
+    FakePerfBackend backend(makeTopology());
+    auto fd = backend.open(PmuEventType::kCycles, 0, -1, -1, false);
+    REQUIRE(fd.has_value());
+
+    std::array<std::uint64_t, 1> value{};
+    backend.advance(kMillisecond);
+    REQUIRE(backend.read(*fd, value) == 1);
+    REQUIRE(value[0] == 0);
+
+    REQUIRE(backend.control(*fd, PerfControl::kEnable, false).has_value());
+    backend.advance(kMillisecond);
+    REQUIRE(backend.control(*fd, PerfControl::kDisable, false).has_value());
+    backend.advance(kMillisecond);
+    REQUIRE(backend.read(*fd, value) == 1);
+    REQUIRE(value[0] == 4'000'000);
+
+    REQUIRE(backend.control(*fd, PerfControl::kReset, false).has_value());
+    REQUIRE(backend.read(*fd, value) == 1);
+    REQUIRE(value[0] == 0);
+    REQUIRE(backend.now() == 3 * kMillisecond);
+
+    backend.close(*fd);
+    REQUIRE(backend.openHandles() == 0);
+    REQUIRE(backend.read(*fd, value).error() == PmuError::kReadFailed);
+}
+
+TEST_CASE("FakePerfBackend applies the model of the thread's core type",
+          "[collection][FakePerfBackend]")
+{
+    FakePerfBackend backend(makeTopology());
+    auto fd = backend.open(PmuEventType::kInstructions, 42, -1, -1, false);
+    REQUIRE(fd.has_value());
+    REQUIRE(backend.control(*fd, PerfControl::kEnable, false).has_value());
+    REQUIRE(backend.currentCpu(42) == 0);
+
+    backend.advance(kMillisecond);
+    backend.setCpu(42, 3);
+    REQUIRE(backend.currentCpu(42) == 3);
+    backend.advance(kMillisecond);
+
+    // Outside the topology nothing is counted
+    backend.setCpu(42, 9);
+    backend.advance(kMillisecond);
+
+    std::array<std::uint64_t, 1> value{};
+    REQUIRE(backend.read(*fd, value) == 1);
+    REQUIRE(value[0] == 8'000'000 + 3'600'000);
+}
+
+TEST_CASE("FakePerfBackend reads groups in join order", "[collection][FakePerfBackend]")
+{
+    FakePerfBackend backend(makeTopology());
+    auto leader = backend.open(PmuEventType::kCycles, 0, 2, -1, true);
+    REQUIRE(leader.has_value());
+    auto misses = backend.open(PmuEventType::kBranchMisses, 0, 2, *leader, false);
+    auto instructions = backend.open(PmuEventType::kInstructions, 0, 2, *leader, false);
+    REQUIRE(misses.has_value());
+    REQUIRE(instructions.has_value());
+
+    // Members follow the leader
+    REQUIRE(backend.control(*leader, PerfControl::kEnable, false).has_value());
+    backend.advance(kMillisecond);
+
+    std::array<std::uint64_t, 4> values{};
+    REQUIRE(backend.read(*leader, values) == 3);
+    REQUIRE(values[0] == 3'000'000);
+    REQUIRE(values[1] == 28'800);
+    REQUIRE(values[2] == 3'600'000);
+
+    std::array<std::uint64_t, 2> too_small{};
+    REQUIRE(backend.read(*leader, too_small).error() == PmuError::kReadFailed);
+
+    REQUIRE(backend.control(*leader, PerfControl::kReset, true).has_value());
+    REQUIRE(backend.read(*leader, values) == 3);
+    REQUIRE(values[0] == 0);
+    REQUIRE(values[2] == 0);
+
+    // Members cannot lead, and groups are bounded
+    REQUIRE(backend.open(PmuEventType::kCycles, 0, 2, *misses, false).error() ==
+            PmuError::kInvalidTarget);
+    for (int i = 0; i < 5; ++i)
+    {
+        REQUIRE(backend.open(PmuEventType::kCycles, 0, 2, *leader, false).has_value());
+    }
+    REQUIRE(backend.open(PmuEventType::kCycles, 0, 2, *leader, false).error() ==
+            PmuError::kTooManyEvents);
+}
+
+TEST_CASE("FakePerfBackend injects open errors and advances on read",
+          "[collection][FakePerfBackend]")
+{
+    FakePerfBackendOptions options;
+    options.read_advance = kMillisecond;
+    FakePerfBackend backend(makeTopology(), options);
+
+    backend.setOpenError(PmuError::kPermissionDenied);
+    REQUIRE(backend.open(PmuEventType::kCycles, 0, -1, -1, false).error() ==
+            PmuError::kPermissionDenied);
+    backend.setOpenError(std::nullopt);
+
+    auto fd = backend.open(PmuEventType::kCycles, 0, -1, -1, false);
+    REQUIRE(fd.has_value());
+    REQUIRE(backend.control(*fd, PerfControl::kEnable, false).has_value());
+
+    std::array<std::uint64_t, 1> value{};
+    REQUIRE(backend.read(*fd, value) == 1);
+    REQUIRE(value[0] == 4'000'000);
+    REQUIRE(backend.read(*fd, value) == 1);
+    REQUIRE(value[0] == 8'000'000);
+    REQUIRE(backend.control(-1, PerfControl::kEnable, false).error() == PmuError::kInvalidState);
+}
+
+TEST_CASE("System backend rejects invalid handles", "[collection][PerfBackend]")
+{
+    auto& backend = systemPerfBackend();
+    REQUIRE(&backend == &systemPerfBackend());
+
+    std::array<std::uint64_t, 1> value{};
+    REQUIRE(backend.read(-1, value).error() == PmuError::kReadFailed);
+    REQUIRE(backend.control(-1, PerfControl::kReset, false).error() == PmuError::kInvalidState);
+}
@@ -0,0 +1,437 @@
+/**
+ *  @file       test_perf_tracepoint_source.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the perf tracepoint migration source.
+ *
+ *  The ring and decoding tests run on rings in heap memory; only the live
+ *  capture test opens the tracepoint, and it is skipped without
+ *  CAP_PERFMON. The consumer throughput benchmark against the BPF ring
+ *  buffer path is hidden; run it with the "[benchmark]" tag.
+ */
+
+#include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/collection/perf_tracepoint_source.hpp"
+#include "threveal/collection/record_decoder.hpp"
+#include "threveal/collection/ringbuf_emulator.hpp"
+#include "threveal/core/events.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using threveal::collection::decodeMigrateSample;
+using threveal::collection::EbpfError;
+using threveal::collection::MigrateTracepointFormat;
+using threveal::collection::parseMigrateTracepointFormat;
+using threveal::collection::PerfRingReader;
+using threveal::collection::PerfTracepointOptions;
+using threveal::collection::PerfTracepointSource;
+using threveal::collection::produceMigrations;
+using threveal::collection::RecordDecoder;
+using threveal::collection::RingbufEmulator;
+using threveal::collection::RingbufEmulatorOptions;
+using threveal::collection::RingbufProducerOptions;
+using threveal::core::MigrationEvent;
+
+namespace
+{
+
+constexpr std::size_t kPage = 4096;
+
+/**
+ *  The format file of a 6.x x86-64 kernel.
+ */
+constexpr std::string_view kFormat =
+    "name: sched_migrate_task\n"
+    "ID: 318\n"
+    "format:\n"
+    "\tfield:unsigned short common_type;\toffset:0;\tsize:2;\tsigned:0;\n"
+    "\tfield:unsigned char common_flags;\toffset:2;\tsize:1;\tsigned:0;\n"
+    "\tfield:unsigned char common_preempt_count;\toffset:3;\tsize:1;\tsigned:0;\n"
+    "\tfield:int common_pid;\toffset:4;\tsize:4;\tsigned:1;\n"
+    "\n"
+    "\tfield:char comm[16];\toffset:8;\tsize:16;\tsigned:0;\n"
+    "\tfield:pid_t pid;\toffset:24;\tsize:4;\tsigned:1;\n"
+    "\tfield:int prio;\toffset:28;\tsize:4;\tsigned:1;\n"
+    "\tfield:int orig_cpu;\toffset:32;\tsize:4;\tsigned:1;\n"
+    "\tfield:int dest_cpu;\toffset:36;\tsize:4;\tsigned:1;\n"
+    "\n"
+    "print fmt: \"comm=%s pid=%d prio=%d orig_cpu=%d dest_cpu=%d\"\n";
+
+constexpr std::size_t kRawBytes = 40;
+
+auto format() -> MigrateTracepointFormat
+{
+    auto parsed = parseMigrateTracepointFormat(kFormat);
+    REQUIRE(parsed.has_value());
+    return *parsed;
+}
+
+template <typename T>
+void storeAt(std::vector<std::byte>& data, std::size_t offset, T value)
+{
+    std::memcpy(data.data() + offset, &value, sizeof(value));
+}
+
+/**
+ *  Builds a sample as the kernel writes it for TIME | CPU | RAW.
+ */
+auto makeSample(std::uint64_t timestamp_ns, std::int32_t tid, std::int32_t src,
+                std::int32_t dst, std::string_view comm = "worker") -> std::vector<std::byte>
+{
+    // header, time, cpu + reserved, raw size, raw, padded to 8 bytes
+    constexpr std::size_t kRawOffset = 28;
+    constexpr std::size_t kSize = (kRawOffset + kRawBytes + 7) & ~std::size_t{7};
+
+    std::vector<std::byte> sample(kSize);
+    perf_event_header header{};
+    header.type = PERF_RECORD_SAMPLE;
+    header.size = kSize;
+    storeAt(sample, 0, header);
+    storeAt(sample, 8, timestamp_ns);
+    storeAt(sample, 16, static_cast<std::uint32_t>(dst));
+    storeAt(sample, 24, static_cast<std::uint32_t>(kRawBytes));
+
+    std::memcpy(sample.data() + kRawOffset + 8, comm.data(), comm.size());
+    storeAt(sample, kRawOffset + 24, tid);
+    storeAt(sample, kRawOffset + 28, std::int32_t{120});
+    storeAt(sample, kRawOffset + 32, src);
+    storeAt(sample, kRawOffset + 36, dst);
+    return sample;
+}
+
+/**
+ *  A perf mmap ring in heap memory, written the way the kernel does.
+ */
+class FakePerfRing
+{
+  public:
+    explicit FakePerfRing(std::size_t data_bytes)
+        : memory_((kPage + data_bytes) / sizeof(std::uint64_t)), data_bytes_(data_bytes)
+    {
+    }
+
+    auto reader() -> PerfRingReader
+    {
+        return PerfRingReader{memory_.data(), kPage, data_bytes_};
+    }
+
+    /**
+     *  Appends a record, wrapping at the end; false if it does not fit.
+     */
+    auto write(std::span<const std::byte> record) -> bool
+    {
+        auto* meta = this->meta();
+        auto head = meta->data_head;
+        auto tail = std::atomic_ref{meta->data_tail}.load(std::memory_order_acquire);
+        if (record.size() > data_bytes_ - (head - tail))
+        {
+            return false;
+        }
+
+        auto* data = static_cast<std::byte*>(static_cast<void*>(memory_.data())) + kPage;
+        auto offset = static_cast<std::size_t>(head & (data_bytes_ - 1));
+        auto first = std::min(record.size(), data_bytes_ - offset);
+        std::memcpy(data + offset, record.data(), first);
+        std::memcpy(data, record.data() + first, record.size() - first);
+
+        std::atomic_ref{meta->data_head}.store(head + record.size(), std::memory_order_release);
+        return true;
+    }
+
+    auto meta() -> perf_event_mmap_page*
+    {
+        return static_cast<perf_event_mmap_page*>(static_cast<void*>(memory_.data()));
+    }
+
+  private:
+    std::vector<std::uint64_t> memory_;
+    std::size_t data_bytes_;
+};
+
+}  // namespace
+
+TEST_CASE("parseMigrateTracepointFormat reads the field layout", "[collection][PerfTracepoint]")
+{
+    auto parsed = format();
+    REQUIRE(parsed.id == 318);
+    REQUIRE(parsed.comm.offset == 8);
+    REQUIRE(parsed.comm.size == 16);
+    REQUIRE(parsed.tid.offset == 24);
+    REQUIRE(parsed.orig_cpu.offset == 32);
+    REQUIRE(parsed.dest_cpu.offset == 36);
+}
+
+TEST_CASE("parseMigrateTracepointFormat rejects unusable formats", "[collection][PerfTracepoint]")
+{
+    auto text = std::string{kFormat};
+
+    SECTION("Missing field")
+    {
+        text.erase(text.find("\tfield:int dest_cpu"));
+        REQUIRE_FALSE(parseMigrateTracepointFormat(text).has_value());
+    }
+
+    SECTION("Unexpected size")
+    {
+        auto pos = text.find("offset:24;\tsize:4");
+        text.replace(pos, 17, "offset:24;\tsize:8");
+        REQUIRE_FALSE(parseMigrateTracepointFormat(text).has_value());
+    }
+
+    SECTION("Missing ID")
+    {
+        text.erase(text.find("ID:"), 8);
+        REQUIRE_FALSE(parseMigrateTracepointFormat(text).has_value());
+    }
+}
+
+TEST_CASE("decodeMigrateSample decodes samples", "[collection][PerfTracepoint]")
+{
+    auto layout = format();
+
+    SECTION("A sample")
+    {
+        auto event = decodeMigrateSample(makeSample(5000, 42, 1, 6, "thread-name-full"), layout);
+        REQUIRE(event.has_value());
+        REQUIRE(event->timestamp_ns == 5000);
+        REQUIRE(event->tid == 42);
+        REQUIRE(event->pid == 0);
+        REQUIRE(event->src_cpu == 1);
+        REQUIRE(event->dst_cpu == 6);
+        REQUIRE(event->sample_weight == 1);
+        REQUIRE(event->commAsStringView() == "thread-name-ful");
+    }
+
+    SECTION("Other records are ignored")
+    {
+        auto sample = makeSample(5000, 42, 1, 6);
+        perf_event_header header{};
+        header.type = PERF_RECORD_LOST;
+        header.size = static_cast<std::uint16_t>(sample.size());
+        storeAt(sample, 0, header);
+        REQUIRE_FALSE(decodeMigrateSample(sample, layout).has_value());
+    }
+
+    SECTION("Truncated records are rejected")
+    {
+        auto sample = makeSample(5000, 42, 1, 6);
+        sample.resize(40);
+        REQUIRE_FALSE(decodeMigrateSample(sample, layout).has_value());
+
+        auto short_raw = makeSample(5000, 42, 1, 6);
+        storeAt(short_raw, 24, std::uint32_t{30});
+        REQUIRE_FALSE(decodeMigrateSample(short_raw, layout).has_value());
+    }
+}
+
+TEST_CASE("PerfRingReader reads records across the wrap", "[collection][PerfTracepoint]")
+{
+    auto layout = format();
+    FakePerfRing ring(kPage);
+    auto reader = ring.reader();
+    REQUIRE(reader.capacity() == kPage);
+
+    std::vector<MigrationEvent> events;
+    auto on_record = [&](std::span<const std::byte> record)
+    {
+        auto event = decodeMigrateSample(record, layout);
+        REQUIRE(event.has_value());
+        events.push_back(*event);
+    };
+
+    // 72-byte samples do not divide the page, so later ones straddle the end
+    std::uint64_t written = 0;
+    for (std::uint64_t round = 0; round < 4; ++round)
+    {
+        while (ring.write(makeSample(written, static_cast<std::int32_t>(written), 0, 1)))
+        {
+            ++written;
+        }
+        REQUIRE(reader.availableBytes() > kPage - 72);
+        reader.read(on_record);
+        REQUIRE(reader.availableBytes() == 0);
+        REQUIRE(ring.meta()->data_tail == ring.meta()->data_head);
+    }
+
+    REQUIRE(events.size() == written);
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+        REQUIRE(events[i].timestamp_ns == i);
+        REQUIRE(events[i].tid == i);
+    }
+}
+
+TEST_CASE("PerfRingReader limits the batch size", "[collection][PerfTracepoint]")
+{
+    FakePerfRing ring(kPage);
+    auto reader = ring.reader();
+    for (int i = 0; i < 5; ++i)
+    {
+        REQUIRE(ring.write(makeSample(0, i, 0, 1)));
+    }
+
+    std::size_t seen = 0;
+    auto count = [&seen](std::span<const std::byte>)
+    {
+        ++seen;
+    };
+    REQUIRE(reader.read(count, 3) == 3);
+    REQUIRE(reader.read(count) == 2);
+    REQUIRE(seen == 5);
+    REQUIRE(PerfRingReader{}.read(count) == 0);
+}
+
+TEST_CASE("PerfTracepointSource creation errors", "[collection][PerfTracepoint]")
+{
+    auto discard = [](const MigrationEvent&) {};
+
+    SECTION("Without a callback")
+    {
+        auto source = PerfTracepointSource::create({});
+        REQUIRE_FALSE(source.has_value());
+        REQUIRE(source.error() == EbpfError::kInvalidState);
+    }
+
+    SECTION("Without the tracepoint")
+    {
+        PerfTracepointOptions options;
+        options.tracefs_root = "/nonexistent/tracing";
+        auto source = PerfTracepointSource::create(discard, options);
+        REQUIRE_FALSE(source.has_value());
+        REQUIRE(source.error() == EbpfError::kOpenFailed);
+    }
+}
+
+TEST_CASE("PerfTracepointSource captures migrations", "[collection][PerfTracepoint]")
+{
+    std::vector<MigrationEvent> events;
+    auto source = PerfTracepointSource::create(
+        [&events](const MigrationEvent& event)
+        {
+            events.push_back(event);
+        });
+    if (!source)
+    {
+        SKIP("perf tracepoint not available: " << toString(source.error()));
+    }
+
+    REQUIRE(source->cpuCount() > 0);
+    REQUIRE(source->start().has_value());
+    REQUIRE(source->isRunning());
+
+    // Hop across CPUs so there is something to capture
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{100};
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::yield();
+        (void)source->poll(std::chrono::milliseconds{0});
+    }
+
+    source->stop();
+    REQUIRE(source->flush() >= 0);
+    REQUIRE_FALSE(source->isRunning());
+    REQUIRE(source->eventCount() == events.size());
+    for (std::size_t i = 1; i < events.size(); ++i)
+    {
+        REQUIRE(events[i - 1].timestamp_ns <= events[i].timestamp_ns);
+    }
+}
+
+TEST_CASE("Perf tracepoint consumer throughput", "[.][benchmark][PerfTracepoint]")
+{
+    // 1M migrations from one producer through each path, decoded and
+    // counted; a perf sample is 72 bytes, a ring buffer record 32
+    constexpr std::uint64_t kEvents = 1'000'000;
+    constexpr std::size_t kRingBytes = 16 * 1024 * 1024;
+
+    BENCHMARK("perf mmap ring")
+    {
+        auto layout = format();
+        FakePerfRing ring(kRingBytes);
+        auto reader = ring.reader();
+        std::uint64_t decoded = 0;
+        auto on_record = [&](std::span<const std::byte> record)
+        {
+            if (decodeMigrateSample(record, layout))
+            {
+                ++decoded;
+            }
+        };
+
+        std::atomic<bool> done{false};
+        std::jthread producer(
+            [&]
+            {
+                auto sample = makeSample(0, 1001, 0, 1);
+                for (std::uint64_t i = 0; i < kEvents; ++i)
+                {
+                    storeAt(sample, 8, i);
+                    while (!ring.write(sample))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                done.store(true, std::memory_order_release);
+            });
+        while (!done.load(std::memory_order_acquire))
+        {
+            if (reader.read(on_record) == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        reader.read(on_record);
+        return decoded;
+    };
+
+    BENCHMARK("BPF ring buffer")
+    {
+        RingbufEmulatorOptions ring_options;
+        ring_options.data_bytes = kRingBytes;
+        auto ring = RingbufEmulator::create(ring_options);
+        REQUIRE(ring.has_value());
+
+        RecordDecoder decoder;
+        std::uint64_t decoded = 0;
+        auto on_record = [&](std::span<const std::byte> data)
+        {
+            if (decoder.decode(data))
+            {
+                ++decoded;
+            }
+            return 0;
+        };
+
+        RingbufProducerOptions options;
+        options.events_per_thread = kEvents;
+        std::atomic<bool> done{false};
+        std::jthread producer(
+            [&]
+            {
+                (void)produceMigrations(*ring, options);
+                done.store(true, std::memory_order_release);
+            });
+        while (!done.load(std::memory_order_acquire))
+        {
+            if (ring->consume(on_record) == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        ring->consume(on_record);
+        return decoded;
+    };
+}
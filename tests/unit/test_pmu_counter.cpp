@@ -8,18 +8,25 @@
  *  Tests that require privileges will be skipped if permissions are insufficient.
  */
 
+#include "threveal/collection/fake_perf_backend.hpp"
 #include "threveal/collection/pmu_counter.hpp"
 #include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
 
 #include <catch2/catch_test_macros.hpp>
+#include <chrono>
 #include <cstdint>
 #include <fstream>
 #include <utility>
+#include <vector>
 
+using threveal::collection::FakePerfBackend;
 using threveal::collection::PmuCounter;
 using threveal::collection::PmuEventType;
 using threveal::collection::toString;
+using threveal::core::CpuId;
 using threveal::core::PmuError;
+using threveal::core::TopologyMap;
 
 namespace
 {
@@ -264,3 +271,41 @@ TEST_CASE("PmuCounter operations on invalid counter fail", "[collection][PmuCoun
         REQUIRE(result.error() == PmuError::kInvalidState);
     }
 }
+
+TEST_CASE("PmuCounter counts deterministically on the fake backend", "[collection][PmuCounter]")
+{
+    std::vector<CpuId> p_cores = {0};
+    std::vector<CpuId> e_cores = {1};
+    FakePerfBackend backend(TopologyMap{p_cores, e_cores});
+
+    auto counter = PmuCounter::create(PmuEventType::kInstructions, 0, -1, backend);
+    REQUIRE(counter.has_value());
+    REQUIRE(counter->read() == 0);
+
+    REQUIRE(counter->enable().has_value());
+    backend.advance(std::chrono::microseconds(10));
+    backend.setCpu(0, 1);
+    backend.advance(std::chrono::microseconds(10));
+    REQUIRE(counter->disable().has_value());
+    backend.advance(std::chrono::microseconds(10));
+
+    // 10 us at 4 GHz with IPC 2.0, then 10 us at 3 GHz with IPC 1.2
+    REQUIRE(counter->read() == 80'000 + 36'000);
+    REQUIRE(counter->reset().has_value());
+    REQUIRE(counter->read() == 0);
+
+    PmuCounter moved = std::move(*counter);
+    REQUIRE(backend.openHandles() == 1);
+    moved = std::move(*PmuCounter::create(PmuEventType::kCycles, 0, -1, backend));
+    REQUIRE(backend.openHandles() == 1);
+}
+
+TEST_CASE("PmuCounter reports backend open errors", "[collection][PmuCounter]")
+{
+    FakePerfBackend backend(TopologyMap{});
+    backend.setOpenError(PmuError::kEventNotSupported);
+
+    auto counter = PmuCounter::create(PmuEventType::kLlcLoads, 0, -1, backend);
+    REQUIRE_FALSE(counter.has_value());
+    REQUIRE(counter.error() == PmuError::kEventNotSupported);
+}
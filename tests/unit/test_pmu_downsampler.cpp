@@ -0,0 +1,273 @@
+/**
+ *  @file       test_pmu_downsampler.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for PMU sample downsampling.
+ *
+ *  The ingest benchmark is hidden; run it with the "[benchmark]" tag.
+ */
+
+#include "threveal/analysis/pmu_downsampler.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using threveal::analysis::PmuDownsampler;
+using threveal::analysis::PmuDownsampling;
+using threveal::analysis::PmuDownsamplingMode;
+using threveal::analysis::toString;
+using threveal::core::CpuId;
+using threveal::core::PmuSample;
+
+namespace
+{
+
+constexpr std::uint64_t kMs = 1'000'000;
+
+/**
+ *  A sample at a millisecond offset; the counters tell samples apart.
+ */
+auto makeSample(std::uint64_t ms, std::uint32_t tid, CpuId cpu = 0) -> PmuSample
+{
+    return PmuSample{
+        .timestamp_ns = ms * kMs,
+        .tid = tid,
+        .cpu_id = cpu,
+        .instructions = 2000 + (ms % 13),
+        .cycles = 1000 + (ms % 7),
+        .llc_misses = 10,
+        .llc_references = 100,
+        .branch_misses = 5,
+    };
+}
+
+auto reservoirPolicy(std::size_t size) -> PmuDownsampling
+{
+    PmuDownsampling policy;
+    policy.mode = PmuDownsamplingMode::kReservoir;
+    policy.migration_window = std::chrono::milliseconds(5);
+    policy.settle_time = std::chrono::milliseconds(20);
+    policy.reservoir_size = size;
+    return policy;
+}
+
+auto countIn(const std::vector<PmuSample>& samples, std::uint64_t from_ms, std::uint64_t to_ms)
+    -> std::size_t
+{
+    return static_cast<std::size_t>(std::ranges::count_if(samples,
+                                                          [&](const PmuSample& sample)
+                                                          {
+                                                              return sample.timestamp_ns >=
+                                                                         from_ms * kMs &&
+                                                                     sample.timestamp_ns <=
+                                                                         to_ms * kMs;
+                                                          }));
+}
+
+auto isSorted(const std::vector<PmuSample>& samples) -> bool
+{
+    return std::ranges::is_sorted(samples, {}, &PmuSample::timestamp_ns);
+}
+
+}  // namespace
+
+TEST_CASE("PmuDownsamplingMode toString", "[analysis][PmuDownsampler]")
+{
+    REQUIRE(toString(PmuDownsamplingMode::kReservoir) == "reservoir");
+    REQUIRE(toString(PmuDownsamplingMode::kRollup) == "rollup");
+}
+
+TEST_CASE("PmuDownsampler keeps a reservoir per thread", "[analysis][PmuDownsampler]")
+{
+    PmuDownsampler downsampler(reservoirPolicy(100));
+    std::vector<PmuSample> samples;
+
+    for (std::uint64_t ms = 0; ms < 10000; ++ms)
+    {
+        downsampler.addSample(makeSample(ms, 1));
+        downsampler.addSample(makeSample(ms, 2));
+        if (downsampler.pendingChanges() > 500)
+        {
+            downsampler.apply(samples);
+        }
+    }
+    downsampler.settle();
+    downsampler.apply(samples);
+
+    REQUIRE(samples.size() == 200);
+    REQUIRE(std::ranges::count(samples, 1u, &PmuSample::tid) == 100);
+    REQUIRE(isSorted(samples));
+    REQUIRE(downsampler.downsampledCount() == 20000 - 200);
+
+    // Uniform over the run, not just its start
+    REQUIRE(countIn(samples, 0, 4999) > 60);
+    REQUIRE(countIn(samples, 5000, 9999) > 60);
+}
+
+TEST_CASE("PmuDownsampler keeps samples around migrations", "[analysis][PmuDownsampler]")
+{
+    PmuDownsampler downsampler(reservoirPolicy(10));
+    std::vector<PmuSample> samples;
+
+    for (std::uint64_t ms = 0; ms < 5000; ++ms)
+    {
+        downsampler.addSample(makeSample(ms, 1));
+
+        // Migrations arrive a little after the samples around them
+        if (ms == 1010 || ms == 3010)
+        {
+            downsampler.addMigration(1, (ms - 10) * kMs);
+        }
+    }
+    downsampler.settle();
+    downsampler.apply(samples);
+
+    // Both windows of 11 samples, plus the reservoir
+    REQUIRE(countIn(samples, 995, 1005) == 11);
+    REQUIRE(countIn(samples, 2995, 3005) == 11);
+    REQUIRE(samples.size() == 22 + 10);
+    REQUIRE(isSorted(samples));
+}
+
+TEST_CASE("PmuDownsampler rolls up old samples", "[analysis][PmuDownsampler]")
+{
+    PmuDownsampling policy;
+    policy.mode = PmuDownsamplingMode::kRollup;
+    policy.migration_window = std::chrono::milliseconds(5);
+    policy.settle_time = std::chrono::milliseconds(20);
+    policy.rollup = {
+        {std::chrono::milliseconds(100), std::chrono::milliseconds(10)},
+        {std::chrono::milliseconds(1000), std::chrono::milliseconds(100)},
+    };
+    PmuDownsampler downsampler(policy);
+    std::vector<PmuSample> samples;
+
+    std::uint64_t cycles[2] = {0, 0};
+    std::uint64_t instructions = 0;
+    for (std::uint64_t ms = 0; ms < 5000; ++ms)
+    {
+        // The thread changes cores every 1.5 s
+        auto sample = makeSample(ms, 1, (ms / 1500) % 2 == 0 ? 0 : 4);
+        cycles[sample.cpu_id == 0 ? 0 : 1] += sample.cycles;
+        instructions += sample.instructions;
+        downsampler.addSample(sample);
+        downsampler.apply(samples);
+
+        // Never a sample and the bucket it went into
+        std::uint64_t stored = 0;
+        for (const auto& stored_sample : samples)
+        {
+            stored += stored_sample.cycles;
+        }
+        REQUIRE(stored <= cycles[0] + cycles[1]);
+    }
+    downsampler.settle();
+    downsampler.apply(samples);
+
+    SECTION("Counters are summed, per core")
+    {
+        std::uint64_t stored[2] = {0, 0};
+        std::uint64_t stored_instructions = 0;
+        for (const auto& sample : samples)
+        {
+            stored[sample.cpu_id == 0 ? 0 : 1] += sample.cycles;
+            stored_instructions += sample.instructions;
+        }
+        REQUIRE(stored[0] == cycles[0]);
+        REQUIRE(stored[1] == cycles[1]);
+        REQUIRE(stored_instructions == instructions);
+        REQUIRE(isSorted(samples));
+    }
+
+    SECTION("Resolution drops with age")
+    {
+        // 1 ms samples for the last 100 ms, 10 ms buckets until 1 s, 100 ms after
+        REQUIRE(countIn(samples, 4900, 4999) >= 90);
+        REQUIRE(countIn(samples, 4100, 4799) <= 80);
+        REQUIRE(countIn(samples, 0, 3799) <= 40);
+        REQUIRE(samples.size() + downsampler.downsampledCount() == 5000);
+    }
+
+    SECTION("An exited thread's buckets are closed")
+    {
+        downsampler.endThread(1);
+        downsampler.apply(samples);
+        REQUIRE(samples.size() < 60);
+        REQUIRE(samples.size() + downsampler.downsampledCount() == 5000);
+    }
+}
+
+TEST_CASE("PmuDownsampler holds samples until they settle", "[analysis][PmuDownsampler]")
+{
+    PmuDownsampler downsampler(reservoirPolicy(100));
+    std::vector<PmuSample> samples;
+
+    for (std::uint64_t ms = 0; ms < 50; ++ms)
+    {
+        downsampler.addSample(makeSample(ms, 1));
+    }
+    downsampler.apply(samples);
+
+    // Samples in the last 20 ms may still get a migration
+    REQUIRE(samples.size() == 30);
+
+    downsampler.addMigration(1, 45 * kMs);
+    downsampler.settle();
+    downsampler.apply(samples);
+    REQUIRE(samples.size() == 50);
+
+    downsampler.clear();
+    REQUIRE(downsampler.pendingChanges() == 0);
+    REQUIRE(downsampler.downsampledCount() == 0);
+}
+
+TEST_CASE("PmuDownsampler ingest cost", "[.][benchmark][PmuDownsampler]")
+{
+    // 100 threads sampled every millisecond for 100 s
+    constexpr std::uint32_t kThreads = 100;
+    constexpr std::uint64_t kSteps = 100'000;
+
+    auto ingest = [](PmuDownsampling policy)
+    {
+        PmuDownsampler downsampler(policy);
+        std::vector<PmuSample> samples;
+        for (std::uint64_t ms = 0; ms < kSteps; ++ms)
+        {
+            for (std::uint32_t tid = 1; tid <= kThreads; ++tid)
+            {
+                downsampler.addSample(makeSample(ms, tid));
+            }
+            if (downsampler.pendingChanges() >= std::max<std::size_t>(4096, samples.size() / 8))
+            {
+                downsampler.apply(samples);
+            }
+        }
+        downsampler.settle();
+        downsampler.apply(samples);
+        return samples.size();
+    };
+
+    BENCHMARK("10M samples into 1000-sample reservoirs")
+    {
+        return ingest(reservoirPolicy(1000));
+    };
+
+    PmuDownsampling rollup;
+    rollup.mode = PmuDownsamplingMode::kRollup;
+    rollup.rollup = {
+        {std::chrono::seconds(1), std::chrono::milliseconds(100)},
+        {std::chrono::seconds(10), std::chrono::seconds(1)},
+    };
+
+    BENCHMARK("10M samples rolled up")
+    {
+        return ingest(rollup);
+    };
+}
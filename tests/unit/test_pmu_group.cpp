@@ -8,20 +8,28 @@
  *  Tests that require privileges will be skipped if permissions are insufficient.
  */
 
+#include "threveal/collection/fake_perf_backend.hpp"
 #include "threveal/collection/pmu_group.hpp"
 #include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
 
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <chrono>
 #include <cstdint>
 #include <fstream>
 #include <utility>
+#include <vector>
 
 using Catch::Matchers::WithinRel;
+using threveal::collection::FakePerfBackend;
 using threveal::collection::PmuGroup;
 using threveal::collection::PmuGroupReading;
+using threveal::core::CpuId;
 using threveal::core::PmuError;
+using threveal::core::TopologyMap;
 
 namespace
 {
@@ -272,3 +280,72 @@ TEST_CASE("PmuGroup operations on invalid group fail", "[collection][PmuGroup]")
         REQUIRE(result.error() == PmuError::kInvalidState);
     }
 }
+
+TEST_CASE("PmuGroup reads the fake PMU model", "[collection][PmuGroup]")
+{
+    std::vector<CpuId> p_cores = {0};
+    std::vector<CpuId> e_cores = {1};
+    FakePerfBackend backend(TopologyMap{p_cores, e_cores});
+
+    auto group = PmuGroup::create(0, -1, backend);
+    REQUIRE(group.has_value());
+    REQUIRE(backend.openHandles() == PmuGroup::kCounterCount);
+
+    REQUIRE(group->reset().has_value());
+    REQUIRE(group->enable().has_value());
+    backend.advance(std::chrono::milliseconds(1));
+    REQUIRE(group->disable().has_value());
+
+    auto reading = group->read();
+    REQUIRE(reading.has_value());
+    REQUIRE(reading->cycles == 4'000'000);
+    REQUIRE(reading->instructions == 8'000'000);
+    REQUIRE(reading->llc_loads == 160'000);
+    REQUIRE(reading->llc_load_misses == 40'000);
+    REQUIRE(reading->branch_misses == 40'000);
+    REQUIRE(reading->ipc() == 2.0);
+    REQUIRE(reading->llcMissRate() == 0.25);
+
+    // The E-core model applies once the thread moves
+    backend.setCpu(0, 1);
+    REQUIRE(group->reset().has_value());
+    REQUIRE(group->enable().has_value());
+    backend.advance(std::chrono::milliseconds(1));
+    reading = group->read();
+    REQUIRE(reading.has_value());
+    REQUIRE(reading->ipc() == 1.2);
+    REQUIRE(reading->llcMissRate() == 0.4);
+}
+
+TEST_CASE("PmuGroup releases opened counters when a member fails", "[collection][PmuGroup]")
+{
+    FakePerfBackend backend(TopologyMap{});
+    backend.setOpenError(PmuError::kTooManyEvents);
+
+    auto group = PmuGroup::create(0, -1, backend);
+    REQUIRE_FALSE(group.has_value());
+    REQUIRE(group.error() == PmuError::kTooManyEvents);
+    REQUIRE(backend.openHandles() == 0);
+
+    backend.setOpenError(std::nullopt);
+    {
+        auto created = PmuGroup::create(0, -1, backend);
+        REQUIRE(created.has_value());
+        PmuGroup moved = std::move(*created);
+        REQUIRE(moved.isValid());
+    }
+    REQUIRE(backend.openHandles() == 0);
+}
+
+TEST_CASE("PmuGroup reads on the fake backend", "[.][benchmark][PmuGroup]")
+{
+    FakePerfBackend backend(TopologyMap{});
+    auto group = PmuGroup::create(0, -1, backend);
+    REQUIRE(group.has_value());
+    REQUIRE(group->enable().has_value());
+
+    BENCHMARK("group read")
+    {
+        return group->read()->cycles;
+    };
+}
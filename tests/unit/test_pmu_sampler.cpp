@@ -8,23 +8,31 @@
  *  Tests that require privileges will be skipped if permissions are insufficient.
  */
 
+#include "threveal/collection/fake_perf_backend.hpp"
 #include "threveal/collection/pmu_sampler.hpp"
 #include "threveal/core/errors.hpp"
 #include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
 
+#include <atomic>
 #include <catch2/catch_test_macros.hpp>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <fstream>
 #include <mutex>
+#include <sys/types.h>
 #include <thread>
 #include <utility>
 #include <vector>
 
+using threveal::collection::FakePerfBackend;
+using threveal::collection::FakePerfBackendOptions;
 using threveal::collection::PmuSampler;
+using threveal::core::CpuId;
 using threveal::core::PmuError;
 using threveal::core::PmuSample;
+using threveal::core::TopologyMap;
 
 namespace
 {
@@ -423,3 +431,128 @@ TEST_CASE("PmuSampler targetTid returns configured TID", "[collection][PmuSample
     // TID 0 means "self" - the actual TID should still be 0 in the sampler
     REQUIRE(sampler->targetTid() == 0);
 }
+
+TEST_CASE("PmuSampler delivers model values from the fake backend", "[collection][PmuSampler]")
+{
+    std::vector<CpuId> p_cores = {0};
+    std::vector<CpuId> e_cores = {4};
+    FakePerfBackendOptions options;
+    options.read_advance = std::chrono::milliseconds(1);
+    FakePerfBackend backend(TopologyMap{p_cores, e_cores}, options);
+    backend.setCpu(1234, 4);
+
+    SampleCollector collector;
+    auto sampler = PmuSampler::create(
+        1234,
+        [&collector](const PmuSample& sample)
+        {
+            collector.addSample(sample);
+        },
+        PmuSampler::kMinInterval, backend);
+    REQUIRE(sampler.has_value());
+
+    REQUIRE(sampler->start().has_value());
+    while (collector.count() < 3)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    sampler->stop();
+
+    // Each read advances the clock by 1 ms on the E-core
+    auto samples = collector.samples();
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        REQUIRE(samples[i].tid == 1234);
+        REQUIRE(samples[i].cpu_id == 4);
+        REQUIRE(samples[i].cycles == (i + 1) * 3'000'000);
+        REQUIRE(samples[i].instructions == (i + 1) * 3'600'000);
+        REQUIRE(samples[i].llc_misses == (i + 1) * 28'800);
+    }
+}
+
+TEST_CASE("PmuSampler suppresses samples of an idle thread", "[collection][PmuSampler]")
+{
+    std::vector<CpuId> p_cores = {0};
+    std::vector<CpuId> e_cores = {4};
+    SampleCollector collector;
+    auto callback = [&collector](const PmuSample& sample)
+    {
+        collector.addSample(sample);
+    };
+
+    SECTION("Counters that do not advance are skipped between heartbeats")
+    {
+        // Without read_advance the fake clock stands still
+        FakePerfBackend backend(TopologyMap{p_cores, e_cores});
+        auto sampler = PmuSampler::create(1234, callback, PmuSampler::kMinInterval, backend);
+        REQUIRE(sampler.has_value());
+        REQUIRE(sampler->setIdleSuppression({.heartbeat_intervals = 4}).has_value());
+
+        REQUIRE(sampler->start().has_value());
+        while (sampler->suppressedCount() < 12)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        sampler->stop();
+
+        // The first sample, then a heartbeat after every three skipped intervals
+        auto heartbeats = sampler->sampleCount() - 1;
+        REQUIRE(heartbeats >= 3);
+        REQUIRE(sampler->suppressedCount() >= 3 * heartbeats);
+        REQUIRE(sampler->suppressedCount() <= 3 * heartbeats + 3);
+        REQUIRE(collector.count() == sampler->sampleCount());
+    }
+
+    SECTION("A running thread is never skipped")
+    {
+        FakePerfBackendOptions options;
+        options.read_advance = std::chrono::milliseconds(1);
+        FakePerfBackend backend(TopologyMap{p_cores, e_cores}, options);
+        auto sampler = PmuSampler::create(1234, callback, PmuSampler::kMinInterval, backend);
+        REQUIRE(sampler.has_value());
+        REQUIRE(sampler->setIdleSuppression({}).has_value());
+
+        REQUIRE(sampler->start().has_value());
+        while (collector.count() < 5)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        sampler->stop();
+
+        REQUIRE(sampler->suppressedCount() == 0);
+    }
+
+    SECTION("The activity probe skips the read")
+    {
+        FakePerfBackendOptions options;
+        options.read_advance = std::chrono::milliseconds(1);
+        FakePerfBackend backend(TopologyMap{p_cores, e_cores}, options);
+        auto sampler = PmuSampler::create(1234, callback, PmuSampler::kMinInterval, backend);
+        REQUIRE(sampler.has_value());
+
+        std::atomic<std::uint64_t> probes{0};
+        std::atomic<pid_t> probed_tid{0};
+        PmuSampler::IdleSuppression suppression;
+        suppression.heartbeat_intervals = 0;
+        suppression.ran_since_last_check = [&probes, &probed_tid](pid_t tid)
+        {
+            probed_tid = tid;
+            probes.fetch_add(1);
+            return false;
+        };
+        REQUIRE(sampler->setIdleSuppression(std::move(suppression)).has_value());
+
+        REQUIRE(sampler->start().has_value());
+        REQUIRE(sampler->setIdleSuppression({}).error() == PmuError::kInvalidState);
+        while (probes.load() < 5)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        sampler->stop();
+
+        // Counters would have advanced on every read; only the first was made
+        REQUIRE(probed_tid.load() == 1234);
+        REQUIRE(collector.count() == 1);
+        REQUIRE(sampler->suppressedCount() == probes.load());
+    }
+}
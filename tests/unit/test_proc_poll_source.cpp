@@ -0,0 +1,381 @@
+/**
+ *  @file       test_proc_poll_source.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the /proc polling migration source.
+ *
+ *  Most tests poll a fake /proc tree; the scan benchmarks are hidden; run
+ *  them with the "[benchmark]" tag.
+ */
+
+#include "threveal/collection/ebpf_loader.hpp"
+#include "threveal/collection/proc_poll_source.hpp"
+#include "threveal/core/events.hpp"
+
+#include <atomic>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using threveal::collection::EbpfError;
+using threveal::collection::parseStatProcessor;
+using threveal::collection::ProcPollOptions;
+using threveal::collection::ProcPollSource;
+using threveal::core::MigrationEvent;
+using threveal::core::MigrationFidelity;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+/**
+ *  Builds a stat line with all 52 fields, as a 6.x kernel writes it.
+ */
+auto makeStat(std::uint32_t tid, std::string_view comm, std::uint32_t cpu) -> std::string
+{
+    auto line = std::to_string(tid) + " (" + std::string(comm) + ") S";
+    for (int field = 4; field <= 52; ++field)
+    {
+        line += ' ';
+        line += (field == 39) ? std::to_string(cpu) : std::to_string(field * 1000);
+    }
+    return line + '\n';
+}
+
+/**
+ *  Fake /proc tree that is removed on destruction.
+ */
+class FakeProc
+{
+  public:
+    FakeProc()
+        : root_(fs::temp_directory_path() /
+                ("threveal_proc_" + std::to_string(getpid()) + "_" + std::to_string(counter_++)))
+    {
+        fs::create_directories(root_);
+    }
+
+    ~FakeProc()
+    {
+        std::error_code ec;
+        fs::remove_all(root_, ec);
+    }
+
+    FakeProc(const FakeProc&) = delete;
+    auto operator=(const FakeProc&) -> FakeProc& = delete;
+    FakeProc(FakeProc&&) = delete;
+    auto operator=(FakeProc&&) -> FakeProc& = delete;
+
+    /**
+     *  Creates or moves a thread; the file is rewritten in place.
+     */
+    void setCpu(std::uint32_t pid, std::uint32_t tid, std::uint32_t cpu,
+                std::string_view comm = "worker")
+    {
+        auto dir = root_ / std::to_string(pid) / "task" / std::to_string(tid);
+        fs::create_directories(dir);
+        std::ofstream file(dir / "stat", std::ios::trunc);
+        file << makeStat(tid, comm, cpu);
+    }
+
+    void removeThread(std::uint32_t pid, std::uint32_t tid)
+    {
+        fs::remove_all(root_ / std::to_string(pid) / "task" / std::to_string(tid));
+    }
+
+    [[nodiscard]] auto options() const -> ProcPollOptions
+    {
+        ProcPollOptions options;
+        options.proc_root = root_.string();
+        return options;
+    }
+
+  private:
+    static inline int counter_ = 0;
+    fs::path root_;
+};
+
+/**
+ *  Threads that sleep until destruction, to populate /proc/self/task.
+ */
+class Sleepers
+{
+  public:
+    explicit Sleepers(std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            threads_.emplace_back(
+                [this]
+                {
+                    done_.wait(false);
+                });
+        }
+    }
+
+    ~Sleepers()
+    {
+        done_ = true;
+        done_.notify_all();
+    }
+
+    Sleepers(const Sleepers&) = delete;
+    auto operator=(const Sleepers&) -> Sleepers& = delete;
+    Sleepers(Sleepers&&) = delete;
+    auto operator=(Sleepers&&) -> Sleepers& = delete;
+
+  private:
+    std::atomic<bool> done_{false};
+    std::vector<std::jthread> threads_;
+};
+
+auto makeSource(const ProcPollOptions& options, std::vector<MigrationEvent>& events)
+    -> ProcPollSource
+{
+    auto source = ProcPollSource::create(
+        [&events](const MigrationEvent& event)
+        {
+            events.push_back(event);
+        },
+        options);
+    REQUIRE(source.has_value());
+    REQUIRE(source->start().has_value());
+    return std::move(*source);
+}
+
+}  // namespace
+
+TEST_CASE("parseStatProcessor finds the processor field", "[collection][ProcPoll]")
+{
+    REQUIRE(parseStatProcessor(makeStat(42, "worker", 5)) == 5u);
+    REQUIRE(parseStatProcessor(makeStat(42, "worker", 127)) == 127u);
+
+    SECTION("Names with spaces and parentheses")
+    {
+        REQUIRE(parseStatProcessor(makeStat(42, "a b) (c", 3)) == 3u);
+        REQUIRE(parseStatProcessor(makeStat(42, ") ) ) )", 11)) == 11u);
+    }
+
+    SECTION("Truncated lines")
+    {
+        auto line = makeStat(42, "worker", 5);
+        REQUIRE_FALSE(parseStatProcessor(line.substr(0, line.find(" 5 ") + 2)).has_value());
+        REQUIRE_FALSE(parseStatProcessor(line.substr(0, 60)).has_value());
+        REQUIRE_FALSE(parseStatProcessor("42 worker S 1").has_value());
+        REQUIRE_FALSE(parseStatProcessor("").has_value());
+    }
+}
+
+TEST_CASE("ProcPollSource reports CPU changes as polled migrations", "[collection][ProcPoll]")
+{
+    FakeProc proc;
+    proc.setCpu(100, 100, 0, "main");
+    proc.setCpu(100, 101, 2, "worker");
+
+    std::vector<MigrationEvent> events;
+    auto source = makeSource(proc.options(), events);
+    REQUIRE(source.threadCount() == 2);
+    REQUIRE(source.isRunning());
+
+    // The first read only records where each thread is
+    REQUIRE(source.tick(1000) == 0);
+
+    proc.setCpu(100, 101, 6, "worker");
+    REQUIRE(source.tick(2000) == 1);
+    REQUIRE(events.size() == 1);
+    REQUIRE(events[0].timestamp_ns == 2000);
+    REQUIRE(events[0].pid == 100);
+    REQUIRE(events[0].tid == 101);
+    REQUIRE(events[0].src_cpu == 2);
+    REQUIRE(events[0].dst_cpu == 6);
+    REQUIRE(events[0].fidelity == MigrationFidelity::kPolled);
+    REQUIRE(events[0].commAsStringView() == "worker");
+
+    // Unchanged threads report nothing
+    REQUIRE(source.tick(3000) == 0);
+    REQUIRE(source.eventCount() == 1);
+
+    source.stop();
+    REQUIRE_FALSE(source.isRunning());
+    REQUIRE(source.threadCount() == 0);
+}
+
+TEST_CASE("ProcPollSource caps the reads per tick", "[collection][ProcPoll]")
+{
+    FakeProc proc;
+    for (std::uint32_t tid = 100; tid < 105; ++tid)
+    {
+        proc.setCpu(100, tid, 0);
+    }
+
+    auto options = proc.options();
+    options.max_reads_per_tick = 2;
+    std::vector<MigrationEvent> events;
+    auto source = makeSource(options, events);
+
+    for (std::uint32_t tid = 100; tid < 105; ++tid)
+    {
+        proc.setCpu(100, tid, 1);
+    }
+
+    // Round-robin: 2, 2, then the last thread and the first one again
+    REQUIRE(source.tick(1) == 2);
+    REQUIRE(source.tick(2) == 2);
+    REQUIRE(source.tick(3) == 1);
+    REQUIRE(events.size() == 5);
+    REQUIRE(events[0].tid == 100);
+    REQUIRE(events[4].tid == 104);
+}
+
+TEST_CASE("ProcPollSource follows new and exited threads", "[collection][ProcPoll]")
+{
+    FakeProc proc;
+    proc.setCpu(100, 100, 0);
+    proc.setCpu(200, 200, 0);
+
+    std::vector<MigrationEvent> events;
+
+    SECTION("All processes")
+    {
+        auto source = makeSource(proc.options(), events);
+        REQUIRE(source.threadCount() == 2);
+
+        proc.setCpu(100, 150, 3);
+        proc.removeThread(200, 200);
+        source.rescan();
+        REQUIRE(source.threadCount() == 2);
+
+        proc.setCpu(100, 150, 4);
+        REQUIRE(source.tick(1) == 1);
+        REQUIRE(events[0].tid == 150);
+        REQUIRE(events[0].src_cpu == 3);
+    }
+
+    SECTION("One process")
+    {
+        auto options = proc.options();
+        options.target_pid = 200;
+        auto source = makeSource(options, events);
+        REQUIRE(source.threadCount() == 1);
+
+        REQUIRE(source.setTargetPid(100).has_value());
+        source.rescan();
+        REQUIRE(source.threadCount() == 1);
+        proc.setCpu(100, 100, 1);
+        proc.setCpu(200, 200, 1);
+        REQUIRE(source.tick(1) == 1);
+        REQUIRE(events[0].pid == 100);
+    }
+}
+
+TEST_CASE("ProcPollSource creation errors", "[collection][ProcPoll]")
+{
+    auto discard = [](const MigrationEvent&) {};
+
+    SECTION("Without a callback")
+    {
+        auto source = ProcPollSource::create({});
+        REQUIRE_FALSE(source.has_value());
+        REQUIRE(source.error() == EbpfError::kInvalidState);
+    }
+
+    SECTION("Without procfs")
+    {
+        ProcPollOptions options;
+        options.proc_root = "/nonexistent/proc";
+        auto source = ProcPollSource::create(discard, options);
+        REQUIRE_FALSE(source.has_value());
+        REQUIRE(source.error() == EbpfError::kOpenFailed);
+    }
+}
+
+TEST_CASE("ProcPollSource polls this process", "[collection][ProcPoll]")
+{
+    ProcPollOptions options;
+    options.target_pid = static_cast<std::uint32_t>(getpid());
+    options.interval = std::chrono::milliseconds{1};
+    std::vector<MigrationEvent> events;
+    auto source = makeSource(options, events);
+    REQUIRE(source.threadCount() >= 1);
+
+    for (int i = 0; i < 5; ++i)
+    {
+        REQUIRE(source.poll(std::chrono::milliseconds{5}) >= 0);
+    }
+    REQUIRE(source.eventCount() == events.size());
+    for (const auto& event : events)
+    {
+        REQUIRE(event.pid == *options.target_pid);
+        REQUIRE(event.src_cpu != event.dst_cpu);
+    }
+}
+
+TEST_CASE("ProcPollSource scan cost", "[.][benchmark][ProcPoll]")
+{
+    // 2000 threads at 10 ms ticks; 2% of a core leaves 200 us per tick
+    constexpr std::uint32_t kThreads = 2000;
+
+    std::vector<std::string> lines;
+    for (std::uint32_t tid = 0; tid < kThreads; ++tid)
+    {
+        lines.push_back(makeStat(10000 + tid, "worker", tid % 16));
+    }
+
+    BENCHMARK("scan 2000 stat lines")
+    {
+        std::uint64_t sum = 0;
+        for (const auto& line : lines)
+        {
+            sum += parseStatProcessor(line).value_or(0);
+        }
+        return sum;
+    };
+
+    FakeProc proc;
+    for (std::uint32_t tid = 0; tid < kThreads; ++tid)
+    {
+        proc.setCpu(100, 10000 + tid, tid % 16);
+    }
+    std::vector<MigrationEvent> events;
+    auto fake = makeSource(proc.options(), events);
+    REQUIRE(fake.threadCount() == kThreads);
+
+    BENCHMARK("tick over 2000 files on tmpfs")
+    {
+        return fake.tick(0);
+    };
+
+    // Real stat files cost far more to generate than to scan
+    Sleepers sleepers(kThreads);
+
+    ProcPollOptions options;
+    options.target_pid = static_cast<std::uint32_t>(getpid());
+    auto live = makeSource(options, events);
+    REQUIRE(live.threadCount() > kThreads);
+
+    BENCHMARK("tick over 2000 threads in /proc")
+    {
+        return live.tick(0);
+    };
+
+    // About the budget; each thread is then read every 23 ticks
+    options.max_reads_per_tick = 90;
+    auto capped = makeSource(options, events);
+
+    BENCHMARK("tick capped at 90 reads")
+    {
+        return capped.tick(0);
+    };
+}
@@ -0,0 +1,360 @@
+/**
+ *  @file       test_record_decoder.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for ring buffer record decoding.
+ */
+
+#include "threveal/collection/record_decoder.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+// Shared BPF structures
+#include "bpf_common.h"
+
+using threveal::collection::IdentityResolution;
+using threveal::collection::RecordDecoder;
+using threveal::collection::ThreadIdentity;
+using threveal::core::CoreType;
+using threveal::core::MigrationEvent;
+using threveal::core::SuppressionSummary;
+using threveal::core::ThreadLifecycleEvent;
+using threveal::core::ThreadLifecycleKind;
+
+namespace
+{
+
+template <typename Raw>
+auto toBytes(const Raw& raw) -> std::vector<std::byte>
+{
+    std::vector<std::byte> bytes(sizeof(raw));
+    std::memcpy(bytes.data(), &raw, sizeof(raw));
+    return bytes;
+}
+
+auto makeMigration() -> migration_record
+{
+    migration_record raw{};
+    raw.header.type = RECORD_MIGRATION;
+    raw.header.size = sizeof(raw);
+    raw.timestamp_ns = 1000;
+    raw.tid = 11;
+    raw.src = static_cast<__u16>(2U | (CORE_TYPE_PCORE << RECORD_CPU_BITS));
+    raw.dst = static_cast<__u16>(6U | (CORE_TYPE_ECORE << RECORD_CPU_BITS));
+    raw.topology_generation = 3;
+    raw.sample_weight = 4;
+    return raw;
+}
+
+auto makeIdentity() -> thread_identity_record
+{
+    thread_identity_record raw{};
+    raw.header.type = RECORD_THREAD_IDENTITY;
+    raw.header.size = sizeof(raw);
+    raw.pid = 10;
+    raw.tid = 11;
+    std::memcpy(raw.comm, "worker", 7);
+    return raw;
+}
+
+/**
+ *  Decodes a migration record that must be valid.
+ */
+auto decodeMigration(RecordDecoder& decoder, const migration_record& raw) -> MigrationEvent
+{
+    auto record = decoder.decode(toBytes(raw));
+    REQUIRE(record.has_value());
+    REQUIRE(std::holds_alternative<MigrationEvent>(*record));
+    return std::get<MigrationEvent>(*record);
+}
+
+}  // namespace
+
+TEST_CASE("RecordDecoder decodes migration records", "[collection][RecordDecoder]")
+{
+    RecordDecoder decoder;
+    REQUIRE(decoder.decode(toBytes(makeIdentity())).has_value());
+
+    auto event = decodeMigration(decoder, makeMigration());
+
+    REQUIRE(event.timestamp_ns == 1000);
+    REQUIRE(event.pid == 10);
+    REQUIRE(event.tid == 11);
+    REQUIRE(event.src_cpu == 2);
+    REQUIRE(event.dst_cpu == 6);
+    REQUIRE(event.topology_generation == 3);
+    REQUIRE(event.src_type == CoreType::kPCore);
+    REQUIRE(event.dst_type == CoreType::kECore);
+    REQUIRE(event.sample_weight == 4);
+    REQUIRE(std::string_view{event.comm.data()} == "worker");
+    REQUIRE(decoder.unresolvedMigrations() == 0);
+}
+
+TEST_CASE("RecordDecoder keeps a table of thread identities", "[collection][RecordDecoder]")
+{
+    RecordDecoder decoder;
+    auto identity = makeIdentity();
+
+    auto record = decoder.decode(toBytes(identity));
+    REQUIRE(record.has_value());
+    REQUIRE(std::holds_alternative<ThreadIdentity>(*record));
+    REQUIRE(std::get<ThreadIdentity>(*record).pid == 10);
+    REQUIRE(decoder.threadCount() == 1);
+
+    SECTION("A rename replaces the command name")
+    {
+        std::memcpy(identity.comm, "renamed", 8);
+        REQUIRE(decoder.decode(toBytes(identity)).has_value());
+
+        REQUIRE(decoder.threadCount() == 1);
+        auto known = decoder.identity(11);
+        REQUIRE(known.has_value());
+        REQUIRE(std::string_view{known->comm.data()} == "renamed");
+        REQUIRE(std::string_view{decodeMigration(decoder, makeMigration()).comm.data()} ==
+                "renamed");
+    }
+
+    SECTION("Migrations of unknown threads are counted as unresolved")
+    {
+        auto raw = makeMigration();
+        raw.tid = 12;
+
+        auto event = decodeMigration(decoder, raw);
+
+        REQUIRE(event.tid == 12);
+        REQUIRE(event.pid == 0);
+        REQUIRE(event.comm[0] == '\0');
+        REQUIRE_FALSE(decoder.identity(12).has_value());
+        REQUIRE(decoder.unresolvedMigrations() == 1);
+    }
+}
+
+TEST_CASE("RecordDecoder follows thread lifecycle records", "[collection][RecordDecoder]")
+{
+    RecordDecoder decoder;
+    thread_lifecycle_record raw{};
+    raw.header.type = RECORD_THREAD_LIFECYCLE;
+    raw.header.size = sizeof(raw);
+    raw.tid = 11;
+    raw.pid = 10;
+    raw.kind = THREAD_EVENT_FORK;
+    raw.timestamp_ns = 900;
+    raw.start_time_ns = 800;
+    std::memcpy(raw.comm, "spawned", 8);
+
+    auto record = decoder.decode(toBytes(raw));
+    REQUIRE(record.has_value());
+    REQUIRE(std::holds_alternative<ThreadLifecycleEvent>(*record));
+    const auto& event = std::get<ThreadLifecycleEvent>(*record);
+    REQUIRE(event.kind == ThreadLifecycleKind::kFork);
+    REQUIRE(event.key().start_time_ns == 800);
+    REQUIRE(event.timestamp_ns == 900);
+
+    // A new thread is known without an identity record
+    auto migration = decodeMigration(decoder, makeMigration());
+    REQUIRE(migration.pid == 10);
+    REQUIRE(std::string_view{migration.comm.data()} == "spawned");
+
+    // An exited thread leaves the table, so a reused ID starts unresolved
+    raw.kind = THREAD_EVENT_EXIT;
+    REQUIRE(decoder.decode(toBytes(raw)).has_value());
+    REQUIRE(decoder.threadCount() == 0);
+    REQUIRE(decodeMigration(decoder, makeMigration()).pid == 0);
+
+    raw.kind = 9;
+    REQUIRE_FALSE(decoder.decode(toBytes(raw)).has_value());
+}
+
+TEST_CASE("RecordDecoder defers resolution across rings", "[collection][RecordDecoder]")
+{
+    RecordDecoder decoder{IdentityResolution::kDeferred};
+
+    SECTION("Migration read before its identity from another ring")
+    {
+        auto migration = decodeMigration(decoder, makeMigration());
+        REQUIRE(migration.pid == 0);
+        REQUIRE(decoder.decode(toBytes(makeIdentity())).has_value());
+
+        decoder.resolve(migration);
+        REQUIRE(migration.pid == 10);
+        REQUIRE(std::string_view{migration.comm.data()} == "worker");
+        REQUIRE(decoder.unresolvedMigrations() == 0);
+    }
+
+    SECTION("Exit read before the thread's last migration")
+    {
+        thread_lifecycle_record raw{};
+        raw.header.type = RECORD_THREAD_LIFECYCLE;
+        raw.header.size = sizeof(raw);
+        raw.tid = 11;
+        raw.pid = 10;
+        raw.kind = THREAD_EVENT_EXIT;
+        raw.timestamp_ns = 1100;
+        std::memcpy(raw.comm, "worker", 7);
+        REQUIRE(decoder.decode(toBytes(raw)).has_value());
+        REQUIRE(decoder.threadCount() == 0);
+
+        // The migration at 1000 is still resolved until the exit is retired
+        auto migration = decodeMigration(decoder, makeMigration());
+        decoder.retireExited(1000);
+        decoder.resolve(migration);
+        REQUIRE(migration.pid == 10);
+
+        decoder.retireExited(1100);
+        auto reused = decodeMigration(decoder, makeMigration());
+        decoder.resolve(reused);
+        REQUIRE(reused.pid == 0);
+        REQUIRE(decoder.unresolvedMigrations() == 1);
+    }
+
+    SECTION("Thread reusing the ID of one not yet retired")
+    {
+        thread_lifecycle_record raw{};
+        raw.header.type = RECORD_THREAD_LIFECYCLE;
+        raw.header.size = sizeof(raw);
+        raw.tid = 11;
+        raw.pid = 10;
+        raw.kind = THREAD_EVENT_EXIT;
+        raw.timestamp_ns = 900;
+        REQUIRE(decoder.decode(toBytes(raw)).has_value());
+
+        raw.pid = 20;
+        raw.kind = THREAD_EVENT_FORK;
+        raw.timestamp_ns = 950;
+        std::memcpy(raw.comm, "spawned", 8);
+        REQUIRE(decoder.decode(toBytes(raw)).has_value());
+        REQUIRE(decoder.threadCount() == 1);
+
+        decoder.retireExited(1000);
+        auto migration = decodeMigration(decoder, makeMigration());
+        decoder.resolve(migration);
+        REQUIRE(migration.pid == 20);
+    }
+}
+
+TEST_CASE("RecordDecoder widens truncated topology generations", "[collection][RecordDecoder]")
+{
+    RecordDecoder decoder;
+    auto raw = makeMigration();
+    raw.topology_generation = 5;
+
+    SECTION("Without a reference the low bits are used as they are")
+    {
+        REQUIRE(decodeMigration(decoder, raw).topology_generation == 5);
+    }
+
+    SECTION("The current generation is restored in full")
+    {
+        decoder.setTopologyGeneration(0x10005);
+        REQUIRE(decodeMigration(decoder, raw).topology_generation == 0x10005);
+    }
+
+    SECTION("An older generation is the latest one with the same low bits")
+    {
+        decoder.setTopologyGeneration(0x10005);
+        raw.topology_generation = 4;
+        REQUIRE(decodeMigration(decoder, raw).topology_generation == 0x10004);
+
+        raw.topology_generation = 6;
+        REQUIRE(decodeMigration(decoder, raw).topology_generation == 0x6);
+    }
+}
+
+TEST_CASE("RecordDecoder treats zero sample weight as one", "[collection][RecordDecoder]")
+{
+    RecordDecoder decoder;
+    auto raw = makeMigration();
+    raw.sample_weight = 0;
+
+    REQUIRE(decodeMigration(decoder, raw).sample_weight == 1);
+}
+
+TEST_CASE("RecordDecoder decodes suppression records", "[collection][RecordDecoder]")
+{
+    RecordDecoder decoder;
+    suppressed_record raw{};
+    raw.header.type = RECORD_SUPPRESSED;
+    raw.header.size = sizeof(raw);
+    raw.timestamp_ns = 5000;
+    raw.first_suppressed_ns = 2000;
+    raw.suppressed = 42;
+    raw.pid = 7;
+    raw.tid = 8;
+    auto bytes = toBytes(raw);
+
+    auto record = decoder.decode(bytes);
+
+    REQUIRE(record.has_value());
+    REQUIRE(std::holds_alternative<SuppressionSummary>(*record));
+    const auto& summary = std::get<SuppressionSummary>(*record);
+    REQUIRE(summary.timestamp_ns == 5000);
+    REQUIRE(summary.first_suppressed_ns == 2000);
+    REQUIRE(summary.suppressed == 42);
+    REQUIRE(summary.pid == 7);
+    REQUIRE(summary.tid == 8);
+}
+
+TEST_CASE("RecordDecoder rejects malformed records", "[collection][RecordDecoder]")
+{
+    RecordDecoder decoder;
+    auto raw = makeMigration();
+
+    SECTION("Empty data")
+    {
+        REQUIRE_FALSE(decoder.decode({}).has_value());
+    }
+
+    SECTION("Truncated record")
+    {
+        auto bytes = toBytes(raw);
+        bytes.resize(sizeof(raw) - 1);
+        REQUIRE_FALSE(decoder.decode(bytes).has_value());
+    }
+
+    SECTION("Header claims more bytes than delivered")
+    {
+        raw.header.size = sizeof(raw) + 8;
+        REQUIRE_FALSE(decoder.decode(toBytes(raw)).has_value());
+    }
+
+    SECTION("Header size too small for its type")
+    {
+        raw.header.size = sizeof(record_header);
+        REQUIRE_FALSE(decoder.decode(toBytes(raw)).has_value());
+    }
+
+    SECTION("Unknown record type")
+    {
+        raw.header.type = 99;
+        REQUIRE_FALSE(decoder.decode(toBytes(raw)).has_value());
+    }
+
+    SECTION("Truncated identity record")
+    {
+        auto bytes = toBytes(makeIdentity());
+        bytes.resize(bytes.size() - 1);
+        REQUIRE_FALSE(decoder.decode(bytes).has_value());
+        REQUIRE(decoder.threadCount() == 0);
+    }
+}
+
+TEST_CASE("RecordDecoder ignores trailing bytes beyond the header size",
+          "[collection][RecordDecoder]")
+{
+    RecordDecoder decoder;
+    auto bytes = toBytes(makeMigration());
+    bytes.resize(bytes.size() + 8, std::byte{0xff});
+
+    auto record = decoder.decode(bytes);
+
+    REQUIRE(record.has_value());
+    REQUIRE(std::get<MigrationEvent>(*record).dst_cpu == 6);
+}
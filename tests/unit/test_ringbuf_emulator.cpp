@@ -0,0 +1,350 @@
+/**
+ *  @file       test_ringbuf_emulator.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the BPF ring buffer emulator.
+ *
+ *  The consumer throughput benchmark is hidden; run it with the
+ *  "[benchmark]" tag.
+ */
+
+#include "threveal/collection/record_decoder.hpp"
+#include "threveal/collection/ringbuf_emulator.hpp"
+#include "threveal/core/events.hpp"
+
+#include <atomic>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <span>
+#include <thread>
+#include <variant>
+#include <vector>
+
+using threveal::collection::kRingbufHeaderSize;
+using threveal::collection::produceMigrations;
+using threveal::collection::RecordDecoder;
+using threveal::collection::RingbufEmulator;
+using threveal::collection::RingbufEmulatorOptions;
+using threveal::collection::RingbufProducerOptions;
+using threveal::collection::RingbufProducerStats;
+using threveal::collection::RingbufWakeup;
+using threveal::core::MigrationEvent;
+
+namespace
+{
+
+constexpr std::size_t kPage = 4096;
+
+/**
+ *  Creates a ring or fails the test.
+ */
+auto makeRing(std::size_t data_bytes = kPage,
+              RingbufWakeup wakeup = RingbufWakeup::kAdaptive) -> RingbufEmulator
+{
+    RingbufEmulatorOptions options;
+    options.data_bytes = data_bytes;
+    options.wakeup = wakeup;
+    auto ring = RingbufEmulator::create(options);
+    REQUIRE(ring.has_value());
+    return std::move(*ring);
+}
+
+/**
+ *  Writes a record whose bytes all equal `fill`.
+ */
+auto outputFilled(RingbufEmulator& ring, std::size_t size, std::byte fill) -> bool
+{
+    std::vector<std::byte> record(size, fill);
+    return ring.output(record);
+}
+
+/**
+ *  Consumes everything, returning the record sizes and first bytes.
+ */
+auto drain(RingbufEmulator& ring) -> std::vector<std::pair<std::size_t, std::byte>>
+{
+    std::vector<std::pair<std::size_t, std::byte>> records;
+    auto consumed = ring.consume(
+        [&records](std::span<const std::byte> record)
+        {
+            records.emplace_back(record.size(), record.front());
+            return 0;
+        });
+    REQUIRE(consumed == static_cast<long>(records.size()));
+    return records;
+}
+
+}  // namespace
+
+TEST_CASE("RingbufEmulator delivers records in order", "[collection][RingbufEmulator]")
+{
+    auto ring = makeRing();
+    REQUIRE(ring.capacity() == kPage);
+
+    REQUIRE(outputFilled(ring, 5, std::byte{1}));
+    REQUIRE(outputFilled(ring, 16, std::byte{2}));
+    REQUIRE(ring.availableBytes() == 16 + 24);
+
+    auto records = drain(ring);
+    REQUIRE(records.size() == 2);
+    REQUIRE(records[0] == std::pair{std::size_t{5}, std::byte{1}});
+    REQUIRE(records[1] == std::pair{std::size_t{16}, std::byte{2}});
+    REQUIRE(ring.availableBytes() == 0);
+    REQUIRE(drain(ring).empty());
+}
+
+TEST_CASE("RingbufEmulator keeps wrapped records contiguous", "[collection][RingbufEmulator]")
+{
+    auto ring = makeRing();
+
+    // Move both positions to 56 bytes before the end of the data area
+    constexpr std::size_t kFirst = kPage - 56 - kRingbufHeaderSize;
+    REQUIRE(outputFilled(ring, kFirst, std::byte{7}));
+    REQUIRE(drain(ring).size() == 1);
+
+    // This record starts before the end and finishes at the start
+    std::vector<std::byte> record(200);
+    for (std::size_t i = 0; i < record.size(); ++i)
+    {
+        record[i] = static_cast<std::byte>(i);
+    }
+    REQUIRE(ring.output(record));
+
+    std::vector<std::byte> received;
+    REQUIRE(ring.consume(
+                [&received](std::span<const std::byte> data)
+                {
+                    received.assign(data.begin(), data.end());
+                    return 0;
+                }) == 1);
+    REQUIRE(received == record);
+}
+
+TEST_CASE("RingbufEmulator follows the busy and discard protocol",
+          "[collection][RingbufEmulator]")
+{
+    auto ring = makeRing();
+
+    auto first = ring.reserve(8);
+    auto second = ring.reserve(8);
+    auto third = ring.reserve(8);
+    REQUIRE(first.size() == 8);
+    REQUIRE(second.size() == 8);
+    REQUIRE(third.size() == 8);
+    first[0] = std::byte{1};
+    second[0] = std::byte{2};
+    third[0] = std::byte{3};
+
+    // A busy record holds back the records after it
+    ring.submit(third);
+    REQUIRE(drain(ring).empty());
+
+    ring.submit(first);
+    auto records = drain(ring);
+    REQUIRE(records.size() == 1);
+    REQUIRE(records[0].second == std::byte{1});
+
+    // Discarded records are skipped, but still free their space
+    ring.discard(second);
+    records = drain(ring);
+    REQUIRE(records.size() == 1);
+    REQUIRE(records[0].second == std::byte{3});
+    REQUIRE(ring.availableBytes() == 0);
+
+    // A negative callback result stops consumption after that record
+    REQUIRE(outputFilled(ring, 8, std::byte{4}));
+    REQUIRE(outputFilled(ring, 8, std::byte{5}));
+    REQUIRE(ring.consume(
+                [](std::span<const std::byte>)
+                {
+                    return -7;
+                }) == -7);
+    REQUIRE(drain(ring).size() == 1);
+}
+
+TEST_CASE("RingbufEmulator drops records that do not fit", "[collection][RingbufEmulator]")
+{
+    auto ring = makeRing();
+
+    REQUIRE(ring.reserve(0).empty());
+    REQUIRE(ring.reserve(kPage).empty());
+    REQUIRE(ring.drops() == 2);
+
+    // 1 KiB records take 1032 bytes each, so only three fit
+    std::size_t written = 0;
+    while (outputFilled(ring, 1024, std::byte{9}))
+    {
+        ++written;
+    }
+    REQUIRE(written == 3);
+    REQUIRE(ring.drops() == 3);
+
+    // Consuming in batches frees space again
+    std::size_t batch = 0;
+    REQUIRE(ring.consume(
+                [&batch](std::span<const std::byte>)
+                {
+                    ++batch;
+                    return 0;
+                },
+                2) == 2);
+    REQUIRE(batch == 2);
+    REQUIRE(outputFilled(ring, 1024, std::byte{9}));
+}
+
+TEST_CASE("RingbufEmulator wakes the consumer per strategy", "[collection][RingbufEmulator]")
+{
+    SECTION("adaptive wakes only when the consumer has caught up")
+    {
+        auto ring = makeRing();
+        REQUIRE(outputFilled(ring, 8, std::byte{1}));
+        REQUIRE(outputFilled(ring, 8, std::byte{2}));
+        REQUIRE(ring.wakeups() == 1);
+
+        REQUIRE(ring.poll(
+                    [](std::span<const std::byte>)
+                    {
+                        return 0;
+                    },
+                    std::chrono::milliseconds(0)) == 2);
+        REQUIRE(outputFilled(ring, 8, std::byte{3}));
+        REQUIRE(ring.wakeups() == 2);
+    }
+
+    SECTION("force wakes on every record")
+    {
+        auto ring = makeRing(kPage, RingbufWakeup::kForce);
+        REQUIRE(outputFilled(ring, 8, std::byte{1}));
+        REQUIRE(outputFilled(ring, 8, std::byte{2}));
+        REQUIRE(ring.wakeups() == 2);
+    }
+
+    SECTION("none leaves records to consume()")
+    {
+        auto ring = makeRing(kPage, RingbufWakeup::kNone);
+        REQUIRE(outputFilled(ring, 8, std::byte{1}));
+        REQUIRE(ring.wakeups() == 0);
+        REQUIRE(ring.poll(
+                    [](std::span<const std::byte>)
+                    {
+                        return 0;
+                    },
+                    std::chrono::milliseconds(1)) == 0);
+        REQUIRE(drain(ring).size() == 1);
+    }
+}
+
+TEST_CASE("RingbufEmulator carries migrations from concurrent producers",
+          "[collection][RingbufEmulator]")
+{
+    // Paced so that every producer gets records through on a single CPU
+    auto ring = makeRing(256 * 1024);
+    RingbufProducerOptions options;
+    options.threads = 4;
+    options.events_per_thread = 5'000;
+    options.events_per_sec = 200'000.0;
+
+    RecordDecoder decoder;
+    std::map<std::uint32_t, std::vector<MigrationEvent>> by_tid;
+    std::size_t malformed = 0;
+    auto on_record = [&](std::span<const std::byte> data)
+    {
+        auto record = decoder.decode(data);
+        if (!record)
+        {
+            ++malformed;
+            return 0;
+        }
+        if (!std::holds_alternative<MigrationEvent>(*record))
+        {
+            return 0;
+        }
+        const auto& event = std::get<MigrationEvent>(*record);
+        by_tid[event.tid].push_back(event);
+        return 0;
+    };
+
+    RingbufProducerStats stats;
+    std::atomic<bool> done{false};
+    std::jthread producer(
+        [&]
+        {
+            stats = produceMigrations(ring, options);
+            done.store(true, std::memory_order_release);
+        });
+    while (!done.load(std::memory_order_acquire))
+    {
+        // Records submitted while the consumer lags do not wake it
+        REQUIRE(ring.poll(on_record, std::chrono::milliseconds(1)) >= 0);
+        REQUIRE(ring.consume(on_record) >= 0);
+    }
+    producer.join();
+    ring.consume(on_record);
+
+    REQUIRE(malformed == 0);
+    REQUIRE(stats.submitted + stats.dropped == options.threads * options.events_per_thread);
+    REQUIRE(stats.dropped + stats.dropped_identities == ring.drops());
+    REQUIRE(by_tid.size() == options.threads);
+    REQUIRE(decoder.threadCount() == options.threads);
+
+    std::size_t delivered = 0;
+    for (const auto& [tid, events] : by_tid)
+    {
+        delivered += events.size();
+        for (std::size_t i = 1; i < events.size(); ++i)
+        {
+            REQUIRE(events[i - 1].timestamp_ns <= events[i].timestamp_ns);
+        }
+        // Every migration after the identity carries the process and name
+        REQUIRE(events.back().dst_cpu == tid - options.pid - 1);
+        REQUIRE(events.back().pid == options.pid);
+        REQUIRE(std::strcmp(events.back().comm.data(), "producer") == 0);
+    }
+    REQUIRE(delivered == stats.submitted);
+}
+
+TEST_CASE("RingbufEmulator consumer throughput", "[.][benchmark][RingbufEmulator]")
+{
+    // 10M migrations from 4 producers into a 16 MiB ring, decoded as the
+    // tracker does
+    RingbufProducerOptions options;
+    options.threads = 4;
+    options.events_per_thread = 2'500'000;
+
+    BENCHMARK("consume 10M migrations")
+    {
+        auto ring = makeRing(16 * 1024 * 1024);
+        RecordDecoder decoder;
+        std::uint64_t decoded = 0;
+        auto on_record = [&decoder, &decoded](std::span<const std::byte> data)
+        {
+            if (decoder.decode(data))
+            {
+                ++decoded;
+            }
+            return 0;
+        };
+
+        std::atomic<bool> done{false};
+        std::jthread producer(
+            [&]
+            {
+                (void)produceMigrations(ring, options);
+                done.store(true, std::memory_order_release);
+            });
+        while (!done.load(std::memory_order_acquire))
+        {
+            if (ring.consume(on_record) == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        ring.consume(on_record);
+        return decoded;
+    };
+}
@@ -0,0 +1,105 @@
+/**
+ *  @file       test_sampling_controller.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for SamplingController.
+ */
+
+#include "threveal/collection/sampling_controller.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+
+using threveal::collection::SamplingController;
+using threveal::collection::SamplingObservation;
+using threveal::collection::SamplingPolicy;
+
+namespace
+{
+
+constexpr std::chrono::nanoseconds kOneSecond{std::chrono::seconds{1}};
+
+}  // namespace
+
+TEST_CASE("SamplingController starts at full capture", "[collection][sampling]")
+{
+    SamplingController controller;
+    REQUIRE(controller.rate() == 1);
+
+    SECTION("Idle rings keep full capture")
+    {
+        REQUIRE(controller.update(SamplingObservation{.fill = 0.0}) == 1);
+    }
+}
+
+TEST_CASE("SamplingController backs off under pressure", "[collection][sampling]")
+{
+    SamplingController controller;
+
+    SECTION("Drops double the rate")
+    {
+        REQUIRE(controller.update(SamplingObservation{.drops = 3}) == 2);
+        REQUIRE(controller.update(SamplingObservation{.drops = 1}) == 4);
+    }
+
+    SECTION("High fill doubles the rate")
+    {
+        REQUIRE(controller.update(SamplingObservation{.fill = 0.75}) == 2);
+    }
+
+    SECTION("Moderate fill holds the rate")
+    {
+        controller.update(SamplingObservation{.fill = 0.9});
+        REQUIRE(controller.update(SamplingObservation{.fill = 0.3}) == 2);
+    }
+
+    SECTION("Low fill halves the rate back to one")
+    {
+        controller.update(SamplingObservation{.drops = 1});
+        controller.update(SamplingObservation{.drops = 1});
+        REQUIRE(controller.update(SamplingObservation{.fill = 0.05}) == 2);
+        REQUIRE(controller.update(SamplingObservation{.fill = 0.05}) == 1);
+        REQUIRE(controller.update(SamplingObservation{.fill = 0.05}) == 1);
+    }
+}
+
+TEST_CASE("SamplingController respects max_rate", "[collection][sampling]")
+{
+    SamplingController controller{SamplingPolicy{.max_rate = 5}};
+
+    REQUIRE(controller.update(SamplingObservation{.drops = 1}) == 2);
+    REQUIRE(controller.update(SamplingObservation{.drops = 1}) == 4);
+    REQUIRE(controller.update(SamplingObservation{.drops = 1}) == 5);
+    REQUIRE(controller.update(SamplingObservation{.drops = 1}) == 5);
+
+    SECTION("Zero max_rate is treated as one")
+    {
+        SamplingController pinned{SamplingPolicy{.max_rate = 0}};
+        REQUIRE(pinned.update(SamplingObservation{.drops = 1}) == 1);
+    }
+}
+
+TEST_CASE("SamplingController enforces the event budget", "[collection][sampling]")
+{
+    SamplingController controller{SamplingPolicy{.event_budget_per_sec = 1000.0}};
+
+    SECTION("Over budget raises the rate even with empty rings")
+    {
+        auto rate = controller.update(
+            SamplingObservation{.fill = 0.0, .events = 5000, .elapsed = kOneSecond});
+        REQUIRE(rate == 2);
+    }
+
+    SECTION("Rate is only lowered if the doubled event rate fits")
+    {
+        controller.update(SamplingObservation{.drops = 1});
+        controller.update(SamplingObservation{.drops = 1});
+        REQUIRE(controller.rate() == 4);
+
+        REQUIRE(controller.update(SamplingObservation{
+                    .fill = 0.0, .events = 800, .elapsed = kOneSecond}) == 4);
+        REQUIRE(controller.update(SamplingObservation{
+                    .fill = 0.0, .events = 400, .elapsed = kOneSecond}) == 2);
+    }
+}
@@ -0,0 +1,227 @@
+/**
+ *  @file       test_stream_aggregator.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the stream aggregator.
+ */
+
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/clock.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+#include "threveal/transport/stream_aggregator.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+#include "threveal/transport/stream_sink.hpp"
+
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using threveal::analysis::TraceHeader;
+using threveal::core::ClockSnapshot;
+using threveal::core::ClockSource;
+using threveal::core::CpuId;
+using threveal::core::MigrationEvent;
+using threveal::core::TopologyMap;
+using threveal::transport::connectStream;
+using threveal::transport::encodeFrameHeader;
+using threveal::transport::FrameHeader;
+using threveal::transport::FrameType;
+using threveal::transport::StreamAggregator;
+using threveal::transport::StreamEndpoint;
+using threveal::transport::StreamSink;
+using threveal::transport::StreamSinkOptions;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+auto socketPath(const char* name) -> std::string
+{
+    return (fs::temp_directory_path() /
+            ("threveal_" + std::string(name) + "_" + std::to_string(getpid()) + ".sock"))
+        .string();
+}
+
+auto makeMetadata(const char* host) -> TraceHeader
+{
+    std::vector<CpuId> p_cores = {0, 1};
+    std::vector<CpuId> e_cores = {2, 3};
+    TraceHeader header;
+    header.host = host;
+    header.topology = TopologyMap{p_cores, e_cores};
+    return header;
+}
+
+auto makeMigrations(std::size_t count, std::uint32_t tid) -> std::vector<MigrationEvent>
+{
+    std::vector<MigrationEvent> events(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        events[i].timestamp_ns = 1000 + i;
+        events[i].pid = tid;
+        events[i].tid = tid;
+        events[i].src_cpu = 0;
+        events[i].dst_cpu = 2;
+        std::strncpy(events[i].comm.data(), "worker", events[i].comm.size() - 1);
+    }
+    return events;
+}
+
+/**
+ *  Polls until the store holds `count` migrations or the attempts run out.
+ */
+auto pollUntil(StreamAggregator& aggregator, std::vector<StreamSink*> sinks, std::size_t count)
+    -> bool
+{
+    for (int i = 0; i < 500 && aggregator.store().migrationCount() < count; ++i)
+    {
+        for (auto* sink : sinks)
+        {
+            (void)sink->flush(std::chrono::milliseconds{0});
+        }
+        (void)aggregator.poll(std::chrono::milliseconds{2});
+    }
+    return aggregator.store().migrationCount() == count;
+}
+
+}  // namespace
+
+TEST_CASE("StreamAggregator merges producers into one store", "[transport][StreamAggregator]")
+{
+    auto path = socketPath("agg_merge");
+    auto aggregator = StreamAggregator::create(StreamEndpoint::unixSocket(path));
+    REQUIRE(aggregator.has_value());
+    REQUIRE(fs::exists(path));
+
+    auto with_clock = makeMetadata("node-a");
+    with_clock.clock = ClockSnapshot{.source = ClockSource::kBoottime,
+                                     .trace_ns = 500,
+                                     .realtime_ns = 1'700'000'000'000'000'000};
+
+    auto first = StreamSink::create(StreamEndpoint::unixSocket(path), with_clock,
+                                    StreamSinkOptions{.chunk_migrations = 16});
+    auto second = StreamSink::create(StreamEndpoint::unixSocket(path), makeMetadata("node-b"),
+                                     StreamSinkOptions{.chunk_migrations = 16});
+    REQUIRE(first.has_value());
+    REQUIRE(second.has_value());
+
+    auto first_events = makeMigrations(100, 11);
+    auto second_events = makeMigrations(60, 22);
+    (void)first->push(first_events);
+    (void)second->push(second_events);
+
+    REQUIRE(pollUntil(*aggregator, {&*first, &*second}, 160));
+    REQUIRE(aggregator->store().migrationsForThread(11).size() == 100);
+    REQUIRE(aggregator->store().migrationsForThread(22).size() == 60);
+    REQUIRE(aggregator->store().clockSnapshot().has_value());
+    REQUIRE(aggregator->store().clockSnapshot()->realtime_ns == 1'700'000'000'000'000'000);
+
+    auto producers = aggregator->producers();
+    REQUIRE(producers.size() == 2);
+    for (const auto& producer : producers)
+    {
+        REQUIRE(producer.connected);
+        REQUIRE(producer.metadata.topology.getECores().size() == 2);
+        REQUIRE(producer.migrations == ((producer.metadata.host == "node-a") ? 100 : 60));
+    }
+}
+
+TEST_CASE("StreamAggregator remembers closed producers", "[transport][StreamAggregator]")
+{
+    auto path = socketPath("agg_closed");
+    auto aggregator = StreamAggregator::create(StreamEndpoint::unixSocket(path));
+    REQUIRE(aggregator.has_value());
+
+    {
+        auto sink = StreamSink::create(StreamEndpoint::unixSocket(path), makeMetadata("node-c"));
+        REQUIRE(sink.has_value());
+        auto events = makeMigrations(5, 3);
+        (void)sink->push(events);
+        REQUIRE(pollUntil(*aggregator, {&*sink}, 5));
+        REQUIRE(aggregator->producers()[0].connected);
+    }
+
+    for (int i = 0; i < 10 && aggregator->producers()[0].connected; ++i)
+    {
+        (void)aggregator->poll(std::chrono::milliseconds{10});
+    }
+    REQUIRE(aggregator->producers().size() == 1);
+    REQUIRE_FALSE(aggregator->producers()[0].connected);
+    REQUIRE(aggregator->store().migrationCount() == 5);
+}
+
+TEST_CASE("StreamAggregator accepts TCP on loopback", "[transport][StreamAggregator]")
+{
+    auto aggregator = StreamAggregator::create(StreamEndpoint::tcp("127.0.0.1", 0));
+    REQUIRE(aggregator.has_value());
+    REQUIRE(aggregator->endpoint().port != 0);
+
+    auto sink = StreamSink::create(aggregator->endpoint(), makeMetadata("node-tcp"));
+    REQUIRE(sink.has_value());
+    REQUIRE(sink->isConnected());
+
+    auto events = makeMigrations(3000, 7);
+    (void)sink->push(events);
+    REQUIRE(pollUntil(*aggregator, {&*sink}, 3000));
+    REQUIRE(aggregator->producers()[0].metadata.host == "node-tcp");
+}
+
+TEST_CASE("StreamAggregator drops producers that break the protocol",
+          "[transport][StreamAggregator]")
+{
+    auto path = socketPath("agg_protocol");
+    auto aggregator = StreamAggregator::create(StreamEndpoint::unixSocket(path));
+    REQUIRE(aggregator.has_value());
+
+    auto fd = connectStream(StreamEndpoint::unixSocket(path));
+    REQUIRE(fd.has_value());
+
+    SECTION("Garbage instead of a frame")
+    {
+        std::array<std::byte, 16> garbage{};
+        garbage.fill(std::byte{0xab});
+        REQUIRE(send(*fd, garbage.data(), garbage.size(), MSG_NOSIGNAL) == 16);
+    }
+
+    SECTION("Chunk before hello")
+    {
+        auto frame = encodeFrameHeader(
+            FrameHeader{.type = FrameType::kChunk, .payload_size = 0, .count = 0});
+        REQUIRE(send(*fd, frame.data(), frame.size(), MSG_NOSIGNAL) == 16);
+    }
+
+    for (int i = 0; i < 10 && aggregator->protocolErrors() == 0; ++i)
+    {
+        (void)aggregator->poll(std::chrono::milliseconds{10});
+    }
+    REQUIRE(aggregator->protocolErrors() == 1);
+    REQUIRE(aggregator->producers().empty());
+
+    // The aggregator closed its end
+    std::array<std::byte, 16> buffer{};
+    REQUIRE(recv(*fd, buffer.data(), buffer.size(), 0) == 0);
+    close(*fd);
+}
+
+TEST_CASE("StreamAggregator removes its socket file", "[transport][StreamAggregator]")
+{
+    auto path = socketPath("agg_cleanup");
+    {
+        auto aggregator = StreamAggregator::create(StreamEndpoint::unixSocket(path));
+        REQUIRE(aggregator.has_value());
+        REQUIRE(fs::exists(path));
+    }
+    REQUIRE_FALSE(fs::exists(path));
+}
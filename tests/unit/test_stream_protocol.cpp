@@ -0,0 +1,191 @@
+/**
+ *  @file       test_stream_protocol.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the stream wire format.
+ */
+
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/types.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+using threveal::analysis::kTraceRecordSize;
+using threveal::core::CoreType;
+using threveal::core::MigrationEvent;
+using threveal::core::MigrationFidelity;
+using threveal::core::TransportError;
+using threveal::transport::connectStream;
+using threveal::transport::decodeFrameHeader;
+using threveal::transport::decodeMigrationChunk;
+using threveal::transport::encodeFrameHeader;
+using threveal::transport::encodeMigrationChunk;
+using threveal::transport::FrameHeader;
+using threveal::transport::FrameType;
+using threveal::transport::kFrameHeaderSize;
+using threveal::transport::kMaxFramePayload;
+using threveal::transport::StreamEndpoint;
+
+namespace
+{
+
+auto makeMigration(std::uint64_t timestamp_ns, std::uint32_t tid, const char* comm)
+    -> MigrationEvent
+{
+    MigrationEvent event{};
+    event.timestamp_ns = timestamp_ns;
+    event.pid = 4000;
+    event.tid = tid;
+    event.src_cpu = 2;
+    event.dst_cpu = 14;
+    event.topology_generation = 3;
+    event.src_type = CoreType::kPCore;
+    event.dst_type = CoreType::kECore;
+    event.sample_weight = 1;
+    std::strncpy(event.comm.data(), comm, event.comm.size() - 1);
+    return event;
+}
+
+}  // namespace
+
+TEST_CASE("Frame headers round-trip", "[transport][StreamProtocol]")
+{
+    auto bytes = encodeFrameHeader(
+        FrameHeader{.type = FrameType::kCredit, .payload_size = 0, .count = 7});
+    auto header = decodeFrameHeader(bytes);
+
+    REQUIRE(header.has_value());
+    REQUIRE(header->type == FrameType::kCredit);
+    REQUIRE(header->payload_size == 0);
+    REQUIRE(header->count == 7);
+}
+
+TEST_CASE("Frame headers are validated", "[transport][StreamProtocol]")
+{
+    auto bytes = encodeFrameHeader(
+        FrameHeader{.type = FrameType::kChunk, .payload_size = 100, .count = 1});
+
+    SECTION("Wrong magic")
+    {
+        bytes[0] = std::byte{'X'};
+        REQUIRE(decodeFrameHeader(bytes).error() == TransportError::kProtocolError);
+    }
+
+    SECTION("Unknown frame type")
+    {
+        bytes[6] = std::byte{0x7f};
+        REQUIRE(decodeFrameHeader(bytes).error() == TransportError::kProtocolError);
+    }
+
+    SECTION("Oversized payload")
+    {
+        bytes = encodeFrameHeader(FrameHeader{
+            .type = FrameType::kChunk, .payload_size = kMaxFramePayload + 1, .count = 1});
+        REQUIRE(decodeFrameHeader(bytes).error() == TransportError::kProtocolError);
+    }
+}
+
+TEST_CASE("Migration chunks round-trip", "[transport][StreamProtocol]")
+{
+    std::vector<MigrationEvent> events;
+    events.push_back(makeMigration(1'000'000, 4000, "worker-1"));
+    events.push_back(makeMigration(1'000'250, 4003, "worker-1"));
+
+    // Out-of-order timestamp, TID below PID and a new name
+    auto unusual = makeMigration(999'000, 12, "gc");
+    unusual.src_type = CoreType::kUnknown;
+    unusual.sample_weight = 64;
+    unusual.fidelity = MigrationFidelity::kPolled;
+    unusual.dst_cpu = std::numeric_limits<std::uint32_t>::max();
+    events.push_back(unusual);
+
+    events.push_back(makeMigration(1'000'900, 4001, "worker-2"));
+
+    std::vector<std::byte> payload;
+    encodeMigrationChunk(events, payload);
+
+    std::vector<MigrationEvent> decoded;
+    REQUIRE(decodeMigrationChunk(payload, static_cast<std::uint32_t>(events.size()), decoded)
+                .has_value());
+    REQUIRE(decoded.size() == events.size());
+
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+        REQUIRE(decoded[i].timestamp_ns == events[i].timestamp_ns);
+        REQUIRE(decoded[i].pid == events[i].pid);
+        REQUIRE(decoded[i].tid == events[i].tid);
+        REQUIRE(decoded[i].src_cpu == events[i].src_cpu);
+        REQUIRE(decoded[i].dst_cpu == events[i].dst_cpu);
+        REQUIRE(decoded[i].topology_generation == events[i].topology_generation);
+        REQUIRE(decoded[i].src_type == events[i].src_type);
+        REQUIRE(decoded[i].dst_type == events[i].dst_type);
+        REQUIRE(decoded[i].sample_weight == events[i].sample_weight);
+        REQUIRE(decoded[i].fidelity == events[i].fidelity);
+        REQUIRE(decoded[i].commAsStringView() == events[i].commAsStringView());
+    }
+}
+
+TEST_CASE("Migration chunks compress typical streams", "[transport][StreamProtocol]")
+{
+    std::vector<MigrationEvent> events;
+    for (std::uint32_t i = 0; i < 1000; ++i)
+    {
+        events.push_back(makeMigration(5'000'000'000 + (i * 40'000), 4000 + (i % 8), "worker"));
+    }
+
+    std::vector<std::byte> payload;
+    encodeMigrationChunk(events, payload);
+
+    REQUIRE(payload.size() * 3 < events.size() * kTraceRecordSize);
+}
+
+TEST_CASE("Malformed chunks are rejected", "[transport][StreamProtocol]")
+{
+    std::vector<MigrationEvent> events = {makeMigration(10, 4000, "a"),
+                                          makeMigration(20, 4000, "b")};
+    std::vector<std::byte> payload;
+    encodeMigrationChunk(events, payload);
+    std::vector<MigrationEvent> decoded;
+
+    SECTION("Truncated payload")
+    {
+        payload.pop_back();
+        REQUIRE(decodeMigrationChunk(payload, 2, decoded).error() ==
+                TransportError::kProtocolError);
+    }
+
+    SECTION("Trailing bytes")
+    {
+        REQUIRE(decodeMigrationChunk(payload, 1, decoded).error() ==
+                TransportError::kProtocolError);
+    }
+
+    SECTION("Count larger than the payload can hold")
+    {
+        REQUIRE(decodeMigrationChunk(payload, 1'000'000, decoded).error() ==
+                TransportError::kProtocolError);
+        REQUIRE(decoded.capacity() < 1'000'000);
+    }
+}
+
+TEST_CASE("connectStream validates endpoints", "[transport][StreamProtocol]")
+{
+    REQUIRE(connectStream(StreamEndpoint::unixSocket("")).error() ==
+            TransportError::kInvalidEndpoint);
+    REQUIRE(connectStream(StreamEndpoint::unixSocket(std::string(200, 'x'))).error() ==
+            TransportError::kInvalidEndpoint);
+    REQUIRE(connectStream(StreamEndpoint::tcp("localhost", 9)).error() ==
+            TransportError::kInvalidEndpoint);
+    REQUIRE(connectStream(StreamEndpoint::unixSocket("/nonexistent/threveal.sock")).error() ==
+            TransportError::kConnectFailed);
+}
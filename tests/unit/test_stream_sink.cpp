@@ -0,0 +1,204 @@
+/**
+ *  @file       test_stream_sink.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the stream producer.
+ */
+
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+#include "threveal/transport/stream_aggregator.hpp"
+#include "threveal/transport/stream_protocol.hpp"
+#include "threveal/transport/stream_sink.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using threveal::analysis::TraceHeader;
+using threveal::core::CpuId;
+using threveal::core::MigrationEvent;
+using threveal::core::TopologyMap;
+using threveal::core::TransportError;
+using threveal::transport::StreamAggregator;
+using threveal::transport::StreamAggregatorOptions;
+using threveal::transport::StreamEndpoint;
+using threveal::transport::StreamSink;
+using threveal::transport::StreamSinkOptions;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+auto socketPath(const char* name) -> std::string
+{
+    return (fs::temp_directory_path() /
+            ("threveal_" + std::string(name) + "_" + std::to_string(getpid()) + ".sock"))
+        .string();
+}
+
+auto makeMetadata() -> TraceHeader
+{
+    std::vector<CpuId> p_cores = {0, 1};
+    std::vector<CpuId> e_cores = {2, 3};
+    TraceHeader header;
+    header.host = "node-1";
+    header.topology = TopologyMap{p_cores, e_cores};
+    return header;
+}
+
+auto makeMigrations(std::size_t count) -> std::vector<MigrationEvent>
+{
+    std::vector<MigrationEvent> events(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        events[i].timestamp_ns = 1000 + i;
+        events[i].pid = 10;
+        events[i].tid = 10;
+        std::strncpy(events[i].comm.data(), "worker", events[i].comm.size() - 1);
+    }
+    return events;
+}
+
+auto fastOptions() -> StreamSinkOptions
+{
+    return StreamSinkOptions{.chunk_migrations = 10,
+                             .max_queued_chunks = 64,
+                             .reconnect_min = std::chrono::milliseconds{1},
+                             .reconnect_max = std::chrono::milliseconds{1}};
+}
+
+/**
+ *  Alternates between sink and aggregator until done() holds.
+ */
+auto pumpUntil(StreamSink& sink, StreamAggregator& aggregator, const std::function<bool()>& done)
+    -> bool
+{
+    for (int i = 0; i < 500 && !done(); ++i)
+    {
+        (void)sink.flush(std::chrono::milliseconds{0});
+        (void)aggregator.poll(std::chrono::milliseconds{2});
+    }
+    return done();
+}
+
+}  // namespace
+
+TEST_CASE("StreamSink rejects unusable endpoints", "[transport][StreamSink]")
+{
+    REQUIRE(StreamSink::create(StreamEndpoint::tcp("not-an-address", 1), makeMetadata()).error() ==
+            TransportError::kInvalidEndpoint);
+
+    auto metadata = makeMetadata();
+    metadata.host = "bad\nhost";
+    REQUIRE(StreamSink::create(StreamEndpoint::unixSocket(socketPath("sink_bad")), metadata)
+                .error() == TransportError::kInvalidEndpoint);
+}
+
+TEST_CASE("StreamSink queues until the aggregator starts", "[transport][StreamSink]")
+{
+    auto path = socketPath("sink_late");
+    auto options = fastOptions();
+    options.max_queued_chunks = 3;
+
+    auto sink = StreamSink::create(StreamEndpoint::unixSocket(path), makeMetadata(), options);
+    REQUIRE(sink.has_value());
+    REQUIRE_FALSE(sink->isConnected());
+
+    // Five full chunks; the two oldest are dropped
+    auto events = makeMigrations(50);
+    REQUIRE(sink->push(events).error() == TransportError::kDisconnected);
+    REQUIRE(sink->queuedChunks() == 3);
+    REQUIRE(sink->droppedMigrations() == 20);
+
+    auto aggregator = StreamAggregator::create(StreamEndpoint::unixSocket(path));
+    REQUIRE(aggregator.has_value());
+
+    REQUIRE(pumpUntil(*sink, *aggregator,
+                      [&aggregator]()
+                      {
+                          return aggregator->store().migrationCount() == 30;
+                      }));
+    REQUIRE(sink->isConnected());
+    REQUIRE(sink->queuedChunks() == 0);
+    REQUIRE(sink->sentChunks() == 3);
+    REQUIRE(sink->reconnects() == 0);
+    REQUIRE(aggregator->store().allMigrations().front().timestamp_ns == 1020);
+}
+
+TEST_CASE("StreamSink sends only what credits allow", "[transport][StreamSink]")
+{
+    auto path = socketPath("sink_credit");
+    auto aggregator = StreamAggregator::create(StreamEndpoint::unixSocket(path),
+                                               StreamAggregatorOptions{.initial_credits = 2});
+    REQUIRE(aggregator.has_value());
+
+    auto options = fastOptions();
+    options.chunk_migrations = 1;
+    auto sink = StreamSink::create(StreamEndpoint::unixSocket(path), makeMetadata(), options);
+    REQUIRE(sink.has_value());
+    REQUIRE(sink->isConnected());
+
+    // Without credits only the hello goes out
+    auto events = makeMigrations(5);
+    REQUIRE(sink->push(events) == 0);
+    REQUIRE(sink->queuedChunks() == 5);
+
+    // Accept, then read the hello and grant the initial credits
+    REQUIRE(aggregator->poll(std::chrono::milliseconds{100}).has_value());
+    REQUIRE(aggregator->poll(std::chrono::milliseconds{100}).has_value());
+
+    REQUIRE(sink->pump() == 2);
+    REQUIRE(sink->credits() == 0);
+    REQUIRE(sink->pump() == 0);
+    REQUIRE(sink->queuedChunks() == 3);
+
+    REQUIRE(pumpUntil(*sink, *aggregator,
+                      [&aggregator]()
+                      {
+                          return aggregator->store().migrationCount() == 5;
+                      }));
+    REQUIRE(aggregator->producers()[0].chunks == 5);
+}
+
+TEST_CASE("StreamSink reconnects after the aggregator restarts", "[transport][StreamSink]")
+{
+    auto path = socketPath("sink_restart");
+    auto events = makeMigrations(10);
+
+    std::optional<StreamAggregator> aggregator;
+    aggregator.emplace(*StreamAggregator::create(StreamEndpoint::unixSocket(path)));
+
+    auto sink = StreamSink::create(StreamEndpoint::unixSocket(path), makeMetadata(), fastOptions());
+    REQUIRE(sink.has_value());
+    REQUIRE(sink->push(events).has_value());
+    REQUIRE(pumpUntil(*sink, *aggregator,
+                      [&aggregator]()
+                      {
+                          return aggregator->store().migrationCount() == 10;
+                      }));
+
+    aggregator.reset();
+    aggregator.emplace(*StreamAggregator::create(StreamEndpoint::unixSocket(path)));
+
+    (void)sink->push(events);
+    REQUIRE(pumpUntil(*sink, *aggregator,
+                      [&aggregator]()
+                      {
+                          return aggregator->store().migrationCount() == 10;
+                      }));
+    REQUIRE(sink->reconnects() == 1);
+    REQUIRE(aggregator->producers().size() == 1);
+    REQUIRE(aggregator->producers()[0].metadata.host == "node-1");
+}
@@ -0,0 +1,93 @@
+/**
+ *  @file       test_thread_activity.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the thread activity view.
+ *
+ *  The blocks are allocated here and written as the sched_switch handler
+ *  would write them.
+ */
+
+#include "threveal/collection/thread_activity.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <vector>
+
+// Shared BPF structures
+#include "bpf_common.h"
+
+using threveal::collection::ThreadActivityMap;
+
+namespace
+{
+
+/**
+ *  Marks a thread as switched out, like handle_sched_switch.
+ */
+void switchOut(std::vector<thread_activity_block>& blocks, std::uint32_t tid)
+{
+    blocks[tid / ACTIVITY_BLOCK_THREADS].ran[tid % ACTIVITY_BLOCK_THREADS] = 1;
+    blocks[tid / ACTIVITY_BLOCK_THREADS].on_cpu[tid % ACTIVITY_BLOCK_THREADS] = 0;
+}
+
+void switchIn(std::vector<thread_activity_block>& blocks, std::uint32_t tid)
+{
+    blocks[tid / ACTIVITY_BLOCK_THREADS].on_cpu[tid % ACTIVITY_BLOCK_THREADS] = 1;
+}
+
+}  // namespace
+
+TEST_CASE("ThreadActivityMap reports and clears activity", "[collection][ThreadActivity]")
+{
+    std::vector<thread_activity_block> blocks(4);
+    ThreadActivityMap activity(blocks.data(), blocks.size());
+    REQUIRE(activity.isMapped());
+    REQUIRE(activity.capacity() == 4 * ACTIVITY_BLOCK_THREADS);
+
+    SECTION("A thread that never ran")
+    {
+        REQUIRE_FALSE(activity.ranSinceLastCheck(100));
+    }
+
+    SECTION("A thread that was switched out is reported once")
+    {
+        switchIn(blocks, 100);
+        switchOut(blocks, 100);
+        REQUIRE(activity.ranSinceLastCheck(100));
+        REQUIRE_FALSE(activity.ranSinceLastCheck(100));
+
+        // Neighbours in the same block are separate
+        REQUIRE_FALSE(activity.ranSinceLastCheck(101));
+    }
+
+    SECTION("A thread still on a CPU keeps running")
+    {
+        switchIn(blocks, 200);
+        REQUIRE(activity.ranSinceLastCheck(200));
+        REQUIRE(activity.ranSinceLastCheck(200));
+
+        switchOut(blocks, 200);
+        REQUIRE(activity.ranSinceLastCheck(200));
+        REQUIRE_FALSE(activity.ranSinceLastCheck(200));
+    }
+}
+
+TEST_CASE("ThreadActivityMap assumes activity it cannot see", "[collection][ThreadActivity]")
+{
+    SECTION("Thread IDs beyond the map")
+    {
+        std::vector<thread_activity_block> blocks(1);
+        ThreadActivityMap activity(blocks.data(), blocks.size());
+        REQUIRE_FALSE(activity.ranSinceLastCheck(ACTIVITY_BLOCK_THREADS - 1));
+        REQUIRE(activity.ranSinceLastCheck(ACTIVITY_BLOCK_THREADS));
+    }
+
+    SECTION("No mapping")
+    {
+        ThreadActivityMap activity;
+        REQUIRE_FALSE(activity.isMapped());
+        REQUIRE(activity.capacity() == 0);
+        REQUIRE(activity.ranSinceLastCheck(1));
+    }
+}
@@ -0,0 +1,136 @@
+/**
+ *  @file       test_thread_registry.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for ThreadRegistry.
+ */
+
+#include "threveal/analysis/thread_registry.hpp"
+#include "threveal/core/events.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+using threveal::analysis::kThreadAlive;
+using threveal::analysis::ThreadRegistry;
+using threveal::core::ThreadKey;
+using threveal::core::ThreadLifecycleEvent;
+using threveal::core::ThreadLifecycleKind;
+
+namespace
+{
+
+auto makeEvent(ThreadLifecycleKind kind, std::uint32_t tid, std::uint64_t start_ns,
+               std::uint64_t timestamp_ns, std::string_view comm = "worker")
+    -> ThreadLifecycleEvent
+{
+    ThreadLifecycleEvent event{
+        .timestamp_ns = timestamp_ns,
+        .start_time_ns = start_ns,
+        .pid = 100,
+        .tid = tid,
+        .kind = kind,
+        .comm = {},
+    };
+    std::memcpy(event.comm.data(), comm.data(), comm.size());
+    return event;
+}
+
+}  // namespace
+
+TEST_CASE("ThreadKey orders by thread ID, then start time", "[analysis][ThreadRegistry]")
+{
+    REQUIRE(ThreadKey{1, 50} < ThreadKey{2, 10});
+    REQUIRE(ThreadKey{2, 10} < ThreadKey{2, 20});
+    REQUIRE(ThreadKey{2, 10} == ThreadKey{2, 10});
+    REQUIRE(toString(ThreadLifecycleKind::kRename) == "rename");
+}
+
+TEST_CASE("ThreadRegistry tells apart threads that reused an ID", "[analysis][ThreadRegistry]")
+{
+    ThreadRegistry registry;
+    registry.record(makeEvent(ThreadLifecycleKind::kFork, 7, 100, 100, "first"));
+    registry.record(makeEvent(ThreadLifecycleKind::kExit, 7, 100, 500, "first"));
+    registry.record(makeEvent(ThreadLifecycleKind::kFork, 7, 900, 900, "second"));
+
+    REQUIRE(registry.threadCount() == 2);
+    REQUIRE(registry.liveThreadCount() == 1);
+
+    REQUIRE(registry.resolve(7, 300) == ThreadKey{7, 100});
+    REQUIRE(registry.resolve(7, 500) == ThreadKey{7, 100});
+    REQUIRE(registry.resolve(7, 1000) == ThreadKey{7, 900});
+
+    // Between the two threads, and for IDs never seen, nothing is known
+    REQUIRE(registry.resolve(7, 700) == ThreadKey{7, 0});
+    REQUIRE(registry.resolve(8, 300) == ThreadKey{8, 0});
+
+    auto first = registry.lifetime({7, 100});
+    REQUIRE(first.has_value());
+    REQUIRE(first->end_ns == 500);
+    REQUIRE(std::string_view{first->comm.data()} == "first");
+    REQUIRE(registry.lifetime({7, 900})->end_ns == kThreadAlive);
+}
+
+TEST_CASE("ThreadRegistry follows exec and rename", "[analysis][ThreadRegistry]")
+{
+    ThreadRegistry registry;
+    registry.record(makeEvent(ThreadLifecycleKind::kFork, 7, 100, 100, "shell"));
+    registry.record(makeEvent(ThreadLifecycleKind::kExec, 7, 100, 200, "server"));
+    registry.record(makeEvent(ThreadLifecycleKind::kRename, 7, 100, 300, "server-io"));
+
+    REQUIRE(registry.threadCount() == 1);
+    auto thread = registry.lifetime({7, 100});
+    REQUIRE(thread.has_value());
+    REQUIRE(std::string_view{thread->comm.data()} == "server-io");
+    REQUIRE(thread->pid == 100);
+}
+
+TEST_CASE("ThreadRegistry copes with missing and late events", "[analysis][ThreadRegistry]")
+{
+    ThreadRegistry registry;
+
+    SECTION("An exit without a start time ends the live thread")
+    {
+        registry.record(makeEvent(ThreadLifecycleKind::kFork, 7, 100, 100));
+        registry.record(makeEvent(ThreadLifecycleKind::kExit, 7, 0, 400));
+
+        REQUIRE(registry.liveThreadCount() == 0);
+        REQUIRE(registry.lifetime({7, 100})->end_ns == 400);
+    }
+
+    SECTION("A new thread ends one whose exit was missed")
+    {
+        registry.record(makeEvent(ThreadLifecycleKind::kFork, 7, 100, 100));
+        registry.record(makeEvent(ThreadLifecycleKind::kFork, 7, 900, 900));
+
+        REQUIRE(registry.liveThreadCount() == 1);
+        REQUIRE(registry.lifetime({7, 100})->end_ns == 899);
+        REQUIRE(registry.resolve(7, 899) == ThreadKey{7, 100});
+        REQUIRE(registry.resolve(7, 900) == ThreadKey{7, 900});
+    }
+
+    SECTION("Events of a replaced thread arriving late do not revive it")
+    {
+        registry.record(makeEvent(ThreadLifecycleKind::kFork, 7, 900, 900));
+        registry.record(makeEvent(ThreadLifecycleKind::kRename, 7, 100, 300));
+
+        REQUIRE(registry.liveThreadCount() == 1);
+        REQUIRE(registry.lifetime({7, 100})->end_ns == 899);
+        REQUIRE(registry.resolve(7, 1000) == ThreadKey{7, 900});
+    }
+
+    SECTION("An exit arriving before the fork")
+    {
+        registry.record(makeEvent(ThreadLifecycleKind::kExit, 7, 100, 400));
+        registry.record(makeEvent(ThreadLifecycleKind::kFork, 7, 100, 100));
+
+        REQUIRE(registry.liveThreadCount() == 0);
+        REQUIRE(registry.lifetime({7, 100})->end_ns == 400);
+    }
+
+    registry.clear();
+    REQUIRE(registry.threadCount() == 0);
+    REQUIRE(registry.liveThreadCount() == 0);
+}
@@ -10,15 +10,80 @@
 #include "threveal/core/types.hpp"
 
 #include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
 #include <vector>
 
 using threveal::core::CoreType;
 using threveal::core::CpuId;
+using threveal::core::formatCpuList;
+using threveal::core::kInvalidCpuId;
 using threveal::core::parseCoreType;
 using threveal::core::parseCpuList;
 using threveal::core::TopologyError;
 using threveal::core::TopologyMap;
 
+namespace
+{
+
+namespace fs = std::filesystem;
+
+/**
+ *  Fake sysfs tree in a temporary directory, removed on destruction.
+ */
+class FakeSysfs
+{
+  public:
+    FakeSysfs()
+        : root_(fs::temp_directory_path() /
+                ("threveal_sysfs_" + std::to_string(getpid()) + "_" + std::to_string(counter_++)))
+    {
+        fs::create_directories(root_ / "devices/system/cpu");
+    }
+
+    ~FakeSysfs()
+    {
+        std::error_code ec;
+        fs::remove_all(root_, ec);
+    }
+
+    FakeSysfs(const FakeSysfs&) = delete;
+    auto operator=(const FakeSysfs&) -> FakeSysfs& = delete;
+    FakeSysfs(FakeSysfs&&) = delete;
+    auto operator=(FakeSysfs&&) -> FakeSysfs& = delete;
+
+    void write(std::string_view relative_path, std::string_view content) const
+    {
+        auto path = root_ / relative_path;
+        fs::create_directories(path.parent_path());
+        std::ofstream{path} << content << "\n";
+    }
+
+    void addCpu(CpuId cpu, CpuId core_id, std::string_view core_type = {}) const
+    {
+        auto dir = "devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        write(dir + "core_id", std::to_string(core_id));
+        if (!core_type.empty())
+        {
+            write(dir + "core_type", core_type);
+        }
+    }
+
+    [[nodiscard]] auto root() const -> std::string
+    {
+        return root_.string();
+    }
+
+  private:
+    static inline int counter_ = 0;
+    fs::path root_;
+};
+
+}  // namespace
+
 TEST_CASE("parseCpuList parses single numbers", "[topology][parseCpuList]")
 {
     SECTION("single digit")
@@ -505,3 +570,242 @@ TEST_CASE("TopologyMap isSmtSibling without SMT data", "[topology][TopologyMap][
         REQUIRE(map.isSmtSibling(99, 100) == false);
     }
 }
+
+TEST_CASE("TopologyMap withOnlineCpus drops offline CPUs", "[topology][TopologyMap][hotplug]")
+{
+    std::vector<CpuId> p_cores = {0, 1, 2, 3};
+    std::vector<CpuId> e_cores = {4, 5, 6, 7};
+    TopologyMap full{p_cores, e_cores};
+
+    std::vector<CpuId> online = {0, 1, 4, 5, 6};
+    auto restricted = full.withOnlineCpus(online);
+
+    REQUIRE(restricted.getPCores().size() == 2);
+    REQUIRE(restricted.getECores().size() == 3);
+    REQUIRE(restricted.getCoreType(1).value() == CoreType::kPCore);
+    REQUIRE(restricted.getCoreType(6).value() == CoreType::kECore);
+
+    SECTION("Offline CPUs no longer classify")
+    {
+        REQUIRE_FALSE(restricted.getCoreType(2).has_value());
+        REQUIRE_FALSE(restricted.getCoreType(7).has_value());
+    }
+
+    SECTION("Original map is unchanged")
+    {
+        REQUIRE(full.totalCpuCount() == 8);
+        REQUIRE(full.getCoreType(7).value() == CoreType::kECore);
+    }
+}
+
+TEST_CASE("TopologyMap isolated CPUs", "[topology][TopologyMap][hotplug]")
+{
+    std::vector<CpuId> p_cores = {0, 1};
+    std::vector<CpuId> e_cores = {2, 3};
+    TopologyMap map{p_cores, e_cores};
+
+    REQUIRE(map.getIsolatedCpus().empty());
+    REQUIRE_FALSE(map.isIsolated(3));
+
+    std::vector<CpuId> isolated = {3, 1};
+    auto with_isolation = map.withIsolatedCpus(isolated);
+
+    REQUIRE(with_isolation.isIsolated(1));
+    REQUIRE(with_isolation.isIsolated(3));
+    REQUIRE_FALSE(with_isolation.isIsolated(0));
+    REQUIRE(with_isolation.getIsolatedCpus()[0] == 1);
+
+    // Isolation does not change core types
+    REQUIRE(with_isolation.getCoreType(3).value() == CoreType::kECore);
+}
+
+TEST_CASE("TopologyMap equality", "[topology][TopologyMap][hotplug]")
+{
+    std::vector<CpuId> p_cores = {0, 1};
+    std::vector<CpuId> e_cores = {2, 3};
+    TopologyMap a{p_cores, e_cores};
+    TopologyMap b{p_cores, e_cores};
+
+    REQUIRE(a == b);
+
+    std::vector<CpuId> online = {0, 1, 2};
+    REQUIRE(a != a.withOnlineCpus(online));
+
+    std::vector<CpuId> isolated = {2};
+    REQUIRE(a != a.withIsolatedCpus(isolated));
+}
+
+TEST_CASE("formatCpuList produces compact sysfs format", "[topology][formatCpuList]")
+{
+    REQUIRE(formatCpuList(std::vector<CpuId>{}).empty());
+    REQUIRE(formatCpuList(std::vector<CpuId>{3}) == "3");
+    REQUIRE(formatCpuList(std::vector<CpuId>{0, 1, 2, 5, 7, 8}) == "0-2,5,7-8");
+    REQUIRE(formatCpuList(std::vector<CpuId>{8, 7, 7, 0}) == "0,7-8");
+
+    SECTION("Round-trips through parseCpuList")
+    {
+        std::vector<CpuId> cpus = {0, 1, 2, 3, 4, 5, 12, 13, 14, 15, 16, 17, 18, 19};
+        auto parsed = parseCpuList(formatCpuList(cpus));
+        REQUIRE(parsed.has_value());
+        REQUIRE(*parsed == cpus);
+    }
+}
+
+TEST_CASE("loadFromSysfsRoot with hybrid PMU lists", "[topology][loadFromSysfs]")
+{
+    FakeSysfs sysfs;
+    sysfs.write("devices/cpu_core/cpus", "0-3");
+    sysfs.write("devices/cpu_atom/cpus", "4-7");
+    sysfs.write("devices/system/cpu/present", "0-7");
+    sysfs.write("devices/system/cpu/online", "0-7");
+    sysfs.write("devices/system/cpu/isolated", "");
+
+    // P-cores 0-3 are two SMT pairs; E-cores are single-threaded
+    sysfs.addCpu(0, 0);
+    sysfs.addCpu(1, 0);
+    sysfs.addCpu(2, 4);
+    sysfs.addCpu(3, 4);
+    for (CpuId cpu = 4; cpu < 8; ++cpu)
+    {
+        sysfs.addCpu(cpu, 8 + cpu);
+    }
+
+    auto map = TopologyMap::loadFromSysfsRoot(sysfs.root());
+    REQUIRE(map.has_value());
+
+    REQUIRE(map->getPCores().size() == 4);
+    REQUIRE(map->getECores().size() == 4);
+    REQUIRE(map->getCoreType(2).value() == CoreType::kPCore);
+    REQUIRE(map->getCoreType(6).value() == CoreType::kECore);
+    REQUIRE(map->isSmtSibling(0, 1));
+    REQUIRE(map->isSmtSibling(2, 3));
+    REQUIRE_FALSE(map->isSmtSibling(1, 2));
+    REQUIRE_FALSE(map->isSmtSibling(4, 5));
+    REQUIRE(map->getIsolatedCpus().empty());
+}
+
+TEST_CASE("loadFromSysfsRoot applies online and isolated lists", "[topology][loadFromSysfs]")
+{
+    FakeSysfs sysfs;
+    sysfs.write("devices/cpu_core/cpus", "0-1");
+    sysfs.write("devices/cpu_atom/cpus", "2-3");
+    sysfs.write("devices/system/cpu/present", "0-3");
+    sysfs.write("devices/system/cpu/online", "0,2-3");
+    sysfs.write("devices/system/cpu/isolated", "3");
+    for (CpuId cpu = 0; cpu < 4; ++cpu)
+    {
+        sysfs.addCpu(cpu, cpu);
+    }
+
+    auto map = TopologyMap::loadFromSysfsRoot(sysfs.root());
+    REQUIRE(map.has_value());
+
+    REQUIRE_FALSE(map->getCoreType(1).has_value());
+    REQUIRE(map->getPCores().size() == 1);
+    REQUIRE(map->isIsolated(3));
+    REQUIRE_FALSE(map->isIsolated(2));
+}
+
+TEST_CASE("loadFromSysfsRoot falls back to core_type", "[topology][loadFromSysfs]")
+{
+    FakeSysfs sysfs;
+    sysfs.write("devices/system/cpu/present", "0-3");
+    sysfs.addCpu(0, 0, "Core");
+    sysfs.addCpu(1, 1, "intel_core");
+    sysfs.addCpu(2, 2, "Atom");
+    sysfs.addCpu(3, 3, "bogus");
+
+    auto map = TopologyMap::loadFromSysfsRoot(sysfs.root());
+    REQUIRE(map.has_value());
+
+    REQUIRE(map->getPCores().size() == 2);
+    REQUIRE(map->getECores().size() == 1);
+    REQUIRE(map->getCoreType(2).value() == CoreType::kECore);
+    REQUIRE_FALSE(map->getCoreType(3).has_value());
+    REQUIRE(map->getPhysicalCoreIds()[1] == 1);
+}
+
+TEST_CASE("loadFromSysfsRoot walks cpu directories without a present list",
+          "[topology][loadFromSysfs]")
+{
+    FakeSysfs sysfs;
+    sysfs.addCpu(0, 0, "Core");
+    sysfs.addCpu(1, 0, "Core");
+    sysfs.addCpu(10, 4, "Atom");
+    sysfs.write("devices/system/cpu/cpufreq/boost", "1");
+
+    auto map = TopologyMap::loadFromSysfsRoot(sysfs.root());
+    REQUIRE(map.has_value());
+
+    REQUIRE(map->getPCores().size() == 2);
+    REQUIRE(map->getECores().size() == 1);
+    REQUIRE(map->getCoreType(10).value() == CoreType::kECore);
+    REQUIRE(map->isSmtSibling(0, 1));
+}
+
+TEST_CASE("loadFromSysfsRoot reports errors", "[topology][loadFromSysfs]")
+{
+    SECTION("Missing sysfs root")
+    {
+        auto map = TopologyMap::loadFromSysfsRoot("/nonexistent/threveal_sysfs");
+        REQUIRE_FALSE(map.has_value());
+        REQUIRE(map.error() == TopologyError::kSysfsNotFound);
+    }
+
+    SECTION("P-core list without E-core list")
+    {
+        FakeSysfs sysfs;
+        sysfs.write("devices/cpu_core/cpus", "0-3");
+
+        auto map = TopologyMap::loadFromSysfsRoot(sysfs.root());
+        REQUIRE_FALSE(map.has_value());
+        REQUIRE(map.error() == TopologyError::kNotHybridCpu);
+    }
+
+    SECTION("Malformed P-core list")
+    {
+        FakeSysfs sysfs;
+        sysfs.write("devices/cpu_core/cpus", "0-");
+        sysfs.write("devices/cpu_atom/cpus", "4-7");
+
+        auto map = TopologyMap::loadFromSysfsRoot(sysfs.root());
+        REQUIRE_FALSE(map.has_value());
+        REQUIRE(map.error() == TopologyError::kParseError);
+    }
+
+    SECTION("Fallback with a single core type")
+    {
+        FakeSysfs sysfs;
+        sysfs.write("devices/system/cpu/present", "0-1");
+        sysfs.addCpu(0, 0, "Core");
+        sysfs.addCpu(1, 1, "Core");
+
+        auto map = TopologyMap::loadFromSysfsRoot(sysfs.root());
+        REQUIRE_FALSE(map.has_value());
+        REQUIRE(map.error() == TopologyError::kNotHybridCpu);
+    }
+
+    SECTION("Fallback with no core_type files")
+    {
+        FakeSysfs sysfs;
+        sysfs.write("devices/system/cpu/present", "0-1");
+
+        auto map = TopologyMap::loadFromSysfsRoot(sysfs.root());
+        REQUIRE_FALSE(map.has_value());
+        REQUIRE(map.error() == TopologyError::kSysfsNotFound);
+    }
+}
+
+TEST_CASE("TopologyMap withPhysicalCoreIds", "[topology][TopologyMap][smt]")
+{
+    std::vector<CpuId> p_cores = {0, 1};
+    std::vector<CpuId> e_cores = {2};
+    TopologyMap map{p_cores, e_cores};
+
+    std::vector<CpuId> core_ids = {0, 0, kInvalidCpuId};
+    auto with_smt = map.withPhysicalCoreIds(core_ids);
+
+    REQUIRE(with_smt.isSmtSibling(0, 1));
+    REQUIRE_FALSE(with_smt.isSmtSibling(1, 2));
+    REQUIRE(with_smt.getPhysicalCoreIds().size() == 3);
+}
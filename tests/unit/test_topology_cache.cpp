@@ -0,0 +1,232 @@
+/**
+ *  @file       test_topology_cache.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the persistent topology snapshot.
+ */
+
+#include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/topology_cache.hpp"
+#include "threveal/core/types.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+using threveal::core::CpuId;
+using threveal::core::deserializeTopology;
+using threveal::core::kInvalidCpuId;
+using threveal::core::loadTopologyCached;
+using threveal::core::serializeTopology;
+using threveal::core::TopologyCacheOptions;
+using threveal::core::topologyCacheKey;
+using threveal::core::TopologyError;
+using threveal::core::TopologyMap;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+/**
+ *  Temporary directory holding a fake sysfs tree, boot_id and cache file.
+ */
+class CacheFixture
+{
+  public:
+    CacheFixture()
+        : root_(fs::temp_directory_path() /
+                ("threveal_topocache_" + std::to_string(getpid()) + "_" +
+                 std::to_string(counter_++)))
+    {
+        write("sys/devices/cpu_core/cpus", "0-1");
+        write("sys/devices/cpu_atom/cpus", "2-3");
+        write("sys/devices/system/cpu/present", "0-3");
+        write("sys/devices/system/cpu/online", "0-3");
+        write("sys/devices/system/cpu/isolated", "");
+        for (CpuId cpu = 0; cpu < 4; ++cpu)
+        {
+            write("sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/core_id",
+                  std::to_string(cpu / 2));
+        }
+        setBootId("3c5e2f0a-1111-2222-3333-444455556666");
+    }
+
+    ~CacheFixture()
+    {
+        std::error_code ec;
+        fs::remove_all(root_, ec);
+    }
+
+    CacheFixture(const CacheFixture&) = delete;
+    auto operator=(const CacheFixture&) -> CacheFixture& = delete;
+    CacheFixture(CacheFixture&&) = delete;
+    auto operator=(CacheFixture&&) -> CacheFixture& = delete;
+
+    void write(std::string_view relative_path, std::string_view content) const
+    {
+        auto path = root_ / relative_path;
+        fs::create_directories(path.parent_path());
+        std::ofstream{path} << content << "\n";
+    }
+
+    void setBootId(std::string_view boot_id) const
+    {
+        write("boot_id", boot_id);
+    }
+
+    [[nodiscard]] auto options() const -> TopologyCacheOptions
+    {
+        return TopologyCacheOptions{
+            .cache_path = (root_ / "topology.cache").string(),
+            .sysfs_root = (root_ / "sys").string(),
+            .boot_id_path = (root_ / "boot_id").string(),
+        };
+    }
+
+    [[nodiscard]] auto cacheExists() const -> bool
+    {
+        return fs::exists(root_ / "topology.cache");
+    }
+
+  private:
+    static inline int counter_ = 0;
+    fs::path root_;
+};
+
+}  // namespace
+
+TEST_CASE("serializeTopology round-trips", "[topology][cache]")
+{
+    std::vector<CpuId> p_cores = {0, 1, 2, 3};
+    std::vector<CpuId> e_cores = {4, 5, 6, 7};
+    std::vector<CpuId> isolated = {7};
+    std::vector<CpuId> core_ids = {0, 0, 1, 1, 8, 9, kInvalidCpuId, 11};
+    auto map = TopologyMap{p_cores, e_cores}.withIsolatedCpus(isolated).withPhysicalCoreIds(
+        core_ids);
+
+    auto data = serializeTopology(map, "boot;0-7;7");
+    auto restored = deserializeTopology(data, "boot;0-7;7");
+
+    REQUIRE(restored.has_value());
+    REQUIRE(*restored == map);
+    REQUIRE(restored->isSmtSibling(0, 1));
+    REQUIRE(restored->isIsolated(7));
+}
+
+TEST_CASE("serializeTopology round-trips an empty core list", "[topology][cache]")
+{
+    // E.g. every E-core offline
+    std::vector<CpuId> p_cores = {0, 1, 2, 3};
+    auto map = TopologyMap{p_cores, {}};
+
+    auto restored = deserializeTopology(serializeTopology(map, "boot;0-3;"), "boot;0-3;");
+
+    REQUIRE(restored.has_value());
+    REQUIRE(*restored == map);
+    REQUIRE(restored->getECores().empty());
+}
+
+TEST_CASE("deserializeTopology rejects stale or corrupt data", "[topology][cache]")
+{
+    std::vector<CpuId> p_cores = {0, 1};
+    std::vector<CpuId> e_cores = {2, 3};
+    auto data = serializeTopology(TopologyMap{p_cores, e_cores}, "key-a");
+
+    SECTION("Different key")
+    {
+        auto result = deserializeTopology(data, "key-b");
+        REQUIRE_FALSE(result.has_value());
+        REQUIRE(result.error() == TopologyError::kParseError);
+    }
+
+    SECTION("Wrong header")
+    {
+        REQUIRE_FALSE(deserializeTopology("threveal-topology 0\n", "key-a").has_value());
+    }
+
+    SECTION("Truncated data")
+    {
+        auto truncated = data.substr(0, data.find("\ne "));
+        REQUIRE_FALSE(deserializeTopology(truncated, "key-a").has_value());
+    }
+
+    SECTION("Garbage core IDs")
+    {
+        auto corrupt = data.substr(0, data.find("core_ids")) + "core_ids 1 x\n";
+        REQUIRE_FALSE(deserializeTopology(corrupt, "key-a").has_value());
+    }
+}
+
+TEST_CASE("topologyCacheKey combines boot ID and CPU state", "[topology][cache]")
+{
+    CacheFixture fixture;
+
+    auto key = topologyCacheKey(fixture.options());
+    REQUIRE(key.has_value());
+    REQUIRE(*key == "3c5e2f0a-1111-2222-3333-444455556666;0-3;");
+
+    fixture.write("sys/devices/system/cpu/online", "0-2");
+    REQUIRE(topologyCacheKey(fixture.options()) != key);
+
+    auto options = fixture.options();
+    options.boot_id_path = "/nonexistent/boot_id";
+    REQUIRE_FALSE(topologyCacheKey(options).has_value());
+}
+
+TEST_CASE("loadTopologyCached writes and reuses the cache", "[topology][cache]")
+{
+    CacheFixture fixture;
+    auto options = fixture.options();
+
+    auto first = loadTopologyCached(options);
+    REQUIRE(first.has_value());
+    REQUIRE(fixture.cacheExists());
+    REQUIRE(first->isSmtSibling(0, 1));
+
+    SECTION("Cache hit does not touch per-CPU files")
+    {
+        // Corrupt the probe source; a hit must not notice
+        fixture.write("sys/devices/cpu_core/cpus", "garbage");
+
+        auto second = loadTopologyCached(options);
+        REQUIRE(second.has_value());
+        REQUIRE(*second == *first);
+    }
+
+    SECTION("New boot invalidates the cache")
+    {
+        fixture.write("sys/devices/cpu_core/cpus", "0");
+        fixture.write("sys/devices/cpu_atom/cpus", "1-3");
+        fixture.setBootId("99999999-1111-2222-3333-444455556666");
+
+        auto second = loadTopologyCached(options);
+        REQUIRE(second.has_value());
+        REQUIRE(second->getPCores().size() == 1);
+    }
+
+    SECTION("Hotplug invalidates the cache")
+    {
+        fixture.write("sys/devices/system/cpu/online", "0-2");
+
+        auto second = loadTopologyCached(options);
+        REQUIRE(second.has_value());
+        REQUIRE_FALSE(second->getCoreType(3).has_value());
+    }
+}
+
+TEST_CASE("loadTopologyCached probes without a boot ID", "[topology][cache]")
+{
+    CacheFixture fixture;
+    auto options = fixture.options();
+    options.boot_id_path = "/nonexistent/boot_id";
+
+    auto map = loadTopologyCached(options);
+    REQUIRE(map.has_value());
+    REQUIRE_FALSE(fixture.cacheExists());
+}
@@ -0,0 +1,148 @@
+/**
+ *  @file       test_topology_handle.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for TopologyHandle and generation-aware classification.
+ */
+
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/topology_handle.hpp"
+#include "threveal/core/types.hpp"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <thread>
+#include <vector>
+
+using threveal::core::classifyMigration;
+using threveal::core::CoreType;
+using threveal::core::CpuId;
+using threveal::core::MigrationEvent;
+using threveal::core::MigrationType;
+using threveal::core::TopologyHandle;
+using threveal::core::TopologyMap;
+
+namespace
+{
+
+// P-cores 0-3, E-cores 4-7
+auto makeTopology() -> TopologyMap
+{
+    std::vector<CpuId> p_cores = {0, 1, 2, 3};
+    std::vector<CpuId> e_cores = {4, 5, 6, 7};
+    return TopologyMap{p_cores, e_cores};
+}
+
+auto makeMigration(CpuId src, CpuId dst) -> MigrationEvent
+{
+    return MigrationEvent{
+        .timestamp_ns = 1000,
+        .pid = 100,
+        .tid = 100,
+        .src_cpu = src,
+        .dst_cpu = dst,
+        .comm = {},
+    };
+}
+
+}  // namespace
+
+TEST_CASE("TopologyHandle starts at generation 1", "[topology][TopologyHandle]")
+{
+    TopologyHandle handle{makeTopology()};
+
+    REQUIRE(handle.generation() == 1);
+    auto snapshot = handle.load();
+    REQUIRE(snapshot != nullptr);
+    REQUIRE(snapshot->generation == 1);
+    REQUIRE(snapshot->map.totalCpuCount() == 8);
+}
+
+TEST_CASE("TopologyHandle publish swaps snapshot", "[topology][TopologyHandle]")
+{
+    TopologyHandle handle{makeTopology()};
+    auto old_snapshot = handle.load();
+
+    std::vector<CpuId> online = {0, 1, 4, 5};
+    auto generation = handle.publish(old_snapshot->map.withOnlineCpus(online));
+
+    REQUIRE(generation == 2);
+    REQUIRE(handle.generation() == 2);
+    REQUIRE(handle.load()->map.totalCpuCount() == 4);
+
+    // Readers holding the old snapshot keep a consistent view
+    REQUIRE(old_snapshot->generation == 1);
+    REQUIRE(old_snapshot->map.totalCpuCount() == 8);
+}
+
+TEST_CASE("TopologyHandle concurrent readers see whole snapshots", "[topology][TopologyHandle]")
+{
+    TopologyHandle handle{makeTopology()};
+    std::atomic<bool> done{false};
+    std::atomic<bool> inconsistent{false};
+
+    std::thread reader(
+        [&]
+        {
+            while (!done.load())
+            {
+                auto snapshot = handle.load();
+                // Odd generations have all 8 CPUs, even ones have 4
+                auto expected = (snapshot->generation % 2 == 1) ? 8U : 4U;
+                if (snapshot->map.totalCpuCount() != expected)
+                {
+                    inconsistent = true;
+                }
+            }
+        });
+
+    auto full = makeTopology();
+    std::vector<CpuId> online = {0, 1, 4, 5};
+    auto reduced = full.withOnlineCpus(online);
+
+    constexpr int kIterations = 200;
+    for (int i = 0; i < kIterations; ++i)
+    {
+        handle.publish((i % 2 == 0) ? reduced : full);
+    }
+
+    done = true;
+    reader.join();
+
+    REQUIRE_FALSE(inconsistent.load());
+    REQUIRE(handle.generation() == 1 + kIterations);
+}
+
+TEST_CASE("classifyMigration with TopologyHandle", "[events][classifyMigration][TopologyHandle]")
+{
+    TopologyHandle handle{makeTopology()};
+
+    SECTION("Unstamped events use the current snapshot")
+    {
+        REQUIRE(classifyMigration(makeMigration(0, 4), handle) == MigrationType::kPToE);
+
+        std::vector<CpuId> online = {0, 1, 2, 3};
+        handle.publish(handle.load()->map.withOnlineCpus(online));
+
+        REQUIRE(classifyMigration(makeMigration(0, 4), handle) == MigrationType::kUnknown);
+    }
+
+    SECTION("Stamped core types take precedence")
+    {
+        auto event = makeMigration(0, 4);
+        event.topology_generation = 1;
+        event.src_type = CoreType::kECore;
+        event.dst_type = CoreType::kPCore;
+
+        REQUIRE(classifyMigration(event, handle) == MigrationType::kEToP);
+    }
+
+    SECTION("Partially stamped events fall back to the snapshot")
+    {
+        auto event = makeMigration(4, 0);
+        event.src_type = CoreType::kPCore;
+
+        REQUIRE(classifyMigration(event, handle) == MigrationType::kEToP);
+    }
+}
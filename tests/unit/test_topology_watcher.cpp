@@ -0,0 +1,232 @@
+/**
+ *  @file       test_topology_watcher.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for TopologyWatcher.
+ *
+ *  A scripted loader stands in for sysfs so hotplug can be simulated.
+ */
+
+#include "threveal/collection/topology_watcher.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/topology_handle.hpp"
+#include "threveal/core/types.hpp"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using threveal::collection::TopologyLoader;
+using threveal::collection::TopologyWatcher;
+using threveal::core::CpuId;
+using threveal::core::TopologyError;
+using threveal::core::TopologyGeneration;
+using threveal::core::TopologyHandle;
+using threveal::core::TopologyMap;
+using threveal::core::TopologySnapshot;
+
+namespace
+{
+
+// P-cores 0-3, E-cores 4-7
+auto makeTopology() -> TopologyMap
+{
+    std::vector<CpuId> p_cores = {0, 1, 2, 3};
+    std::vector<CpuId> e_cores = {4, 5, 6, 7};
+    return TopologyMap{p_cores, e_cores};
+}
+
+/**
+ *  Loader whose result can be changed from the test thread.
+ */
+class ScriptedTopology
+{
+  public:
+    explicit ScriptedTopology(TopologyMap initial) : state_(std::make_shared<State>())
+    {
+        state_->map = std::move(initial);
+    }
+
+    void set(TopologyMap map)
+    {
+        std::lock_guard lock(state_->mutex);
+        state_->map = std::move(map);
+        state_->error = false;
+    }
+
+    void fail()
+    {
+        std::lock_guard lock(state_->mutex);
+        state_->error = true;
+    }
+
+    [[nodiscard]] auto loader() const -> TopologyLoader
+    {
+        return [state = state_]() -> std::expected<TopologyMap, TopologyError>
+        {
+            std::lock_guard lock(state->mutex);
+            if (state->error)
+            {
+                return std::unexpected(TopologyError::kSysfsNotFound);
+            }
+            return state->map;
+        };
+    }
+
+  private:
+    struct State
+    {
+        std::mutex mutex;
+        TopologyMap map;
+        bool error{false};
+    };
+
+    std::shared_ptr<State> state_;
+};
+
+}  // namespace
+
+TEST_CASE("TopologyWatcher::create propagates loader errors", "[collection][TopologyWatcher]")
+{
+    TopologyHandle handle{makeTopology()};
+    ScriptedTopology source{makeTopology()};
+    source.fail();
+
+    auto watcher = TopologyWatcher::create(handle, {}, TopologyWatcher::kDefaultInterval,
+                                           source.loader());
+
+    REQUIRE_FALSE(watcher.has_value());
+    REQUIRE(watcher.error() == TopologyError::kSysfsNotFound);
+}
+
+TEST_CASE("TopologyWatcher::create rejects empty loader", "[collection][TopologyWatcher]")
+{
+    TopologyHandle handle{makeTopology()};
+
+    auto watcher = TopologyWatcher::create(handle, {}, TopologyWatcher::kDefaultInterval, nullptr);
+
+    REQUIRE_FALSE(watcher.has_value());
+    REQUIRE(watcher.error() == TopologyError::kInvalidState);
+}
+
+TEST_CASE("TopologyWatcher clamps interval", "[collection][TopologyWatcher]")
+{
+    TopologyHandle handle{makeTopology()};
+    ScriptedTopology source{makeTopology()};
+
+    auto watcher =
+        TopologyWatcher::create(handle, {}, std::chrono::milliseconds{1}, source.loader());
+
+    REQUIRE(watcher.has_value());
+    REQUIRE(watcher->interval() == TopologyWatcher::kMinInterval);
+}
+
+TEST_CASE("TopologyWatcher::checkNow publishes only on change", "[collection][TopologyWatcher]")
+{
+    TopologyHandle handle{makeTopology()};
+    ScriptedTopology source{makeTopology()};
+
+    std::vector<TopologyGeneration> notified;
+    auto watcher = TopologyWatcher::create(
+        handle,
+        [&](const TopologySnapshot& snapshot)
+        {
+            notified.push_back(snapshot.generation);
+        },
+        TopologyWatcher::kDefaultInterval, source.loader());
+    REQUIRE(watcher.has_value());
+
+    SECTION("Unchanged topology is not republished")
+    {
+        REQUIRE_FALSE(watcher->checkNow());
+        REQUIRE(handle.generation() == 1);
+        REQUIRE(notified.empty());
+    }
+
+    SECTION("CPU offline produces a new generation")
+    {
+        std::vector<CpuId> online = {0, 1, 2, 4, 5, 6, 7};
+        source.set(makeTopology().withOnlineCpus(online));
+
+        REQUIRE(watcher->checkNow());
+        REQUIRE(handle.generation() == 2);
+        REQUIRE_FALSE(handle.load()->map.getCoreType(3).has_value());
+        REQUIRE(watcher->changeCount() == 1);
+        REQUIRE(notified == std::vector<TopologyGeneration>{2});
+
+        // Same topology again is a no-op
+        REQUIRE_FALSE(watcher->checkNow());
+        REQUIRE(handle.generation() == 2);
+    }
+
+    SECTION("Isolation change produces a new generation")
+    {
+        std::vector<CpuId> isolated = {7};
+        source.set(makeTopology().withIsolatedCpus(isolated));
+
+        REQUIRE(watcher->checkNow());
+        REQUIRE(handle.load()->map.isIsolated(7));
+    }
+
+    SECTION("Failed reload keeps the current snapshot")
+    {
+        source.fail();
+
+        REQUIRE_FALSE(watcher->checkNow());
+        REQUIRE(handle.generation() == 1);
+        REQUIRE(handle.load()->map.totalCpuCount() == 8);
+    }
+}
+
+TEST_CASE("TopologyWatcher::create publishes an already-changed topology",
+          "[collection][TopologyWatcher]")
+{
+    TopologyHandle handle{makeTopology()};
+    std::vector<CpuId> online = {0, 1, 4, 5};
+    ScriptedTopology source{makeTopology().withOnlineCpus(online)};
+
+    auto watcher = TopologyWatcher::create(handle, {}, TopologyWatcher::kDefaultInterval,
+                                           source.loader());
+
+    REQUIRE(watcher.has_value());
+    REQUIRE(handle.generation() == 2);
+    REQUIRE(handle.load()->map.totalCpuCount() == 4);
+}
+
+TEST_CASE("TopologyWatcher background thread picks up changes", "[collection][TopologyWatcher]")
+{
+    TopologyHandle handle{makeTopology()};
+    ScriptedTopology source{makeTopology()};
+
+    auto watcher =
+        TopologyWatcher::create(handle, {}, TopologyWatcher::kMinInterval, source.loader());
+    REQUIRE(watcher.has_value());
+
+    REQUIRE(watcher->start().has_value());
+    REQUIRE(watcher->isRunning());
+    REQUIRE(watcher->start().error() == TopologyError::kInvalidState);
+
+    std::vector<CpuId> online = {0, 4};
+    source.set(makeTopology().withOnlineCpus(online));
+
+    // Allow several check intervals to elapse
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{2};
+    while (handle.generation() == 1 && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(TopologyWatcher::kMinInterval);
+    }
+
+    REQUIRE(handle.generation() == 2);
+    REQUIRE(handle.load()->map.totalCpuCount() == 2);
+
+    auto stop_start = std::chrono::steady_clock::now();
+    watcher->stop();
+    REQUIRE_FALSE(watcher->isRunning());
+    REQUIRE(std::chrono::steady_clock::now() - stop_start < std::chrono::seconds{1});
+}
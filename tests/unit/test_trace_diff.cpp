@@ -0,0 +1,272 @@
+/**
+ *  @file       test_trace_diff.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the A/B run comparison.
+ *
+ *  The large-run benchmark is hidden; run it with the "[benchmark]" tag.
+ */
+
+#include "threveal/analysis/event_store.hpp"
+#include "threveal/analysis/trace_diff.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <algorithm>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using threveal::analysis::DiffEntry;
+using threveal::analysis::DiffMetric;
+using threveal::analysis::diffRuns;
+using threveal::analysis::EventStore;
+using threveal::analysis::TraceDiff;
+using threveal::analysis::TraceDiffOptions;
+using threveal::core::CpuId;
+using threveal::core::MigrationEvent;
+using threveal::core::PmuSample;
+using threveal::core::TopologyMap;
+
+namespace
+{
+
+auto makeTopology() -> TopologyMap
+{
+    std::vector<CpuId> p_cores = {0, 1};
+    std::vector<CpuId> e_cores = {2, 3};
+    return TopologyMap{p_cores, e_cores};
+}
+
+/**
+ *  Adds a thread that alternates between a P-core and an E-core every
+ *  `interval_ns`, staying `p_share` of each round trip on the P-core.
+ */
+void addThread(EventStore& store, const char* comm, std::uint32_t tid, std::uint64_t start_ns,
+               std::size_t migrations, std::uint64_t interval_ns, double p_share = 0.5)
+{
+    auto p_time = static_cast<std::uint64_t>(p_share * 2.0 * static_cast<double>(interval_ns));
+    auto timestamp = start_ns;
+    for (std::size_t i = 0; i < migrations; ++i)
+    {
+        MigrationEvent event{};
+        event.timestamp_ns = timestamp;
+        event.pid = 1;
+        event.tid = tid;
+        bool to_e = (i % 2 == 0);
+        event.src_cpu = to_e ? 0 : 2;
+        event.dst_cpu = to_e ? 2 : 0;
+        event.sample_weight = 1;
+        std::strncpy(event.comm.data(), comm, event.comm.size() - 1);
+        store.addMigration(event);
+
+        // Odd migrations leave the E-core, so the P-core interval comes first
+        timestamp += to_e ? ((2 * interval_ns) - p_time) : p_time;
+    }
+}
+
+void addSamples(EventStore& store, std::uint32_t tid, CpuId cpu, std::uint64_t instructions,
+                std::uint64_t cycles)
+{
+    PmuSample sample{};
+    sample.tid = tid;
+    sample.cpu_id = cpu;
+    sample.instructions = instructions;
+    sample.cycles = cycles;
+    store.addPmuSample(sample);
+}
+
+auto find(const TraceDiff& diff, const std::string& role, DiffMetric metric) -> const DiffEntry*
+{
+    auto found = std::ranges::find_if(diff.entries,
+                                      [&](const DiffEntry& entry)
+                                      {
+                                          return entry.role == role && entry.metric == metric;
+                                      });
+    return (found == diff.entries.end()) ? nullptr : &*found;
+}
+
+constexpr std::uint64_t kMillisecond = 1'000'000;
+
+}  // namespace
+
+TEST_CASE("diffRuns aligns threads by name and order of appearance", "[analysis][TraceDiff]")
+{
+    EventStore baseline;
+    addThread(baseline, "worker-1", 10, 0, 10, kMillisecond);
+    addThread(baseline, "worker-1", 11, 5, 10, kMillisecond);
+    addThread(baseline, "main", 1, 0, 10, kMillisecond);
+    addThread(baseline, "gc", 2, 0, 10, kMillisecond);
+
+    EventStore candidate;
+    addThread(candidate, "worker-1", 300, 0, 10, kMillisecond);
+    addThread(candidate, "worker-1", 200, 5, 10, kMillisecond);
+    addThread(candidate, "main", 7, 0, 10, kMillisecond);
+    addThread(candidate, "io", 8, 0, 10, kMillisecond);
+
+    auto topology = makeTopology();
+    auto diff = diffRuns(baseline, topology, candidate, topology);
+    REQUIRE(diff.aligned_threads == 3);
+    REQUIRE(diff.unmatched_baseline == 1);
+    REQUIRE(diff.unmatched_candidate == 1);
+
+    // Identical behaviour is not a regression, and there is no PMU data
+    REQUIRE(std::ranges::none_of(diff.entries,
+                                 [](const DiffEntry& entry)
+                                 {
+                                     return entry.regression;
+                                 }));
+    REQUIRE(find(diff, "worker", DiffMetric::kMigrationRate) != nullptr);
+    REQUIRE(find(diff, "worker", DiffMetric::kPCoreIpc) == nullptr);
+    REQUIRE(find(diff, "gc", DiffMetric::kMigrationRate) == nullptr);
+}
+
+TEST_CASE("diffRuns ranks significant regressions first", "[analysis][TraceDiff]")
+{
+    EventStore baseline;
+    EventStore candidate;
+    for (std::uint32_t i = 0; i < 8; ++i)
+    {
+        auto comm = "worker-" + std::to_string(i);
+        addThread(baseline, comm.c_str(), 100 + i, i, 100, 10 * kMillisecond, 0.8);
+        addThread(candidate, comm.c_str(), 500 + i, i, 200 + (i * 4), 5 * kMillisecond, 0.5);
+    }
+
+    auto topology = makeTopology();
+    auto diff = diffRuns(baseline, topology, candidate, topology);
+    REQUIRE(diff.aligned_threads == 8);
+    REQUIRE(diff.entries.size() >= 3);
+
+    const auto& top = diff.entries.front();
+    REQUIRE(top.role == "worker");
+    REQUIRE(top.regression);
+    REQUIRE(top.threads == 8);
+    REQUIRE(top.p_value < 0.05);
+
+    auto* rate = find(diff, "worker", DiffMetric::kMigrationRate);
+    REQUIRE(rate != nullptr);
+    REQUIRE(rate->regression);
+    REQUIRE(rate->relative_change > 0.9);
+    REQUIRE(rate->ci_low > 0.0);
+    REQUIRE(rate->ci_low <= rate->ci_high);
+
+    auto* residency = find(diff, "worker", DiffMetric::kPCoreResidency);
+    REQUIRE(residency != nullptr);
+    REQUIRE(residency->regression);
+    REQUIRE(residency->baseline > 0.75);
+    REQUIRE(residency->candidate < 0.55);
+
+    // Warm-up only covers the first second; both runs migrate throughout
+    auto* warmup = find(diff, "worker", DiffMetric::kWarmupMigrations);
+    REQUIRE(warmup != nullptr);
+    REQUIRE(warmup->candidate > warmup->baseline);
+}
+
+TEST_CASE("diffRuns compares IPC per core type", "[analysis][TraceDiff]")
+{
+    EventStore baseline;
+    EventStore candidate;
+    for (std::uint32_t i = 0; i < 4; ++i)
+    {
+        addThread(baseline, "db", 10 + i, 0, 10, kMillisecond);
+        addThread(candidate, "db", 20 + i, 0, 10, kMillisecond);
+        addSamples(baseline, 10 + i, 0, 2000 + i, 1000);
+        addSamples(candidate, 20 + i, 0, 1000 + i, 1000);
+        addSamples(baseline, 10 + i, 2, 1000, 1000);
+        addSamples(candidate, 20 + i, 2, 1000, 1000);
+    }
+
+    auto topology = makeTopology();
+    auto diff = diffRuns(baseline, topology, candidate, topology);
+
+    auto* p_ipc = find(diff, "db", DiffMetric::kPCoreIpc);
+    REQUIRE(p_ipc != nullptr);
+    REQUIRE(p_ipc->regression);
+    REQUIRE(p_ipc->baseline > 1.9);
+    REQUIRE(p_ipc->candidate < 1.1);
+
+    auto* e_ipc = find(diff, "db", DiffMetric::kECoreIpc);
+    REQUIRE(e_ipc != nullptr);
+    REQUIRE(!e_ipc->regression);
+    REQUIRE(e_ipc->relative_change == 0.0);
+}
+
+TEST_CASE("diffRuns does not test roles with too few threads", "[analysis][TraceDiff]")
+{
+    EventStore baseline;
+    EventStore candidate;
+    addThread(baseline, "main", 1, 0, 10, 10 * kMillisecond);
+    addThread(candidate, "main", 1, 0, 40, kMillisecond);
+
+    auto topology = makeTopology();
+    auto diff = diffRuns(baseline, topology, candidate, topology);
+
+    auto* rate = find(diff, "main", DiffMetric::kMigrationRate);
+    REQUIRE(rate != nullptr);
+    REQUIRE(rate->relative_change > 1.0);
+    REQUIRE(rate->p_value == 1.0);
+    REQUIRE(!rate->regression);
+    REQUIRE(rate->ci_low == rate->ci_high);
+}
+
+TEST_CASE("diffRuns results do not depend on the worker count", "[analysis][TraceDiff]")
+{
+    EventStore baseline;
+    EventStore candidate;
+    for (std::uint32_t i = 0; i < 6; ++i)
+    {
+        addThread(baseline, "pool", 10 + i, i, 20 + i, kMillisecond);
+        addThread(candidate, "pool", 20 + i, i, 25 + (2 * i), kMillisecond);
+    }
+
+    auto topology = makeTopology();
+    TraceDiffOptions options;
+    options.bootstrap_samples = 500;
+    options.threads = 1;
+    auto single = diffRuns(baseline, topology, candidate, topology, options);
+    options.threads = 4;
+    auto parallel = diffRuns(baseline, topology, candidate, topology, options);
+
+    REQUIRE(single.entries.size() == parallel.entries.size());
+    for (std::size_t i = 0; i < single.entries.size(); ++i)
+    {
+        REQUIRE(single.entries[i].metric == parallel.entries[i].metric);
+        REQUIRE(single.entries[i].p_value == parallel.entries[i].p_value);
+        REQUIRE(single.entries[i].ci_low == parallel.entries[i].ci_low);
+        REQUIRE(single.entries[i].ci_high == parallel.entries[i].ci_high);
+    }
+}
+
+TEST_CASE("diffRuns compares large runs", "[.][benchmark][TraceDiff]")
+{
+    // 5M migrations per run across 1000 threads of 50 roles
+    constexpr std::uint32_t kThreads = 1000;
+    EventStore baseline;
+    EventStore candidate;
+    for (std::size_t i = 0; i < 5'000'000; ++i)
+    {
+        auto tid = static_cast<std::uint32_t>(i % kThreads);
+        MigrationEvent event{};
+        event.timestamp_ns = i * 1000;
+        event.tid = tid;
+        event.src_cpu = (i / kThreads) % 2 == 0 ? 0 : 2;
+        event.dst_cpu = (i / kThreads) % 2 == 0 ? 2 : 0;
+        event.sample_weight = 1;
+        auto comm = "role" + std::to_string(tid % 50) + "-" + std::to_string(tid / 50);
+        std::strncpy(event.comm.data(), comm.c_str(), event.comm.size() - 1);
+        baseline.addMigration(event);
+        event.tid += kThreads;
+        candidate.addMigration(event);
+    }
+
+    auto topology = makeTopology();
+    BENCHMARK("diff 2 x 5M migrations")
+    {
+        return diffRuns(baseline, topology, candidate, topology).entries.size();
+    };
+}
@@ -0,0 +1,246 @@
+/**
+ *  @file       test_trace_file.cpp
+ *  @author     Rutger Kool <rutgerkool@gmail.com>
+ *
+ *  Unit tests for the trace file format.
+ */
+
+#include "threveal/analysis/trace_file.hpp"
+#include "threveal/core/clock.hpp"
+#include "threveal/core/errors.hpp"
+#include "threveal/core/events.hpp"
+#include "threveal/core/topology.hpp"
+#include "threveal/core/types.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using threveal::analysis::formatTraceHeader;
+using threveal::analysis::kTraceRecordSize;
+using threveal::analysis::parseTraceHeader;
+using threveal::analysis::TraceHeader;
+using threveal::analysis::TraceReader;
+using threveal::analysis::writeTrace;
+using threveal::core::ClockSnapshot;
+using threveal::core::ClockSource;
+using threveal::core::CoreType;
+using threveal::core::CpuId;
+using threveal::core::MigrationEvent;
+using threveal::core::MigrationFidelity;
+using threveal::core::TopologyMap;
+using threveal::core::TraceError;
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+/**
+ *  Temporary trace file path, removed on destruction.
+ */
+class TempTrace
+{
+  public:
+    TempTrace()
+        : path_(fs::temp_directory_path() / ("threveal_trace_" + std::to_string(getpid()) +
+                                             "_" + std::to_string(counter_++) + ".trace"))
+    {
+    }
+
+    ~TempTrace()
+    {
+        std::error_code ec;
+        fs::remove(path_, ec);
+    }
+
+    TempTrace(const TempTrace&) = delete;
+    auto operator=(const TempTrace&) -> TempTrace& = delete;
+    TempTrace(TempTrace&&) = delete;
+    auto operator=(TempTrace&&) -> TempTrace& = delete;
+
+    [[nodiscard]] auto path() const -> std::string
+    {
+        return path_.string();
+    }
+
+  private:
+    static inline int counter_ = 0;
+    fs::path path_;
+};
+
+auto makeHeader() -> TraceHeader
+{
+    std::vector<CpuId> p_cores = {0, 1, 2, 3};
+    std::vector<CpuId> e_cores = {4, 5, 6, 7};
+    return TraceHeader{
+        .host = "node-17",
+        .clock = ClockSnapshot{.source = ClockSource::kBoottime,
+                               .trace_ns = 1000,
+                               .realtime_ns = 1'700'000'000'000'000'000,
+                               .monotonic_ns = 900,
+                               .boottime_ns = 1000,
+                               .uncertainty_ns = 40},
+        .topology = TopologyMap{p_cores, e_cores},
+    };
+}
+
+auto makeMigration(std::uint64_t timestamp_ns, std::uint32_t tid) -> MigrationEvent
+{
+    MigrationEvent event{};
+    event.timestamp_ns = timestamp_ns;
+    event.pid = 100;
+    event.tid = tid;
+    event.src_cpu = 1;
+    event.dst_cpu = 5;
+    event.topology_generation = 2;
+    event.src_type = CoreType::kPCore;
+    event.dst_type = CoreType::kECore;
+    event.sample_weight = 3;
+    event.fidelity = (tid % 2 == 0) ? MigrationFidelity::kExact : MigrationFidelity::kPolled;
+    std::strncpy(event.comm.data(), "worker-1", event.comm.size() - 1);
+    return event;
+}
+
+}  // namespace
+
+TEST_CASE("Trace files round-trip header and migrations", "[analysis][TraceFile]")
+{
+    TempTrace file;
+    std::vector<MigrationEvent> migrations;
+    for (std::uint32_t i = 0; i < 2500; ++i)
+    {
+        migrations.push_back(makeMigration(1000 + i, i));
+    }
+
+    REQUIRE(writeTrace(file.path(), makeHeader(), migrations).has_value());
+    REQUIRE(fs::file_size(file.path()) > migrations.size() * kTraceRecordSize);
+
+    auto reader = TraceReader::open(file.path());
+    REQUIRE(reader.has_value());
+
+    const auto& header = reader->header();
+    REQUIRE(header.host == "node-17");
+    REQUIRE(header.migration_count == migrations.size());
+    REQUIRE(header.clock.has_value());
+    REQUIRE(header.clock->source == ClockSource::kBoottime);
+    REQUIRE(header.clock->realtime_ns == 1'700'000'000'000'000'000);
+    REQUIRE(header.clock->uncertainty_ns == 40);
+    REQUIRE(header.topology.getPCores().size() == 4);
+    REQUIRE(header.topology.getCoreType(6) == CoreType::kECore);
+
+    // Read in uneven batches to cross internal chunk boundaries
+    std::vector<MigrationEvent> read_back;
+    std::vector<MigrationEvent> batch(333);
+    while (reader->remaining() > 0)
+    {
+        auto count = reader->read(batch);
+        REQUIRE(count.has_value());
+        read_back.insert(read_back.end(), batch.begin(),
+                         batch.begin() + static_cast<std::ptrdiff_t>(*count));
+    }
+
+    REQUIRE(read_back.size() == migrations.size());
+    for (std::size_t i = 0; i < migrations.size(); i += 499)
+    {
+        const auto& event = read_back[i];
+        REQUIRE(event.timestamp_ns == migrations[i].timestamp_ns);
+        REQUIRE(event.tid == migrations[i].tid);
+        REQUIRE(event.pid == 100);
+        REQUIRE(event.src_cpu == 1);
+        REQUIRE(event.dst_cpu == 5);
+        REQUIRE(event.topology_generation == 2);
+        REQUIRE(event.src_type == CoreType::kPCore);
+        REQUIRE(event.dst_type == CoreType::kECore);
+        REQUIRE(event.sample_weight == 3);
+        REQUIRE(event.fidelity == migrations[i].fidelity);
+        REQUIRE(event.commAsStringView() == "worker-1");
+    }
+
+    auto end = reader->read(batch);
+    REQUIRE(end.has_value());
+    REQUIRE(*end == 0);
+}
+
+TEST_CASE("Trace files without clock offsets", "[analysis][TraceFile]")
+{
+    TempTrace file;
+    auto header = makeHeader();
+    header.clock.reset();
+
+    REQUIRE(writeTrace(file.path(), header, {}).has_value());
+
+    auto reader = TraceReader::open(file.path());
+    REQUIRE(reader.has_value());
+    REQUIRE_FALSE(reader->header().clock.has_value());
+    REQUIRE(reader->remaining() == 0);
+}
+
+TEST_CASE("Trace headers round-trip as text", "[analysis][TraceFile]")
+{
+    auto header = makeHeader();
+    header.migration_count = 42;
+
+    auto text = formatTraceHeader(header);
+    REQUIRE(text.has_value());
+
+    auto parsed = parseTraceHeader(*text);
+    REQUIRE(parsed.has_value());
+    REQUIRE(parsed->host == "node-17");
+    REQUIRE(parsed->migration_count == 42);
+    REQUIRE(parsed->clock.has_value());
+    REQUIRE(parsed->clock->trace_ns == 1000);
+    REQUIRE(parsed->topology.getECores().size() == 4);
+
+    REQUIRE(parseTraceHeader("threveal-trace 1\nhost x\n").error() == TraceError::kParseError);
+}
+
+TEST_CASE("writeTrace rejects host names with line breaks", "[analysis][TraceFile]")
+{
+    TempTrace file;
+    auto header = makeHeader();
+    header.host = "node\nclock none";
+
+    REQUIRE(writeTrace(file.path(), header, {}).error() == TraceError::kInvalidHeader);
+}
+
+TEST_CASE("TraceReader rejects bad files", "[analysis][TraceFile]")
+{
+    TempTrace file;
+
+    SECTION("Missing file")
+    {
+        REQUIRE(TraceReader::open(file.path()).error() == TraceError::kOpenFailed);
+    }
+
+    SECTION("Not a trace")
+    {
+        std::ofstream{file.path()} << "hello\nworld\n";
+        REQUIRE(TraceReader::open(file.path()).error() == TraceError::kParseError);
+    }
+
+    SECTION("Newer format version")
+    {
+        std::ofstream{file.path()} << "threveal-trace 99\nhost x\nclock none\np 0\ne 1\n"
+                                      "migrations 0\ndata\n";
+        REQUIRE(TraceReader::open(file.path()).error() == TraceError::kVersionMismatch);
+    }
+
+    SECTION("Truncated records")
+    {
+        std::vector<MigrationEvent> migrations = {makeMigration(1, 1), makeMigration(2, 2)};
+        REQUIRE(writeTrace(file.path(), makeHeader(), migrations).has_value());
+        fs::resize_file(file.path(), fs::file_size(file.path()) - 1);
+
+        auto reader = TraceReader::open(file.path());
+        REQUIRE(reader.has_value());
+
+        std::vector<MigrationEvent> batch(2);
+        REQUIRE(reader->read(batch).error() == TraceError::kReadFailed);
+    }
+}